@@ -4,9 +4,15 @@
 #include "framework.h"
 #include "10.Compute.h"
 #include "Renderer.h"
+#include "Benchmark.h"
+#include "CpuProfiler.h"
+#include "FrameInput.h"
 
 #include <windowsx.h>
 
+#include <atomic>
+#include <thread>
+
 extern LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 #define MAX_LOADSTRING 100
@@ -21,24 +27,92 @@ ATOM                MyRegisterClass(HINSTANCE hInstance);
 BOOL                InitInstance(HINSTANCE, int);
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 INT_PTR CALLBACK    About(HWND, UINT, WPARAM, LPARAM);
+void                HandleInput(HWND, UINT, WPARAM, LPARAM);
+bool                RunFrame(Benchmark*);
+void                RenderLoop(HWND, Benchmark*);
+void                SetModalLoop(HWND, bool);
+void                RunModalFrame(HWND);
 
 UINT                WindowWidth = 1280;
 UINT                WindowHeight = 720;
 
 Renderer* pRenderer = nullptr;
+Benchmark* pBenchmark = nullptr;
+bool UseFlipModel = true;
+bool BuildShaderCache = false; // Only compile all shaders into cache and exit
+int ShaderOptimization = -1; // Build configuration default if negative
+UINT TextureSkipMips = 0;
+bool UseVirtualTextures = false; // Tiled material textures, only tiles in view are resident
+bool UsePackedVertices = true;
+bool UseRenderThread = false; // Window thread only pumps messages, frames are updated, rendered and presented on a separate thread
+bool UseRawInput = false;
+bool RenderOnDemand = false; // Frames are skipped while nothing changes
+const DWORD IdleWakeMs = 250; // Background loads are checked that often while idle
+const UINT_PTR ModalFrameTimer = 1;
+bool InModalLoop = false; // Window drag, menu or dialog loop runs on window thread, frames are run from WM_PAINT meanwhile
+int AdapterIndex = -1; // Selected by GPU preference and video memory if negative
+std::wstring ScenePath; // Binary scene loaded at startup instead of generated instances
+std::wstring MeshPath; // OBJ mesh drawn as one of the instanced meshes
 
 bool PressedKeys[0xff] = {};
 
+HWND MainWindow = nullptr;
+FrameInput Input;
+std::thread RenderThread;
+std::atomic<bool> StopRendering(false);
+
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     _In_opt_ HINSTANCE hPrevInstance,
     _In_ LPWSTR    lpCmdLine,
     _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
     srand(12345);
 
+    Benchmark::Config benchmarkConfig;
+    bool runBenchmark = ParseBenchmarkArgs(lpCmdLine, benchmarkConfig);
+    UseFlipModel = wcsstr(lpCmdLine, L"-noflip") == nullptr;
+    BuildShaderCache = wcsstr(lpCmdLine, L"-buildShaderCache") != nullptr;
+    UsePackedVertices = wcsstr(lpCmdLine, L"-nopackedVertices") == nullptr;
+    UseRenderThread = wcsstr(lpCmdLine, L"-renderThread") != nullptr;
+    UseRawInput = wcsstr(lpCmdLine, L"-rawInput") != nullptr;
+    RenderOnDemand = wcsstr(lpCmdLine, L"-onDemand") != nullptr;
+    UseVirtualTextures = wcsstr(lpCmdLine, L"-virtualTextures") != nullptr;
+    if (wcsstr(lpCmdLine, L"-shaderDebug") != nullptr)
+    {
+        ShaderOptimization = ShaderCache::OptimizationDebug;
+    }
+    else if (wcsstr(lpCmdLine, L"-shaderRelease") != nullptr)
+    {
+        ShaderOptimization = ShaderCache::OptimizationRelease;
+    }
+    const wchar_t* pAdapter = wcsstr(lpCmdLine, L"-adapter ");
+    if (pAdapter != nullptr)
+    {
+        AdapterIndex = _wtoi(pAdapter + 9);
+    }
+    const wchar_t* pScene = wcsstr(lpCmdLine, L"-scene ");
+    if (pScene != nullptr)
+    {
+        const wchar_t* pPath = pScene + 7;
+        const wchar_t* pEnd = wcschr(pPath, L' ');
+        ScenePath = pEnd != nullptr ? std::wstring(pPath, pEnd) : std::wstring(pPath);
+    }
+    const wchar_t* pMesh = wcsstr(lpCmdLine, L"-mesh ");
+    if (pMesh != nullptr)
+    {
+        const wchar_t* pPath = pMesh + 6;
+        const wchar_t* pEnd = wcschr(pPath, L' ');
+        MeshPath = pEnd != nullptr ? std::wstring(pPath, pEnd) : std::wstring(pPath);
+    }
+    const wchar_t* pFps = wcsstr(lpCmdLine, L"-fps ");
+    const wchar_t* pSkipMips = wcsstr(lpCmdLine, L"-skipMips ");
+    if (pSkipMips != nullptr)
+    {
+        TextureSkipMips = (UINT)_wtoi(pSkipMips + 10);
+    }
+
     // TODO: Place code here.
 
     // Initialize global strings
@@ -61,41 +135,195 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     // Perform application initialization:
     if (!InitInstance(hInstance, nCmdShow))
     {
-        return FALSE;
+        // Non zero exit code fails build step
+        return BuildShaderCache ? 1 : FALSE;
+    }
+    if (BuildShaderCache)
+    {
+        // Every shader permutation is compiled during initialization
+        pRenderer->Term();
+        delete pRenderer;
+        return 0;
     }
 
     HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_MY10COMPUTE));
 
+    pBenchmark = runBenchmark ? new Benchmark(benchmarkConfig) : nullptr;
+    if (pFps != nullptr)
+    {
+        pRenderer->GetFramePacer().SetTargetFps((UINT)_wtoi(pFps + 5));
+    }
+
     MSG msg;
 
-    bool exit = false;
-    while (!exit)
+    if (UseRenderThread)
     {
-        if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        // Window drags and other modal loops block only this thread
+        RenderThread = std::thread(RenderLoop, MainWindow, pBenchmark);
+        while (GetMessage(&msg, nullptr, 0, 0))
         {
             if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
             {
                 TranslateMessage(&msg);
                 DispatchMessage(&msg);
             }
-            if (msg.message == WM_QUIT)
-            {
-                exit = true;
-            }
         }
-        //OutputDebugString(_T("Render\n"));
-        if (pRenderer->Update())
+        if (RenderThread.joinable())
+        {
+            StopRendering = true;
+            RenderThread.join();
+        }
+    }
+    else
+    {
+        bool exit = false;
+        while (!exit)
         {
-            pRenderer->Render();
+            if (pBenchmark == nullptr && !pRenderer->IsFrameNeeded())
+            {
+                // Sleep until a message arrives, messages already peeked at count too
+                MsgWaitForMultipleObjectsEx(0, nullptr, IdleWakeMs, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+                while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
+                    {
+                        TranslateMessage(&msg);
+                        DispatchMessage(&msg);
+                    }
+                    if (msg.message == WM_QUIT)
+                    {
+                        exit = true;
+                        break;
+                    }
+                }
+                continue;
+            }
+
+            CpuProfiler::Get().BeginFrame();
+
+            if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+            {
+                CPU_PROFILE_ZONE("Messages");
+                if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
+                {
+                    TranslateMessage(&msg);
+                    DispatchMessage(&msg);
+                }
+                if (msg.message == WM_QUIT)
+                {
+                    exit = true;
+                }
+            }
+            //OutputDebugString(_T("Render\n"));
+            if (!RunFrame(pBenchmark))
+            {
+                // Report is written, stop the application
+                break;
+            }
         }
     }
 
+    delete pBenchmark;
+    pBenchmark = nullptr;
+
     pRenderer->Term();
     delete pRenderer;
 
     return (int)msg.wParam;
 }
 
+// Returns false when benchmark is finished
+bool RunFrame(Benchmark* pBenchmark)
+{
+    if (pBenchmark != nullptr && !pBenchmark->BeginFrame(*pRenderer))
+    {
+        return false;
+    }
+    if (pRenderer->Update())
+    {
+        pRenderer->Render();
+    }
+    if (pBenchmark != nullptr)
+    {
+        pBenchmark->EndFrame(*pRenderer);
+    }
+    return true;
+}
+
+void RenderLoop(HWND hWnd, Benchmark* pBenchmark)
+{
+    while (!StopRendering)
+    {
+        if (pBenchmark == nullptr && !pRenderer->IsFrameNeeded())
+        {
+            Input.Wait(IdleWakeMs);
+            for (const FrameInput::Message& msg : Input.Swap())
+            {
+                HandleInput(msg.hWnd, msg.message, msg.wParam, msg.lParam);
+            }
+            continue;
+        }
+
+        CpuProfiler::Get().BeginFrame();
+
+        {
+            CPU_PROFILE_ZONE("Input");
+            for (const FrameInput::Message& msg : Input.Swap())
+            {
+                HandleInput(msg.hWnd, msg.message, msg.wParam, msg.lParam);
+            }
+        }
+
+        if (!RunFrame(pBenchmark))
+        {
+            // Report is written, window thread closes the application
+            PostMessage(hWnd, WM_CLOSE, 0, 0);
+            break;
+        }
+    }
+}
+
+// Modal loops of Windows don't return to the message loop until they end, so frames are run from the messages
+// they dispatch. Each frame invalidates the window for the next WM_PAINT, which comes as soon as the queue is empty,
+// and timer wakes the loop while nothing has to be rendered. Not needed with render thread, which is never blocked
+void SetModalLoop(HWND hWnd, bool modal)
+{
+    if (RenderThread.joinable() || pRenderer == nullptr || modal == InModalLoop)
+    {
+        return;
+    }
+
+    InModalLoop = modal;
+    if (modal)
+    {
+        SetTimer(hWnd, ModalFrameTimer, IdleWakeMs, nullptr);
+        InvalidateRect(hWnd, nullptr, FALSE);
+    }
+    else
+    {
+        KillTimer(hWnd, ModalFrameTimer);
+    }
+}
+
+void RunModalFrame(HWND hWnd)
+{
+    if (pBenchmark == nullptr && !pRenderer->IsFrameNeeded())
+    {
+        return;
+    }
+
+    CpuProfiler::Get().BeginFrame();
+
+    if (!RunFrame(pBenchmark))
+    {
+        // Report is written, main loop stops once the modal loop ends
+        SetModalLoop(hWnd, false);
+        PostMessage(hWnd, WM_CLOSE, 0, 0);
+        return;
+    }
+    InvalidateRect(hWnd, nullptr, FALSE);
+}
+
 
 
 //
@@ -146,13 +374,34 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
     {
         return FALSE;
     }
+    MainWindow = hWnd;
 
     pRenderer = new Renderer();
+    pRenderer->SetAdapterIndex(AdapterIndex);
+    pRenderer->SetFlipModel(UseFlipModel);
+    pRenderer->SetTextureSkipMips(TextureSkipMips);
+    pRenderer->SetVirtualTexturing(UseVirtualTextures);
+    pRenderer->SetPackedVertices(UsePackedVertices);
+    pRenderer->SetRawInput(UseRawInput);
+    pRenderer->SetRenderOnDemand(RenderOnDemand);
+    pRenderer->SetMeshPath(MeshPath);
+    if (ShaderOptimization >= 0)
+    {
+        pRenderer->SetShaderOptimization((ShaderCache::Optimization)ShaderOptimization);
+    }
     if (!pRenderer->Init(hWnd))
     {
         delete pRenderer;
         return FALSE;
     }
+    if (BuildShaderCache)
+    {
+        return TRUE;
+    }
+    if (!ScenePath.empty())
+    {
+        pRenderer->LoadScene(ScenePath);
+    }
 
     ShowWindow(hWnd, nCmdShow);
     UpdateWindow(hWnd);
@@ -185,9 +434,106 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 //
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
-    if (ImGui_ImplWin32_WndProcHandler(hWnd, message, wParam, lParam))
+    if (message == WM_ENTERSIZEMOVE || message == WM_EXITSIZEMOVE)
+    {
+        SetModalLoop(hWnd, message == WM_ENTERSIZEMOVE);
+    }
+
+    if (FrameInput::IsInputMessage(message))
+    {
+        if (RenderThread.joinable())
+        {
+            // Renderer and ImGui belong to the render thread, input is replayed there at the next frame start
+            Input.Push(hWnd, message, wParam, lParam);
+        }
+        else
+        {
+            HandleInput(hWnd, message, wParam, lParam);
+        }
+        return message == WM_SYSKEYDOWN || message == WM_SYSKEYUP ? DefWindowProc(hWnd, message, wParam, lParam) : 0;
+    }
+
+    // ImGui state is not touched from this thread while the render thread runs
+    if (!RenderThread.joinable() && ImGui_ImplWin32_WndProcHandler(hWnd, message, wParam, lParam))
         return true;
 
+    switch (message)
+    {
+    case WM_INPUT:
+        // Accumulated right away on this thread, and taken by renderer when the view is built
+        if (pRenderer != nullptr)
+        {
+            pRenderer->GetRawMouse().OnInput((HRAWINPUT)lParam);
+        }
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    case WM_ENTERMENULOOP:
+    case WM_EXITMENULOOP:
+        SetModalLoop(hWnd, message == WM_ENTERMENULOOP);
+        break;
+    case WM_TIMER:
+        if (wParam == ModalFrameTimer)
+        {
+            // Frame is run from WM_PAINT, after messages already queued
+            InvalidateRect(hWnd, nullptr, FALSE);
+            break;
+        }
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    case WM_PAINT:
+        if (InModalLoop)
+        {
+            ValidateRect(hWnd, nullptr);
+            RunModalFrame(hWnd);
+            break;
+        }
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    case WM_CLOSE:
+        if (RenderThread.joinable())
+        {
+            // Swap chain should not outlive the window it presents to
+            StopRendering = true;
+            RenderThread.join();
+        }
+        DestroyWindow(hWnd);
+        break;
+    case WM_COMMAND:
+    {
+        int wmId = LOWORD(wParam);
+        // Parse the menu selections:
+        switch (wmId)
+        {
+        case IDM_ABOUT:
+            SetModalLoop(hWnd, true);
+            DialogBox(hInst, MAKEINTRESOURCE(IDD_ABOUTBOX), hWnd, About);
+            SetModalLoop(hWnd, false);
+            break;
+        case IDM_EXIT:
+            SendMessage(hWnd, WM_CLOSE, 0, 0);
+            break;
+        default:
+            return DefWindowProc(hWnd, message, wParam, lParam);
+        }
+    }
+    break;
+    case WM_DESTROY:
+        PostQuitMessage(0);
+        break;
+    default:
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    }
+    return 0;
+}
+
+// Input of the frame, called on the thread which owns the renderer
+void HandleInput(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    if (pRenderer != nullptr)
+    {
+        pRenderer->Invalidate();
+    }
+
+    if (ImGui_ImplWin32_WndProcHandler(hWnd, message, wParam, lParam))
+        return;
+
     switch (message)
     {
     case WM_SIZE:
@@ -198,6 +544,13 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             pRenderer->Resize(rc.right - rc.left, rc.bottom - rc.top);
         }
         break;
+    case WM_ENTERSIZEMOVE:
+    case WM_EXITSIZEMOVE:
+        if (pRenderer != nullptr)
+        {
+            pRenderer->SetSizeMove(message == WM_ENTERSIZEMOVE);
+        }
+        break;
     case WM_RBUTTONDOWN:
         if (pRenderer != nullptr)
         {
@@ -247,31 +600,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             PressedKeys[wParam] = false;
         }
         break;
-
-    case WM_COMMAND:
-    {
-        int wmId = LOWORD(wParam);
-        // Parse the menu selections:
-        switch (wmId)
-        {
-        case IDM_ABOUT:
-            DialogBox(hInst, MAKEINTRESOURCE(IDD_ABOUTBOX), hWnd, About);
-            break;
-        case IDM_EXIT:
-            DestroyWindow(hWnd);
-            break;
-        default:
-            return DefWindowProc(hWnd, message, wParam, lParam);
-        }
-    }
-    break;
-    case WM_DESTROY:
-        PostQuitMessage(0);
-        break;
-    default:
-        return DefWindowProc(hWnd, message, wParam, lParam);
     }
-    return 0;
 }
 
 // Message handler for about box.
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../Math/Point.h"
+
+#include <algorithm>
+#include <limits>
+
+// Layout matches the AABB structured buffer element in CullCommon.h
+struct AABB
+{
+    Point3f vmin = Point3f{
+        std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()
+    };
+    Point3f vmax = Point3f{
+        std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()
+    };
+
+    inline Point3f GetVert(int idx) const
+    {
+        return Point3f
+        {
+            (idx & 1) == 0 ? vmin.x : vmax.x,
+            (idx & 2) == 0 ? vmin.y : vmax.y,
+            (idx & 4) == 0 ? vmin.z : vmax.z
+        };
+    }
+
+    inline void Add(const AABB& bb)
+    {
+        vmin = Point3f{ std::min(vmin.x, bb.vmin.x), std::min(vmin.y, bb.vmin.y), std::min(vmin.z, bb.vmin.z) };
+        vmax = Point3f{ std::max(vmax.x, bb.vmax.x), std::max(vmax.y, bb.vmax.y), std::max(vmax.z, bb.vmax.z) };
+    }
+};
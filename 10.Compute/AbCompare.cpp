@@ -0,0 +1,140 @@
+#include "framework.h"
+
+#include "AbCompare.h"
+
+#include <algorithm>
+#include <math.h>
+
+static const char* ToggleNames[AbCompare::ToggleCount] = { "Cull", "Cull on GPU", "Normal maps", "Sepia" };
+
+// Two-sided 95% quantiles of Student's t by degrees of freedom
+static const float StudentT95[] =
+{
+    12.706f, 4.303f, 3.182f, 2.776f, 2.571f, 2.447f, 2.365f, 2.306f, 2.262f, 2.228f,
+    2.201f, 2.179f, 2.160f, 2.145f, 2.131f, 2.120f, 2.110f, 2.101f, 2.093f, 2.086f,
+    2.080f, 2.074f, 2.069f, 2.064f, 2.060f, 2.056f, 2.052f, 2.048f, 2.045f, 2.042f
+};
+
+const char* AbCompare::GetToggleName(UINT toggle)
+{
+    return toggle < ToggleCount ? ToggleNames[toggle] : "";
+}
+
+void AbCompare::Start(const Settings& settings)
+{
+    m_settings = settings;
+    m_settings.blockFrames = std::max(m_settings.blockFrames, 1u);
+    m_settings.pairs = std::max(m_settings.pairs, 2u); // Interval needs at least two pairs
+    // Time of the first frame of a block spans the switch
+    m_settings.settleFrames = std::max(m_settings.settleFrames, 1u);
+
+    m_cpuSums.assign(m_settings.pairs * 2, 0.0f);
+    m_gpuSums.assign(m_settings.pairs * 2, 0.0f);
+    m_frame = 0;
+    m_prevTicks = 0;
+    m_running = true;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_msPerTick = 1000.0 / frequency.QuadPart;
+}
+
+UINT AbCompare::GetConfig(UINT block) const
+{
+    // A B, then B A
+    UINT pair = block / 2;
+    return (block % 2) ^ (pair % 2);
+}
+
+UINT AbCompare::GetToggles() const
+{
+    UINT block = m_frame / (m_settings.settleFrames + m_settings.blockFrames);
+    return m_settings.toggles[GetConfig(block)];
+}
+
+float AbCompare::GetPathPos() const
+{
+    UINT blockLength = m_settings.settleFrames + m_settings.blockFrames;
+    UINT pair = m_frame / (blockLength * 2);
+    UINT blockFrame = m_frame % blockLength;
+    // Camera waits at segment start while block settles
+    UINT measured = blockFrame > m_settings.settleFrames ? blockFrame - m_settings.settleFrames : 0;
+
+    return (float)(pair * m_settings.blockFrames + measured) / (m_settings.pairs * m_settings.blockFrames);
+}
+
+float AbCompare::GetProgress() const
+{
+    UINT total = (m_settings.settleFrames + m_settings.blockFrames) * 2 * m_settings.pairs;
+    return m_running ? (float)m_frame / total : (m_hasResult ? 1.0f : 0.0f);
+}
+
+bool AbCompare::AddFrame(float gpuMs)
+{
+    if (!m_running)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    float frameMs = (float)((ticks.QuadPart - m_prevTicks) * m_msPerTick);
+    m_prevTicks = ticks.QuadPart;
+
+    UINT blockLength = m_settings.settleFrames + m_settings.blockFrames;
+    UINT block = m_frame / blockLength;
+    if (m_frame % blockLength >= m_settings.settleFrames)
+    {
+        UINT idx = (block / 2) * 2 + GetConfig(block);
+        m_cpuSums[idx] += frameMs;
+        m_gpuSums[idx] += gpuMs;
+    }
+
+    if (++m_frame == blockLength * 2 * m_settings.pairs)
+    {
+        Finish();
+        return true;
+    }
+
+    return false;
+}
+
+AbCompare::Delta AbCompare::GetDelta(const std::vector<float>& sums, UINT pairs, UINT frames)
+{
+    Delta delta = {};
+    double diffSum = 0.0;
+    for (UINT i = 0; i < pairs; i++)
+    {
+        delta.meanMs[0] += sums[i * 2] / frames;
+        delta.meanMs[1] += sums[i * 2 + 1] / frames;
+        diffSum += (sums[i * 2 + 1] - sums[i * 2]) / frames;
+    }
+    delta.meanMs[0] /= pairs;
+    delta.meanMs[1] /= pairs;
+    delta.deltaMs = (float)(diffSum / pairs);
+
+    double variance = 0.0;
+    for (UINT i = 0; i < pairs; i++)
+    {
+        double d = (sums[i * 2 + 1] - sums[i * 2]) / frames - delta.deltaMs;
+        variance += d * d;
+    }
+    variance /= pairs - 1;
+
+    UINT dof = pairs - 1;
+    float t = dof <= ARRAYSIZE(StudentT95) ? StudentT95[dof - 1] : 1.96f;
+    delta.ciMs = (float)(t * sqrt(variance / pairs));
+
+    return delta;
+}
+
+void AbCompare::Finish()
+{
+    m_running = false;
+
+    m_result.pairs = m_settings.pairs;
+    m_result.frames = m_settings.blockFrames * m_settings.pairs;
+    m_result.cpu = GetDelta(m_cpuSums, m_settings.pairs, m_settings.blockFrames);
+    m_result.gpu = GetDelta(m_gpuSums, m_settings.pairs, m_settings.blockFrames);
+    m_hasResult = true;
+}
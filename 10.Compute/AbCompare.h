@@ -0,0 +1,99 @@
+#pragma once
+
+#include <windows.h>
+
+#include <vector>
+
+/**
+ * A/B comparison of two sets of feature toggles.
+ * Configurations alternate in blocks of frames, in A B B A order so slow drift of clocks and temperature cancels out.
+ * Both blocks of a pair follow the same camera path segment, the first frames of each block are skipped
+ * until toggles settle and GPU timings, which are several frames old, belong to the block.
+ * Delta is the mean of per pair differences, with 95% confidence interval of Student's t over pairs,
+ * as frames inside a block are correlated and pairs are not.
+ */
+class AbCompare
+{
+public:
+    enum Toggle
+    {
+        ToggleCull = 1 << 0,
+        ToggleGpuCull = 1 << 1,
+        ToggleNormalMaps = 1 << 2,
+        ToggleSepia = 1 << 3,
+
+        ToggleCount = 4
+    };
+
+    struct Settings
+    {
+        UINT toggles[2];   ///< Toggle flags of A and B
+        UINT blockFrames;  ///< Measured frames per block
+        UINT settleFrames; ///< Skipped frames at the start of each block
+        UINT pairs;        ///< A and B blocks each
+    };
+
+    struct Delta
+    {
+        float meanMs[2]; // A and B
+        float deltaMs;   // B - A
+        float ciMs;      // Half width of 95% interval
+    };
+
+    struct Result
+    {
+        UINT pairs;
+        UINT frames; // Measured per configuration
+        Delta cpu;   // Frame time
+        Delta gpu;   // Sum of GPU profiler top level scopes
+    };
+
+    AbCompare()
+        : m_settings{ { 0, 0 }, 60, 8, 8 }
+        , m_running(false)
+        , m_hasResult(false)
+        , m_frame(0)
+        , m_prevTicks(0)
+        , m_msPerTick(0.0)
+        , m_result{}
+    {}
+
+    static const char* GetToggleName(UINT toggle);
+
+    void Start(const Settings& settings);
+    void Stop() { m_running = false; }
+    inline bool IsRunning() const { return m_running; }
+
+    /** Toggle flags the next frame should be rendered with */
+    UINT GetToggles() const;
+    /** Camera path position of the next frame in [0, 1), the same for matched frames of A and B */
+    float GetPathPos() const;
+    /** Progress of the whole comparison in [0, 1] */
+    float GetProgress() const;
+
+    /** Add samples of the rendered frame, frame time is measured between calls. Returns true on completion */
+    bool AddFrame(float gpuMs);
+
+    inline bool HasResult() const { return m_hasResult; }
+    inline const Result& GetResult() const { return m_result; }
+
+private:
+    /** Configuration of block, 0 for A and 1 for B */
+    UINT GetConfig(UINT block) const;
+    void Finish();
+    static Delta GetDelta(const std::vector<float>& sums, UINT pairs, UINT frames);
+
+private:
+    Settings m_settings;
+    bool m_running;
+    bool m_hasResult;
+    UINT m_frame; // Since start, including skipped ones
+    INT64 m_prevTicks;
+    double m_msPerTick;
+
+    // Per pair and configuration sums of measured frames, index is pair * 2 + config
+    std::vector<float> m_cpuSums;
+    std::vector<float> m_gpuSums;
+
+    Result m_result;
+};
@@ -0,0 +1,37 @@
+#include "GeomBuffer.h"
+
+cbuffer AnimateParams : register(b0)
+{
+    float4 deltaTime; // x - time since last update in seconds, y - offset of rendered time from simulated one
+    uint4 numShapes; // x - objects count
+};
+
+RWStructuredBuffer<GeomBuffer> geomBuffer : register(u0);
+
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (globalThreadId.x >= numShapes.x)
+    {
+        return;
+    }
+
+    GeomBuffer geom = geomBuffer[globalThreadId.x];
+    if (abs(geom.speed) <= 0.0001)
+    {
+        return;
+    }
+
+    geom.angle = geom.angle + deltaTime.x * geom.speed;
+
+    // Same as Renderer::UpdateGeomMatrices - rotation around Y by -angle followed by translation
+    float s, c;
+    sincos(geom.angle + geom.speed * deltaTime.y, s, c);
+    float3 t = GetPosition(geom);
+
+    geom.model[0] = float4(c, 0, -s, t.x);
+    geom.model[1] = float4(0, 1, 0, t.y);
+    geom.model[2] = float4(s, 0, c, t.z);
+
+    geomBuffer[globalThreadId.x] = geom;
+}
@@ -0,0 +1,72 @@
+cbuffer ProcessParams : register(b0)
+{
+    uint4 sizes; // xy - source size, zw - block count
+};
+
+Texture2D<float4> src : register(t0);
+RWTexture2D<uint2> dst : register(u0); // x - endpoints, y - indices
+
+uint PackColor(float3 color)
+{
+    uint3 c = (uint3)round(saturate(color) * float3(31, 63, 31));
+    return (c.r << 11) | (c.g << 5) | c.b;
+}
+
+float3 UnpackColor(uint color)
+{
+    return float3((color >> 11) & 31, (color >> 5) & 63, color & 31) / float3(31, 63, 31);
+}
+
+// One block per thread, endpoints are bounding box of block colors
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (any(globalThreadId.xy >= sizes.zw))
+    {
+        return;
+    }
+
+    // Mips smaller than block repeat edge texels
+    float3 colors[16];
+    float3 minColor = float3(1, 1, 1);
+    float3 maxColor = float3(0, 0, 0);
+    for (uint i = 0; i < 16; i++)
+    {
+        uint2 pos = min(globalThreadId.xy * 4 + uint2(i % 4, i / 4), sizes.xy - 1);
+        colors[i] = src.Load(int3(pos, 0)).rgb;
+        minColor = min(minColor, colors[i]);
+        maxColor = max(maxColor, colors[i]);
+    }
+
+    // Inset bounding box a bit, as extremes are rarely used
+    float3 inset = (maxColor - minColor) / 16.0;
+    uint c0 = PackColor(maxColor - inset);
+    uint c1 = PackColor(minColor + inset);
+
+    // Four color mode requires c0 > c1, equal endpoints give solid block
+    if (c0 < c1)
+    {
+        uint c = c0;
+        c0 = c1;
+        c1 = c;
+    }
+
+    uint indices = 0;
+    if (c0 != c1)
+    {
+        // Palette order is c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+        static const uint Remap[4] = { 1, 3, 2, 0 };
+
+        float3 e0 = UnpackColor(c0);
+        float3 e1 = UnpackColor(c1);
+        float3 dir = e0 - e1;
+        float invLenSqr = 1.0 / dot(dir, dir);
+        for (uint i = 0; i < 16; i++)
+        {
+            uint level = (uint)round(saturate(dot(colors[i] - e1, dir) * invLenSqr) * 3.0);
+            indices |= Remap[level] << (i * 2);
+        }
+    }
+
+    dst[globalThreadId.xy] = uint2(c0 | (c1 << 16), indices);
+}
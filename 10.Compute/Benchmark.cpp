@@ -0,0 +1,429 @@
+#include "framework.h"
+
+#include "Benchmark.h"
+#include "Renderer.h"
+
+#include <shellapi.h>
+
+#include <algorithm>
+#include <stdio.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+static const char* FeatureNames[] = { "normalmaps", "gpucull", "sepia", "hdr" };
+static const char* DepthFormatNames[Renderer::DepthFormatCount] = { "d32", "d24", "d16" };
+
+Benchmark::Benchmark(const Config& config)
+    : m_config(config)
+    , m_configIdx(0)
+    , m_frame(0)
+    , m_prevTicks(0)
+    , m_frequency(1)
+{
+    std::vector<UINT> lightCounts = m_config.lightCounts.empty() ? std::vector<UINT>{ 0 } : m_config.lightCounts;
+    std::vector<Resolution> resolutions = m_config.resolutions.empty() ? std::vector<Resolution>{ { 0, 0 } } : m_config.resolutions;
+    std::vector<UINT> depthFormats = m_config.depthFormats.empty() ? std::vector<UINT>{ 0 } : m_config.depthFormats;
+
+    // Instance count is the innermost loop, so each row of sweep table is a contiguous range of runs
+    for (const Resolution& resolution : resolutions)
+    {
+        for (UINT features = 0; features <= FeatureAll; features++)
+        {
+            if ((features & ~m_config.sweepFeatures) != 0)
+            {
+                continue;
+            }
+            for (UINT depthFormat : depthFormats)
+            {
+                for (UINT lights : lightCounts)
+                {
+                    for (UINT instances : m_config.instanceCounts)
+                    {
+                        m_runs.push_back({ instances, lights, resolution, features, depthFormat });
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool Benchmark::BeginFrame(Renderer& renderer)
+{
+    if (m_configIdx >= m_runs.size())
+    {
+        return false;
+    }
+
+    if (m_frame == 0)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        m_frequency = frequency.QuadPart;
+
+        renderer.SetShowUI(false);
+        renderer.SetFixedDeltaSec(1.0 / 60.0);
+        const Run& run = m_runs[m_configIdx];
+        renderer.ResetInstances(run.instances, m_config.seed);
+        if (!m_config.lightCounts.empty())
+        {
+            renderer.SetLightCount(run.lights, m_config.seed);
+        }
+        if (!m_config.resolutions.empty())
+        {
+            renderer.SetInternalResolution(run.resolution.width, run.resolution.height);
+        }
+        if ((m_config.sweepFeatures & FeatureNormalMaps) != 0)
+        {
+            renderer.SetUseNormalMaps((run.features & FeatureNormalMaps) != 0);
+        }
+        if ((m_config.sweepFeatures & FeatureGpuCull) != 0)
+        {
+            renderer.SetComputeCull((run.features & FeatureGpuCull) != 0);
+        }
+        if ((m_config.sweepFeatures & FeatureSepia) != 0)
+        {
+            renderer.SetSepia((run.features & FeatureSepia) != 0);
+        }
+        if ((m_config.sweepFeatures & FeatureHdrColor) != 0)
+        {
+            renderer.SetColorFormat((run.features & FeatureHdrColor) != 0 ? Renderer::ColorFormatR11G11B10 : Renderer::ColorFormatRGBA8);
+        }
+        if (!m_config.depthFormats.empty())
+        {
+            renderer.SetDepthFormat((Renderer::DepthFormat)run.depthFormat);
+        }
+        if (!m_config.captureDir.empty())
+        {
+            renderer.GetFrameCapture().SetDirectory(m_config.captureDir);
+        }
+
+        Result result;
+        result.instances = run.instances;
+        result.visibleSum = 0.0;
+        result.frameMs.reserve(m_config.frames);
+        m_results.push_back(result);
+    }
+    if (m_frame == m_config.warmupFrames)
+    {
+        renderer.GetGpuProfiler().ResetHistory();
+    }
+    if (m_frame >= m_config.warmupFrames && !m_config.captureDir.empty())
+    {
+        char name[32];
+        if (m_config.sweep)
+        {
+            sprintf_s(name, "%u_%u_%06u", m_configIdx, m_runs[m_configIdx].instances, m_frame - m_config.warmupFrames);
+        }
+        else
+        {
+            sprintf_s(name, "%u_%06u", m_runs[m_configIdx].instances, m_frame - m_config.warmupFrames);
+        }
+        renderer.RequestCapture(name);
+    }
+
+    // Full orbit around the instances during measured frames
+    float t = m_frame < m_config.warmupFrames ? 0.0f : (float)(m_frame - m_config.warmupFrames) / m_config.frames;
+    renderer.SetCamera(Point3f{ 0, 0, 0 }, 8.0f + 4.0f * sinf(t * 4.0f * (float)M_PI), -(float)M_PI / 4 + t * 2.0f * (float)M_PI, (float)M_PI / 8);
+
+    return true;
+}
+
+void Benchmark::EndFrame(Renderer& renderer)
+{
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+
+    Result& result = m_results.back();
+    if (m_frame >= m_config.warmupFrames)
+    {
+        result.frameMs.push_back((float)((ticks.QuadPart - m_prevTicks) * 1000.0 / m_frequency));
+        result.visibleSum += renderer.GetVisibleInstances();
+    }
+    m_prevTicks = ticks.QuadPart;
+
+    if (++m_frame == m_config.warmupFrames + m_config.frames)
+    {
+        FrameVector<GpuProfiler::PassTime> gpuTimes = renderer.GetGpuProfiler().GetAverageTimes();
+        result.gpuTimes.assign(gpuTimes.begin(), gpuTimes.end());
+
+        m_frame = 0;
+        ++m_configIdx;
+        if (m_configIdx == m_runs.size())
+        {
+            SaveReport();
+            if (m_config.sweep)
+            {
+                SaveSweepTable();
+            }
+        }
+    }
+}
+
+float Benchmark::Percentile(const std::vector<float>& sorted, float p)
+{
+    if (sorted.empty())
+    {
+        return 0.0f;
+    }
+    // Nearest rank
+    size_t rank = (size_t)ceilf(p * sorted.size());
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+float Benchmark::FramePercentile(const Result& result, float p)
+{
+    std::vector<float> sorted = result.frameMs;
+    std::sort(sorted.begin(), sorted.end());
+    return Percentile(sorted, p);
+}
+
+std::string Benchmark::GetRowName(const Run& run) const
+{
+    char name[64];
+    if (run.resolution.width > 0)
+    {
+        sprintf_s(name, "%ux%u,", run.resolution.width, run.resolution.height);
+    }
+    else
+    {
+        sprintf_s(name, "window,");
+    }
+    std::string row = name;
+
+    std::string features;
+    for (UINT i = 0; i < _countof(FeatureNames); i++)
+    {
+        if ((run.features & (1u << i)) != 0)
+        {
+            features += (features.empty() ? "" : "+") + std::string(FeatureNames[i]);
+        }
+    }
+    row += features.empty() ? "none" : features;
+
+    row += ",";
+    row += m_config.depthFormats.empty() ? "default" : DepthFormatNames[run.depthFormat];
+
+    if (!m_config.lightCounts.empty())
+    {
+        sprintf_s(name, ",%u", run.lights);
+        row += name;
+    }
+    else
+    {
+        row += ",default";
+    }
+
+    return row;
+}
+
+bool Benchmark::SaveSweepTable() const
+{
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, m_config.csvPath.c_str(), "w") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+    // Frame time p95 in ms, knee is the largest instance count before the first one over budget
+    fprintf(pFile, "resolution,features,depth,lights");
+    for (UINT instances : m_config.instanceCounts)
+    {
+        fprintf(pFile, ",%u", instances);
+    }
+    fprintf(pFile, ",knee at %.1f ms\n", m_config.budgetMs);
+
+    const size_t rowSize = m_config.instanceCounts.size();
+    for (size_t row = 0; row + rowSize <= m_results.size(); row += rowSize)
+    {
+        fprintf(pFile, "%s", GetRowName(m_runs[row]).c_str());
+
+        UINT knee = 0;
+        bool overBudget = false;
+        for (size_t i = row; i < row + rowSize; i++)
+        {
+            float ms = FramePercentile(m_results[i], 0.95f);
+            fprintf(pFile, ",%.3f", ms);
+
+            overBudget = overBudget || ms > m_config.budgetMs;
+            knee = overBudget ? knee : m_results[i].instances;
+        }
+        fprintf(pFile, ",%u\n", knee);
+    }
+
+    fclose(pFile);
+
+    return true;
+}
+
+bool Benchmark::SaveReport() const
+{
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, m_config.reportPath.c_str(), "w") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+    fprintf(pFile, "{\n  \"seed\": %u,\n  \"frames\": %u,\n  \"results\": [\n", m_config.seed, m_config.frames);
+    for (size_t i = 0; i < m_results.size(); i++)
+    {
+        const Result& result = m_results[i];
+
+        std::vector<float> sorted = result.frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (float ms : sorted)
+        {
+            sum += ms;
+        }
+        size_t count = std::max(sorted.size(), (size_t)1);
+
+        fprintf(pFile, "    {\n      \"instances\": %u,\n", result.instances);
+        if (m_config.sweep)
+        {
+            fprintf(pFile, "      \"run\": \"%s\",\n", GetRowName(m_runs[i]).c_str());
+        }
+        fprintf(pFile, "      \"frameMs\": { \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+            sum / count, Percentile(sorted, 0.5f), Percentile(sorted, 0.95f), Percentile(sorted, 0.99f), sorted.empty() ? 0.0f : sorted.back());
+        fprintf(pFile, "      \"visibleAvg\": %.1f,\n", result.visibleSum / count);
+        fprintf(pFile, "      \"gpuMs\": {");
+        for (size_t j = 0; j < result.gpuTimes.size(); j++)
+        {
+            fprintf(pFile, "%s \"%s\": %.4f", j == 0 ? "" : ",", result.gpuTimes[j].name, result.gpuTimes[j].avgMs);
+        }
+        fprintf(pFile, " }\n    }%s\n", i + 1 < m_results.size() ? "," : "");
+    }
+    fprintf(pFile, "  ]\n}\n");
+
+    fclose(pFile);
+
+    return true;
+}
+
+/** Comma separated numbers, smaller than minValue are skipped */
+static std::vector<UINT> ParseList(const wchar_t* pList, UINT minValue)
+{
+    std::vector<UINT> values;
+    while (*pList != 0)
+    {
+        wchar_t* pEnd = nullptr;
+        UINT value = (UINT)wcstoul(pList, &pEnd, 10);
+        if (pEnd != pList && value >= minValue)
+        {
+            values.push_back(value);
+        }
+        pList = *pEnd != 0 ? pEnd + 1 : pEnd; // Skip separator
+    }
+    return values;
+}
+
+bool ParseBenchmarkArgs(const wchar_t* pCmdLine, Benchmark::Config& config)
+{
+    if (pCmdLine == nullptr || *pCmdLine == 0)
+    {
+        return false;
+    }
+
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(pCmdLine, &argc);
+    if (argv == nullptr)
+    {
+        return false;
+    }
+
+    bool benchmark = false;
+    for (int i = 0; i < argc; i++)
+    {
+        if (wcscmp(argv[i], L"-benchmark") == 0)
+        {
+            benchmark = true;
+        }
+        else if (wcscmp(argv[i], L"-frames") == 0 && i + 1 < argc)
+        {
+            config.frames = std::max((UINT)_wtoi(argv[++i]), 1u);
+        }
+        else if (wcscmp(argv[i], L"-report") == 0 && i + 1 < argc)
+        {
+            std::wstring path = argv[++i];
+            config.reportPath = std::string(path.begin(), path.end());
+        }
+        else if (wcscmp(argv[i], L"-capture") == 0 && i + 1 < argc)
+        {
+            std::wstring path = argv[++i];
+            config.captureDir = std::string(path.begin(), path.end());
+        }
+        else if (wcscmp(argv[i], L"-counts") == 0 && i + 1 < argc)
+        {
+            config.instanceCounts = ParseList(argv[++i], 1);
+        }
+        else if (wcscmp(argv[i], L"-sweep") == 0)
+        {
+            config.sweep = true;
+        }
+        else if (wcscmp(argv[i], L"-lights") == 0 && i + 1 < argc)
+        {
+            // Zero lights is a valid point of the sweep
+            config.lightCounts = ParseList(argv[++i], 0);
+        }
+        else if (wcscmp(argv[i], L"-resolutions") == 0 && i + 1 < argc)
+        {
+            config.resolutions.clear();
+            wchar_t* pSizes = argv[++i];
+            while (*pSizes != 0)
+            {
+                wchar_t* pEnd = nullptr;
+                UINT width = (UINT)wcstoul(pSizes, &pEnd, 10);
+                UINT height = *pEnd == L'x' ? (UINT)wcstoul(pEnd + 1, &pEnd, 10) : 0;
+                if (width > 0 && height > 0)
+                {
+                    config.resolutions.push_back({ width, height });
+                }
+                pSizes = *pEnd != 0 ? pEnd + 1 : pEnd; // Skip separator
+            }
+        }
+        else if (wcscmp(argv[i], L"-toggles") == 0 && i + 1 < argc)
+        {
+            std::wstring toggles = argv[++i];
+            for (UINT j = 0; j < _countof(FeatureNames); j++)
+            {
+                std::string name = FeatureNames[j];
+                if (toggles.find(std::wstring(name.begin(), name.end())) != std::wstring::npos)
+                {
+                    config.sweepFeatures |= 1u << j;
+                }
+            }
+        }
+        else if (wcscmp(argv[i], L"-depths") == 0 && i + 1 < argc)
+        {
+            // Formats are run in the order they are given
+            config.depthFormats.clear();
+            wchar_t* pFormats = argv[++i];
+            while (*pFormats != 0)
+            {
+                for (UINT j = 0; j < _countof(DepthFormatNames); j++)
+                {
+                    std::string name = DepthFormatNames[j];
+                    if (wcsncmp(pFormats, std::wstring(name.begin(), name.end()).c_str(), name.size()) == 0)
+                    {
+                        config.depthFormats.push_back(j);
+                    }
+                }
+                wchar_t* pEnd = wcschr(pFormats, L',');
+                pFormats = pEnd != nullptr ? pEnd + 1 : pFormats + wcslen(pFormats);
+            }
+        }
+        else if (wcscmp(argv[i], L"-budget") == 0 && i + 1 < argc)
+        {
+            config.budgetMs = std::max((float)_wtof(argv[++i]), 0.1f);
+        }
+        else if (wcscmp(argv[i], L"-csv") == 0 && i + 1 < argc)
+        {
+            std::wstring path = argv[++i];
+            config.csvPath = std::string(path.begin(), path.end());
+        }
+    }
+
+    LocalFree(argv);
+
+    return (benchmark || config.sweep) && !config.instanceCounts.empty();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "GpuProfiler.h"
+
+class Renderer;
+
+/**
+ * Deterministic benchmark driving the renderer instead of user input.
+ * Each instance count is rendered for a fixed number of frames along a scripted camera orbit,
+ * results are written as JSON report.
+ * Sweep mode runs every combination of resolution, feature toggles, depth format, light count and instance count,
+ * and writes a CSV table of frame time with the largest instance count within frame budget for each row.
+ */
+class Benchmark
+{
+public:
+    enum Feature
+    {
+        FeatureNormalMaps = 1 << 0,
+        FeatureGpuCull = 1 << 1,
+        FeatureSepia = 1 << 2,
+        FeatureHdrColor = 1 << 3, ///< R11G11B10 float color buffer instead of RGBA8
+
+        FeatureAll = FeatureNormalMaps | FeatureGpuCull | FeatureSepia | FeatureHdrColor
+    };
+
+    struct Resolution
+    {
+        UINT width;
+        UINT height;
+    };
+
+    struct Config
+    {
+        std::vector<UINT> instanceCounts = { 100, 1000, 10000, 100000 };
+        UINT warmupFrames = 60;         ///< Frames skipped before measurement, covers GPU query latency
+        UINT frames = 600;              ///< Measured frames per instance count
+        unsigned int seed = 12345;
+        std::string reportPath = "benchmark.json";
+        std::string captureDir;         ///< Measured frames are written as images here, empty - no capture
+
+        bool sweep = false;
+        std::vector<UINT> lightCounts;      ///< Empty - lights are not changed
+        std::vector<Resolution> resolutions; ///< Internal resolutions, empty - window size
+        std::vector<UINT> depthFormats;     ///< Renderer::DepthFormat values, empty - format is not changed
+        UINT sweepFeatures = 0;             ///< Feature flags toggled on and off, other features keep their settings
+        float budgetMs = 16.7f;             ///< Frame time p95 the knee is searched for
+        std::string csvPath = "sweep.csv";
+    };
+
+    Benchmark(const Config& config);
+
+    /** Setup renderer for the next frame, false when benchmark is finished */
+    bool BeginFrame(Renderer& renderer);
+    void EndFrame(Renderer& renderer);
+
+    bool SaveReport() const;
+
+    bool SaveSweepTable() const;
+
+private:
+    /** Settings of one measured run */
+    struct Run
+    {
+        UINT instances;
+        UINT lights;     ///< Valid if lightCounts are given
+        Resolution resolution;
+        UINT features;   ///< Set flags of sweepFeatures
+        UINT depthFormat; ///< Valid if depthFormats are given
+    };
+
+    struct Result
+    {
+        UINT instances;
+        std::vector<float> frameMs;
+        double visibleSum;
+        std::vector<GpuProfiler::PassTime> gpuTimes;
+    };
+
+    static float Percentile(const std::vector<float>& sorted, float p);
+    static float FramePercentile(const Result& result, float p);
+    /** Row of sweep table, runs of a row differ only in instance count */
+    std::string GetRowName(const Run& run) const;
+
+    Config m_config;
+    std::vector<Run> m_runs;
+    std::vector<Result> m_results;
+    UINT m_configIdx;
+    UINT m_frame;
+    INT64 m_prevTicks;
+    INT64 m_frequency;
+};
+
+/**
+ * Parse -benchmark [-frames N] [-report path] [-counts a,b,c] [-capture dir] options and
+ * -sweep [-lights a,b,c] [-resolutions WxH,WxH] [-toggles normalmaps,gpucull,sepia,hdr] [-depths d32,d24,d16] [-budget ms] [-csv path] ones,
+ * false if neither benchmark nor sweep is requested
+ */
+bool ParseBenchmarkArgs(const wchar_t* pCmdLine, Benchmark::Config& config);
@@ -0,0 +1,137 @@
+#include "SceneCB.h"
+#include "CullCommon.h"
+
+cbuffer SortParams : register(b1)
+{
+    uint4 sortParams; // x - padded power of two key count, y - bitonic block size, z - compare distance or object count of CULL_TRANSPARENT, w - mesh LOD draw
+};
+
+StructuredBuffer<AABB> bounds : register(t0);
+
+RWBuffer<uint> indirectArgs : register(u0); // Visible count of mesh is instanceCount of its DrawIndexedIndirect
+RWStructuredBuffer<uint> objectIds : register(u1);
+RWStructuredBuffer<uint2> keys : register(u2); // x - squared distance or inverted view depth bits, y - instance id
+
+static const uint LocalSize = 1024; // Keys sorted in group shared memory, should match Renderer::SortLocalSize
+
+// Ids make the order strict, so the result is deterministic
+bool Less(in uint2 a, in uint2 b)
+{
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+#if defined(SORT_KEYS)
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint i = globalThreadId.x;
+    if (i >= sortParams.x)
+    {
+        return;
+    }
+
+    // Padding keys go to the end
+    uint2 key = uint2(0xFFFFFFFF, 0xFFFFFFFF);
+    if (i < indirectArgs[sortParams.w * ArgsStride + 1])
+    {
+        uint id = objectIds[sortParams.w * MeshSegmentSize + i];
+        AABB bb = bounds[id];
+        float3 d = (bb.bbMin + bb.bbMax) * 0.5 - cameraPos.xyz;
+        key = uint2(asuint(dot(d, d)), id);
+    }
+    keys[i] = key;
+}
+#elif defined(CULL_TRANSPARENT)
+// Transparent objects are culled without compaction, as sort moves hidden ones to the end.
+// Keys of positive floats keep their order as uints, so inverted depth sorts back to front
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint i = globalThreadId.x;
+    if (i >= sortParams.x)
+    {
+        return;
+    }
+
+    uint2 key = uint2(0xFFFFFFFF, 0xFFFFFFFF);
+    if (i < sortParams.z)
+    {
+        AABB bb = bounds[i];
+        if (IsBoxInside(frustum, bb.bbMin, bb.bbMax))
+        {
+            float depth = mul(vp, float4((bb.bbMin + bb.bbMax) * 0.5, 1.0)).w;
+            key = uint2(~asuint(max(depth, 0.0)), i);
+
+            InterlockedAdd(indirectArgs[1], 1);
+        }
+    }
+    keys[i] = key;
+}
+#elif defined(SORT_LOCAL)
+groupshared uint2 sharedKeys[LocalSize];
+
+// Full sort of a block if block size is 0, otherwise the steps of bigger block size which fit into local block
+[numthreads(LocalSize / 2, 1, 1)]
+void cs(uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID)
+{
+    uint t = groupThreadId.x;
+    uint groupBase = groupId.x * LocalSize;
+
+    sharedKeys[t] = keys[groupBase + t];
+    sharedKeys[t + LocalSize / 2] = keys[groupBase + t + LocalSize / 2];
+    GroupMemoryBarrierWithGroupSync();
+
+    uint kFirst = sortParams.y == 0 ? 2 : sortParams.y;
+    uint kLast = sortParams.y == 0 ? LocalSize : sortParams.y;
+    for (uint k = kFirst; k <= kLast; k *= 2)
+    {
+        for (uint j = min(k, LocalSize) / 2; j > 0; j /= 2)
+        {
+            uint i = (t / j) * 2 * j + (t % j);
+            bool ascending = ((groupBase + i) & k) == 0;
+
+            uint2 a = sharedKeys[i];
+            uint2 b = sharedKeys[i + j];
+            if (Less(b, a) == ascending)
+            {
+                sharedKeys[i] = b;
+                sharedKeys[i + j] = a;
+            }
+            GroupMemoryBarrierWithGroupSync();
+        }
+    }
+
+    keys[groupBase + t] = sharedKeys[t];
+    keys[groupBase + t + LocalSize / 2] = sharedKeys[t + LocalSize / 2];
+}
+#elif defined(SORT_GLOBAL)
+// Single compare step with distance not fitting into local block, thread per pair
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint t = globalThreadId.x;
+    uint k = sortParams.y;
+    uint j = sortParams.z;
+
+    uint i = (t / j) * 2 * j + (t % j);
+    bool ascending = (i & k) == 0;
+
+    uint2 a = keys[i];
+    uint2 b = keys[i + j];
+    if (Less(b, a) == ascending)
+    {
+        keys[i] = b;
+        keys[i + j] = a;
+    }
+}
+#else
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint i = globalThreadId.x;
+    if (i < indirectArgs[sortParams.w * ArgsStride + 1])
+    {
+        objectIds[sortParams.w * MeshSegmentSize + i] = keys[i].y;
+    }
+}
+#endif
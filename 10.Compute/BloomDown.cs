@@ -0,0 +1,31 @@
+#include "PostParams.h"
+
+Texture2D<float4> src : register(t0); // Scene color or previous level
+RWTexture2D<float3> dst : register(u0);
+
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (any(globalThreadId.xy >= sizes.zw))
+    {
+        return;
+    }
+
+    // Each bilinear tap averages 2x2 source texels, so four taps cover 4x4 block around destination texel
+    float2 uv = (globalThreadId.xy + 0.5) / (float2)sizes.zw;
+    float2 texel = 1.0 / (float2)sizes.xy;
+    float3 color = src.SampleLevel(linearSampler, uv + texel * float2(-1, -1), 0).rgb
+        + src.SampleLevel(linearSampler, uv + texel * float2(1, -1), 0).rgb
+        + src.SampleLevel(linearSampler, uv + texel * float2(-1, 1), 0).rgb
+        + src.SampleLevel(linearSampler, uv + texel * float2(1, 1), 0).rgb;
+    color *= 0.25;
+
+    if (flags.x != 0)
+    {
+        // Keep color of bright pixels, scaled by how much they are above threshold
+        float brightness = max(color.r, max(color.g, color.b));
+        color *= max(brightness - params.x, 0.0) / max(brightness, 0.0001);
+    }
+
+    dst[globalThreadId.xy] = color;
+}
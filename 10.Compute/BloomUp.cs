@@ -0,0 +1,23 @@
+#include "PostParams.h"
+
+Texture2D<float3> lowRes : register(t0); // Next smaller level, already accumulated
+Texture2D<float3> highRes : register(t1); // Downsampled level of destination size
+RWTexture2D<float3> dst : register(u0);
+
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (any(globalThreadId.xy >= sizes.zw))
+    {
+        return;
+    }
+
+    float2 uv = (globalThreadId.xy + 0.5) / (float2)sizes.zw;
+    float2 texel = 1.0 / (float2)sizes.xy;
+    float3 up = lowRes.SampleLevel(linearSampler, uv + texel * float2(-0.5, -0.5), 0)
+        + lowRes.SampleLevel(linearSampler, uv + texel * float2(0.5, -0.5), 0)
+        + lowRes.SampleLevel(linearSampler, uv + texel * float2(-0.5, 0.5), 0)
+        + lowRes.SampleLevel(linearSampler, uv + texel * float2(0.5, 0.5), 0);
+
+    dst[globalThreadId.xy] = highRes.Load(int3(globalThreadId.xy, 0)) + up * 0.25;
+}
@@ -0,0 +1,225 @@
+#include "framework.h"
+
+#include "Bvh.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace
+{
+
+const UINT PlaneMaskAll = 0x3F;
+
+/** Spread lower 10 bits so there are two zero bits between each */
+UINT ExpandBits(UINT v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+/** 30-bit Morton code for point in [0,1]^3 */
+UINT MortonCode(const Point3f& p)
+{
+    UINT x = (UINT)std::min(std::max(p.x * 1024.0f, 0.0f), 1023.0f);
+    UINT y = (UINT)std::min(std::max(p.y * 1024.0f, 0.0f), 1023.0f);
+    UINT z = (UINT)std::min(std::max(p.z * 1024.0f, 0.0f), 1023.0f);
+    return ExpandBits(x) * 4 + ExpandBits(y) * 2 + ExpandBits(z);
+}
+
+/** Test box against planes in mask. Returns false if box is outside, clears bits of planes it is fully inside. */
+bool TestBox(const Point4f frustum[6], const Point3f& bbMin, const Point3f& bbMax, UINT& mask)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if ((mask & (1u << i)) == 0)
+        {
+            continue;
+        }
+
+        const Point3f norm = frustum[i];
+        Point4f p(
+            signbit(norm.x) ? bbMin.x : bbMax.x,
+            signbit(norm.y) ? bbMin.y : bbMax.y,
+            signbit(norm.z) ? bbMin.z : bbMax.z,
+            1.0f
+        );
+        if (p.dot(frustum[i]) < 0.0f)
+        {
+            return false;
+        }
+
+        Point4f n(
+            signbit(norm.x) ? bbMax.x : bbMin.x,
+            signbit(norm.y) ? bbMax.y : bbMin.y,
+            signbit(norm.z) ? bbMax.z : bbMin.z,
+            1.0f
+        );
+        if (n.dot(frustum[i]) >= 0.0f)
+        {
+            mask &= ~(1u << i);
+        }
+    }
+
+    return true;
+}
+
+}
+
+void Bvh::Build(const AABB* pBoxes, UINT count)
+{
+    m_order.resize(count);
+    m_nodes.clear();
+    m_clusterCount = 0;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Sort instances along Morton curve over box centers
+    AABB centerBB;
+    for (UINT i = 0; i < count; i++)
+    {
+        Point3f center = (pBoxes[i].vmin + pBoxes[i].vmax) * 0.5f;
+        centerBB.Add(AABB{ center, center });
+    }
+    Point3f size = centerBB.vmax - centerBB.vmin;
+    Point3f scale = Point3f{ 1.0f / std::max(size.x, 1e-6f), 1.0f / std::max(size.y, 1e-6f), 1.0f / std::max(size.z, 1e-6f) };
+
+    std::vector<std::pair<UINT, UINT>> keys(count);
+    for (UINT i = 0; i < count; i++)
+    {
+        Point3f p = (pBoxes[i].vmin + pBoxes[i].vmax) * 0.5f - centerBB.vmin;
+        keys[i] = std::make_pair(MortonCode(Point3f{ p.x * scale.x, p.y * scale.y, p.z * scale.z }), i);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (UINT i = 0; i < count; i++)
+    {
+        m_order[i] = keys[i].second;
+    }
+
+    // Leaf clusters
+    m_clusterCount = DivUp(count, (UINT)LeafSize);
+    m_nodes.reserve(m_clusterCount * 2);
+    for (UINT c = 0; c < m_clusterCount; c++)
+    {
+        Node node = {};
+        node.bounds.first = c * LeafSize;
+        node.bounds.count = std::min((UINT)LeafSize, count - node.bounds.first);
+
+        AABB bb;
+        for (UINT i = node.bounds.first; i < node.bounds.first + node.bounds.count; i++)
+        {
+            bb.Add(pBoxes[m_order[i]]);
+        }
+        node.bounds.vmin = bb.vmin;
+        node.bounds.vmax = bb.vmax;
+
+        m_nodes.push_back(node);
+    }
+
+    // Inner nodes, neighbours in Morton order are merged level by level, root is the last node
+    std::vector<UINT> level(m_clusterCount);
+    for (UINT c = 0; c < m_clusterCount; c++)
+    {
+        level[c] = c;
+    }
+    std::vector<UINT> nextLevel;
+    while (level.size() > 1)
+    {
+        nextLevel.clear();
+        for (size_t i = 0; i + 1 < level.size(); i += 2)
+        {
+            const Cluster& left = m_nodes[level[i]].bounds;
+            const Cluster& right = m_nodes[level[i + 1]].bounds;
+
+            AABB bb = AABB{ left.vmin, left.vmax };
+            bb.Add(AABB{ right.vmin, right.vmax });
+
+            Node node;
+            node.bounds.vmin = bb.vmin;
+            node.bounds.vmax = bb.vmax;
+            node.bounds.first = left.first;
+            node.bounds.count = left.count + right.count;
+            node.left = level[i];
+            node.right = level[i + 1];
+
+            nextLevel.push_back((UINT)m_nodes.size());
+            m_nodes.push_back(node);
+        }
+        if (level.size() % 2 != 0)
+        {
+            nextLevel.push_back(level.back());
+        }
+        level.swap(nextLevel);
+    }
+}
+
+UINT Bvh::Cull(const Point4f frustum[6], const AABB* pBoxes, UINT* pIds) const
+{
+    if (m_nodes.empty())
+    {
+        return 0;
+    }
+
+    struct Entry
+    {
+        UINT node;
+        UINT mask; // Planes the node is not yet known to be fully inside
+    };
+    Entry stack[64]; // Tree depth is log2 of cluster count
+    int top = 0;
+    stack[top++] = Entry{ (UINT)m_nodes.size() - 1, PlaneMaskAll };
+
+    UINT visible = 0;
+    while (top > 0)
+    {
+        Entry entry = stack[--top];
+        const Node& node = m_nodes[entry.node];
+
+        UINT mask = entry.mask;
+        if (!TestBox(frustum, node.bounds.vmin, node.bounds.vmax, mask))
+        {
+            continue;
+        }
+
+        if (mask == 0)
+        {
+            // Whole subtree is inside
+            memcpy(pIds + visible, m_order.data() + node.bounds.first, node.bounds.count * sizeof(UINT));
+            visible += node.bounds.count;
+        }
+        else if (entry.node < m_clusterCount)
+        {
+            for (UINT i = node.bounds.first; i < node.bounds.first + node.bounds.count; i++)
+            {
+                UINT id = m_order[i];
+                UINT instMask = mask;
+                if (TestBox(frustum, pBoxes[id].vmin, pBoxes[id].vmax, instMask))
+                {
+                    pIds[visible++] = id;
+                }
+            }
+        }
+        else
+        {
+            stack[top++] = Entry{ node.right, mask };
+            stack[top++] = Entry{ node.left, mask };
+        }
+    }
+
+    return visible;
+}
+
+std::vector<Bvh::Cluster> Bvh::GetClusters() const
+{
+    std::vector<Cluster> clusters(m_clusterCount);
+    for (UINT c = 0; c < m_clusterCount; c++)
+    {
+        clusters[c] = m_nodes[c].bounds;
+    }
+    return clusters;
+}
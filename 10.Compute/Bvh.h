@@ -0,0 +1,53 @@
+#pragma once
+
+#include "AABB.h"
+
+#include <vector>
+
+/**
+ * Bounding volume hierarchy over instance boxes. Instances are sorted along a Morton curve
+ * and grouped in clusters of LeafSize, clusters are leaves of a binary tree.
+ * Each node covers a contiguous range of sorted instances.
+ */
+class Bvh
+{
+public:
+    static const UINT LeafSize = 64; // Matches thread group size of the clustered FrustumCull.cs
+
+    Bvh()
+        : m_clusterCount(0)
+    {}
+
+    // Layout matches Cluster structured buffer element in CullCommon.h
+    struct Cluster
+    {
+        Point3f vmin;
+        UINT first;     // First instance in sorted order
+        Point3f vmax;
+        UINT count;     // Instance count
+    };
+
+    struct Node
+    {
+        Cluster bounds;
+        UINT left;      // Children, unused for leaves
+        UINT right;
+    };
+
+    void Build(const AABB* pBoxes, UINT count);
+
+    /** Write indices of boxes inside the frustum to pIds, returns visible count */
+    UINT Cull(const Point4f frustum[6], const AABB* pBoxes, UINT* pIds) const;
+
+    inline UINT GetClusterCount() const { return m_clusterCount; }
+    inline UINT GetNodeCount() const { return (UINT)m_nodes.size(); }
+    inline const std::vector<UINT>& GetOrder() const { return m_order; }
+
+    /** Leaf clusters are the first GetClusterCount() nodes */
+    std::vector<Cluster> GetClusters() const;
+
+private:
+    std::vector<UINT> m_order;
+    std::vector<Node> m_nodes;
+    UINT m_clusterCount;
+};
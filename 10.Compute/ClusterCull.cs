@@ -0,0 +1,30 @@
+#include "SceneCB.h"
+#include "CullCommon.h"
+
+cbuffer CullParams : register(b1)
+{
+    uint4 numShapes; // x - objects count, y - clusters count, z - test mesh bounds after boxes
+};
+
+StructuredBuffer<Cluster> clusters : register(t0);
+
+RWBuffer<uint> dispatchArgs : register(u0);
+RWStructuredBuffer<uint> visibleClusters : register(u1);
+
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (globalThreadId.x >= numShapes.y)
+    {
+        return;
+    }
+
+    Cluster cluster = clusters[globalThreadId.x];
+    if (IsBoxInside(frustum, cluster.bbMin, cluster.bbMax))
+    {
+        uint id = 0;
+        InterlockedAdd(dispatchArgs[0], 1, id); // Corresponds to ThreadGroupCountX in DispatchIndirect
+
+        visibleClusters[id] = globalThreadId.x | (IsBoxFullyInside(frustum, cluster.bbMin, cluster.bbMax) ? FullyInsideFlag : 0);
+    }
+}
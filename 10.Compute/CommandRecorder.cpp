@@ -0,0 +1,1842 @@
+#include "framework.h"
+
+#include "CommandRecorder.h"
+
+#include <algorithm>
+
+namespace
+{
+
+const UINT32 FileMagic = 0x53444D43; // "CMDS"
+const UINT32 FileVersion = 1;
+
+const UINT MaxSlots = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+
+bool IsBlockCompressed(DXGI_FORMAT format)
+{
+    return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM)
+        || (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+/** Sequential reads of command stream, fails instead of reading past the end */
+class StreamReader
+{
+public:
+    StreamReader(const std::vector<BYTE>& stream, const std::vector<ID3D11DeviceChild*>& objects)
+        : m_pData(stream.data())
+        , m_size(stream.size())
+        , m_pos(0)
+        , m_objects(objects)
+        , m_failed(false)
+    {}
+
+    inline bool IsEnd() const { return m_pos >= m_size || m_failed; }
+    inline bool IsFailed() const { return m_failed; }
+
+    template <typename T>
+    T Get()
+    {
+        T value = {};
+        const BYTE* pBytes = GetBytes(sizeof(T));
+        if (pBytes != nullptr)
+        {
+            memcpy(&value, pBytes, sizeof(T));
+        }
+        return value;
+    }
+
+    const BYTE* GetBytes(size_t size)
+    {
+        if (m_failed || size > m_size - m_pos)
+        {
+            m_failed = true;
+            return nullptr;
+        }
+        const BYTE* pBytes = m_pData + m_pos;
+        m_pos += size;
+        return pBytes;
+    }
+
+    template <typename T>
+    T* GetChild()
+    {
+        UINT32 id = Get<UINT32>();
+        if (id > m_objects.size())
+        {
+            m_failed = true;
+            return nullptr;
+        }
+        return id == 0 ? nullptr : static_cast<T*>(m_objects[id - 1]);
+    }
+
+    template <typename T>
+    UINT GetChildren(UINT count, T** ppObjects)
+    {
+        if (count > MaxSlots)
+        {
+            m_failed = true;
+            return 0;
+        }
+        for (UINT i = 0; i < count; i++)
+        {
+            ppObjects[i] = GetChild<T>();
+        }
+        return count;
+    }
+
+private:
+    const BYTE* m_pData;
+    size_t m_size;
+    size_t m_pos;
+    const std::vector<ID3D11DeviceChild*>& m_objects;
+    bool m_failed;
+};
+
+}
+
+void CommandRecorder::StartCapture(ID3D11DeviceContext* pContext)
+{
+    Clear();
+
+    m_pContext = pContext;
+    m_pContext->AddRef();
+    m_recording = true;
+
+    // Replay starts from cleared state too, so stream does not depend on state set before capture
+    ClearState();
+}
+
+void CommandRecorder::StopCapture()
+{
+    // Maps left open at the end of capture have no contents to store
+    m_unsupported += (UINT)m_pendingMaps.size();
+    m_pendingMaps.clear();
+    m_recording = false;
+}
+
+void CommandRecorder::Clear()
+{
+    m_recording = false;
+    m_stream.clear();
+    m_stream.shrink_to_fit();
+    for (auto pObject : m_objects)
+    {
+        pObject->Release();
+    }
+    m_objects.clear();
+    m_objectIds.clear();
+    m_pendingMaps.clear();
+    m_commands = 0;
+    m_payloadBytes = 0;
+    m_unsupported = 0;
+    SAFE_RELEASE(m_pContext);
+}
+
+void CommandRecorder::PutOp(Op op)
+{
+    Put<UINT8>(op);
+    ++m_commands;
+}
+
+void CommandRecorder::PutObject(ID3D11DeviceChild* pObject)
+{
+    UINT32 id = 0;
+    if (pObject != nullptr)
+    {
+        auto it = m_objectIds.find(pObject);
+        if (it != m_objectIds.end())
+        {
+            id = it->second;
+        }
+        else
+        {
+            // Reference keeps pointer from being reused by another object until capture is cleared
+            pObject->AddRef();
+            m_objects.push_back(pObject);
+            id = (UINT32)m_objects.size();
+            m_objectIds[pObject] = id;
+        }
+    }
+    Put(id);
+}
+
+void CommandRecorder::PutBytes(const void* pData, size_t size)
+{
+    const BYTE* pBytes = static_cast<const BYTE*>(pData);
+    m_stream.insert(m_stream.end(), pBytes, pBytes + size);
+    m_payloadBytes += size;
+}
+
+void CommandRecorder::PutSlots(Op op, Stage stage, UINT startSlot, UINT count, ID3D11DeviceChild* const* ppObjects)
+{
+    PutOp(op);
+    Put<UINT8>(stage);
+    Put(startSlot);
+    Put(count);
+    PutObjects(count, ppObjects);
+}
+
+void CommandRecorder::PutShader(Stage stage, ID3D11DeviceChild* pShader, UINT numClassInstances)
+{
+    if (numClassInstances > 0)
+    {
+        ++m_unsupported;
+    }
+    PutOp(OpSetShader);
+    Put<UINT8>(stage);
+    PutObject(pShader);
+}
+
+size_t CommandRecorder::GetMappedSize(ID3D11Resource* pResource, UINT subresource, const D3D11_MAPPED_SUBRESOURCE& mapped)
+{
+    D3D11_RESOURCE_DIMENSION dimension = D3D11_RESOURCE_DIMENSION_UNKNOWN;
+    pResource->GetType(&dimension);
+    switch (dimension)
+    {
+        case D3D11_RESOURCE_DIMENSION_BUFFER:
+        {
+            D3D11_BUFFER_DESC desc;
+            static_cast<ID3D11Buffer*>(pResource)->GetDesc(&desc);
+            return desc.ByteWidth;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+            return mapped.RowPitch;
+        case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+            return mapped.DepthPitch;
+        case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+        {
+            D3D11_TEXTURE3D_DESC desc;
+            static_cast<ID3D11Texture3D*>(pResource)->GetDesc(&desc);
+            UINT mip = subresource % desc.MipLevels;
+            return (size_t)mapped.DepthPitch * std::max(desc.Depth >> mip, 1u);
+        }
+    }
+    return 0;
+}
+
+size_t CommandRecorder::GetUpdateSize(ID3D11Resource* pResource, UINT subresource, const D3D11_BOX* pBox, UINT rowPitch, UINT depthPitch)
+{
+    D3D11_RESOURCE_DIMENSION dimension = D3D11_RESOURCE_DIMENSION_UNKNOWN;
+    pResource->GetType(&dimension);
+
+    UINT height = 1;
+    UINT depth = 1;
+    DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+    switch (dimension)
+    {
+        case D3D11_RESOURCE_DIMENSION_BUFFER:
+        {
+            D3D11_BUFFER_DESC desc;
+            static_cast<ID3D11Buffer*>(pResource)->GetDesc(&desc);
+            return pBox != nullptr ? pBox->right - pBox->left : desc.ByteWidth;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+        {
+            D3D11_TEXTURE2D_DESC desc;
+            static_cast<ID3D11Texture2D*>(pResource)->GetDesc(&desc);
+            height = std::max(desc.Height >> (subresource % desc.MipLevels), 1u);
+            format = desc.Format;
+            break;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+        {
+            D3D11_TEXTURE3D_DESC desc;
+            static_cast<ID3D11Texture3D*>(pResource)->GetDesc(&desc);
+            height = std::max(desc.Height >> (subresource % desc.MipLevels), 1u);
+            depth = std::max(desc.Depth >> (subresource % desc.MipLevels), 1u);
+            format = desc.Format;
+            break;
+        }
+        default:
+            return 0; // Size of 1D texture data depends on format only, not supported
+    }
+    if (pBox != nullptr)
+    {
+        height = pBox->bottom - pBox->top;
+        depth = pBox->back - pBox->front;
+    }
+    UINT rows = IsBlockCompressed(format) ? DivUp(height, 4u) : height;
+
+    // Last row is taken at full pitch, sources of the renderer are tightly packed
+    return (size_t)(depth - 1) * depthPitch + (size_t)rows * rowPitch;
+}
+
+// IUnknown, lifetime is owned by the renderer, references are not counted
+
+HRESULT STDMETHODCALLTYPE CommandRecorder::QueryInterface(REFIID riid, void** ppObject)
+{
+    if (ppObject == nullptr)
+    {
+        return E_POINTER;
+    }
+    // Newer context interfaces are not exposed, their calls would bypass recording
+    if (riid == __uuidof(IUnknown) || riid == __uuidof(ID3D11DeviceChild) || riid == __uuidof(ID3D11DeviceContext))
+    {
+        *ppObject = static_cast<ID3D11DeviceContext*>(this);
+        return S_OK;
+    }
+    *ppObject = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG STDMETHODCALLTYPE CommandRecorder::AddRef()
+{
+    return 1;
+}
+
+ULONG STDMETHODCALLTYPE CommandRecorder::Release()
+{
+    return 1;
+}
+
+bool CommandRecorder::Replay(ID3D11DeviceContext* pContext) const
+{
+    StreamReader reader(m_stream, m_objects);
+
+    ID3D11DeviceChild* objects[MaxSlots];
+    UINT values[MaxSlots * 2];
+
+    pContext->ClearState();
+    while (!reader.IsEnd())
+    {
+        Op op = (Op)reader.Get<UINT8>();
+        switch (op)
+        {
+            case OpSetConstantBuffers:
+            case OpSetShaderResources:
+            case OpSetSamplers:
+            {
+                Stage stage = (Stage)reader.Get<UINT8>();
+                UINT startSlot = reader.Get<UINT>();
+                UINT count = reader.GetChildren(reader.Get<UINT>(), objects);
+                if (reader.IsFailed())
+                {
+                    break;
+                }
+                if (op == OpSetConstantBuffers)
+                {
+                    ID3D11Buffer* const* ppBuffers = reinterpret_cast<ID3D11Buffer* const*>(objects);
+                    switch (stage)
+                    {
+                        case StageVS: pContext->VSSetConstantBuffers(startSlot, count, ppBuffers); break;
+                        case StagePS: pContext->PSSetConstantBuffers(startSlot, count, ppBuffers); break;
+                        case StageGS: pContext->GSSetConstantBuffers(startSlot, count, ppBuffers); break;
+                        case StageHS: pContext->HSSetConstantBuffers(startSlot, count, ppBuffers); break;
+                        case StageDS: pContext->DSSetConstantBuffers(startSlot, count, ppBuffers); break;
+                        case StageCS: pContext->CSSetConstantBuffers(startSlot, count, ppBuffers); break;
+                    }
+                }
+                else if (op == OpSetShaderResources)
+                {
+                    ID3D11ShaderResourceView* const* ppViews = reinterpret_cast<ID3D11ShaderResourceView* const*>(objects);
+                    switch (stage)
+                    {
+                        case StageVS: pContext->VSSetShaderResources(startSlot, count, ppViews); break;
+                        case StagePS: pContext->PSSetShaderResources(startSlot, count, ppViews); break;
+                        case StageGS: pContext->GSSetShaderResources(startSlot, count, ppViews); break;
+                        case StageHS: pContext->HSSetShaderResources(startSlot, count, ppViews); break;
+                        case StageDS: pContext->DSSetShaderResources(startSlot, count, ppViews); break;
+                        case StageCS: pContext->CSSetShaderResources(startSlot, count, ppViews); break;
+                    }
+                }
+                else
+                {
+                    ID3D11SamplerState* const* ppSamplers = reinterpret_cast<ID3D11SamplerState* const*>(objects);
+                    switch (stage)
+                    {
+                        case StageVS: pContext->VSSetSamplers(startSlot, count, ppSamplers); break;
+                        case StagePS: pContext->PSSetSamplers(startSlot, count, ppSamplers); break;
+                        case StageGS: pContext->GSSetSamplers(startSlot, count, ppSamplers); break;
+                        case StageHS: pContext->HSSetSamplers(startSlot, count, ppSamplers); break;
+                        case StageDS: pContext->DSSetSamplers(startSlot, count, ppSamplers); break;
+                        case StageCS: pContext->CSSetSamplers(startSlot, count, ppSamplers); break;
+                    }
+                }
+                break;
+            }
+
+            case OpSetShader:
+            {
+                Stage stage = (Stage)reader.Get<UINT8>();
+                ID3D11DeviceChild* pShader = reader.GetChild<ID3D11DeviceChild>();
+                switch (stage)
+                {
+                    case StageVS: pContext->VSSetShader(static_cast<ID3D11VertexShader*>(pShader), nullptr, 0); break;
+                    case StagePS: pContext->PSSetShader(static_cast<ID3D11PixelShader*>(pShader), nullptr, 0); break;
+                    case StageGS: pContext->GSSetShader(static_cast<ID3D11GeometryShader*>(pShader), nullptr, 0); break;
+                    case StageHS: pContext->HSSetShader(static_cast<ID3D11HullShader*>(pShader), nullptr, 0); break;
+                    case StageDS: pContext->DSSetShader(static_cast<ID3D11DomainShader*>(pShader), nullptr, 0); break;
+                    case StageCS: pContext->CSSetShader(static_cast<ID3D11ComputeShader*>(pShader), nullptr, 0); break;
+                }
+                break;
+            }
+
+            case OpCSSetUnorderedAccessViews:
+            {
+                UINT startSlot = reader.Get<UINT>();
+                UINT count = reader.GetChildren(reader.Get<UINT>(), objects);
+                const UINT* pInitialCounts = reader.Get<UINT8>() ? reinterpret_cast<const UINT*>(reader.GetBytes(count * sizeof(UINT))) : nullptr;
+                if (!reader.IsFailed())
+                {
+                    pContext->CSSetUnorderedAccessViews(startSlot, count, reinterpret_cast<ID3D11UnorderedAccessView* const*>(objects), pInitialCounts);
+                }
+                break;
+            }
+
+            case OpDrawIndexed:
+            {
+                UINT indexCount = reader.Get<UINT>();
+                UINT startIndexLocation = reader.Get<UINT>();
+                INT baseVertexLocation = reader.Get<INT>();
+                pContext->DrawIndexed(indexCount, startIndexLocation, baseVertexLocation);
+                break;
+            }
+
+            case OpDraw:
+            {
+                UINT vertexCount = reader.Get<UINT>();
+                UINT startVertexLocation = reader.Get<UINT>();
+                pContext->Draw(vertexCount, startVertexLocation);
+                break;
+            }
+
+            case OpMap:
+            {
+                ID3D11Resource* pResource = reader.GetChild<ID3D11Resource>();
+                UINT subresource = reader.Get<UINT>();
+                D3D11_MAP mapType = (D3D11_MAP)reader.Get<UINT32>();
+                UINT mapFlags = reader.Get<UINT>();
+                size_t offset = (size_t)reader.Get<UINT64>();
+                size_t size = (size_t)reader.Get<UINT64>();
+                const BYTE* pBytes = reader.GetBytes(size);
+                D3D11_MAPPED_SUBRESOURCE mapped;
+                if (!reader.IsFailed() && pResource != nullptr && SUCCEEDED(pContext->Map(pResource, subresource, mapType, mapFlags, &mapped)))
+                {
+                    memcpy(static_cast<BYTE*>(mapped.pData) + offset, pBytes, size);
+                    pContext->Unmap(pResource, subresource);
+                }
+                break;
+            }
+
+            case OpIASetInputLayout:
+                pContext->IASetInputLayout(reader.GetChild<ID3D11InputLayout>());
+                break;
+
+            case OpIASetVertexBuffers:
+            {
+                UINT startSlot = reader.Get<UINT>();
+                UINT count = reader.GetChildren(reader.Get<UINT>(), objects);
+                for (UINT i = 0; i < count; i++)
+                {
+                    values[i] = reader.Get<UINT>();
+                    values[MaxSlots + i] = reader.Get<UINT>();
+                }
+                if (!reader.IsFailed())
+                {
+                    pContext->IASetVertexBuffers(startSlot, count, reinterpret_cast<ID3D11Buffer* const*>(objects), values, values + MaxSlots);
+                }
+                break;
+            }
+
+            case OpIASetIndexBuffer:
+            {
+                ID3D11Buffer* pBuffer = reader.GetChild<ID3D11Buffer>();
+                DXGI_FORMAT format = (DXGI_FORMAT)reader.Get<UINT32>();
+                UINT offset = reader.Get<UINT>();
+                pContext->IASetIndexBuffer(pBuffer, format, offset);
+                break;
+            }
+
+            case OpDrawIndexedInstanced:
+            {
+                UINT indexCountPerInstance = reader.Get<UINT>();
+                UINT instanceCount = reader.Get<UINT>();
+                UINT startIndexLocation = reader.Get<UINT>();
+                INT baseVertexLocation = reader.Get<INT>();
+                UINT startInstanceLocation = reader.Get<UINT>();
+                pContext->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+                break;
+            }
+
+            case OpDrawInstanced:
+            {
+                UINT vertexCountPerInstance = reader.Get<UINT>();
+                UINT instanceCount = reader.Get<UINT>();
+                UINT startVertexLocation = reader.Get<UINT>();
+                UINT startInstanceLocation = reader.Get<UINT>();
+                pContext->DrawInstanced(vertexCountPerInstance, instanceCount, startVertexLocation, startInstanceLocation);
+                break;
+            }
+
+            case OpIASetPrimitiveTopology:
+                pContext->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)reader.Get<UINT32>());
+                break;
+
+            case OpBegin:
+            case OpEnd:
+            {
+                ID3D11Predicate* pPredicate = reader.GetChild<ID3D11Predicate>();
+                if (pPredicate != nullptr)
+                {
+                    if (op == OpBegin)
+                    {
+                        pContext->Begin(pPredicate);
+                    }
+                    else
+                    {
+                        pContext->End(pPredicate);
+                    }
+                }
+                break;
+            }
+
+            case OpSetPredication:
+            {
+                ID3D11Predicate* pPredicate = reader.GetChild<ID3D11Predicate>();
+                BOOL predicateValue = reader.Get<BOOL>();
+                pContext->SetPredication(pPredicate, predicateValue);
+                break;
+            }
+
+            case OpOMSetRenderTargets:
+            {
+                UINT count = reader.GetChildren(reader.Get<UINT>(), objects);
+                ID3D11DepthStencilView* pDepthStencilView = reader.GetChild<ID3D11DepthStencilView>();
+                if (!reader.IsFailed())
+                {
+                    pContext->OMSetRenderTargets(count, reinterpret_cast<ID3D11RenderTargetView* const*>(objects), pDepthStencilView);
+                }
+                break;
+            }
+
+            case OpOMSetRenderTargetsAndUnorderedAccessViews:
+            {
+                ID3D11DeviceChild* uavs[MaxSlots];
+                ID3D11DepthStencilView* pDepthStencilView = nullptr;
+                UINT numRTVs = reader.Get<UINT>();
+                if (numRTVs != D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL)
+                {
+                    numRTVs = reader.GetChildren(numRTVs, objects);
+                    pDepthStencilView = reader.GetChild<ID3D11DepthStencilView>();
+                }
+                UINT uavStartSlot = reader.Get<UINT>();
+                UINT numUAVs = reader.Get<UINT>();
+                const UINT* pInitialCounts = nullptr;
+                if (numUAVs != D3D11_KEEP_UNORDERED_ACCESS_VIEWS)
+                {
+                    numUAVs = reader.GetChildren(numUAVs, uavs);
+                    if (reader.Get<UINT8>())
+                    {
+                        pInitialCounts = reinterpret_cast<const UINT*>(reader.GetBytes(numUAVs * sizeof(UINT)));
+                    }
+                }
+                if (!reader.IsFailed())
+                {
+                    pContext->OMSetRenderTargetsAndUnorderedAccessViews(numRTVs, reinterpret_cast<ID3D11RenderTargetView* const*>(objects), pDepthStencilView,
+                        uavStartSlot, numUAVs, reinterpret_cast<ID3D11UnorderedAccessView* const*>(uavs), pInitialCounts);
+                }
+                break;
+            }
+
+            case OpOMSetBlendState:
+            {
+                ID3D11BlendState* pBlendState = reader.GetChild<ID3D11BlendState>();
+                const FLOAT* pBlendFactor = reader.Get<UINT8>() ? reinterpret_cast<const FLOAT*>(reader.GetBytes(4 * sizeof(FLOAT))) : nullptr;
+                UINT sampleMask = reader.Get<UINT>();
+                if (!reader.IsFailed())
+                {
+                    pContext->OMSetBlendState(pBlendState, pBlendFactor, sampleMask);
+                }
+                break;
+            }
+
+            case OpOMSetDepthStencilState:
+            {
+                ID3D11DepthStencilState* pDepthStencilState = reader.GetChild<ID3D11DepthStencilState>();
+                UINT stencilRef = reader.Get<UINT>();
+                pContext->OMSetDepthStencilState(pDepthStencilState, stencilRef);
+                break;
+            }
+
+            case OpSOSetTargets:
+            {
+                UINT count = reader.GetChildren(reader.Get<UINT>(), objects);
+                for (UINT i = 0; i < count; i++)
+                {
+                    values[i] = reader.Get<UINT>();
+                }
+                if (!reader.IsFailed())
+                {
+                    pContext->SOSetTargets(count, reinterpret_cast<ID3D11Buffer* const*>(objects), values);
+                }
+                break;
+            }
+
+            case OpDrawAuto:
+                pContext->DrawAuto();
+                break;
+
+            case OpDrawIndexedInstancedIndirect:
+            case OpDrawInstancedIndirect:
+            case OpDispatchIndirect:
+            {
+                ID3D11Buffer* pBuffer = reader.GetChild<ID3D11Buffer>();
+                UINT offset = reader.Get<UINT>();
+                if (reader.IsFailed() || pBuffer == nullptr)
+                {
+                    break;
+                }
+                if (op == OpDrawIndexedInstancedIndirect)
+                {
+                    pContext->DrawIndexedInstancedIndirect(pBuffer, offset);
+                }
+                else if (op == OpDrawInstancedIndirect)
+                {
+                    pContext->DrawInstancedIndirect(pBuffer, offset);
+                }
+                else
+                {
+                    pContext->DispatchIndirect(pBuffer, offset);
+                }
+                break;
+            }
+
+            case OpDispatch:
+            {
+                UINT x = reader.Get<UINT>();
+                UINT y = reader.Get<UINT>();
+                UINT z = reader.Get<UINT>();
+                pContext->Dispatch(x, y, z);
+                break;
+            }
+
+            case OpRSSetState:
+                pContext->RSSetState(reader.GetChild<ID3D11RasterizerState>());
+                break;
+
+            case OpRSSetViewports:
+            {
+                UINT count = reader.Get<UINT>();
+                const D3D11_VIEWPORT* pViewports = reinterpret_cast<const D3D11_VIEWPORT*>(reader.GetBytes(count * sizeof(D3D11_VIEWPORT)));
+                if (!reader.IsFailed())
+                {
+                    pContext->RSSetViewports(count, pViewports);
+                }
+                break;
+            }
+
+            case OpRSSetScissorRects:
+            {
+                UINT count = reader.Get<UINT>();
+                const D3D11_RECT* pRects = reinterpret_cast<const D3D11_RECT*>(reader.GetBytes(count * sizeof(D3D11_RECT)));
+                if (!reader.IsFailed())
+                {
+                    pContext->RSSetScissorRects(count, pRects);
+                }
+                break;
+            }
+
+            case OpCopySubresourceRegion:
+            {
+                ID3D11Resource* pDst = reader.GetChild<ID3D11Resource>();
+                UINT dstSubresource = reader.Get<UINT>();
+                UINT dstX = reader.Get<UINT>();
+                UINT dstY = reader.Get<UINT>();
+                UINT dstZ = reader.Get<UINT>();
+                ID3D11Resource* pSrc = reader.GetChild<ID3D11Resource>();
+                UINT srcSubresource = reader.Get<UINT>();
+                bool hasBox = reader.Get<UINT8>() != 0;
+                D3D11_BOX box = hasBox ? reader.Get<D3D11_BOX>() : D3D11_BOX{};
+                if (!reader.IsFailed() && pDst != nullptr && pSrc != nullptr)
+                {
+                    pContext->CopySubresourceRegion(pDst, dstSubresource, dstX, dstY, dstZ, pSrc, srcSubresource, hasBox ? &box : nullptr);
+                }
+                break;
+            }
+
+            case OpCopyResource:
+            {
+                ID3D11Resource* pDst = reader.GetChild<ID3D11Resource>();
+                ID3D11Resource* pSrc = reader.GetChild<ID3D11Resource>();
+                if (pDst != nullptr && pSrc != nullptr)
+                {
+                    pContext->CopyResource(pDst, pSrc);
+                }
+                break;
+            }
+
+            case OpUpdateSubresource:
+            {
+                ID3D11Resource* pDst = reader.GetChild<ID3D11Resource>();
+                UINT dstSubresource = reader.Get<UINT>();
+                bool hasBox = reader.Get<UINT8>() != 0;
+                D3D11_BOX box = hasBox ? reader.Get<D3D11_BOX>() : D3D11_BOX{};
+                UINT rowPitch = reader.Get<UINT>();
+                UINT depthPitch = reader.Get<UINT>();
+                const BYTE* pBytes = reader.GetBytes((size_t)reader.Get<UINT64>());
+                if (!reader.IsFailed() && pDst != nullptr)
+                {
+                    pContext->UpdateSubresource(pDst, dstSubresource, hasBox ? &box : nullptr, pBytes, rowPitch, depthPitch);
+                }
+                break;
+            }
+
+            case OpCopyStructureCount:
+            {
+                ID3D11Buffer* pDst = reader.GetChild<ID3D11Buffer>();
+                UINT offset = reader.Get<UINT>();
+                ID3D11UnorderedAccessView* pSrc = reader.GetChild<ID3D11UnorderedAccessView>();
+                if (pDst != nullptr && pSrc != nullptr)
+                {
+                    pContext->CopyStructureCount(pDst, offset, pSrc);
+                }
+                break;
+            }
+
+            case OpClearRenderTargetView:
+            {
+                ID3D11RenderTargetView* pView = reader.GetChild<ID3D11RenderTargetView>();
+                const FLOAT* pColor = reinterpret_cast<const FLOAT*>(reader.GetBytes(4 * sizeof(FLOAT)));
+                if (!reader.IsFailed() && pView != nullptr)
+                {
+                    pContext->ClearRenderTargetView(pView, pColor);
+                }
+                break;
+            }
+
+            case OpClearUnorderedAccessViewUint:
+            case OpClearUnorderedAccessViewFloat:
+            {
+                ID3D11UnorderedAccessView* pView = reader.GetChild<ID3D11UnorderedAccessView>();
+                const BYTE* pValues = reader.GetBytes(4 * sizeof(UINT));
+                if (reader.IsFailed() || pView == nullptr)
+                {
+                    break;
+                }
+                if (op == OpClearUnorderedAccessViewUint)
+                {
+                    pContext->ClearUnorderedAccessViewUint(pView, reinterpret_cast<const UINT*>(pValues));
+                }
+                else
+                {
+                    pContext->ClearUnorderedAccessViewFloat(pView, reinterpret_cast<const FLOAT*>(pValues));
+                }
+                break;
+            }
+
+            case OpClearDepthStencilView:
+            {
+                ID3D11DepthStencilView* pView = reader.GetChild<ID3D11DepthStencilView>();
+                UINT clearFlags = reader.Get<UINT>();
+                FLOAT depth = reader.Get<FLOAT>();
+                UINT8 stencil = reader.Get<UINT8>();
+                if (pView != nullptr)
+                {
+                    pContext->ClearDepthStencilView(pView, clearFlags, depth, stencil);
+                }
+                break;
+            }
+
+            case OpGenerateMips:
+            {
+                ID3D11ShaderResourceView* pView = reader.GetChild<ID3D11ShaderResourceView>();
+                if (pView != nullptr)
+                {
+                    pContext->GenerateMips(pView);
+                }
+                break;
+            }
+
+            case OpSetResourceMinLOD:
+            {
+                ID3D11Resource* pResource = reader.GetChild<ID3D11Resource>();
+                FLOAT minLOD = reader.Get<FLOAT>();
+                if (pResource != nullptr)
+                {
+                    pContext->SetResourceMinLOD(pResource, minLOD);
+                }
+                break;
+            }
+
+            case OpResolveSubresource:
+            {
+                ID3D11Resource* pDst = reader.GetChild<ID3D11Resource>();
+                UINT dstSubresource = reader.Get<UINT>();
+                ID3D11Resource* pSrc = reader.GetChild<ID3D11Resource>();
+                UINT srcSubresource = reader.Get<UINT>();
+                DXGI_FORMAT format = (DXGI_FORMAT)reader.Get<UINT32>();
+                if (pDst != nullptr && pSrc != nullptr)
+                {
+                    pContext->ResolveSubresource(pDst, dstSubresource, pSrc, srcSubresource, format);
+                }
+                break;
+            }
+
+            case OpClearState:
+                pContext->ClearState();
+                break;
+
+            case OpFlush:
+                pContext->Flush();
+                break;
+
+            default:
+                return false;
+        }
+        if (reader.IsFailed())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CommandRecorder::Save(const std::wstring& path) const
+{
+    FILE* pFile = nullptr;
+    if (_wfopen_s(&pFile, path.c_str(), L"wb") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+    struct Header
+    {
+        UINT32 magic;
+        UINT32 version;
+        UINT32 objectCount;
+        UINT32 commandCount;
+        UINT64 streamBytes;
+    };
+    Header header = { FileMagic, FileVersion, (UINT32)m_objects.size(), m_commands, m_stream.size() };
+    bool success = fwrite(&header, sizeof(header), 1, pFile) == 1;
+
+    // Names let the stream be read against the objects it refers to, in order of ids
+    for (auto pObject : m_objects)
+    {
+        char name[256] = {};
+        UINT size = sizeof(name) - 1;
+        if (FAILED(pObject->GetPrivateData(WKPDID_D3DDebugObjectName, &size, name)))
+        {
+            size = 0;
+        }
+        UINT32 length = size;
+        success = success && fwrite(&length, sizeof(length), 1, pFile) == 1;
+        success = success && (length == 0 || fwrite(name, length, 1, pFile) == 1);
+    }
+    success = success && (m_stream.empty() || fwrite(m_stream.data(), m_stream.size(), 1, pFile) == 1);
+
+    fclose(pFile);
+
+    return success;
+}
+
+// Recorded calls, forwarded first so the stream only has calls made on a valid context
+
+void STDMETHODCALLTYPE CommandRecorder::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+    m_pContext->VSSetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+    if (m_recording)
+    {
+        PutSlots(OpSetConstantBuffers, StageVS, startSlot, numBuffers, reinterpret_cast<ID3D11DeviceChild* const*>(ppConstantBuffers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+    m_pContext->VSSetShaderResources(startSlot, numViews, ppShaderResourceViews);
+    if (m_recording)
+    {
+        PutSlots(OpSetShaderResources, StageVS, startSlot, numViews, reinterpret_cast<ID3D11DeviceChild* const*>(ppShaderResourceViews));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+    m_pContext->VSSetSamplers(startSlot, numSamplers, ppSamplers);
+    if (m_recording)
+    {
+        PutSlots(OpSetSamplers, StageVS, startSlot, numSamplers, reinterpret_cast<ID3D11DeviceChild* const*>(ppSamplers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::VSSetShader(ID3D11VertexShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances)
+{
+    m_pContext->VSSetShader(pShader, ppClassInstances, numClassInstances);
+    if (m_recording)
+    {
+        PutShader(StageVS, pShader, numClassInstances);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+    m_pContext->PSSetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+    if (m_recording)
+    {
+        PutSlots(OpSetConstantBuffers, StagePS, startSlot, numBuffers, reinterpret_cast<ID3D11DeviceChild* const*>(ppConstantBuffers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+    m_pContext->PSSetShaderResources(startSlot, numViews, ppShaderResourceViews);
+    if (m_recording)
+    {
+        PutSlots(OpSetShaderResources, StagePS, startSlot, numViews, reinterpret_cast<ID3D11DeviceChild* const*>(ppShaderResourceViews));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+    m_pContext->PSSetSamplers(startSlot, numSamplers, ppSamplers);
+    if (m_recording)
+    {
+        PutSlots(OpSetSamplers, StagePS, startSlot, numSamplers, reinterpret_cast<ID3D11DeviceChild* const*>(ppSamplers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::PSSetShader(ID3D11PixelShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances)
+{
+    m_pContext->PSSetShader(pShader, ppClassInstances, numClassInstances);
+    if (m_recording)
+    {
+        PutShader(StagePS, pShader, numClassInstances);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+    m_pContext->GSSetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+    if (m_recording)
+    {
+        PutSlots(OpSetConstantBuffers, StageGS, startSlot, numBuffers, reinterpret_cast<ID3D11DeviceChild* const*>(ppConstantBuffers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+    m_pContext->GSSetShaderResources(startSlot, numViews, ppShaderResourceViews);
+    if (m_recording)
+    {
+        PutSlots(OpSetShaderResources, StageGS, startSlot, numViews, reinterpret_cast<ID3D11DeviceChild* const*>(ppShaderResourceViews));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+    m_pContext->GSSetSamplers(startSlot, numSamplers, ppSamplers);
+    if (m_recording)
+    {
+        PutSlots(OpSetSamplers, StageGS, startSlot, numSamplers, reinterpret_cast<ID3D11DeviceChild* const*>(ppSamplers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GSSetShader(ID3D11GeometryShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances)
+{
+    m_pContext->GSSetShader(pShader, ppClassInstances, numClassInstances);
+    if (m_recording)
+    {
+        PutShader(StageGS, pShader, numClassInstances);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::HSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+    m_pContext->HSSetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+    if (m_recording)
+    {
+        PutSlots(OpSetConstantBuffers, StageHS, startSlot, numBuffers, reinterpret_cast<ID3D11DeviceChild* const*>(ppConstantBuffers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::HSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+    m_pContext->HSSetShaderResources(startSlot, numViews, ppShaderResourceViews);
+    if (m_recording)
+    {
+        PutSlots(OpSetShaderResources, StageHS, startSlot, numViews, reinterpret_cast<ID3D11DeviceChild* const*>(ppShaderResourceViews));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::HSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+    m_pContext->HSSetSamplers(startSlot, numSamplers, ppSamplers);
+    if (m_recording)
+    {
+        PutSlots(OpSetSamplers, StageHS, startSlot, numSamplers, reinterpret_cast<ID3D11DeviceChild* const*>(ppSamplers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::HSSetShader(ID3D11HullShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances)
+{
+    m_pContext->HSSetShader(pShader, ppClassInstances, numClassInstances);
+    if (m_recording)
+    {
+        PutShader(StageHS, pShader, numClassInstances);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+    m_pContext->DSSetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+    if (m_recording)
+    {
+        PutSlots(OpSetConstantBuffers, StageDS, startSlot, numBuffers, reinterpret_cast<ID3D11DeviceChild* const*>(ppConstantBuffers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+    m_pContext->DSSetShaderResources(startSlot, numViews, ppShaderResourceViews);
+    if (m_recording)
+    {
+        PutSlots(OpSetShaderResources, StageDS, startSlot, numViews, reinterpret_cast<ID3D11DeviceChild* const*>(ppShaderResourceViews));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+    m_pContext->DSSetSamplers(startSlot, numSamplers, ppSamplers);
+    if (m_recording)
+    {
+        PutSlots(OpSetSamplers, StageDS, startSlot, numSamplers, reinterpret_cast<ID3D11DeviceChild* const*>(ppSamplers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DSSetShader(ID3D11DomainShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances)
+{
+    m_pContext->DSSetShader(pShader, ppClassInstances, numClassInstances);
+    if (m_recording)
+    {
+        PutShader(StageDS, pShader, numClassInstances);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+    m_pContext->CSSetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+    if (m_recording)
+    {
+        PutSlots(OpSetConstantBuffers, StageCS, startSlot, numBuffers, reinterpret_cast<ID3D11DeviceChild* const*>(ppConstantBuffers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+    m_pContext->CSSetShaderResources(startSlot, numViews, ppShaderResourceViews);
+    if (m_recording)
+    {
+        PutSlots(OpSetShaderResources, StageCS, startSlot, numViews, reinterpret_cast<ID3D11DeviceChild* const*>(ppShaderResourceViews));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+    m_pContext->CSSetSamplers(startSlot, numSamplers, ppSamplers);
+    if (m_recording)
+    {
+        PutSlots(OpSetSamplers, StageCS, startSlot, numSamplers, reinterpret_cast<ID3D11DeviceChild* const*>(ppSamplers));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSSetShader(ID3D11ComputeShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances)
+{
+    m_pContext->CSSetShader(pShader, ppClassInstances, numClassInstances);
+    if (m_recording)
+    {
+        PutShader(StageCS, pShader, numClassInstances);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSSetUnorderedAccessViews(UINT startSlot, UINT numUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews, const UINT* pUAVInitialCounts)
+{
+    m_pContext->CSSetUnorderedAccessViews(startSlot, numUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    if (m_recording)
+    {
+        PutOp(OpCSSetUnorderedAccessViews);
+        Put(startSlot);
+        Put(numUAVs);
+        PutObjects(numUAVs, ppUnorderedAccessViews);
+        Put<UINT8>(pUAVInitialCounts != nullptr);
+        if (pUAVInitialCounts != nullptr)
+        {
+            PutBytes(pUAVInitialCounts, numUAVs * sizeof(UINT));
+        }
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DrawIndexed(UINT indexCount, UINT startIndexLocation, INT baseVertexLocation)
+{
+    m_pContext->DrawIndexed(indexCount, startIndexLocation, baseVertexLocation);
+    if (m_recording)
+    {
+        PutOp(OpDrawIndexed);
+        Put(indexCount);
+        Put(startIndexLocation);
+        Put(baseVertexLocation);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::Draw(UINT vertexCount, UINT startVertexLocation)
+{
+    m_pContext->Draw(vertexCount, startVertexLocation);
+    if (m_recording)
+    {
+        PutOp(OpDraw);
+        Put(vertexCount);
+        Put(startVertexLocation);
+    }
+}
+
+HRESULT STDMETHODCALLTYPE CommandRecorder::Map(ID3D11Resource* pResource, UINT subresource, D3D11_MAP mapType, UINT mapFlags, D3D11_MAPPED_SUBRESOURCE* pMappedResource)
+{
+    HRESULT result = m_pContext->Map(pResource, subresource, mapType, mapFlags, pMappedResource);
+    if (m_recording && SUCCEEDED(result) && pMappedResource != nullptr)
+    {
+        PendingMap pending = { pResource, subresource, mapType, mapFlags, static_cast<BYTE*>(pMappedResource->pData), GetMappedSize(pResource, subresource, *pMappedResource), {} };
+        if (mapType != D3D11_MAP_WRITE_DISCARD && mapType != D3D11_MAP_READ)
+        {
+            pending.snapshot.assign(pending.pData, pending.pData + pending.size);
+        }
+        m_pendingMaps.push_back(std::move(pending));
+    }
+    return result;
+}
+
+void STDMETHODCALLTYPE CommandRecorder::Unmap(ID3D11Resource* pResource, UINT subresource)
+{
+    if (m_recording)
+    {
+        auto it = std::find_if(m_pendingMaps.begin(), m_pendingMaps.end(), [pResource, subresource](const PendingMap& pending)
+        {
+            return pending.pResource == pResource && pending.subresource == subresource;
+        });
+        if (it != m_pendingMaps.end())
+        {
+            // Discarded contents are undefined, so all of it is stored, otherwise only the range which differs
+            size_t begin = 0;
+            size_t end = it->mapType == D3D11_MAP_READ ? 0 : it->size;
+            if (!it->snapshot.empty())
+            {
+                while (begin < end && it->pData[begin] == it->snapshot[begin])
+                {
+                    ++begin;
+                }
+                while (end > begin && it->pData[end - 1] == it->snapshot[end - 1])
+                {
+                    --end;
+                }
+            }
+
+            PutOp(OpMap);
+            PutObject(pResource);
+            Put(subresource);
+            Put<UINT32>(it->mapType);
+            Put(it->mapFlags);
+            Put<UINT64>(begin);
+            Put<UINT64>(end - begin);
+            PutBytes(it->pData + begin, end - begin);
+
+            m_pendingMaps.erase(it);
+        }
+    }
+    m_pContext->Unmap(pResource, subresource);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::IASetInputLayout(ID3D11InputLayout* pInputLayout)
+{
+    m_pContext->IASetInputLayout(pInputLayout);
+    if (m_recording)
+    {
+        PutOp(OpIASetInputLayout);
+        PutObject(pInputLayout);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets)
+{
+    m_pContext->IASetVertexBuffers(startSlot, numBuffers, ppVertexBuffers, pStrides, pOffsets);
+    if (m_recording)
+    {
+        PutOp(OpIASetVertexBuffers);
+        Put(startSlot);
+        Put(numBuffers);
+        PutObjects(numBuffers, ppVertexBuffers);
+        for (UINT i = 0; i < numBuffers; i++)
+        {
+            Put<UINT>(pStrides != nullptr ? pStrides[i] : 0);
+            Put<UINT>(pOffsets != nullptr ? pOffsets[i] : 0);
+        }
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT format, UINT offset)
+{
+    m_pContext->IASetIndexBuffer(pIndexBuffer, format, offset);
+    if (m_recording)
+    {
+        PutOp(OpIASetIndexBuffer);
+        PutObject(pIndexBuffer);
+        Put<UINT32>(format);
+        Put(offset);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+{
+    m_pContext->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+    if (m_recording)
+    {
+        PutOp(OpDrawIndexedInstanced);
+        Put(indexCountPerInstance);
+        Put(instanceCount);
+        Put(startIndexLocation);
+        Put(baseVertexLocation);
+        Put(startInstanceLocation);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DrawInstanced(UINT vertexCountPerInstance, UINT instanceCount, UINT startVertexLocation, UINT startInstanceLocation)
+{
+    m_pContext->DrawInstanced(vertexCountPerInstance, instanceCount, startVertexLocation, startInstanceLocation);
+    if (m_recording)
+    {
+        PutOp(OpDrawInstanced);
+        Put(vertexCountPerInstance);
+        Put(instanceCount);
+        Put(startVertexLocation);
+        Put(startInstanceLocation);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+    m_pContext->IASetPrimitiveTopology(topology);
+    if (m_recording)
+    {
+        PutOp(OpIASetPrimitiveTopology);
+        Put<UINT32>(topology);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::Begin(ID3D11Asynchronous* pAsync)
+{
+    m_pContext->Begin(pAsync);
+    // Only predicates affect rendering, timing and statistics queries of profilers are not replayed
+    ID3D11Predicate* pPredicate = nullptr;
+    if (m_recording && SUCCEEDED(pAsync->QueryInterface(__uuidof(ID3D11Predicate), (void**)&pPredicate)))
+    {
+        PutOp(OpBegin);
+        PutObject(pPredicate);
+        SAFE_RELEASE(pPredicate);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::End(ID3D11Asynchronous* pAsync)
+{
+    m_pContext->End(pAsync);
+    ID3D11Predicate* pPredicate = nullptr;
+    if (m_recording && SUCCEEDED(pAsync->QueryInterface(__uuidof(ID3D11Predicate), (void**)&pPredicate)))
+    {
+        PutOp(OpEnd);
+        PutObject(pPredicate);
+        SAFE_RELEASE(pPredicate);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::SetPredication(ID3D11Predicate* pPredicate, BOOL predicateValue)
+{
+    m_pContext->SetPredication(pPredicate, predicateValue);
+    if (m_recording)
+    {
+        PutOp(OpSetPredication);
+        PutObject(pPredicate);
+        Put(predicateValue);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView)
+{
+    m_pContext->OMSetRenderTargets(numViews, ppRenderTargetViews, pDepthStencilView);
+    if (m_recording)
+    {
+        PutOp(OpOMSetRenderTargets);
+        Put(numViews);
+        PutObjects(numViews, ppRenderTargetViews);
+        PutObject(pDepthStencilView);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::OMSetRenderTargetsAndUnorderedAccessViews(UINT numRTVs, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView, UINT uavStartSlot, UINT numUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews, const UINT* pUAVInitialCounts)
+{
+    m_pContext->OMSetRenderTargetsAndUnorderedAccessViews(numRTVs, ppRenderTargetViews, pDepthStencilView, uavStartSlot, numUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+    if (m_recording)
+    {
+        // Keep values mean the part is not changed, views are only written if set
+        bool keepTargets = numRTVs == D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL;
+        bool keepUAVs = numUAVs == D3D11_KEEP_UNORDERED_ACCESS_VIEWS;
+
+        PutOp(OpOMSetRenderTargetsAndUnorderedAccessViews);
+        Put(numRTVs);
+        if (!keepTargets)
+        {
+            PutObjects(numRTVs, ppRenderTargetViews);
+            PutObject(pDepthStencilView);
+        }
+        Put(uavStartSlot);
+        Put(numUAVs);
+        if (!keepUAVs)
+        {
+            PutObjects(numUAVs, ppUnorderedAccessViews);
+            Put<UINT8>(pUAVInitialCounts != nullptr);
+            if (pUAVInitialCounts != nullptr)
+            {
+                PutBytes(pUAVInitialCounts, numUAVs * sizeof(UINT));
+            }
+        }
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::OMSetBlendState(ID3D11BlendState* pBlendState, const FLOAT blendFactor[4], UINT sampleMask)
+{
+    m_pContext->OMSetBlendState(pBlendState, blendFactor, sampleMask);
+    if (m_recording)
+    {
+        PutOp(OpOMSetBlendState);
+        PutObject(pBlendState);
+        Put<UINT8>(blendFactor != nullptr);
+        if (blendFactor != nullptr)
+        {
+            PutBytes(blendFactor, 4 * sizeof(FLOAT));
+        }
+        Put(sampleMask);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::OMSetDepthStencilState(ID3D11DepthStencilState* pDepthStencilState, UINT stencilRef)
+{
+    m_pContext->OMSetDepthStencilState(pDepthStencilState, stencilRef);
+    if (m_recording)
+    {
+        PutOp(OpOMSetDepthStencilState);
+        PutObject(pDepthStencilState);
+        Put(stencilRef);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::SOSetTargets(UINT numBuffers, ID3D11Buffer* const* ppSOTargets, const UINT* pOffsets)
+{
+    m_pContext->SOSetTargets(numBuffers, ppSOTargets, pOffsets);
+    if (m_recording)
+    {
+        PutOp(OpSOSetTargets);
+        Put(numBuffers);
+        PutObjects(numBuffers, ppSOTargets);
+        for (UINT i = 0; i < numBuffers; i++)
+        {
+            Put<UINT>(pOffsets != nullptr ? pOffsets[i] : 0);
+        }
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DrawAuto()
+{
+    m_pContext->DrawAuto();
+    if (m_recording)
+    {
+        PutOp(OpDrawAuto);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DrawIndexedInstancedIndirect(ID3D11Buffer* pBufferForArgs, UINT alignedByteOffsetForArgs)
+{
+    m_pContext->DrawIndexedInstancedIndirect(pBufferForArgs, alignedByteOffsetForArgs);
+    if (m_recording)
+    {
+        PutOp(OpDrawIndexedInstancedIndirect);
+        PutObject(pBufferForArgs);
+        Put(alignedByteOffsetForArgs);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DrawInstancedIndirect(ID3D11Buffer* pBufferForArgs, UINT alignedByteOffsetForArgs)
+{
+    m_pContext->DrawInstancedIndirect(pBufferForArgs, alignedByteOffsetForArgs);
+    if (m_recording)
+    {
+        PutOp(OpDrawInstancedIndirect);
+        PutObject(pBufferForArgs);
+        Put(alignedByteOffsetForArgs);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::Dispatch(UINT threadGroupCountX, UINT threadGroupCountY, UINT threadGroupCountZ)
+{
+    m_pContext->Dispatch(threadGroupCountX, threadGroupCountY, threadGroupCountZ);
+    if (m_recording)
+    {
+        PutOp(OpDispatch);
+        Put(threadGroupCountX);
+        Put(threadGroupCountY);
+        Put(threadGroupCountZ);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DispatchIndirect(ID3D11Buffer* pBufferForArgs, UINT alignedByteOffsetForArgs)
+{
+    m_pContext->DispatchIndirect(pBufferForArgs, alignedByteOffsetForArgs);
+    if (m_recording)
+    {
+        PutOp(OpDispatchIndirect);
+        PutObject(pBufferForArgs);
+        Put(alignedByteOffsetForArgs);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::RSSetState(ID3D11RasterizerState* pRasterizerState)
+{
+    m_pContext->RSSetState(pRasterizerState);
+    if (m_recording)
+    {
+        PutOp(OpRSSetState);
+        PutObject(pRasterizerState);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* pViewports)
+{
+    m_pContext->RSSetViewports(numViewports, pViewports);
+    if (m_recording)
+    {
+        PutOp(OpRSSetViewports);
+        Put(numViewports);
+        PutBytes(pViewports, numViewports * sizeof(D3D11_VIEWPORT));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::RSSetScissorRects(UINT numRects, const D3D11_RECT* pRects)
+{
+    m_pContext->RSSetScissorRects(numRects, pRects);
+    if (m_recording)
+    {
+        PutOp(OpRSSetScissorRects);
+        Put(numRects);
+        PutBytes(pRects, numRects * sizeof(D3D11_RECT));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CopySubresourceRegion(ID3D11Resource* pDstResource, UINT dstSubresource, UINT dstX, UINT dstY, UINT dstZ, ID3D11Resource* pSrcResource, UINT srcSubresource, const D3D11_BOX* pSrcBox)
+{
+    m_pContext->CopySubresourceRegion(pDstResource, dstSubresource, dstX, dstY, dstZ, pSrcResource, srcSubresource, pSrcBox);
+    if (m_recording)
+    {
+        PutOp(OpCopySubresourceRegion);
+        PutObject(pDstResource);
+        Put(dstSubresource);
+        Put(dstX);
+        Put(dstY);
+        Put(dstZ);
+        PutObject(pSrcResource);
+        Put(srcSubresource);
+        Put<UINT8>(pSrcBox != nullptr);
+        if (pSrcBox != nullptr)
+        {
+            Put(*pSrcBox);
+        }
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CopyResource(ID3D11Resource* pDstResource, ID3D11Resource* pSrcResource)
+{
+    m_pContext->CopyResource(pDstResource, pSrcResource);
+    if (m_recording)
+    {
+        PutOp(OpCopyResource);
+        PutObject(pDstResource);
+        PutObject(pSrcResource);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::UpdateSubresource(ID3D11Resource* pDstResource, UINT dstSubresource, const D3D11_BOX* pDstBox, const void* pSrcData, UINT srcRowPitch, UINT srcDepthPitch)
+{
+    m_pContext->UpdateSubresource(pDstResource, dstSubresource, pDstBox, pSrcData, srcRowPitch, srcDepthPitch);
+    if (m_recording)
+    {
+        size_t size = GetUpdateSize(pDstResource, dstSubresource, pDstBox, srcRowPitch, srcDepthPitch);
+        if (size == 0)
+        {
+            ++m_unsupported;
+            return;
+        }
+        PutOp(OpUpdateSubresource);
+        PutObject(pDstResource);
+        Put(dstSubresource);
+        Put<UINT8>(pDstBox != nullptr);
+        if (pDstBox != nullptr)
+        {
+            Put(*pDstBox);
+        }
+        Put(srcRowPitch);
+        Put(srcDepthPitch);
+        Put<UINT64>(size);
+        PutBytes(pSrcData, size);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CopyStructureCount(ID3D11Buffer* pDstBuffer, UINT dstAlignedByteOffset, ID3D11UnorderedAccessView* pSrcView)
+{
+    m_pContext->CopyStructureCount(pDstBuffer, dstAlignedByteOffset, pSrcView);
+    if (m_recording)
+    {
+        PutOp(OpCopyStructureCount);
+        PutObject(pDstBuffer);
+        Put(dstAlignedByteOffset);
+        PutObject(pSrcView);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::ClearRenderTargetView(ID3D11RenderTargetView* pRenderTargetView, const FLOAT colorRGBA[4])
+{
+    m_pContext->ClearRenderTargetView(pRenderTargetView, colorRGBA);
+    if (m_recording)
+    {
+        PutOp(OpClearRenderTargetView);
+        PutObject(pRenderTargetView);
+        PutBytes(colorRGBA, 4 * sizeof(FLOAT));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView* pUnorderedAccessView, const UINT values[4])
+{
+    m_pContext->ClearUnorderedAccessViewUint(pUnorderedAccessView, values);
+    if (m_recording)
+    {
+        PutOp(OpClearUnorderedAccessViewUint);
+        PutObject(pUnorderedAccessView);
+        PutBytes(values, 4 * sizeof(UINT));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::ClearUnorderedAccessViewFloat(ID3D11UnorderedAccessView* pUnorderedAccessView, const FLOAT values[4])
+{
+    m_pContext->ClearUnorderedAccessViewFloat(pUnorderedAccessView, values);
+    if (m_recording)
+    {
+        PutOp(OpClearUnorderedAccessViewFloat);
+        PutObject(pUnorderedAccessView);
+        PutBytes(values, 4 * sizeof(FLOAT));
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::ClearDepthStencilView(ID3D11DepthStencilView* pDepthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil)
+{
+    m_pContext->ClearDepthStencilView(pDepthStencilView, clearFlags, depth, stencil);
+    if (m_recording)
+    {
+        PutOp(OpClearDepthStencilView);
+        PutObject(pDepthStencilView);
+        Put(clearFlags);
+        Put(depth);
+        Put(stencil);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GenerateMips(ID3D11ShaderResourceView* pShaderResourceView)
+{
+    m_pContext->GenerateMips(pShaderResourceView);
+    if (m_recording)
+    {
+        PutOp(OpGenerateMips);
+        PutObject(pShaderResourceView);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::SetResourceMinLOD(ID3D11Resource* pResource, FLOAT minLOD)
+{
+    m_pContext->SetResourceMinLOD(pResource, minLOD);
+    if (m_recording)
+    {
+        PutOp(OpSetResourceMinLOD);
+        PutObject(pResource);
+        Put(minLOD);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::ResolveSubresource(ID3D11Resource* pDstResource, UINT dstSubresource, ID3D11Resource* pSrcResource, UINT srcSubresource, DXGI_FORMAT format)
+{
+    m_pContext->ResolveSubresource(pDstResource, dstSubresource, pSrcResource, srcSubresource, format);
+    if (m_recording)
+    {
+        PutOp(OpResolveSubresource);
+        PutObject(pDstResource);
+        Put(dstSubresource);
+        PutObject(pSrcResource);
+        Put(srcSubresource);
+        Put<UINT32>(format);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::ExecuteCommandList(ID3D11CommandList* pCommandList, BOOL restoreContextState)
+{
+    m_pContext->ExecuteCommandList(pCommandList, restoreContextState);
+    if (m_recording)
+    {
+        ++m_unsupported;
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::ClearState()
+{
+    m_pContext->ClearState();
+    if (m_recording)
+    {
+        PutOp(OpClearState);
+    }
+}
+
+void STDMETHODCALLTYPE CommandRecorder::Flush()
+{
+    m_pContext->Flush();
+    if (m_recording)
+    {
+        PutOp(OpFlush);
+    }
+}
+
+// Forwarded only
+
+void STDMETHODCALLTYPE CommandRecorder::GetDevice(ID3D11Device** ppDevice)
+{
+    m_pContext->GetDevice(ppDevice);
+}
+
+HRESULT STDMETHODCALLTYPE CommandRecorder::GetPrivateData(REFGUID guid, UINT* pDataSize, void* pData)
+{
+    return m_pContext->GetPrivateData(guid, pDataSize, pData);
+}
+
+HRESULT STDMETHODCALLTYPE CommandRecorder::SetPrivateData(REFGUID guid, UINT dataSize, const void* pData)
+{
+    return m_pContext->SetPrivateData(guid, dataSize, pData);
+}
+
+HRESULT STDMETHODCALLTYPE CommandRecorder::SetPrivateDataInterface(REFGUID guid, const IUnknown* pData)
+{
+    return m_pContext->SetPrivateDataInterface(guid, pData);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::VSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+    m_pContext->VSGetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::VSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+    m_pContext->VSGetShaderResources(startSlot, numViews, ppShaderResourceViews);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::VSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers)
+{
+    m_pContext->VSGetSamplers(startSlot, numSamplers, ppSamplers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::VSGetShader(ID3D11VertexShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+    m_pContext->VSGetShader(ppShader, ppClassInstances, pNumClassInstances);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::PSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+    m_pContext->PSGetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::PSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+    m_pContext->PSGetShaderResources(startSlot, numViews, ppShaderResourceViews);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::PSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers)
+{
+    m_pContext->PSGetSamplers(startSlot, numSamplers, ppSamplers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::PSGetShader(ID3D11PixelShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+    m_pContext->PSGetShader(ppShader, ppClassInstances, pNumClassInstances);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+    m_pContext->GSGetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+    m_pContext->GSGetShaderResources(startSlot, numViews, ppShaderResourceViews);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers)
+{
+    m_pContext->GSGetSamplers(startSlot, numSamplers, ppSamplers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GSGetShader(ID3D11GeometryShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+    m_pContext->GSGetShader(ppShader, ppClassInstances, pNumClassInstances);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::HSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+    m_pContext->HSGetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::HSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+    m_pContext->HSGetShaderResources(startSlot, numViews, ppShaderResourceViews);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::HSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers)
+{
+    m_pContext->HSGetSamplers(startSlot, numSamplers, ppSamplers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::HSGetShader(ID3D11HullShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+    m_pContext->HSGetShader(ppShader, ppClassInstances, pNumClassInstances);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+    m_pContext->DSGetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+    m_pContext->DSGetShaderResources(startSlot, numViews, ppShaderResourceViews);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers)
+{
+    m_pContext->DSGetSamplers(startSlot, numSamplers, ppSamplers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::DSGetShader(ID3D11DomainShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+    m_pContext->DSGetShader(ppShader, ppClassInstances, pNumClassInstances);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+    m_pContext->CSGetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+    m_pContext->CSGetShaderResources(startSlot, numViews, ppShaderResourceViews);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers)
+{
+    m_pContext->CSGetSamplers(startSlot, numSamplers, ppSamplers);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSGetShader(ID3D11ComputeShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+    m_pContext->CSGetShader(ppShader, ppClassInstances, pNumClassInstances);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::CSGetUnorderedAccessViews(UINT startSlot, UINT numUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews)
+{
+    m_pContext->CSGetUnorderedAccessViews(startSlot, numUAVs, ppUnorderedAccessViews);
+}
+
+HRESULT STDMETHODCALLTYPE CommandRecorder::GetData(ID3D11Asynchronous* pAsync, void* pData, UINT dataSize, UINT getDataFlags)
+{
+    return m_pContext->GetData(pAsync, pData, dataSize, getDataFlags);
+}
+
+FLOAT STDMETHODCALLTYPE CommandRecorder::GetResourceMinLOD(ID3D11Resource* pResource)
+{
+    return m_pContext->GetResourceMinLOD(pResource);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::IAGetInputLayout(ID3D11InputLayout** ppInputLayout)
+{
+    m_pContext->IAGetInputLayout(ppInputLayout);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::IAGetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppVertexBuffers, UINT* pStrides, UINT* pOffsets)
+{
+    m_pContext->IAGetVertexBuffers(startSlot, numBuffers, ppVertexBuffers, pStrides, pOffsets);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::IAGetIndexBuffer(ID3D11Buffer** pIndexBuffer, DXGI_FORMAT* pFormat, UINT* pOffset)
+{
+    m_pContext->IAGetIndexBuffer(pIndexBuffer, pFormat, pOffset);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::IAGetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY* pTopology)
+{
+    m_pContext->IAGetPrimitiveTopology(pTopology);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::GetPredication(ID3D11Predicate** ppPredicate, BOOL* pPredicateValue)
+{
+    m_pContext->GetPredication(ppPredicate, pPredicateValue);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::OMGetRenderTargets(UINT numViews, ID3D11RenderTargetView** ppRenderTargetViews, ID3D11DepthStencilView** ppDepthStencilView)
+{
+    m_pContext->OMGetRenderTargets(numViews, ppRenderTargetViews, ppDepthStencilView);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::OMGetRenderTargetsAndUnorderedAccessViews(UINT numRTVs, ID3D11RenderTargetView** ppRenderTargetViews, ID3D11DepthStencilView** ppDepthStencilView, UINT uavStartSlot, UINT numUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews)
+{
+    m_pContext->OMGetRenderTargetsAndUnorderedAccessViews(numRTVs, ppRenderTargetViews, ppDepthStencilView, uavStartSlot, numUAVs, ppUnorderedAccessViews);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::OMGetBlendState(ID3D11BlendState** ppBlendState, FLOAT blendFactor[4], UINT* pSampleMask)
+{
+    m_pContext->OMGetBlendState(ppBlendState, blendFactor, pSampleMask);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::OMGetDepthStencilState(ID3D11DepthStencilState** ppDepthStencilState, UINT* pStencilRef)
+{
+    m_pContext->OMGetDepthStencilState(ppDepthStencilState, pStencilRef);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::SOGetTargets(UINT numBuffers, ID3D11Buffer** ppSOTargets)
+{
+    m_pContext->SOGetTargets(numBuffers, ppSOTargets);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::RSGetState(ID3D11RasterizerState** ppRasterizerState)
+{
+    m_pContext->RSGetState(ppRasterizerState);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::RSGetViewports(UINT* pNumViewports, D3D11_VIEWPORT* pViewports)
+{
+    m_pContext->RSGetViewports(pNumViewports, pViewports);
+}
+
+void STDMETHODCALLTYPE CommandRecorder::RSGetScissorRects(UINT* pNumRects, D3D11_RECT* pRects)
+{
+    m_pContext->RSGetScissorRects(pNumRects, pRects);
+}
+
+D3D11_DEVICE_CONTEXT_TYPE STDMETHODCALLTYPE CommandRecorder::GetType()
+{
+    return m_pContext->GetType();
+}
+
+UINT STDMETHODCALLTYPE CommandRecorder::GetContextFlags()
+{
+    return m_pContext->GetContextFlags();
+}
+
+HRESULT STDMETHODCALLTYPE CommandRecorder::FinishCommandList(BOOL restoreDeferredContextState, ID3D11CommandList** ppCommandList)
+{
+    return m_pContext->FinishCommandList(restoreDeferredContextState, ppCommandList);
+}
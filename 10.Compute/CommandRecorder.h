@@ -0,0 +1,280 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Recording layer around device context for driver overhead measurements.
+ * Every call is forwarded to the wrapped context, calls which set state or do GPU work are also appended to
+ * a compact command stream: opcode, ids of objects in a table filled on first use, then arguments.
+ * Contents written through Map are stored at Unmap, only the changed range for maps without discard.
+ * Replay issues the stream on a context as fast as it is read. Objects are resolved through the table, which holds
+ * references, so a capture is replayed in the session it was taken in, saved file keeps stream and object names.
+ * Getters and timing queries are forwarded only, command lists are counted as unsupported.
+ */
+class CommandRecorder : public ID3D11DeviceContext
+{
+public:
+    struct Stats
+    {
+        UINT commands;
+        UINT objects;
+        size_t streamBytes;
+        size_t payloadBytes; // Map and UpdateSubresource contents
+        UINT unsupported;    // Calls forwarded only, replay differs from capture if any
+    };
+
+    CommandRecorder()
+        : m_pContext(nullptr)
+        , m_recording(false)
+        , m_commands(0)
+        , m_payloadBytes(0)
+        , m_unsupported(0)
+    {}
+    ~CommandRecorder() { Clear(); }
+
+    /** Drop previous capture and record calls forwarded to pContext from now on */
+    void StartCapture(ID3D11DeviceContext* pContext);
+    void StopCapture();
+    inline bool IsRecording() const { return m_recording; }
+    inline bool HasCapture() const { return !m_recording && m_commands > 0; }
+    /** Wrapped context */
+    inline ID3D11DeviceContext* GetContext() const { return m_pContext; }
+    /** Release captured objects */
+    void Clear();
+
+    /** Issue captured calls on pContext, from cleared state like the capture starts with. Returns false on corrupt stream */
+    bool Replay(ID3D11DeviceContext* pContext) const;
+    /** Stream with debug names of objects in table order */
+    bool Save(const std::wstring& path) const;
+
+    inline Stats GetStats() const { return { m_commands, (UINT)m_objects.size(), m_stream.size(), m_payloadBytes, m_unsupported }; }
+
+    // ID3D11DeviceContext
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppObject) override;
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+    void STDMETHODCALLTYPE GetDevice(ID3D11Device** ppDevice) override;
+    HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID guid, UINT* pDataSize, void* pData) override;
+    HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID guid, UINT dataSize, const void* pData) override;
+    HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID guid, const IUnknown* pData) override;
+    void STDMETHODCALLTYPE VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers) override;
+    void STDMETHODCALLTYPE VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers) override;
+    void STDMETHODCALLTYPE VSSetShader(ID3D11VertexShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances) override;
+    void STDMETHODCALLTYPE VSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers) override;
+    void STDMETHODCALLTYPE VSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE VSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers) override;
+    void STDMETHODCALLTYPE VSGetShader(ID3D11VertexShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances) override;
+    void STDMETHODCALLTYPE PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers) override;
+    void STDMETHODCALLTYPE PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers) override;
+    void STDMETHODCALLTYPE PSSetShader(ID3D11PixelShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances) override;
+    void STDMETHODCALLTYPE PSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers) override;
+    void STDMETHODCALLTYPE PSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE PSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers) override;
+    void STDMETHODCALLTYPE PSGetShader(ID3D11PixelShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances) override;
+    void STDMETHODCALLTYPE GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers) override;
+    void STDMETHODCALLTYPE GSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE GSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers) override;
+    void STDMETHODCALLTYPE GSSetShader(ID3D11GeometryShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances) override;
+    void STDMETHODCALLTYPE GSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers) override;
+    void STDMETHODCALLTYPE GSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE GSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers) override;
+    void STDMETHODCALLTYPE GSGetShader(ID3D11GeometryShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances) override;
+    void STDMETHODCALLTYPE HSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers) override;
+    void STDMETHODCALLTYPE HSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE HSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers) override;
+    void STDMETHODCALLTYPE HSSetShader(ID3D11HullShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances) override;
+    void STDMETHODCALLTYPE HSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers) override;
+    void STDMETHODCALLTYPE HSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE HSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers) override;
+    void STDMETHODCALLTYPE HSGetShader(ID3D11HullShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances) override;
+    void STDMETHODCALLTYPE DSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers) override;
+    void STDMETHODCALLTYPE DSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE DSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers) override;
+    void STDMETHODCALLTYPE DSSetShader(ID3D11DomainShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances) override;
+    void STDMETHODCALLTYPE DSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers) override;
+    void STDMETHODCALLTYPE DSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE DSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers) override;
+    void STDMETHODCALLTYPE DSGetShader(ID3D11DomainShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances) override;
+    void STDMETHODCALLTYPE CSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers) override;
+    void STDMETHODCALLTYPE CSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE CSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers) override;
+    void STDMETHODCALLTYPE CSSetShader(ID3D11ComputeShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances) override;
+    void STDMETHODCALLTYPE CSGetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppConstantBuffers) override;
+    void STDMETHODCALLTYPE CSGetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView** ppShaderResourceViews) override;
+    void STDMETHODCALLTYPE CSGetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState** ppSamplers) override;
+    void STDMETHODCALLTYPE CSGetShader(ID3D11ComputeShader** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances) override;
+    void STDMETHODCALLTYPE CSSetUnorderedAccessViews(UINT startSlot, UINT numUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews, const UINT* pUAVInitialCounts) override;
+    void STDMETHODCALLTYPE CSGetUnorderedAccessViews(UINT startSlot, UINT numUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews) override;
+    void STDMETHODCALLTYPE DrawIndexed(UINT indexCount, UINT startIndexLocation, INT baseVertexLocation) override;
+    void STDMETHODCALLTYPE Draw(UINT vertexCount, UINT startVertexLocation) override;
+    HRESULT STDMETHODCALLTYPE Map(ID3D11Resource* pResource, UINT subresource, D3D11_MAP mapType, UINT mapFlags, D3D11_MAPPED_SUBRESOURCE* pMappedResource) override;
+    void STDMETHODCALLTYPE Unmap(ID3D11Resource* pResource, UINT subresource) override;
+    void STDMETHODCALLTYPE IASetInputLayout(ID3D11InputLayout* pInputLayout) override;
+    void STDMETHODCALLTYPE IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets) override;
+    void STDMETHODCALLTYPE IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT format, UINT offset) override;
+    void STDMETHODCALLTYPE DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation) override;
+    void STDMETHODCALLTYPE DrawInstanced(UINT vertexCountPerInstance, UINT instanceCount, UINT startVertexLocation, UINT startInstanceLocation) override;
+    void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+    void STDMETHODCALLTYPE Begin(ID3D11Asynchronous* pAsync) override;
+    void STDMETHODCALLTYPE End(ID3D11Asynchronous* pAsync) override;
+    HRESULT STDMETHODCALLTYPE GetData(ID3D11Asynchronous* pAsync, void* pData, UINT dataSize, UINT getDataFlags) override;
+    void STDMETHODCALLTYPE SetPredication(ID3D11Predicate* pPredicate, BOOL predicateValue) override;
+    void STDMETHODCALLTYPE OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView) override;
+    void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews(UINT numRTVs, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView, UINT uavStartSlot, UINT numUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews, const UINT* pUAVInitialCounts) override;
+    void STDMETHODCALLTYPE OMSetBlendState(ID3D11BlendState* pBlendState, const FLOAT blendFactor[4], UINT sampleMask) override;
+    void STDMETHODCALLTYPE OMSetDepthStencilState(ID3D11DepthStencilState* pDepthStencilState, UINT stencilRef) override;
+    void STDMETHODCALLTYPE SOSetTargets(UINT numBuffers, ID3D11Buffer* const* ppSOTargets, const UINT* pOffsets) override;
+    void STDMETHODCALLTYPE DrawAuto() override;
+    void STDMETHODCALLTYPE DrawIndexedInstancedIndirect(ID3D11Buffer* pBufferForArgs, UINT alignedByteOffsetForArgs) override;
+    void STDMETHODCALLTYPE DrawInstancedIndirect(ID3D11Buffer* pBufferForArgs, UINT alignedByteOffsetForArgs) override;
+    void STDMETHODCALLTYPE Dispatch(UINT threadGroupCountX, UINT threadGroupCountY, UINT threadGroupCountZ) override;
+    void STDMETHODCALLTYPE DispatchIndirect(ID3D11Buffer* pBufferForArgs, UINT alignedByteOffsetForArgs) override;
+    void STDMETHODCALLTYPE RSSetState(ID3D11RasterizerState* pRasterizerState) override;
+    void STDMETHODCALLTYPE RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* pViewports) override;
+    void STDMETHODCALLTYPE RSSetScissorRects(UINT numRects, const D3D11_RECT* pRects) override;
+    void STDMETHODCALLTYPE CopySubresourceRegion(ID3D11Resource* pDstResource, UINT dstSubresource, UINT dstX, UINT dstY, UINT dstZ, ID3D11Resource* pSrcResource, UINT srcSubresource, const D3D11_BOX* pSrcBox) override;
+    void STDMETHODCALLTYPE CopyResource(ID3D11Resource* pDstResource, ID3D11Resource* pSrcResource) override;
+    void STDMETHODCALLTYPE UpdateSubresource(ID3D11Resource* pDstResource, UINT dstSubresource, const D3D11_BOX* pDstBox, const void* pSrcData, UINT srcRowPitch, UINT srcDepthPitch) override;
+    void STDMETHODCALLTYPE CopyStructureCount(ID3D11Buffer* pDstBuffer, UINT dstAlignedByteOffset, ID3D11UnorderedAccessView* pSrcView) override;
+    void STDMETHODCALLTYPE ClearRenderTargetView(ID3D11RenderTargetView* pRenderTargetView, const FLOAT colorRGBA[4]) override;
+    void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView* pUnorderedAccessView, const UINT values[4]) override;
+    void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(ID3D11UnorderedAccessView* pUnorderedAccessView, const FLOAT values[4]) override;
+    void STDMETHODCALLTYPE ClearDepthStencilView(ID3D11DepthStencilView* pDepthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil) override;
+    void STDMETHODCALLTYPE GenerateMips(ID3D11ShaderResourceView* pShaderResourceView) override;
+    void STDMETHODCALLTYPE SetResourceMinLOD(ID3D11Resource* pResource, FLOAT minLOD) override;
+    FLOAT STDMETHODCALLTYPE GetResourceMinLOD(ID3D11Resource* pResource) override;
+    void STDMETHODCALLTYPE ResolveSubresource(ID3D11Resource* pDstResource, UINT dstSubresource, ID3D11Resource* pSrcResource, UINT srcSubresource, DXGI_FORMAT format) override;
+    void STDMETHODCALLTYPE ExecuteCommandList(ID3D11CommandList* pCommandList, BOOL restoreContextState) override;
+    void STDMETHODCALLTYPE IAGetInputLayout(ID3D11InputLayout** ppInputLayout) override;
+    void STDMETHODCALLTYPE IAGetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer** ppVertexBuffers, UINT* pStrides, UINT* pOffsets) override;
+    void STDMETHODCALLTYPE IAGetIndexBuffer(ID3D11Buffer** pIndexBuffer, DXGI_FORMAT* pFormat, UINT* pOffset) override;
+    void STDMETHODCALLTYPE IAGetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY* pTopology) override;
+    void STDMETHODCALLTYPE GetPredication(ID3D11Predicate** ppPredicate, BOOL* pPredicateValue) override;
+    void STDMETHODCALLTYPE OMGetRenderTargets(UINT numViews, ID3D11RenderTargetView** ppRenderTargetViews, ID3D11DepthStencilView** ppDepthStencilView) override;
+    void STDMETHODCALLTYPE OMGetRenderTargetsAndUnorderedAccessViews(UINT numRTVs, ID3D11RenderTargetView** ppRenderTargetViews, ID3D11DepthStencilView** ppDepthStencilView, UINT uavStartSlot, UINT numUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews) override;
+    void STDMETHODCALLTYPE OMGetBlendState(ID3D11BlendState** ppBlendState, FLOAT blendFactor[4], UINT* pSampleMask) override;
+    void STDMETHODCALLTYPE OMGetDepthStencilState(ID3D11DepthStencilState** ppDepthStencilState, UINT* pStencilRef) override;
+    void STDMETHODCALLTYPE SOGetTargets(UINT numBuffers, ID3D11Buffer** ppSOTargets) override;
+    void STDMETHODCALLTYPE RSGetState(ID3D11RasterizerState** ppRasterizerState) override;
+    void STDMETHODCALLTYPE RSGetViewports(UINT* pNumViewports, D3D11_VIEWPORT* pViewports) override;
+    void STDMETHODCALLTYPE RSGetScissorRects(UINT* pNumRects, D3D11_RECT* pRects) override;
+    void STDMETHODCALLTYPE ClearState() override;
+    void STDMETHODCALLTYPE Flush() override;
+    D3D11_DEVICE_CONTEXT_TYPE STDMETHODCALLTYPE GetType() override;
+    UINT STDMETHODCALLTYPE GetContextFlags() override;
+    HRESULT STDMETHODCALLTYPE FinishCommandList(BOOL restoreDeferredContextState, ID3D11CommandList** ppCommandList) override;
+
+private:
+    enum Op : UINT8
+    {
+        OpSetConstantBuffers = 0,
+        OpSetShaderResources,
+        OpSetSamplers,
+        OpSetShader,
+        OpCSSetUnorderedAccessViews,
+        OpDrawIndexed,
+        OpDraw,
+        OpMap,
+        OpIASetInputLayout,
+        OpIASetVertexBuffers,
+        OpIASetIndexBuffer,
+        OpDrawIndexedInstanced,
+        OpDrawInstanced,
+        OpIASetPrimitiveTopology,
+        OpBegin,
+        OpEnd,
+        OpSetPredication,
+        OpOMSetRenderTargets,
+        OpOMSetRenderTargetsAndUnorderedAccessViews,
+        OpOMSetBlendState,
+        OpOMSetDepthStencilState,
+        OpSOSetTargets,
+        OpDrawAuto,
+        OpDrawIndexedInstancedIndirect,
+        OpDrawInstancedIndirect,
+        OpDispatch,
+        OpDispatchIndirect,
+        OpRSSetState,
+        OpRSSetViewports,
+        OpRSSetScissorRects,
+        OpCopySubresourceRegion,
+        OpCopyResource,
+        OpUpdateSubresource,
+        OpCopyStructureCount,
+        OpClearRenderTargetView,
+        OpClearUnorderedAccessViewUint,
+        OpClearUnorderedAccessViewFloat,
+        OpClearDepthStencilView,
+        OpGenerateMips,
+        OpSetResourceMinLOD,
+        OpResolveSubresource,
+        OpClearState,
+        OpFlush,
+
+        OpCount
+    };
+
+    enum Stage : UINT8
+    {
+        StageVS = 0,
+        StagePS,
+        StageGS,
+        StageHS,
+        StageDS,
+        StageCS
+    };
+
+    /** Map waiting for Unmap, written range is found at Unmap */
+    struct PendingMap
+    {
+        ID3D11Resource* pResource;
+        UINT subresource;
+        D3D11_MAP mapType;
+        UINT mapFlags;
+        BYTE* pData;
+        size_t size;
+        std::vector<BYTE> snapshot; // Contents at Map, maps without discard keep what is not written
+    };
+
+    template <typename T>
+    void Put(const T& value)
+    {
+        const BYTE* pBytes = reinterpret_cast<const BYTE*>(&value);
+        m_stream.insert(m_stream.end(), pBytes, pBytes + sizeof(T));
+    }
+    void PutOp(Op op);
+    void PutObject(ID3D11DeviceChild* pObject);
+    template <typename T>
+    void PutObjects(UINT count, T* const* ppObjects)
+    {
+        for (UINT i = 0; i < count; i++)
+        {
+            PutObject(ppObjects != nullptr ? ppObjects[i] : nullptr);
+        }
+    }
+    void PutBytes(const void* pData, size_t size);
+    void PutSlots(Op op, Stage stage, UINT startSlot, UINT count, ID3D11DeviceChild* const* ppObjects);
+    void PutShader(Stage stage, ID3D11DeviceChild* pShader, UINT numClassInstances);
+
+    static size_t GetMappedSize(ID3D11Resource* pResource, UINT subresource, const D3D11_MAPPED_SUBRESOURCE& mapped);
+    static size_t GetUpdateSize(ID3D11Resource* pResource, UINT subresource, const D3D11_BOX* pBox, UINT rowPitch, UINT depthPitch);
+
+private:
+    ID3D11DeviceContext* m_pContext;
+    bool m_recording;
+
+    std::vector<BYTE> m_stream;
+    std::vector<ID3D11DeviceChild*> m_objects; // Referenced, id is index plus one, zero is null
+    std::unordered_map<ID3D11DeviceChild*, UINT> m_objectIds;
+    std::vector<PendingMap> m_pendingMaps;
+
+    UINT m_commands;
+    size_t m_payloadBytes;
+    UINT m_unsupported;
+};
@@ -0,0 +1,65 @@
+#include "PostParams.h"
+
+Texture2D<float4> colorTexture : register(t0);
+Texture2D<float3> bloomTexture : register(t1);
+Texture3D<float3> lutTexture : register(t2);
+
+RWTexture2D<unorm float4> colorTarget : register(u0);
+
+static const float LutSize = 16.0; // Should match PostProcess::LutSize
+
+// HALF_PRECISION variant does the per pixel math in min16float, the scene is 8-bit so it loses nothing visible
+#ifdef HALF_PRECISION
+typedef min16float3 post3;
+#else
+typedef float3 post3;
+#endif // !HALF_PRECISION
+
+// Fitted ACES curve
+post3 ToneMap(in post3 color)
+{
+    return saturate(color * (2.51 * color + 0.03) / (color * (2.43 * color + 0.59) + 0.14));
+}
+
+post3 Sepia(in post3 color)
+{
+    return post3(
+        dot(color, float3(0.3, 0.769, 0.189)),
+        dot(color, float3(0.3, 0.686, 0.168)),
+        dot(color, float3(0.272, 0.534, 0.131))
+    );
+}
+
+// Per pixel post effects, all in one pass
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (any(globalThreadId.xy >= sizes.zw))
+    {
+        return;
+    }
+
+    post3 color = (post3)colorTexture.Load(int3(globalThreadId.xy, 0)).rgb;
+
+    if (flags.x != 0)
+    {
+        float2 uv = (globalThreadId.xy + 0.5) / (float2)sizes.zw;
+        color += (post3)(bloomTexture.SampleLevel(linearSampler, uv, 0) * params.x);
+    }
+    if (flags.y != 0)
+    {
+        color = ToneMap(color * (post3)params.y);
+    }
+    if (flags.z != 0)
+    {
+        // Texel centers of LUT are at the ends of the range, coordinates stay 32-bit to address texels exactly
+        float3 uvw = saturate((float3)color) * ((LutSize - 1.0) / LutSize) + 0.5 / LutSize;
+        color = (post3)lutTexture.SampleLevel(linearSampler, uvw, 0);
+    }
+    if (flags.w != 0)
+    {
+        color = Sepia(color);
+    }
+
+    colorTarget[globalThreadId.xy] = float4(saturate(color), 1.0);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "StallDetector.h"
+
+#include <string.h>
+#include <string>
+
+/**
+ * Dynamic constant buffer which keeps CPU copy of its last written contents.
+ * Update maps the buffer only when data differs, so constants of different
+ * update frequency can live in separate buffers without rewriting unchanged ones.
+ */
+template <typename T>
+class ConstantBuffer
+{
+public:
+    ConstantBuffer()
+        : m_pBuffer(nullptr)
+        , m_valid(false)
+        , m_writeCount(0)
+        , m_skipCount(0)
+    {}
+
+    HRESULT Init(ID3D11Device* pDevice, const std::string& name)
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(T);
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        HRESULT result = pDevice->CreateBuffer(&desc, nullptr, &m_pBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pBuffer, name);
+        }
+        m_valid = false;
+
+        return result;
+    }
+
+    void Term()
+    {
+        SAFE_RELEASE(m_pBuffer);
+        m_valid = false;
+    }
+
+    /** Write data if it differs from buffer contents, true if buffer was written */
+    bool Update(ID3D11DeviceContext* pContext, const T& data)
+    {
+        if (m_valid && memcmp(&m_data, &data, sizeof(T)) == 0)
+        {
+            ++m_skipCount;
+            return false;
+        }
+
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        HRESULT result = StallDetector::Get().Map(pContext, m_pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource, STALL_SITE);
+        assert(SUCCEEDED(result));
+        if (SUCCEEDED(result))
+        {
+            memcpy(subresource.pData, &data, sizeof(T));
+            pContext->Unmap(m_pBuffer, 0);
+
+            m_data = data;
+            m_valid = true;
+            ++m_writeCount;
+        }
+        return SUCCEEDED(result);
+    }
+
+    ID3D11Buffer* Get() const { return m_pBuffer; }
+
+    void ResetStats() { m_writeCount = 0; m_skipCount = 0; }
+    UINT GetWriteCount() const { return m_writeCount; }
+    UINT GetSkipCount() const { return m_skipCount; }
+
+private:
+    ID3D11Buffer* m_pBuffer;
+    T m_data;
+    bool m_valid;
+
+    UINT m_writeCount;
+    UINT m_skipCount;
+};
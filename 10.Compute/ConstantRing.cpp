@@ -0,0 +1,68 @@
+#include "framework.h"
+
+#include "ConstantRing.h"
+#include "StallDetector.h"
+
+HRESULT ConstantRing::Init(ID3D11Device* pDevice, UINT size, const std::string& name)
+{
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = size;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    desc.MiscFlags = 0;
+    desc.StructureByteStride = 0;
+
+    HRESULT result = pDevice->CreateBuffer(&desc, nullptr, &m_pBuffer);
+    assert(SUCCEEDED(result));
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pBuffer, name);
+    }
+    if (SUCCEEDED(result))
+    {
+        m_size = size;
+        m_offset = size; // So the very first map discards
+    }
+
+    return result;
+}
+
+void ConstantRing::Term()
+{
+    SAFE_RELEASE(m_pBuffer);
+    m_size = 0;
+    m_offset = 0;
+}
+
+UINT ConstantRing::Write(ID3D11DeviceContext* pContext, const void* pData, UINT size)
+{
+    UINT alignedSize = DivUp(size, Alignment) * Alignment;
+    assert(alignedSize <= m_size);
+
+    // Ranges written before are still read by GPU until the ring wraps around
+    D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+    if (m_offset + alignedSize > m_size)
+    {
+        mapType = D3D11_MAP_WRITE_DISCARD;
+        m_offset = 0;
+        ++m_discardCount;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE subresource;
+    HRESULT result = StallDetector::Get().Map(pContext, m_pBuffer, 0, mapType, 0, &subresource, STALL_SITE);
+    assert(SUCCEEDED(result));
+    if (FAILED(result))
+    {
+        return 0;
+    }
+
+    memcpy(reinterpret_cast<char*>(subresource.pData) + m_offset, pData, size);
+    pContext->Unmap(m_pBuffer, 0);
+
+    UINT firstConstant = m_offset / 16;
+    m_offset += alignedSize;
+    m_writtenBytes += alignedSize;
+
+    return firstConstant;
+}
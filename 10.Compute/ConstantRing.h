@@ -0,0 +1,48 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+
+/**
+ * Dynamic constant buffer sub-allocated for per view and per draw constants.
+ * Ranges are bound with constant offsets of D3D11.1 (VSSetConstantBuffers1 and others),
+ * so many small constant buffers share one buffer object. It is mapped with NO_OVERWRITE
+ * and discarded only when it wraps around, which needs MapNoOverwriteOnDynamicConstantBuffer.
+ */
+class ConstantRing
+{
+public:
+    static const UINT Alignment = 256; ///< Constant offsets are multiples of 16 constants
+
+    ConstantRing()
+        : m_pBuffer(nullptr)
+        , m_size(0)
+        , m_offset(0)
+        , m_writtenBytes(0)
+        , m_discardCount(0)
+    {}
+
+    HRESULT Init(ID3D11Device* pDevice, UINT size, const std::string& name);
+    void Term();
+
+    /** Write size bytes and return first constant of them, for size rounded up to Alignment */
+    UINT Write(ID3D11DeviceContext* pContext, const void* pData, UINT size);
+
+    /** Constant count to bind for size bytes */
+    static UINT GetConstantCount(UINT size) { return (size + Alignment - 1) / Alignment * (Alignment / 16); }
+
+    ID3D11Buffer* Get() const { return m_pBuffer; }
+
+    void ResetStats() { m_writtenBytes = 0; m_discardCount = 0; }
+    UINT GetWrittenBytes() const { return m_writtenBytes; }
+    UINT GetDiscardCount() const { return m_discardCount; }
+
+private:
+    ID3D11Buffer* m_pBuffer;
+    UINT m_size;
+    UINT m_offset;
+
+    UINT m_writtenBytes;
+    UINT m_discardCount;
+};
@@ -0,0 +1,146 @@
+#include "framework.h"
+
+#include "CpuCull.h"
+#include "JobSystem.h"
+
+#include <immintrin.h>
+#include <intrin.h>
+
+#include <limits>
+#include <math.h>
+
+void CpuCull::Resize(UINT count)
+{
+    UINT paddedCount = DivUp(count, (UINT)Width) * Width;
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    m_minX.resize(paddedCount, nan);
+    m_minY.resize(paddedCount, nan);
+    m_minZ.resize(paddedCount, nan);
+    m_maxX.resize(paddedCount, nan);
+    m_maxY.resize(paddedCount, nan);
+    m_maxZ.resize(paddedCount, nan);
+
+    for (UINT i = count; i < paddedCount; i++)
+    {
+        SetBox(i, Point3f{ nan, nan, nan }, Point3f{ nan, nan, nan });
+    }
+
+    m_count = count;
+}
+
+void CpuCull::SetBox(UINT idx, const Point3f& vmin, const Point3f& vmax)
+{
+    m_minX[idx] = vmin.x;
+    m_minY[idx] = vmin.y;
+    m_minZ[idx] = vmin.z;
+    m_maxX[idx] = vmax.x;
+    m_maxY[idx] = vmax.y;
+    m_maxZ[idx] = vmax.z;
+}
+
+UINT CpuCull::Cull(const Point4f frustum[6], UINT* pIds, JobSystem* pJobs)
+{
+    if (pJobs == nullptr || pJobs->GetWorkerCount() == 0 || m_count < ParallelThreshold)
+    {
+        return CullRange(frustum, 0, m_count, pIds);
+    }
+
+    UINT chunkCount = DivUp(m_count, (UINT)ChunkSize);
+    m_chunkIds.resize(chunkCount * ChunkSize);
+    m_chunkVisible.resize(chunkCount);
+
+    pJobs->ParallelFor(m_count, ChunkSize, [&](UINT begin, UINT end)
+    {
+        m_chunkVisible[begin / ChunkSize] = CullRange(frustum, begin, end, m_chunkIds.data() + begin);
+    });
+
+    // Mapped memory is write combined, so copy sequentially
+    UINT visible = 0;
+    for (UINT i = 0; i < chunkCount; i++)
+    {
+        memcpy(pIds + visible, m_chunkIds.data() + i * ChunkSize, m_chunkVisible[i] * sizeof(UINT));
+        visible += m_chunkVisible[i];
+    }
+
+    return visible;
+}
+
+UINT CpuCull::CullRange(const Point4f frustum[6], UINT begin, UINT end, UINT* pIds) const
+{
+    // Pick the most positive vertex per plane once, same as scalar IsBoxInside
+    const float* px[6];
+    const float* py[6];
+    const float* pz[6];
+    for (int p = 0; p < 6; p++)
+    {
+        px[p] = signbit(frustum[p].x) ? m_minX.data() : m_maxX.data();
+        py[p] = signbit(frustum[p].y) ? m_minY.data() : m_maxY.data();
+        pz[p] = signbit(frustum[p].z) ? m_minZ.data() : m_maxZ.data();
+    }
+
+    UINT visible = 0;
+
+#ifdef __AVX__
+    __m256 nx[6], ny[6], nz[6], nw[6];
+    for (int p = 0; p < 6; p++)
+    {
+        nx[p] = _mm256_set1_ps(frustum[p].x);
+        ny[p] = _mm256_set1_ps(frustum[p].y);
+        nz[p] = _mm256_set1_ps(frustum[p].z);
+        nw[p] = _mm256_set1_ps(frustum[p].w);
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    for (UINT i = begin; i < end; i += Width)
+    {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 s = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(nx[p], _mm256_loadu_ps(px[p] + i)), _mm256_mul_ps(ny[p], _mm256_loadu_ps(py[p] + i))),
+                _mm256_add_ps(_mm256_mul_ps(nz[p], _mm256_loadu_ps(pz[p] + i)), nw[p])
+            );
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(s, zero, _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+#else
+    __m128 nx[6], ny[6], nz[6], nw[6];
+    for (int p = 0; p < 6; p++)
+    {
+        nx[p] = _mm_set1_ps(frustum[p].x);
+        ny[p] = _mm_set1_ps(frustum[p].y);
+        nz[p] = _mm_set1_ps(frustum[p].z);
+        nw[p] = _mm_set1_ps(frustum[p].w);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    for (UINT i = begin; i < end; i += Width)
+    {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 s = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(nx[p], _mm_loadu_ps(px[p] + i)), _mm_mul_ps(ny[p], _mm_loadu_ps(py[p] + i))),
+                _mm_add_ps(_mm_mul_ps(nz[p], _mm_loadu_ps(pz[p] + i)), nw[p])
+            );
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(s, zero));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+#endif // __AVX__
+
+        // Padding boxes are NaN, so they never pass the test
+        while (mask != 0)
+        {
+            unsigned long bit;
+            _BitScanForward(&bit, (unsigned long)mask);
+            mask &= mask - 1;
+
+            pIds[visible++] = i + bit;
+        }
+    }
+
+    return visible;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../Math/Point.h"
+
+#include <vector>
+
+class JobSystem;
+
+/** Frustum culling of axis aligned boxes stored as structure of arrays, 4 (SSE) or 8 (AVX) boxes at once */
+class CpuCull
+{
+public:
+#ifdef __AVX__
+    static const UINT Width = 8;
+#else
+    static const UINT Width = 4;
+#endif // __AVX__
+    static const UINT ChunkSize = 4096;          // Boxes per job, multiple of Width
+    static const UINT ParallelThreshold = 16384; // Below that culling is done on the calling thread
+
+    CpuCull()
+        : m_count(0)
+    {}
+
+    void Resize(UINT count);
+    void SetBox(UINT idx, const Point3f& vmin, const Point3f& vmax);
+
+    /** Write indices of boxes inside the frustum to pIds, returns visible count. pJobs may be nullptr. */
+    UINT Cull(const Point4f frustum[6], UINT* pIds, JobSystem* pJobs);
+
+private:
+    UINT CullRange(const Point4f frustum[6], UINT begin, UINT end, UINT* pIds) const;
+
+private:
+    UINT m_count;
+
+    // Bounds, padded to multiple of Width with NaN boxes which are never inside
+    std::vector<float> m_minX, m_minY, m_minZ;
+    std::vector<float> m_maxX, m_maxY, m_maxZ;
+
+    // Per chunk output for parallel culling, to avoid reading from mapped memory
+    std::vector<UINT> m_chunkIds;
+    std::vector<UINT> m_chunkVisible;
+};
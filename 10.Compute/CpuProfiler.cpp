@@ -0,0 +1,205 @@
+#include "framework.h"
+
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+#include "imgui.h"
+
+CpuProfiler& CpuProfiler::Get()
+{
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+CpuProfiler::CpuProfiler()
+    : m_enabled(true)
+    , m_paused(false)
+    , m_frequency(1)
+    , m_frameBegin(0)
+    , m_frameCount(0)
+    , m_framePos(0)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_frequency = frequency.QuadPart;
+}
+
+INT64 CpuProfiler::GetTicks()
+{
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return ticks.QuadPart;
+}
+
+CpuProfiler::ThreadData& CpuProfiler::GetThreadData()
+{
+    // Thread data is owned by profiler, so zones of finished threads are still gathered
+    static thread_local ThreadData* pThreadData = nullptr;
+    if (pThreadData == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_threadsMutex);
+        m_threads.push_back(std::make_unique<ThreadData>());
+        pThreadData = m_threads.back().get();
+        pThreadData->depth = 0;
+        pThreadData->threadId = (UINT)m_threads.size() - 1;
+    }
+    return *pThreadData;
+}
+
+UINT CpuProfiler::EnterZone()
+{
+    return GetThreadData().depth++;
+}
+
+void CpuProfiler::LeaveZone(const char* name, INT64 begin, UINT depth)
+{
+    INT64 end = GetTicks();
+
+    ThreadData& data = GetThreadData();
+    data.depth = depth;
+
+    // Only contended while frame is gathered
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.zones.push_back(Zone{ name, begin, end, depth, data.threadId });
+}
+
+void CpuProfiler::BeginFrame()
+{
+    INT64 now = GetTicks();
+
+    if (m_frameBegin != 0 && !m_paused)
+    {
+        Frame& frame = m_frames[m_framePos];
+        frame.begin = m_frameBegin;
+        frame.end = now;
+        frame.zones.clear();
+
+        std::lock_guard<std::mutex> threadsLock(m_threadsMutex);
+        for (auto& pData : m_threads)
+        {
+            std::lock_guard<std::mutex> lock(pData->mutex);
+            frame.zones.insert(frame.zones.end(), pData->zones.begin(), pData->zones.end());
+            pData->zones.clear();
+        }
+
+        m_framePos = (m_framePos + 1) % HistorySize;
+        m_frameCount = std::min(m_frameCount + 1, (UINT)HistorySize);
+    }
+    else
+    {
+        // Drop zones recorded while paused
+        std::lock_guard<std::mutex> threadsLock(m_threadsMutex);
+        for (auto& pData : m_threads)
+        {
+            std::lock_guard<std::mutex> lock(pData->mutex);
+            pData->zones.clear();
+        }
+    }
+
+    m_frameBegin = now;
+}
+
+void CpuProfiler::ShowWindow()
+{
+    ImGui::Begin("CPU profiler");
+
+    bool enabled = IsEnabled();
+    if (ImGui::Checkbox("Enabled", &enabled))
+    {
+        SetEnabled(enabled);
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Pause", &m_paused);
+    ImGui::SameLine();
+    if (ImGui::Button("Save trace"))
+    {
+        SaveChromeTrace("cpu_trace.json");
+    }
+
+    if (m_frameCount > 0)
+    {
+        const Frame& frame = m_frames[(m_framePos + HistorySize - 1) % HistorySize];
+        double frameMs = (frame.end - frame.begin) * 1000.0 / m_frequency;
+        ImGui::Text("Frame %.3f ms", frameMs);
+
+        UINT maxDepth = 0;
+        UINT threadCount = 0;
+        for (const auto& zone : frame.zones)
+        {
+            maxDepth = std::max(maxDepth, zone.depth + 1);
+            threadCount = std::max(threadCount, zone.threadId + 1);
+        }
+
+        // Flame view, one band per thread, one row per zone depth
+        const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+        float height = rowHeight * maxDepth * threadCount;
+        ImGui::InvisibleButton("Flame", ImVec2(width, std::max(height, 1.0f)));
+
+        ImDrawList* pDrawList = ImGui::GetWindowDrawList();
+        const ImVec2 mouse = ImGui::GetIO().MousePos;
+        const float scale = width / (float)std::max(frame.end - frame.begin, (INT64)1);
+        for (const auto& zone : frame.zones)
+        {
+            float x0 = origin.x + (zone.begin - frame.begin) * scale;
+            float x1 = origin.x + (zone.end - frame.begin) * scale;
+            float y0 = origin.y + (zone.threadId * maxDepth + zone.depth) * rowHeight;
+            float y1 = y0 + rowHeight - 1.0f;
+            x1 = std::max(x1, x0 + 1.0f);
+
+            ImU32 color = ImColor::HSV(fmodf(zone.depth * 0.13f + zone.threadId * 0.31f, 1.0f), 0.6f, 0.7f);
+            pDrawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), color);
+            if (x1 - x0 > ImGui::CalcTextSize(zone.name).x)
+            {
+                pDrawList->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32_WHITE, zone.name);
+            }
+
+            if (ImGui::IsItemHovered() && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1)
+            {
+                ImGui::SetTooltip("%s\nThread %u\n%.3f ms", zone.name, zone.threadId, (zone.end - zone.begin) * 1000.0 / m_frequency);
+            }
+        }
+    }
+
+    ImGui::End();
+}
+
+bool CpuProfiler::SaveChromeTrace(const std::string& path) const
+{
+    if (m_frameCount == 0)
+    {
+        return false;
+    }
+
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, path.c_str(), "w") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+    UINT first = (m_framePos + HistorySize - m_frameCount) % HistorySize;
+    INT64 base = m_frames[first].begin;
+    auto toUSec = [&](INT64 ticks) { return (double)(ticks - base) * 1000000.0 / m_frequency; };
+
+    fprintf(pFile, "{\"traceEvents\":[\n");
+    bool comma = false;
+    for (UINT i = 0; i < m_frameCount; i++)
+    {
+        const Frame& frame = m_frames[(first + i) % HistorySize];
+        fprintf(pFile, "%s{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}", comma ? ",\n" : "", toUSec(frame.begin), toUSec(frame.end) - toUSec(frame.begin));
+        comma = true;
+        for (const auto& zone : frame.zones)
+        {
+            fprintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", zone.name, zone.threadId, toUSec(zone.begin), toUSec(zone.end) - toUSec(zone.begin));
+        }
+    }
+    fprintf(pFile, "\n]}\n");
+
+    fclose(pFile);
+
+    return true;
+}
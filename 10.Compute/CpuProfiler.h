@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * CPU frame profiler with scoped zones.
+ * Zones are recorded per thread into thread local buffers and gathered once per frame.
+ * When profiler is disabled zone costs a single relaxed atomic load.
+ */
+class CpuProfiler
+{
+public:
+    static const UINT HistorySize = 120; ///< Frames kept for trace export
+
+    struct Zone
+    {
+        const char* name;
+        INT64 begin;
+        INT64 end;
+        UINT depth;
+        UINT threadId;
+    };
+
+    struct Frame
+    {
+        INT64 begin;
+        INT64 end;
+        std::vector<Zone> zones;
+    };
+
+    static CpuProfiler& Get();
+
+    bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    void SetEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+    /** Close previous frame, gathering zones of all threads, and start new one */
+    void BeginFrame();
+
+    static INT64 GetTicks();
+    UINT EnterZone();
+    void LeaveZone(const char* name, INT64 begin, UINT depth);
+
+    /** Show flame view of the last frame in ImGui window */
+    void ShowWindow();
+
+    /** Save collected frames in Chrome trace_event format */
+    bool SaveChromeTrace(const std::string& path) const;
+
+private:
+    struct ThreadData
+    {
+        std::mutex mutex;
+        std::vector<Zone> zones;
+        UINT depth;
+        UINT threadId;
+    };
+
+    CpuProfiler();
+
+    ThreadData& GetThreadData();
+
+    std::atomic<bool> m_enabled;
+    bool m_paused;
+    INT64 m_frequency;
+    INT64 m_frameBegin;
+
+    std::mutex m_threadsMutex;
+    std::vector<std::unique_ptr<ThreadData>> m_threads;
+
+    // Ring of completed frames
+    Frame m_frames[HistorySize];
+    UINT m_frameCount;
+    UINT m_framePos;
+};
+
+/** Helper to profile a block */
+class CpuProfileZone
+{
+public:
+    CpuProfileZone(const char* name)
+        : m_name(CpuProfiler::Get().IsEnabled() ? name : nullptr)
+        , m_begin(0)
+        , m_depth(0)
+    {
+        if (m_name != nullptr)
+        {
+            m_depth = CpuProfiler::Get().EnterZone();
+            m_begin = CpuProfiler::GetTicks();
+        }
+    }
+
+    ~CpuProfileZone()
+    {
+        if (m_name != nullptr)
+        {
+            CpuProfiler::Get().LeaveZone(m_name, m_begin, m_depth);
+        }
+    }
+
+private:
+    const char* m_name;
+    INT64 m_begin;
+    UINT m_depth;
+};
+
+#define CPU_PROFILE_CONCAT_IMPL(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_IMPL(a, b)
+#define CPU_PROFILE_ZONE(name) CpuProfileZone CPU_PROFILE_CONCAT(cpuProfileZone, __LINE__)(name)
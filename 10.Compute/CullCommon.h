@@ -0,0 +1,116 @@
+struct AABB
+{
+    float3 bbMin;
+    float3 bbMax;
+};
+
+struct Cluster
+{
+    float3 bbMin;
+    uint first; // First instance in sorted order
+    float3 bbMax;
+    uint count; // Instance count
+};
+
+static const uint FullyInsideFlag = 0x80000000;
+
+// Triangle cluster of meshlet model, 48 bytes. Should match MeshOptimizer::Meshlet
+struct Meshlet
+{
+    float4 sphere; // xyz - center, w - radius, model space
+    float4 cone; // xyz - average triangle normal, w - sine of normal spread, 1 if cone can't cull
+    uint firstIndex; // Relative to mesh start index
+    uint indexCount;
+    uint2 pad;
+};
+
+// Each instanced mesh LOD has own draw arguments and segment of visible ids
+static const uint ArgsStride = 5; // D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS size in uints
+static const uint MeshSegmentSize = 100000; // Should match Renderer::MaxInst
+static const uint MaxLods = 4; // Should match Renderer::MaxLods
+static const uint ImpostorLod = MaxLods - 1; // Last draw of each mesh is its impostor, mesh LODs go before it
+static const uint InstanceMeshCount = 3; // Should match Renderer::InstanceMeshCount
+
+// Model space bounds of instanced meshes, xyz - box half size, w - radius it is extended by. Should match Renderer.cpp
+static const float4 InstanceMeshBounds[InstanceMeshCount] = {
+    float4(0.5, 0.5, 0.5, 0.0), // Cube
+    float4(0.0, 0.0, 0.0, 0.5), // Sphere
+    float4(0.5, 0.5, 0.5, 0.0)  // Imported, normalized to unit box
+};
+
+// LOD from projected bounding sphere radius, each next LOD starts at half radius of previous one.
+// Below lodParams.z instance is drawn as impostor, zero keeps mesh LODs only
+uint SelectLod(in AABB bb, in float3 cameraPos, in float4 lodParams, in uint lodCount)
+{
+    float3 center = (bb.bbMin + bb.bbMax) * 0.5;
+    float radius = length(bb.bbMax - bb.bbMin) * 0.5;
+    float size = radius * lodParams.x / max(length(center - cameraPos), radius);
+    if (size < lodParams.z)
+    {
+        return ImpostorLod;
+    }
+
+    float lod = floor(log2(lodParams.y / size)) + 1;
+    return (uint)clamp(lod, 0, (float)(lodCount - 1));
+}
+
+bool IsBoxInside(in float4 frustum[6], in float3 bbMin, in float3 bbMax)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const float3 norm = frustum[i].xyz;
+        float4 p = float4(
+            norm.x < 0 ? bbMin.x : bbMax.x,
+            norm.y < 0 ? bbMin.y : bbMax.y,
+            norm.z < 0 ? bbMin.z : bbMax.z,
+            1.0
+        );
+        float s = dot(p, frustum[i]);
+        if (s < 0.0f)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool IsBoxFullyInside(in float4 frustum[6], in float3 bbMin, in float3 bbMax)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const float3 norm = frustum[i].xyz;
+        float4 p = float4(
+            norm.x < 0 ? bbMax.x : bbMin.x,
+            norm.y < 0 ? bbMax.y : bbMin.y,
+            norm.z < 0 ? bbMax.z : bbMin.z,
+            1.0
+        );
+        float s = dot(p, frustum[i]);
+        if (s < 0.0f)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Mesh bounds transformed with model matrix, so they follow rotation. Matrix has no scale
+bool IsInstanceInside(in float4 frustum[6], in float3x4 model, in uint mesh)
+{
+    float4 bounds = InstanceMeshBounds[mesh];
+    float3 center = float3(model[0][3], model[1][3], model[2][3]);
+    for (int i = 0; i < 6; i++)
+    {
+        // Projections of box axes onto plane normal
+        float3 axes = abs(mul(frustum[i].xyz, (float3x3)model));
+        float radius = dot(axes, bounds.xyz) + bounds.w;
+        if (dot(frustum[i].xyz, center) + frustum[i].w < -radius)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
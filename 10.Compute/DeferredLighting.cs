@@ -0,0 +1,111 @@
+#include "Light.h"
+
+cbuffer ResolveParams : register(b1)
+{
+    float4x4 invVP;
+    uint4 resolveSize; // xy - target size
+};
+
+Texture2D<float> depthTexture : register(t0);
+Texture2D<float4> albedoTexture : register(t1);
+Texture2D<float4> normalTexture : register(t2); // xyz - normal, w - shininess
+StructuredBuffer<uint> visibleLightCount : register(t3); // Lights are the visible ones
+
+RWTexture2D<float4> colorTarget : register(u0);
+
+static const uint TileSize = 16;
+static const uint MaxTileLights = 256;
+
+groupshared uint tileMinDepth;
+groupshared uint tileMaxDepth;
+groupshared uint tileLightCount;
+groupshared uint tileLights[MaxTileLights];
+
+float3 Unproject(in float2 uv, in float depth)
+{
+    float4 pos = mul(invVP, float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), depth, 1.0));
+    return pos.xyz / pos.w;
+}
+
+[numthreads(TileSize, TileSize, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint localIdx : SV_GroupIndex)
+{
+    if (localIdx == 0)
+    {
+        tileMinDepth = 0xFFFFFFFF;
+        tileMaxDepth = 0;
+        tileLightCount = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint2 pixel = globalThreadId.xy;
+    float depth = all(pixel < resolveSize.xy) ? depthTexture.Load(int3(pixel, 0)) : 0.0;
+    bool covered = depth > 0.0; // Reversed Z, so empty pixels are cleared to 0
+
+    // Positive floats keep their order as uints
+    if (covered)
+    {
+        InterlockedMin(tileMinDepth, asuint(depth));
+        InterlockedMax(tileMaxDepth, asuint(depth));
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Lights are culled against world space bounds of the tile between its depth range
+    if (tileMaxDepth != 0)
+    {
+        float2 uvMin = float2(groupId.xy * TileSize) / float2(resolveSize.xy);
+        float2 uvMax = float2(groupId.xy * TileSize + TileSize) / float2(resolveSize.xy);
+
+        float3 bbMin = float3(1e30, 1e30, 1e30);
+        float3 bbMax = float3(-1e30, -1e30, -1e30);
+        for (int i = 0; i < 8; i++)
+        {
+            float2 uv = float2((i & 1) == 0 ? uvMin.x : uvMax.x, (i & 2) == 0 ? uvMin.y : uvMax.y);
+            float3 p = Unproject(uv, asfloat((i & 4) == 0 ? tileMinDepth : tileMaxDepth));
+            bbMin = min(bbMin, p);
+            bbMax = max(bbMax, p);
+        }
+
+        for (uint lightIdx = localIdx; lightIdx < visibleLightCount[0]; lightIdx += TileSize * TileSize)
+        {
+            float4 light = lights[lightIdx].pos;
+            float3 d = max(max(bbMin - light.xyz, 0.0), light.xyz - bbMax);
+            if (dot(d, d) <= light.w * light.w)
+            {
+                uint slot;
+                InterlockedAdd(tileLightCount, 1, slot);
+                if (slot < MaxTileLights)
+                {
+                    tileLights[slot] = lightIdx;
+                }
+            }
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (!covered)
+    {
+        return;
+    }
+
+    float3 albedo = albedoTexture.Load(int3(pixel, 0)).xyz;
+    float4 normalShine = normalTexture.Load(int3(pixel, 0));
+    float3 pos = Unproject((float2(pixel) + 0.5) / float2(resolveSize.xy), depth);
+
+#ifdef SHOW_NORMALS
+    float3 color = normalShine.xyz * 0.5 + float3(0.5, 0.5, 0.5);
+#else
+    shade3 objColor = (shade3)albedo;
+    shade3 normal = (shade3)normalShine.xyz;
+    shade shine = (shade)normalShine.w;
+    shade3 color = objColor * SkyAmbient(normal) + ShadeSun(objColor, normal, pos, shine, false);
+
+    uint count = min(tileLightCount, MaxTileLights);
+    for (uint j = 0; j < count; j++)
+    {
+        color += ShadeLight(lights[tileLights[j]], objColor, normal, pos, shine, false);
+    }
+#endif // !SHOW_NORMALS
+
+    colorTarget[pixel] = float4(color, 1.0);
+}
@@ -0,0 +1,78 @@
+#include "framework.h"
+
+#include "DepthSort.h"
+#include "AABB.h"
+
+#include <string.h>
+
+void DepthSort::Sort(const UINT* pIds, UINT count, const AABB* pBounds, const Point3f& cameraPos, UINT* pDst)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (m_keys[i].size() < count)
+        {
+            m_keys[i].resize(count);
+            m_ids[i].resize(count);
+        }
+    }
+
+    // Bits of non negative floats are ordered the same way as their values
+    for (UINT i = 0; i < count; i++)
+    {
+        const AABB& bb = pBounds[pIds[i]];
+        float dx = (bb.vmin.x + bb.vmax.x) * 0.5f - cameraPos.x;
+        float dy = (bb.vmin.y + bb.vmax.y) * 0.5f - cameraPos.y;
+        float dz = (bb.vmin.z + bb.vmax.z) * 0.5f - cameraPos.z;
+        float dist = dx * dx + dy * dy + dz * dz;
+
+        memcpy(&m_keys[0][i], &dist, sizeof(UINT));
+        m_ids[0][i] = pIds[i];
+    }
+
+    UINT src = 0;
+    UINT histogram[1 << RadixBits];
+    for (UINT pass = 0; pass < PassCount; pass++)
+    {
+        const UINT shift = pass * RadixBits;
+        const UINT mask = (1u << RadixBits) - 1;
+
+        memset(histogram, 0, sizeof(histogram));
+        const UINT* pKeys = m_keys[src].data();
+        for (UINT i = 0; i < count; i++)
+        {
+            ++histogram[(pKeys[i] >> shift) & mask];
+        }
+
+        // All keys have the same digit, order is kept as is
+        if (histogram[(pKeys[0] >> shift) & mask] == count)
+        {
+            continue;
+        }
+
+        UINT offset = 0;
+        for (UINT d = 0; d <= mask; d++)
+        {
+            UINT digitCount = histogram[d];
+            histogram[d] = offset;
+            offset += digitCount;
+        }
+
+        const UINT* pSrcIds = m_ids[src].data();
+        UINT* pDstKeys = m_keys[1 - src].data();
+        UINT* pDstIds = m_ids[1 - src].data();
+        for (UINT i = 0; i < count; i++)
+        {
+            UINT pos = histogram[(pKeys[i] >> shift) & mask]++;
+            pDstKeys[pos] = pKeys[i];
+            pDstIds[pos] = pSrcIds[i];
+        }
+        src = 1 - src;
+    }
+
+    memcpy(pDst, m_ids[src].data(), count * sizeof(UINT));
+}
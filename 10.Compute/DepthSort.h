@@ -0,0 +1,22 @@
+#pragma once
+
+#include "../Math/Point.h"
+
+#include <vector>
+
+struct AABB;
+
+/** Stable radix sort of instance ids by squared distance from camera to box center, for front to back drawing */
+class DepthSort
+{
+public:
+    static const UINT RadixBits = 11;
+    static const UINT PassCount = (32 + RadixBits - 1) / RadixBits;
+
+    /** Sort count ids from pIds by distance, result is written to pDst, which is only written sequentially */
+    void Sort(const UINT* pIds, UINT count, const AABB* pBounds, const Point3f& cameraPos, UINT* pDst);
+
+private:
+    std::vector<UINT> m_keys[2];
+    std::vector<UINT> m_ids[2];
+};
@@ -0,0 +1,25 @@
+// Thread group counts of indirect dispatch from counts written by the previous pass, so they never go through CPU
+cbuffer DispatchArgsParams : register(b0)
+{
+    uint4 argsParams; // x - dispatch count, y - stride of counts, z - offset of first count, w - threads per group of next pass
+};
+
+#if defined(STRUCTURED_COUNTS)
+RWStructuredBuffer<uint> counts : register(u0);
+#else
+RWBuffer<uint> counts : register(u0);
+#endif
+RWBuffer<uint> dispatchArgs : register(u1);
+
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint i = globalThreadId.x;
+    if (i < argsParams.x)
+    {
+        uint count = counts[i * argsParams.y + argsParams.z];
+        dispatchArgs[i * 3] = (count + argsParams.w - 1) / argsParams.w; // Zero groups for empty pass
+        dispatchArgs[i * 3 + 1] = 1;
+        dispatchArgs[i * 3 + 2] = 1;
+    }
+}
@@ -0,0 +1,101 @@
+#include "framework.h"
+
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace
+{
+
+// Arenas are kept until exit, as threads may end before the frame is reset
+std::mutex ArenasMutex;
+std::vector<std::unique_ptr<FrameArena>> Arenas;
+FrameArena::Stats LastStats = {};
+
+thread_local FrameArena* pThreadArena = nullptr;
+
+}
+
+FrameArena& FrameArena::Get()
+{
+    if (pThreadArena == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(ArenasMutex);
+        Arenas.push_back(std::make_unique<FrameArena>());
+        pThreadArena = Arenas.back().get();
+    }
+    return *pThreadArena;
+}
+
+void FrameArena::ResetAll()
+{
+    std::lock_guard<std::mutex> lock(ArenasMutex);
+
+    Stats stats = {};
+    for (const std::unique_ptr<FrameArena>& pArena : Arenas)
+    {
+        stats.allocations += pArena->m_allocations;
+        stats.bytes += pArena->m_bytes;
+        stats.heapBlocks += pArena->m_heapBlocks;
+        pArena->Reset();
+    }
+    stats.arenas = (UINT)Arenas.size();
+    LastStats = stats;
+}
+
+const FrameArena::Stats& FrameArena::GetStats()
+{
+    return LastStats;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    ++m_allocations;
+    m_bytes += size;
+
+    if (!m_blocks.empty())
+    {
+        const Block& block = m_blocks.back();
+        uintptr_t base = (uintptr_t)block.pData.get();
+        size_t offset = ((base + m_offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (offset + size <= block.size)
+        {
+            m_offset = offset + size;
+            return block.pData.get() + offset;
+        }
+    }
+
+    // Block is at least as big as all previous ones, so a growing frame needs few of them
+    Block block;
+    block.size = std::max(std::max(MinBlockSize, size + alignment), m_capacity);
+    block.pData.reset(new char[block.size]);
+    m_capacity += block.size;
+    ++m_heapBlocks;
+
+    uintptr_t base = (uintptr_t)block.pData.get();
+    size_t offset = ((base + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    m_offset = offset + size;
+    m_blocks.push_back(std::move(block));
+
+    return m_blocks.back().pData.get() + offset;
+}
+
+void FrameArena::Reset()
+{
+    // Peak of the frame becomes one block, so the same frame again fits without growing
+    if (m_blocks.size() > 1)
+    {
+        m_blocks.clear();
+
+        Block block;
+        block.size = m_capacity;
+        block.pData.reset(new char[block.size]);
+        m_blocks.push_back(std::move(block));
+    }
+
+    m_offset = 0;
+    m_allocations = 0;
+    m_bytes = 0;
+    m_heapBlocks = 0;
+}
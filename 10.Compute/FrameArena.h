@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+/**
+ * Per thread bump allocator for transient data living within a frame.
+ * Allocations are never freed one by one, arenas of all threads are reset together at frame end.
+ * Arena grows by blocks while a frame needs more, reset merges them into one block of the peak size,
+ * so steady frames take nothing from heap.
+ */
+class FrameArena
+{
+public:
+    static const size_t MinBlockSize = 256 * 1024;
+
+    struct Stats
+    {
+        UINT allocations; // All threads
+        UINT64 bytes;
+        UINT heapBlocks; // Blocks taken from heap, zero in steady state
+        UINT arenas;
+    };
+
+    FrameArena()
+        : m_offset(0)
+        , m_capacity(0)
+        , m_allocations(0)
+        , m_bytes(0)
+        , m_heapBlocks(0)
+    {}
+
+    /** Arena of calling thread, created on first use */
+    static FrameArena& Get();
+    /** Reset arenas of all threads, no thread should use frame allocations meanwhile or after it */
+    static void ResetAll();
+    /** Counters of the frame finished by the last ResetAll */
+    static const Stats& GetStats();
+
+    void* Allocate(size_t size, size_t alignment);
+
+private:
+    void Reset();
+
+    struct Block
+    {
+        std::unique_ptr<char[]> pData;
+        size_t size;
+    };
+
+    std::vector<Block> m_blocks; // Allocations go to the last one
+    size_t m_offset; // In the last block
+    size_t m_capacity; // Of all blocks
+    UINT m_allocations;
+    UINT64 m_bytes;
+    UINT m_heapBlocks;
+};
+
+/** STL allocator over frame arena of the thread which created it, deallocation does nothing */
+template <typename T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+
+    FrameAllocator()
+        : m_pArena(&FrameArena::Get())
+    {}
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other)
+        : m_pArena(other.GetArena())
+    {}
+
+    T* allocate(size_t count) { return static_cast<T*>(m_pArena->Allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+    FrameArena* GetArena() const { return m_pArena; }
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const { return m_pArena == other.GetArena(); }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const { return m_pArena != other.GetArena(); }
+
+private:
+    FrameArena* m_pArena;
+};
+
+/** Vector valid until frame end, should not be kept in members across frames */
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
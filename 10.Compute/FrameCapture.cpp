@@ -0,0 +1,398 @@
+#include "framework.h"
+
+#include "FrameCapture.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+UINT Crc32(UINT crc, const BYTE* pData, size_t size)
+{
+    static UINT table[256] = {};
+    static bool tableReady = false;
+    if (!tableReady)
+    {
+        for (UINT i = 0; i < 256; i++)
+        {
+            UINT value = i;
+            for (UINT bit = 0; bit < 8; bit++)
+            {
+                value = (value & 1) != 0 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            table[i] = value;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void PutBigEndian(std::vector<BYTE>& data, UINT value)
+{
+    data.push_back((BYTE)(value >> 24));
+    data.push_back((BYTE)(value >> 16));
+    data.push_back((BYTE)(value >> 8));
+    data.push_back((BYTE)value);
+}
+
+bool WriteChunk(FILE* pFile, const char* type, const std::vector<BYTE>& payload)
+{
+    std::vector<BYTE> chunk;
+    chunk.reserve(payload.size() + 12);
+    PutBigEndian(chunk, (UINT)payload.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), payload.begin(), payload.end());
+    PutBigEndian(chunk, Crc32(0, chunk.data() + 4, chunk.size() - 4));
+
+    return fwrite(chunk.data(), 1, chunk.size(), pFile) == chunk.size();
+}
+
+// Deflate with stored blocks only, encoding speed matters more than file size here
+bool WritePng(const std::string& path, const BYTE* pData, UINT rowPitch, UINT width, UINT height)
+{
+    static const BYTE Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    static const UINT MaxStoredBlock = 0xFFFF;
+
+    // Scanlines of RGB pixels, each prefixed with filter type none
+    const UINT lineSize = 1 + width * 3;
+    std::vector<BYTE> lines((size_t)lineSize * height);
+    for (UINT y = 0; y < height; y++)
+    {
+        BYTE* pLine = &lines[(size_t)y * lineSize];
+        const BYTE* pSrc = pData + (size_t)y * rowPitch;
+        *pLine++ = 0;
+        for (UINT x = 0; x < width; x++)
+        {
+            *pLine++ = pSrc[x * 4 + 0];
+            *pLine++ = pSrc[x * 4 + 1];
+            *pLine++ = pSrc[x * 4 + 2];
+        }
+    }
+
+    std::vector<BYTE> zlib;
+    zlib.reserve(lines.size() + lines.size() / MaxStoredBlock * 5 + 16);
+    zlib.push_back(0x78); // Deflate, 32K window
+    zlib.push_back(0x01); // No preset dictionary, fastest
+    size_t offset = 0;
+    do
+    {
+        UINT size = (UINT)std::min<size_t>(lines.size() - offset, MaxStoredBlock);
+        zlib.push_back(offset + size == lines.size() ? 1 : 0); // Final flag, stored block type
+        zlib.push_back((BYTE)size);
+        zlib.push_back((BYTE)(size >> 8));
+        zlib.push_back((BYTE)~size);
+        zlib.push_back((BYTE)(~size >> 8));
+        zlib.insert(zlib.end(), lines.begin() + offset, lines.begin() + offset + size);
+        offset += size;
+    } while (offset < lines.size());
+
+    UINT a = 1;
+    UINT b = 0;
+    for (BYTE value : lines)
+    {
+        a = (a + value) % 65521;
+        b = (b + a) % 65521;
+    }
+    PutBigEndian(zlib, (b << 16) | a);
+
+    std::vector<BYTE> header;
+    PutBigEndian(header, width);
+    PutBigEndian(header, height);
+    header.push_back(8); // Bit depth
+    header.push_back(2); // Truecolor
+    header.push_back(0); // Deflate
+    header.push_back(0); // Adaptive filtering
+    header.push_back(0); // No interlace
+
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, path.c_str(), "wb") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+    bool written = fwrite(Signature, 1, sizeof(Signature), pFile) == sizeof(Signature)
+        && WriteChunk(pFile, "IHDR", header)
+        && WriteChunk(pFile, "IDAT", zlib)
+        && WriteChunk(pFile, "IEND", std::vector<BYTE>());
+    fclose(pFile);
+
+    return written;
+}
+
+bool WriteRaw(const std::string& path, const BYTE* pData, UINT rowPitch, UINT width, UINT height)
+{
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, path.c_str(), "wb") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+    bool written = true;
+    for (UINT y = 0; y < height && written; y++)
+    {
+        written = fwrite(pData + (size_t)y * rowPitch, 4, width, pFile) == width;
+    }
+    fclose(pFile);
+
+    return written;
+}
+
+}
+
+HRESULT FrameCapture::Init(ID3D11Device* pDevice)
+{
+    HRESULT result = S_OK;
+
+    for (UINT i = 0; i < SlotCount && SUCCEEDED(result); i++)
+    {
+        D3D11_QUERY_DESC queryDesc;
+        queryDesc.Query = D3D11_QUERY_EVENT;
+        queryDesc.MiscFlags = 0;
+
+        result = pDevice->CreateQuery(&queryDesc, &m_slots[i].pEvent);
+    }
+    assert(SUCCEEDED(result));
+    if (SUCCEEDED(result))
+    {
+        m_pDevice = pDevice;
+        m_pDevice->AddRef();
+
+        m_stop = false;
+        m_writer = std::thread(&FrameCapture::WriterLoop, this);
+    }
+
+    return result;
+}
+
+void FrameCapture::Term(ID3D11DeviceContext* pContext)
+{
+    if (m_writer.joinable())
+    {
+        // Only wait of the class, at shutdown last captures are more important than latency
+        pContext->Flush();
+        bool busy = true;
+        while (busy)
+        {
+            Update(pContext);
+
+            busy = false;
+            for (UINT i = 0; i < SlotCount; i++)
+            {
+                busy = busy || m_slots[i].state != SlotFree;
+            }
+            if (busy)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_queueCV.notify_all();
+
+        m_writer.join();
+    }
+
+    for (UINT i = 0; i < SlotCount; i++)
+    {
+        SAFE_RELEASE(m_slots[i].pStaging);
+        SAFE_RELEASE(m_slots[i].pEvent);
+        m_slots[i].width = 0;
+        m_slots[i].height = 0;
+        m_slots[i].state = SlotFree;
+    }
+    SAFE_RELEASE(m_pDevice);
+}
+
+void FrameCapture::SetDirectory(const std::string& directory)
+{
+    m_directory = directory;
+    while (!m_directory.empty() && (m_directory.back() == '\\' || m_directory.back() == '/'))
+    {
+        m_directory.pop_back();
+    }
+    if (!m_directory.empty())
+    {
+        CreateDirectoryA(m_directory.c_str(), nullptr);
+    }
+}
+
+HRESULT FrameCapture::CreateStaging(Slot& slot, UINT slotIdx, const D3D11_TEXTURE2D_DESC& srcDesc)
+{
+    SAFE_RELEASE(slot.pStaging);
+    slot.width = 0;
+    slot.height = 0;
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = srcDesc.Format;
+    desc.ArraySize = 1;
+    desc.BindFlags = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.Height = srcDesc.Height;
+    desc.Width = srcDesc.Width;
+    desc.MipLevels = 1;
+
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, nullptr, &slot.pStaging);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(slot.pStaging, "FrameCapture" + std::to_string(slotIdx));
+    }
+    if (SUCCEEDED(result))
+    {
+        slot.width = srcDesc.Width;
+        slot.height = srcDesc.Height;
+    }
+
+    return result;
+}
+
+bool FrameCapture::Capture(ID3D11DeviceContext* pContext, ID3D11Texture2D* pSrc, const std::string& name)
+{
+    if (m_pDevice == nullptr)
+    {
+        return false;
+    }
+
+    D3D11_TEXTURE2D_DESC srcDesc;
+    pSrc->GetDesc(&srcDesc);
+    if ((srcDesc.Format != DXGI_FORMAT_R8G8B8A8_UNORM && srcDesc.Format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) || srcDesc.SampleDesc.Count != 1)
+    {
+        assert(0);
+        return false;
+    }
+
+    UINT slotIdx = SlotCount;
+    for (UINT i = 0; i < SlotCount && slotIdx == SlotCount; i++)
+    {
+        if (m_slots[i].state == SlotFree)
+        {
+            slotIdx = i;
+        }
+    }
+    // All slots are in flight or being written, skip this frame
+    if (slotIdx == SlotCount)
+    {
+        ++m_dropped;
+        return false;
+    }
+
+    Slot& slot = m_slots[slotIdx];
+    if (slot.width != srcDesc.Width || slot.height != srcDesc.Height)
+    {
+        if (FAILED(CreateStaging(slot, slotIdx, srcDesc)))
+        {
+            ++m_dropped;
+            return false;
+        }
+    }
+
+    pContext->CopySubresourceRegion(slot.pStaging, 0, 0, 0, 0, pSrc, 0, nullptr);
+    pContext->End(slot.pEvent);
+
+    slot.format = m_format;
+    slot.path = (m_directory.empty() ? "" : m_directory + "\\") + name;
+    if (slot.format == FileFormatRaw)
+    {
+        slot.path += "_" + std::to_string(slot.width) + "x" + std::to_string(slot.height) + ".raw";
+    }
+    else
+    {
+        slot.path += ".png";
+    }
+    slot.state = SlotCopying;
+    ++m_captured;
+
+    return true;
+}
+
+void FrameCapture::Update(ID3D11DeviceContext* pContext)
+{
+    for (UINT i = 0; i < SlotCount; i++)
+    {
+        Slot& slot = m_slots[i];
+        if (slot.state == SlotWritten)
+        {
+            pContext->Unmap(slot.pStaging, 0);
+            slot.pData = nullptr;
+            slot.state = SlotFree;
+        }
+        else if (slot.state == SlotCopying)
+        {
+            if (pContext->GetData(slot.pEvent, nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+            {
+                continue;
+            }
+
+            D3D11_MAPPED_SUBRESOURCE subresource;
+            if (FAILED(StallDetector::Get().Map(pContext, slot.pStaging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &subresource, STALL_SITE)))
+            {
+                continue;
+            }
+            slot.pData = (const BYTE*)subresource.pData;
+            slot.rowPitch = subresource.RowPitch;
+            slot.state = SlotWriting;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue.push_back(i);
+            }
+            m_queueCV.notify_one();
+        }
+    }
+}
+
+FrameCapture::Stats FrameCapture::GetStats() const
+{
+    Stats stats;
+    stats.captured = m_captured;
+    stats.written = m_written;
+    stats.dropped = m_dropped;
+    stats.failed = m_failed;
+
+    return stats;
+}
+
+void FrameCapture::WriterLoop()
+{
+    for (;;)
+    {
+        UINT slotIdx = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queueCV.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                return;
+            }
+            slotIdx = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        Slot& slot = m_slots[slotIdx];
+        bool written = slot.format == FileFormatRaw
+            ? WriteRaw(slot.path, slot.pData, slot.rowPitch, slot.width, slot.height)
+            : WritePng(slot.path, slot.pData, slot.rowPitch, slot.width, slot.height);
+        if (written)
+        {
+            ++m_written;
+        }
+        else
+        {
+            ++m_failed;
+        }
+
+        slot.state = SlotWritten;
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Non-blocking capture of rendered frames to image files.
+ * Frame is copied to a staging texture of a ring, a few frames later completed copy is mapped
+ * and handed to writer thread, which encodes the file straight from mapped memory.
+ * Render thread neither waits for GPU nor copies pixels, slot is unmapped once its file is written.
+ */
+class FrameCapture
+{
+public:
+    static const UINT SlotCount = 6; // GPU latency plus files being written
+
+    enum FileFormat
+    {
+        FileFormatPng = 0, // RGB, alpha of back buffer is not meaningful
+        FileFormatRaw,     // RGBA rows without padding, size is in file name
+
+        FileFormatCount
+    };
+
+    struct Stats
+    {
+        UINT64 captured;
+        UINT64 written;
+        UINT64 dropped; // No free slot at the time of capture
+        UINT64 failed;
+    };
+
+    FrameCapture()
+        : m_pDevice(nullptr)
+        , m_format(FileFormatPng)
+        , m_stop(false)
+        , m_captured(0)
+        , m_dropped(0)
+        , m_written(0)
+        , m_failed(0)
+    {
+        for (UINT i = 0; i < SlotCount; i++)
+        {
+            m_slots[i].pStaging = nullptr;
+            m_slots[i].pEvent = nullptr;
+            m_slots[i].width = 0;
+            m_slots[i].height = 0;
+            m_slots[i].format = FileFormatPng;
+            m_slots[i].pData = nullptr;
+            m_slots[i].rowPitch = 0;
+            m_slots[i].state = SlotFree;
+        }
+    }
+
+    HRESULT Init(ID3D11Device* pDevice);
+    /** Captures in flight are completed and written before return */
+    void Term(ID3D11DeviceContext* pContext);
+
+    /** Directory of written files, created if missing, empty for working directory */
+    void SetDirectory(const std::string& directory);
+    inline void SetFileFormat(FileFormat format) { m_format = format; }
+    inline FileFormat GetFileFormat() const { return m_format; }
+
+    /** Copy single sampled R8G8B8A8 texture to free slot, name is without extension. False if all slots are busy */
+    bool Capture(ID3D11DeviceContext* pContext, ID3D11Texture2D* pSrc, const std::string& name);
+
+    /** Pass completed copies to writer and release written slots, should be called once a frame */
+    void Update(ID3D11DeviceContext* pContext);
+
+    Stats GetStats() const;
+
+private:
+    enum SlotState
+    {
+        SlotFree = 0,
+        SlotCopying,  // Copy is queued on GPU
+        SlotWriting,  // Mapped, owned by writer thread
+        SlotWritten   // Waits for Unmap on render thread
+    };
+
+    struct Slot
+    {
+        ID3D11Texture2D* pStaging;
+        ID3D11Query* pEvent;
+        UINT width;
+        UINT height;
+        std::string path;
+        FileFormat format;
+        const BYTE* pData;
+        UINT rowPitch;
+        std::atomic<int> state;
+    };
+
+    void WriterLoop();
+    HRESULT CreateStaging(Slot& slot, UINT slotIdx, const D3D11_TEXTURE2D_DESC& srcDesc);
+
+private:
+    ID3D11Device* m_pDevice;
+    Slot m_slots[SlotCount];
+    std::string m_directory;
+    FileFormat m_format;
+
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_queueCV;
+    // Guarded by m_mutex
+    std::deque<UINT> m_queue;
+    bool m_stop;
+
+    UINT64 m_captured;
+    UINT64 m_dropped;
+    std::atomic<UINT64> m_written;
+    std::atomic<UINT64> m_failed;
+};
@@ -0,0 +1,67 @@
+#include "framework.h"
+
+#include "FrameInput.h"
+
+bool FrameInput::IsInputMessage(UINT message)
+{
+    switch (message)
+    {
+    case WM_SIZE:
+    case WM_ENTERSIZEMOVE:
+    case WM_EXITSIZEMOVE:
+    case WM_MOUSEMOVE:
+    case WM_MOUSEWHEEL:
+    case WM_MOUSEHWHEEL:
+    case WM_LBUTTONDOWN:
+    case WM_LBUTTONUP:
+    case WM_LBUTTONDBLCLK:
+    case WM_RBUTTONDOWN:
+    case WM_RBUTTONUP:
+    case WM_RBUTTONDBLCLK:
+    case WM_MBUTTONDOWN:
+    case WM_MBUTTONUP:
+    case WM_MBUTTONDBLCLK:
+    case WM_KEYDOWN:
+    case WM_KEYUP:
+    case WM_SYSKEYDOWN:
+    case WM_SYSKEYUP:
+    case WM_CHAR:
+    case WM_SETFOCUS:
+    case WM_KILLFOCUS:
+        return true;
+    }
+    return false;
+}
+
+void FrameInput::Push(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Only the latest position and size matter, so message storms do not grow the packet
+    std::vector<Message>& packet = m_packets[m_writeIdx];
+    if ((message == WM_MOUSEMOVE || message == WM_SIZE) && !packet.empty() && packet.back().message == message)
+    {
+        packet.back() = Message{ hWnd, message, wParam, lParam };
+        return;
+    }
+    packet.push_back(Message{ hWnd, message, wParam, lParam });
+    m_pushedCV.notify_one();
+}
+
+const std::vector<FrameInput::Message>& FrameInput::Swap()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Previous read packet is already replayed, it becomes the write one
+    UINT readIdx = m_writeIdx;
+    m_writeIdx = 1 - m_writeIdx;
+    m_packets[m_writeIdx].clear();
+
+    return m_packets[readIdx];
+}
+
+void FrameInput::Wait(DWORD timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pushedCV.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return !m_packets[m_writeIdx].empty(); });
+}
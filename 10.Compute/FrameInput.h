@@ -0,0 +1,46 @@
+#pragma once
+
+#include <windows.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/**
+ * Input messages passed from the window thread to the render thread.
+ * Double buffered, window thread fills one packet while render thread replays the other,
+ * and both only wait for the buffer swap.
+ */
+class FrameInput
+{
+public:
+    struct Message
+    {
+        HWND hWnd;
+        UINT message;
+        WPARAM wParam;
+        LPARAM lParam;
+    };
+
+    FrameInput()
+        : m_writeIdx(0)
+    {}
+
+    /** Messages which are replayed on the render thread */
+    static bool IsInputMessage(UINT message);
+
+    /** Called on the window thread, repeated mouse moves and resizes are coalesced */
+    void Push(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+
+    /** Called on the render thread, returns messages since the previous call */
+    const std::vector<Message>& Swap();
+
+    /** Called on the render thread while it is idle, returns when a message is pushed or on timeout */
+    void Wait(DWORD timeoutMs);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_pushedCV;
+    std::vector<Message> m_packets[2];
+    UINT m_writeIdx; // Guarded by m_mutex
+};
@@ -0,0 +1,122 @@
+#include "framework.h"
+
+#include "FramePacer.h"
+
+#include <algorithm>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+HRESULT FramePacer::Init(ID3D11Device* pDevice)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_frequency = frequency.QuadPart;
+
+    // High resolution timers are available since Windows 10 1803
+    m_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    m_highResTimer = m_timer != nullptr;
+    if (m_timer == nullptr)
+    {
+        m_timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    }
+
+    HRESULT result = m_timer != nullptr ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+    for (UINT i = 0; i < MaxFramesInFlightLimit && SUCCEEDED(result); i++)
+    {
+        D3D11_QUERY_DESC desc;
+        desc.Query = D3D11_QUERY_EVENT;
+        desc.MiscFlags = 0;
+
+        result = pDevice->CreateQuery(&desc, &m_pEvents[i]);
+    }
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void FramePacer::Term()
+{
+    for (UINT i = 0; i < MaxFramesInFlightLimit; i++)
+    {
+        SAFE_RELEASE(m_pEvents[i]);
+    }
+    if (m_timer != nullptr)
+    {
+        CloseHandle(m_timer);
+        m_timer = nullptr;
+    }
+}
+
+void FramePacer::SetMaxFramesInFlight(UINT count)
+{
+    m_maxFramesInFlight = std::min(std::max(count, 1u), (UINT)MaxFramesInFlightLimit);
+}
+
+INT64 FramePacer::GetTicks()
+{
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return ticks.QuadPart;
+}
+
+void FramePacer::SleepUntil(INT64 ticks)
+{
+    // Regular timer has scheduler granularity, so it wakes up a bit earlier and yields for the rest
+    const INT64 margin = m_highResTimer ? 0 : m_frequency / 1000;
+    for (;;)
+    {
+        INT64 left = ticks - GetTicks();
+        if (left <= 0)
+        {
+            break;
+        }
+        if (left > margin && m_timer != nullptr)
+        {
+            LARGE_INTEGER dueTime;
+            dueTime.QuadPart = -std::max((left - margin) * 10000000 / m_frequency, (INT64)1); // Relative, in 100 ns units
+            if (SetWaitableTimerEx(m_timer, &dueTime, 0, nullptr, nullptr, nullptr, 0))
+            {
+                WaitForSingleObject(m_timer, INFINITE);
+                continue;
+            }
+        }
+        SwitchToThread();
+    }
+}
+
+void FramePacer::WaitForFrame(ID3D11DeviceContext* pContext)
+{
+    // Limit CPU run-ahead: frame N - maxFramesInFlight should be finished on GPU
+    if (m_frame >= m_maxFramesInFlight)
+    {
+        ID3D11Query* pEvent = m_pEvents[(m_frame - m_maxFramesInFlight) % MaxFramesInFlightLimit];
+        BOOL done = FALSE;
+        while (pContext->GetData(pEvent, &done, sizeof(done), 0) == S_FALSE)
+        {
+            SleepUntil(GetTicks() + m_frequency / 5000); // Poll every 0.2 ms
+        }
+    }
+
+    // Limit frame rate
+    if (m_targetFps > 0)
+    {
+        INT64 now = GetTicks();
+        INT64 frameTicks = m_frequency / m_targetFps;
+        if (now < m_nextFrameTicks)
+        {
+            SleepUntil(m_nextFrameTicks);
+            now = m_nextFrameTicks;
+        }
+        // Keep regular cadence, but don't try to catch up after long frames
+        bool late = m_nextFrameTicks == 0 || now - m_nextFrameTicks > frameTicks;
+        m_nextFrameTicks = late ? now + frameTicks : m_nextFrameTicks + frameTicks;
+    }
+}
+
+void FramePacer::EndFrame(ID3D11DeviceContext* pContext)
+{
+    pContext->End(m_pEvents[m_frame % MaxFramesInFlightLimit]);
+    ++m_frame;
+}
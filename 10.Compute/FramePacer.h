@@ -0,0 +1,59 @@
+#pragma once
+
+#include <d3d11.h>
+
+/**
+ * Frame rate limiter and CPU run-ahead control.
+ * Frames in flight are tracked with event queries issued after Present,
+ * waiting is done with high resolution waitable timer instead of spinning.
+ */
+class FramePacer
+{
+public:
+    static const UINT MaxFramesInFlightLimit = 4;
+
+    FramePacer()
+        : m_timer(nullptr)
+        , m_highResTimer(false)
+        , m_frequency(1)
+        , m_nextFrameTicks(0)
+        , m_frame(0)
+        , m_targetFps(0)
+        , m_maxFramesInFlight(2)
+    {
+        for (UINT i = 0; i < MaxFramesInFlightLimit; i++)
+        {
+            m_pEvents[i] = nullptr;
+        }
+    }
+
+    HRESULT Init(ID3D11Device* pDevice);
+    void Term();
+
+    /** Wait until limits allow to start a new frame */
+    void WaitForFrame(ID3D11DeviceContext* pContext);
+    /** Mark the end of frame submission, called after Present */
+    void EndFrame(ID3D11DeviceContext* pContext);
+
+    /** Zero means no limit */
+    void SetTargetFps(UINT fps) { m_targetFps = fps; m_nextFrameTicks = 0; }
+    UINT GetTargetFps() const { return m_targetFps; }
+
+    void SetMaxFramesInFlight(UINT count);
+    UINT GetMaxFramesInFlight() const { return m_maxFramesInFlight; }
+
+private:
+    static INT64 GetTicks();
+    void SleepUntil(INT64 ticks);
+
+    HANDLE m_timer;
+    bool m_highResTimer;
+    INT64 m_frequency;
+    INT64 m_nextFrameTicks;
+
+    ID3D11Query* m_pEvents[MaxFramesInFlightLimit];
+    UINT64 m_frame;
+
+    UINT m_targetFps;
+    UINT m_maxFramesInFlight;
+};
@@ -0,0 +1,125 @@
+#include "framework.h"
+
+#include "Frustum.h"
+
+#include <math.h>
+
+Point4f BuildPlane(const Point3f& p0, const Point3f& p1, const Point3f& p2, const Point3f& p3)
+{
+    Point3f norm = (p1 - p0).cross(p3 - p0);
+    norm.normalize();
+    Point3f pos = (p0 + p1 + p2 + p3) * 0.25f;
+
+    return Point4f(norm.x, norm.y, norm.z, -pos.dot(norm));
+}
+
+void CalcFrustum(const Point3f& pos, const Point3f& dir, const Point3f& up, float fov, float aspect, float n, float f, Point4f frustum[6])
+{
+    Point3f right = up.cross(dir);
+
+    float x = tanf(fov * 0.5f) * n;
+    float y = tanf(fov * 0.5f) * n * aspect;
+
+    Point3f nearVertices[4];
+    nearVertices[0] = pos + dir * n - up * y - right * x;
+    nearVertices[1] = pos + dir * n - up * y + right * x;
+    nearVertices[2] = pos + dir * n + up * y + right * x;
+    nearVertices[3] = pos + dir * n + up * y - right * x;
+
+    // Side planes go through camera position, so any finite distance works for them
+    bool infinite = isinf(f);
+    float farDist = infinite ? n * 2.0f : f;
+
+    x = tanf(fov * 0.5f) * farDist;
+    y = tanf(fov * 0.5f) * farDist * aspect;
+
+    Point3f farVertices[4];
+    farVertices[0] = pos + dir * farDist - up * y - right * x;
+    farVertices[1] = pos + dir * farDist - up * y + right * x;
+    farVertices[2] = pos + dir * farDist + up * y + right * x;
+    farVertices[3] = pos + dir * farDist + up * y - right * x;
+
+    frustum[0] = BuildPlane(nearVertices[0], nearVertices[1], nearVertices[2], nearVertices[3]);
+    frustum[1] = BuildPlane(nearVertices[0], farVertices[0], farVertices[1], nearVertices[1]);
+    frustum[2] = BuildPlane(nearVertices[1], farVertices[1], farVertices[2], nearVertices[2]);
+    frustum[3] = BuildPlane(nearVertices[2], farVertices[2], farVertices[3], nearVertices[3]);
+    frustum[4] = BuildPlane(nearVertices[3], farVertices[3], farVertices[0], nearVertices[0]);
+    frustum[5] = infinite ? Point4f(0, 0, 0, 1) : BuildPlane(farVertices[1], farVertices[0], farVertices[3], farVertices[2]);
+}
+
+void ExtractFrustum(const DirectX::XMMATRIX& vp, bool infiniteFar, Point4f frustum[6])
+{
+    // Row vectors are multiplied, so clip coordinates are dot products with matrix columns
+    DirectX::XMFLOAT4X4 m;
+    DirectX::XMStoreFloat4x4(&m, DirectX::XMMatrixTranspose(vp));
+    Point4f x{ m._11, m._12, m._13, m._14 };
+    Point4f y{ m._21, m._22, m._23, m._24 };
+    Point4f z{ m._31, m._32, m._33, m._34 };
+    Point4f w{ m._41, m._42, m._43, m._44 };
+
+    // Reversed Z, near plane is at clip z = w and far one at z = 0
+    frustum[0] = w - z;
+    frustum[1] = w + y;
+    frustum[2] = w - x;
+    frustum[3] = w - y;
+    frustum[4] = w + x;
+    frustum[5] = z;
+
+    // Depth of infinite projection does not depend on distance, so its far plane has no normal
+    if (infiniteFar)
+    {
+        frustum[5] = Point4f(0, 0, 0, 1);
+    }
+
+    for (int i = 0; i < (infiniteFar ? 5 : 6); i++)
+    {
+        float length = Point3f(frustum[i]).length();
+        frustum[i] = frustum[i] * (1.0f / length);
+    }
+}
+
+bool IsBoxInside(const Point4f frustum[6], const Point3f& bbMin, const Point3f& bbMax)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const Point3f norm = frustum[i];
+        Point4f p(
+            signbit(norm.x) ? bbMin.x : bbMax.x,
+            signbit(norm.y) ? bbMin.y : bbMax.y,
+            signbit(norm.z) ? bbMin.z : bbMax.z,
+            1.0f
+        );
+        float s = p.dot(frustum[i]);
+        if (s < 0.0f)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool IsOrientedBoxInside(const Point4f frustum[6], const DirectX::XMMATRIX& m, const Point4f& bounds)
+{
+    // Row vectors are multiplied, so rows are box axes and translation
+    DirectX::XMFLOAT4X4 model;
+    DirectX::XMStoreFloat4x4(&model, m);
+    const Point3f axes[3] = {
+        Point3f{ model._11, model._12, model._13 },
+        Point3f{ model._21, model._22, model._23 },
+        Point3f{ model._31, model._32, model._33 }
+    };
+    const Point4f center{ model._41, model._42, model._43, 1.0f };
+
+    for (int i = 0; i < 6; i++)
+    {
+        const Point3f norm = frustum[i];
+        float radius = fabsf(norm.dot(axes[0])) * bounds.x + fabsf(norm.dot(axes[1])) * bounds.y + fabsf(norm.dot(axes[2])) * bounds.z + bounds.w;
+        if (center.dot(frustum[i]) < -radius)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
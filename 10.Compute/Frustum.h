@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../Math/Point.h"
+
+#include <DirectXMath.h>
+
+/** Build plane equation on 4 points, normal points inside for clockwise order */
+Point4f BuildPlane(const Point3f& p0, const Point3f& p1, const Point3f& p2, const Point3f& p3);
+
+/**
+ * Frustum planes of perspective camera, near and far first. Aspect is height to width ratio.
+ * For infinite f far plane passes everything
+ */
+void CalcFrustum(const Point3f& pos, const Point3f& dir, const Point3f& up, float fov, float aspect, float n, float f, Point4f frustum[6]);
+
+/**
+ * Frustum planes of reversed Z view projection (Gribb-Hartmann), in CalcFrustum order with normalized normals.
+ * For infinite far plane passes everything
+ */
+void ExtractFrustum(const DirectX::XMMATRIX& vp, bool infiniteFar, Point4f frustum[6]);
+
+/** Is box inside? */
+bool IsBoxInside(const Point4f frustum[6], const Point3f& bbMin, const Point3f& bbMax);
+
+/**
+ * Are model space bounds transformed with m inside? Bounds xyz is box half size around origin, w is radius it is extended by,
+ * so both oriented boxes and spheres are covered. Matrix should have no scale
+ */
+bool IsOrientedBoxInside(const Point4f frustum[6], const DirectX::XMMATRIX& m, const Point4f& bounds);
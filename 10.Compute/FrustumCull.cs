@@ -1,49 +1,143 @@
 #include "SceneCB.h"
+#include "GroupAppend.h"
+#include "Occlusion.h"
+#include "GeomBuffer.h"
+#ifdef MULTI_VIEW
+#include "MultiView.h"
+#endif // MULTI_VIEW
 
 cbuffer CullParams : register(b1)
 {
-    uint4 numShapes; // x - objects count
-    float4 bbMin[100];
-    float4 bbMax[100];
+    uint4 numShapes; // x - objects count, y - clusters count, z - test mesh bounds after boxes
+    float4 lodParams; // x - vertical projection scale, y - projected radius where LOD 1 starts, z - where impostors start
+    uint4 lodCounts; // LOD count of each instanced mesh
 };
 
-RWStructuredBuffer<uint> indirectArgs : register(u0);
-RWStructuredBuffer<uint4> objectIds : register(u1);
+StructuredBuffer<AABB> bounds : register(t0);
+StructuredBuffer<GeomBuffer> geomBuffer : register(t5);
 
-bool IsBoxInside(in float4 frustum[6], in float3 bbMin, in float3 bbMax)
+RWBuffer<uint> indirectArgs : register(u0); // Per mesh LOD, instance counts are reset by copy from initial arguments
+RWStructuredBuffer<uint> objectIds : register(u1);
+RWStructuredBuffer<uint> occludedIds : register(u2);
+RWStructuredBuffer<uint> occludedCount : register(u3);
+
+// Boxes cover any rotation, so they are used for hierarchy and occlusion, and bounds of rotated mesh are tested for visible ones
+bool IsMeshInside(in uint objectId)
 {
-    for (int i = 0; i < 6; i++)
-    {
-        const float3 norm = frustum[i].xyz;
-        float4 p = float4(
-            norm.x < 0 ? bbMin.x : bbMax.x,
-            norm.y < 0 ? bbMin.y : bbMax.y,
-            norm.z < 0 ? bbMin.z : bbMax.z,
-            1.0
-        );
-        float s = dot(p, frustum[i]);
-        if (s < 0.0f)
-        {
-            return false;
-        }
+    return numShapes.z == 0 || IsInstanceInside(frustum, GetModel(geomBuffer[objectId]), GetInstancedMesh(geomBuffer[objectId]));
+}
+
+uint GetDestination(in uint objectId, in AABB bb)
+{
+    if (IsOccluded(bb.bbMin, bb.bbMax))
+    {
+        // Occluded by previous frame depth, OcclusionCull.cs retests it against current frame
+        return AppendOccluded;
+    }
+
+    uint mesh = GetInstancedMesh(geomBuffer[objectId]);
+    return mesh * MaxLods + SelectLod(bb, cameraPos.xyz, lodParams, lodCounts[mesh]);
+}
+
+void AppendObject(in uint groupIndex, in uint objectId, in uint dest, in uint segmentSize = MeshSegmentSize)
+{
+#ifdef PER_THREAD_APPEND
+    // Global atomic per id, kept for comparison
+    uint slot = 0;
+    if (dest == AppendOccluded)
+    {
+        InterlockedAdd(occludedCount[0], 1, slot);
+    }
+    else if (dest != AppendNone)
+    {
+        InterlockedAdd(indirectArgs[dest * ArgsStride + 1], 1, slot); // Corresponds to instanceCount in DrawIndexedIndirect
     }
+#else
+    uint slot = GroupAppend(groupIndex, dest, indirectArgs, occludedCount);
+#endif
 
-    return true;
+    if (dest == AppendOccluded)
+    {
+        occludedIds[slot] = objectId;
+    }
+    else if (dest != AppendNone)
+    {
+        objectIds[dest * segmentSize + slot] = objectId;
+    }
 }
 
+#if defined(MULTI_VIEW)
+// Each instance is tested against all views, and appended once per view it is in, tagged with view index.
+// LOD is selected by camera position, so it is the same in all views
 [numthreads(64, 1, 1)]
-void cs(uint3 globalThreadId : SV_DispatchThreadID)
+void cs(uint3 globalThreadId : SV_DispatchThreadID, uint3 groupThreadId : SV_GroupThreadID)
 {
-    if (globalThreadId.x >= numShapes.x)
+    bool valid = globalThreadId.x < numShapes.x;
+    uint objectId = min(globalThreadId.x, numShapes.x - 1);
+    AABB bb = bounds[objectId];
+    uint lodDest = GetDestination(objectId, bb);
+
+    // No early exit, as all threads take part in append of each view
+    for (uint view = 0; view < viewParams.x; view++)
     {
-        return;
+        float4 viewFrustum[6];
+        for (uint i = 0; i < 6; i++)
+        {
+            viewFrustum[i] = viewFrusta[view * 6 + i];
+        }
+
+        uint dest = AppendNone;
+        if (valid && IsBoxInside(viewFrustum, bb.bbMin, bb.bbMax)
+            && (numShapes.z == 0 || IsInstanceInside(viewFrustum, GetModel(geomBuffer[objectId]), GetInstancedMesh(geomBuffer[objectId]))))
+        {
+            dest = lodDest;
+        }
+
+        AppendObject(groupThreadId.x, objectId | (view << ViewShift), dest, viewParams.y);
     }
+}
+#elif defined(CLUSTERS)
+StructuredBuffer<Cluster> clusters : register(t1);
+StructuredBuffer<uint> instOrder : register(t2);
+StructuredBuffer<uint> visibleClusters : register(t3);
+
+// One group per visible cluster from ClusterCull.cs, group size matches Bvh::LeafSize
+[numthreads(64, 1, 1)]
+void cs(uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID)
+{
+    uint clusterInfo = visibleClusters[groupId.x];
+    Cluster cluster = clusters[clusterInfo & ~FullyInsideFlag];
 
-    if (IsBoxInside(frustum, bbMin[globalThreadId.x].xyz, bbMax[globalThreadId.x].xyz))
+    // No early exit, as all threads take part in append
+    uint objectId = 0;
+    uint dest = AppendNone;
+    if (groupThreadId.x < cluster.count)
     {
-        uint id = 0;
-        InterlockedAdd(indirectArgs[1], 1, id); // Corresponds to instanceCount in DrawIndexedIndirect
+        objectId = instOrder[cluster.first + groupThreadId.x];
+        AABB bb = bounds[objectId];
+        if ((clusterInfo & FullyInsideFlag) != 0 || (IsBoxInside(frustum, bb.bbMin, bb.bbMax) && IsMeshInside(objectId)))
+        {
+            dest = GetDestination(objectId, bb);
+        }
+    }
 
-        objectIds[id] = uint4(globalThreadId.x, 0, 0, 0);
+    AppendObject(groupThreadId.x, objectId, dest);
+}
+#else
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID, uint3 groupThreadId : SV_GroupThreadID)
+{
+    // No early exit, as all threads take part in append
+    uint dest = AppendNone;
+    if (globalThreadId.x < numShapes.x)
+    {
+        AABB bb = bounds[globalThreadId.x];
+        if (IsBoxInside(frustum, bb.bbMin, bb.bbMax) && IsMeshInside(globalThreadId.x))
+        {
+            dest = GetDestination(globalThreadId.x, bb);
+        }
     }
+
+    AppendObject(groupThreadId.x, globalThreadId.x, dest);
 }
+#endif // CLUSTERS
@@ -0,0 +1,16 @@
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float2 uv : TEXCOORD;
+};
+
+// Triangle covering the viewport, generated from vertex id without vertex buffer
+VSOutput vs(uint vertexId : SV_VertexID)
+{
+    VSOutput result;
+
+    result.uv = float2((vertexId << 1) & 2, vertexId & 2);
+    result.pos = float4(result.uv * float2(2, -2) + float2(-1, 1), 0, 1);
+
+    return result;
+}
@@ -0,0 +1,116 @@
+Texture2D<float4> colorTexture : register(t0);
+RWTexture2D<unorm float4> colorTarget : register(u0);
+
+static const float EdgeThresholdMin = 0.0312;
+static const float EdgeThreshold = 0.125;
+static const float SubpixelQuality = 0.75;
+static const int SearchSteps = 8;
+
+static int2 maxPixel;
+
+float3 LoadColor(in int2 pixel)
+{
+    return colorTexture.Load(int3(clamp(pixel, int2(0, 0), maxPixel), 0)).rgb;
+}
+
+float LoadLuma(in int2 pixel)
+{
+    return dot(LoadColor(pixel), float3(0.299, 0.587, 0.114));
+}
+
+// Simplified FXAA, edge end search is done with whole pixel steps, so no filtered samples are needed
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint width, height;
+    colorTexture.GetDimensions(width, height);
+    if (globalThreadId.x >= width || globalThreadId.y >= height)
+    {
+        return;
+    }
+    maxPixel = int2(width - 1, height - 1);
+
+    int2 pixel = int2(globalThreadId.xy);
+    float3 color = LoadColor(pixel);
+
+    float lumaC = dot(color, float3(0.299, 0.587, 0.114));
+    float lumaN = LoadLuma(pixel + int2(0, -1));
+    float lumaS = LoadLuma(pixel + int2(0, 1));
+    float lumaW = LoadLuma(pixel + int2(-1, 0));
+    float lumaE = LoadLuma(pixel + int2(1, 0));
+
+    float lumaMin = min(lumaC, min(min(lumaN, lumaS), min(lumaW, lumaE)));
+    float lumaMax = max(lumaC, max(max(lumaN, lumaS), max(lumaW, lumaE)));
+    float lumaRange = lumaMax - lumaMin;
+    if (lumaRange < max(EdgeThresholdMin, lumaMax * EdgeThreshold))
+    {
+        colorTarget[pixel] = float4(color, 1.0);
+        return;
+    }
+
+    float lumaNW = LoadLuma(pixel + int2(-1, -1));
+    float lumaNE = LoadLuma(pixel + int2(1, -1));
+    float lumaSW = LoadLuma(pixel + int2(-1, 1));
+    float lumaSE = LoadLuma(pixel + int2(1, 1));
+
+    float edgeHorz = abs(lumaNW + lumaSW - 2.0 * lumaW) + 2.0 * abs(lumaN + lumaS - 2.0 * lumaC) + abs(lumaNE + lumaSE - 2.0 * lumaE);
+    float edgeVert = abs(lumaNW + lumaNE - 2.0 * lumaN) + 2.0 * abs(lumaW + lumaE - 2.0 * lumaC) + abs(lumaSW + lumaSE - 2.0 * lumaS);
+    bool isHorz = edgeHorz >= edgeVert;
+
+    // Edge is between center and the neighbour across it with the steepest gradient
+    float luma1 = isHorz ? lumaN : lumaW;
+    float luma2 = isHorz ? lumaS : lumaE;
+    float gradient1 = luma1 - lumaC;
+    float gradient2 = luma2 - lumaC;
+    bool is1Steepest = abs(gradient1) >= abs(gradient2);
+    float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+    int2 across = isHorz ? int2(0, 1) : int2(1, 0);
+    int2 along = isHorz ? int2(1, 0) : int2(0, 1);
+    float lumaLocal = 0.5 * (lumaC + (is1Steepest ? luma1 : luma2));
+    if (is1Steepest)
+    {
+        across = -across;
+    }
+
+    // Walk both ways along the edge until its luma changes
+    float delta1 = 0.0;
+    float delta2 = 0.0;
+    int dist1 = SearchSteps;
+    int dist2 = SearchSteps;
+    bool reached1 = false;
+    bool reached2 = false;
+    for (int i = 1; i <= SearchSteps && !(reached1 && reached2); i++)
+    {
+        if (!reached1)
+        {
+            int2 p = pixel - along * i;
+            delta1 = 0.5 * (LoadLuma(p) + LoadLuma(p + across)) - lumaLocal;
+            reached1 = abs(delta1) >= gradientScaled;
+            dist1 = i;
+        }
+        if (!reached2)
+        {
+            int2 p = pixel + along * i;
+            delta2 = 0.5 * (LoadLuma(p) + LoadLuma(p + across)) - lumaLocal;
+            reached2 = abs(delta2) >= gradientScaled;
+            dist2 = i;
+        }
+    }
+
+    bool isDirection1 = dist1 < dist2;
+    float pixelOffset = 0.5 - (float)min(dist1, dist2) / (float)(dist1 + dist2);
+
+    // Edge end with the same luma variation as center means the center is past the edge
+    bool isCenterSmaller = lumaC < lumaLocal;
+    bool correctVariation = ((isDirection1 ? delta1 : delta2) < 0.0) != isCenterSmaller;
+    float offset = correctVariation ? pixelOffset : 0.0;
+
+    // Subpixel aliasing, thin lines and single pixel features
+    float lumaAverage = (2.0 * (lumaN + lumaS + lumaW + lumaE) + lumaNW + lumaNE + lumaSW + lumaSE) / 12.0;
+    float subpixel = saturate(abs(lumaAverage - lumaC) / lumaRange);
+    subpixel = (-2.0 * subpixel + 3.0) * subpixel * subpixel;
+    offset = max(offset, subpixel * subpixel * SubpixelQuality);
+
+    colorTarget[pixel] = float4(lerp(color, LoadColor(pixel + across), offset), 1.0);
+}
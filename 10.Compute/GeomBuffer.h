@@ -0,0 +1,34 @@
+// Compact instance, 64 bytes. Should match Renderer::PackedGeomBuffer
+struct GeomBuffer
+{
+    float4 model[3]; // Rows of 3x4 model matrix, transform is rigid so directions are transformed with it too
+    float angle; // Current rotation angle
+    float speed; // Rotation speed
+    uint shininess; // Half float in low 16 bits
+    uint materialMesh; // Bits 0-15 - material id, 16-23 - instanced mesh
+};
+
+float3x4 GetModel(in GeomBuffer geom)
+{
+    return float3x4(geom.model[0], geom.model[1], geom.model[2]);
+}
+
+float3 GetPosition(in GeomBuffer geom)
+{
+    return float3(geom.model[0].w, geom.model[1].w, geom.model[2].w);
+}
+
+uint GetMaterialId(in GeomBuffer geom)
+{
+    return geom.materialMesh & 0xffff;
+}
+
+uint GetInstancedMesh(in GeomBuffer geom)
+{
+    return (geom.materialMesh >> 16) & 0xff;
+}
+
+float GetShininess(in GeomBuffer geom)
+{
+    return f16tof32(geom.shininess);
+}
@@ -0,0 +1,227 @@
+#include "framework.h"
+
+#include "GeometryPool.h"
+#include "StateCache.h"
+
+#include <DirectXPackedVector.h>
+
+namespace
+{
+
+Point3f GetPosition(GeometryPool::VertexFormat format, const char* pVertex)
+{
+    if (format == GeometryPool::VertexFormatPacked)
+    {
+        using DirectX::PackedVector::XMConvertHalfToFloat;
+
+        const UINT16* pPos = reinterpret_cast<const UINT16*>(pVertex);
+        return Point3f{ XMConvertHalfToFloat(pPos[0]), XMConvertHalfToFloat(pPos[1]), XMConvertHalfToFloat(pPos[2]) };
+    }
+
+    return *reinterpret_cast<const Point3f*>(pVertex);
+}
+
+}
+
+UINT GeometryPool::AddMesh(VertexFormat format, UINT stride, const void* pVertices, UINT vertexCount, const UINT16* pIndices, UINT indexCount, bool optimize)
+{
+    return AddTypedMesh(format, stride, pVertices, vertexCount, pIndices, indexCount, optimize, m_indices);
+}
+
+UINT GeometryPool::AddMesh(VertexFormat format, UINT stride, const void* pVertices, UINT vertexCount, const UINT32* pIndices, UINT indexCount, bool optimize)
+{
+    return AddTypedMesh(format, stride, pVertices, vertexCount, pIndices, indexCount, optimize, m_wideIndices);
+}
+
+template <typename Index>
+UINT GeometryPool::AddTypedMesh(VertexFormat format, UINT stride, const void* pVertices, UINT vertexCount, const Index* pIndices, UINT indexCount, bool optimize, std::vector<Index>& poolIndices)
+{
+    assert(m_strides[format] == 0 || m_strides[format] == stride);
+    m_strides[format] = stride;
+
+    std::vector<char>& vertices = m_vertices[format];
+
+    Mesh mesh;
+    mesh.format = format;
+    mesh.indexCount = indexCount;
+    mesh.startIndex = (UINT)poolIndices.size();
+    mesh.baseVertex = (INT)(vertices.size() / stride);
+    mesh.indexFormat = sizeof(Index) == sizeof(UINT16) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+
+    const char* pSrcVertices = reinterpret_cast<const char*>(pVertices);
+    std::vector<char> meshVertices(pSrcVertices, pSrcVertices + vertexCount * stride);
+    std::vector<Index> meshIndices(pIndices, pIndices + indexCount);
+
+    // Vertex cache order first, overdraw sort moves only cache efficient clusters, fetch order follows the final indices
+    mesh.sourceStats = MeshOptimizer::AnalyzeVertexCache(meshIndices.data(), indexCount, vertexCount);
+    if (optimize)
+    {
+        MeshOptimizer::OptimizeVertexCache(meshIndices.data(), indexCount, vertexCount);
+
+        std::vector<Point3f> positions(vertexCount);
+        for (UINT i = 0; i < vertexCount; i++)
+        {
+            positions[i] = GetPosition(format, meshVertices.data() + i * stride);
+        }
+        MeshOptimizer::OptimizeOverdraw(meshIndices.data(), indexCount, positions.data(), vertexCount);
+
+        MeshOptimizer::OptimizeVertexFetch(meshVertices.data(), vertexCount, stride, meshIndices.data(), indexCount);
+        mesh.stats = MeshOptimizer::AnalyzeVertexCache(meshIndices.data(), indexCount, vertexCount);
+    }
+    else
+    {
+        mesh.stats = mesh.sourceStats;
+    }
+
+    vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+    poolIndices.insert(poolIndices.end(), meshIndices.begin(), meshIndices.end());
+
+    m_meshes.push_back(mesh);
+    return (UINT)m_meshes.size() - 1;
+}
+
+HRESULT GeometryPool::Init(ID3D11Device* pDevice)
+{
+    static const char* VertexBufferNames[VertexFormatCount] = { "PoolTexturedVertexBuffer", "PoolPositionVertexBuffer", "PoolColorVertexBuffer", "PoolPackedVertexBuffer" };
+
+    HRESULT result = S_OK;
+    for (UINT i = 0; i < VertexFormatCount && SUCCEEDED(result); i++)
+    {
+        if (m_vertices[i].empty())
+        {
+            continue;
+        }
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = (UINT)m_vertices[i].size();
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = m_vertices[i].data();
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = pDevice->CreateBuffer(&desc, &data, &m_pVertexBuffers[i]);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVertexBuffers[i], VertexBufferNames[i]);
+        }
+    }
+    if (SUCCEEDED(result) && !m_indices.empty())
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = (UINT)(m_indices.size() * sizeof(UINT16));
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = m_indices.data();
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = pDevice->CreateBuffer(&desc, &data, &m_pIndexBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pIndexBuffer, "PoolIndexBuffer");
+        }
+    }
+    if (SUCCEEDED(result) && !m_wideIndices.empty())
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = (UINT)(m_wideIndices.size() * sizeof(UINT32));
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_INDEX_BUFFER | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+        desc.StructureByteStride = 0;
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = m_wideIndices.data();
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = pDevice->CreateBuffer(&desc, &data, &m_pWideIndexBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pWideIndexBuffer, "PoolWideIndexBuffer");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+            srvDesc.BufferEx.FirstElement = 0;
+            srvDesc.BufferEx.NumElements = (UINT)m_wideIndices.size();
+            srvDesc.BufferEx.Flags = D3D11_BUFFEREX_SRV_FLAG_RAW;
+
+            result = pDevice->CreateShaderResourceView(m_pWideIndexBuffer, &srvDesc, &m_pWideIndexSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pWideIndexSRV, "PoolWideIndexSRV");
+        }
+    }
+
+    // Buffers are immutable, so CPU data is no longer needed
+    for (UINT i = 0; i < VertexFormatCount; i++)
+    {
+        std::vector<char>().swap(m_vertices[i]);
+    }
+    std::vector<UINT16>().swap(m_indices);
+    std::vector<UINT32>().swap(m_wideIndices);
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void GeometryPool::Term()
+{
+    for (UINT i = 0; i < VertexFormatCount; i++)
+    {
+        SAFE_RELEASE(m_pVertexBuffers[i]);
+        m_vertices[i].clear();
+        m_strides[i] = 0;
+    }
+    SAFE_RELEASE(m_pWideIndexSRV);
+    SAFE_RELEASE(m_pWideIndexBuffer);
+    SAFE_RELEASE(m_pIndexBuffer);
+    m_indices.clear();
+    m_wideIndices.clear();
+    m_meshes.clear();
+}
+
+void GeometryPool::Bind(StateCache& state, VertexFormat format) const
+{
+    state.IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+
+    ID3D11Buffer* vertexBuffers[] = { m_pVertexBuffers[format] };
+    UINT strides[] = { m_strides[format] };
+    UINT offsets[] = { 0 };
+    state.IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+}
+
+void GeometryPool::BindIndexBuffer(StateCache& state, UINT id) const
+{
+    const Mesh& mesh = m_meshes[id];
+    state.IASetIndexBuffer(mesh.indexFormat == DXGI_FORMAT_R16_UINT ? m_pIndexBuffer : m_pWideIndexBuffer, mesh.indexFormat, 0);
+}
+
+void GeometryPool::Draw(StateCache& state, UINT id) const
+{
+    const Mesh& mesh = m_meshes[id];
+    state.DrawIndexed(mesh.indexCount, mesh.startIndex, mesh.baseVertex);
+}
+
+void GeometryPool::DrawInstanced(StateCache& state, UINT id, UINT instanceCount, UINT startInstance) const
+{
+    const Mesh& mesh = m_meshes[id];
+    state.DrawIndexedInstanced(mesh.indexCount, instanceCount, mesh.startIndex, mesh.baseVertex, startInstance);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <vector>
+
+#include "MeshOptimizer.h"
+
+class StateCache;
+
+/**
+ * Static meshes sub-allocated from one immutable vertex buffer per vertex format and shared 16-bit and 32-bit index buffers.
+ * Meshes added with 32-bit indices go to the wide buffer, which is also readable as raw buffer for cluster culling.
+ * Meshes are addressed with start index and base vertex, so switching meshes of the same format needs no rebinding.
+ * All meshes should be added before Init, offsets are known right away though.
+ * Meshes are reordered by MeshOptimizer when added, vertex position should be the first vertex element.
+ */
+class GeometryPool
+{
+public:
+    enum VertexFormat
+    {
+        VertexFormatTextured = 0, // Position, tangent, normal, uv
+        VertexFormatPosition,
+        VertexFormatColor,        // Position, color
+        VertexFormatPacked,       // Half position, octahedral normal and tangent, half uv
+
+        VertexFormatCount
+    };
+
+    struct Mesh
+    {
+        VertexFormat format;
+        UINT indexCount;
+        UINT startIndex; // In index buffer of indexFormat
+        INT baseVertex;
+        DXGI_FORMAT indexFormat;
+
+        MeshOptimizer::Stats sourceStats; // Vertex cache efficiency of indices as they were added
+        MeshOptimizer::Stats stats;
+    };
+
+    GeometryPool()
+        : m_pIndexBuffer(nullptr)
+        , m_pWideIndexBuffer(nullptr)
+        , m_pWideIndexSRV(nullptr)
+    {
+        for (UINT i = 0; i < VertexFormatCount; i++)
+        {
+            m_strides[i] = 0;
+            m_pVertexBuffers[i] = nullptr;
+        }
+    }
+
+    /** Returns mesh id, indices are relative to mesh first vertex. Cooked meshes are optimized already, so they can skip MeshOptimizer */
+    UINT AddMesh(VertexFormat format, UINT stride, const void* pVertices, UINT vertexCount, const UINT16* pIndices, UINT indexCount, bool optimize = true);
+    UINT AddMesh(VertexFormat format, UINT stride, const void* pVertices, UINT vertexCount, const UINT32* pIndices, UINT indexCount, bool optimize = true);
+
+    /** Create buffers from all added meshes, CPU copies are freed */
+    HRESULT Init(ID3D11Device* pDevice);
+    void Term();
+
+    inline const Mesh& GetMesh(UINT id) const { return m_meshes[id]; }
+    inline ID3D11Buffer* GetVertexBuffer(VertexFormat format) const { return m_pVertexBuffers[format]; }
+    inline UINT GetStride(VertexFormat format) const { return m_strides[format]; }
+    inline ID3D11ShaderResourceView* GetWideIndexSRV() const { return m_pWideIndexSRV; }
+
+    /** Bind vertex buffer of given format to slot 0 and the shared 16-bit index buffer */
+    void Bind(StateCache& state, VertexFormat format) const;
+    /** Bind index buffer the mesh is in, state cache skips it while meshes of the same index format are drawn */
+    void BindIndexBuffer(StateCache& state, UINT id) const;
+
+    void Draw(StateCache& state, UINT id) const;
+    void DrawInstanced(StateCache& state, UINT id, UINT instanceCount, UINT startInstance = 0) const;
+
+private:
+    template <typename Index>
+    UINT AddTypedMesh(VertexFormat format, UINT stride, const void* pVertices, UINT vertexCount, const Index* pIndices, UINT indexCount, bool optimize, std::vector<Index>& poolIndices);
+
+    std::vector<Mesh> m_meshes;
+
+    std::vector<char> m_vertices[VertexFormatCount];
+    std::vector<UINT16> m_indices;
+    std::vector<UINT32> m_wideIndices;
+    UINT m_strides[VertexFormatCount];
+
+    ID3D11Buffer* m_pVertexBuffers[VertexFormatCount];
+    ID3D11Buffer* m_pIndexBuffer;
+    ID3D11Buffer* m_pWideIndexBuffer;
+    ID3D11ShaderResourceView* m_pWideIndexSRV;
+};
@@ -0,0 +1,348 @@
+#include "framework.h"
+
+#include "GpuProfiler.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+#include <float.h>
+#include <stdio.h>
+
+#include "imgui.h"
+
+HRESULT GpuProfiler::Init(ID3D11Device* pDevice)
+{
+    HRESULT result = S_OK;
+
+    for (UINT i = 0; i < FrameCount && SUCCEEDED(result); i++)
+    {
+        D3D11_QUERY_DESC desc;
+        desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+        desc.MiscFlags = 0;
+
+        result = pDevice->CreateQuery(&desc, &m_frames[i].pDisjoint);
+
+        desc.Query = D3D11_QUERY_TIMESTAMP;
+        for (UINT j = 0; j < MaxScopes * 2 && SUCCEEDED(result); j++)
+        {
+            result = pDevice->CreateQuery(&desc, &m_frames[i].pTimestamps[j]);
+        }
+
+        desc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+        for (UINT j = 0; j < MaxScopes && SUCCEEDED(result); j++)
+        {
+            result = pDevice->CreateQuery(&desc, &m_frames[i].pStats[j]);
+        }
+    }
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void GpuProfiler::Term()
+{
+    for (UINT i = 0; i < FrameCount; i++)
+    {
+        SAFE_RELEASE(m_frames[i].pDisjoint);
+        for (UINT j = 0; j < MaxScopes * 2; j++)
+        {
+            SAFE_RELEASE(m_frames[i].pTimestamps[j]);
+        }
+        for (UINT j = 0; j < MaxScopes; j++)
+        {
+            SAFE_RELEASE(m_frames[i].pStats[j]);
+        }
+    }
+    ResetHistory();
+}
+
+void GpuProfiler::BeginFrame(ID3D11DeviceContext* pContext)
+{
+    // Skip profiling in the rare case when all frames are still in flight
+    if (m_curFrame - m_readFrame >= FrameCount)
+    {
+        CollectFrames(pContext);
+    }
+    m_frameActive = m_curFrame - m_readFrame < FrameCount;
+    if (!m_frameActive)
+    {
+        return;
+    }
+
+    Frame& frame = m_frames[m_curFrame % FrameCount];
+    frame.scopeCount = 0;
+    frame.pipelineStats = m_pipelineStats;
+    m_depth = 0;
+
+    pContext->Begin(frame.pDisjoint);
+}
+
+void GpuProfiler::EndFrame(ID3D11DeviceContext* pContext)
+{
+    if (m_frameActive)
+    {
+        Frame& frame = m_frames[m_curFrame % FrameCount];
+        pContext->End(frame.pDisjoint);
+        ++m_curFrame;
+        m_frameActive = false;
+    }
+
+    CollectFrames(pContext);
+}
+
+UINT GpuProfiler::BeginScope(ID3D11DeviceContext* pContext, const char* name)
+{
+    Frame& frame = m_frames[m_curFrame % FrameCount];
+    if (!m_frameActive || frame.scopeCount >= MaxScopes)
+    {
+        return MaxScopes;
+    }
+
+    UINT scope = frame.scopeCount++;
+    frame.scopes[scope].name = name;
+    frame.scopes[scope].depth = m_depth++;
+    pContext->End(frame.pTimestamps[scope * 2]);
+    if (frame.pipelineStats)
+    {
+        pContext->Begin(frame.pStats[scope]);
+    }
+
+    return scope;
+}
+
+void GpuProfiler::EndScope(ID3D11DeviceContext* pContext, UINT scope)
+{
+    if (!m_frameActive || scope >= MaxScopes)
+    {
+        return;
+    }
+
+    Frame& frame = m_frames[m_curFrame % FrameCount];
+    if (frame.pipelineStats)
+    {
+        pContext->End(frame.pStats[scope]);
+    }
+    pContext->End(frame.pTimestamps[scope * 2 + 1]);
+    --m_depth;
+}
+
+void GpuProfiler::CollectFrames(ID3D11DeviceContext* pContext)
+{
+    while (m_readFrame < m_curFrame)
+    {
+        Frame& frame = m_frames[m_readFrame % FrameCount];
+
+        D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+        if (StallDetector::Get().GetData(pContext, frame.pDisjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH, STALL_SITE) != S_OK)
+        {
+            break;
+        }
+
+        // Timestamps are unreliable if frequency changed during the frame
+        bool valid = !disjoint.Disjoint;
+        float times[MaxScopes];
+        for (UINT i = 0; i < frame.scopeCount && valid; i++)
+        {
+            UINT64 begin = 0, end = 0;
+            valid = StallDetector::Get().GetData(pContext, frame.pTimestamps[i * 2], &begin, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH, STALL_SITE) == S_OK
+                && StallDetector::Get().GetData(pContext, frame.pTimestamps[i * 2 + 1], &end, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH, STALL_SITE) == S_OK;
+            times[i] = (float)((double)(end - begin) * 1000.0 / (double)disjoint.Frequency);
+        }
+        D3D11_QUERY_DATA_PIPELINE_STATISTICS stats[MaxScopes] = {};
+        for (UINT i = 0; i < frame.scopeCount && valid && frame.pipelineStats; i++)
+        {
+            valid = StallDetector::Get().GetData(pContext, frame.pStats[i], &stats[i], sizeof(stats[i]), D3D11_ASYNC_GETDATA_DONOTFLUSH, STALL_SITE) == S_OK;
+        }
+
+        if (valid)
+        {
+            // Scopes missing in the frame get zero time
+            for (auto& scopeStats : m_stats)
+            {
+                scopeStats.lastMs = 0.0f;
+                scopeStats.history[m_historyPos] = 0.0f;
+                if (frame.pipelineStats)
+                {
+                    scopeStats.lastStats = {};
+                }
+            }
+            m_lastFrameMs = 0.0f;
+            for (UINT i = 0; i < frame.scopeCount; i++)
+            {
+                ScopeStats& scopeStats = GetStats(frame.scopes[i].name, frame.scopes[i].depth);
+                scopeStats.lastMs += times[i];
+                scopeStats.history[m_historyPos] = scopeStats.lastMs;
+                if (frame.pipelineStats)
+                {
+                    D3D11_QUERY_DATA_PIPELINE_STATISTICS& last = scopeStats.lastStats;
+                    last.IAPrimitives += stats[i].IAPrimitives;
+                    last.VSInvocations += stats[i].VSInvocations;
+                    last.CInvocations += stats[i].CInvocations;
+                    last.CPrimitives += stats[i].CPrimitives;
+                    last.PSInvocations += stats[i].PSInvocations;
+                    last.CSInvocations += stats[i].CSInvocations;
+                }
+
+                if (frame.scopes[i].depth == 0)
+                {
+                    m_lastFrameMs += times[i];
+                }
+            }
+            ++m_collectedFrames;
+            m_historyPos = (m_historyPos + 1) % HistorySize;
+            m_historyCount = std::min(m_historyCount + 1, (UINT)HistorySize);
+        }
+
+        ++m_readFrame;
+    }
+}
+
+GpuProfiler::ScopeStats& GpuProfiler::GetStats(const char* name, UINT depth)
+{
+    for (auto& stats : m_stats)
+    {
+        if (stats.name == name)
+        {
+            return stats;
+        }
+    }
+
+    ScopeStats stats = {};
+    stats.name = name;
+    stats.depth = depth;
+    m_stats.push_back(stats);
+
+    return m_stats.back();
+}
+
+FrameVector<GpuProfiler::PassTime> GpuProfiler::GetAverageTimes() const
+{
+    FrameVector<PassTime> times;
+    times.reserve(m_stats.size());
+    for (const auto& stats : m_stats)
+    {
+        float avg = 0.0f;
+        for (UINT i = 0; i < m_historyCount; i++)
+        {
+            avg += stats.history[i];
+        }
+        times.push_back(PassTime{ stats.name, m_historyCount > 0 ? avg / m_historyCount : 0.0f });
+    }
+
+    return times;
+}
+
+void GpuProfiler::ResetHistory()
+{
+    m_stats.clear();
+    m_historyCount = 0;
+    m_historyPos = 0;
+}
+
+void GpuProfiler::ShowWindow()
+{
+    ImGui::Begin("GPU profiler");
+
+    ImGui::Checkbox("Pipeline statistics", &m_pipelineStats);
+
+    if (ImGui::BeginTable("Passes", m_pipelineStats ? 8 : 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Pass");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("avg ms");
+        if (m_pipelineStats)
+        {
+            // Culled are primitives sent to rasterizer which clipper discarded
+            ImGui::TableSetupColumn("VS");
+            ImGui::TableSetupColumn("PS");
+            ImGui::TableSetupColumn("Prims");
+            ImGui::TableSetupColumn("Culled");
+            ImGui::TableSetupColumn("CS");
+        }
+        ImGui::TableHeadersRow();
+
+        FrameVector<PassTime> avgTimes = GetAverageTimes();
+        for (size_t i = 0; i < m_stats.size(); i++)
+        {
+            const ScopeStats& stats = m_stats[i];
+            float avg = avgTimes[i].avgMs;
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (stats.depth > 0)
+            {
+                ImGui::Indent(stats.depth * 10.0f);
+            }
+            ImGui::TextUnformatted(stats.name);
+            if (stats.depth > 0)
+            {
+                ImGui::Unindent(stats.depth * 10.0f);
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.lastMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", avg);
+            if (m_pipelineStats)
+            {
+                const D3D11_QUERY_DATA_PIPELINE_STATISTICS& last = stats.lastStats;
+                UINT64 culled = last.CInvocations > last.CPrimitives ? last.CInvocations - last.CPrimitives : 0;
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", last.VSInvocations);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", last.PSInvocations);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", last.IAPrimitives);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", culled);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", last.CSInvocations);
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    for (const auto& stats : m_stats)
+    {
+        if (stats.depth == 0)
+        {
+            ImGui::PlotLines(stats.name, stats.history, (int)m_historyCount, m_historyCount < HistorySize ? 0 : (int)m_historyPos, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+        }
+    }
+
+    if (ImGui::Button("Save CSV"))
+    {
+        SaveCSV("gpu_profile.csv");
+    }
+
+    ImGui::End();
+}
+
+bool GpuProfiler::SaveCSV(const std::string& path) const
+{
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, path.c_str(), "w") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+    fprintf(pFile, "frame");
+    for (const auto& stats : m_stats)
+    {
+        fprintf(pFile, ",%s", stats.name);
+    }
+    fprintf(pFile, "\n");
+
+    UINT first = m_historyCount < HistorySize ? 0 : m_historyPos;
+    for (UINT i = 0; i < m_historyCount; i++)
+    {
+        fprintf(pFile, "%u", i);
+        for (const auto& stats : m_stats)
+        {
+            fprintf(pFile, ",%.4f", stats.history[(first + i) % HistorySize]);
+        }
+        fprintf(pFile, "\n");
+    }
+
+    fclose(pFile);
+
+    return true;
+}
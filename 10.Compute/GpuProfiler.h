@@ -0,0 +1,153 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "FrameArena.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * GPU pass timings based on timestamp queries, optionally with pipeline statistics of each pass.
+ * Queries of a frame are read several frames later, when they are ready, so profiling never stalls.
+ */
+class GpuProfiler
+{
+public:
+    static const UINT FrameCount = 5;       ///< Frames in flight
+    static const UINT MaxScopes = 32;       ///< Scopes per frame
+    static const UINT HistorySize = 256;    ///< Frames kept for graph and CSV
+
+    struct PassTime
+    {
+        const char* name;
+        float avgMs;
+    };
+
+    GpuProfiler()
+        : m_curFrame(0)
+        , m_readFrame(0)
+        , m_depth(0)
+        , m_frameActive(false)
+        , m_pipelineStats(false)
+        , m_historyCount(0)
+        , m_historyPos(0)
+        , m_lastFrameMs(0.0f)
+        , m_collectedFrames(0)
+    {
+        for (UINT i = 0; i < FrameCount; i++)
+        {
+            m_frames[i].pDisjoint = nullptr;
+            m_frames[i].scopeCount = 0;
+            m_frames[i].pipelineStats = false;
+            for (UINT j = 0; j < MaxScopes * 2; j++)
+            {
+                m_frames[i].pTimestamps[j] = nullptr;
+            }
+            for (UINT j = 0; j < MaxScopes; j++)
+            {
+                m_frames[i].pStats[j] = nullptr;
+            }
+        }
+    }
+
+    HRESULT Init(ID3D11Device* pDevice);
+    void Term();
+
+    void BeginFrame(ID3D11DeviceContext* pContext);
+    void EndFrame(ID3D11DeviceContext* pContext);
+
+    /** Scope name should be a string literal, as it is used as scope identity */
+    UINT BeginScope(ID3D11DeviceContext* pContext, const char* name);
+    void EndScope(ID3D11DeviceContext* pContext, UINT scope);
+
+    /** Show per pass table and graph in ImGui window */
+    void ShowWindow();
+
+    /** Save collected history, one row per frame */
+    bool SaveCSV(const std::string& path) const;
+
+    /** Average pass times over collected history, valid until frame end */
+    FrameVector<PassTime> GetAverageTimes() const;
+
+    /** Drop collected history, frames in flight are still collected */
+    void ResetHistory();
+
+    /** Collect invocation and primitive counts of scopes from the next frame on */
+    inline void SetPipelineStats(bool enabled) { m_pipelineStats = enabled; }
+    inline bool GetPipelineStats() const { return m_pipelineStats; }
+
+    /** Sum of top level scopes of the last collected frame, it is several frames old */
+    inline float GetLastFrameMs() const { return m_lastFrameMs; }
+    /** Changes when a new frame is collected */
+    inline UINT64 GetCollectedFrames() const { return m_collectedFrames; }
+
+    /** Scopes seen since history reset, with their time in the last collected frame */
+    inline UINT GetScopeCount() const { return (UINT)m_stats.size(); }
+    inline const char* GetScopeName(UINT scope) const { return m_stats[scope].name; }
+    inline float GetScopeLastMs(UINT scope) const { return m_stats[scope].lastMs; }
+
+private:
+    struct FrameScope
+    {
+        const char* name;
+        UINT depth;
+    };
+
+    struct Frame
+    {
+        ID3D11Query* pDisjoint;
+        ID3D11Query* pTimestamps[MaxScopes * 2];
+        ID3D11Query* pStats[MaxScopes];
+        FrameScope scopes[MaxScopes];
+        UINT scopeCount;
+        bool pipelineStats;
+    };
+
+    struct ScopeStats
+    {
+        const char* name;
+        UINT depth;
+        float lastMs;
+        float history[HistorySize];
+        D3D11_QUERY_DATA_PIPELINE_STATISTICS lastStats; // Of the last frame with pipeline statistics
+    };
+
+    void CollectFrames(ID3D11DeviceContext* pContext);
+    ScopeStats& GetStats(const char* name, UINT depth);
+
+    Frame m_frames[FrameCount];
+    UINT64 m_curFrame;
+    UINT64 m_readFrame;
+    UINT m_depth;
+    bool m_frameActive;
+    bool m_pipelineStats;
+
+    std::vector<ScopeStats> m_stats;
+    UINT m_historyCount;
+    UINT m_historyPos;
+
+    float m_lastFrameMs;
+    UINT64 m_collectedFrames;
+};
+
+/** Helper to profile a block */
+class GpuProfileScope
+{
+public:
+    GpuProfileScope(GpuProfiler& profiler, ID3D11DeviceContext* pContext, const char* name)
+        : m_profiler(profiler)
+        , m_pContext(pContext)
+        , m_scope(profiler.BeginScope(pContext, name))
+    {}
+
+    ~GpuProfileScope()
+    {
+        m_profiler.EndScope(m_pContext, m_scope);
+    }
+
+private:
+    GpuProfiler& m_profiler;
+    ID3D11DeviceContext* m_pContext;
+    UINT m_scope;
+};
@@ -0,0 +1,124 @@
+#include "framework.h"
+
+#include "GpuReadback.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+
+HRESULT GpuReadback::Init(ID3D11Device* pDevice, UINT size, const std::string& name)
+{
+    HRESULT result = S_OK;
+
+    for (UINT i = 0; i < SlotCount && SUCCEEDED(result); i++)
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = size;
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = pDevice->CreateBuffer(&desc, nullptr, &m_slots[i].pStaging);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_slots[i].pStaging, name + std::to_string(i));
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_QUERY_DESC queryDesc;
+            queryDesc.Query = D3D11_QUERY_EVENT;
+            queryDesc.MiscFlags = 0;
+
+            result = pDevice->CreateQuery(&queryDesc, &m_slots[i].pEvent);
+        }
+    }
+    assert(SUCCEEDED(result));
+    if (SUCCEEDED(result))
+    {
+        m_size = size;
+    }
+
+    return result;
+}
+
+void GpuReadback::Term()
+{
+    for (UINT i = 0; i < SlotCount; i++)
+    {
+        SAFE_RELEASE(m_slots[i].pStaging);
+        SAFE_RELEASE(m_slots[i].pEvent);
+        m_slots[i].pending = false;
+    }
+    m_size = 0;
+}
+
+bool GpuReadback::Copy(ID3D11DeviceContext* pContext, ID3D11Buffer* pSrc, UINT srcOffset, UINT size, UINT dstOffset)
+{
+    Slot& slot = m_slots[m_writeSlot];
+    // All slots are still in flight, skip this frame
+    if (slot.pending || dstOffset + size > m_size)
+    {
+        return false;
+    }
+
+    D3D11_BOX box;
+    box.left = srcOffset;
+    box.right = srcOffset + size;
+    box.top = 0;
+    box.bottom = 1;
+    box.front = 0;
+    box.back = 1;
+    pContext->CopySubresourceRegion(slot.pStaging, 0, dstOffset, 0, 0, pSrc, 0, &box);
+
+    m_recorded = true;
+
+    return true;
+}
+
+void GpuReadback::EndFrame(ID3D11DeviceContext* pContext)
+{
+    if (m_recorded)
+    {
+        Slot& slot = m_slots[m_writeSlot];
+        pContext->End(slot.pEvent);
+        slot.frame = m_frame;
+        slot.pending = true;
+
+        m_writeSlot = (m_writeSlot + 1) % SlotCount;
+        m_recorded = false;
+    }
+    ++m_frame;
+}
+
+bool GpuReadback::Read(ID3D11DeviceContext* pContext, void* pDst, UINT size, UINT64* pFrame)
+{
+    bool read = false;
+    // Drain all completed slots in order, so the latest one wins
+    while (m_slots[m_readSlot].pending)
+    {
+        Slot& slot = m_slots[m_readSlot];
+        if (pContext->GetData(slot.pEvent, nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+        {
+            break;
+        }
+
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        if (FAILED(StallDetector::Get().Map(pContext, slot.pStaging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &subresource, STALL_SITE)))
+        {
+            break;
+        }
+        memcpy(pDst, subresource.pData, std::min(size, m_size));
+        pContext->Unmap(slot.pStaging, 0);
+
+        if (pFrame != nullptr)
+        {
+            *pFrame = slot.frame;
+        }
+        slot.pending = false;
+        m_readSlot = (m_readSlot + 1) % SlotCount;
+        read = true;
+    }
+
+    return read;
+}
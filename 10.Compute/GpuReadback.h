@@ -0,0 +1,60 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+
+/**
+ * Ring of staging buffers for non-blocking readback of small GPU produced values.
+ * Values copied during a frame become available on CPU a few frames later,
+ * completion of each slot is tracked with an event query, so neither GetData nor Map ever waits.
+ */
+class GpuReadback
+{
+public:
+    static const UINT SlotCount = 4;
+
+    GpuReadback()
+        : m_size(0)
+        , m_writeSlot(0)
+        , m_readSlot(0)
+        , m_frame(0)
+        , m_recorded(false)
+    {
+        for (UINT i = 0; i < SlotCount; i++)
+        {
+            m_slots[i].pStaging = nullptr;
+            m_slots[i].pEvent = nullptr;
+            m_slots[i].frame = 0;
+            m_slots[i].pending = false;
+        }
+    }
+
+    HRESULT Init(ID3D11Device* pDevice, UINT size, const std::string& name);
+    void Term();
+
+    /** Copy size bytes of pSrc at srcOffset to dstOffset of current frame data, false if no slot is free */
+    bool Copy(ID3D11DeviceContext* pContext, ID3D11Buffer* pSrc, UINT srcOffset, UINT size, UINT dstOffset);
+
+    /** Close current frame data */
+    void EndFrame(ID3D11DeviceContext* pContext);
+
+    /** Get most recent completed frame data, false if nothing new is available */
+    bool Read(ID3D11DeviceContext* pContext, void* pDst, UINT size, UINT64* pFrame = nullptr);
+
+private:
+    struct Slot
+    {
+        ID3D11Buffer* pStaging;
+        ID3D11Query* pEvent;
+        UINT64 frame;
+        bool pending;
+    };
+
+    Slot m_slots[SlotCount];
+    UINT m_size;
+    UINT m_writeSlot;
+    UINT m_readSlot;
+    UINT64 m_frame;
+    bool m_recorded;
+};
@@ -0,0 +1,45 @@
+#include "CullCommon.h"
+
+// Visible ids are compacted per thread group, so one global atomic runs per destination and group instead of per id.
+// Slots in group are taken with groupshared atomics, then first threads reserve ranges of destinations they have ids for.
+
+static const uint AppendDrawCount = InstanceMeshCount * MaxLods;
+static const uint AppendOccluded = AppendDrawCount; // Occluded list goes after draws
+static const uint AppendNone = 0xffffffff;
+
+groupshared uint groupAppendCounts[AppendDrawCount + 1];
+groupshared uint groupAppendBases[AppendDrawCount + 1];
+
+// Returns slot in destination, which is draw of mesh LOD, occluded list or none. Should be called by all threads of the group, as it syncs them
+uint GroupAppend(in uint groupIndex, in uint dest, RWBuffer<uint> drawArgs, RWStructuredBuffer<uint> occludedCount)
+{
+    if (groupIndex <= AppendDrawCount)
+    {
+        groupAppendCounts[groupIndex] = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint slot = 0;
+    if (dest != AppendNone)
+    {
+        InterlockedAdd(groupAppendCounts[dest], 1, slot);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (groupIndex <= AppendDrawCount && groupAppendCounts[groupIndex] > 0)
+    {
+        uint base = 0;
+        if (groupIndex == AppendOccluded)
+        {
+            InterlockedAdd(occludedCount[0], groupAppendCounts[groupIndex], base);
+        }
+        else
+        {
+            InterlockedAdd(drawArgs[groupIndex * ArgsStride + 1], groupAppendCounts[groupIndex], base); // Corresponds to instanceCount in DrawIndexedIndirect
+        }
+        groupAppendBases[groupIndex] = base;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    return dest != AppendNone ? groupAppendBases[dest] + slot : AppendNone;
+}
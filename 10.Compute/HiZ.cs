@@ -0,0 +1,55 @@
+cbuffer HiZParams : register(b0)
+{
+    uint4 sizes; // xy - source size, zw - destination size
+};
+
+#ifdef MSAA
+Texture2DMS<float> src : register(t0); // Multisampled depth buffer
+
+float LoadDepth(in uint x, in uint y)
+{
+    uint width, height, samples;
+    src.GetDimensions(width, height, samples);
+
+    float depth = 1.0f;
+    for (uint i = 0; i < samples; i++)
+    {
+        depth = min(depth, src.Load(int2(x, y), i));
+    }
+    return depth;
+}
+#else
+Texture2D<float> src : register(t0); // Depth buffer or previous mip
+
+float LoadDepth(in uint x, in uint y)
+{
+    return src.Load(int3(x, y, 0));
+}
+#endif
+
+RWTexture2D<float> dst : register(u0);
+
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (any(globalThreadId.xy >= sizes.zw))
+    {
+        return;
+    }
+
+    // Last texel also covers the extra row/column of odd sized source, so the pyramid stays conservative
+    uint2 srcStart = globalThreadId.xy * 2;
+    uint2 srcEnd = globalThreadId.xy == sizes.zw - 1 ? sizes.xy - 1 : srcStart + 1;
+
+    // Farthest depth, as reversed Z is used
+    float depth = 1.0f;
+    for (uint y = srcStart.y; y <= srcEnd.y; y++)
+    {
+        for (uint x = srcStart.x; x <= srcEnd.x; x++)
+        {
+            depth = min(depth, LoadDepth(x, y));
+        }
+    }
+
+    dst[globalThreadId.xy] = depth;
+}
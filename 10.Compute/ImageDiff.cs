@@ -0,0 +1,33 @@
+Texture2D<float4> referenceTexture : register(t0);
+Texture2D<float4> currentTexture : register(t1);
+
+RWByteAddressBuffer diffResult : register(u0); // Max difference, sum of differences, pixels over threshold
+
+static const uint DiffThreshold = 2; // Should match Renderer::PrecisionDiffThreshold
+
+// Largest channel difference per pixel, in 1/255 steps of 8-bit images
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint2 size;
+    referenceTexture.GetDimensions(size.x, size.y);
+    if (any(globalThreadId.xy >= size))
+    {
+        return;
+    }
+
+    float3 diff = abs(referenceTexture.Load(int3(globalThreadId.xy, 0)).rgb - currentTexture.Load(int3(globalThreadId.xy, 0)).rgb);
+    uint pixelDiff = (uint)(max(diff.r, max(diff.g, diff.b)) * 255.0 + 0.5);
+    if (pixelDiff == 0)
+    {
+        return;
+    }
+
+    uint prev;
+    diffResult.InterlockedMax(0, pixelDiff, prev);
+    diffResult.InterlockedAdd(4, pixelDiff, prev);
+    if (pixelDiff > DiffThreshold)
+    {
+        diffResult.InterlockedAdd(8, 1, prev);
+    }
+}
@@ -0,0 +1,62 @@
+#include "CullCommon.h"
+
+// Octahedral impostors, each instanced mesh is baked at load from ImpostorFrames x ImpostorFrames directions over the whole sphere.
+// Frame nearest to direction to camera is drawn, there is no blending between frames
+static const uint ImpostorFrames = 8; // Should match Renderer::ImpostorFrames
+static const uint ImpostorFrameSize = 64; // Texels, should match Renderer::ImpostorFrameSize
+
+float2 OctEncode(float3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    float2 e = n.xy;
+    if (n.z < 0)
+    {
+        e = (1.0 - abs(n.yx)) * float2(n.x >= 0 ? 1.0 : -1.0, n.y >= 0 ? 1.0 : -1.0);
+    }
+    return e;
+}
+
+float3 OctDecode(float2 e)
+{
+    float3 v = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0)
+    {
+        v.xy = (1.0 - abs(v.yx)) * float2(v.x >= 0 ? 1.0 : -1.0, v.y >= 0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
+// Bounding sphere of mesh bounds, it fits frame cell in orthographic bake projection
+float GetImpostorRadius(in uint mesh)
+{
+    float4 bounds = InstanceMeshBounds[mesh];
+    return length(bounds.xyz) + bounds.w;
+}
+
+uint GetImpostorFrame(in float3 dir)
+{
+    uint2 cell = min((uint2)((OctEncode(dir) * 0.5 + 0.5) * ImpostorFrames), ImpostorFrames - 1);
+    return cell.y * ImpostorFrames + cell.x;
+}
+
+// Model space direction the frame is seen from
+float3 GetImpostorDirection(in uint frame)
+{
+    float2 cell = float2(frame % ImpostorFrames, frame / ImpostorFrames) + 0.5;
+    return OctDecode(cell / ImpostorFrames * 2.0 - 1.0);
+}
+
+// Axes of frame projection, the same as of left handed view looking at the mesh from dir
+void GetImpostorBasis(in float3 dir, out float3 right, out float3 up)
+{
+    float3 forward = -dir;
+    right = normalize(cross(abs(dir.y) > 0.99 ? float3(0.0, 0.0, 1.0) : float3(0.0, 1.0, 0.0), forward));
+    up = cross(forward, right);
+}
+
+// Atlas uv of point of frame projection, xy of corner are in [-1, 1] with y up
+float2 GetImpostorUV(in uint frame, in float2 corner)
+{
+    float2 cell = float2(frame % ImpostorFrames, frame / ImpostorFrames);
+    return (cell + 0.5 + corner * float2(0.5, -0.5)) / ImpostorFrames;
+}
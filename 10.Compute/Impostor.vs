@@ -0,0 +1,56 @@
+#include "SceneCB.h"
+#include "Instances.h"
+#include "Impostor.h"
+
+struct VSInput
+{
+    unsigned int drawInstance : INSTANCE; // Index into visible ids, offset to impostor segment by start instance
+    uint vertexId : SV_VertexID;
+};
+
+// Should match VSOutput of SimpleTexture.vs, so picking shader reads impostors too
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float4 worldPos : POSITION;
+    float3 tang : TANGENT; // Right axis of frame
+    float3 norm : NORMAL; // Direction frame is seen from
+    float2 uv : TEXCOORD; // Atlas uv
+
+    nointerpolation unsigned int instanceId : SV_InstanceID;
+};
+
+static const float2 QuadCorners[6] = {
+    float2(-1, -1), float2(-1, 1), float2(1, -1),
+    float2(1, -1), float2(-1, 1), float2(1, 1)
+};
+
+// Quad per instance, no vertex buffer. Quad lies in projection plane of the frame nearest to camera direction,
+// through instance center, so it rotates with the instance and shows the side of the mesh which faces camera
+VSOutput vs(VSInput vertex)
+{
+    VSOutput result;
+
+    GeomBuffer geom = geomBuffer[ids[vertex.drawInstance]];
+    float3x4 model = GetModel(geom);
+    float3 center = float3(model[0][3], model[1][3], model[2][3]);
+
+    // Model has no scale, so transposed rotation takes camera direction to model space
+    uint frame = GetImpostorFrame(mul(normalize(cameraPos.xyz - center), (float3x3)model));
+    float3 dir = GetImpostorDirection(frame);
+    float3 right;
+    float3 up;
+    GetImpostorBasis(dir, right, up);
+
+    float2 corner = QuadCorners[vertex.vertexId];
+    float3 local = (right * corner.x + up * corner.y) * GetImpostorRadius(GetInstancedMesh(geom));
+
+    result.worldPos = float4(mul(model, float4(local, 1.0)), 1.0);
+    result.pos = mul(vp, result.worldPos);
+    result.tang = mul((float3x3)model, right);
+    result.norm = mul((float3x3)model, dir);
+    result.uv = GetImpostorUV(frame, corner);
+    result.instanceId = vertex.drawInstance;
+
+    return result;
+}
@@ -0,0 +1,57 @@
+#include "Impostor.h"
+
+cbuffer ImpostorBakeParams : register (b0)
+{
+    uint4 bakeParams; // x - instanced mesh
+};
+
+// Should match VSInput of SimpleTexture.vs, so input layout of instanced meshes is used
+struct VSInput
+{
+#ifdef PACKED_VERTEX
+    float3 pos : POSITION;
+    float4 normTang : NORMAL; // Octahedral normal in xy, tangent in zw
+    float2 uv : TEXCOORD;
+#else
+    float3 pos : POSITION;
+    float3 tang : TANGENT;
+    float3 norm : NORMAL;
+    float2 uv : TEXCOORD;
+#endif
+
+    unsigned int drawInstance : INSTANCE; // Frame, draw starts at instance 0
+};
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float3 norm : NORMAL;
+    float2 uv : TEXCOORD;
+};
+
+// Instance per frame, mesh is projected orthographically into its cell of the atlas.
+// Bounding sphere fits the cell, so nothing spills into neighbour frames
+VSOutput vs(VSInput vertex)
+{
+    VSOutput result;
+
+    uint frame = vertex.drawInstance;
+    float3 dir = GetImpostorDirection(frame);
+    float3 right;
+    float3 up;
+    GetImpostorBasis(dir, right, up);
+
+    float3 local = float3(dot(vertex.pos, right), dot(vertex.pos, up), dot(vertex.pos, dir)) / GetImpostorRadius(bakeParams.x);
+    float2 uv = GetImpostorUV(frame, local.xy);
+
+    // Reversed depth, points towards the viewer are nearer
+    result.pos = float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), local.z * 0.5 + 0.5, 1.0);
+#ifdef PACKED_VERTEX
+    result.norm = OctDecode(vertex.normTang.xy);
+#else
+    result.norm = vertex.norm;
+#endif
+    result.uv = vertex.uv;
+
+    return result;
+}
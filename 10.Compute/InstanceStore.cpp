@@ -0,0 +1,184 @@
+#include "framework.h"
+
+#include "InstanceStore.h"
+
+#include <DirectXPackedVector.h>
+
+#include <algorithm>
+#include <math.h>
+
+InstanceStore::InstanceStore(UINT capacity)
+    : m_positions(capacity)
+    , m_angles(capacity, 0.0f)
+    , m_speeds(capacity, 0.0f)
+    , m_shininess(capacity, 0.0f)
+    , m_materials(capacity, 0)
+    , m_meshes(capacity, 0)
+    , m_bounds(capacity)
+    , m_packed(capacity)
+    , m_slotIndices(capacity, InvalidIndex)
+    , m_slotGenerations(capacity, 0)
+    , m_indexSlots(capacity, 0)
+{
+    assert(capacity <= SlotMask);
+
+    ResetHandles(0);
+}
+
+void InstanceStore::Set(UINT idx, const Point3f& pos, float speed, float shininess, UINT material, UINT mesh, const AABB& bb)
+{
+    m_positions[idx] = pos;
+    m_angles[idx] = 0.0f;
+    m_speeds[idx] = speed;
+    m_shininess[idx] = shininess;
+    m_materials[idx] = material;
+    m_meshes[idx] = mesh;
+    m_bounds[idx] = bb;
+}
+
+void InstanceStore::Clear(UINT idx)
+{
+    m_positions[idx] = Point3f{ 0, 0, 0 };
+}
+
+void InstanceStore::Load(UINT first, UINT count, const Point3f* pPositions, const float* pSpeeds, const float* pShininess,
+    const UINT* pMaterials, const UINT* pMeshes, const AABB* pBounds)
+{
+    assert(first + count <= GetCapacity());
+
+    // Fields are stored as arrays, so each one is a single copy
+    memcpy(m_positions.data() + first, pPositions, sizeof(Point3f) * count);
+    memcpy(m_speeds.data() + first, pSpeeds, sizeof(float) * count);
+    memcpy(m_shininess.data() + first, pShininess, sizeof(float) * count);
+    memcpy(m_materials.data() + first, pMaterials, sizeof(UINT) * count);
+    memcpy(m_meshes.data() + first, pMeshes, sizeof(UINT) * count);
+    memcpy(m_bounds.data() + first, pBounds, sizeof(AABB) * count);
+    std::fill(m_angles.begin() + first, m_angles.begin() + first + count, 0.0f);
+}
+
+void InstanceStore::RemapMeshes(UINT first, UINT count, const UINT* pRemap, UINT remapCount)
+{
+    UINT* pMeshes = m_meshes.data();
+    for (UINT i = first; i < first + count; i++)
+    {
+        pMeshes[i] = pMeshes[i] < remapCount ? pRemap[pMeshes[i]] : pRemap[0];
+    }
+}
+
+void InstanceStore::ResetHandles(UINT count)
+{
+    UINT capacity = GetCapacity();
+    m_freeSlots.clear();
+    m_freeSlots.reserve(capacity);
+    for (UINT slot = capacity; slot-- > 0;)
+    {
+        m_slotGenerations[slot] = (m_slotGenerations[slot] + 1) & GenerationMask;
+        if (slot < count)
+        {
+            m_slotIndices[slot] = slot;
+            m_indexSlots[slot] = slot;
+        }
+        else
+        {
+            m_slotIndices[slot] = InvalidIndex;
+            m_freeSlots.push_back(slot);
+        }
+    }
+}
+
+InstanceStore::Handle InstanceStore::AddHandle(UINT idx)
+{
+    assert(!m_freeSlots.empty());
+
+    UINT slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    m_slotIndices[slot] = idx;
+    m_indexSlots[idx] = slot;
+
+    return slot | (m_slotGenerations[slot] << SlotBits);
+}
+
+void InstanceStore::RemoveLast(UINT idx)
+{
+    ReleaseSlot(m_indexSlots[idx]);
+}
+
+UINT InstanceStore::Remove(Handle handle, UINT count)
+{
+    assert(IsValid(handle) && count > 0);
+
+    UINT idx = GetIndex(handle);
+    UINT last = count - 1;
+    ReleaseSlot(handle & SlotMask);
+    if (idx != last)
+    {
+        m_positions[idx] = m_positions[last];
+        m_angles[idx] = m_angles[last];
+        m_speeds[idx] = m_speeds[last];
+        m_shininess[idx] = m_shininess[last];
+        m_materials[idx] = m_materials[last];
+        m_meshes[idx] = m_meshes[last];
+        m_bounds[idx] = m_bounds[last];
+        m_packed[idx] = m_packed[last];
+
+        UINT movedSlot = m_indexSlots[last];
+        m_slotIndices[movedSlot] = idx;
+        m_indexSlots[idx] = movedSlot;
+    }
+    // Vacated instance is generated anew if count grows again
+    Clear(last);
+
+    return idx;
+}
+
+void InstanceStore::ReleaseSlot(UINT slot)
+{
+    // Generation change invalidates handles of the slot
+    m_slotIndices[slot] = InvalidIndex;
+    m_slotGenerations[slot] = (m_slotGenerations[slot] + 1) & GenerationMask;
+    m_freeSlots.push_back(slot);
+}
+
+void InstanceStore::Animate(float deltaSec, UINT begin, UINT end)
+{
+    // Static instances have zero speed, so no branch is needed
+    float* pAngles = m_angles.data();
+    const float* pSpeeds = m_speeds.data();
+    for (UINT i = begin; i < end; i++)
+    {
+        pAngles[i] += deltaSec * pSpeeds[i];
+    }
+}
+
+DirectX::XMMATRIX InstanceStore::GetModel(UINT idx, float timeOffset) const
+{
+    // Angle is reversed, as DirectXMath calculates it as clockwise
+    const Point3f& pos = m_positions[idx];
+    return DirectX::XMMatrixMultiply(
+        DirectX::XMMatrixRotationY(-(m_angles[idx] + m_speeds[idx] * timeOffset)),
+        DirectX::XMMatrixTranslation(pos.x, pos.y, pos.z)
+    );
+}
+
+void InstanceStore::Pack(UINT first, UINT count, float timeOffset)
+{
+    using DirectX::PackedVector::XMConvertFloatToHalf;
+
+    // Same matrix as GetModel and Animate.cs, stored transposed for column vectors
+    for (UINT i = first; i < first + count; i++)
+    {
+        float s, c;
+        DirectX::XMScalarSinCos(&s, &c, m_angles[i] + m_speeds[i] * timeOffset);
+
+        const Point3f& t = m_positions[i];
+        GpuInstance& packed = m_packed[i];
+        packed.model[0] = Point4f{ c, 0, -s, t.x };
+        packed.model[1] = Point4f{ 0, 1, 0, t.y };
+        packed.model[2] = Point4f{ s, 0, c, t.z };
+
+        packed.angle = m_angles[i];
+        packed.speed = m_speeds[i];
+        packed.shininess = XMConvertFloatToHalf(m_shininess[i]);
+        packed.materialMesh = (m_materials[i] & 0xffff) | ((m_meshes[i] & 0xff) << 16);
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "AABB.h"
+
+#include <d3d11.h>
+#include <DirectXMath.h>
+
+#include <vector>
+
+/**
+ * Scene instances as structure of arrays, so simulation and culling loops read only the fields they need.
+ * GPU layout is produced by a separate packing step and does not dictate CPU side layout.
+ * Instances are kept dense, removal moves the last instance into the hole. Handles stay valid across
+ * such moves through a slot map, and a generation in the handle rejects handles of removed instances.
+ */
+class InstanceStore
+{
+public:
+    // Stable reference to an instance, index of the instance changes when others are removed
+    typedef UINT Handle;
+    static const Handle InvalidHandle = 0xffffffff;
+    // GPU instance layout. Should match GeomBuffer.h
+    struct GpuInstance
+    {
+        Point4f model[3]; // Rows of 3x4 model matrix for column vectors
+        float angle;
+        float speed;
+        UINT shininess; // Half float
+        UINT materialMesh; // Bits 0-15 - material id, 16-23 - instanced mesh
+    };
+    static_assert(sizeof(GpuInstance) == 64, "GpuInstance should match GeomBuffer.h");
+
+    InstanceStore(UINT capacity);
+
+    void Set(UINT idx, const Point3f& pos, float speed, float shininess, UINT material, UINT mesh, const AABB& bb);
+    /** Mark instance as never initialized */
+    void Clear(UINT idx);
+    /** Copy count instances from field arrays starting at first, rotation starts from zero angle */
+    void Load(UINT first, UINT count, const Point3f* pPositions, const float* pSpeeds, const float* pShininess,
+        const UINT* pMaterials, const UINT* pMeshes, const AABB* pBounds);
+    /** Replace mesh ids of instances in [first, first + count) with remap[id] */
+    void RemapMeshes(UINT first, UINT count, const UINT* pRemap, UINT remapCount);
+
+    /** Give instances [0, count) new handles, all handles given before become invalid */
+    void ResetHandles(UINT count);
+    /** Handle for instance appended at idx, which is the previous instance count */
+    Handle AddHandle(UINT idx);
+    /** Release handle of the last instance at idx, when instances are popped from the end */
+    void RemoveLast(UINT idx);
+    /** Remove instance by moving the last of count instances into its place. Returns index of the removed instance,
+     *  which holds the moved one now unless the removed one was the last */
+    UINT Remove(Handle handle, UINT count);
+
+    inline bool IsValid(Handle handle) const
+    {
+        UINT slot = handle & SlotMask;
+        return slot < m_slotIndices.size() && m_slotIndices[slot] != InvalidIndex && m_slotGenerations[slot] == handle >> SlotBits;
+    }
+    inline UINT GetIndex(Handle handle) const { return m_slotIndices[handle & SlotMask]; }
+    inline Handle GetHandle(UINT idx) const { UINT slot = m_indexSlots[idx]; return slot | (m_slotGenerations[slot] << SlotBits); }
+
+    /** Advance rotation angles of instances in [begin, end) */
+    void Animate(float deltaSec, UINT begin, UINT end);
+
+    /** Model matrix, rotation around Y followed by translation. Angle is advanced by timeOffset seconds of rotation */
+    DirectX::XMMATRIX GetModel(UINT idx, float timeOffset) const;
+
+    /** Convert instances to GPU layout, matrices are built as in GetModel */
+    void Pack(UINT first, UINT count, float timeOffset);
+
+    inline UINT GetCapacity() const { return (UINT)m_positions.size(); }
+
+    inline const Point3f& GetPosition(UINT idx) const { return m_positions[idx]; }
+    inline bool IsRotating(UINT idx) const { return fabsf(m_speeds[idx]) > 0.0001f; }
+    inline UINT GetMesh(UINT idx) const { return m_meshes[idx]; }
+
+    // Field arrays, e.g. for saving the scene
+    inline const Point3f* GetPositions() const { return m_positions.data(); }
+    inline const float* GetSpeeds() const { return m_speeds.data(); }
+    inline const float* GetShininess() const { return m_shininess.data(); }
+    inline const UINT* GetMaterials() const { return m_materials.data(); }
+    inline const UINT* GetMeshes() const { return m_meshes.data(); }
+
+    inline const AABB& GetBounds(UINT idx) const { return m_bounds[idx]; }
+    inline const AABB* GetBounds() const { return m_bounds.data(); }
+
+    inline const GpuInstance* GetPacked() const { return m_packed.data(); }
+
+private:
+    static const UINT SlotBits = 20;
+    static const UINT SlotMask = (1 << SlotBits) - 1;
+    static const UINT GenerationMask = 0xfff; // Rest of handle bits
+    static const UINT InvalidIndex = 0xffffffff;
+
+    void ReleaseSlot(UINT slot);
+
+private:
+    std::vector<Point3f> m_positions;
+    std::vector<float> m_angles;
+    std::vector<float> m_speeds;
+    std::vector<float> m_shininess;
+    std::vector<UINT> m_materials;
+    std::vector<UINT> m_meshes;
+    std::vector<AABB> m_bounds;
+
+    std::vector<GpuInstance> m_packed;
+
+    // Slot map, slot of handle gives index of instance and instance gives back its slot
+    std::vector<UINT> m_slotIndices;
+    std::vector<UINT> m_slotGenerations;
+    std::vector<UINT> m_indexSlots;
+    std::vector<UINT> m_freeSlots; // Stack, last released slot is reused first
+};
@@ -0,0 +1,10 @@
+#include "CullCommon.h"
+
+static const uint DrawCount = InstanceMeshCount * MaxLods; // Should match Renderer::InstanceDrawCount
+
+// Visible instance prepared for vertex shader, 112 bytes. Should match Renderer::InstanceTransform
+struct InstanceTransform
+{
+    float4x4 mvp; // Model to clip space, with view projection of the frame
+    float4 model[3]; // Rows of 3x4 model matrix, its rotation part is normal basis
+};
@@ -0,0 +1,46 @@
+#include "SceneCB.h"
+#include "GeomBuffer.h"
+#include "InstanceTransform.h"
+
+StructuredBuffer<GeomBuffer> geomBuffer : register(t0);
+StructuredBuffer<uint> objectIds : register(t1); // Visible ids, segment per mesh LOD
+
+RWBuffer<uint> indirectArgs : register(u0); // Visible count of mesh is instanceCount of its DrawIndexedIndirect
+RWStructuredBuffer<InstanceTransform> transforms : register(u1);
+RWStructuredBuffer<uint> drawBases : register(u2); // First transform of each draw
+
+// Visible instances of all draws together fit one segment, so transforms are packed in draw order
+// and thread finds its draw by running sum of instance counts
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint draw = DrawCount;
+    uint drawBase = 0;
+    uint base = 0;
+    for (uint i = 0; i < DrawCount; i++)
+    {
+        if (globalThreadId.x == 0)
+        {
+            drawBases[i] = base;
+        }
+
+        uint count = indirectArgs[i * ArgsStride + 1];
+        if (draw == DrawCount && globalThreadId.x < base + count)
+        {
+            draw = i;
+            drawBase = base;
+        }
+        base += count;
+    }
+    if (draw == DrawCount)
+    {
+        return;
+    }
+
+    GeomBuffer geom = geomBuffer[objectIds[draw * MeshSegmentSize + globalThreadId.x - drawBase]];
+
+    InstanceTransform transform;
+    transform.mvp = mul(vp, float4x4(geom.model[0], geom.model[1], geom.model[2], float4(0.0, 0.0, 0.0, 1.0)));
+    transform.model = geom.model;
+    transforms[globalThreadId.x] = transform;
+}
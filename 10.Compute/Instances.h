@@ -0,0 +1,4 @@
+#include "GeomBuffer.h"
+
+StructuredBuffer<GeomBuffer> geomBuffer : register (t2);
+StructuredBuffer<uint> ids : register (t3);
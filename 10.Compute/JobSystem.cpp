@@ -0,0 +1,241 @@
+#include "framework.h"
+
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+#include "FrameArena.h"
+
+#include <algorithm>
+
+namespace
+{
+
+// Queue of current thread, not set for threads other than workers
+thread_local UINT t_queueIdx = ~0u;
+
+}
+
+void JobSystem::Init(UINT threadCount)
+{
+    if (threadCount == 0)
+    {
+        UINT hwCount = std::thread::hardware_concurrency();
+        threadCount = hwCount > 1 ? hwCount - 1 : 0;
+    }
+
+    m_stop = false;
+    m_queuedTasks = 0;
+    for (UINT i = 0; i < threadCount + 1; i++)
+    {
+        m_queues.emplace_back(new Queue());
+    }
+    for (UINT i = 0; i < threadCount; i++)
+    {
+        m_workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+}
+
+void JobSystem::Term()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wakeCV.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+    m_queues.clear();
+}
+
+JobSystem::TaskHandle JobSystem::Submit(const TaskFunc& func, std::initializer_list<TaskHandle> deps)
+{
+    TaskHandle task = std::make_shared<Task>();
+    task->func = func;
+    task->pending = 1;
+    task->finished = false;
+
+    for (const TaskHandle& dep : deps)
+    {
+        if (dep == nullptr)
+        {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(dep->mutex);
+        if (!dep->finished)
+        {
+            ++task->pending;
+            dep->dependents.push_back(task);
+        }
+    }
+
+    // Dependencies may finish while they are added, so task is queued by whoever drops the last one
+    if (--task->pending == 0)
+    {
+        Push(task);
+    }
+
+    return task;
+}
+
+void JobSystem::Wait(const TaskHandle& task)
+{
+    while (task != nullptr && !task->finished)
+    {
+        TaskHandle next = Pop();
+        if (next != nullptr)
+        {
+            Run(next);
+            continue;
+        }
+
+        // Task is run by another thread or waits for its dependencies
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeCV.wait(lock, [&]() { return task->finished || m_queuedTasks > 0; });
+    }
+}
+
+void JobSystem::ParallelFor(UINT count, UINT chunkSize, const RangeFunc& func)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    UINT chunkCount = DivUp(count, chunkSize);
+    if (m_workers.empty() || chunkCount == 1)
+    {
+        func(0, count);
+        return;
+    }
+
+    // func is owned by the caller, it is alive until all chunks are waited for
+    FrameVector<TaskHandle> chunks;
+    chunks.reserve(chunkCount - 1);
+    for (UINT chunk = 1; chunk < chunkCount; chunk++)
+    {
+        UINT begin = chunk * chunkSize;
+        UINT end = std::min(begin + chunkSize, count);
+        chunks.push_back(Submit([&func, begin, end]() { func(begin, end); }));
+    }
+
+    {
+        CPU_PROFILE_ZONE("Job chunk");
+        func(0, std::min(chunkSize, count));
+    }
+
+    for (const TaskHandle& chunk : chunks)
+    {
+        Wait(chunk);
+    }
+}
+
+void JobSystem::ParallelForAdaptive(UINT count, UINT minChunkSize, const RangeFunc& func)
+{
+    UINT threadCount = GetWorkerCount() + 1;
+    UINT chunkSize = std::max(DivUp(count, threadCount * ChunksPerThread), std::max(minChunkSize, 1u));
+
+    ParallelFor(count, chunkSize, func);
+}
+
+void JobSystem::WorkerLoop(UINT queueIdx)
+{
+    t_queueIdx = queueIdx;
+
+    while (!m_stop)
+    {
+        TaskHandle task = Pop();
+        if (task != nullptr)
+        {
+            Run(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeCV.wait(lock, [this]() { return m_stop || m_queuedTasks > 0; });
+    }
+}
+
+void JobSystem::Push(const TaskHandle& task)
+{
+    // Counted first, so the count never drops below zero when the task is taken right away
+    ++m_queuedTasks;
+    {
+        Queue& queue = *m_queues[GetQueueIndex()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+
+    // Sleeping thread checks the count under this mutex, so the wake up is not lost
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeCV.notify_one();
+}
+
+JobSystem::TaskHandle JobSystem::Pop()
+{
+    UINT queueCount = (UINT)m_queues.size();
+    UINT own = GetQueueIndex();
+
+    // Newest own task is likely to have its data in cache, stolen ones are the oldest
+    for (UINT i = 0; i < queueCount; i++)
+    {
+        Queue& queue = *m_queues[(own + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            TaskHandle task;
+            if (i == 0)
+            {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            }
+            --m_queuedTasks;
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void JobSystem::Run(const TaskHandle& task)
+{
+    {
+        CPU_PROFILE_ZONE("Job chunk");
+        task->func();
+    }
+
+    std::vector<TaskHandle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->finished = true;
+        dependents.swap(task->dependents);
+    }
+    for (const TaskHandle& dependent : dependents)
+    {
+        if (--dependent->pending == 0)
+        {
+            Push(dependent);
+        }
+    }
+
+    // Wake threads waiting for this task
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeCV.notify_all();
+}
+
+UINT JobSystem::GetQueueIndex() const
+{
+    return t_queueIdx < m_workers.size() ? t_queueIdx : (UINT)m_workers.size();
+}
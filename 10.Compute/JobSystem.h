@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work stealing task scheduler with a worker per hardware thread.
+ * Each thread pushes and pops tasks at the back of its own queue, idle threads steal from the front of others.
+ * Task is queued when all its dependencies are finished, waiting threads run queued tasks meanwhile.
+ */
+class JobSystem
+{
+public:
+    using TaskFunc = std::function<void()>;
+    using RangeFunc = std::function<void(UINT begin, UINT end)>;
+
+    static const UINT ChunksPerThread = 4; // Adaptive chunks per thread, so uneven chunks can be stolen
+
+    struct Task
+    {
+        TaskFunc func;
+        std::atomic<UINT> pending; // Unfinished dependencies, and one more until submitted
+        std::atomic<bool> finished;
+
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Task>> dependents; // Guarded by mutex
+    };
+    using TaskHandle = std::shared_ptr<Task>;
+
+    JobSystem()
+        : m_stop(false)
+        , m_queuedTasks(0)
+    {}
+
+    /** Start workers, threadCount == 0 means one per hardware thread except the calling one */
+    void Init(UINT threadCount = 0);
+    void Term();
+
+    inline UINT GetWorkerCount() const { return (UINT)m_workers.size(); }
+
+    /** Queue func to run after deps are finished, null deps are skipped */
+    TaskHandle Submit(const TaskFunc& func, std::initializer_list<TaskHandle> deps = {});
+
+    /** Block until task is finished, calling thread runs queued tasks meanwhile. Null task is finished. */
+    void Wait(const TaskHandle& task);
+
+    /** Call func for [0, count) split by chunkSize, calling thread participates. Blocks until done. */
+    void ParallelFor(UINT count, UINT chunkSize, const RangeFunc& func);
+
+    /** ParallelFor with chunk size picked for worker count, not less than minChunkSize */
+    void ParallelForAdaptive(UINT count, UINT minChunkSize, const RangeFunc& func);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<TaskHandle> tasks;
+    };
+
+    void WorkerLoop(UINT queueIdx);
+
+    void Push(const TaskHandle& task);
+    /** Own queue back first, then front of other queues */
+    TaskHandle Pop();
+    void Run(const TaskHandle& task);
+
+    UINT GetQueueIndex() const;
+
+private:
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<Queue>> m_queues; // Per worker, the last one is shared by other threads
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeCV;
+    std::atomic<bool> m_stop;
+    std::atomic<UINT> m_queuedTasks;
+};
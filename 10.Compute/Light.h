@@ -1,40 +1,110 @@
-#include "SceneCB.h"
+#include "LightCluster.h"
+#include "Shadow.h"
 
-float3 CalculateColor(in float3 objColor, in float3 objNormal, in float3 pos, in float shine, in bool trans)
+StructuredBuffer<Light> lights : register(t5);
+StructuredBuffer<uint> clusterLights : register(t6);
+
+// Diffuse light of the sky in L2 spherical harmonics, projected from the cubemap by SkyAmbient.cs.
+// Cosine convolution is baked in, flat ambient color is in the first one when sky ambient is off
+cbuffer AmbientBuffer : register (b6)
+{
+    float4 ambientSH[9];
+};
+
+// HALF_PRECISION variant shades colors and directions in min16float, positions and distances stay 32-bit as they need the range
+#ifdef HALF_PRECISION
+typedef min16float shade;
+typedef min16float2 shade2;
+typedef min16float3 shade3;
+#else
+typedef float shade;
+typedef float2 shade2;
+typedef float3 shade3;
+#endif // !HALF_PRECISION
+
+// Inverse square falloff, smoothly faded to zero at light radius
+shade Attenuation(in float lightDist, in float radius)
 {
-    float3 finalColor = float3(0, 0, 0);
+    float ratio = lightDist / radius;
+    float window = saturate(1.0 - ratio * ratio * ratio * ratio);
+
+    return (shade)(clamp(1.0 / (lightDist * lightDist), 0, 1) * window * window);
+}
 
-    if (lightCount.z > 0)
+// Attenuation is applied to diffuse part only
+shade3 ShadeDirection(in shade3 lightDir, in shade3 lightColor, in shade atten, in shade3 objColor, in shade3 objNormal, in float3 pos, in shade shine, in bool trans)
+{
+    shade3 normal = objNormal;
+
+    if (trans && dot(lightDir, objNormal) < 0.0)
     {
-        return float3(objNormal * 0.5 + float3(0.5, 0.5, 0.5));
+        normal = -normal;
     }
 
-    for (int i = 0; i < lightCount.x; i++)
-    {
-        float3 normal = objNormal;
+    // Diffuse part
+    shade3 color = objColor * max(dot(lightDir, normal), 0) * atten * lightColor;
+
+    shade3 viewDir = (shade3)normalize(cameraPos.xyz - pos);
+    shade3 reflectDir = reflect(-lightDir, normal);
+
+    shade spec = shine > 0 ? pow(max(dot(viewDir, reflectDir), 0.0), shine) : 0.0;
 
-        float3 lightDir = lights[i].pos.xyz - pos;
-        float lightDist = length(lightDir);
-        lightDir /= lightDist;
+    // Specular part
+    color += objColor * 0.5 * spec * lightColor;
 
-        float atten = clamp(1.0 / (lightDist * lightDist), 0, 1);
+    return color;
+}
 
-        if (trans && dot(lightDir, objNormal) < 0.0)
-        {
-            normal = -normal;
-        }
+shade3 ShadeLight(in Light light, in shade3 objColor, in shade3 objNormal, in float3 pos, in shade shine, in bool trans)
+{
+    float3 lightDir = light.pos.xyz - pos;
+    float lightDist = length(lightDir);
+    lightDir /= lightDist;
+
+    return ShadeDirection((shade3)lightDir, (shade3)light.color.xyz, Attenuation(lightDist, light.pos.w), objColor, objNormal, pos, shine, trans);
+}
 
-        // Diffuse part
-        finalColor += objColor * max(dot(lightDir, normal), 0) * atten * lights[i].color.xyz;
+// Basis order matches SkyAmbient.cs
+shade3 SkyAmbient(in shade3 normal)
+{
+    float3 n = (float3)normal;
+    float3 color = ambientSH[0].xyz
+        + ambientSH[1].xyz * n.y + ambientSH[2].xyz * n.z + ambientSH[3].xyz * n.x
+        + ambientSH[4].xyz * (n.x * n.y) + ambientSH[5].xyz * (n.y * n.z) + ambientSH[6].xyz * (3.0 * n.z * n.z - 1.0)
+        + ambientSH[7].xyz * (n.x * n.z) + ambientSH[8].xyz * (n.x * n.x - n.y * n.y);
 
-        float3 viewDir = normalize(cameraPos.xyz - pos);
-        float3 reflectDir = reflect(-lightDir, normal);
+    return (shade3)max(color, 0);
+}
 
-        float spec = shine > 0 ? pow(max(dot(viewDir, reflectDir), 0.0), shine) : 0.0;
+// Directional light, dimmed by shadow cascades
+shade3 ShadeSun(in shade3 objColor, in shade3 objNormal, in float3 pos, in shade shine, in bool trans)
+{
+    if (sunColor.w == 0)
+    {
+        return shade3(0, 0, 0);
+    }
 
-        // Specular part
-        finalColor += objColor * 0.5 * spec * lights[i].color.xyz;
+    return ShadeDirection((shade3)sunDir.xyz, (shade3)(sunColor.xyz * SunShadow(pos)), 1.0, objColor, objNormal, pos, shine, trans);
+}
+
+// SHOW_NORMALS variant outputs normal instead of color
+float3 CalculateColor(in float3 objColor, in float3 objNormal, in float3 pos, in float shine, in bool trans)
+{
+#ifdef SHOW_NORMALS
+    return float3(objNormal * 0.5 + float3(0.5, 0.5, 0.5));
+#else
+    shade3 color = (shade3)objColor;
+    shade3 normal = (shade3)objNormal;
+    shade3 finalColor = color * SkyAmbient(normal) + ShadeSun(color, normal, pos, (shade)shine, trans);
+
+    // Only lights binned to the pixel's cluster are iterated
+    uint clusterBase = GetClusterIndex(pos) * ClusterStride;
+    uint clusterLightCount = clusterLights[clusterBase];
+    for (uint j = 0; j < clusterLightCount; j++)
+    {
+        finalColor += ShadeLight(lights[clusterLights[clusterBase + 1 + j]], color, normal, pos, (shade)shine, trans);
     }
 
-    return finalColor;
-}
\ No newline at end of file
+    return (float3)finalColor;
+#endif // !SHOW_NORMALS
+}
@@ -0,0 +1,70 @@
+#include "SceneCB.h"
+
+StructuredBuffer<Light> lights : register(t5); // Visible lights
+
+#ifdef IMPOSTOR
+static const float BulbRadius = 0.125; // Should match LightBulbRadius in Renderer.cpp
+
+static const float2 QuadCorners[6] = {
+    float2(-1, -1), float2(-1, 1), float2(1, -1),
+    float2(1, -1), float2(-1, 1), float2(1, 1)
+};
+#endif // IMPOSTOR
+
+struct VSInput
+{
+#ifndef IMPOSTOR
+    float3 pos : POSITION;
+#else
+    uint vertexId : SV_VertexID;
+#endif // IMPOSTOR
+    uint instanceId : SV_InstanceID;
+};
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float4 color : COLOR;
+#ifdef IMPOSTOR
+    float3 worldPos : POSITION;
+    nointerpolation float3 center : CENTER;
+#endif // IMPOSTOR
+};
+
+#ifdef IMPOSTOR
+// Camera facing quad through bulb center, no vertex buffer. Its half size is where cone of rays touching
+// the sphere crosses quad plane, so the quad covers sphere silhouette
+VSOutput vs(VSInput vertex)
+{
+    VSOutput result;
+
+    Light light = lights[vertex.instanceId];
+
+    float3 toCamera = cameraPos.xyz - light.pos.xyz;
+    float dist = max(length(toCamera), BulbRadius * 1.01);
+    float3 forward = -toCamera / dist;
+    float3 right = normalize(cross(abs(forward.y) > 0.99 ? float3(0.0, 0.0, 1.0) : float3(0.0, 1.0, 0.0), forward));
+    float3 up = cross(forward, right);
+    float size = BulbRadius * dist / sqrt(dist * dist - BulbRadius * BulbRadius);
+
+    float2 corner = QuadCorners[vertex.vertexId];
+    result.worldPos = light.pos.xyz + (right * corner.x + up * corner.y) * size;
+    result.pos = mul(vp, float4(result.worldPos, 1.0));
+    result.color = light.color;
+    result.center = light.pos.xyz;
+
+    return result;
+}
+#else
+VSOutput vs(VSInput vertex)
+{
+    VSOutput result;
+
+    Light light = lights[vertex.instanceId];
+
+    result.pos = mul(vp, float4(vertex.pos + light.pos.xyz, 1.0));
+    result.color = light.color;
+
+    return result;
+}
+#endif // !IMPOSTOR
@@ -0,0 +1,19 @@
+#include "SceneCB.h"
+
+// Should match cluster grid constants in Renderer.h
+static const uint ClusterGridX = 16;
+static const uint ClusterGridY = 9;
+static const uint ClusterGridZ = 24;
+static const uint MaxLightsPerCluster = 127;
+static const uint ClusterStride = MaxLightsPerCluster + 1; // Light count, then light indices
+
+// Slices are exponential in view depth, so clusters stay close to cubes
+uint GetClusterIndex(in float3 worldPos)
+{
+    float4 clip = mul(vp, float4(worldPos, 1.0));
+    float2 uv = saturate(clip.xy / clip.w * float2(0.5, -0.5) + 0.5);
+    uint2 xy = min(uint2(uv * float2(ClusterGridX, ClusterGridY)), uint2(ClusterGridX - 1, ClusterGridY - 1));
+    uint z = (uint)clamp(log(clip.w) * clusterParams.x + clusterParams.y, 0.0, (float)(ClusterGridZ - 1));
+
+    return xy.x + (xy.y + z * ClusterGridY) * ClusterGridX;
+}
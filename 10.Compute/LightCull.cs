@@ -0,0 +1,170 @@
+#include "LightCluster.h"
+
+cbuffer LightCullParams : register(b1)
+{
+    float4x4 v;
+    float4 projParams; // x - inverse horizontal scale, y - inverse vertical scale of projection
+    float4 bulbParams; // x - bulb radius, y - 1 if bulbs and sky are tested against Hi-Z of this frame
+};
+
+StructuredBuffer<Light> lights : register(t0);
+
+static const uint GroupSize = 64;
+
+#ifdef VISIBLE_LIST
+RWStructuredBuffer<Light> visibleLights : register(u0);
+RWStructuredBuffer<uint> visibleLightCount : register(u1);
+
+// Thread per light, lights which radius does not reach view frustum are dropped
+[numthreads(GroupSize, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint lightIdx = globalThreadId.x;
+    if (lightIdx >= (uint)lightCount.x)
+    {
+        return;
+    }
+
+    Light light = lights[lightIdx];
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(frustum[i], float4(light.pos.xyz, 1.0)) < -light.pos.w)
+        {
+            return;
+        }
+    }
+
+    uint slot;
+    InterlockedAdd(visibleLightCount[0], 1, slot);
+    visibleLights[slot] = light;
+}
+#elif defined(BULB_LIST)
+#include "Occlusion.h"
+
+RWStructuredBuffer<Light> visibleBulbs : register(u0);
+RWStructuredBuffer<uint> visibleBulbCount : register(u1);
+RWBuffer<uint> skyArgs : register(u2); // Instance counts at 1 - screen triangle, 5 - sphere arguments
+
+// Thread per light, bulbs outside of view frustum or behind Hi-Z are dropped.
+// First thread also decides if any sky pixel is left, dispatch has at least one group for it
+[numthreads(GroupSize, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    bool hiZTest = bulbParams.y != 0;
+    if (globalThreadId.x == 0)
+    {
+        // Cleared depth is 0 with reversed Z, so farthest depth of the whole Hi-Z is above it if the scene covers the view
+        uint skyInstances = 1;
+        if (hiZTest)
+        {
+            uint width, height, mipCount;
+            hiZ.GetDimensions(hiZSize.z - 1, width, height, mipCount);
+            float farthest = 1.0;
+            for (uint y = 0; y < height; y++)
+            {
+                for (uint x = 0; x < width; x++)
+                {
+                    farthest = min(farthest, hiZ.Load(int3(x, y, hiZSize.z - 1)));
+                }
+            }
+            skyInstances = farthest > 0.0 ? 0 : 1;
+        }
+        skyArgs[1] = skyInstances;
+        skyArgs[5] = skyInstances;
+    }
+
+    uint lightIdx = globalThreadId.x;
+    if (lightIdx >= (uint)lightCount.x)
+    {
+        return;
+    }
+
+    Light light = lights[lightIdx];
+    float radius = bulbParams.x;
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(frustum[i], float4(light.pos.xyz, 1.0)) < -radius)
+        {
+            return;
+        }
+    }
+    if (hiZTest && IsOccluded(light.pos.xyz - radius, light.pos.xyz + radius))
+    {
+        return;
+    }
+
+    uint slot;
+    InterlockedAdd(visibleBulbCount[0], 1, slot);
+    visibleBulbs[slot] = light;
+}
+#else
+StructuredBuffer<uint> visibleLightCount : register(t1); // Lights are the visible ones
+RWStructuredBuffer<uint> clusterLights : register(u0);
+
+groupshared float4 sharedLights[GroupSize]; // xyz - view space position, w - radius
+
+float3 ViewPos(in float2 uv, in float z)
+{
+    float2 ndc = uv * float2(2.0, -2.0) + float2(-1.0, 1.0);
+    return float3(ndc * projParams.xy * z, z);
+}
+
+[numthreads(GroupSize, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID, uint3 localThreadId : SV_GroupThreadID)
+{
+    uint clusterIdx = globalThreadId.x;
+    bool valid = clusterIdx < ClusterGridX * ClusterGridY * ClusterGridZ;
+
+    // View space bounds of the cluster
+    uint3 cluster = uint3(clusterIdx % ClusterGridX, (clusterIdx / ClusterGridX) % ClusterGridY, clusterIdx / (ClusterGridX * ClusterGridY));
+    float zNear = exp(((float)cluster.z - clusterParams.y) / clusterParams.x);
+    float zFar = exp(((float)cluster.z + 1.0 - clusterParams.y) / clusterParams.x);
+    float2 uvMin = float2(cluster.xy) / float2(ClusterGridX, ClusterGridY);
+    float2 uvMax = float2(cluster.xy + 1) / float2(ClusterGridX, ClusterGridY);
+
+    float3 bbMin = float3(1e30, 1e30, zNear);
+    float3 bbMax = float3(-1e30, -1e30, zFar);
+    for (int i = 0; i < 4; i++)
+    {
+        float2 uv = float2((i & 1) == 0 ? uvMin.x : uvMax.x, (i & 2) == 0 ? uvMin.y : uvMax.y);
+        float3 p0 = ViewPos(uv, zNear);
+        float3 p1 = ViewPos(uv, zFar);
+        bbMin.xy = min(bbMin.xy, min(p0.xy, p1.xy));
+        bbMax.xy = max(bbMax.xy, max(p0.xy, p1.xy));
+    }
+
+    uint base = clusterIdx * ClusterStride;
+    uint count = 0;
+
+    // Lights are loaded to group shared memory in batches, which all threads of the group test
+    uint lightTotal = visibleLightCount[0];
+    for (uint first = 0; first < lightTotal; first += GroupSize)
+    {
+        uint lightIdx = first + localThreadId.x;
+        if (lightIdx < lightTotal)
+        {
+            Light light = lights[lightIdx];
+            sharedLights[localThreadId.x] = float4(mul(v, float4(light.pos.xyz, 1.0)).xyz, light.pos.w);
+        }
+        GroupMemoryBarrierWithGroupSync();
+
+        uint batchCount = min(GroupSize, lightTotal - first);
+        for (uint j = 0; valid && j < batchCount; j++)
+        {
+            float4 light = sharedLights[j];
+            float3 d = max(max(bbMin - light.xyz, 0.0), light.xyz - bbMax);
+            if (dot(d, d) <= light.w * light.w && count < MaxLightsPerCluster)
+            {
+                clusterLights[base + 1 + count] = first + j;
+                ++count;
+            }
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (valid)
+    {
+        clusterLights[base] = count;
+    }
+}
+#endif // !VISIBLE_LIST && !BULB_LIST
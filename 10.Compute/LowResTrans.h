@@ -0,0 +1,14 @@
+// Reduced resolution transparents, block of scale x scale scene pixels is one pixel of transparent target
+cbuffer LowResTransBuffer : register(b0)
+{
+    uint4 lowResParams; // x - scale, yz - render size in scene pixels
+};
+
+// Scene depth, single sampled
+Texture2D<float> sceneDepth : register(t0);
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float2 uv : TEXCOORD;
+};
@@ -0,0 +1,48 @@
+#include "framework.h"
+
+#include "MappedFile.h"
+
+bool MappedFile::Open(const std::wstring& path)
+{
+    Close();
+
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    // View keeps both mapping and file alive, so handles are closed right away
+    HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (hMapping != nullptr)
+    {
+        m_pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(hMapping);
+    }
+    CloseHandle(hFile);
+
+    if (m_pView == nullptr)
+    {
+        return false;
+    }
+    m_size = (UINT64)size.QuadPart;
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_pView != nullptr)
+    {
+        UnmapViewOfFile(m_pView);
+        m_pView = nullptr;
+    }
+    m_size = 0;
+}
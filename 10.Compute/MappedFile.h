@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Read only memory mapped file, data is paged in on access, so large files are not read up front.
+ */
+class MappedFile
+{
+public:
+    MappedFile()
+        : m_pView(nullptr)
+        , m_size(0)
+    {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::wstring& path);
+    void Close();
+
+    inline const char* GetData() const { return reinterpret_cast<const char*>(m_pView); }
+    inline UINT64 GetSize() const { return m_size; }
+
+    /** True if count elements of elementSize at offset are inside file, element size should not be zero */
+    inline bool Contains(UINT64 offset, UINT64 count, UINT64 elementSize) const
+    {
+        return offset <= m_size && count <= (m_size - offset) / elementSize;
+    }
+
+private:
+    void* m_pView;
+    UINT64 m_size;
+};
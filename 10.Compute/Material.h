@@ -0,0 +1,97 @@
+struct Material
+{
+    float4 tint; // Albedo multiplier
+    uint albedoSlice; // Slice of albedo texture array
+    uint normalSlice; // Slice of normal map array, NoTexture if not used
+    uint filter; // Sampler of materialSamplers
+    uint pad;
+};
+
+static const uint NoTexture = 0xFFFFFFFF;
+static const uint MaterialFilterCount = 3; // Should match MaterialTable::FilterCount
+
+StructuredBuffer<Material> materials : register (t4);
+
+// Best filtering first, samplers are set by global filtering quality
+SamplerState materialSamplers[MaterialFilterCount] : register(s2);
+
+// Gradients are taken by caller out of flow control, as pixels of a quad may be of different materials
+float4 SampleMaterial(in Texture2DArray tex, in float3 uvw, in float2 uvDx, in float2 uvDy, in uint filter)
+{
+    [branch] switch (filter)
+    {
+    case 0:
+        return tex.SampleGrad(materialSamplers[0], uvw, uvDx, uvDy);
+    case 1:
+        return tex.SampleGrad(materialSamplers[1], uvw, uvDx, uvDy);
+    default:
+        return tex.SampleGrad(materialSamplers[2], uvw, uvDx, uvDy);
+    }
+}
+
+#ifdef VIRTUAL_TEXTURES
+static const uint VirtualMaxMips = 16; // Should match VirtualTextures::MaxMips
+
+// Tiled texture array of material texture set, should match VirtualTextures::SetInfo
+struct VirtualTextureInfo
+{
+    uint2 size; // Mip 0 size in texels
+    uint2 tileShape; // Standard tile size in texels
+    uint standardMips; // Mips of standard tiles, coarser ones are packed and always resident
+    uint sliceBits; // Feedback bits per array slice
+    uint feedbackBase; // First feedback bit of the set
+    uint pad;
+    uint4 mipBits[VirtualMaxMips / 4]; // First feedback bit of each mip inside a slice
+};
+
+cbuffer VirtualTextureBuffer : register (b5)
+{
+    VirtualTextureInfo virtualInfo[2]; // By MaterialTable::TextureSet
+    uint4 feedbackParams; // x - pixel of 4x4 block which writes feedback this frame
+};
+
+Texture2DArray<uint> residency[2] : register (t8); // Finest resident mip per mip 0 tile, by set
+RWByteAddressBuffer feedback : register (u5); // Bit per tile, above render targets, should match Renderer FeedbackUAVSlot
+
+bool IsFeedbackPixel(in float2 pos)
+{
+    uint2 pixel = (uint2)pos % 4;
+    return pixel.y * 4 + pixel.x == feedbackParams.x;
+}
+
+// Sampling is clamped to resident mips, wanted tile is marked in feedback by selected pixels.
+// Set should be a literal, as residency maps are indexed by it
+float4 SampleVirtual(in Texture2DArray tex, in uint set, in float3 uvw, in float2 uvDx, in float2 uvDy, in uint filter, in bool writeFeedback)
+{
+    VirtualTextureInfo info = virtualInfo[set];
+    uint2 texel = min((uint2)(frac(uvw.xy) * info.size), info.size - 1);
+    float minLod = (float)residency[set].Load(int4(texel / info.tileShape, uvw.z, 0));
+
+    if (writeFeedback)
+    {
+        // Anisotropic filtering takes mip of minor axis of footprint, major one is at most 16x longer
+        float2 dx = uvDx * info.size;
+        float2 dy = uvDy * info.size;
+        float major = max(dot(dx, dx), dot(dy, dy));
+        float minor = min(dot(dx, dx), dot(dy, dy));
+        uint mip = (uint)clamp(0.5 * log2(max(minor, major / 256.0)), 0.0, VirtualMaxMips - 1);
+        if (mip < info.standardMips)
+        {
+            uint2 mipTiles = (max(info.size >> mip, 1) + info.tileShape - 1) / info.tileShape;
+            uint2 tile = min((texel >> mip) / info.tileShape, mipTiles - 1);
+            uint bit = info.feedbackBase + (uint)uvw.z * info.sliceBits + info.mipBits[mip / 4][mip % 4] + tile.y * mipTiles.x + tile.x;
+            feedback.InterlockedOr((bit / 32) * 4, 1u << (bit % 32));
+        }
+    }
+
+    [branch] switch (filter)
+    {
+    case 0:
+        return tex.SampleGrad(materialSamplers[0], uvw, uvDx, uvDy, int2(0, 0), minLod);
+    case 1:
+        return tex.SampleGrad(materialSamplers[1], uvw, uvDx, uvDy, int2(0, 0), minLod);
+    default:
+        return tex.SampleGrad(materialSamplers[2], uvw, uvDx, uvDy, int2(0, 0), minLod);
+    }
+}
+#endif // VIRTUAL_TEXTURES
@@ -0,0 +1,139 @@
+#include "framework.h"
+
+#include "MaterialTable.h"
+#include "TextureStreamer.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+
+UINT MaterialTable::AddTexture(TextureSet set, const std::wstring& file)
+{
+    std::vector<std::wstring>& files = m_files[set];
+
+    auto it = std::find(files.begin(), files.end(), file);
+    if (it != files.end())
+    {
+        return (UINT)(it - files.begin());
+    }
+
+    files.push_back(file);
+    return (UINT)files.size() - 1;
+}
+
+UINT MaterialTable::AddMaterial(const Material& material)
+{
+    assert(m_materials.size() < MaxMaterials);
+    m_materials.push_back(material);
+    return (UINT)m_materials.size() - 1;
+}
+
+UINT MaterialTable::FindTexture(TextureSet set, const std::wstring& file) const
+{
+    const std::vector<std::wstring>& files = m_files[set];
+
+    auto it = std::find(files.begin(), files.end(), file);
+    return it != files.end() ? (UINT)(it - files.begin()) : NoTexture;
+}
+
+void MaterialTable::SetMaterials(ID3D11DeviceContext* pContext, const Material* pMaterials, UINT count)
+{
+    assert(count > 0 && count <= MaxMaterials);
+
+    m_materials.assign(pMaterials, pMaterials + count);
+
+    D3D11_BOX box = { 0, 0, 0, (UINT)(sizeof(Material) * count), 1, 1 };
+    StallDetector::Get().UpdateSubresource(pContext, m_pMaterialBuffer, 0, &box, m_materials.data(), 0, 0, STALL_SITE);
+}
+
+bool MaterialTable::IsSigned(TextureSet set) const
+{
+    D3D11_TEXTURE2D_DESC desc;
+    m_pTextures[set]->GetDesc(&desc);
+
+    return desc.Format == DXGI_FORMAT_BC5_SNORM || desc.Format == DXGI_FORMAT_BC4_SNORM
+        || desc.Format == DXGI_FORMAT_R8G8_SNORM || desc.Format == DXGI_FORMAT_R8G8B8A8_SNORM;
+}
+
+HRESULT MaterialTable::Init(ID3D11Device* pDevice, TextureStreamer& streamer, UINT skipMips)
+{
+    static const char* SetNames[TextureSetCount] = { "AlbedoTextures", "NormalTextures" };
+    static const UINT32 PlaceholderColors[TextureSetCount] = { 0xFF808080, 0xFFFF8080 }; // Grey, flat normal
+
+    // Texture arrays are streamed in background, placeholders are bound until then
+    HRESULT result = S_OK;
+    for (UINT i = 0; i < TextureSetCount && SUCCEEDED(result); i++)
+    {
+        UINT arraySize = std::max(1u, (UINT)m_files[i].size());
+        result = TextureStreamer::CreatePlaceholder(pDevice, arraySize, false, PlaceholderColors[i], SetNames[i], &m_pTextures[i], &m_pTextureViews[i], true);
+        if (SUCCEEDED(result) && !m_files[i].empty())
+        {
+            TextureStreamer::Request request;
+            request.files = m_files[i];
+            request.skipMips = skipMips;
+            request.arrayView = true;
+            request.name = SetNames[i];
+            request.ppTexture = &m_pTextures[i];
+            request.ppView = &m_pTextureViews[i];
+            streamer.Load(request);
+        }
+    }
+
+    if (SUCCEEDED(result))
+    {
+        assert(!m_materials.empty());
+
+        // Sized for all materials, as they can be replaced by loaded scene
+        std::vector<Material> materials(MaxMaterials, m_materials.front());
+        std::copy(m_materials.begin(), m_materials.end(), materials.begin());
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = (UINT)(sizeof(Material) * MaxMaterials);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(Material);
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = materials.data();
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = pDevice->CreateBuffer(&desc, &data, &m_pMaterialBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMaterialBuffer, "MaterialBuffer");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxMaterials;
+
+            result = pDevice->CreateShaderResourceView(m_pMaterialBuffer, &srvDesc, &m_pMaterialBufferSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMaterialBufferSRV, "MaterialBufferSRV");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void MaterialTable::Term()
+{
+    for (UINT i = 0; i < TextureSetCount; i++)
+    {
+        SAFE_RELEASE(m_pTextures[i]);
+        SAFE_RELEASE(m_pTextureViews[i]);
+        m_files[i].clear();
+    }
+    SAFE_RELEASE(m_pMaterialBuffer);
+    SAFE_RELEASE(m_pMaterialBufferSRV);
+    m_materials.clear();
+}
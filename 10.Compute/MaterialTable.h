@@ -0,0 +1,93 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "../Math/Point.h"
+
+#include <string>
+#include <vector>
+
+class TextureStreamer;
+
+/**
+ * Materials of instanced geometry.
+ * Textures of each set share one texture array, so all materials are drawn without rebinding,
+ * materials themselves are stored in a structured buffer indexed by per instance material id.
+ * Normal maps may be two channel BC5, shaders reconstruct z for any format.
+ */
+class MaterialTable
+{
+public:
+    static const UINT MaxMaterials = 256;
+    static const UINT NoTexture = 0xFFFFFFFF; // Should match Material.h
+
+    // Texture arrays, all textures of a set should have the same format and size
+    enum TextureSet
+    {
+        TextureSetAlbedo = 0,
+        TextureSetNormal,
+
+        TextureSetCount
+    };
+
+    // Texture filtering of material, best first, actual samplers of each are set by global filtering quality
+    enum Filter
+    {
+        FilterBest = 0, // Highest anisotropy of quality
+        FilterMedium,
+        FilterTrilinear,
+
+        FilterCount // Should match Material.h
+    };
+
+    // Should match Material.h
+    struct Material
+    {
+        Point4f tint;
+        UINT albedoSlice;
+        UINT normalSlice;
+        UINT filter;
+        UINT pad;
+    };
+
+    MaterialTable()
+        : m_pMaterialBuffer(nullptr)
+        , m_pMaterialBufferSRV(nullptr)
+    {
+        for (UINT i = 0; i < TextureSetCount; i++)
+        {
+            m_pTextures[i] = nullptr;
+            m_pTextureViews[i] = nullptr;
+        }
+    }
+
+    /** Get array slice of texture file, file is added to the set if it is new */
+    UINT AddTexture(TextureSet set, const std::wstring& file);
+    /** Returns material id */
+    UINT AddMaterial(const Material& material);
+    /** Array slice of texture file, NoTexture if file was not added before Init */
+    UINT FindTexture(TextureSet set, const std::wstring& file) const;
+    /** Replace all materials after Init, textures should be the ones added before it */
+    void SetMaterials(ID3D11DeviceContext* pContext, const Material* pMaterials, UINT count);
+
+    /** Create placeholders and material buffer and start streaming of all added textures */
+    HRESULT Init(ID3D11Device* pDevice, TextureStreamer& streamer, UINT skipMips = 0);
+    void Term();
+
+    inline UINT GetMaterialCount() const { return (UINT)m_materials.size(); }
+    inline const std::vector<Material>& GetMaterials() const { return m_materials; }
+    inline const std::vector<std::wstring>& GetTextureFiles(TextureSet set) const { return m_files[set]; }
+    inline ID3D11ShaderResourceView* GetTextureView(TextureSet set) const { return m_pTextureViews[set]; }
+    inline ID3D11ShaderResourceView* GetMaterialsSRV() const { return m_pMaterialBufferSRV; }
+    /** Texture set is of signed normalized format, placeholder until streaming completes */
+    bool IsSigned(TextureSet set) const;
+
+private:
+    std::vector<std::wstring> m_files[TextureSetCount];
+    std::vector<Material> m_materials;
+
+    ID3D11Texture2D* m_pTextures[TextureSetCount];
+    ID3D11ShaderResourceView* m_pTextureViews[TextureSetCount];
+    ID3D11Buffer* m_pMaterialBuffer;
+    ID3D11ShaderResourceView* m_pMaterialBufferSRV;
+};
@@ -0,0 +1,403 @@
+#include "framework.h"
+
+#include "MemoryRegistry.h"
+
+#include <dxgi1_4.h>
+
+#include <algorithm>
+#include <stdio.h>
+
+#include "imgui.h"
+
+// Private data key of tracker attached to recorded resources
+static const GUID TrackerGuid = { 0x5c2e8a41, 0x7d13, 0x4b9f, { 0xa6, 0x0e, 0x3f, 0x94, 0xc1, 0x27, 0xd8, 0x5b } };
+
+static const UINT ShownEntryCount = 32; // Largest resources listed in window
+
+static double ToMB(UINT64 bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+static bool IsBlockCompressed(DXGI_FORMAT format)
+{
+    return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM)
+        || (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+static UINT GetBitsPerPixel(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+        case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+        case DXGI_FORMAT_R32G32B32A32_UINT:
+        case DXGI_FORMAT_R32G32B32A32_SINT:
+            return 128;
+
+        case DXGI_FORMAT_R32G32B32_TYPELESS:
+        case DXGI_FORMAT_R32G32B32_FLOAT:
+        case DXGI_FORMAT_R32G32B32_UINT:
+        case DXGI_FORMAT_R32G32B32_SINT:
+            return 96;
+
+        case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+        case DXGI_FORMAT_R16G16B16A16_UINT:
+        case DXGI_FORMAT_R16G16B16A16_SNORM:
+        case DXGI_FORMAT_R16G16B16A16_SINT:
+        case DXGI_FORMAT_R32G32_TYPELESS:
+        case DXGI_FORMAT_R32G32_FLOAT:
+        case DXGI_FORMAT_R32G32_UINT:
+        case DXGI_FORMAT_R32G32_SINT:
+        case DXGI_FORMAT_R32G8X24_TYPELESS:
+        case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+            return 64;
+
+        case DXGI_FORMAT_R16_TYPELESS:
+        case DXGI_FORMAT_R16_FLOAT:
+        case DXGI_FORMAT_D16_UNORM:
+        case DXGI_FORMAT_R16_UNORM:
+        case DXGI_FORMAT_R16_UINT:
+        case DXGI_FORMAT_R16_SNORM:
+        case DXGI_FORMAT_R16_SINT:
+        case DXGI_FORMAT_R8G8_TYPELESS:
+        case DXGI_FORMAT_R8G8_UNORM:
+        case DXGI_FORMAT_R8G8_UINT:
+        case DXGI_FORMAT_R8G8_SNORM:
+        case DXGI_FORMAT_R8G8_SINT:
+            return 16;
+
+        case DXGI_FORMAT_R8_TYPELESS:
+        case DXGI_FORMAT_R8_UNORM:
+        case DXGI_FORMAT_R8_UINT:
+        case DXGI_FORMAT_R8_SNORM:
+        case DXGI_FORMAT_R8_SINT:
+        case DXGI_FORMAT_A8_UNORM:
+            return 8;
+    }
+
+    // Remaining formats in use, like R8G8B8A8, R10G10B10A2, R11G11B10, R16G16 and R32, are 32 bit
+    return 32;
+}
+
+static UINT64 GetSurfaceBytes(DXGI_FORMAT format, UINT width, UINT height)
+{
+    if (IsBlockCompressed(format))
+    {
+        return (UINT64)DivUp(width, 4u) * DivUp(height, 4u) * GetBytesPerBlock(format);
+    }
+    return (UINT64)width * height * GetBitsPerPixel(format) / 8;
+}
+
+static UINT64 GetMipChainBytes(DXGI_FORMAT format, UINT width, UINT height, UINT depth, UINT mipLevels)
+{
+    // Zero mip levels means full chain
+    if (mipLevels == 0)
+    {
+        UINT size = std::max(std::max(width, height), depth);
+        while (size > 0)
+        {
+            ++mipLevels;
+            size >>= 1;
+        }
+    }
+
+    UINT64 bytes = 0;
+    for (UINT mip = 0; mip < mipLevels; mip++)
+    {
+        bytes += GetSurfaceBytes(format, std::max(width >> mip, 1u), std::max(height >> mip, 1u)) * std::max(depth >> mip, 1u);
+    }
+    return bytes;
+}
+
+/** Removes its resource from registry when resource releases its private data on destruction */
+class MemoryRegistry::Tracker : public IUnknown
+{
+public:
+    Tracker(ID3D11Resource* pResource)
+        : m_refCount(1)
+        , m_pResource(pResource)
+    {}
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppObject) override
+    {
+        if (riid == __uuidof(IUnknown))
+        {
+            *ppObject = this;
+            AddRef();
+            return S_OK;
+        }
+        *ppObject = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return (ULONG)InterlockedIncrement(&m_refCount);
+    }
+
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG refCount = (ULONG)InterlockedDecrement(&m_refCount);
+        if (refCount == 0)
+        {
+            MemoryRegistry::Get().Untrack(m_pResource);
+            delete this;
+        }
+        return refCount;
+    }
+
+private:
+    volatile LONG m_refCount;
+    ID3D11Resource* m_pResource; // Not referenced, as resource owns the tracker
+};
+
+MemoryRegistry& MemoryRegistry::Get()
+{
+    static MemoryRegistry registry;
+    return registry;
+}
+
+MemoryRegistry::MemoryRegistry()
+    : m_pAdapter(nullptr)
+{
+}
+
+void MemoryRegistry::Track(ID3D11DeviceChild* pChild, const std::string& name)
+{
+    // Views, shaders and states take no memory worth tracking
+    ID3D11Resource* pResource = nullptr;
+    if (FAILED(pChild->QueryInterface(__uuidof(ID3D11Resource), (void**)&pResource)))
+    {
+        return;
+    }
+
+    Entry entry;
+    entry.name = name;
+    entry.bytes = GetResourceBytes(pResource, entry.category);
+
+    // Renamed resource already has its tracker
+    bool tracked = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        tracked = m_resources.find(pResource) != m_resources.end();
+        m_resources[pResource] = entry;
+    }
+    if (!tracked)
+    {
+        Tracker* pTracker = new Tracker(pResource);
+        pResource->SetPrivateDataInterface(TrackerGuid, pTracker);
+        pTracker->Release();
+    }
+
+    pResource->Release();
+}
+
+void MemoryRegistry::Untrack(ID3D11Resource* pResource)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_resources.erase(pResource);
+}
+
+void MemoryRegistry::SetExternal(const std::string& name, UINT64 bytes, Category category)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (bytes == 0)
+    {
+        m_external.erase(name);
+    }
+    else
+    {
+        m_external[name] = Entry{ name, bytes, category };
+    }
+}
+
+void MemoryRegistry::SetAdapter(IDXGIAdapter* pAdapter)
+{
+    if (m_pAdapter != nullptr)
+    {
+        m_pAdapter->Release();
+        m_pAdapter = nullptr;
+    }
+
+    // Budget needs DXGI 1.4
+    if (pAdapter != nullptr && FAILED(pAdapter->QueryInterface(__uuidof(IDXGIAdapter3), (void**)&m_pAdapter)))
+    {
+        m_pAdapter = nullptr;
+    }
+}
+
+bool MemoryRegistry::QueryBudget(UINT64& budget, UINT64& usage) const
+{
+    DXGI_QUERY_VIDEO_MEMORY_INFO info;
+    if (m_pAdapter == nullptr || FAILED(m_pAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)))
+    {
+        budget = usage = 0;
+        return false;
+    }
+
+    budget = info.Budget;
+    usage = info.CurrentUsage;
+    return true;
+}
+
+UINT64 MemoryRegistry::GetTotal(Category category) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    UINT64 total = 0;
+    for (const auto& item : m_resources)
+    {
+        total += item.second.category == category ? item.second.bytes : 0;
+    }
+    for (const auto& item : m_external)
+    {
+        total += item.second.category == category ? item.second.bytes : 0;
+    }
+    return total;
+}
+
+std::vector<MemoryRegistry::Entry> MemoryRegistry::GetEntries() const
+{
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        entries.reserve(m_resources.size() + m_external.size());
+        for (const auto& item : m_resources)
+        {
+            entries.push_back(item.second);
+        }
+        for (const auto& item : m_external)
+        {
+            entries.push_back(item.second);
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.bytes > b.bytes; });
+
+    return entries;
+}
+
+void MemoryRegistry::ShowWindow()
+{
+    ImGui::Begin("Video memory");
+
+    UINT64 budget = 0;
+    UINT64 usage = 0;
+    if (QueryBudget(budget, usage))
+    {
+        ImGui::Text("Budget %.1f MB, used %.1f MB (%.0f%%)", ToMB(budget), ToMB(usage), budget > 0 ? usage * 100.0 / budget : 0.0);
+    }
+    else
+    {
+        ImGui::Text("Budget is not reported by adapter");
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Save CSV"))
+    {
+        SaveCsv("video_memory.csv");
+    }
+
+    UINT64 total = 0;
+    for (UINT i = 0; i < CategoryCount; i++)
+    {
+        UINT64 bytes = GetTotal((Category)i);
+        ImGui::Text("%s %.2f MB", GetCategoryName((Category)i), ToMB(bytes));
+        total += bytes;
+    }
+    ImGui::Text("Tracked %.2f MB", ToMB(total));
+
+    ImGui::Separator();
+    std::vector<Entry> entries = GetEntries();
+    for (UINT i = 0; i < std::min((UINT)entries.size(), ShownEntryCount); i++)
+    {
+        ImGui::Text("%8.2f MB %s", ToMB(entries[i].bytes), entries[i].name.c_str());
+    }
+
+    ImGui::End();
+}
+
+bool MemoryRegistry::SaveCsv(const std::string& path) const
+{
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, path.c_str(), "w") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+    fprintf(pFile, "name,category,bytes\n");
+    for (const Entry& entry : GetEntries())
+    {
+        fprintf(pFile, "%s,%s,%llu\n", entry.name.c_str(), GetCategoryName(entry.category), (unsigned long long)entry.bytes);
+    }
+
+    UINT64 budget = 0;
+    UINT64 usage = 0;
+    if (QueryBudget(budget, usage))
+    {
+        fprintf(pFile, "Budget,,%llu\nUsage,,%llu\n", (unsigned long long)budget, (unsigned long long)usage);
+    }
+
+    fclose(pFile);
+    return true;
+}
+
+const char* MemoryRegistry::GetCategoryName(Category category)
+{
+    static const char* Names[CategoryCount] = { "Buffers", "Textures", "Render targets", "Swap chain" };
+    return Names[category];
+}
+
+UINT64 MemoryRegistry::GetResourceBytes(ID3D11Resource* pResource, Category& category)
+{
+    const UINT TargetFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_UNORDERED_ACCESS;
+
+    D3D11_RESOURCE_DIMENSION dimension;
+    pResource->GetType(&dimension);
+    switch (dimension)
+    {
+        case D3D11_RESOURCE_DIMENSION_BUFFER:
+        {
+            D3D11_BUFFER_DESC desc;
+            ((ID3D11Buffer*)pResource)->GetDesc(&desc);
+            // Tile pool holds memory of tiled textures
+            category = (desc.MiscFlags & D3D11_RESOURCE_MISC_TILE_POOL) != 0 ? CategoryTexture : CategoryBuffer;
+            return desc.ByteWidth;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+        {
+            D3D11_TEXTURE1D_DESC desc;
+            ((ID3D11Texture1D*)pResource)->GetDesc(&desc);
+            category = (desc.BindFlags & TargetFlags) != 0 ? CategoryRenderTarget : CategoryTexture;
+            return GetMipChainBytes(desc.Format, desc.Width, 1, 1, desc.MipLevels) * desc.ArraySize;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+        {
+            D3D11_TEXTURE2D_DESC desc;
+            ((ID3D11Texture2D*)pResource)->GetDesc(&desc);
+            category = (desc.BindFlags & TargetFlags) != 0 ? CategoryRenderTarget : CategoryTexture;
+            if ((desc.MiscFlags & D3D11_RESOURCE_MISC_TILED) != 0)
+            {
+                return 0;
+            }
+            return GetMipChainBytes(desc.Format, desc.Width, desc.Height, 1, desc.MipLevels) * desc.ArraySize * desc.SampleDesc.Count;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+        {
+            D3D11_TEXTURE3D_DESC desc;
+            ((ID3D11Texture3D*)pResource)->GetDesc(&desc);
+            category = (desc.BindFlags & TargetFlags) != 0 ? CategoryRenderTarget : CategoryTexture;
+            return GetMipChainBytes(desc.Format, desc.Width, desc.Height, desc.Depth, desc.MipLevels);
+        }
+    }
+
+    category = CategoryBuffer;
+    return 0;
+}
+
+void TrackResourceMemory(ID3D11DeviceChild* pResource, const std::string& name)
+{
+    MemoryRegistry::Get().Track(pResource, name);
+}
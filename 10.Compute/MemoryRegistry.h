@@ -0,0 +1,73 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct IDXGIAdapter3;
+
+/**
+ * Video memory taken by resources created through the renderer.
+ * Buffers and textures are recorded when they are named with SetResourceName,
+ * a tracker is attached to each one as private data, so it is dropped when resource is destroyed.
+ */
+class MemoryRegistry
+{
+public:
+    enum Category
+    {
+        CategoryBuffer = 0,
+        CategoryTexture,
+        CategoryRenderTarget, ///< Textures rendered or written to
+        CategorySwapChain,
+        CategoryCount
+    };
+
+    struct Entry
+    {
+        std::string name;
+        UINT64 bytes;
+        Category category;
+    };
+
+    static MemoryRegistry& Get();
+
+    /** Record buffer or texture, other device children are skipped */
+    void Track(ID3D11DeviceChild* pChild, const std::string& name);
+    /** Record memory which is not created by renderer, like swap chain buffers, zero size removes it */
+    void SetExternal(const std::string& name, UINT64 bytes, Category category);
+
+    /** Adapter to query budget from, nullptr releases it */
+    void SetAdapter(IDXGIAdapter* pAdapter);
+    /** Local video memory budget given to the process by OS and its current usage, false if adapter can't report them */
+    bool QueryBudget(UINT64& budget, UINT64& usage) const;
+
+    UINT64 GetTotal(Category category) const;
+    /** Entries sorted from the largest one */
+    std::vector<Entry> GetEntries() const;
+
+    /** Show budget, totals per category and the largest resources in ImGui window */
+    void ShowWindow();
+
+    /** Save entries in CSV format */
+    bool SaveCsv(const std::string& path) const;
+
+    static const char* GetCategoryName(Category category);
+
+private:
+    class Tracker;
+
+    MemoryRegistry();
+
+    void Untrack(ID3D11Resource* pResource);
+
+    static UINT64 GetResourceBytes(ID3D11Resource* pResource, Category& category);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<ID3D11Resource*, Entry> m_resources; // Resources are not referenced, trackers remove them
+    std::unordered_map<std::string, Entry> m_external;
+    IDXGIAdapter3* m_pAdapter;
+};
@@ -0,0 +1,163 @@
+#include "framework.h"
+
+#include "MeshCache.h"
+
+bool MeshCache::Open(const std::wstring& sourcePath, bool* pCooked)
+{
+    Close();
+
+    if (pCooked != nullptr)
+    {
+        *pCooked = false;
+    }
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(sourcePath.c_str(), GetFileExInfoStandard, &data))
+    {
+        return false;
+    }
+    UINT64 sourceSize = ((UINT64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    UINT64 sourceWriteTime = ((UINT64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+
+    std::wstring entryPath = GetEntryPath(sourcePath);
+    if (OpenEntry(entryPath, sourceSize, sourceWriteTime))
+    {
+        return true;
+    }
+
+    // Text is only parsed when there is no valid entry
+    MeshImporter::Mesh mesh;
+    if (!MeshImporter::ImportObj(sourcePath, mesh) || !Store(entryPath, mesh, sourceSize, sourceWriteTime))
+    {
+        return false;
+    }
+    if (pCooked != nullptr)
+    {
+        *pCooked = true;
+    }
+
+    return OpenEntry(entryPath, sourceSize, sourceWriteTime);
+}
+
+void MeshCache::Close()
+{
+    m_pHeader = nullptr;
+    m_file.Close();
+}
+
+std::wstring MeshCache::GetEntryPath(const std::wstring& sourcePath) const
+{
+    size_t slash = sourcePath.find_last_of(L"/\\");
+    std::wstring fileName = slash != std::wstring::npos ? sourcePath.substr(slash + 1) : sourcePath;
+    return m_directory + L"/" + fileName + L".mesh";
+}
+
+bool MeshCache::OpenEntry(const std::wstring& entryPath, UINT64 sourceSize, UINT64 sourceWriteTime)
+{
+    if (!m_file.Open(entryPath) || !m_file.Contains(0, 1, sizeof(Header)))
+    {
+        m_file.Close();
+        return false;
+    }
+
+    const Header* pHeader = reinterpret_cast<const Header*>(m_file.GetData());
+    bool valid = pHeader->magic == Magic && pHeader->version == Version && pHeader->vertexSize == sizeof(TextureTangentVertex)
+        && pHeader->sourceSize == sourceSize && pHeader->sourceWriteTime == sourceWriteTime
+        && pHeader->lodCount > 0 && pHeader->lodCount <= MeshImporter::MaxLods;
+    for (UINT i = 0; valid && i < pHeader->lodCount; i++)
+    {
+        const LodRange& lod = pHeader->lods[i];
+        valid = lod.vertexOffset % BlockAlignment == 0 && lod.indexOffset % BlockAlignment == 0
+            && m_file.Contains(lod.vertexOffset, lod.vertexCount, sizeof(TextureTangentVertex))
+            && m_file.Contains(lod.indexOffset, lod.indexCount, sizeof(UINT32));
+    }
+    valid = valid && pHeader->meshletOffset % BlockAlignment == 0
+        && m_file.Contains(pHeader->meshletOffset, pHeader->meshletCount, sizeof(MeshOptimizer::Meshlet));
+    if (!valid)
+    {
+        m_file.Close();
+        return false;
+    }
+
+    m_pHeader = pHeader;
+
+    return true;
+}
+
+bool MeshCache::Store(const std::wstring& entryPath, const MeshImporter::Mesh& mesh, UINT64 sourceSize, UINT64 sourceWriteTime)
+{
+    Header header = {};
+    header.magic = Magic;
+    header.version = Version;
+    header.vertexSize = sizeof(TextureTangentVertex);
+    header.lodCount = mesh.lodCount;
+    header.sourceSize = sourceSize;
+    header.sourceWriteTime = sourceWriteTime;
+    header.sourceBounds = mesh.sourceBounds;
+
+    // Blobs are aligned, so they can be read in place from mapped file
+    UINT64 offset = DivUp((UINT64)sizeof(Header), (UINT64)BlockAlignment) * BlockAlignment;
+    for (UINT i = 0; i < mesh.lodCount; i++)
+    {
+        const MeshImporter::Lod& lod = mesh.lods[i];
+        LodRange& range = header.lods[i];
+        range.vertexCount = (UINT32)lod.vertices.size();
+        range.indexCount = (UINT32)lod.indices.size();
+        range.vertexOffset = offset;
+        offset += DivUp((UINT64)sizeof(TextureTangentVertex) * range.vertexCount, (UINT64)BlockAlignment) * BlockAlignment;
+        range.indexOffset = offset;
+        offset += DivUp((UINT64)sizeof(UINT32) * range.indexCount, (UINT64)BlockAlignment) * BlockAlignment;
+    }
+    header.meshletOffset = offset;
+    header.meshletCount = (UINT32)mesh.meshlets.size();
+
+    CreateDirectoryW(m_directory.c_str(), nullptr);
+
+    // Written to temporary file first, so interrupted write never leaves broken entry
+    std::wstring tempPath = entryPath + L".tmp";
+
+    FILE* pFile = nullptr;
+    _wfopen_s(&pFile, tempPath.c_str(), L"wb");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+
+    static const char Padding[BlockAlignment] = {};
+
+    bool written = fwrite(&header, sizeof(header), 1, pFile) == 1;
+    UINT64 position = sizeof(header);
+    for (UINT i = 0; i < mesh.lodCount && written; i++)
+    {
+        const MeshImporter::Lod& lod = mesh.lods[i];
+        const LodRange& range = header.lods[i];
+
+        const void* blobs[2] = { lod.vertices.data(), lod.indices.data() };
+        UINT64 offsets[2] = { range.vertexOffset, range.indexOffset };
+        size_t sizes[2] = { sizeof(TextureTangentVertex) * lod.vertices.size(), sizeof(UINT32) * lod.indices.size() };
+        for (UINT j = 0; j < 2 && written; j++)
+        {
+            size_t padding = (size_t)(offsets[j] - position);
+            written = fwrite(Padding, 1, padding, pFile) == padding;
+            written = written && fwrite(blobs[j], 1, sizes[j], pFile) == sizes[j];
+            position = offsets[j] + sizes[j];
+        }
+    }
+    if (written)
+    {
+        size_t padding = (size_t)(header.meshletOffset - position);
+        size_t size = sizeof(MeshOptimizer::Meshlet) * mesh.meshlets.size();
+        written = fwrite(Padding, 1, padding, pFile) == padding;
+        written = written && fwrite(mesh.meshlets.data(), 1, size, pFile) == size;
+    }
+
+    fclose(pFile);
+
+    if (!written || !MoveFileExW(tempPath.c_str(), entryPath.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "MeshImporter.h"
+
+#include <string>
+
+/**
+ * Cooked meshes, one file per source asset in cache directory. Holds vertex and index blobs of all LODs, meshlets of LOD 0
+ * and source bounds, which are used in place from memory mapped file, so the geometry pool copies them directly.
+ * Entry is valid while size and write time of the source match the ones it was cooked from.
+ */
+class MeshCache
+{
+public:
+    static const UINT32 Magic = 0x3148534D; // "MSH1"
+    static const UINT32 Version = 2; // 32-bit indices and meshlets
+    static const UINT BlockAlignment = 16;
+
+    struct LodRange
+    {
+        UINT64 vertexOffset;
+        UINT64 indexOffset;
+        UINT32 vertexCount;
+        UINT32 indexCount;
+    };
+
+    struct Header
+    {
+        UINT32 magic;
+        UINT32 version;
+        UINT32 vertexSize; // sizeof(TextureTangentVertex)
+        UINT32 lodCount;
+        UINT64 sourceSize;
+        UINT64 sourceWriteTime;
+        AABB sourceBounds;
+        LodRange lods[MeshImporter::MaxLods];
+        UINT64 meshletOffset;
+        UINT32 meshletCount;
+        UINT32 pad;
+    };
+
+    MeshCache()
+        : m_directory(L"MeshCache")
+        , m_pHeader(nullptr)
+    {}
+
+    void SetDirectory(const std::wstring& directory) { m_directory = directory; }
+
+    /** Open cooked entry of the source, source is imported and cooked first if entry is missing or out of date */
+    bool Open(const std::wstring& sourcePath, bool* pCooked = nullptr);
+    void Close();
+
+    inline UINT GetLodCount() const { return m_pHeader->lodCount; }
+    inline const AABB& GetSourceBounds() const { return m_pHeader->sourceBounds; }
+    inline UINT GetVertexCount(UINT lod) const { return m_pHeader->lods[lod].vertexCount; }
+    inline UINT GetIndexCount(UINT lod) const { return m_pHeader->lods[lod].indexCount; }
+    inline const TextureTangentVertex* GetVertices(UINT lod) const
+    {
+        return reinterpret_cast<const TextureTangentVertex*>(m_file.GetData() + m_pHeader->lods[lod].vertexOffset);
+    }
+    inline const UINT32* GetIndices(UINT lod) const
+    {
+        return reinterpret_cast<const UINT32*>(m_file.GetData() + m_pHeader->lods[lod].indexOffset);
+    }
+    inline UINT GetMeshletCount() const { return m_pHeader->meshletCount; }
+    inline const MeshOptimizer::Meshlet* GetMeshlets() const
+    {
+        return reinterpret_cast<const MeshOptimizer::Meshlet*>(m_file.GetData() + m_pHeader->meshletOffset);
+    }
+
+private:
+    std::wstring GetEntryPath(const std::wstring& sourcePath) const;
+    bool OpenEntry(const std::wstring& entryPath, UINT64 sourceSize, UINT64 sourceWriteTime);
+    bool Store(const std::wstring& entryPath, const MeshImporter::Mesh& mesh, UINT64 sourceSize, UINT64 sourceWriteTime);
+
+    std::wstring m_directory;
+    MappedFile m_file;
+    const Header* m_pHeader;
+};
@@ -0,0 +1,349 @@
+#include "framework.h"
+
+#include "MeshImporter.h"
+
+#include <algorithm>
+#include <math.h>
+#include <unordered_map>
+
+namespace
+{
+
+static const UINT FirstLodGrid = 64; // Cells per unit box side of first clustering attempt, halved for each next one
+static const UINT MinLodGrid = 4; // Coarsest clustering grid
+static const float MinLodReduction = 0.75f; // Next LOD should have at most this part of triangles
+
+// Position, uv and normal ids of face corner, zero based, -1 if absent
+struct ObjCorner
+{
+    int v;
+    int vt;
+    int vn;
+
+    bool operator==(const ObjCorner& other) const { return v == other.v && vt == other.vt && vn == other.vn; }
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const ObjCorner& c) const
+    {
+        return ((size_t)c.v * 73856093) ^ ((size_t)(c.vt + 1) * 19349663) ^ ((size_t)(c.vn + 1) * 83492791);
+    }
+};
+
+// OBJ ids are one based, negative ones are relative to the end of the list
+int ResolveObjId(int id, size_t count)
+{
+    return id > 0 ? id - 1 : (id < 0 ? (int)count + id : -1);
+}
+
+bool ParseObjCorner(const char*& p, size_t posCount, size_t uvCount, size_t normCount, ObjCorner& corner)
+{
+    char* pEnd = nullptr;
+    corner.v = ResolveObjId(strtol(p, &pEnd, 10), posCount);
+    if (pEnd == p || corner.v < 0 || corner.v >= (int)posCount)
+    {
+        return false;
+    }
+    p = pEnd;
+    corner.vt = -1;
+    corner.vn = -1;
+    if (*p == '/')
+    {
+        ++p;
+        if (*p != '/')
+        {
+            corner.vt = ResolveObjId(strtol(p, &pEnd, 10), uvCount);
+            p = pEnd;
+        }
+        if (*p == '/')
+        {
+            ++p;
+            corner.vn = ResolveObjId(strtol(p, &pEnd, 10), normCount);
+            p = pEnd;
+        }
+    }
+    corner.vt = corner.vt < (int)uvCount ? corner.vt : -1;
+    corner.vn = corner.vn < (int)normCount ? corner.vn : -1;
+    return true;
+}
+
+Point3f AnyPerpendicular(const Point3f& n)
+{
+    Point3f axis = fabsf(n.x) < 0.9f ? Point3f{ 1, 0, 0 } : Point3f{ 0, 1, 0 };
+    Point3f t = axis - n * n.dot(axis);
+    t.normalize();
+    return t;
+}
+
+}
+
+bool MeshImporter::ImportObj(const std::wstring& path, Mesh& mesh)
+{
+    FILE* pFile = nullptr;
+    _wfopen_s(&pFile, path.c_str(), L"rb");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<Point3f> positions;
+    std::vector<Point2f> uvs;
+    std::vector<Point3f> normals;
+    std::vector<ObjCorner> corners; // Three per triangle
+
+    char line[1024];
+    std::vector<ObjCorner> face;
+    while (fgets(line, sizeof(line), pFile) != nullptr)
+    {
+        const char* p = line;
+        while (*p == ' ' || *p == '\t')
+        {
+            ++p;
+        }
+
+        // Right handed OBJ to left handed space by mirrored z, faces are flipped below to keep them facing outside
+        if (p[0] == 'v' && p[1] == ' ')
+        {
+            Point3f v = {};
+            sscanf_s(p + 2, "%f %f %f", &v.x, &v.y, &v.z);
+            positions.push_back(Point3f{ v.x, v.y, -v.z });
+        }
+        else if (p[0] == 'v' && p[1] == 't')
+        {
+            Point2f uv = {};
+            sscanf_s(p + 2, "%f %f", &uv.x, &uv.y);
+            uvs.push_back(Point2f{ uv.x, 1.0f - uv.y });
+        }
+        else if (p[0] == 'v' && p[1] == 'n')
+        {
+            Point3f n = {};
+            sscanf_s(p + 2, "%f %f %f", &n.x, &n.y, &n.z);
+            normals.push_back(Point3f{ n.x, n.y, -n.z });
+        }
+        else if (p[0] == 'f' && p[1] == ' ')
+        {
+            face.clear();
+            p += 2;
+            while (true)
+            {
+                while (*p == ' ' || *p == '\t')
+                {
+                    ++p;
+                }
+                ObjCorner corner;
+                if (!ParseObjCorner(p, positions.size(), uvs.size(), normals.size(), corner))
+                {
+                    break;
+                }
+                face.push_back(corner);
+            }
+            // Polygons are triangulated as fans, in reversed order, as mirroring turned them inside out
+            for (size_t i = 2; i < face.size(); i++)
+            {
+                corners.push_back(face[0]);
+                corners.push_back(face[i]);
+                corners.push_back(face[i - 1]);
+            }
+        }
+    }
+    fclose(pFile);
+
+    if (corners.empty())
+    {
+        return false;
+    }
+
+    // Corners with the same ids share vertex
+    Lod& lod = mesh.lods[0];
+    lod.vertices.clear();
+    std::vector<UINT> indices(corners.size());
+    std::unordered_map<ObjCorner, UINT, ObjCornerHash> vertexIds;
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        const ObjCorner& corner = corners[i];
+        auto it = vertexIds.find(corner);
+        if (it == vertexIds.end())
+        {
+            TextureTangentVertex vertex = {};
+            vertex.pos = positions[corner.v];
+            vertex.uv = corner.vt >= 0 ? uvs[corner.vt] : Point2f{ 0, 0 };
+            vertex.norm = corner.vn >= 0 ? normals[corner.vn] : Point3f{ 0, 0, 0 };
+            it = vertexIds.emplace(corner, (UINT)lod.vertices.size()).first;
+            lod.vertices.push_back(vertex);
+        }
+        indices[i] = it->second;
+    }
+
+    // Smooth normals of shared positions for corners without them
+    std::vector<Point3f> positionNormals(positions.size(), Point3f{ 0, 0, 0 });
+    for (size_t i = 0; i < corners.size(); i += 3)
+    {
+        const Point3f& p0 = positions[corners[i].v];
+        Point3f faceNormal = (positions[corners[i + 1].v] - p0).cross(positions[corners[i + 2].v] - p0);
+        for (size_t j = 0; j < 3; j++)
+        {
+            positionNormals[corners[i + j].v] = positionNormals[corners[i + j].v] + faceNormal;
+        }
+    }
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        TextureTangentVertex& vertex = lod.vertices[indices[i]];
+        if (corners[i].vn < 0)
+        {
+            vertex.norm = positionNormals[corners[i].v];
+        }
+    }
+
+    GenerateTangents(lod.vertices, indices);
+
+    // Centered and scaled to unit box
+    AABB bounds;
+    for (const TextureTangentVertex& vertex : lod.vertices)
+    {
+        bounds.vmin = Point3f{ std::min(bounds.vmin.x, vertex.pos.x), std::min(bounds.vmin.y, vertex.pos.y), std::min(bounds.vmin.z, vertex.pos.z) };
+        bounds.vmax = Point3f{ std::max(bounds.vmax.x, vertex.pos.x), std::max(bounds.vmax.y, vertex.pos.y), std::max(bounds.vmax.z, vertex.pos.z) };
+    }
+    mesh.sourceBounds = bounds;
+
+    Point3f size = bounds.vmax - bounds.vmin;
+    Point3f center = (bounds.vmin + bounds.vmax) * 0.5f;
+    float scale = 1.0f / std::max(std::max(size.x, size.y), std::max(size.z, 1e-6f));
+    for (TextureTangentVertex& vertex : lod.vertices)
+    {
+        vertex.pos = (vertex.pos - center) * scale;
+    }
+
+    lod.indices.assign(indices.begin(), indices.end());
+    mesh.lodCount = 1;
+
+    // Coarser grids are tried until the mesh gets reduced enough for the next LOD
+    for (UINT gridSize = FirstLodGrid; gridSize >= MinLodGrid && mesh.lodCount < MaxLods; gridSize /= 2)
+    {
+        if (SimplifyLod(mesh.lods[mesh.lodCount - 1], gridSize, mesh.lods[mesh.lodCount]))
+        {
+            ++mesh.lodCount;
+        }
+    }
+
+    // Optimized once here, as geometry pool skips it for cooked meshes.
+    // Meshlets of LOD 0 are culled on GPU instead of overdraw ordering, which would break them apart.
+    for (UINT i = 0; i < mesh.lodCount; i++)
+    {
+        Lod& lod = mesh.lods[i];
+        UINT vertexCount = (UINT)lod.vertices.size();
+        UINT indexCount = (UINT)lod.indices.size();
+        MeshOptimizer::OptimizeVertexCache(lod.indices.data(), indexCount, vertexCount);
+
+        std::vector<Point3f> positions(vertexCount);
+        for (UINT j = 0; j < vertexCount; j++)
+        {
+            positions[j] = lod.vertices[j].pos;
+        }
+        if (i == 0)
+        {
+            MeshOptimizer::BuildMeshlets(lod.indices.data(), indexCount, positions.data(), vertexCount, mesh.meshlets);
+        }
+        else
+        {
+            MeshOptimizer::OptimizeOverdraw(lod.indices.data(), indexCount, positions.data(), vertexCount);
+        }
+        MeshOptimizer::OptimizeVertexFetch(lod.vertices.data(), vertexCount, sizeof(TextureTangentVertex), lod.indices.data(), indexCount);
+    }
+
+    return true;
+}
+
+void MeshImporter::GenerateTangents(std::vector<TextureTangentVertex>& vertices, const std::vector<UINT>& indices)
+{
+    // Tangent is along increasing u, accumulated from triangles and orthogonalized against normal
+    std::vector<Point3f> tangents(vertices.size(), Point3f{ 0, 0, 0 });
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const TextureTangentVertex& v0 = vertices[indices[i]];
+        const TextureTangentVertex& v1 = vertices[indices[i + 1]];
+        const TextureTangentVertex& v2 = vertices[indices[i + 2]];
+
+        Point3f e1 = v1.pos - v0.pos;
+        Point3f e2 = v2.pos - v0.pos;
+        float du1 = v1.uv.x - v0.uv.x;
+        float dv1 = v1.uv.y - v0.uv.y;
+        float du2 = v2.uv.x - v0.uv.x;
+        float dv2 = v2.uv.y - v0.uv.y;
+
+        float det = du1 * dv2 - du2 * dv1;
+        if (fabsf(det) < 1e-12f)
+        {
+            continue;
+        }
+        Point3f tangent = (e1 * dv2 - e2 * dv1) * (1.0f / det);
+        for (size_t j = 0; j < 3; j++)
+        {
+            tangents[indices[i + j]] = tangents[indices[i + j]] + tangent;
+        }
+    }
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        TextureTangentVertex& vertex = vertices[i];
+        if (vertex.norm.length() < 1e-12f)
+        {
+            vertex.norm = Point3f{ 0, 1, 0 };
+        }
+        vertex.norm.normalize();
+
+        Point3f t = tangents[i] - vertex.norm * vertex.norm.dot(tangents[i]);
+        if (t.length() < 1e-6f)
+        {
+            vertex.tangent = AnyPerpendicular(vertex.norm);
+        }
+        else
+        {
+            t.normalize();
+            vertex.tangent = t;
+        }
+    }
+}
+
+bool MeshImporter::SimplifyLod(const Lod& src, UINT gridSize, Lod& dst)
+{
+    // Vertices of the same grid cell and normal octant collapse to the first of them,
+    // octant keeps opposite sides of thin parts apart
+    std::unordered_map<UINT64, UINT32> cellVertices;
+    std::vector<UINT32> remap(src.vertices.size());
+    dst.vertices.clear();
+    for (size_t i = 0; i < src.vertices.size(); i++)
+    {
+        const TextureTangentVertex& vertex = src.vertices[i];
+        UINT64 x = (UINT64)std::min((UINT)((vertex.pos.x + 0.5f) * gridSize), gridSize - 1);
+        UINT64 y = (UINT64)std::min((UINT)((vertex.pos.y + 0.5f) * gridSize), gridSize - 1);
+        UINT64 z = (UINT64)std::min((UINT)((vertex.pos.z + 0.5f) * gridSize), gridSize - 1);
+        UINT64 octant = (vertex.norm.x < 0 ? 1 : 0) | (vertex.norm.y < 0 ? 2 : 0) | (vertex.norm.z < 0 ? 4 : 0);
+        UINT64 key = (((x * gridSize + y) * gridSize + z) << 3) | octant;
+
+        auto it = cellVertices.find(key);
+        if (it == cellVertices.end())
+        {
+            it = cellVertices.emplace(key, (UINT32)dst.vertices.size()).first;
+            dst.vertices.push_back(vertex);
+        }
+        remap[i] = it->second;
+    }
+
+    // Triangles collapsed to a line or a point are dropped
+    dst.indices.clear();
+    for (size_t i = 0; i < src.indices.size(); i += 3)
+    {
+        UINT32 a = remap[src.indices[i]];
+        UINT32 b = remap[src.indices[i + 1]];
+        UINT32 c = remap[src.indices[i + 2]];
+        if (a != b && b != c && a != c)
+        {
+            dst.indices.push_back(a);
+            dst.indices.push_back(b);
+            dst.indices.push_back(c);
+        }
+    }
+
+    return !dst.indices.empty() && dst.indices.size() <= src.indices.size() * MinLodReduction;
+}
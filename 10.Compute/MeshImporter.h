@@ -0,0 +1,49 @@
+#pragma once
+
+#include "AABB.h"
+#include "MeshOptimizer.h"
+
+#include <string>
+#include <vector>
+
+struct TextureTangentVertex
+{
+    Point3f pos;
+    Point3f tangent;
+    Point3f norm;
+    Point2f uv;
+};
+
+/**
+ * Import of OBJ meshes into TextureTangentVertex layout, with normals if the file has none and tangents from uv.
+ * Mesh is centered and scaled to unit box, like the built-in instanced meshes, so instance bounds don't depend on asset.
+ * Coarser LODs are made by vertex clustering on halved grids, while they still drop enough triangles.
+ * Full detail LOD is split into meshlets for cluster culling, so indices are 32-bit and mesh size is not limited by them.
+ * Result is meant to be cooked once with MeshCache, as text parsing is slow at real asset sizes.
+ */
+class MeshImporter
+{
+public:
+    static const UINT MaxLods = 3; // Should fit mesh LODs of Renderer, which go before its impostor LOD
+
+    struct Lod
+    {
+        std::vector<TextureTangentVertex> vertices;
+        std::vector<UINT32> indices;
+    };
+
+    struct Mesh
+    {
+        AABB sourceBounds; // Before normalization to unit box
+        UINT lodCount = 0;
+        Lod lods[MaxLods];
+        std::vector<MeshOptimizer::Meshlet> meshlets; // Of LOD 0, its indices are ordered by meshlet
+    };
+
+    /** Triangulated OBJ with positions and optional uv and normals, groups and materials are ignored */
+    static bool ImportObj(const std::wstring& path, Mesh& mesh);
+
+private:
+    static void GenerateTangents(std::vector<TextureTangentVertex>& vertices, const std::vector<UINT>& indices);
+    static bool SimplifyLod(const Lod& src, UINT gridSize, Lod& dst);
+};
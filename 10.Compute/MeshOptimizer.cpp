@@ -0,0 +1,601 @@
+#include "framework.h"
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <math.h>
+#include <numeric>
+#include <string.h>
+#include <vector>
+
+namespace
+{
+
+const float CacheDecayPower = 1.5f;
+const float LastTriangleScore = 0.75f;
+const float ValenceBoostScale = 2.0f;
+const float ValenceBoostPower = 0.5f;
+
+const UINT InvalidIndex = ~0u;
+
+const float MinConeNormalDot = 0.1f; // Meshlets with normals spread wider than this can't be backface culled as a whole
+
+float VertexScore(int cachePos, UINT remaining)
+{
+    if (remaining == 0)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePos >= 0)
+    {
+        if (cachePos < 3)
+        {
+            // Vertices of just emitted triangle get fixed score, so long thin strips are not favoured
+            score = LastTriangleScore;
+        }
+        else
+        {
+            float scale = 1.0f / (MeshOptimizer::CacheSize - 3);
+            score = powf(1.0f - (cachePos - 3) * scale, CacheDecayPower);
+        }
+    }
+
+    // Vertices with few triangles left are finished first
+    return score + ValenceBoostScale * powf((float)remaining, -ValenceBoostPower);
+}
+
+// FIFO cache, vertex stays cached until cacheSize other vertices are loaded after it
+class FifoCache
+{
+public:
+    FifoCache(UINT vertexCount, UINT cacheSize)
+        : m_loadTime(vertexCount, 0)
+        , m_time(cacheSize + 1)
+        , m_cacheSize(cacheSize)
+    {}
+
+    /** Returns true on miss */
+    bool Access(UINT32 vertex)
+    {
+        if (m_time - m_loadTime[vertex] > m_cacheSize)
+        {
+            m_loadTime[vertex] = m_time++;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<UINT> m_loadTime;
+    UINT m_time;
+    UINT m_cacheSize;
+};
+
+// 16-bit variants run 32-bit code on widened copy of indices, which is narrowed back as vertex count stays the same
+template <typename Func>
+void ProcessWidened(UINT16* pIndices, UINT indexCount, Func func)
+{
+    std::vector<UINT32> wide(pIndices, pIndices + indexCount);
+    func(wide.data());
+    for (UINT i = 0; i < indexCount; i++)
+    {
+        pIndices[i] = (UINT16)wide[i];
+    }
+}
+
+}
+
+void MeshOptimizer::OptimizeVertexCache(UINT32* pIndices, UINT indexCount, UINT vertexCount)
+{
+    UINT triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Triangles of each vertex, only first remaining[v] entries are not emitted yet
+    std::vector<UINT> remaining(vertexCount, 0);
+    for (UINT i = 0; i < triangleCount * 3; i++)
+    {
+        remaining[pIndices[i]]++;
+    }
+
+    std::vector<UINT> offsets(vertexCount + 1, 0);
+    for (UINT v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+
+    std::vector<UINT> adjacency(triangleCount * 3);
+    std::vector<UINT> fill(offsets.begin(), offsets.end() - 1);
+    for (UINT t = 0; t < triangleCount; t++)
+    {
+        for (UINT k = 0; k < 3; k++)
+        {
+            adjacency[fill[pIndices[t * 3 + k]]++] = t;
+        }
+    }
+
+    std::vector<int> cachePos(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (UINT v = 0; v < vertexCount; v++)
+    {
+        vertexScores[v] = VertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    UINT bestTriangle = 0;
+    for (UINT t = 0; t < triangleCount; t++)
+    {
+        const UINT32* pTriangle = pIndices + t * 3;
+        triangleScores[t] = vertexScores[pTriangle[0]] + vertexScores[pTriangle[1]] + vertexScores[pTriangle[2]];
+        if (triangleScores[t] > triangleScores[bestTriangle])
+        {
+            bestTriangle = t;
+        }
+    }
+
+    std::vector<UINT32> result;
+    result.reserve(triangleCount * 3);
+
+    // Cache grows by up to 3 entries while triangle is added, extra entries are dropped after rescoring
+    std::vector<UINT> cache;
+    std::vector<UINT> newCache;
+    cache.reserve(CacheSize + 3);
+    newCache.reserve(CacheSize + 3);
+
+    UINT scanPos = 0;
+    while (result.size() < triangleCount * 3)
+    {
+        if (bestTriangle == InvalidIndex)
+        {
+            // No cached vertex has triangles left, so continue with first remaining one
+            while (emitted[scanPos])
+            {
+                scanPos++;
+            }
+            bestTriangle = scanPos;
+        }
+
+        const UINT32* pTriangle = pIndices + bestTriangle * 3;
+        emitted[bestTriangle] = true;
+        result.insert(result.end(), pTriangle, pTriangle + 3);
+
+        newCache.clear();
+        for (UINT k = 0; k < 3; k++)
+        {
+            UINT v = pTriangle[k];
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+            {
+                newCache.push_back(v);
+            }
+
+            // Move emitted triangle past remaining ones
+            UINT* pFirst = adjacency.data() + offsets[v];
+            UINT* pLast = pFirst + remaining[v] - 1;
+            std::swap(*std::find(pFirst, pLast + 1, bestTriangle), *pLast);
+            remaining[v]--;
+        }
+        for (UINT v : cache)
+        {
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+            {
+                newCache.push_back(v);
+            }
+        }
+
+        for (UINT i = 0; i < (UINT)newCache.size(); i++)
+        {
+            UINT v = newCache[i];
+            cachePos[v] = i < CacheSize ? (int)i : -1;
+            vertexScores[v] = VertexScore(cachePos[v], remaining[v]);
+        }
+
+        // Only triangles of changed vertices are rescored, the best of them goes next
+        bestTriangle = InvalidIndex;
+        float bestScore = -1.0f;
+        for (UINT v : newCache)
+        {
+            for (UINT i = offsets[v]; i < offsets[v] + remaining[v]; i++)
+            {
+                UINT t = adjacency[i];
+                const UINT32* pAdjacent = pIndices + t * 3;
+                triangleScores[t] = vertexScores[pAdjacent[0]] + vertexScores[pAdjacent[1]] + vertexScores[pAdjacent[2]];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (newCache.size() > CacheSize)
+        {
+            newCache.resize(CacheSize);
+        }
+        cache.swap(newCache);
+    }
+
+    memcpy(pIndices, result.data(), result.size() * sizeof(UINT32));
+}
+
+void MeshOptimizer::OptimizeVertexCache(UINT16* pIndices, UINT indexCount, UINT vertexCount)
+{
+    ProcessWidened(pIndices, indexCount, [=](UINT32* pWide) { OptimizeVertexCache(pWide, indexCount, vertexCount); });
+}
+
+void MeshOptimizer::OptimizeOverdraw(UINT32* pIndices, UINT indexCount, const Point3f* pPositions, UINT vertexCount)
+{
+    UINT triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Clusters start where all triangle vertices miss the cache, so moving them keeps cache efficiency
+    struct Cluster
+    {
+        UINT first;
+        UINT count;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+
+    FifoCache cache(vertexCount, CacheSize);
+    for (UINT t = 0; t < triangleCount; t++)
+    {
+        UINT misses = 0;
+        for (UINT k = 0; k < 3; k++)
+        {
+            misses += cache.Access(pIndices[t * 3 + k]) ? 1 : 0;
+        }
+        if (misses == 3 || clusters.empty())
+        {
+            clusters.push_back(Cluster{ t, 0, 0.0f });
+        }
+        clusters.back().count++;
+    }
+
+    Point3f meshCenter;
+    for (UINT v = 0; v < vertexCount; v++)
+    {
+        meshCenter = meshCenter + pPositions[v];
+    }
+    meshCenter = meshCenter * (1.0f / vertexCount);
+
+    // Clusters facing away from mesh center are likely to occlude others
+    for (Cluster& cluster : clusters)
+    {
+        Point3f center;
+        Point3f normal;
+        float area = 0.0f;
+        for (UINT t = cluster.first; t < cluster.first + cluster.count; t++)
+        {
+            const Point3f& p0 = pPositions[pIndices[t * 3 + 0]];
+            const Point3f& p1 = pPositions[pIndices[t * 3 + 1]];
+            const Point3f& p2 = pPositions[pIndices[t * 3 + 2]];
+
+            Point3f n = (p1 - p0).cross(p2 - p0);
+            float triangleArea = n.length();
+
+            center = center + (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal = normal + n;
+            area += triangleArea;
+        }
+
+        float normalLength = normal.length();
+        if (area > 0.0f && normalLength > 0.0f)
+        {
+            center = center * (1.0f / area);
+            cluster.sortKey = (center - meshCenter).dot(normal) / normalLength;
+        }
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<UINT32> result;
+    result.reserve(triangleCount * 3);
+    for (const Cluster& cluster : clusters)
+    {
+        result.insert(result.end(), pIndices + cluster.first * 3, pIndices + (cluster.first + cluster.count) * 3);
+    }
+
+    memcpy(pIndices, result.data(), result.size() * sizeof(UINT32));
+}
+
+void MeshOptimizer::OptimizeOverdraw(UINT16* pIndices, UINT indexCount, const Point3f* pPositions, UINT vertexCount)
+{
+    ProcessWidened(pIndices, indexCount, [=](UINT32* pWide) { OptimizeOverdraw(pWide, indexCount, pPositions, vertexCount); });
+}
+
+void MeshOptimizer::OptimizeVertexFetch(void* pVertices, UINT vertexCount, UINT stride, UINT32* pIndices, UINT indexCount)
+{
+    std::vector<UINT> remap(vertexCount, InvalidIndex);
+    UINT next = 0;
+    for (UINT i = 0; i < indexCount; i++)
+    {
+        UINT v = pIndices[i];
+        if (remap[v] == InvalidIndex)
+        {
+            remap[v] = next++;
+        }
+        pIndices[i] = remap[v];
+    }
+
+    // Unreferenced vertices are kept at the end
+    for (UINT v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] == InvalidIndex)
+        {
+            remap[v] = next++;
+        }
+    }
+
+    char* pData = reinterpret_cast<char*>(pVertices);
+    std::vector<char> source(pData, pData + vertexCount * stride);
+    for (UINT v = 0; v < vertexCount; v++)
+    {
+        memcpy(pData + remap[v] * stride, source.data() + v * stride, stride);
+    }
+}
+
+void MeshOptimizer::OptimizeVertexFetch(void* pVertices, UINT vertexCount, UINT stride, UINT16* pIndices, UINT indexCount)
+{
+    ProcessWidened(pIndices, indexCount, [=](UINT32* pWide) { OptimizeVertexFetch(pVertices, vertexCount, stride, pWide, indexCount); });
+}
+
+void MeshOptimizer::BuildMeshlets(UINT32* pIndices, UINT indexCount, const Point3f* pPositions, UINT vertexCount, std::vector<Meshlet>& meshlets)
+{
+    meshlets.clear();
+
+    UINT triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Vertices split on uv or normal seams share position, so triangles are connected through welded ids
+    std::vector<UINT> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [pPositions](UINT a, UINT b)
+    {
+        const Point3f& pa = pPositions[a];
+        const Point3f& pb = pPositions[b];
+        return pa.x != pb.x ? pa.x < pb.x : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+    });
+    std::vector<UINT> welded(vertexCount);
+    for (UINT i = 0; i < vertexCount; i++)
+    {
+        const Point3f& p = pPositions[order[i]];
+        const Point3f& prev = pPositions[order[i > 0 ? i - 1 : 0]];
+        welded[order[i]] = i > 0 && p.x == prev.x && p.y == prev.y && p.z == prev.z ? welded[order[i - 1]] : order[i];
+    }
+
+    std::vector<UINT> offsets(vertexCount + 1, 0);
+    for (UINT i = 0; i < triangleCount * 3; i++)
+    {
+        offsets[welded[pIndices[i]] + 1]++;
+    }
+    for (UINT v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<UINT> adjacency(triangleCount * 3);
+    std::vector<UINT> fill(offsets.begin(), offsets.end() - 1);
+    for (UINT t = 0; t < triangleCount; t++)
+    {
+        for (UINT k = 0; k < 3; k++)
+        {
+            adjacency[fill[welded[pIndices[t * 3 + k]]]++] = t;
+        }
+    }
+
+    // Candidates are bucketed by count of their positions already in meshlet, stale entries are skipped when popped
+    std::vector<bool> used(triangleCount, false);
+    std::vector<UINT> shared(triangleCount, 0);
+    std::vector<UINT> vertexMeshlet(vertexCount, InvalidIndex);
+    std::vector<UINT> candidates[3];
+    std::vector<UINT> touched;
+
+    std::vector<UINT32> result;
+    result.reserve(triangleCount * 3);
+
+    UINT seed = 0;
+    for (;;)
+    {
+        while (seed < triangleCount && used[seed])
+        {
+            seed++;
+        }
+        if (seed == triangleCount)
+        {
+            break;
+        }
+
+        UINT meshlet = (UINT)meshlets.size();
+        UINT firstIndex = (UINT)result.size();
+        UINT meshletTriangles = 0;
+        UINT meshletVertices = 0;
+        UINT next = seed;
+        while (next != InvalidIndex)
+        {
+            used[next] = true;
+            result.insert(result.end(), pIndices + next * 3, pIndices + next * 3 + 3);
+            meshletTriangles++;
+
+            for (UINT k = 0; k < 3; k++)
+            {
+                UINT v = welded[pIndices[next * 3 + k]];
+                if (vertexMeshlet[v] == meshlet)
+                {
+                    continue;
+                }
+                vertexMeshlet[v] = meshlet;
+                meshletVertices++;
+
+                for (UINT i = offsets[v]; i < offsets[v + 1]; i++)
+                {
+                    UINT t = adjacency[i];
+                    if (used[t])
+                    {
+                        continue;
+                    }
+                    if (shared[t] == 0)
+                    {
+                        touched.push_back(t);
+                    }
+                    shared[t] = std::min(shared[t] + 1, 3u);
+                    candidates[shared[t] - 1].push_back(t);
+                }
+            }
+
+            next = InvalidIndex;
+            if (meshletTriangles == MaxMeshletTriangles)
+            {
+                break;
+            }
+
+            // Best candidate adds fewest vertices, if even it doesn't fit, the rest don't either
+            bool full = false;
+            for (int s = 2; s >= 0 && next == InvalidIndex && !full; s--)
+            {
+                while (!candidates[s].empty())
+                {
+                    UINT t = candidates[s].back();
+                    candidates[s].pop_back();
+                    if (used[t] || shared[t] != (UINT)s + 1)
+                    {
+                        continue;
+                    }
+
+                    UINT added = 0;
+                    for (UINT k = 0; k < 3; k++)
+                    {
+                        UINT v = welded[pIndices[t * 3 + k]];
+                        bool repeated = (k > 0 && v == welded[pIndices[t * 3]]) || (k > 1 && v == welded[pIndices[t * 3 + 1]]);
+                        added += vertexMeshlet[v] != meshlet && !repeated ? 1 : 0;
+                    }
+                    if (meshletVertices + added <= MaxMeshletVertices)
+                    {
+                        next = t;
+                    }
+                    else
+                    {
+                        full = true;
+                    }
+                    break;
+                }
+            }
+        }
+
+        for (UINT t : touched)
+        {
+            shared[t] = 0;
+        }
+        touched.clear();
+        for (std::vector<UINT>& bucket : candidates)
+        {
+            bucket.clear();
+        }
+
+        meshlets.push_back(ComputeMeshletBounds(result.data(), firstIndex, (UINT)result.size() - firstIndex, pPositions));
+    }
+
+    memcpy(pIndices, result.data(), result.size() * sizeof(UINT32));
+}
+
+MeshOptimizer::Meshlet MeshOptimizer::ComputeMeshletBounds(const UINT32* pIndices, UINT firstIndex, UINT indexCount, const Point3f* pPositions)
+{
+    Meshlet meshlet = {};
+    meshlet.firstIndex = firstIndex;
+    meshlet.indexCount = indexCount;
+
+    const UINT32* pMeshletIndices = pIndices + firstIndex;
+
+    // Sphere around box center is not minimal, but it is close for compact meshlets
+    Point3f bbMin = pPositions[pMeshletIndices[0]];
+    Point3f bbMax = bbMin;
+    for (UINT i = 1; i < indexCount; i++)
+    {
+        const Point3f& p = pPositions[pMeshletIndices[i]];
+        bbMin = Point3f{ std::min(bbMin.x, p.x), std::min(bbMin.y, p.y), std::min(bbMin.z, p.z) };
+        bbMax = Point3f{ std::max(bbMax.x, p.x), std::max(bbMax.y, p.y), std::max(bbMax.z, p.z) };
+    }
+    meshlet.center = (bbMin + bbMax) * 0.5f;
+    for (UINT i = 0; i < indexCount; i++)
+    {
+        meshlet.radius = std::max(meshlet.radius, (pPositions[pMeshletIndices[i]] - meshlet.center).length());
+    }
+
+    // Cone around average normal, which contains all triangle normals
+    Point3f normals[MaxMeshletTriangles];
+    UINT normalCount = 0;
+    Point3f axis = Point3f{ 0, 0, 0 };
+    for (UINT i = 0; i < indexCount; i += 3)
+    {
+        const Point3f& p0 = pPositions[pMeshletIndices[i]];
+        const Point3f& p1 = pPositions[pMeshletIndices[i + 1]];
+        const Point3f& p2 = pPositions[pMeshletIndices[i + 2]];
+
+        Point3f n = (p1 - p0).cross(p2 - p0);
+        float length = n.length();
+        if (length > 0.0f)
+        {
+            normals[normalCount] = n * (1.0f / length);
+            axis = axis + normals[normalCount];
+            normalCount++;
+        }
+    }
+
+    meshlet.coneCutoff = 1.0f;
+    float axisLength = axis.length();
+    if (axisLength > 0.0f)
+    {
+        meshlet.coneAxis = axis * (1.0f / axisLength);
+
+        float minDot = 1.0f;
+        for (UINT i = 0; i < normalCount; i++)
+        {
+            minDot = std::min(minDot, normals[i].dot(meshlet.coneAxis));
+        }
+        if (minDot > MinConeNormalDot)
+        {
+            meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+        }
+    }
+
+    return meshlet;
+}
+
+MeshOptimizer::Stats MeshOptimizer::AnalyzeVertexCache(const UINT32* pIndices, UINT indexCount, UINT vertexCount, UINT cacheSize)
+{
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+
+    UINT misses = 0;
+    UINT uniqueVertices = 0;
+    for (UINT i = 0; i < indexCount; i++)
+    {
+        misses += cache.Access(pIndices[i]) ? 1 : 0;
+        if (!referenced[pIndices[i]])
+        {
+            referenced[pIndices[i]] = true;
+            uniqueVertices++;
+        }
+    }
+
+    Stats stats;
+    stats.acmr = indexCount >= 3 ? (float)misses / (indexCount / 3) : 0.0f;
+    stats.atvr = uniqueVertices > 0 ? (float)misses / uniqueVertices : 0.0f;
+
+    return stats;
+}
+
+MeshOptimizer::Stats MeshOptimizer::AnalyzeVertexCache(const UINT16* pIndices, UINT indexCount, UINT vertexCount, UINT cacheSize)
+{
+    std::vector<UINT32> wide(pIndices, pIndices + indexCount);
+    return AnalyzeVertexCache(wide.data(), indexCount, vertexCount, cacheSize);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../Math/Point.h"
+
+#include <d3d11.h>
+
+#include <vector>
+
+/**
+ * Reordering of static indexed triangle lists before upload.
+ * Triangles are ordered for post-transform vertex cache (Forsyth linear-speed algorithm),
+ * clusters of them are sorted outside facing first to reduce overdraw,
+ * and vertices are renumbered in order of first use for vertex fetch locality.
+ * Large meshes are split into meshlets, small connected clusters of triangles with bounds for GPU culling.
+ * Indices are processed as 32-bit, 16-bit variants work on widened copy.
+ */
+class MeshOptimizer
+{
+public:
+    static const UINT CacheSize = 32; // Simulated cache size for scoring and stats
+    static const UINT MaxMeshletTriangles = 128;
+    static const UINT MaxMeshletVertices = 96; // Unique positions, limits stretched meshlets along mesh borders
+
+    struct Stats
+    {
+        float acmr; // Average cache miss ratio, transformed vertices per triangle
+        float atvr; // Average transform to vertex ratio, 1 is optimal
+    };
+
+    // 48 bytes. Should match Meshlet in CullCommon.h
+    struct Meshlet
+    {
+        Point3f center; // Bounding sphere in model space
+        float radius;
+        Point3f coneAxis; // Average triangle normal
+        float coneCutoff; // Sine of normal spread around axis, 1 if triangles face too many ways to be culled together
+        UINT firstIndex; // Relative to mesh indices
+        UINT indexCount;
+        UINT pad[2];
+    };
+    static_assert(sizeof(Meshlet) == 48, "Meshlet should match CullCommon.h");
+
+    /** Reorder triangles in place for vertex cache locality */
+    static void OptimizeVertexCache(UINT32* pIndices, UINT indexCount, UINT vertexCount);
+    static void OptimizeVertexCache(UINT16* pIndices, UINT indexCount, UINT vertexCount);
+
+    /** Sort triangle clusters of vertex cache optimized indices, outside facing ones go first */
+    static void OptimizeOverdraw(UINT32* pIndices, UINT indexCount, const Point3f* pPositions, UINT vertexCount);
+    static void OptimizeOverdraw(UINT16* pIndices, UINT indexCount, const Point3f* pPositions, UINT vertexCount);
+
+    /** Renumber vertices in order of first use, pVertices of stride bytes is reordered in place */
+    static void OptimizeVertexFetch(void* pVertices, UINT vertexCount, UINT stride, UINT32* pIndices, UINT indexCount);
+    static void OptimizeVertexFetch(void* pVertices, UINT vertexCount, UINT stride, UINT16* pIndices, UINT indexCount);
+
+    /**
+     * Group triangles of vertex cache optimized indices into meshlets, indices are reordered so each meshlet is a contiguous range.
+     * Meshlets grow over shared positions from first unused triangle, so they stay compact while following cache order.
+     */
+    static void BuildMeshlets(UINT32* pIndices, UINT indexCount, const Point3f* pPositions, UINT vertexCount, std::vector<Meshlet>& meshlets);
+
+    /** FIFO cache simulation */
+    static Stats AnalyzeVertexCache(const UINT32* pIndices, UINT indexCount, UINT vertexCount, UINT cacheSize = CacheSize);
+    static Stats AnalyzeVertexCache(const UINT16* pIndices, UINT indexCount, UINT vertexCount, UINT cacheSize = CacheSize);
+
+private:
+    static Meshlet ComputeMeshletBounds(const UINT32* pIndices, UINT firstIndex, UINT indexCount, const Point3f* pPositions);
+};
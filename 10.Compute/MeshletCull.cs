@@ -0,0 +1,82 @@
+#include "SceneCB.h"
+#include "CullCommon.h"
+#include "Occlusion.h"
+
+cbuffer MeshletParams : register(b1)
+{
+    float4 model[3]; // Rows of 3x4 model matrix with uniform scale
+    float4 modelScale; // x - scale of model matrix
+    uint4 meshletParams; // x - meshlet count, y - mesh start index, z - cone culling enabled, w - Hi-Z test enabled
+};
+
+StructuredBuffer<Meshlet> meshlets : register(t0);
+ByteAddressBuffer poolIndices : register(t1); // Wide index buffer of geometry pool
+
+RWBuffer<uint> drawArgs : register(u0);
+RWByteAddressBuffer visibleIndices : register(u1); // Bound as index buffer for indirect draw
+
+static const uint GroupSize = 64;
+static const uint MaxGroupsX = 65535; // Meshlets over this count continue in next group rows
+
+groupshared uint visibleOffset;
+
+bool IsMeshletVisible(in Meshlet meshlet)
+{
+    float3x4 modelMatrix = float3x4(model[0], model[1], model[2]);
+    float3 center = mul(modelMatrix, float4(meshlet.sphere.xyz, 1.0));
+    float radius = meshlet.sphere.w * modelScale.x;
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(frustum[i].xyz, center) + frustum[i].w < -radius)
+        {
+            return false;
+        }
+    }
+
+    // All triangles face away if view direction is within cone around axis narrowed by normal spread, sphere extent is accounted by radius
+    if (meshletParams.z != 0 && meshlet.cone.w < 1.0)
+    {
+        float3 axis = normalize(mul((float3x3)modelMatrix, meshlet.cone.xyz));
+        float3 view = center - cameraPos.xyz;
+        if (dot(view, axis) >= meshlet.cone.w * length(view) + radius)
+        {
+            return false;
+        }
+    }
+
+    return meshletParams.w == 0 || !IsOccluded(center - radius, center + radius);
+}
+
+// Group per meshlet, first thread tests it and reserves space, the whole group copies its indices
+[numthreads(GroupSize, 1, 1)]
+void cs(uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID)
+{
+    uint meshletId = groupId.y * MaxGroupsX + groupId.x;
+    if (meshletId >= meshletParams.x)
+    {
+        return;
+    }
+
+    Meshlet meshlet = meshlets[meshletId];
+    if (groupThreadId.x == 0)
+    {
+        visibleOffset = 0xffffffff;
+        if (IsMeshletVisible(meshlet))
+        {
+            InterlockedAdd(drawArgs[0], meshlet.indexCount, visibleOffset); // Corresponds to IndexCountPerInstance
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (visibleOffset == 0xffffffff)
+    {
+        return;
+    }
+
+    uint first = meshletParams.y + meshlet.firstIndex;
+    for (uint i = groupThreadId.x; i < meshlet.indexCount; i += GroupSize)
+    {
+        visibleIndices.Store((visibleOffset + i) * 4, poolIndices.Load((first + i) * 4));
+    }
+}
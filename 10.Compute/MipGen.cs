@@ -0,0 +1,33 @@
+cbuffer ProcessParams : register(b0)
+{
+    uint4 sizes; // xy - source size, zw - destination size
+};
+
+Texture2D<float4> src : register(t0); // Previous mip
+RWTexture2D<unorm float4> dst : register(u0);
+
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (any(globalThreadId.xy >= sizes.zw))
+    {
+        return;
+    }
+
+    // Last texel also covers the extra row/column of odd sized source, so no source texel is skipped
+    uint2 srcStart = globalThreadId.xy * 2;
+    uint2 srcEnd = globalThreadId.xy == sizes.zw - 1 ? sizes.xy - 1 : srcStart + 1;
+
+    // Box filter
+    float4 color = float4(0, 0, 0, 0);
+    for (uint y = srcStart.y; y <= srcEnd.y; y++)
+    {
+        for (uint x = srcStart.x; x <= srcEnd.x; x++)
+        {
+            color += src.Load(int3(x, y, 0));
+        }
+    }
+
+    uint2 count = srcEnd - srcStart + 1;
+    dst[globalThreadId.xy] = color / (count.x * count.y);
+}
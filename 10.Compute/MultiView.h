@@ -0,0 +1,11 @@
+static const uint MaxViews = 8; // Should match Renderer::MaxViews
+static const uint ViewShift = 29; // Visible ids of multi-view lists carry view index in high bits
+static const uint ViewIdMask = (1u << ViewShift) - 1;
+
+// Views rendered in single pass, culled by one dispatch, and instanced draws are amplified across them
+cbuffer MultiViewBuffer : register (b5)
+{
+    float4x4 viewVp[MaxViews];
+    float4 viewFrusta[MaxViews * 6];
+    uint4 viewParams; // x - view count, y - visible ids per mesh LOD segment
+};
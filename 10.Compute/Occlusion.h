@@ -0,0 +1,76 @@
+cbuffer OcclusionParams : register(b2)
+{
+    float4x4 hiZVP; // View projection matrix Hi-Z was rendered with
+    uint4 hiZSize; // xy - depth buffer size, z - Hi-Z mip count, w - occlusion culling enabled
+};
+
+Texture2D<float> hiZ : register(t4); // Mip 0 is half of depth buffer size
+
+bool IsOccluded(in float3 bbMin, in float3 bbMax)
+{
+    if (hiZSize.w == 0)
+    {
+        return false;
+    }
+
+    // Screen rectangle and nearest depth of the box
+    float2 uvMin = float2(1, 1);
+    float2 uvMax = float2(0, 0);
+    float nearestDepth = 0.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        float3 corner = float3(
+            (i & 1) == 0 ? bbMin.x : bbMax.x,
+            (i & 2) == 0 ? bbMin.y : bbMax.y,
+            (i & 4) == 0 ? bbMin.z : bbMax.z
+        );
+        float4 clip = mul(hiZVP, float4(corner, 1.0));
+        if (clip.w <= 0.0f)
+        {
+            return false; // Box crosses camera plane
+        }
+
+        float3 ndc = clip.xyz / clip.w;
+        float2 uv = ndc.xy * float2(0.5, -0.5) + 0.5;
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearestDepth = max(nearestDepth, ndc.z); // Reversed Z
+    }
+
+    uvMin = saturate(uvMin);
+    uvMax = saturate(uvMax);
+
+    // Texel ranges in depth buffer pixels
+    int2 pMin = int2(uvMin * hiZSize.xy);
+    int2 pMax = min(int2(uvMax * hiZSize.xy), int2(hiZSize.xy) - 1);
+
+    // Pick level where the rectangle covers at most 2x2 texels, level 1 is Hi-Z mip 0
+    float2 extent = float2(pMax - pMin + 1);
+    int level = max(1, (int)ceil(log2(max(extent.x, extent.y))));
+    int2 tMin, tMax;
+    int2 mipSize;
+    for (;;)
+    {
+        int mip = min(level - 1, (int)hiZSize.z - 1);
+        mipSize = max(int2(hiZSize.xy) >> (mip + 1), 1);
+        tMin = min(pMin >> (mip + 1), mipSize - 1);
+        tMax = min(pMax >> (mip + 1), mipSize - 1);
+        if (all(tMax - tMin <= 1) || mip == (int)hiZSize.z - 1)
+        {
+            level = mip + 1;
+            break;
+        }
+        ++level;
+    }
+
+    float farthest = 1.0f;
+    for (int y = tMin.y; y <= tMax.y; y++)
+    {
+        for (int x = tMin.x; x <= tMax.x; x++)
+        {
+            farthest = min(farthest, hiZ.Load(int3(x, y, level - 1)));
+        }
+    }
+
+    return nearestDepth < farthest;
+}
@@ -0,0 +1,45 @@
+#include "SceneCB.h"
+#include "GroupAppend.h"
+#include "Occlusion.h"
+#include "GeomBuffer.h"
+
+cbuffer CullParams : register(b1)
+{
+    uint4 numShapes; // x - objects count, y - clusters count, z - test mesh bounds after boxes
+    float4 lodParams; // x - vertical projection scale, y - projected radius where LOD 1 starts, z - where impostors start
+    uint4 lodCounts; // LOD count of each instanced mesh
+};
+
+StructuredBuffer<AABB> bounds : register(t0);
+StructuredBuffer<GeomBuffer> geomBuffer : register(t5);
+
+RWBuffer<uint> lateArgs : register(u0);
+RWStructuredBuffer<uint> lateIds : register(u1);
+RWStructuredBuffer<uint> occludedIds : register(u2);
+RWStructuredBuffer<uint> occludedCount : register(u3);
+
+// Second phase, retest boxes occluded by previous frame depth against current frame Hi-Z
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID, uint3 groupThreadId : SV_GroupThreadID)
+{
+    // Groups are dispatched for candidates count, threads past it in the last group run through append with nothing to add
+    uint objectId = 0;
+    uint draw = AppendNone;
+    if (globalThreadId.x < occludedCount[0])
+    {
+        objectId = occludedIds[globalThreadId.x];
+        AABB bb = bounds[objectId];
+        if (!IsOccluded(bb.bbMin, bb.bbMax))
+        {
+            uint mesh = GetInstancedMesh(geomBuffer[objectId]);
+            draw = mesh * MaxLods + SelectLod(bb, cameraPos.xyz, lodParams, lodCounts[mesh]);
+        }
+    }
+
+    // Occluded list is only read here, nothing is appended to it
+    uint slot = GroupAppend(groupThreadId.x, draw, lateArgs, occludedCount);
+    if (draw != AppendNone)
+    {
+        lateIds[draw * MeshSegmentSize + slot] = objectId;
+    }
+}
@@ -0,0 +1,26 @@
+// Particle pool shared by simulation kernels and the billboard shaders
+
+struct Particle
+{
+    float3 pos;
+    float age; // Seconds since emission
+    float3 vel;
+    float lifetime; // Particle dies once its age reaches it
+};
+
+// Rewritten every frame, should match ParticleParams of Renderer
+cbuffer ParticleParams : register(b1)
+{
+    float4 emitter; // xyz - position, w - radius
+    float4 emitParams; // x - lifetime, y - speed, z - spread of direction, w - delta time
+    float4 simParams; // x - gravity, y - drag, z - particle size
+    float4 cameraRight;
+    float4 cameraUp;
+    uint4 particleCounts; // x - particles to emit, y - random seed, z - sort key count
+};
+
+// Hidden counters of dead and alive lists, copied by CopyStructureCount so their values never go through CPU
+cbuffer ParticleListCounts : register(b2)
+{
+    uint4 listCounts; // x - dead before emission, y - alive after emission
+};
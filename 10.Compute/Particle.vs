@@ -0,0 +1,36 @@
+#include "SceneCB.h"
+#include "Particle.h"
+
+StructuredBuffer<Particle> particles : register(t0);
+StructuredBuffer<uint2> keys : register(t1); // Visible particles, sorted back to front
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float2 uv : TEXCOORD;
+    float4 color : COLOR;
+};
+
+static const float2 QuadCorners[6] = {
+    float2(-1, -1), float2(-1, 1), float2(1, -1),
+    float2(1, -1), float2(-1, 1), float2(1, 1)
+};
+
+// Camera facing quad per instance, no vertex buffer
+VSOutput vs(uint vertexId : SV_VertexID, uint instanceId : SV_InstanceID)
+{
+    VSOutput result;
+
+    Particle p = particles[keys[instanceId].y];
+    float t = saturate(p.age / p.lifetime);
+
+    float2 corner = QuadCorners[vertexId];
+    float size = simParams.z * (0.5 + t);
+    float3 pos = p.pos + (cameraRight.xyz * corner.x + cameraUp.xyz * corner.y) * size;
+
+    result.pos = mul(vp, float4(pos, 1.0));
+    result.uv = corner;
+    result.color = lerp(float4(1.0, 0.85, 0.4, 0.8), float4(0.6, 0.15, 0.05, 0.0), t);
+
+    return result;
+}
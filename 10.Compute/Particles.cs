@@ -0,0 +1,137 @@
+#include "SceneCB.h"
+#include "CullCommon.h"
+#include "Particle.h"
+
+// Pool slots move between dead and alive lists with append and consume buffers, so only particles which exist are simulated.
+// Alive list is rebuilt by simulation each frame, which also compacts it, and visible particles get sort keys for drawing.
+
+RWStructuredBuffer<Particle> particles : register(u0);
+
+uint Hash(in uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+float Random(inout uint state)
+{
+    state = Hash(state);
+    return (state >> 8) / 16777216.0;
+}
+
+#if defined(RESET)
+AppendStructuredBuffer<uint> deadList : register(u1);
+
+// All slots are free, dead list counter is reset to zero when bound
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    deadList.Append(globalThreadId.x);
+}
+#elif defined(EMIT)
+ConsumeStructuredBuffer<uint> deadList : register(u1);
+AppendStructuredBuffer<uint> aliveList : register(u2);
+
+// Emission stops when the pool is exhausted, until older particles die
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint i = globalThreadId.x;
+    if (i >= min(particleCounts.x, listCounts.x))
+    {
+        return;
+    }
+
+    uint state = Hash(i ^ Hash(particleCounts.y));
+
+    // Fountain, directions are spread around up axis
+    float angle = Random(state) * 6.2831853;
+    float spread = Random(state) * emitParams.z;
+    float3 dir = normalize(float3(cos(angle) * spread, 1.0, sin(angle) * spread));
+
+    float3 offset = float3(Random(state), Random(state), Random(state)) * 2.0 - 1.0;
+
+    Particle p;
+    p.pos = emitter.xyz + offset * emitter.w;
+    p.age = 0.0;
+    p.vel = dir * emitParams.y * (0.75 + 0.5 * Random(state));
+    p.lifetime = emitParams.x * (0.75 + 0.5 * Random(state));
+
+    uint index = deadList.Consume();
+    particles[index] = p;
+    aliveList.Append(index);
+}
+#elif defined(SIMULATE)
+AppendStructuredBuffer<uint> deadList : register(u1);
+AppendStructuredBuffer<uint> aliveNext : register(u2);
+RWStructuredBuffer<uint2> keys : register(u3); // x - inverted view depth bits, y - particle index
+RWBuffer<uint> drawArgs : register(u4); // Visible count is instanceCount of DrawInstancedIndirect
+
+StructuredBuffer<uint> aliveList : register(t0);
+
+groupshared uint groupVisibleCount;
+groupshared uint groupVisibleBase;
+
+// Dispatched indirectly from alive count, visible keys are appended per group with a single global atomic
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+    if (groupIndex == 0)
+    {
+        groupVisibleCount = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    bool visible = false;
+    uint2 key = uint2(0, 0);
+    uint slot = 0;
+    if (globalThreadId.x < listCounts.y)
+    {
+        uint index = aliveList[globalThreadId.x];
+        Particle p = particles[index];
+
+        float dt = emitParams.w;
+        p.age += dt;
+        if (p.age >= p.lifetime)
+        {
+            deadList.Append(index);
+        }
+        else
+        {
+            p.vel.y -= simParams.x * dt;
+            p.vel *= max(1.0 - simParams.y * dt, 0.0);
+            p.pos += p.vel * dt;
+            particles[index] = p;
+            aliveNext.Append(index);
+
+            float size = simParams.z;
+            if (IsBoxInside(frustum, p.pos - size, p.pos + size))
+            {
+                // Keys of positive floats keep their order as uints, so inverted depth sorts back to front
+                float depth = mul(vp, float4(p.pos, 1.0)).w;
+                key = uint2(~asuint(max(depth, 0.0)), index);
+                visible = true;
+                InterlockedAdd(groupVisibleCount, 1, slot);
+            }
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (groupIndex == 0 && groupVisibleCount > 0)
+    {
+        uint base = 0;
+        InterlockedAdd(drawArgs[1], groupVisibleCount, base);
+        groupVisibleBase = base;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (visible)
+    {
+        keys[groupVisibleBase + slot] = key;
+    }
+}
+#endif
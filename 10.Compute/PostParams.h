@@ -0,0 +1,8 @@
+cbuffer PostParams : register(b0)
+{
+    uint4 sizes; // xy - source size, zw - destination size
+    float4 params; // Upscale: xy - rendered part of source in uv. Temporal resolve: xy - jitter in rendered pixels. Bloom down: x - threshold. Composite: x - bloom intensity, y - exposure
+    uint4 flags; // Temporal resolve: x - history is valid. Bloom down: x - apply threshold. Composite: x - bloom, y - tone mapping, z - color grading, w - sepia
+};
+
+SamplerState linearSampler : register(s0);
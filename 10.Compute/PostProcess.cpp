@@ -0,0 +1,343 @@
+#include "framework.h"
+
+#include "PostProcess.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <vector>
+
+HRESULT PostProcess::Init(ID3D11Device* pDevice, const CreateShader& createShader)
+{
+    HRESULT result = createShader(L"Upscale.cs", (ID3D11DeviceChild**)&m_pUpscaleShader, {});
+    if (SUCCEEDED(result))
+    {
+        result = createShader(L"TemporalResolve.cs", (ID3D11DeviceChild**)&m_pTemporalShader, {});
+    }
+    if (SUCCEEDED(result))
+    {
+        result = createShader(L"BloomDown.cs", (ID3D11DeviceChild**)&m_pBloomDownShader, {});
+    }
+    if (SUCCEEDED(result))
+    {
+        result = createShader(L"BloomUp.cs", (ID3D11DeviceChild**)&m_pBloomUpShader, {});
+    }
+    if (SUCCEEDED(result))
+    {
+        result = createShader(L"Composite.cs", (ID3D11DeviceChild**)&m_pCompositeShader, {});
+    }
+    if (SUCCEEDED(result))
+    {
+        result = createShader(L"Composite.cs", (ID3D11DeviceChild**)&m_pHalfCompositeShader, { "HALF_PRECISION" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = createShader(L"Fxaa.cs", (ID3D11DeviceChild**)&m_pFxaaShader, {});
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(Params);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = pDevice->CreateBuffer(&desc, nullptr, &m_pParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pParams, "PostParams");
+        }
+        if (SUCCEEDED(result))
+        {
+            desc.ByteWidth = sizeof(DirectX::XMFLOAT4X4);
+
+            result = pDevice->CreateBuffer(&desc, nullptr, &m_pTemporalParams);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pTemporalParams, "TemporalParams");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_SAMPLER_DESC desc = {};
+        desc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+        desc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+        desc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+        desc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+        desc.MinLOD = -FLT_MAX;
+        desc.MaxLOD = FLT_MAX;
+        desc.MipLODBias = 0.0f;
+        desc.MaxAnisotropy = 1;
+        desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+
+        result = pDevice->CreateSamplerState(&desc, &m_pSampler);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSampler, "PostSampler");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CreateLut(pDevice);
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void PostProcess::Term()
+{
+    SAFE_RELEASE(m_pUpscaleShader);
+    SAFE_RELEASE(m_pTemporalShader);
+    SAFE_RELEASE(m_pBloomDownShader);
+    SAFE_RELEASE(m_pBloomUpShader);
+    SAFE_RELEASE(m_pCompositeShader);
+    SAFE_RELEASE(m_pHalfCompositeShader);
+    SAFE_RELEASE(m_pFxaaShader);
+    SAFE_RELEASE(m_pParams);
+    SAFE_RELEASE(m_pTemporalParams);
+    SAFE_RELEASE(m_pSampler);
+    SAFE_RELEASE(m_pLut);
+    SAFE_RELEASE(m_pLutSRV);
+}
+
+void PostProcess::AddPasses(RenderGraph& graph, const Settings& settings, UINT width, UINT height, UINT srcWidth, UINT srcHeight,
+    UINT renderWidth, UINT renderHeight, RenderGraph::Handle src, RenderGraph::Handle dst, const TemporalInputs* pTemporal)
+{
+    if (pTemporal != nullptr)
+    {
+        Params params = {
+            { renderWidth, renderHeight, width, height },
+            { pTemporal->jitter[0], pTemporal->jitter[1], 0, 0 },
+            { pTemporal->historyValid ? 1u : 0u, 0, 0, 0 }
+        };
+        DirectX::XMFLOAT4X4 reproject = pTemporal->reproject;
+        RenderGraph::Handle depth = pTemporal->depth;
+        RenderGraph::Handle motion = pTemporal->motion;
+        RenderGraph::Handle history = pTemporal->history;
+        RenderGraph::Handle output = pTemporal->output;
+        graph.AddPass("TemporalResolve", { src, depth, motion, history }, { output },
+            [this, params, reproject, src, depth, motion, history, output](ID3D11DeviceContext* pContext, const RenderGraph& graph)
+        {
+            StallDetector::Get().UpdateSubresource(pContext, m_pTemporalParams, 0, nullptr, &reproject, 0, 0, STALL_SITE);
+            ID3D11Buffer* constBuffers[1] = {m_pTemporalParams};
+            pContext->CSSetConstantBuffers(1, 1, constBuffers);
+
+            ID3D11ShaderResourceView* srvs[4] = {graph.GetSRV(src), graph.GetSRV(depth), graph.GetSRV(motion), graph.GetSRV(history)};
+            Dispatch(pContext, m_pTemporalShader, params, srvs, 4, graph.GetUAV(output));
+        });
+
+        // Output stays as history, so it is copied to destination if nothing else writes there
+        src = output;
+        srcWidth = width;
+        srcHeight = height;
+        renderWidth = width;
+        renderHeight = height;
+    }
+
+    // Rest of the chain works in full resolution, on source of destination size
+    if (renderWidth != width || renderHeight != height || srcWidth != width || srcHeight != height || (pTemporal != nullptr && !IsEnabled(settings)))
+    {
+        RenderGraph::Handle target = IsEnabled(settings) ? graph.CreateTexture("PostUpscaled", { width, height, DXGI_FORMAT_R8G8B8A8_UNORM }) : dst;
+
+        Params params = {
+            { renderWidth, renderHeight, width, height },
+            { (float)renderWidth / srcWidth, (float)renderHeight / srcHeight, 0, 0 },
+            {}
+        };
+        graph.AddPass("Upscale", { src }, { target }, [this, params, src, target](ID3D11DeviceContext* pContext, const RenderGraph& graph)
+        {
+            ID3D11ShaderResourceView* srvs[1] = {graph.GetSRV(src)};
+            Dispatch(pContext, m_pUpscaleShader, params, srvs, 1, graph.GetUAV(target));
+        });
+
+        src = target;
+    }
+
+    RenderGraph::Handle bloom = RenderGraph::InvalidHandle;
+    if (settings.bloom)
+    {
+        bloom = AddBloomPasses(graph, settings, width, height, src);
+    }
+
+    if (settings.bloom || settings.toneMapping || settings.colorGrading || settings.sepia)
+    {
+        RenderGraph::Handle target = settings.fxaa ? graph.CreateTexture("PostComposite", { width, height, DXGI_FORMAT_R8G8B8A8_UNORM }) : dst;
+
+        RenderGraph::HandleList reads = { src };
+        if (bloom != RenderGraph::InvalidHandle)
+        {
+            reads.push_back(bloom);
+        }
+
+        Params params = {
+            { width, height, width, height },
+            { settings.bloomIntensity, settings.exposure, 0, 0 },
+            { settings.bloom ? 1u : 0u, settings.toneMapping ? 1u : 0u, settings.colorGrading ? 1u : 0u, settings.sepia ? 1u : 0u }
+        };
+        ID3D11ComputeShader* pShader = settings.halfPrecision ? m_pHalfCompositeShader : m_pCompositeShader;
+        graph.AddPass("Composite", reads, { target }, [this, params, pShader, src, bloom, target](ID3D11DeviceContext* pContext, const RenderGraph& graph)
+        {
+            ID3D11ShaderResourceView* srvs[3] = {graph.GetSRV(src), bloom != RenderGraph::InvalidHandle ? graph.GetSRV(bloom) : nullptr, m_pLutSRV};
+            Dispatch(pContext, pShader, params, srvs, 3, graph.GetUAV(target));
+        });
+
+        src = target;
+    }
+
+    if (settings.fxaa)
+    {
+        Params params = { { width, height, width, height }, {}, {} };
+        graph.AddPass("FXAA", { src }, { dst }, [this, params, src, dst](ID3D11DeviceContext* pContext, const RenderGraph& graph)
+        {
+            ID3D11ShaderResourceView* srvs[1] = {graph.GetSRV(src)};
+            Dispatch(pContext, m_pFxaaShader, params, srvs, 1, graph.GetUAV(dst));
+        });
+    }
+}
+
+HRESULT PostProcess::CreateLut(ID3D11Device* pDevice)
+{
+    // Fixed grade: mild contrast curve with warm tint
+    std::vector<UINT> texels(LutSize * LutSize * LutSize);
+    for (UINT b = 0; b < LutSize; b++)
+    {
+        for (UINT g = 0; g < LutSize; g++)
+        {
+            for (UINT r = 0; r < LutSize; r++)
+            {
+                static const float Tint[3] = { 1.05f, 1.0f, 0.92f };
+
+                UINT rgb[3] = { r, g, b };
+                UINT texel = 0xFF000000;
+                for (UINT c = 0; c < 3; c++)
+                {
+                    float v = (float)rgb[c] / (LutSize - 1);
+                    v = 0.5f * (v + v * v * (3.0f - 2.0f * v));
+                    v = std::min(1.0f, v * Tint[c]);
+                    texel |= (UINT)(v * 255.0f + 0.5f) << (c * 8);
+                }
+                texels[(b * LutSize + g) * LutSize + r] = texel;
+            }
+        }
+    }
+
+    D3D11_TEXTURE3D_DESC desc = {};
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.Width = LutSize;
+    desc.Height = LutSize;
+    desc.Depth = LutSize;
+    desc.MipLevels = 1;
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+
+    D3D11_SUBRESOURCE_DATA data;
+    data.pSysMem = texels.data();
+    data.SysMemPitch = LutSize * sizeof(UINT);
+    data.SysMemSlicePitch = LutSize * LutSize * sizeof(UINT);
+
+    HRESULT result = pDevice->CreateTexture3D(&desc, &data, &m_pLut);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pLut, "ColorGradingLut");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = pDevice->CreateShaderResourceView(m_pLut, nullptr, &m_pLutSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pLutSRV, "ColorGradingLutSRV");
+    }
+
+    return result;
+}
+
+RenderGraph::Handle PostProcess::AddBloomPasses(RenderGraph& graph, const Settings& settings, UINT width, UINT height, RenderGraph::Handle src)
+{
+    // Level i is of source size divided by 2^(i + 1)
+    UINT levels = 1;
+    while (levels < BloomLevels && (width >> (levels + 1)) > 0 && (height >> (levels + 1)) > 0)
+    {
+        levels++;
+    }
+
+    // Downsample, threshold is applied to the first level only. Bloom needs no alpha and is above 1 before tone mapping
+    RenderGraph::Handle down[BloomLevels];
+    RenderGraph::Handle prev = src;
+    UINT srcWidth = width;
+    UINT srcHeight = height;
+    for (UINT level = 0; level < levels; level++)
+    {
+        UINT dstWidth = std::max(1u, width >> (level + 1));
+        UINT dstHeight = std::max(1u, height >> (level + 1));
+        RenderGraph::Handle target = graph.CreateTexture("BloomDown" + std::to_string(level), { dstWidth, dstHeight, DXGI_FORMAT_R11G11B10_FLOAT });
+
+        Params params = {
+            { srcWidth, srcHeight, dstWidth, dstHeight },
+            { settings.bloomThreshold, 0, 0, 0 },
+            { level == 0 ? 1u : 0u, 0, 0, 0 }
+        };
+        graph.AddPass("Bloom", { prev }, { target }, [this, params, prev, target](ID3D11DeviceContext* pContext, const RenderGraph& graph)
+        {
+            ID3D11ShaderResourceView* srvs[1] = {graph.GetSRV(prev)};
+            Dispatch(pContext, m_pBloomDownShader, params, srvs, 1, graph.GetUAV(target));
+        });
+
+        down[level] = target;
+        prev = target;
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+
+    // Accumulate back up, starting from the smallest level
+    RenderGraph::Handle lowRes = down[levels - 1];
+    for (int level = (int)levels - 2; level >= 0; level--)
+    {
+        UINT dstWidth = std::max(1u, width >> (level + 1));
+        UINT dstHeight = std::max(1u, height >> (level + 1));
+        RenderGraph::Handle highRes = down[level];
+        RenderGraph::Handle target = graph.CreateTexture("BloomUp" + std::to_string(level), { dstWidth, dstHeight, DXGI_FORMAT_R11G11B10_FLOAT });
+
+        Params params = {
+            { std::max(1u, width >> (level + 2)), std::max(1u, height >> (level + 2)), dstWidth, dstHeight },
+            {},
+            {}
+        };
+        graph.AddPass("Bloom", { lowRes, highRes }, { target }, [this, params, lowRes, highRes, target](ID3D11DeviceContext* pContext, const RenderGraph& graph)
+        {
+            ID3D11ShaderResourceView* srvs[2] = {graph.GetSRV(lowRes), graph.GetSRV(highRes)};
+            Dispatch(pContext, m_pBloomUpShader, params, srvs, 2, graph.GetUAV(target));
+        });
+
+        lowRes = target;
+    }
+
+    return lowRes;
+}
+
+void PostProcess::Dispatch(ID3D11DeviceContext* pContext, ID3D11ComputeShader* pShader, const Params& params, ID3D11ShaderResourceView* const* ppSRVs, UINT srvCount, ID3D11UnorderedAccessView* pDst)
+{
+    StallDetector::Get().UpdateSubresource(pContext, m_pParams, 0, nullptr, &params, 0, 0, STALL_SITE);
+
+    ID3D11Buffer* constBuffers[1] = {m_pParams};
+    pContext->CSSetConstantBuffers(0, 1, constBuffers);
+    ID3D11SamplerState* samplers[1] = {m_pSampler};
+    pContext->CSSetSamplers(0, 1, samplers);
+
+    pContext->CSSetShaderResources(0, srvCount, ppSRVs);
+
+    ID3D11UnorderedAccessView* uavs[1] = {pDst};
+    pContext->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+
+    // Views are unbound by render graph, when next pass needs it
+    pContext->CSSetShader(pShader, nullptr, 0);
+    pContext->Dispatch(DivUp(params.sizes[2], 8u), DivUp(params.sizes[3], 8u), 1);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <d3d11.h>
+#include <DirectXMath.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "RenderGraph.h"
+
+/**
+ * Chain of compute post processing passes: temporal resolve or upscale of dynamic resolution scene, bloom, per pixel composite of tone mapping, color grading LUT and sepia, then FXAA.
+ * Disabled passes are not added, and the last enabled one writes to destination directly.
+ * With nothing enabled no pass is added, so the scene should be rendered to destination itself.
+ * Intermediate targets are render graph transients.
+ * State is changed directly on the context, so state cache should be invalidated after use.
+ */
+class PostProcess
+{
+public:
+    // Should create compute shader from file with given defines, so shaders go through cache and hot reload
+    typedef std::function<HRESULT(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines)> CreateShader;
+
+    static const UINT BloomLevels = 5; // Downsample chain, starting from half resolution
+    static const UINT LutSize = 16; // Should match Composite.cs
+
+    struct Settings
+    {
+        bool bloom;
+        float bloomThreshold;
+        float bloomIntensity;
+        bool toneMapping;
+        float exposure;
+        bool colorGrading;
+        bool sepia;
+        bool fxaa;
+        bool halfPrecision; // Composite in min16float, doesn't enable post processing by itself
+
+        Settings()
+            : bloom(false)
+            , bloomThreshold(0.8f)
+            , bloomIntensity(0.5f)
+            , toneMapping(false)
+            , exposure(1.0f)
+            , colorGrading(false)
+            , sepia(false)
+            , fxaa(false)
+            , halfPrecision(false)
+        {}
+    };
+
+    // Targets of temporal resolve, depth and motion are of source size, history and output of destination size
+    struct TemporalInputs
+    {
+        RenderGraph::Handle depth;
+        RenderGraph::Handle motion;
+        RenderGraph::Handle history; // Output of the previous frame
+        RenderGraph::Handle output; // R16G16B16A16_FLOAT, history of the next frame
+        DirectX::XMFLOAT4X4 reproject; // Jittered clip space of this frame to clip space of the previous one
+        float jitter[2]; // In rendered pixels
+        bool historyValid;
+    };
+
+    PostProcess()
+        : m_pUpscaleShader(nullptr)
+        , m_pTemporalShader(nullptr)
+        , m_pBloomDownShader(nullptr)
+        , m_pBloomUpShader(nullptr)
+        , m_pCompositeShader(nullptr)
+        , m_pHalfCompositeShader(nullptr)
+        , m_pFxaaShader(nullptr)
+        , m_pParams(nullptr)
+        , m_pTemporalParams(nullptr)
+        , m_pSampler(nullptr)
+        , m_pLut(nullptr)
+        , m_pLutSRV(nullptr)
+    {}
+
+    HRESULT Init(ID3D11Device* pDevice, const CreateShader& createShader);
+    void Term();
+
+    static inline bool IsEnabled(const Settings& settings)
+    {
+        return settings.bloom || settings.toneMapping || settings.colorGrading || settings.sepia || settings.fxaa;
+    }
+
+    /**
+     * Add enabled passes, destination should be R8G8B8A8_UNORM with UAV of width x height.
+     * Source is srcWidth x srcHeight, scene is rendered to its top left renderWidth x renderHeight part.
+     * With temporal inputs scene is resolved with history to destination size instead of upscaled.
+     */
+    void AddPasses(RenderGraph& graph, const Settings& settings, UINT width, UINT height, UINT srcWidth, UINT srcHeight,
+        UINT renderWidth, UINT renderHeight, RenderGraph::Handle src, RenderGraph::Handle dst, const TemporalInputs* pTemporal = nullptr);
+
+private:
+    struct Params
+    {
+        UINT sizes[4]; // xy - source size, zw - destination size
+        float params[4];
+        UINT flags[4];
+    };
+
+    HRESULT CreateLut(ID3D11Device* pDevice);
+
+    /** Returns accumulated bloom of half source size */
+    RenderGraph::Handle AddBloomPasses(RenderGraph& graph, const Settings& settings, UINT width, UINT height, RenderGraph::Handle src);
+    void Dispatch(ID3D11DeviceContext* pContext, ID3D11ComputeShader* pShader, const Params& params, ID3D11ShaderResourceView* const* ppSRVs, UINT srvCount, ID3D11UnorderedAccessView* pDst);
+
+private:
+    ID3D11ComputeShader* m_pUpscaleShader;
+    ID3D11ComputeShader* m_pTemporalShader;
+    ID3D11ComputeShader* m_pBloomDownShader;
+    ID3D11ComputeShader* m_pBloomUpShader;
+    ID3D11ComputeShader* m_pCompositeShader;
+    ID3D11ComputeShader* m_pHalfCompositeShader;
+    ID3D11ComputeShader* m_pFxaaShader;
+    ID3D11Buffer* m_pParams;
+    ID3D11Buffer* m_pTemporalParams; // Reprojection matrix
+    ID3D11SamplerState* m_pSampler; // Linear clamp
+
+    ID3D11Texture3D* m_pLut;
+    ID3D11ShaderResourceView* m_pLutSRV;
+};
@@ -0,0 +1,28 @@
+#include "SceneCB.h"
+
+// Bounding boxes of predicated draw groups, should match PredicateBuffer of Renderer
+cbuffer PredicateBuffer : register(b1)
+{
+    float4 boxMin[2];
+    float4 boxMax[2];
+};
+
+// Corners of box faces, bit 0 - x, bit 1 - y, bit 2 - z of max corner
+static const uint BoxCorners[36] = {
+    0, 2, 4, 4, 2, 6,
+    1, 5, 3, 3, 5, 7,
+    0, 4, 1, 1, 4, 5,
+    2, 3, 6, 6, 3, 7,
+    0, 1, 2, 2, 1, 3,
+    4, 6, 5, 5, 6, 7
+};
+
+// Box of the group is selected by start vertex, 36 vertices each
+float4 vs(uint vertexId : SV_VertexID) : SV_Position
+{
+    uint box = vertexId / 36;
+    uint corner = BoxCorners[vertexId % 36];
+    float3 t = float3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+
+    return mul(vp, float4(lerp(boxMin[box].xyz, boxMax[box].xyz, t), 1.0));
+}
@@ -0,0 +1,106 @@
+#include "framework.h"
+
+#include "RawMouse.h"
+
+namespace
+{
+
+const USHORT UsagePageGeneric = 0x01;
+const USHORT UsageMouse = 0x02;
+
+const UINT BufferedInputs = 64;
+
+}
+
+bool RawMouse::Register(HWND hWnd)
+{
+    RAWINPUTDEVICE device = {};
+    device.usUsagePage = UsagePageGeneric;
+    device.usUsage = UsageMouse;
+    device.dwFlags = 0; // Legacy messages are still generated for ImGui and buttons
+    device.hwndTarget = hWnd;
+
+    if (!RegisterRawInputDevices(&device, 1, sizeof(device)))
+    {
+        return false;
+    }
+
+    m_hWnd = hWnd;
+    m_dx = 0;
+    m_dy = 0;
+
+    return true;
+}
+
+void RawMouse::Unregister()
+{
+    if (m_hWnd == nullptr)
+    {
+        return;
+    }
+
+    RAWINPUTDEVICE device = {};
+    device.usUsagePage = UsagePageGeneric;
+    device.usUsage = UsageMouse;
+    device.dwFlags = RIDEV_REMOVE;
+    device.hwndTarget = nullptr;
+
+    RegisterRawInputDevices(&device, 1, sizeof(device));
+    m_hWnd = nullptr;
+}
+
+void RawMouse::OnInput(HRAWINPUT hInput)
+{
+    RAWINPUT input;
+    UINT size = sizeof(input);
+    if (GetRawInputData(hInput, RID_INPUT, &input, &size, sizeof(RAWINPUTHEADER)) != (UINT)-1)
+    {
+        Accumulate(input);
+    }
+}
+
+void RawMouse::Poll()
+{
+    if (m_hWnd == nullptr || GetWindowThreadProcessId(m_hWnd, nullptr) != GetCurrentThreadId())
+    {
+        return;
+    }
+
+    if (m_buffer.empty())
+    {
+        m_buffer.resize(DivUp(sizeof(RAWINPUT) * BufferedInputs, sizeof(UINT64)));
+    }
+
+    for (;;)
+    {
+        UINT size = (UINT)(m_buffer.size() * sizeof(UINT64));
+        UINT count = GetRawInputBuffer(reinterpret_cast<RAWINPUT*>(m_buffer.data()), &size, sizeof(RAWINPUTHEADER));
+        if (count == 0 || count == (UINT)-1)
+        {
+            break;
+        }
+
+        RAWINPUT* pInput = reinterpret_cast<RAWINPUT*>(m_buffer.data());
+        for (UINT i = 0; i < count; i++)
+        {
+            Accumulate(*pInput);
+            pInput = NEXTRAWINPUTBLOCK(pInput);
+        }
+    }
+}
+
+void RawMouse::TakeDelta(int& dx, int& dy)
+{
+    dx = m_dx.exchange(0);
+    dy = m_dy.exchange(0);
+}
+
+void RawMouse::Accumulate(const RAWINPUT& input)
+{
+    // Absolute devices (tablets, remote desktop) are left to WM_MOUSEMOVE
+    if (input.header.dwType == RIM_TYPEMOUSE && (input.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE) == 0)
+    {
+        m_dx += input.data.mouse.lLastX;
+        m_dy += input.data.mouse.lLastY;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <vector>
+
+/**
+ * Relative mouse motion from raw input, accumulated at device report rate.
+ * Motion is taken right before the view is built, instead of waiting for coalesced WM_MOUSEMOVE of the next frame.
+ */
+class RawMouse
+{
+public:
+    RawMouse()
+        : m_hWnd(nullptr)
+        , m_dx(0)
+        , m_dy(0)
+    {}
+
+    /** Should be called on the window thread */
+    bool Register(HWND hWnd);
+    void Unregister();
+
+    inline bool IsRegistered() const { return m_hWnd != nullptr; }
+
+    /** WM_INPUT handler */
+    void OnInput(HRAWINPUT hInput);
+
+    /** Read raw input still queued for the calling thread, does nothing on threads other than the window one */
+    void Poll();
+
+    /** Returns motion since the previous call */
+    void TakeDelta(int& dx, int& dy);
+
+private:
+    void Accumulate(const RAWINPUT& input);
+
+private:
+    HWND m_hWnd;
+
+    // Written on the window thread, taken on the thread which renders
+    std::atomic<int> m_dx;
+    std::atomic<int> m_dy;
+
+    std::vector<UINT64> m_buffer; // For buffered read, 64 bit aligned
+};
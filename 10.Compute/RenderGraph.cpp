@@ -0,0 +1,367 @@
+#include "framework.h"
+
+#include "RenderGraph.h"
+#include "GpuProfiler.h"
+
+#include <algorithm>
+
+namespace
+{
+
+UINT GetFormatSize(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            return 8;
+
+        case DXGI_FORMAT_R8_UNORM:
+            return 1;
+
+        default:
+            return 4;
+    }
+}
+
+}
+
+void RenderGraph::Term()
+{
+    for (PooledTexture& texture : m_pool)
+    {
+        SAFE_RELEASE(texture.pSRV);
+        SAFE_RELEASE(texture.pUAV);
+        SAFE_RELEASE(texture.pTexture);
+    }
+    m_pool.clear();
+
+    m_resources.clear();
+    m_passes.clear();
+}
+
+void RenderGraph::Reset()
+{
+    m_resources.clear();
+    m_passes.clear();
+    ++m_frame;
+}
+
+RenderGraph::Handle RenderGraph::CreateTexture(const std::string& name, const TextureDesc& desc)
+{
+    Resource resource = {};
+    resource.name = name;
+    resource.desc = desc;
+    resource.transient = true;
+    resource.pooled = InvalidHandle;
+    resource.firstPass = InvalidHandle;
+
+    m_resources.push_back(resource);
+    return (Handle)m_resources.size() - 1;
+}
+
+RenderGraph::Handle RenderGraph::ImportTexture(const std::string& name, ID3D11ShaderResourceView* pSRV, ID3D11UnorderedAccessView* pUAV)
+{
+    Resource resource = {};
+    resource.name = name;
+    resource.transient = false;
+    resource.pSRV = pSRV;
+    resource.pUAV = pUAV;
+    resource.pooled = InvalidHandle;
+    resource.firstPass = InvalidHandle;
+
+    // Views are compared by resource, as SRV and UAV of the same texture conflict
+    ID3D11Resource* pResource = nullptr;
+    if (pSRV != nullptr)
+    {
+        pSRV->GetResource(&pResource);
+    }
+    else if (pUAV != nullptr)
+    {
+        pUAV->GetResource(&pResource);
+    }
+    resource.pKey = pResource;
+    SAFE_RELEASE(pResource);
+
+    m_resources.push_back(resource);
+    return (Handle)m_resources.size() - 1;
+}
+
+void RenderGraph::MarkOutput(Handle handle)
+{
+    m_resources[handle].output = true;
+}
+
+void RenderGraph::AddPass(const char* name, const HandleList& reads, const HandleList& writes, const ExecuteFunc& execute)
+{
+    m_passes.push_back(Pass{ name, reads, writes, execute, false });
+}
+
+HRESULT RenderGraph::Execute(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, GpuProfiler& profiler)
+{
+    m_stats = Stats();
+
+    Cull();
+
+    // Lifetimes in executed passes
+    for (UINT i = 0; i < (UINT)m_passes.size(); i++)
+    {
+        const Pass& pass = m_passes[i];
+        if (pass.culled)
+        {
+            continue;
+        }
+        for (const HandleList* pHandles : { &pass.reads, &pass.writes })
+        {
+            for (Handle handle : *pHandles)
+            {
+                Resource& resource = m_resources[handle];
+                resource.firstPass = std::min(resource.firstPass, i);
+                resource.lastPass = resource.firstPass == i ? i : std::max(resource.lastPass, i);
+            }
+        }
+    }
+
+    HRESULT result = S_OK;
+    const char* scopeName = nullptr;
+    UINT scope = 0;
+    for (UINT i = 0; i < (UINT)m_passes.size() && SUCCEEDED(result); i++)
+    {
+        const Pass& pass = m_passes[i];
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        for (Resource& resource : m_resources)
+        {
+            if (resource.transient && resource.firstPass == i)
+            {
+                result = Acquire(pDevice, resource);
+                ++m_stats.transients;
+            }
+        }
+        if (FAILED(result))
+        {
+            break;
+        }
+
+        if (HasHazard(pass))
+        {
+            Unbind(pContext);
+            ++m_stats.unbinds;
+        }
+
+        if (scopeName != pass.name)
+        {
+            if (scopeName != nullptr)
+            {
+                profiler.EndScope(pContext, scope);
+            }
+            scope = profiler.BeginScope(pContext, pass.name);
+            scopeName = pass.name;
+        }
+
+        pass.execute(pContext, *this);
+        ++m_stats.passes;
+
+        for (Handle handle : pass.reads)
+        {
+            m_boundReads.push_back(m_resources[handle].pKey);
+        }
+        for (Handle handle : pass.writes)
+        {
+            m_boundWrites.push_back(m_resources[handle].pKey);
+        }
+
+        for (Resource& resource : m_resources)
+        {
+            if (resource.transient && resource.firstPass != InvalidHandle && resource.lastPass == i)
+            {
+                Release(resource);
+            }
+        }
+    }
+    if (scopeName != nullptr)
+    {
+        profiler.EndScope(pContext, scope);
+    }
+
+    // Nothing of the graph is left bound for the following rendering
+    Unbind(pContext);
+
+    TrimPool();
+    for (const PooledTexture& texture : m_pool)
+    {
+        ++m_stats.pooledTextures;
+        m_stats.pooledBytes += (UINT64)texture.desc.width * texture.desc.height * GetFormatSize(texture.desc.format);
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void RenderGraph::Cull()
+{
+    // Backwards from outputs, pass is kept if anything it writes is needed later
+    FrameVector<bool> needed(m_resources.size(), false);
+    for (UINT i = 0; i < (UINT)m_resources.size(); i++)
+    {
+        needed[i] = m_resources[i].output;
+    }
+
+    for (UINT i = (UINT)m_passes.size(); i-- > 0;)
+    {
+        Pass& pass = m_passes[i];
+        pass.culled = std::none_of(pass.writes.begin(), pass.writes.end(), [&needed](Handle handle) { return needed[handle]; });
+        if (pass.culled)
+        {
+            ++m_stats.culledPasses;
+            continue;
+        }
+        for (Handle handle : pass.reads)
+        {
+            needed[handle] = true;
+        }
+    }
+}
+
+HRESULT RenderGraph::Acquire(ID3D11Device* pDevice, Resource& resource)
+{
+    for (UINT i = 0; i < (UINT)m_pool.size(); i++)
+    {
+        PooledTexture& texture = m_pool[i];
+        if (!texture.inUse && texture.desc == resource.desc)
+        {
+            texture.inUse = true;
+            texture.lastFrame = m_frame;
+
+            resource.pooled = i;
+            resource.pSRV = texture.pSRV;
+            resource.pUAV = texture.pUAV;
+            resource.pKey = texture.pTexture;
+            return S_OK;
+        }
+    }
+
+    PooledTexture texture = {};
+    texture.desc = resource.desc;
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = resource.desc.format;
+    desc.ArraySize = 1;
+    desc.MipLevels = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Height = resource.desc.height;
+    desc.Width = resource.desc.width;
+
+    // Name of the first user, later ones may alias it
+    HRESULT result = pDevice->CreateTexture2D(&desc, nullptr, &texture.pTexture);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(texture.pTexture, "Transient" + resource.name);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = pDevice->CreateShaderResourceView(texture.pTexture, nullptr, &texture.pSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(texture.pSRV, "Transient" + resource.name + "SRV");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = pDevice->CreateUnorderedAccessView(texture.pTexture, nullptr, &texture.pUAV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(texture.pUAV, "Transient" + resource.name + "UAV");
+    }
+
+    if (FAILED(result))
+    {
+        SAFE_RELEASE(texture.pSRV);
+        SAFE_RELEASE(texture.pUAV);
+        SAFE_RELEASE(texture.pTexture);
+        return result;
+    }
+
+    texture.inUse = true;
+    texture.lastFrame = m_frame;
+    m_pool.push_back(texture);
+
+    resource.pooled = (UINT)m_pool.size() - 1;
+    resource.pSRV = texture.pSRV;
+    resource.pUAV = texture.pUAV;
+    resource.pKey = texture.pTexture;
+
+    return S_OK;
+}
+
+void RenderGraph::Release(Resource& resource)
+{
+    if (resource.pooled != InvalidHandle)
+    {
+        m_pool[resource.pooled].inUse = false;
+    }
+}
+
+bool RenderGraph::HasHazard(const Pass& pass) const
+{
+    auto isBound = [this](const std::vector<const void*>& bound, Handle handle)
+    {
+        return std::find(bound.begin(), bound.end(), m_resources[handle].pKey) != bound.end();
+    };
+
+    // Written resource may still be bound for read, or read resource for write
+    for (Handle handle : pass.writes)
+    {
+        if (isBound(m_boundReads, handle))
+        {
+            return true;
+        }
+    }
+    for (Handle handle : pass.reads)
+    {
+        if (isBound(m_boundWrites, handle))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RenderGraph::Unbind(ID3D11DeviceContext* pContext)
+{
+    ID3D11ShaderResourceView* nullSRVs[MaxBindSlots] = {};
+    pContext->CSSetShaderResources(0, MaxBindSlots, nullSRVs);
+    ID3D11UnorderedAccessView* nullUAVs[MaxBindSlots] = {};
+    pContext->CSSetUnorderedAccessViews(0, MaxBindSlots, nullUAVs, nullptr);
+
+    m_boundReads.clear();
+    m_boundWrites.clear();
+}
+
+void RenderGraph::TrimPool()
+{
+    for (UINT i = 0; i < (UINT)m_pool.size();)
+    {
+        PooledTexture& texture = m_pool[i];
+        if (!texture.inUse && texture.lastFrame + PoolFramesUnused < m_frame)
+        {
+            SAFE_RELEASE(texture.pSRV);
+            SAFE_RELEASE(texture.pUAV);
+            SAFE_RELEASE(texture.pTexture);
+            m_pool.erase(m_pool.begin() + i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "FrameArena.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class GpuProfiler;
+
+/**
+ * Per frame graph of compute passes over transient and imported textures.
+ * Passes declare textures they read and write, passes not contributing to outputs are culled.
+ * Transient textures are taken from pool before first use and returned after last one,
+ * so textures of equal description with non-overlapping lifetimes share one allocation.
+ * Views left bound by previous passes are unbound before a pass which would hit read/write hazard on them.
+ * Consecutive passes of the same name are profiled as one GPU scope.
+ */
+class RenderGraph
+{
+public:
+    typedef UINT Handle;
+    typedef FrameVector<Handle> HandleList;
+    static const Handle InvalidHandle = ~0u;
+
+    static const UINT MaxBindSlots = 4; // Compute SRV and UAV slots unbound on hazard
+    static const UINT PoolFramesUnused = 120; // Pooled textures unused for that many frames are released
+
+    // Transient textures are single mip, with SRV and UAV
+    struct TextureDesc
+    {
+        UINT width;
+        UINT height;
+        DXGI_FORMAT format;
+
+        inline bool operator==(const TextureDesc& other) const
+        {
+            return width == other.width && height == other.height && format == other.format;
+        }
+    };
+
+    typedef std::function<void(ID3D11DeviceContext* pContext, const RenderGraph& graph)> ExecuteFunc;
+
+    struct Stats
+    {
+        UINT passes; // Executed ones
+        UINT culledPasses;
+        UINT unbinds; // Hazards resolved by unbinding
+        UINT transients; // Transient textures of the frame
+        UINT pooledTextures; // Allocations backing them
+        UINT64 pooledBytes;
+    };
+
+    RenderGraph()
+        : m_frame(0)
+        , m_stats()
+    {}
+
+    void Term();
+
+    /** Start new frame, handles of previous one become invalid */
+    void Reset();
+
+    Handle CreateTexture(const std::string& name, const TextureDesc& desc);
+    /** External texture, should stay alive until Execute returns */
+    Handle ImportTexture(const std::string& name, ID3D11ShaderResourceView* pSRV, ID3D11UnorderedAccessView* pUAV);
+    /** Passes writing output are never culled */
+    void MarkOutput(Handle handle);
+
+    /** Name should be a string literal, as it is used for GPU profiling */
+    void AddPass(const char* name, const HandleList& reads, const HandleList& writes, const ExecuteFunc& execute);
+
+    /** Views are valid only while pass is executed */
+    ID3D11ShaderResourceView* GetSRV(Handle handle) const { return m_resources[handle].pSRV; }
+    ID3D11UnorderedAccessView* GetUAV(Handle handle) const { return m_resources[handle].pUAV; }
+
+    /** Cull, allocate and run passes in order they were added */
+    HRESULT Execute(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, GpuProfiler& profiler);
+
+    inline const Stats& GetStats() const { return m_stats; }
+
+private:
+    struct PooledTexture
+    {
+        TextureDesc desc;
+        ID3D11Texture2D* pTexture;
+        ID3D11ShaderResourceView* pSRV;
+        ID3D11UnorderedAccessView* pUAV;
+        bool inUse;
+        UINT64 lastFrame;
+    };
+
+    struct Resource
+    {
+        std::string name;
+        TextureDesc desc;
+        bool transient;
+        bool output;
+        ID3D11ShaderResourceView* pSRV;
+        ID3D11UnorderedAccessView* pUAV;
+        const void* pKey; // Underlying resource, aliased handles have the same one
+        UINT pooled; // Pool entry of transient one
+        UINT firstPass;
+        UINT lastPass;
+    };
+
+    // Handle lists are in frame arena, passes are not read after Execute and dropped by the next Reset
+    struct Pass
+    {
+        const char* name;
+        HandleList reads;
+        HandleList writes;
+        ExecuteFunc execute;
+        bool culled;
+    };
+
+    void Cull();
+    HRESULT Acquire(ID3D11Device* pDevice, Resource& resource);
+    void Release(Resource& resource);
+    bool HasHazard(const Pass& pass) const;
+    void Unbind(ID3D11DeviceContext* pContext);
+    void TrimPool();
+
+private:
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<PooledTexture> m_pool;
+
+    // Resources possibly bound by passes since last unbind
+    std::vector<const void*> m_boundReads;
+    std::vector<const void*> m_boundWrites;
+    UINT64 m_frame;
+    Stats m_stats;
+};
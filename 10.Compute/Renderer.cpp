@@ -1,27 +1,36 @@
 #include "framework.h"
 
 #include "Renderer.h"
-#include "DDS.h"
+#include "CpuProfiler.h"
+#include "Frustum.h"
+#include "MemoryRegistry.h"
+#include "MeshCache.h"
+#include "SceneFile.h"
+#include "StallDetector.h"
 
 #include <d3dcompiler.h>
+#include <DirectXPackedVector.h>
 
 #include <chrono>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include "../Core/DDS.h"
+#include "../Core/Shapes.h"
 #include "../Math/Matrix.h"
 
 #include "imgui.h"
+#include "imgui_internal.h"
 #include "backends/imgui_impl_dx11.h"
 #include "backends/imgui_impl_win32.h"
 
-struct TextureTangentVertex
+// 16 bytes instead of 44, decoded in SimpleTexture.vs with PACKED_VERTEX
+struct PackedTangentVertex
 {
-    Point3f pos;
-    Point3f tangent;
-    Point3f norm;
-    Point2f uv;
+    UINT16 pos[4];       // Half floats, w is padding
+    INT8 normTangent[4]; // Octahedral normal in xy, tangent in zw
+    UINT16 uv[2];        // Half floats
 };
 
 struct ColorVertex
@@ -30,12 +39,6 @@ struct ColorVertex
     COLORREF color;
 };
 
-struct SphereGeomBuffer
-{
-    DirectX::XMMATRIX m;
-    Point4f size;
-};
-
 struct RectGeomBuffer
 {
     DirectX::XMMATRIX m;
@@ -45,89 +48,267 @@ struct RectGeomBuffer
 struct CullParams
 {
     Point4i shapeCount; // x - shapes count
-    Point4f bbMin[Renderer::MaxInst];
-    Point4f bbMax[Renderer::MaxInst];
+    Point4f lodParams;  // x - vertical projection scale, y - projected radius where LOD 1 starts, z - where impostors start
+    Point4i lodCounts;  // LOD count of each instanced mesh
 };
 
-static const float CameraRotationSpeed = (float)M_PI * 2.0f;
-static const float ModelRotationSpeed = (float)M_PI / 2.0f;
+static_assert(Renderer::InstanceMeshCount <= 4, "LOD counts should fit CullParams");
+static_assert(MeshImporter::MaxLods <= Renderer::ImpostorLod, "Imported LOD chain should fit instanced mesh LODs");
 
-static const float Eps = 0.00001f;
+// Instanced meshes are referenced by these names in scene files
+static const char* InstanceMeshNames[Renderer::InstanceMeshCount] = { "Cube", "Sphere", "Imported" };
 
-namespace
+// RGBA8 is also the format of back buffer
+static const DXGI_FORMAT ColorFormats[Renderer::ColorFormatCount] = { DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R11G11B10_FLOAT };
+static const char* ColorFormatNames[Renderer::ColorFormatCount] = { "RGBA8", "R11G11B10 float" };
+
+struct DepthFormatDesc
 {
+    DXGI_FORMAT texture; // Typeless, as depth is also read for Hi-Z
+    DXGI_FORMAT dsv;
+    DXGI_FORMAT srv;
+};
 
-void GetSphereDataSize(size_t latCells, size_t lonCells, size_t& indexCount, size_t& vertexCount)
+static const DepthFormatDesc DepthFormats[Renderer::DepthFormatCount] =
 {
-    vertexCount = (latCells + 1) * (lonCells + 1);
-    indexCount = latCells * lonCells * 6;
-}
+    { DXGI_FORMAT_R32_TYPELESS, DXGI_FORMAT_D32_FLOAT, DXGI_FORMAT_R32_FLOAT },
+    { DXGI_FORMAT_R24G8_TYPELESS, DXGI_FORMAT_D24_UNORM_S8_UINT, DXGI_FORMAT_R24_UNORM_X8_TYPELESS },
+    { DXGI_FORMAT_R16_TYPELESS, DXGI_FORMAT_D16_UNORM, DXGI_FORMAT_R16_UNORM }
+};
+static const char* DepthFormatNames[Renderer::DepthFormatCount] = { "D32 float", "D24", "D16" };
 
-void CreateSphere(size_t latCells, size_t lonCells, UINT16* pIndices, Point3f* pPos)
+// All usage bits are supported, as well as every sample count of the mask
+static bool IsFormatSupported(ID3D11Device* pDevice, DXGI_FORMAT format, UINT usage, UINT sampleMask)
 {
-    for (size_t lat = 0; lat < latCells + 1; lat++)
+    UINT support = 0;
+    if (FAILED(pDevice->CheckFormatSupport(format, &support)) || (support & usage) != usage)
     {
-        for (size_t lon = 0; lon < lonCells + 1; lon++)
+        return false;
+    }
+    for (UINT samples = 2; samples <= D3D11_MAX_MULTISAMPLE_SAMPLE_COUNT; samples *= 2)
+    {
+        UINT levels = 0;
+        if ((sampleMask & samples) != 0 && (FAILED(pDevice->CheckMultisampleQualityLevels(format, samples, &levels)) || levels == 0))
         {
-            int index = (int)(lat * (lonCells + 1) + lon);
-            float lonAngle = 2.0f * (float)M_PI * lon / lonCells + (float)M_PI;
-            float latAngle = -(float)M_PI / 2 + (float)M_PI * lat / latCells;
-
-            Point3f r = Point3f{
-                sinf(lonAngle) * cosf(latAngle),
-                sinf(latAngle),
-                cosf(lonAngle) * cosf(latAngle)
-            };
-
-            pPos[index] = r * 0.5f;
+            return false;
         }
     }
+    return true;
+}
 
-    for (size_t lat = 0; lat < latCells; lat++)
+// Low discrepancy sample in [0, 1) of index in given prime base
+static float Halton(UINT index, UINT base)
+{
+    float result = 0.0f;
+    float fraction = 1.0f / base;
+    for (; index > 0; index /= base)
     {
-        for (size_t lon = 0; lon < lonCells; lon++)
-        {
-            size_t index = lat * lonCells * 6 + lon * 6;
-            pIndices[index + 0] = (UINT16)(lat * (latCells + 1) + lon + 0);
-            pIndices[index + 2] = (UINT16)(lat * (latCells + 1) + lon + 1);
-            pIndices[index + 1] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon);
-            pIndices[index + 3] = (UINT16)(lat * (latCells + 1) + lon + 1);
-            pIndices[index + 5] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon + 1);
-            pIndices[index + 4] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon);
-        }
+        result += (index % base) * fraction;
+        fraction /= base;
     }
+    return result;
+}
+
+struct OcclusionParams
+{
+    DirectX::XMMATRIX vp; // View projection Hi-Z was built with
+    Point4i hiZSize;      // xy - depth buffer size, z - Hi-Z mip count, w - occlusion culling enabled
+};
+
+struct MeshletParams
+{
+    Point4f model[3];   // Rows of 3x4 model matrix with uniform scale
+    Point4f modelScale; // x - scale of model matrix
+    Point4i params;     // x - meshlet count, y - mesh start index, z - cone culling enabled, w - Hi-Z test enabled
+};
+
+struct HiZParams
+{
+    Point4i sizes; // xy - source size, zw - destination size
+};
+
+struct LightCullParams
+{
+    DirectX::XMMATRIX v;
+    Point4f projParams; // x - inverse horizontal scale, y - inverse vertical scale of projection
+    Point4f bulbParams; // x - bulb radius, y - 1 if bulbs and sky are tested against Hi-Z of this frame
+};
+
+struct SortParams
+{
+    Point4i sortParams; // x - padded key count, y - bitonic block size, z - compare distance or transparent object count, w - instanced mesh
+};
+
+struct DispatchArgsParams
+{
+    Point4i argsParams; // x - dispatch count, y - stride of counts, z - offset of first count, w - threads per group of next pass
+};
+
+static const UINT DispatchGroupSize = 64; // Threads per group of all indirectly dispatched passes
+
+struct ResolveParams
+{
+    DirectX::XMMATRIX invVP;
+    Point4i resolveSize; // xy - target size
+};
+
+struct SkyAmbientParams
+{
+    Point4f ambientParams; // x - intensity
+};
+
+static const UINT SkyAmbientCoeffCount = 9; // L2 spherical harmonics, should match SkyAmbient.cs
+
+struct AnimateParams
+{
+    Point4f deltaTime;  // x - time since last update in seconds, y - offset of rendered time from simulated one
+    Point4i shapeCount; // x - shapes count
+};
+
+static const float CameraRotationSpeed = (float)M_PI * 2.0f;
+static const float ModelRotationSpeed = (float)M_PI / 2.0f;
+
+static const float Eps = 0.00001f;
+
+static const float CameraFov = (float)M_PI / 3;
+static const float CameraNear = 0.1f;
+static const float CameraFar = 100.0f; // Far plane if it is finite, light clusters end here anyway
+static const float PredicateNearMargin = CameraNear * 2.0f; // Camera this close to box of predicated group may clip its faces
+static const float ParticleEmitterRadius = 0.1f;
+static const float ParticleSpeed = 5.0f;
+static const float ParticleSpread = 0.3f; // Horizontal part of emission direction
+static const float ParticleGravity = 4.0f;
+static const float ParticleDrag = 0.1f;
+static const float ParticleSize = 0.03f;
+static const float LightBulbRadius = 0.125f;
+static const float NoMotion = 1000.0f; // Motion target clear value, should match TemporalResolve.cs
+static const UINT JitterPhases = 8; // Halton (2, 3) sequence length of projection jitter
+static const UINT SettingsCBSlot = 3; // Should match SettingsBuffer register in SceneCB.h
+static const UINT OverdrawUAVSlot = 4; // Should match overdraw register in Overdraw.ps
+static const UINT FeedbackUAVSlot = 5; // Should match feedback register in Material.h
+static const UINT VirtualTextureCBSlot = 5; // Should match VirtualTextureBuffer register in Material.h
+static const UINT ResidencySlot = 8; // Should match residency register in Material.h
+static const UINT ShadowCBSlot = 4; // Should match ShadowBuffer register in Shadow.h
+static const UINT ShadowAtlasSlot = 7; // Should match shadowAtlas register in Shadow.h
+static const UINT AmbientCBSlot = 6; // Should match AmbientBuffer register in Light.h
+static const float CascadeSplitLambda = 0.75f; // Blend of logarithmic and uniform cascade splits
+static const float ShadowCasterRange = 20.0f; // Cascades are extended towards the sun by it to catch casters out of view
+static const Point3f SunDir = Point3f{ 0.4f, 0.8f, 0.45f }; // Direction to the sun, normalized on use
+
+static const float MinResolutionScale = 0.5f;
+static const float ResolutionScaleDamping = 0.1f; // GPU times are several frames late, so scale moves only part of the way
+
+// Model space bounds of instanced meshes, xyz - box half size, w - radius it is extended by. Should match CullCommon.h
+static const Point4f InstanceMeshBounds[Renderer::InstanceMeshCount] = {
+    Point4f{ 0.5f, 0.5f, 0.5f, 0.0f }, // Cube
+    Point4f{ 0.0f, 0.0f, 0.0f, 0.5f }, // Sphere
+    Point4f{ 0.5f, 0.5f, 0.5f, 0.0f }  // Imported, normalized to unit box
+};
+
+static const float LodStartRadius = 0.1f; // Each next LOD starts at half projected radius of previous one
+static const float ImpostorStartRadius = 0.02f; // Projected radius below which instances are drawn as impostors
+static const UINT ImpostorSlot = 10; // Should match impostorNormals register in Impostor.ps
+
+// Imported mesh is also placed once at large scale behind instances, so its meshlets cover a good part of the screen
+static const Point3f MeshletModelPos = Point3f{ 0.0f, 0.0f, 9.0f };
+static const float MeshletModelScale = 6.0f;
+static const UINT MaxMeshletGroupsX = 65535; // Should match MaxGroupsX in MeshletCull.cs
+
+// Filtering of samplers by global quality, sampler name describes the filter, as samplers are shared by description
+struct SamplerFilter
+{
+    D3D11_FILTER filter;
+    UINT maxAnisotropy;
+    const char* name;
+};
+static const SamplerFilter BilinearFilter = { D3D11_FILTER_MIN_MAG_LINEAR_MIP_POINT, 1, "BilinearSampler" };
+static const SamplerFilter TrilinearFilter = { D3D11_FILTER_MIN_MAG_MIP_LINEAR, 1, "TrilinearSampler" };
+static const SamplerFilter MaterialFilters[Renderer::FilterQualityCount][MaterialTable::FilterCount] = {
+    { TrilinearFilter, TrilinearFilter, BilinearFilter },
+    { { D3D11_FILTER_ANISOTROPIC, 4, "Aniso4xSampler" }, { D3D11_FILTER_ANISOTROPIC, 2, "Aniso2xSampler" }, TrilinearFilter },
+    { { D3D11_FILTER_ANISOTROPIC, 16, "Aniso16xSampler" }, { D3D11_FILTER_ANISOTROPIC, 4, "Aniso4xSampler" }, TrilinearFilter }
+};
+static const SamplerFilter SceneFilters[Renderer::FilterQualityCount] = { BilinearFilter, TrilinearFilter, TrilinearFilter };
+static const UINT MaterialSamplerSlot = 2; // Should match materialSamplers register in Material.h
+
+static const char* ShaderVariantDefines[] = { "NORMAL_MAPS", "SHOW_NORMALS", "HALF_PRECISION", "VIRTUAL_TEXTURES", "MOTION_VECTORS" }; // By bit of Renderer::ShaderVariantFlag
+static const UINT ForwardVariants = Renderer::VariantNormalMaps | Renderer::VariantShowNormals | Renderer::VariantHalfPrecision | Renderer::VariantVirtualTextures
+    | Renderer::VariantMotionVectors;
+static const UINT GBufferVariants = Renderer::VariantNormalMaps | Renderer::VariantHalfPrecision | Renderer::VariantVirtualTextures | Renderer::VariantMotionVectors; // Normals are shown by resolve
+static const UINT LitVariants = Renderer::VariantShowNormals | Renderer::VariantHalfPrecision; // Transparent rects and deferred resolve have no normal maps
+static const UINT ImpostorVariants = Renderer::VariantShowNormals | Renderer::VariantHalfPrecision | Renderer::VariantVirtualTextures | Renderer::VariantMotionVectors; // Normals are baked
+static const UINT ImpostorGBufferVariants = Renderer::VariantHalfPrecision | Renderer::VariantVirtualTextures | Renderer::VariantMotionVectors;
+
+namespace
+{
+
+// Rows of 3x4 matrix with uniform scale and translation
+void GetMeshletModel(Point4f rows[3])
+{
+    rows[0] = Point4f{ MeshletModelScale, 0.0f, 0.0f, MeshletModelPos.x };
+    rows[1] = Point4f{ 0.0f, MeshletModelScale, 0.0f, MeshletModelPos.y };
+    rows[2] = Point4f{ 0.0f, 0.0f, MeshletModelScale, MeshletModelPos.z };
 }
 
-// Build plane equation on 4 points
-Point4f BuildPlane(const Point3f& p0, const Point3f& p1, const Point3f& p2, const Point3f& p3)
+// Unit vector to octahedral coordinates as SNORM bytes
+void OctEncode(const Point3f& v, INT8* pOut)
 {
-    Point3f norm = (p1 - p0).cross(p3 - p0);
-    norm.normalize();
-    Point3f pos = (p0 + p1 + p2 + p3) * 0.25f;
+    float invL1 = 1.0f / (fabsf(v.x) + fabsf(v.y) + fabsf(v.z));
+    float x = v.x * invL1;
+    float y = v.y * invL1;
+    if (v.z < 0.0f)
+    {
+        float foldX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldX;
+        y = foldY;
+    }
 
-    return Point4f(norm.x, norm.y, norm.z, -pos.dot(norm));
+    pOut[0] = (INT8)roundf(x * 127.0f);
+    pOut[1] = (INT8)roundf(y * 127.0f);
 }
 
-/** Is box inside? */
-bool IsBoxInside(const Point4f frustum[6], const Point3f& bbMin, const Point3f& bbMax)
+PackedTangentVertex PackVertex(const TextureTangentVertex& vertex)
 {
-    for (int i = 0; i < 6; i++)
+    using DirectX::PackedVector::XMConvertFloatToHalf;
+
+    PackedTangentVertex packed;
+    packed.pos[0] = XMConvertFloatToHalf(vertex.pos.x);
+    packed.pos[1] = XMConvertFloatToHalf(vertex.pos.y);
+    packed.pos[2] = XMConvertFloatToHalf(vertex.pos.z);
+    packed.pos[3] = XMConvertFloatToHalf(1.0f);
+    OctEncode(vertex.norm, packed.normTangent);
+    OctEncode(vertex.tangent, packed.normTangent + 2);
+    packed.uv[0] = XMConvertFloatToHalf(vertex.uv.x);
+    packed.uv[1] = XMConvertFloatToHalf(vertex.uv.y);
+
+    return packed;
+}
+
+// Same layout as CreateSphere, with tangent along longitude for normal mapping.
+// Seen from outside, so winding is flipped to match the cube
+void CreateTexturedSphere(size_t latCells, size_t lonCells, UINT16* pIndices, TextureTangentVertex* pVertices)
+{
+    std::vector<Point3f> pos((latCells + 1) * (lonCells + 1));
+    CreateSphere(latCells, lonCells, pIndices, pos.data());
+    for (size_t i = 0; i < latCells * lonCells * 6; i += 3)
     {
-        const Point3f norm = frustum[i];
-        Point4f p(
-            signbit(norm.x) ? bbMin.x : bbMax.x,
-            signbit(norm.y) ? bbMin.y : bbMax.y,
-            signbit(norm.z) ? bbMin.z : bbMax.z,
-            1.0f
-        );
-        float s = p.dot(frustum[i]);
-        if (s < 0.0f)
+        std::swap(pIndices[i + 1], pIndices[i + 2]);
+    }
+
+    for (size_t lat = 0; lat < latCells + 1; lat++)
+    {
+        for (size_t lon = 0; lon < lonCells + 1; lon++)
         {
-            return false;
+            size_t index = lat * (lonCells + 1) + lon;
+            float lonAngle = 2.0f * (float)M_PI * lon / lonCells + (float)M_PI;
+
+            pVertices[index].pos = pos[index];
+            pVertices[index].tangent = Point3f{ cosf(lonAngle), 0, -sinf(lonAngle) };
+            pVertices[index].norm = pos[index] * 2.0f;
+            pVertices[index].uv = Point2f{ (float)lon / lonCells, 1.0f - (float)lat / latCells };
         }
     }
-
-    return true;
 }
 
 }
@@ -161,6 +342,22 @@ bool Renderer::Init(HWND hWnd)
 {
     HRESULT result;
 
+    // Phases are timed for startup report
+    m_startupPhases.clear();
+    std::chrono::steady_clock::time_point phaseStart = std::chrono::steady_clock::now();
+    auto endPhase = [this, &phaseStart](const char* name)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        m_startupPhases.push_back({ name, std::chrono::duration<float, std::milli>(now - phaseStart).count() });
+        phaseStart = now;
+    };
+
+    // Falls back to window messages if raw input is not available
+    if (m_rawInput && !m_rawMouse.Register(hWnd))
+    {
+        m_rawInput = false;
+    }
+
     // Create a DirectX graphics interface factory.
     IDXGIFactory* pFactory = nullptr;
     result = CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)&pFactory);
@@ -169,52 +366,151 @@ bool Renderer::Init(HWND hWnd)
     IDXGIAdapter* pSelectedAdapter = NULL;
     if (SUCCEEDED(result))
     {
-        IDXGIAdapter* pAdapter = NULL;
-        UINT adapterIdx = 0;
-        while (SUCCEEDED(pFactory->EnumAdapters(adapterIdx, &pAdapter)))
-        {
-            DXGI_ADAPTER_DESC desc;
-            pAdapter->GetDesc(&desc);
-
-            if (wcscmp(desc.Description, L"Microsoft Basic Render Driver") != 0)
-            {
-                pSelectedAdapter = pAdapter;
-                break;
-            }
-
-            pAdapter->Release();
-
-            adapterIdx++;
-        }
+        pSelectedAdapter = SelectAdapter(pFactory);
     }
     assert(pSelectedAdapter != NULL);
 
     // Create DirectX 11 device
-    D3D_FEATURE_LEVEL level;
-    D3D_FEATURE_LEVEL levels[] = { D3D_FEATURE_LEVEL_11_0 };
+    D3D_FEATURE_LEVEL level = D3D_FEATURE_LEVEL_11_0;
+    D3D_FEATURE_LEVEL levels[] = { D3D_FEATURE_LEVEL_11_1, D3D_FEATURE_LEVEL_11_0 };
     if (SUCCEEDED(result))
     {
-        UINT flags = 0;
+        // Hardware encoder of video recording shares the device
+        UINT flags = D3D11_CREATE_DEVICE_VIDEO_SUPPORT;
 #ifdef _DEBUG
         flags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif // _DEBUG
-        result = D3D11CreateDevice(pSelectedAdapter, D3D_DRIVER_TYPE_UNKNOWN, NULL,
-            flags, levels, 1, D3D11_SDK_VERSION, &m_pDevice, &level, &m_pDeviceContext);
-        assert(level == D3D_FEATURE_LEVEL_11_0);
+        auto createDevice = [&](UINT deviceFlags)
+        {
+            HRESULT createResult = D3D11CreateDevice(pSelectedAdapter, D3D_DRIVER_TYPE_UNKNOWN, NULL,
+                deviceFlags, levels, _countof(levels), D3D11_SDK_VERSION, &m_pDevice, &level, &m_pDeviceContext);
+            if (createResult == E_INVALIDARG)
+            {
+                // D3D11.0 runtime doesn't know feature level 11.1
+                createResult = D3D11CreateDevice(pSelectedAdapter, D3D_DRIVER_TYPE_UNKNOWN, NULL,
+                    deviceFlags, &levels[1], 1, D3D11_SDK_VERSION, &m_pDevice, &level, &m_pDeviceContext);
+            }
+            return createResult;
+        };
+        result = createDevice(flags);
+        if (FAILED(result))
+        {
+            // Adapter without video support, recording is not available
+            result = createDevice(flags & ~D3D11_CREATE_DEVICE_VIDEO_SUPPORT);
+        }
+        assert(level >= D3D_FEATURE_LEVEL_11_0);
         assert(SUCCEEDED(result));
     }
 
-    // Create swapchain
+    // Constant buffer offsets are used for per draw constants, if both runtime and driver support them
     if (SUCCEEDED(result))
     {
+        m_featureLevel = level;
+        if (SUCCEEDED(m_pDeviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_pDeviceContext1)))
+        {
+            D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+            if (SUCCEEDED(m_pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+            {
+                m_constantOffsets = level >= D3D_FEATURE_LEVEL_11_1
+                    && options.ConstantBufferOffsetting == TRUE
+                    && options.MapNoOverwriteOnDynamicConstantBuffer == TRUE;
+            }
+        }
+
+        // Half precision variants run everywhere, but only GPUs with 16-bit ALUs gain from them
+        D3D11_FEATURE_DATA_SHADER_MIN_PRECISION_SUPPORT precision = {};
+        if (SUCCEEDED(m_pDevice->CheckFeatureSupport(D3D11_FEATURE_SHADER_MIN_PRECISION_SUPPORT, &precision, sizeof(precision))))
+        {
+            m_nativeHalfPrecision = (precision.PixelShaderMinPrecision & D3D11_SHADER_MIN_PRECISION_16_BIT) != 0;
+        }
+        m_halfPrecision = m_nativeHalfPrecision;
+
+        // Single pass cascades need viewport index output from vertex shader
+        D3D11_FEATURE_DATA_D3D11_OPTIONS3 options3 = {};
+        if (SUCCEEDED(m_pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS3, &options3, sizeof(options3))))
+        {
+            m_multiViewSupported = options3.VPAndRTArrayIndexFromAnyShaderFeedingRasterizer == TRUE;
+        }
+
+        // Virtual textures clamp LOD to resident tiles, which needs tier 2
+        m_virtualTexturesSupported = VirtualTextures::IsSupported(m_pDevice);
+    }
+
+    // Create flip model swapchain, requires DXGI 1.2
+    IDXGIFactory2* pFactory2 = nullptr;
+    if (SUCCEEDED(result) && m_flipModel)
+    {
+        if (FAILED(pFactory->QueryInterface(__uuidof(IDXGIFactory2), (void**)&pFactory2)))
+        {
+            m_flipModel = false;
+        }
+    }
+    if (SUCCEEDED(result) && m_flipModel)
+    {
+        // Tearing is needed for vsync off presentation with flip model on variable refresh rate displays
+        IDXGIFactory5* pFactory5 = nullptr;
+        if (SUCCEEDED(pFactory->QueryInterface(__uuidof(IDXGIFactory5), (void**)&pFactory5)))
+        {
+            BOOL allowTearing = FALSE;
+            if (SUCCEEDED(pFactory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))))
+            {
+                m_allowTearing = allowTearing == TRUE;
+            }
+            SAFE_RELEASE(pFactory5);
+        }
+
+        m_swapChainFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT | (m_allowTearing ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING : 0);
+
+        DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+        swapChainDesc.Width = m_width;
+        swapChainDesc.Height = m_height;
+        swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        swapChainDesc.Stereo = FALSE;
+        swapChainDesc.SampleDesc.Count = 1;
+        swapChainDesc.SampleDesc.Quality = 0;
+        swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT | DXGI_USAGE_UNORDERED_ACCESS | DXGI_USAGE_SHADER_INPUT;
+        swapChainDesc.BufferCount = BackBufferCount;
+        swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
+        swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+        swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
+        swapChainDesc.Flags = m_swapChainFlags;
+
+        IDXGISwapChain1* pSwapChain1 = nullptr;
+        result = pFactory2->CreateSwapChainForHwnd(m_pDevice, hWnd, &swapChainDesc, nullptr, nullptr, &pSwapChain1);
+        assert(SUCCEEDED(result));
+        if (SUCCEEDED(result))
+        {
+            m_pSwapChain = pSwapChain1;
+
+            IDXGISwapChain2* pSwapChain2 = nullptr;
+            result = m_pSwapChain->QueryInterface(__uuidof(IDXGISwapChain2), (void**)&pSwapChain2);
+            if (SUCCEEDED(result))
+            {
+                result = pSwapChain2->SetMaximumFrameLatency(MaxFrameLatency);
+            }
+            if (SUCCEEDED(result))
+            {
+                m_frameLatencyWaitable = pSwapChain2->GetFrameLatencyWaitableObject();
+            }
+            SAFE_RELEASE(pSwapChain2);
+            assert(SUCCEEDED(result));
+        }
+    }
+    SAFE_RELEASE(pFactory2);
+
+    // Create legacy swapchain
+    if (SUCCEEDED(result) && !m_flipModel)
+    {
+        m_swapChainFlags = 0;
+
         DXGI_SWAP_CHAIN_DESC swapChainDesc = { 0 };
-        swapChainDesc.BufferCount = 2;
+        swapChainDesc.BufferCount = BackBufferCount;
         swapChainDesc.BufferDesc.Width = m_width;
         swapChainDesc.BufferDesc.Height = m_height;
         swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
         swapChainDesc.BufferDesc.RefreshRate.Numerator = 0;
         swapChainDesc.BufferDesc.RefreshRate.Denominator = 1;
-        swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+        swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT | DXGI_USAGE_UNORDERED_ACCESS | DXGI_USAGE_SHADER_INPUT;
         swapChainDesc.OutputWindow = hWnd;
         swapChainDesc.SampleDesc.Count = 1;
         swapChainDesc.SampleDesc.Quality = 0;
@@ -222,21 +518,120 @@ bool Renderer::Init(HWND hWnd)
         swapChainDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
         swapChainDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
         swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
-        swapChainDesc.Flags = 0;
+        swapChainDesc.Flags = m_swapChainFlags;
 
         result = pFactory->CreateSwapChain(m_pDevice, &swapChainDesc, &m_pSwapChain);
         assert(SUCCEEDED(result));
     }
 
+    // Sample counts usable for both color and depth
+    for (UINT samples = 2; samples <= D3D11_MAX_MULTISAMPLE_SAMPLE_COUNT && SUCCEEDED(result); samples *= 2)
+    {
+        UINT colorLevels = 0;
+        UINT depthLevels = 0;
+        m_pDevice->CheckMultisampleQualityLevels(DXGI_FORMAT_R8G8B8A8_UNORM, samples, &colorLevels);
+        m_pDevice->CheckMultisampleQualityLevels(DXGI_FORMAT_D32_FLOAT, samples, &depthLevels);
+        if (colorLevels > 0 && depthLevels > 0)
+        {
+            m_msaaSupportMask |= samples;
+        }
+    }
+
+    // Scene formats besides RGBA8 and D32 are offered only if they can be used wherever scene targets are
+    for (UINT i = 1; i < ColorFormatCount && SUCCEEDED(result); i++)
+    {
+        UINT usage = D3D11_FORMAT_SUPPORT_RENDER_TARGET | D3D11_FORMAT_SUPPORT_BLENDABLE | D3D11_FORMAT_SUPPORT_SHADER_LOAD
+            | D3D11_FORMAT_SUPPORT_SHADER_SAMPLE | D3D11_FORMAT_SUPPORT_TYPED_UNORDERED_ACCESS_VIEW | D3D11_FORMAT_SUPPORT_MULTISAMPLE_RESOLVE;
+        if (IsFormatSupported(m_pDevice, ColorFormats[i], usage, m_msaaSupportMask))
+        {
+            m_colorFormatSupportMask |= 1u << i;
+        }
+    }
+    for (UINT i = 1; i < DepthFormatCount && SUCCEEDED(result); i++)
+    {
+        if (IsFormatSupported(m_pDevice, DepthFormats[i].dsv, D3D11_FORMAT_SUPPORT_DEPTH_STENCIL, m_msaaSupportMask)
+            && IsFormatSupported(m_pDevice, DepthFormats[i].srv, D3D11_FORMAT_SUPPORT_SHADER_LOAD, 1))
+        {
+            m_depthFormatSupportMask |= 1u << i;
+        }
+    }
+
     if (SUCCEEDED(result))
     {
         result = SetupBackBuffer();
     }
+    if (SUCCEEDED(result))
+    {
+        result = UpdateSceneTargets();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_frameCapture.Init(m_pDevice);
+    }
+    endPhase("Device and swap chain");
+
+    // Shaders of the last run are loaded or compiled on workers, scene creation waits only for the one it needs next,
+    // so cold start is bounded by the slowest shader rather than the sum of all
+    if (SUCCEEDED(result))
+    {
+        m_jobSystem.Init();
+
+        std::vector<ShaderCache::Request> requests;
+        if (m_shaderCache.LoadManifest(requests))
+        {
+            m_shaderCache.Prefetch(requests, [this](const std::function<void()>& func) { m_jobSystem.Submit(func); });
+        }
+        m_shaderCache.SetRecording(true);
+    }
+    endPhase("Job system and shader prefetch");
 
     if (SUCCEEDED(result))
     {
         result = InitScene();
     }
+    endPhase("Scene");
+
+    // Shaders which are no longer requested are waited for, as jobs use the cache
+    m_shaderCache.EndPrefetch();
+    m_shaderCache.SetRecording(false);
+    if (SUCCEEDED(result))
+    {
+        m_shaderCache.SaveManifest();
+    }
+    endPhase("Unused prefetch and manifest");
+
+    if (SUCCEEDED(result))
+    {
+        result = m_gpuProfiler.Init(m_pDevice);
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = m_framePacer.Init(m_pDevice);
+    }
+
+    for (UINT i = 0; i < PassCount && SUCCEEDED(result); i++)
+    {
+        result = m_pDevice->CreateDeferredContext(0, &m_pDeferredContexts[i]);
+        assert(SUCCEEDED(result));
+        if (SUCCEEDED(result))
+        {
+            // Deferred context starts recording with default state
+            m_deferredStates[i].SetContext(m_pDeferredContexts[i]);
+            m_deferredStates[i].ResetToDefault();
+        }
+    }
+
+    if (SUCCEEDED(result))
+    {
+        m_immediateState.SetContext(m_pDeviceContext);
+    }
+
+    if (SUCCEEDED(result))
+    {
+        m_shaderReloader.Init(m_pDevice);
+        m_textureStreamer.Init(m_pDevice);
+    }
 
     // Initial camera setup
     if (SUCCEEDED(result))
@@ -247,6 +642,15 @@ bool Renderer::Init(HWND hWnd)
         m_camera.theta = (float)M_PI/4;
     }
 
+    // Budget is queried from the adapter device is created on
+    MemoryRegistry::Get().SetAdapter(pSelectedAdapter);
+
+    // Optional, the second instance runs without it
+    if (!m_telemetry.Init(L"Local\\DX11Tutorial.Telemetry"))
+    {
+        OutputDebugStringA("Telemetry export is not available\n");
+    }
+
     SAFE_RELEASE(pSelectedAdapter);
     SAFE_RELEASE(pFactory);
 
@@ -264,14 +668,29 @@ bool Renderer::Init(HWND hWnd)
         //ImGui::StyleColorsLight();
 
         // Setup Platform/Renderer backends
+        // Compiled ImGui shaders, font texture and states survive device object invalidation
+        ImGui_ImplDX11_SetCacheDeviceObjects(true);
+        // Font atlas and shaders of the previous run, next to compiled scene shaders
+        ImGui_ImplDX11_SetCacheFile("ShaderCache/ImGui.cache");
         ImGui_ImplWin32_Init(hWnd);
         ImGui_ImplDX11_Init(m_pDevice, m_pDeviceContext);
 
-        m_sceneBuffer.lightCount.x = 1;
-        m_sceneBuffer.lights[0].pos = Point4f{0, 1.05f, 0, 1};
-        m_sceneBuffer.lights[0].color = Point4f{1,1,0};
-        m_sceneBuffer.ambientColor = Point4f(0,0,0.2f,0);
+        m_settingsBuffer.lightCount.x = 1;
+        m_lights[0].pos = Point4f{0, 1.05f, 0, 5};
+        m_lights[0].color = Point4f{1,1,0};
+        m_settingsBuffer.ambientColor = Point4f(0,0,0.2f,0);
+    }
+    endPhase("Profilers, contexts and UI");
+
+    float totalMs = 0.0f;
+    for (const StartupPhase& phase : m_startupPhases)
+    {
+        char buffer[128];
+        sprintf_s(buffer, "Startup %s %.1f ms\n", phase.name, phase.ms);
+        OutputDebugStringA(buffer);
+        totalMs += phase.ms;
     }
+    m_startupPhases.push_back({ "Total", totalMs });
 
     if (FAILED(result))
     {
@@ -283,14 +702,42 @@ bool Renderer::Init(HWND hWnd)
 
 void Renderer::Term()
 {
+    m_rawMouse.Unregister();
+
     ImGui_ImplDX11_Shutdown();
+    ImGui_ImplDX11_SetCacheDeviceObjects(false);
     ImGui_ImplWin32_Shutdown();
     ImGui::DestroyContext();
 
+    // Stop reloads and streaming before shaders and textures are released
+    m_shaderReloader.Term();
+    m_textureStreamer.Term();
+    m_frameCapture.Term(m_pDeviceContext);
+
     TermScene();
 
+    m_gpuProfiler.Term();
+    m_framePacer.Term();
+    for (UINT i = 0; i < PassCount; i++)
+    {
+        SAFE_RELEASE(m_pCommandLists[i]);
+        SAFE_RELEASE(m_pDeferredContexts[i]);
+    }
+    m_jobSystem.Term();
+
     SAFE_RELEASE(m_pBackBufferRTV);
+    SAFE_RELEASE(m_pBackBufferUAV);
+    SAFE_RELEASE(m_pBackBufferSRV);
+    if (m_frameLatencyWaitable != nullptr)
+    {
+        CloseHandle(m_frameLatencyWaitable);
+        m_frameLatencyWaitable = nullptr;
+    }
     SAFE_RELEASE(m_pSwapChain);
+    MemoryRegistry::Get().SetExternal("SwapChain", 0, MemoryRegistry::CategorySwapChain);
+    MemoryRegistry::Get().SetAdapter(nullptr);
+    m_telemetry.Term();
+    SAFE_RELEASE(m_pDeviceContext1);
     SAFE_RELEASE(m_pDeviceContext);
 
 #ifdef _DEBUG
@@ -317,2023 +764,8680 @@ void Renderer::Term()
 
 bool Renderer::Update()
 {
-    size_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
-    if (m_prevUSec == 0)
+    StallDetector::Get().BeginFrame();
+
+    // Wait until swap chain can accept a new frame, before input and time are sampled
+    if (m_frameLatencyWaitable != nullptr)
     {
-        m_prevUSec = usec; // Initial update
+        CPU_PROFILE_ZONE("WaitForFrame");
+        WaitForSingleObjectEx(m_frameLatencyWaitable, 1000, TRUE);
     }
-
-    double deltaSec = (usec - m_prevUSec) / 1000000.0;
-
-    // Move camera
     {
-        Point3f cf, cr;
-        m_camera.GetDirections(cf, cr);
-        Point3f d = (cf * (float)m_forwardDelta + cr * (float)m_rightDelta) * (float)deltaSec;
-        m_camera.poi = m_camera.poi + d;
+        CPU_PROFILE_ZONE("FramePacer");
+        m_framePacer.WaitForFrame(m_pDeviceContext);
     }
 
-    UpdateCubes(deltaSec);
+    CPU_PROFILE_ZONE("Update");
 
-    // Move light bulb spheres
+    HRESULT result = S_OK;
+
+    // Window size is applied once per frame, and while window is dragged only after size settles
+    if (m_resizePending)
     {
-        for (int i = 0; i < m_sceneBuffer.lightCount.x; i++)
+        size_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (!m_sizeMove || usec - m_resizeUSec >= ResizeSettleMs * 1000)
         {
-            RectGeomBuffer geomBuffer;
-            geomBuffer.m = DirectX::XMMatrixTranslation(m_sceneBuffer.lights[i].pos.x , m_sceneBuffer.lights[i].pos.y, m_sceneBuffer.lights[i].pos.z);
-            geomBuffer.color = m_sceneBuffer.lights[i].color;
-
-            m_pDeviceContext->UpdateSubresource(m_pSmallSphereGeomBuffers[i], 0, nullptr, &geomBuffer, 0, 0);
+            result = ApplyResize();
         }
     }
-
-    m_prevUSec = usec;
-
-    // Setup camera
-    DirectX::XMMATRIX v;
-    Point4f cameraPos;
+    if (SUCCEEDED(result))
     {
-        Point3f pos = m_camera.poi + Point3f{ cosf(m_camera.theta) * cosf(m_camera.phi), sinf(m_camera.theta), cosf(m_camera.theta) * sinf(m_camera.phi) } * m_camera.r;
-        float upTheta = m_camera.theta + (float)M_PI / 2;
-        Point3f up = Point3f{ cosf(upTheta) * cosf(m_camera.phi), sinf(upTheta), cosf(upTheta) * sinf(m_camera.phi) };
-
-        v = DirectX::XMMatrixLookAtLH(
-            DirectX::XMVectorSet(pos.x, pos.y, pos.z, 0.0f),
-            DirectX::XMVectorSet(m_camera.poi.x, m_camera.poi.y, m_camera.poi.z, 0.0f),
-            DirectX::XMVectorSet(up.x, up.y, up.z, 0.0f)
-        );
-
-        cameraPos = pos;
+        result = UpdateSceneTargets();
     }
 
-    float f = 100.0f;
-    float n = 0.1f;
-    float fov = (float)M_PI / 3;
-    float c = 1.0f / tanf(fov / 2);
-    float aspectRatio = (float)m_height / m_width;
-    DirectX::XMMATRIX p = DirectX::XMMatrixPerspectiveLH(tanf(fov / 2) * 2 * f, tanf(fov / 2) * 2 * f * aspectRatio, f, n);
-
-    D3D11_MAPPED_SUBRESOURCE subresource;
-    HRESULT result = m_pDeviceContext->Map(m_pSceneBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
-    assert(SUCCEEDED(result));
-    if (SUCCEEDED(result))
+    if (SUCCEEDED(result) && (m_colorFormat != m_colorBufferFormat || m_depthFormat != m_depthBufferFormat))
     {
-        m_sceneBuffer.vp = DirectX::XMMatrixMultiply(v, p);
-        m_sceneBuffer.cameraPos = cameraPos;
-        CalcFrustum(m_sceneBuffer.frustum);
+        // Targets may be bound
+        m_pDeviceContext->ClearState();
 
-        memcpy(subresource.pData, &m_sceneBuffer, sizeof(SceneBuffer));
-
-        m_pDeviceContext->Unmap(m_pSceneBuffer, 0);
+        result = CreateSceneTargets(m_targetWidth, m_targetHeight);
     }
-
-    // Update culling parameters
-    if (m_updateCullParams)
+    // Sample count is selected in UI
+    if (SUCCEEDED(result) && m_msaaSamples != m_msaaBufferSamples)
     {
-        CullParams cullParams;
-        cullParams.shapeCount = m_instCount;
-        for (UINT i = 0; i < m_instCount; i++)
+        result = CreateMsaaTargets();
+    }
+    if (SUCCEEDED(result) && m_filterQuality != m_samplerFilterQuality)
+    {
+        result = UpdateSamplers();
+    }
+    if (SUCCEEDED(result) && m_precisionCompare == PrecisionCompareReference && (m_diffWidth != m_width || m_diffHeight != m_height))
+    {
+        result = CreateDiffTargets();
+    }
+    if (SUCCEEDED(result) && m_transResolution != TransResolutionFull && !IsMsaaActive()
+        && (m_lowResTransWidth != DivUp(m_targetWidth, 1u << m_transResolution) || m_lowResTransHeight != DivUp(m_targetHeight, 1u << m_transResolution)))
+    {
+        result = CreateLowResTransTargets();
+        if (FAILED(result))
         {
-            cullParams.bbMin[i] = m_geomBBs[i].vmin;
-            cullParams.bbMax[i] = m_geomBBs[i].vmax;
+            m_transResolution = TransResolutionFull;
+            result = S_OK;
         }
-
-        m_pDeviceContext->UpdateSubresource(m_pCullParams, 0, nullptr, &cullParams, 0, 0);
-
-        m_updateCullParams = false;
+    }
+    // Accumulation is of transparent target size
+    if (SUCCEEDED(result) && m_weightedOit
+        && (m_oitWidth != DivUp(m_targetWidth, GetTransScale()) || m_oitHeight != DivUp(m_targetHeight, GetTransScale())
+            || m_oitSamples != (IsMsaaActive() ? m_msaaBufferSamples : 1)))
+    {
+        result = CreateOitTargets();
+    }
+    if (SUCCEEDED(result) && IsTemporalUpscaleActive()
+        && (m_motionWidth != m_targetWidth || m_motionHeight != m_targetHeight || m_historyWidth != m_width || m_historyHeight != m_height))
+    {
+        result = CreateTemporalTargets();
+    }
+    if (!IsTemporalUpscaleActive())
+    {
+        // History of frames rendered without jitter and motion vectors is not reused
+        m_historyValid = false;
     }
 
-    return SUCCEEDED(result);
-}
-
-bool Renderer::Render()
-{
-    m_pDeviceContext->ClearState();
+    UpdateResolutionScale();
 
-    ID3D11RenderTargetView* views[] = { m_pColorBufferRTV };
-    m_pDeviceContext->OMSetRenderTargets(1, views, m_pDepthBufferDSV);
+    // Shaders recompiled and textures loaded in background are swapped before anything of the frame is recorded
+    UINT swapped = m_shaderReloader.Apply();
+    {
+        CPU_PROFILE_ZONE("TextureStreaming");
+        swapped += m_textureStreamer.Update(m_pDeviceContext);
+        UpdateVirtualTextures();
+    }
+    if (swapped > 0)
+    {
+        m_immediateState.Invalidate();
+    }
+    UpdateSkyAmbient();
 
-    static const FLOAT BackColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
-    m_pDeviceContext->ClearRenderTargetView(m_pColorBufferRTV, BackColor);
-    m_pDeviceContext->ClearDepthStencilView(m_pDepthBufferDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
+    size_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (m_prevUSec == 0)
+    {
+        m_prevUSec = usec; // Initial update
+    }
 
-    D3D11_VIEWPORT viewport;
-    viewport.TopLeftX = 0;
-    viewport.TopLeftY = 0;
-    viewport.Width = (FLOAT)m_width;
-    viewport.Height = (FLOAT)m_height;
-    viewport.MinDepth = 0.0f;
-    viewport.MaxDepth = 1.0f;
-    m_pDeviceContext->RSSetViewports(1, &viewport);
+    if (m_abCompare.IsRunning())
+    {
+        UpdateAbCompare();
+    }
+    UpdateFeatureResources();
 
-    D3D11_RECT rect;
-    rect.left = 0;
-    rect.top = 0;
-    rect.right = m_width;
-    rect.bottom = m_height;
-    m_pDeviceContext->RSSetScissorRects(1, &rect);
+    double deltaSec = m_fixedDeltaSec > 0.0 ? m_fixedDeltaSec : (usec - m_prevUSec) / 1000000.0;
+    if (m_precisionCompare == PrecisionCompareHalf)
+    {
+        deltaSec = 0.0; // Compared frame should show the same scene as the reference one
+    }
 
-    m_pDeviceContext->OMSetDepthStencilState(m_pDepthState, 0);
+    // Move camera
+    {
+        Point3f cf, cr;
+        m_camera.GetDirections(cf, cr);
+        Point3f d = (cf * (float)m_forwardDelta + cr * (float)m_rightDelta) * (float)deltaSec;
+        m_camera.poi = m_camera.poi + d;
+    }
 
-    m_pDeviceContext->RSSetState(m_pRasterizerState);
+    // Instances are animated and packed, and culling structures rebuilt on workers while camera is set up
+    JobSystem::TaskHandle cubesTask;
+    {
+        CPU_PROFILE_ZONE("UpdateCubes");
+        cubesTask = UpdateCubes(deltaSec);
+    }
+    JobSystem::TaskHandle cullBuildTask;
+    if (m_updateCullParams)
+    {
+        cullBuildTask = m_jobSystem.Submit([this]() { BuildCullStructures(); });
+    }
 
-    m_pDeviceContext->OMSetBlendState(m_pOpaqueBlendState, nullptr, 0xFFFFFFFF);
+    // Upload lights, visible ones are listed on GPU for clusters and light bulbs
+    m_lightUploads = 0;
+    int lightCount = m_settingsBuffer.lightCount.x;
+    if (lightCount > 0
+        && (lightCount != m_uploadedLightCount || memcmp(m_lights, m_uploadedLights, lightCount * sizeof(Light)) != 0))
+    {
+        memcpy(m_uploadedLights, m_lights, lightCount * sizeof(Light));
+        m_uploadedLightCount = lightCount;
+        ++m_lightUploads;
 
-    CullBoxes();
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        HRESULT result = StallDetector::Get().Map(m_pDeviceContext, m_pLightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource, STALL_SITE);
+        assert(SUCCEEDED(result));
+        if (SUCCEEDED(result))
+        {
+            memcpy(subresource.pData, m_lights, lightCount * sizeof(Light));
 
-    ID3D11SamplerState* samplers[] = {m_pSampler};
-    m_pDeviceContext->PSSetSamplers(0, 1, samplers);
+            m_pDeviceContext->Unmap(m_pLightBuffer, 0);
+        }
+    }
 
-    ID3D11ShaderResourceView* resources[] = {m_pTextureView, m_pTextureViewNM};
-    m_pDeviceContext->PSSetShaderResources(0, 2, resources);
+    m_prevUSec = usec;
 
-    m_pDeviceContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-    ID3D11Buffer* vertexBuffers[] = {m_pVertexBuffer};
-    UINT strides[] = {44};
-    UINT offsets[] = {0};
-    ID3D11Buffer* cbuffers[] = {m_pSceneBuffer, m_pGeomBufferInst, m_pGeomBufferInstVis};
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pVertexShader, nullptr, 0);
-    m_pDeviceContext->VSSetConstantBuffers(0, 3, cbuffers);
-    m_pDeviceContext->PSSetConstantBuffers(0, 3, cbuffers);
-    m_pDeviceContext->PSSetShader(m_pPixelShader, nullptr, 0);
-    if (m_doCull)
+    // Raw mouse motion is taken as late as possible, right before the view is built
+    if (m_rawInput)
     {
-        if (m_computeCull)
-        {
-            m_pDeviceContext->CopyResource(m_pIndirectArgs, m_pIndirectArgsSrc);
-            m_pDeviceContext->Begin(m_queries[m_curFrame % 10]);
-            m_pDeviceContext->DrawIndexedInstancedIndirect(m_pIndirectArgs, 0);
-            m_pDeviceContext->End(m_queries[m_curFrame % 10]);
-            ++m_curFrame;
-        }
-        else
+        CPU_PROFILE_ZONE("RawInput");
+        m_rawMouse.Poll();
+
+        int dx = 0;
+        int dy = 0;
+        m_rawMouse.TakeDelta(dx, dy);
+        if (m_rbPressed)
         {
-            m_pDeviceContext->DrawIndexedInstanced(36, m_visibleInstances, 0, 0, 0);
+            RotateCamera(dx, dy);
         }
     }
+
+    // Setup camera, snapshot of it is shared by everything in the frame
+    {
+        float cosTheta = cosf(m_camera.theta);
+        float sinTheta = sinf(m_camera.theta);
+        float cosPhi = cosf(m_camera.phi);
+        float sinPhi = sinf(m_camera.phi);
+
+        // Up is direction to camera rotated by a quarter turn of theta
+        Point3f toCamera = Point3f{ cosTheta * cosPhi, sinTheta, cosTheta * sinPhi };
+        m_cameraSnapshot.pos = m_camera.poi + toCamera * m_camera.r;
+        m_cameraSnapshot.dir = -toCamera;
+        m_cameraSnapshot.up = Point3f{ -sinTheta * cosPhi, cosTheta, -sinTheta * sinPhi };
+    }
+    const Point3f& pos = m_cameraSnapshot.pos;
+    const Point3f& up = m_cameraSnapshot.up;
+    DirectX::XMMATRIX v = DirectX::XMMatrixLookAtLH(
+        DirectX::XMVectorSet(pos.x, pos.y, pos.z, 0.0f),
+        DirectX::XMVectorSet(m_camera.poi.x, m_camera.poi.y, m_camera.poi.z, 0.0f),
+        DirectX::XMVectorSet(up.x, up.y, up.z, 0.0f)
+    );
+
+    float f = CameraFar;
+    float n = CameraNear;
+    float fov = CameraFov;
+    float c = 1.0f / tanf(fov / 2);
+    float aspectRatio = (float)m_height / m_width;
+    DirectX::XMMATRIX p;
+    if (m_infiniteFar)
+    {
+        // Reversed Z with far plane at infinity, depth is n / z
+        p = DirectX::XMMATRIX(
+            c, 0, 0, 0,
+            0, c / aspectRatio, 0, 0,
+            0, 0, 0, 1,
+            0, 0, n, 0
+        );
+    }
     else
     {
-        m_pDeviceContext->DrawIndexedInstanced(36, m_instCount, 0, 0, 0);
+        p = DirectX::XMMatrixPerspectiveLH(tanf(fov / 2) * 2 * f, tanf(fov / 2) * 2 * f * aspectRatio, f, n);
+    }
+
+    // Light cluster slices are exponential between near and far planes
+    float logDepthRange = logf(f / n);
+    m_settingsBuffer.clusterParams = Point4f{ (float)ClusterGridZ / logDepthRange, -(float)ClusterGridZ * logf(n) / logDepthRange, 0, 0 };
+
+    LightCullParams lightCullParams;
+    lightCullParams.v = v;
+    lightCullParams.projParams = Point4f{ 1.0f / c, aspectRatio / c, 0, 0 };
+    lightCullParams.bulbParams = Point4f{ LightBulbRadius, m_doCull && m_computeCull && m_occlusionCull ? 1.0f : 0.0f, 0, 0 };
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pLightCullParams, 0, nullptr, &lightCullParams, 0, 0, STALL_SITE);
+
+    // Unchanged constants are not rewritten
+    m_sceneCB.ResetStats();
+    m_settingsCB.ResetStats();
+
+    // Planes come from the matrix vertices are transformed with, so CPU and GPU culling test the same frustum
+    m_cameraSnapshot.vp = DirectX::XMMatrixMultiply(v, p);
+    ExtractFrustum(m_cameraSnapshot.vp, m_infiniteFar, m_cameraSnapshot.frustum);
+
+    // Temporal upscaling renders each frame with subpixel offset, culling uses unjittered frustum as the offset is below a pixel
+    DirectX::XMMATRIX vp = m_cameraSnapshot.vp;
+    Point4f motionParams = Point4f{ 0, 0, 0, 0 };
+    if (IsTemporalUpscaleActive())
+    {
+        m_jitterIdx = (m_jitterIdx + 1) % JitterPhases;
+        float jitterX = (Halton(m_jitterIdx + 1, 2) - 0.5f) * 2.0f / GetRenderWidth();
+        float jitterY = (Halton(m_jitterIdx + 1, 3) - 0.5f) * 2.0f / GetRenderHeight();
+        vp = DirectX::XMMatrixMultiply(vp, DirectX::XMMatrixTranslation(jitterX, jitterY, 0.0f));
+        m_jitter[0] = jitterX * GetRenderWidth() / 2.0f;
+        m_jitter[1] = -jitterY * GetRenderHeight() / 2.0f;
+        motionParams = Point4f{ jitterX, jitterY, m_motionDeltaSec, 0 };
+    }
+
+    m_sceneBuffer.vp = vp;
+    m_sceneBuffer.cameraPos = pos;
+    memcpy(m_sceneBuffer.frustum, m_cameraSnapshot.frustum, sizeof(m_sceneBuffer.frustum));
+    m_sceneBuffer.invVp = DirectX::XMMatrixInverse(nullptr, vp);
+    m_sceneBuffer.prevVp = m_prevVp;
+    m_sceneBuffer.motionParams = motionParams;
+    m_sceneCB.Update(m_pDeviceContext, m_sceneBuffer);
+
+    // Static geometry is reprojected from depth with camera motion only
+    m_temporalReproject = DirectX::XMMatrixMultiply(m_sceneBuffer.invVp, m_prevVp);
+    m_prevVp = m_cameraSnapshot.vp;
+
+    UpdateShadowCascades();
+    UpdatePredicates();
+    if (IsLowResTransActive())
+    {
+        LowResTransBuffer lowResTransBuffer;
+        lowResTransBuffer.lowResParams = Point4i{ (int)GetTransScale(), (int)GetRenderWidth(), (int)GetRenderHeight(), 0 };
+        m_lowResTransCB.Update(m_pDeviceContext, lowResTransBuffer);
     }
+    if (m_particles)
+    {
+        UpdateParticleParams(deltaSec);
+    }
+
+    // Format of normal maps is only known once they are streamed in, signed ones are used as is
+    bool signedNormals = m_materials.IsSigned(MaterialTable::TextureSetNormal);
+    m_settingsBuffer.normalDecode = signedNormals ? Point4f{ 1.0f, 0.0f, 0.0f, 0.0f } : Point4f{ 2.0f, -1.0f, 0.0f, 0.0f };
+
+    m_settingsCB.Update(m_pDeviceContext, m_settingsBuffer);
 
-    if (m_showLightBulbs)
     {
-        RenderSmallSpheres();
+        CPU_PROFILE_ZONE("WaitCubes");
+        m_jobSystem.Wait(cubesTask);
     }
+    UploadCubes();
 
-    RenderSphere();
+    // Update culling parameters
+    if (m_updateCullParams)
+    {
+        {
+            CPU_PROFILE_ZONE("WaitCullStructures");
+            m_jobSystem.Wait(cullBuildTask);
+        }
+
+        CullParams cullParams;
+        cullParams.shapeCount = Point4i{ (int)m_instCount, (int)m_bvh.GetClusterCount(), m_orientedBounds ? 1 : 0, 0 };
+        cullParams.lodParams = Point4f{ 1.0f / tanf(CameraFov / 2), LodStartRadius, 0, 0 };
+        cullParams.lodCounts = Point4i{ (int)m_lodCounts[InstanceMeshCube], (int)m_lodCounts[InstanceMeshSphere], (int)m_lodCounts[InstanceMeshImported], 0 };
+
+        StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pShadowCullParams, 0, nullptr, &cullParams, 0, 0, STALL_SITE);
 
-    RenderRects();
+        cullParams.lodParams.z = m_impostors ? ImpostorStartRadius : 0.0f;
+        StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pCullParams, 0, nullptr, &cullParams, 0, 0, STALL_SITE);
 
-    RenderPostProcess();
+        UploadBounds();
 
-    ReadQueries();
+        // Hierarchy is rebuilt as a whole, so its clusters and order are sent whole
+        if (m_instCount > 0 && m_pClusters != nullptr)
+        {
+            std::vector<Bvh::Cluster> clusters = m_bvh.GetClusters();
+            D3D11_BOX box = { 0, 0, 0, (UINT)(sizeof(Bvh::Cluster) * clusters.size()), 1, 1 };
+            StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pClusters, 0, &box, clusters.data(), 0, 0, STALL_SITE);
+
+            box.right = (UINT)(sizeof(UINT) * m_instCount);
+            StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pInstOrder, 0, &box, m_bvh.GetOrder().data(), 0, 0, STALL_SITE);
+        }
+
+        m_updateCullParams = false;
+        m_cullStateValid = false;
+    }
+
+    return SUCCEEDED(result);
+}
 
-    // Start the Dear ImGui frame
-    ImGui_ImplDX11_NewFrame();
-    ImGui_ImplWin32_NewFrame();
-    ImGui::NewFrame();
+bool Renderer::Render()
+{
+    CPU_PROFILE_ZONE("Render");
 
+    if (m_replayCount > 0 && m_commandRecorder.HasCapture())
     {
-        ImGui::Begin("Lights");
+        ReplayCommands();
+    }
+    m_replayCount = 0;
 
-        ImGui::Checkbox("Show bulbs", &m_showLightBulbs);
-        ImGui::Checkbox("Use normal maps", &m_useNormalMaps);
-        ImGui::Checkbox("Show normals", &m_showNormals);
-        ImGui::Checkbox("Use sepia", &m_useSepia);
+    // Whole frame goes through the recorder, so deferred passes and 11.1 constant ranges are off for it
+    if (m_captureCommands)
+    {
+        m_commandRecorder.StartCapture(m_pDeviceContext);
+        m_pDeviceContext = &m_commandRecorder;
+        m_immediateState.SetContext(m_pDeviceContext);
+    }
 
-        m_sceneBuffer.lightCount.y = m_useNormalMaps ? 1 : 0;
-        m_sceneBuffer.lightCount.z = m_showNormals ? 1 : 0;
-        m_sceneBuffer.lightCount.w = m_doCull ? 1 : 0;
+    m_pDeviceContext->ClearState();
 
-        m_sceneBuffer.postProcess.x = m_useSepia ? 1 : 0;
+    m_immediateState.ResetStats();
+    for (UINT i = 0; i < PassCount; i++)
+    {
+        m_deferredStates[i].ResetStats();
+    }
 
-        bool add = ImGui::Button("+");
-        ImGui::SameLine();
-        bool remove = ImGui::Button("-");
+    m_gpuProfiler.BeginFrame(m_pDeviceContext);
 
-        if (add && m_sceneBuffer.lightCount.x < 10)
+    ID3D11RenderTargetView* views[] = { GetSceneRTV() };
+    m_pDeviceContext->OMSetRenderTargets(1, views, GetSceneDSV());
+
+    static const FLOAT BackColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
+    m_pDeviceContext->ClearRenderTargetView(GetSceneRTV(), BackColor);
+    m_pDeviceContext->ClearDepthStencilView(GetSceneDSV(), D3D11_CLEAR_DEPTH, 0.0f, 0);
+    if (IsTemporalUpscaleActive())
+    {
+        static const FLOAT ClearMotion[4] = { NoMotion, NoMotion, 0.0f, 0.0f };
+        m_pDeviceContext->ClearRenderTargetView(m_pMotionBufferRTV, ClearMotion);
+    }
+
+    if (m_debugView == DebugViewOverdraw)
+    {
+        if ((m_overdrawWidth != m_targetWidth || m_overdrawHeight != m_targetHeight) && FAILED(CreateOverdrawTarget()))
         {
-            ++m_sceneBuffer.lightCount.x;
-            m_sceneBuffer.lights[m_sceneBuffer.lightCount.x - 1] = Light();
+            m_debugView = DebugViewNone;
         }
-        if (remove && m_sceneBuffer.lightCount.x > 0)
+        else
         {
-            --m_sceneBuffer.lightCount.x;
+            static const UINT Zero[4] = { 0, 0, 0, 0 };
+            m_pDeviceContext->ClearUnorderedAccessViewUint(m_pOverdrawUAV, Zero);
         }
+    }
 
-        char buffer[1024];
-        for (int i = 0; i < m_sceneBuffer.lightCount.x; i++)
+    {
+        CPU_PROFILE_ZONE("AnimateCubes");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "AnimateCubes");
+        AnimateCubes();
+    }
+    {
+        CPU_PROFILE_ZONE("CullBoxes");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "CullBoxes");
+        CullBoxes();
+    }
+    if (m_doCull && m_computeCull && m_sortInstances && !m_visibilityReused)
+    {
+        CPU_PROFILE_ZONE("SortInstances");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "SortInstances");
+        SortVisibleInstances();
+    }
+    if (m_doCull && m_computeCull && m_instanceTransforms)
+    {
+        // Rebuilt each frame, as camera and animation change transforms of reused visibility too
+        CPU_PROFILE_ZONE("InstanceTransforms");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "InstanceTransforms");
+        BuildInstanceTransforms(TransformSetVisible);
+    }
+    if (!m_weightedOit || m_pOitAccumRTV == nullptr)
+    {
+        CPU_PROFILE_ZONE("SortTransparent");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "SortTransparent");
+        SortTransparent();
+    }
+    if (m_particles && m_pParticles != nullptr)
+    {
+        CPU_PROFILE_ZONE("UpdateParticles");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "UpdateParticles");
+        UpdateParticles();
+    }
+    {
+        CPU_PROFILE_ZONE("CullLights");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "CullLights");
+        CullLights();
+    }
+    if (m_sunShadows)
+    {
+        CPU_PROFILE_ZONE("CullShadowCasters");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "CullShadowCasters");
+        if (IsMultiViewShadowsActive())
+        {
+            CullShadowCastersMultiView();
+        }
+        else
         {
-            ImGui::Text("Light %d", i);
-            sprintf_s(buffer, "Pos %d", i);
-            ImGui::DragFloat3(buffer, (float*)&m_sceneBuffer.lights[i].pos, 0.1f, -10.0f, 10.0f);
-            sprintf_s(buffer, "Color %d", i);
-            ImGui::ColorEdit3(buffer, (float*)&m_sceneBuffer.lights[i].color);
+            CullShadowCasters();
         }
+    }
 
-        ImGui::End();
+    // Compute passes bind resources directly
+    m_immediateState.Invalidate();
 
-        ImGui::Begin("Instances");
-        add = ImGui::Button("+");
-        ImGui::SameLine();
-        remove = ImGui::Button("-");
-        ImGui::Text("Count %d", m_instCount);
-        if (m_computeCull)
+    if (m_sunShadows)
+    {
+        CPU_PROFILE_ZONE("RenderShadows");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "RenderShadows");
+        if (IsMultiViewShadowsActive())
         {
-            ImGui::Text("Visible (GPU) %d", m_gpuVisibleInstances);
+            RenderShadowsMultiView();
         }
         else
         {
-            ImGui::Text("Visible %d", m_visibleInstances);
+            RenderShadows();
         }
-        ImGui::Checkbox("Cull", &m_doCull);
-        ImGui::Checkbox("Cull on GPU", &m_computeCull);
-        ImGui::End();
-        if (add && m_instCount < MaxInst)
+    }
+
+    // Feedback is cleared before cubes pass, which may be recorded on deferred context
+    if (IsVirtualTexturingActive())
+    {
+        m_virtualTextures.BeginFrame(m_pDeviceContext);
+    }
+
+    if (m_useDeferredContexts && !m_commandRecorder.IsRecording())
+    {
+        CPU_PROFILE_ZONE("RecordPasses");
+        RecordPasses();
+    }
+
+    {
+        GpuProfileScope cubesScope(m_gpuProfiler, m_pDeviceContext, "Cubes");
+        SubmitPass(PassCubes);
+        // Late instances and meshlet model belong to cubes pass
+        SetOverdrawCounting(m_immediateState, IsOverdrawCounted(PassCubes), true);
+        if (m_doCull && m_computeCull)
         {
-            Point4f pos = m_geomBuffers[m_instCount].posAngle;
-            if (pos.x == 0 && pos.y == 0 && pos.z == 0)
+            if (m_occlusionCull)
+            {
+                {
+                    GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "BuildHiZ");
+                    BuildHiZ();
+                }
+                {
+                    GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "CullOccluded");
+                    CullOccluded();
+                }
+                {
+                    GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "CullBulbs");
+                    CullBulbs();
+                }
+                if (m_instanceTransforms)
+                {
+                    GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "LateInstanceTransforms");
+                    BuildInstanceTransforms(TransformSetLate);
+                }
+                m_immediateState.Invalidate();
+
+                // Draw instances which were hidden only in previous frame
+                BindFrameState(m_immediateState);
+                BindCubeState(m_immediateState, m_pLateIdsSRV, m_instanceTransforms ? TransformSetLate : TransformSetNone);
+                DrawLateCubes(m_immediateState);
+                DrawImpostors(m_immediateState, m_pLateIdsSRV, m_pLateArgs, GetImpostorPixelShader());
+            }
+
+            // Whole arguments are read back, instance counts are summed on CPU
+            static const UINT ArgsSize = InstanceDrawCount * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS);
+            m_statsReadback.Copy(m_pDeviceContext, m_pIndirectArgs, 0, ArgsSize, 0);
+            if (m_occlusionCull)
             {
-                InitGeom(m_geomBuffers[m_instCount], m_geomBBs[m_instCount]);
+                m_statsReadback.Copy(m_pDeviceContext, m_pLateArgs, 0, ArgsSize, ArgsSize);
             }
-            ++m_instCount;
+            m_statsReadback.EndFrame(m_pDeviceContext);
         }
-        if (remove && m_instCount > 0)
+
+        // Drawn after late instances, so Hi-Z of this frame is complete if occlusion culling has built it
+        if (m_meshletModel && m_meshletCount > 0)
+        {
+            if (m_meshletCull)
+            {
+                GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "CullMeshlets");
+                CullMeshlets();
+                m_immediateState.Invalidate();
+            }
+            GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "RenderMeshletModel");
+            RenderMeshletModel(m_immediateState);
+        }
+        SetOverdrawCounting(m_immediateState, false);
+        if (IsVirtualTexturingActive())
         {
-            --m_instCount;
+            m_virtualTextures.EndFrame(m_pDeviceContext);
         }
-        m_updateCullParams = add || remove;
     }
 
-    // Rendering
-    ImGui::Render();
-    ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+    if (m_pickMode)
+    {
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "PickInstance");
+        PickInstance();
+        m_immediateState.Invalidate();
+    }
 
-    HRESULT result = m_pSwapChain->Present(0, 0);
-    assert(SUCCEEDED(result));
+    if (m_deferredShading)
+    {
+        CPU_PROFILE_ZONE("ResolveLighting");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "ResolveLighting");
+        ResolveLighting();
+        m_immediateState.Invalidate();
+    }
 
-    return SUCCEEDED(result);
-}
+    {
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "RenderSmallSpheres");
+        SubmitPass(PassSmallSpheres);
+    }
 
-bool Renderer::Resize(UINT width, UINT height)
-{
-    if (width != m_width || height != m_height)
     {
-        SAFE_RELEASE(m_pBackBufferRTV);
-        SAFE_RELEASE(m_pDepthBuffer);
-        SAFE_RELEASE(m_pDepthBufferDSV);
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "RenderSphere");
+        SubmitPass(PassSphere);
+    }
 
-        HRESULT result = m_pSwapChain->ResizeBuffers(2, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            m_width = width;
-            m_height = height;
+    {
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "RenderRects");
+        SubmitPass(PassRects);
+    }
+
+    if (m_debugView != DebugViewNone)
+    {
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "DebugView");
+        RenderDebugView(m_immediateState);
+    }
 
-            result = SetupBackBuffer();
+    if (IsMsaaActive())
+    {
+        CPU_PROFILE_ZONE("ResolveMSAA");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "ResolveMSAA");
+        ResolveMsaa();
+        m_immediateState.Invalidate();
+    }
 
-            // Setup skybox sphere
-            float n = 0.1f;
-            float fov = (float)M_PI / 3;
-            float halfW = tanf(fov / 2) * n;
-            float halfH = (float)m_height / m_width * halfW;
+    if (IsPostProcessActive())
+    {
+        CPU_PROFILE_ZONE("PostProcess");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "PostProcess");
+
+        // Color buffer is read from compute shaders
+        m_pDeviceContext->OMSetRenderTargets(0, nullptr, nullptr);
+
+        m_renderGraph.Reset();
+        RenderGraph::Handle colorBuffer = m_renderGraph.ImportTexture("ColorBuffer", m_pColorBufferSRV, m_pColorBufferUAV);
+        RenderGraph::Handle backBuffer = m_renderGraph.ImportTexture("BackBuffer", nullptr, m_pBackBufferUAV);
+        PostProcess::Settings postSettings = m_postSettings;
+        postSettings.halfPrecision = IsHalfPrecisionActive();
+        PostProcess::TemporalInputs temporal;
+        if (IsTemporalUpscaleActive())
+        {
+            temporal.depth = m_renderGraph.ImportTexture("DepthBuffer", m_pDepthBufferSRV, nullptr);
+            temporal.motion = m_renderGraph.ImportTexture("MotionBuffer", m_pMotionBufferSRV, nullptr);
+            temporal.history = m_renderGraph.ImportTexture("History", m_pHistorySRV[m_historyIdx], nullptr);
+            temporal.output = m_renderGraph.ImportTexture("TemporalOutput", m_pHistorySRV[1 - m_historyIdx], m_pHistoryUAV[1 - m_historyIdx]);
+            DirectX::XMStoreFloat4x4(&temporal.reproject, m_temporalReproject);
+            temporal.jitter[0] = m_jitter[0];
+            temporal.jitter[1] = m_jitter[1];
+            temporal.historyValid = m_historyValid;
+            // Output is the history of the next frame
+            m_renderGraph.MarkOutput(temporal.output);
+        }
+        m_postProcess.AddPasses(m_renderGraph, postSettings, m_width, m_height, m_targetWidth, m_targetHeight, GetRenderWidth(), GetRenderHeight(), colorBuffer, backBuffer,
+            IsTemporalUpscaleActive() ? &temporal : nullptr);
+        m_renderGraph.MarkOutput(backBuffer);
 
-            float r = sqrtf(n*n + halfH*halfH + halfW*halfW) * 1.1f * 2.0f;
+        HRESULT result = m_renderGraph.Execute(m_pDevice, m_pDeviceContext, m_gpuProfiler);
+        assert(SUCCEEDED(result));
+        m_immediateState.Invalidate();
 
-            SphereGeomBuffer geomBuffer;
-            geomBuffer.m = DirectX::XMMatrixIdentity();
-            geomBuffer.size = r;
-            m_pDeviceContext->UpdateSubresource(m_pSphereGeomBuffer, 0, nullptr, &geomBuffer, 0, 0);
+        if (IsTemporalUpscaleActive())
+        {
+            m_historyIdx = 1 - m_historyIdx;
+            m_historyValid = true;
         }
+    }
 
-        return SUCCEEDED(result);
+    if (m_precisionCompare != PrecisionCompareIdle)
+    {
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "ComparePrecision");
+        ComparePrecision();
+        m_immediateState.Invalidate();
     }
 
-    return true;
-}
+    if (m_captureEveryFrame && m_captureName.empty())
+    {
+        char name[32];
+        sprintf_s(name, "frame_%06u", m_captureIndex++);
+        m_captureName = name;
+    }
+    if (!m_captureName.empty())
+    {
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "CaptureFrame");
+        CaptureFrame();
+    }
+    m_frameCapture.Update(m_pDeviceContext);
 
-void Renderer::MouseRBPressed(bool pressed, int x, int y)
-{
-    m_rbPressed = pressed;
-    if (m_rbPressed)
+    if (m_videoRecorder.IsRecording() && !m_recordOverlay)
     {
-        m_prevMouseX = x;
-        m_prevMouseY = y;
+        RecordFrame();
     }
-}
 
-void Renderer::MouseMoved(int x, int y)
-{
-    if (m_rbPressed)
+    m_stateCallsIssued = m_immediateState.GetIssuedCount();
+    m_stateCallsSkipped = m_immediateState.GetSkippedCount();
+    for (UINT i = 0; i < PassCount; i++)
     {
-        float dx = -(float)(x - m_prevMouseX) / m_width * CameraRotationSpeed;
-        float dy = (float)(y - m_prevMouseY) / m_width * CameraRotationSpeed;
+        m_stateCallsIssued += m_deferredStates[i].GetIssuedCount();
+        m_stateCallsSkipped += m_deferredStates[i].GetSkippedCount();
+    }
 
-        m_camera.phi += dx;
-        m_camera.theta += dy;
-        m_camera.theta = std::min(std::max(m_camera.theta, -(float)M_PI / 2), (float)M_PI / 2);
+    // UI and presentation are not part of the capture
+    if (m_commandRecorder.IsRecording())
+    {
+        m_pDeviceContext = m_commandRecorder.GetContext();
+        m_immediateState.SetContext(m_pDeviceContext);
+        m_commandRecorder.StopCapture();
+        m_commandRecorder.Save(L"commands.bin");
+        m_captureCommands = false;
+    }
 
-        m_prevMouseX = x;
-        m_prevMouseY = y;
+    ReadGpuStats();
+    PublishTelemetry();
+    if (m_abCompare.AddFrame(m_gpuProfiler.GetLastFrameMs()))
+    {
+        EndAbCompare();
     }
-}
 
-void Renderer::MouseWheel(int delta)
-{
-    m_camera.r -= delta / 100.0f;
-    if (m_camera.r < 1.0f)
+    if (m_showUI && IsUIRebuildNeeded())
     {
-        m_camera.r = 1.0f;
+        BuildUI();
     }
-}
 
-void Renderer::KeyPressed(int keyCode)
-{
-    switch (keyCode)
+    if (m_showUI && ImGui::GetDrawData() != nullptr)
     {
-        case ' ':
-            m_rotateModel = !m_rotateModel;
-            break;
+        // Command list execution leaves immediate context without state
+        ID3D11RenderTargetView* backBufferViews[] = { m_pBackBufferRTV };
+        m_pDeviceContext->OMSetRenderTargets(1, backBufferViews, nullptr);
 
-        case 'W':
-        case 'w':
-            m_forwardDelta += PanSpeed;
-            break;
+        CPU_PROFILE_ZONE("ImGui::RenderDrawData");
+        GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "ImGui");
+        ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+    }
 
-        case 'S':
-        case 's':
+    if (m_videoRecorder.IsRecording() && m_recordOverlay)
+    {
+        RecordFrame();
+    }
+
+    m_gpuProfiler.EndFrame(m_pDeviceContext);
+
+    HRESULT result = S_OK;
+    {
+        CPU_PROFILE_ZONE("Present");
+        // Tearing is only allowed for unsynchronized presentation in windowed mode
+        result = StallDetector::Get().Present(m_pSwapChain, m_vsync ? 1 : 0, !m_vsync && m_allowTearing ? DXGI_PRESENT_ALLOW_TEARING : 0, STALL_SITE);
+    }
+    m_framePacer.EndFrame(m_pDeviceContext);
+    assert(SUCCEEDED(result));
+
+    // Jobs of the frame are all waited for, so transient allocations of every thread are dropped
+    FrameArena::ResetAll();
+
+    if (m_pendingFrames > 0)
+    {
+        --m_pendingFrames;
+    }
+
+    return SUCCEEDED(result);
+}
+
+bool Renderer::IsFrameNeeded()
+{
+    if (!m_renderOnDemand || m_pendingFrames > 0)
+    {
+        return true;
+    }
+
+    // Continuous changes, input with a held key or button is one too
+    bool animated = m_rotateModel || m_particles || m_forwardDelta != 0.0 || m_rightDelta != 0.0 || m_rbPressed;
+    // Work which completes over several frames
+    bool inProgress = m_resizePending || m_abCompare.IsRunning() || m_replayCount > 0 || m_captureCommands
+        || m_videoRecorder.IsRecording() || m_captureEveryFrame || !m_captureName.empty() || m_precisionCompare != PrecisionCompareIdle;
+    // Textures still streaming in, or shaders recompiled in background
+    bool loaded = m_textureStreamer.GetPendingCount() > 0 || m_virtualTextures.GetPendingCount() > 0 || m_shaderReloader.HasReloaded();
+
+    if (animated || inProgress || loaded)
+    {
+        // Last change reaches readbacks and UI a few frames later
+        m_pendingFrames = SettleFrames;
+        return true;
+    }
+    return false;
+}
+
+bool Renderer::IsUIRebuildNeeded()
+{
+    size_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    // Input is queued until NewFrame, so queued events mean UI should react right away
+    // Frames on demand are few, and UI should show the state they were rendered for
+    if (m_uiDirty || m_uiRefreshRate == 0 || m_renderOnDemand || !ImGui::GetCurrentContext()->InputEventsQueue.empty()
+        || usec - m_uiBuildUSec >= 1000000 / m_uiRefreshRate)
+    {
+        m_uiBuildUSec = usec;
+        m_uiDirty = false;
+        return true;
+    }
+    return false;
+}
+
+void Renderer::BuildUI()
+{
+    {
+        CPU_PROFILE_ZONE("ImGui::NewFrame");
+        ImGui_ImplDX11_NewFrame();
+        ImGui_ImplWin32_NewFrame();
+        ImGui::NewFrame();
+    }
+
+    {
+        CPU_PROFILE_ZONE("ImGui UI");
+
+        ImGui::Begin("Lights");
+
+        ImGui::Checkbox("Show bulbs", &m_showLightBulbs);
+        if (m_showLightBulbs)
+        {
+            ImGui::SameLine();
+            ImGui::Checkbox("Bulb impostors", &m_bulbImpostors);
+        }
+        ImGui::Checkbox("Use normal maps", &m_useNormalMaps);
+        if (m_virtualTexturesSupported)
+        {
+            ImGui::Checkbox("Virtual textures", &m_virtualTexturing);
+        }
+        ImGui::Checkbox("Show normals", &m_showNormals);
+        ImGui::Combo("Debug view", &m_debugView, "None\0Overdraw\0Light count\0");
+        if (m_debugView == DebugViewOverdraw)
+        {
+            ImGui::Combo("Overdraw of", &m_overdrawPass, "Cubes\0Small spheres\0Sphere\0Rects\0All passes\0");
+        }
+        ImGui::Checkbox("Half precision shading", &m_halfPrecision);
+        ImGui::SameLine();
+        ImGui::Text(m_nativeHalfPrecision ? "(native)" : "(emulated)");
+        if (ImGui::Button("Compare with FP32") && m_precisionCompare == PrecisionCompareIdle)
+        {
+            m_precisionCompare = PrecisionCompareReference;
+            m_diffValid = false;
+        }
+        if (m_diffValid)
+        {
+            ImGui::Text("Max diff %u/255, mean %.3f, %u pixels over %u/255", m_diffMax, m_diffMean, m_diffPixels, PrecisionDiffThreshold);
+        }
+
+        bool add = ImGui::Button("+");
+        ImGui::SameLine();
+        bool remove = ImGui::Button("-");
+        ImGui::SameLine();
+        bool addManyLights = ImGui::Button("+100 random");
+        ImGui::SameLine();
+        bool removeManyLights = ImGui::Button("-100");
+
+        if (add && m_settingsBuffer.lightCount.x < (int)MaxLights)
+        {
+            ++m_settingsBuffer.lightCount.x;
+            m_lights[m_settingsBuffer.lightCount.x - 1] = Light();
+        }
+        if (remove && m_settingsBuffer.lightCount.x > 0)
+        {
+            --m_settingsBuffer.lightCount.x;
+        }
+        if (addManyLights)
+        {
+            AddRandomLights(100);
+        }
+        if (removeManyLights)
+        {
+            m_settingsBuffer.lightCount.x = m_settingsBuffer.lightCount.x > 100 ? m_settingsBuffer.lightCount.x - 100 : 0;
+        }
+        ImGui::Text("Count %d", m_settingsBuffer.lightCount.x);
+
+        // Widget ids are made unique by light index on id stack, so labels need no formatting
+        ImGuiListClipper clipper;
+        clipper.Begin(m_settingsBuffer.lightCount.x);
+        while (clipper.Step())
+        {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+            {
+                ImGui::PushID(i);
+                ImGui::Text("Light %d", i);
+                ImGui::DragFloat3("Pos", (float*)&m_lights[i].pos, 0.1f, -10.0f, 10.0f);
+                ImGui::DragFloat("Radius", &m_lights[i].pos.w, 0.1f, 0.1f, 20.0f);
+                ImGui::ColorEdit3("Color", (float*)&m_lights[i].color);
+                ImGui::PopID();
+            }
+        }
+
+        ImGui::End();
+
+        ImGui::Begin("Instances");
+        add = ImGui::Button("+");
+        ImGui::SameLine();
+        remove = ImGui::Button("-");
+        ImGui::SameLine();
+        bool addMany = ImGui::Button("+1000");
+        ImGui::SameLine();
+        bool removeMany = ImGui::Button("-1000");
+        ImGui::SameLine();
+        bool removeRandom = ImGui::Button("Remove random");
+        ImGui::Text("Count %d", m_instCount);
+        ImGui::Checkbox("Pick under cursor", &m_pickMode);
+        bool removePicked = false;
+        if (m_pickMode)
+        {
+            // Index is from a frame or two ago, instances removed since then may have moved another one into it
+            if (m_pickedIdx < m_instCount)
+            {
+                ImGui::Text("Picked %u", m_pickedIdx);
+                ImGui::SameLine();
+                removePicked = ImGui::Button("Remove picked");
+            }
+            else
+            {
+                ImGui::Text("Picked none");
+            }
+        }
+        if (m_computeCull)
+        {
+            ImGui::Text("Visible (GPU) %d", m_gpuVisibleInstances);
+        }
+        else
+        {
+            ImGui::Text("Visible %d", m_visibleInstances);
+        }
+        ImGui::Checkbox("Scatter uploads", &m_scatterUploads);
+        if (m_scatterUploads)
+        {
+            ImGui::Text("Upload %u KB, %u records, %u dispatches", (m_geomScatter.GetUploadedBytes() + m_boundsScatter.GetUploadedBytes()) / 1024,
+                m_geomScatter.GetRecordCount() + m_boundsScatter.GetRecordCount(), m_geomScatter.GetDispatchCount() + m_boundsScatter.GetDispatchCount());
+        }
+        else
+        {
+            ImGui::Text("Upload %u KB, %u copies", m_geomUploadRing.GetUploadedBytes() / 1024, m_geomUploadRing.GetCopyCount());
+        }
+        if (!m_meshStatus.empty())
+        {
+            ImGui::Text("%s", m_meshStatus.c_str());
+        }
+        if (m_meshletCount > 0)
+        {
+            ImGui::Checkbox("Meshlet model", &m_meshletModel);
+            ImGui::SameLine();
+            ImGui::Checkbox("Cull meshlets", &m_meshletCull);
+            ImGui::SameLine();
+            ImGui::Checkbox("Cone", &m_meshletConeCull);
+            const GeometryPool::Mesh& mesh = m_geometryPool.GetMesh(m_instanceMeshes[InstanceMeshImported * MaxLods]);
+            ImGui::Text("%u meshlets, %u of %u triangles drawn", m_meshletCount, m_meshletCull ? m_meshletTriangles : mesh.indexCount / 3, mesh.indexCount / 3);
+        }
+        bool saveScene = ImGui::Button("Save scene");
+        ImGui::SameLine();
+        bool loadScene = ImGui::Button("Load scene");
+        if (!m_sceneFileStatus.empty())
+        {
+            ImGui::Text("%s in %.2f ms", m_sceneFileStatus.c_str(), m_sceneFileMs);
+        }
+        if (ImGui::CollapsingHeader("Vertex cache"))
+        {
+            for (UINT i = 0; i < InstanceDrawCount; i++)
+            {
+                if (i % MaxLods < m_lodCounts[i / MaxLods])
+                {
+                    const GeometryPool::Mesh& mesh = m_geometryPool.GetMesh(m_instanceMeshes[i]);
+                    ImGui::Text("%s LOD %u: ACMR %.2f -> %.2f, ATVR %.2f -> %.2f", InstanceMeshNames[i / MaxLods], i % MaxLods,
+                        mesh.sourceStats.acmr, mesh.stats.acmr, mesh.sourceStats.atvr, mesh.stats.atvr);
+                }
+            }
+        }
+        ImGui::Checkbox("Cull", &m_doCull);
+        ImGui::Checkbox("Cull on GPU", &m_computeCull);
+        ImGui::Checkbox("Hierarchical", &m_hierarchicalCull);
+        if (m_computeCull)
+        {
+            ImGui::Checkbox("Occlusion (Hi-Z)", &m_occlusionCull);
+            ImGui::Checkbox("Precomputed instance transforms", &m_instanceTransforms);
+            if (ImGui::Checkbox("Group compaction", &m_groupAppend))
+            {
+                // Averages should only cover frames of the current mode
+                m_gpuProfiler.ResetHistory();
+            }
+            ImGui::Text("Cull GPU %.3f ms, with group compaction %.3f ms", m_cullGpuMs[0], m_cullGpuMs[1]);
+        }
+        if (!m_computeCull && !m_hierarchicalCull)
+        {
+            ImGui::Checkbox("SIMD", &m_simdCull);
+            ImGui::SameLine();
+            ImGui::Checkbox("Parallel", &m_parallelCull);
+        }
+        if (ImGui::Checkbox("Oriented bounds", &m_orientedBounds))
+        {
+            m_updateCullParams = true;
+        }
+        // Impostor start radius is a LOD parameter of culling
+        if (ImGui::Checkbox("Impostors for distant instances", &m_impostors))
+        {
+            m_updateCullParams = true;
+        }
+        ImGui::Checkbox("Front to back sort", &m_sortInstances);
+        ImGui::Checkbox("Reuse visibility of still view", &m_reuseVisibility);
+        if (m_visibilityReused)
+        {
+            ImGui::SameLine();
+            ImGui::Text("(reused)");
+        }
+        ImGui::Checkbox("Animate on GPU", &m_computeAnimation);
+        ImGui::SliderInt("Simulation Hz", &m_simulationHz, 0, 240);
+        if (m_simulationHz > 0)
+        {
+            ImGui::SameLine();
+            ImGui::Text("%u ticks", m_simulationTicks);
+        }
+        ImGui::Checkbox("VSync", &m_vsync);
+        if (m_rawInput)
+        {
+            ImGui::SameLine();
+            ImGui::Text("Raw mouse input");
+        }
+        ImGui::Checkbox("Infinite far plane", &m_infiniteFar);
+        int filterQuality = (int)m_filterQuality;
+        if (ImGui::Combo("Texture filtering", &filterQuality, "Low\0Medium\0High\0"))
+        {
+            m_filterQuality = (FilterQuality)filterQuality;
+        }
+        ImGui::SameLine();
+        ImGui::Text("%u samplers, %u states", m_samplerCache.GetCount(), m_stateObjects.GetCount());
+        static const char* MsaaNames[] = { "Off", "2x", "4x", "8x" };
+        UINT msaaIdx = 0;
+        while ((1u << msaaIdx) < m_msaaSamples)
+        {
+            ++msaaIdx;
+        }
+        if (ImGui::BeginCombo("MSAA", MsaaNames[msaaIdx]))
+        {
+            for (UINT i = 0; i < _countof(MsaaNames); i++)
+            {
+                if ((m_msaaSupportMask & (1u << i)) != 0 && ImGui::Selectable(MsaaNames[i], i == msaaIdx))
+                {
+                    m_msaaSamples = 1u << i;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (m_msaaSamples > 1 && m_deferredShading)
+        {
+            ImGui::Text("MSAA is not used with deferred shading");
+        }
+        if (ImGui::BeginCombo("Color format", ColorFormatNames[m_colorFormat]))
+        {
+            for (UINT i = 0; i < ColorFormatCount; i++)
+            {
+                if ((m_colorFormatSupportMask & (1u << i)) != 0 && ImGui::Selectable(ColorFormatNames[i], i == (UINT)m_colorFormat))
+                {
+                    m_colorFormat = (ColorFormat)i;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (ImGui::BeginCombo("Depth format", DepthFormatNames[m_depthFormat]))
+        {
+            for (UINT i = 0; i < DepthFormatCount; i++)
+            {
+                if ((m_depthFormatSupportMask & (1u << i)) != 0 && ImGui::Selectable(DepthFormatNames[i], i == (UINT)m_depthFormat))
+                {
+                    m_depthFormat = (DepthFormat)i;
+                }
+            }
+            ImGui::EndCombo();
+        }
+        if (m_depthFormat != DepthFormatD32)
+        {
+            ImGui::Text("Reversed depth gains nothing with fixed point, far surfaces may z-fight");
+        }
+        ImGui::Checkbox("Dynamic resolution", &m_dynamicResolution);
+        if (m_dynamicResolution)
+        {
+            ImGui::SliderFloat("Target GPU ms", &m_targetGpuMs, 4.0f, 33.0f);
+            ImGui::Text("Render %ux%u (%.0f%%), GPU %.2f ms", GetRenderWidth(), GetRenderHeight(), m_resolutionScale * 100.0f, m_gpuProfiler.GetLastFrameMs());
+        }
+        ImGui::Checkbox("Temporal upscaling", &m_temporalUpscale);
+        if (m_temporalUpscale && IsMsaaActive())
+        {
+            ImGui::Text("Not used with MSAA");
+        }
+        ImGui::Checkbox("Fixed internal resolution", &m_fixedResolution);
+        if (m_fixedResolution)
+        {
+            static const UINT InternalSizes[][2] = { { 960, 540 }, { 1280, 720 }, { 1600, 900 }, { 1920, 1080 } };
+            char name[32];
+            sprintf_s(name, "%ux%u", m_internalWidth, m_internalHeight);
+            if (ImGui::BeginCombo("Internal resolution", name))
+            {
+                for (UINT i = 0; i < _countof(InternalSizes); i++)
+                {
+                    sprintf_s(name, "%ux%u", InternalSizes[i][0], InternalSizes[i][1]);
+                    if (ImGui::Selectable(name, InternalSizes[i][0] == m_internalWidth && InternalSizes[i][1] == m_internalHeight))
+                    {
+                        m_internalWidth = InternalSizes[i][0];
+                        m_internalHeight = InternalSizes[i][1];
+                    }
+                }
+                ImGui::EndCombo();
+            }
+        }
+        ImGui::Text("Back buffer %ux%u, scene targets %ux%u", m_width, m_height, m_targetWidth, m_targetHeight);
+        ImGui::Text("Swap chain resizes %u, target allocations %u", m_swapChainResizes, m_targetReallocs);
+        ImGui::Text("Post processing");
+        ImGui::Checkbox("Bloom", &m_postSettings.bloom);
+        if (m_postSettings.bloom)
+        {
+            ImGui::SliderFloat("Bloom threshold", &m_postSettings.bloomThreshold, 0.0f, 1.0f);
+            ImGui::SliderFloat("Bloom intensity", &m_postSettings.bloomIntensity, 0.0f, 2.0f);
+        }
+        ImGui::Checkbox("Tone mapping", &m_postSettings.toneMapping);
+        if (m_postSettings.toneMapping)
+        {
+            ImGui::SliderFloat("Exposure", &m_postSettings.exposure, 0.1f, 4.0f);
+        }
+        ImGui::Checkbox("Color grading", &m_postSettings.colorGrading);
+        ImGui::Checkbox("Sepia", &m_postSettings.sepia);
+        ImGui::Checkbox("FXAA", &m_postSettings.fxaa);
+        const RenderGraph::Stats& graphStats = m_renderGraph.GetStats();
+        ImGui::Text("Render graph passes %u, culled %u, unbinds %u", graphStats.passes, graphStats.culledPasses, graphStats.unbinds);
+        ImGui::Text("Transients %u in %u textures (%.1f MB)", graphStats.transients, graphStats.pooledTextures, graphStats.pooledBytes / (1024.0 * 1024.0));
+        ImGui::Checkbox("Deferred contexts", &m_useDeferredContexts);
+        ImGui::Checkbox("Deferred shading", &m_deferredShading);
+        ImGui::Checkbox("Weighted blended OIT", &m_weightedOit);
+        ImGui::Combo("Transparent resolution", &m_transResolution, "Full\0Half\0Quarter\0");
+        ImGui::Checkbox("Occlusion predicates", &m_occlusionPredicates);
+        ImGui::Checkbox("GPU particles", &m_particles);
+        if (m_particles)
+        {
+            ImGui::SliderInt("Particle count", &m_particleCount, 1024, (int)MaxParticles);
+            ImGui::SliderFloat("Particle lifetime", &m_particleLifetime, 0.5f, 10.0f);
+            ImGui::DragFloat3("Particle emitter", &m_particleEmitter.x, 0.05f);
+            ImGui::Checkbox("Sort particles", &m_sortParticles);
+        }
+        ImGui::Checkbox("Sky as screen triangle", &m_skyTriangle);
+        if (ImGui::Checkbox("Sky ambient", &m_skyAmbient))
+        {
+            m_updateSkyAmbient = true;
+        }
+        if (m_skyAmbient && ImGui::SliderFloat("Sky ambient intensity", &m_skyAmbientIntensity, 0.0f, 2.0f))
+        {
+            m_updateSkyAmbient = true;
+        }
+        ImGui::Checkbox("Sun shadows", &m_sunShadows);
+        if (m_sunShadows)
+        {
+            ImGui::SliderFloat("Shadow distance", &m_shadowDistance, 5.0f, 100.0f);
+            if (m_multiViewSupported)
+            {
+                ImGui::Checkbox("Single pass cascades", &m_multiViewShadows);
+            }
+            else
+            {
+                ImGui::Text("Single pass cascades are not supported");
+            }
+        }
+        if (ImGui::Checkbox("Depth pre-pass", &m_depthPrePass))
+        {
+            // Averages should only cover frames of the current mode
+            m_gpuProfiler.ResetHistory();
+        }
+        for (const GpuProfiler::PassTime& passTime : m_gpuProfiler.GetAverageTimes())
+        {
+            if (strcmp(passTime.name, "Cubes") == 0)
+            {
+                m_cubesGpuMs[m_depthPrePass ? 1 : 0] = passTime.avgMs;
+            }
+            if (strcmp(passTime.name, "CullBoxes") == 0)
+            {
+                m_cullGpuMs[m_groupAppend ? 1 : 0] = passTime.avgMs;
+            }
+        }
+        ImGui::Text("Cubes GPU %.3f ms, with pre-pass %.3f ms", m_cubesGpuMs[0], m_cubesGpuMs[1]);
+        ImGui::Text("Adapter %s", m_adapterName.c_str());
+        ImGui::Text("Feature level %s, constant offsets %s", m_featureLevel >= D3D_FEATURE_LEVEL_11_1 ? "11.1" : "11.0", m_constantOffsets ? "on" : "off");
+        if (m_constantOffsets)
+        {
+            ImGui::Text("Constant ring written %u bytes, discards %u", m_constantRing.GetWrittenBytes(), m_constantRing.GetDiscardCount());
+        }
+        ImGui::Text("State calls %u, skipped %u", m_stateCallsIssued, m_stateCallsSkipped);
+        const FrameArena::Stats& arenaStats = FrameArena::GetStats();
+        ImGui::Text("Frame arena allocations %u, %.1f KB, heap blocks %u, threads %u", arenaStats.allocations, arenaStats.bytes / 1024.0,
+            arenaStats.heapBlocks, arenaStats.arenas);
+        ImGui::Text("Constants written %u, skipped %u, lights uploaded %u", m_sceneCB.GetWriteCount() + m_settingsCB.GetWriteCount(),
+            m_sceneCB.GetSkipCount() + m_settingsCB.GetSkipCount(), m_lightUploads);
+        ImGui::Text("Shaders cached %u, compiled %u, reloaded %u", m_shaderCache.GetHitCount(), m_shaderCache.GetMissCount(), m_shaderReloader.GetReloadCount());
+        ImGui::Text("Textures streaming %u", m_textureStreamer.GetPendingCount());
+        if (IsVirtualTexturingActive())
+        {
+            VirtualTextures::Stats stats = m_virtualTextures.GetStats();
+            ImGui::Text("Virtual tiles %u/%u (%.1f MB) + %u packed, pending %u, mapped %llu, evicted %llu", stats.residentTiles, stats.poolTiles,
+                stats.residentTiles * (double)VirtualTextures::TileBytes / (1024.0 * 1024.0), stats.packedTiles, stats.pendingTiles, stats.mappedTiles, stats.evictedTiles);
+        }
+        if (ImGui::CollapsingHeader("Capture"))
+        {
+            if (ImGui::Button("Capture frame"))
+            {
+                char name[32];
+                sprintf_s(name, "frame_%06u", m_captureIndex++);
+                RequestCapture(name);
+            }
+            ImGui::SameLine();
+            ImGui::Checkbox("Every frame", &m_captureEveryFrame);
+            int captureSource = (int)m_captureSource;
+            if (ImGui::Combo("Source", &captureSource, "Back buffer\0Color buffer\0"))
+            {
+                m_captureSource = (CaptureSource)captureSource;
+            }
+            int captureFormat = (int)m_frameCapture.GetFileFormat();
+            if (ImGui::Combo("File format", &captureFormat, "PNG\0Raw\0"))
+            {
+                m_frameCapture.SetFileFormat((FrameCapture::FileFormat)captureFormat);
+            }
+            FrameCapture::Stats captureStats = m_frameCapture.GetStats();
+            ImGui::Text("Captured %llu, written %llu, dropped %llu, failed %llu", captureStats.captured, captureStats.written, captureStats.dropped, captureStats.failed);
+        }
+        if (ImGui::CollapsingHeader("Recording"))
+        {
+            bool recording = m_videoRecorder.IsRecording();
+            int recordCodec = (int)m_recordCodec;
+            if (ImGui::Combo("Codec", &recordCodec, "H.264\0HEVC\0") && !recording)
+            {
+                m_recordCodec = (VideoRecorder::Codec)recordCodec;
+            }
+            ImGui::Checkbox("Burn in UI", &m_recordOverlay);
+            if (ImGui::Button(recording ? "Stop recording" : "Start recording"))
+            {
+                if (recording)
+                {
+                    m_videoRecorder.Stop();
+                }
+                else
+                {
+                    wchar_t path[32];
+                    swprintf_s(path, L"recording_%03u.mp4", m_recordIndex++);
+                    // Encoders need even frame size
+                    m_videoRecorder.Start(path, m_width & ~1u, m_height & ~1u, m_recordCodec, RecordFps, RecordBitrate);
+                }
+            }
+            VideoRecorder::Stats recordStats = m_videoRecorder.GetStats();
+            ImGui::Text("Recorded %llu frames, dropped %llu", recordStats.frames, recordStats.dropped);
+        }
+        if (ImGui::CollapsingHeader("A/B comparison"))
+        {
+            bool running = m_abCompare.IsRunning();
+            for (UINT config = 0; config < 2; config++)
+            {
+                ImGui::PushID(config);
+                ImGui::Text(config == 0 ? "A:" : "B:");
+                for (UINT i = 0; i < AbCompare::ToggleCount; i++)
+                {
+                    ImGui::SameLine();
+                    bool enabled = (m_abSettings.toggles[config] & (1u << i)) != 0;
+                    if (ImGui::Checkbox(AbCompare::GetToggleName(i), &enabled) && !running)
+                    {
+                        m_abSettings.toggles[config] ^= 1u << i;
+                    }
+                }
+                ImGui::PopID();
+            }
+            int blockFrames = (int)m_abSettings.blockFrames;
+            if (ImGui::SliderInt("Frames per block", &blockFrames, 10, 600) && !running)
+            {
+                m_abSettings.blockFrames = (UINT)blockFrames;
+            }
+            int pairs = (int)m_abSettings.pairs;
+            if (ImGui::SliderInt("Block pairs", &pairs, 2, 40) && !running)
+            {
+                m_abSettings.pairs = (UINT)pairs;
+            }
+            if (ImGui::Button(running ? "Stop##ab" : "Start##ab"))
+            {
+                if (running)
+                {
+                    EndAbCompare();
+                }
+                else
+                {
+                    StartAbCompare();
+                }
+            }
+            ImGui::SameLine();
+            ImGui::ProgressBar(m_abCompare.GetProgress());
+            if (m_abCompare.HasResult())
+            {
+                const AbCompare::Result& result = m_abCompare.GetResult();
+                const AbCompare::Delta* deltas[] = { &result.cpu, &result.gpu };
+                for (UINT i = 0; i < 2; i++)
+                {
+                    const AbCompare::Delta& delta = *deltas[i];
+                    // Interval not covering zero means the difference is unlikely to be noise
+                    bool significant = fabsf(delta.deltaMs) > delta.ciMs;
+                    ImGui::Text("%s A %.3f ms, B %.3f ms, B - A %+.3f ms (%+.1f%%) +-%.3f%s", i == 0 ? "Frame" : "GPU",
+                        delta.meanMs[0], delta.meanMs[1], delta.deltaMs, delta.meanMs[0] > 0.0f ? delta.deltaMs * 100.0f / delta.meanMs[0] : 0.0f,
+                        delta.ciMs, significant ? "" : ", not significant");
+                }
+                ImGui::Text("95%% interval over %u block pairs, %u frames each", result.pairs, result.frames);
+            }
+        }
+        if (ImGui::CollapsingHeader("Command capture"))
+        {
+            if (ImGui::Button("Capture commands"))
+            {
+                m_captureCommands = true;
+            }
+            if (m_commandRecorder.HasCapture())
+            {
+                CommandRecorder::Stats commandStats = m_commandRecorder.GetStats();
+                ImGui::Text("Commands %u, objects %u, %.1f KB, payload %.1f KB", commandStats.commands, commandStats.objects,
+                    commandStats.streamBytes / 1024.0f, commandStats.payloadBytes / 1024.0f);
+                if (commandStats.unsupported > 0)
+                {
+                    ImGui::Text("Not captured calls %u", commandStats.unsupported);
+                }
+                if (ImGui::Button("Replay x100"))
+                {
+                    m_replayCount = 100;
+                }
+                if (m_replayWallMs > 0.0f)
+                {
+                    ImGui::SameLine();
+                    ImGui::Text("CPU %.3f ms, with GPU %.3f ms", m_replayCpuMs, m_replayWallMs);
+                }
+            }
+        }
+        if (ImGui::CollapsingHeader("Startup"))
+        {
+            ImGui::Text("Shaders prefetched %u on %u workers", m_shaderCache.GetPrefetchUsedCount(), m_jobSystem.GetWorkerCount());
+            for (const StartupPhase& phase : m_startupPhases)
+            {
+                ImGui::Text("%s %.1f ms", phase.name, phase.ms);
+            }
+            int releaseFrames = (int)m_featureReleaseFrames;
+            if (ImGui::SliderInt("Release unused features after frames (0 - never)", &releaseFrames, 0, 3600))
+            {
+                m_featureReleaseFrames = (UINT)releaseFrames;
+            }
+        }
+        int shaderOptimization = (int)m_shaderOptimization;
+        if (ImGui::Combo("Shader optimization", &shaderOptimization, "Debug\0Release\0"))
+        {
+            m_shaderOptimization = (ShaderCache::Optimization)shaderOptimization;
+            m_shaderReloader.SetFlags(ShaderCache::GetCompileFlags(m_shaderOptimization));
+        }
+        int targetFps = (int)m_framePacer.GetTargetFps();
+        if (ImGui::SliderInt("FPS limit (0 - off)", &targetFps, 0, 240))
+        {
+            m_framePacer.SetTargetFps((UINT)targetFps);
+        }
+        int framesInFlight = (int)m_framePacer.GetMaxFramesInFlight();
+        if (ImGui::SliderInt("Frames in flight", &framesInFlight, 1, FramePacer::MaxFramesInFlightLimit))
+        {
+            m_framePacer.SetMaxFramesInFlight((UINT)framesInFlight);
+        }
+        if (ImGui::Checkbox("Render on demand", &m_renderOnDemand))
+        {
+            Invalidate();
+        }
+        int uiRefreshRate = (int)m_uiRefreshRate;
+        if (ImGui::SliderInt("UI refresh rate (0 - every frame)", &uiRefreshRate, 0, 120))
+        {
+            m_uiRefreshRate = (UINT)uiRefreshRate;
+        }
+        ImGui::Text("F1 - hide UI");
+        ImGui::End();
+
+        m_gpuProfiler.ShowWindow();
+        CpuProfiler::Get().ShowWindow();
+        MemoryRegistry::Get().ShowWindow();
+        StallDetector::Get().ShowWindow();
+        if (add)
+        {
+            SetInstanceCount(m_instCount + 1);
+        }
+        if (addMany)
+        {
+            SetInstanceCount(m_instCount + 1000);
+        }
+        if (remove && m_instCount > 0)
+        {
+            SetInstanceCount(m_instCount - 1);
+        }
+        if (removeMany)
+        {
+            SetInstanceCount(m_instCount > 1000 ? m_instCount - 1000 : 0);
+        }
+        if (removeRandom && m_instCount > 0)
+        {
+            RemoveInstance(m_instances.GetHandle(rand() % m_instCount));
+        }
+        if (removePicked && m_pickedIdx < m_instCount)
+        {
+            RemoveInstance(m_instances.GetHandle(m_pickedIdx));
+            m_pickedIdx = NoPick;
+        }
+        if (saveScene)
+        {
+            SaveScene(L"scene.bin");
+        }
+        if (loadScene)
+        {
+            LoadScene(L"scene.bin");
+        }
+    }
+
+    {
+        CPU_PROFILE_ZONE("ImGui::Render");
+        ImGui::Render();
+    }
+}
+
+void Renderer::Resize(UINT width, UINT height)
+{
+    // Minimized window has zero size, buffers are kept as they are
+    if (width == 0 || height == 0)
+    {
+        return;
+    }
+
+    // Only recorded here, as WM_SIZE comes for every intermediate size while window is dragged
+    if (width != m_pendingWidth || height != m_pendingHeight)
+    {
+        m_resizeUSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    m_pendingWidth = width;
+    m_pendingHeight = height;
+    m_resizePending = width != m_width || height != m_height;
+}
+
+void Renderer::SetSizeMove(bool sizeMove)
+{
+    m_sizeMove = sizeMove;
+}
+
+HRESULT Renderer::ApplyResize()
+{
+    m_resizePending = false;
+
+    // Cached UI draw data has old display size
+    m_uiDirty = true;
+
+    SAFE_RELEASE(m_pBackBufferRTV);
+    SAFE_RELEASE(m_pBackBufferUAV);
+    SAFE_RELEASE(m_pBackBufferSRV);
+
+    // Video has fixed frame size
+    if (m_videoRecorder.IsRecording())
+    {
+        m_videoRecorder.Stop();
+    }
+
+    // Back buffer should not be referenced for resize, including bound views
+    m_pDeviceContext->ClearState();
+
+    // Flags should match the ones swap chain was created with
+    HRESULT result = m_pSwapChain->ResizeBuffers(BackBufferCount, m_pendingWidth, m_pendingHeight, DXGI_FORMAT_R8G8B8A8_UNORM, m_swapChainFlags);
+    assert(SUCCEEDED(result));
+    if (SUCCEEDED(result))
+    {
+        m_width = m_pendingWidth;
+        m_height = m_pendingHeight;
+        ++m_swapChainResizes;
+
+        // Scene targets are checked separately, they are usually large enough already
+        result = SetupBackBuffer();
+    }
+
+    return result;
+}
+
+HRESULT Renderer::UpdateSceneTargets()
+{
+    UINT width = GetBaseWidth();
+    UINT height = GetBaseHeight();
+
+    // Shrinking only crops the viewport, unless most of the targets would be unused
+    bool fits = width <= m_targetWidth && height <= m_targetHeight;
+    bool oversized = (UINT64)width * height * TargetShrinkRatio < (UINT64)m_targetWidth * m_targetHeight;
+    if (fits && !oversized)
+    {
+        return S_OK;
+    }
+
+    // Targets are of exact size, so scene can go straight to back buffer, except while window is dragged,
+    // where growing targets get headroom, so the following sizes of the drag don't reallocate them again
+    UINT targetWidth = width;
+    UINT targetHeight = height;
+    if (!fits && m_sizeMove)
+    {
+        targetWidth = std::max(m_targetWidth, DivUp(width, TargetSizeStep) * TargetSizeStep);
+        targetHeight = std::max(m_targetHeight, DivUp(height, TargetSizeStep) * TargetSizeStep);
+    }
+
+    // Targets may be bound
+    m_pDeviceContext->ClearState();
+
+    return CreateSceneTargets(targetWidth, targetHeight);
+}
+
+void Renderer::ResetInstances(UINT count, unsigned int seed)
+{
+    count = std::min(count, (UINT)MaxInst);
+
+    srand(seed);
+    for (UINT i = 0; i < count; i++)
+    {
+        InitGeom(i);
+    }
+    // Regenerated if instance count grows later
+    for (UINT i = count; i < (UINT)MaxInst; i++)
+    {
+        m_instances.Clear(i);
+    }
+
+    m_instCount = count;
+    m_instances.ResetHandles(count);
+    m_updateCullParams = true;
+    MarkGeomDirty(0, count);
+    MarkBoundsDirty(0, count);
+}
+
+bool Renderer::LoadScene(const std::wstring& path)
+{
+    CPU_PROFILE_ZONE("LoadScene");
+    auto start = std::chrono::steady_clock::now();
+
+    SceneFile scene;
+    if (!scene.Open(path))
+    {
+        m_sceneFileStatus = "Failed to load " + WCSToMBS(path);
+        return false;
+    }
+
+    // Texture slices are of textures loaded at startup, other files are not used
+    if (scene.GetMaterialCount() > 0)
+    {
+        std::vector<MaterialTable::Material> materials(scene.GetMaterialTable(),
+            scene.GetMaterialTable() + std::min(scene.GetMaterialCount(), (UINT)MaterialTable::MaxMaterials));
+        for (MaterialTable::Material& material : materials)
+        {
+            material.filter = std::min(material.filter, (UINT)MaterialTable::FilterCount - 1);
+            UINT* slices[MaterialTable::TextureSetCount] = { &material.albedoSlice, &material.normalSlice };
+            for (UINT set = 0; set < MaterialTable::TextureSetCount; set++)
+            {
+                MaterialTable::TextureSet textureSet = (MaterialTable::TextureSet)set;
+                UINT& slice = *slices[set];
+                slice = slice < scene.GetTextureCount(textureSet)
+                    ? m_materials.FindTexture(textureSet, scene.GetTextureFile(textureSet, slice))
+                    : MaterialTable::NoTexture;
+            }
+        }
+        m_materials.SetMaterials(m_pDeviceContext, materials.data(), (UINT)materials.size());
+    }
+
+    // Blocks are copied as they are, mesh references are only rewritten if they differ from renderer mesh ids
+    UINT count = std::min(scene.GetInstanceCount(), (UINT)MaxInst);
+    m_instances.Load(0, count, scene.GetPositions(), scene.GetSpeeds(), scene.GetShininess(), scene.GetMaterials(), scene.GetMeshes(), scene.GetBounds());
+
+    std::vector<UINT> meshRemap(std::max(scene.GetMeshCount(), 1u), InstanceMeshCube);
+    bool identity = true;
+    for (UINT i = 0; i < scene.GetMeshCount(); i++)
+    {
+        std::string name = scene.GetMeshName(i);
+        for (UINT mesh = 0; mesh < InstanceMeshCount; mesh++)
+        {
+            if (name == InstanceMeshNames[mesh])
+            {
+                meshRemap[i] = mesh;
+            }
+        }
+        identity = identity && meshRemap[i] == i;
+    }
+    if (!identity || scene.GetMeshCount() < InstanceMeshCount)
+    {
+        m_instances.RemapMeshes(0, count, meshRemap.data(), (UINT)meshRemap.size());
+    }
+
+    for (UINT i = count; i < (UINT)MaxInst; i++)
+    {
+        m_instances.Clear(i);
+    }
+
+    m_instCount = count;
+    m_instances.ResetHandles(count);
+    m_updateCullParams = true;
+    MarkGeomDirty(0, count);
+    MarkBoundsDirty(0, count);
+
+    m_sceneFileMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_sceneFileStatus = "Loaded " + std::to_string(count) + " instances";
+
+    return true;
+}
+
+bool Renderer::SaveScene(const std::wstring& path)
+{
+    CPU_PROFILE_ZONE("SaveScene");
+    auto start = std::chrono::steady_clock::now();
+
+    SceneFile::Contents contents;
+    contents.instanceCount = m_instCount;
+    contents.pPositions = m_instances.GetPositions();
+    contents.pSpeeds = m_instances.GetSpeeds();
+    contents.pShininess = m_instances.GetShininess();
+    contents.pMaterials = m_instances.GetMaterials();
+    contents.pMeshes = m_instances.GetMeshes();
+    contents.pBounds = m_instances.GetBounds();
+    contents.materials = m_materials.GetMaterials();
+    for (UINT set = 0; set < MaterialTable::TextureSetCount; set++)
+    {
+        contents.textureFiles[set] = m_materials.GetTextureFiles((MaterialTable::TextureSet)set);
+    }
+    contents.meshNames.assign(InstanceMeshNames, InstanceMeshNames + InstanceMeshCount);
+
+    bool written = SceneFile::Write(path, contents);
+
+    m_sceneFileMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_sceneFileStatus = written ? "Saved " + std::to_string(m_instCount) + " instances" : "Failed to save " + WCSToMBS(path);
+
+    return written;
+}
+
+void Renderer::SetCamera(const Point3f& poi, float r, float phi, float theta)
+{
+    m_camera.poi = poi;
+    m_camera.r = r;
+    m_camera.phi = phi;
+    m_camera.theta = theta;
+}
+
+void Renderer::SetLightCount(UINT count, unsigned int seed)
+{
+    srand(seed);
+    m_settingsBuffer.lightCount.x = 0;
+    AddRandomLights(count);
+}
+
+void Renderer::MouseRBPressed(bool pressed, int x, int y)
+{
+    m_rbPressed = pressed;
+    if (m_rbPressed)
+    {
+        m_prevMouseX = x;
+        m_prevMouseY = y;
+    }
+}
+
+void Renderer::MouseMoved(int x, int y)
+{
+    m_mouseX = x;
+    m_mouseY = y;
+
+    if (m_rbPressed)
+    {
+        // Raw motion is applied in Update
+        if (!m_rawInput)
+        {
+            RotateCamera(x - m_prevMouseX, y - m_prevMouseY);
+        }
+
+        m_prevMouseX = x;
+        m_prevMouseY = y;
+    }
+}
+
+void Renderer::RotateCamera(int dx, int dy)
+{
+    m_camera.phi += -(float)dx / m_width * CameraRotationSpeed;
+    m_camera.theta += (float)dy / m_width * CameraRotationSpeed;
+    m_camera.theta = std::min(std::max(m_camera.theta, -(float)M_PI / 2), (float)M_PI / 2);
+}
+
+void Renderer::MouseWheel(int delta)
+{
+    m_camera.r -= delta / 100.0f;
+    if (m_camera.r < 1.0f)
+    {
+        m_camera.r = 1.0f;
+    }
+}
+
+void Renderer::KeyPressed(int keyCode)
+{
+    switch (keyCode)
+    {
+        case ' ':
+            m_rotateModel = !m_rotateModel;
+            break;
+
+        case VK_F1:
+            SetShowUI(!m_showUI);
+            break;
+
+        case 'W':
+        case 'w':
+            m_forwardDelta += PanSpeed;
+            break;
+
+        case 'S':
+        case 's':
+            m_forwardDelta -= PanSpeed;
+            break;
+
+        case 'D':
+        case 'd':
+            m_rightDelta += PanSpeed;
+            break;
+
+        case 'A':
+        case 'a':
+            m_rightDelta -= PanSpeed;
+            break;
+    }
+}
+
+void Renderer::KeyReleased(int keyCode)
+{
+    switch (keyCode)
+    {
+        case 'W':
+        case 'w':
             m_forwardDelta -= PanSpeed;
             break;
 
-        case 'D':
-        case 'd':
-            m_rightDelta += PanSpeed;
-            break;
+        case 'S':
+        case 's':
+            m_forwardDelta += PanSpeed;
+            break;
+
+        case 'D':
+        case 'd':
+            m_rightDelta -= PanSpeed;
+            break;
+
+        case 'A':
+        case 'a':
+            m_rightDelta += PanSpeed;
+            break;
+    }
+}
+
+IDXGIAdapter* Renderer::SelectAdapter(IDXGIFactory* pFactory)
+{
+    IDXGIAdapter* pSelectedAdapter = nullptr;
+
+    // Forced from command line
+    if (m_adapterIndex >= 0)
+    {
+        if (FAILED(pFactory->EnumAdapters((UINT)m_adapterIndex, &pSelectedAdapter)))
+        {
+            pSelectedAdapter = nullptr;
+        }
+    }
+
+    // DXGI 1.6 knows which adapter is the discrete one on hybrid systems, software adapters are enumerated last
+    IDXGIFactory6* pFactory6 = nullptr;
+    if (pSelectedAdapter == nullptr && SUCCEEDED(pFactory->QueryInterface(__uuidof(IDXGIFactory6), (void**)&pFactory6)))
+    {
+        IDXGIAdapter1* pAdapter = nullptr;
+        if (SUCCEEDED(pFactory6->EnumAdapterByGpuPreference(0, DXGI_GPU_PREFERENCE_HIGH_PERFORMANCE, __uuidof(IDXGIAdapter1), (void**)&pAdapter)))
+        {
+            DXGI_ADAPTER_DESC1 desc;
+            pAdapter->GetDesc1(&desc);
+            if ((desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) == 0)
+            {
+                pSelectedAdapter = pAdapter;
+            }
+            else
+            {
+                pAdapter->Release();
+            }
+        }
+        SAFE_RELEASE(pFactory6);
+    }
+
+    // Otherwise the hardware adapter with the most dedicated video memory is taken
+    if (pSelectedAdapter == nullptr)
+    {
+        SIZE_T bestMemory = 0;
+        IDXGIAdapter* pAdapter = nullptr;
+        UINT adapterIdx = 0;
+        while (SUCCEEDED(pFactory->EnumAdapters(adapterIdx, &pAdapter)))
+        {
+            DXGI_ADAPTER_DESC desc;
+            pAdapter->GetDesc(&desc);
+
+            if (wcscmp(desc.Description, L"Microsoft Basic Render Driver") != 0
+                && (pSelectedAdapter == nullptr || desc.DedicatedVideoMemory > bestMemory))
+            {
+                SAFE_RELEASE(pSelectedAdapter);
+                pSelectedAdapter = pAdapter;
+                bestMemory = desc.DedicatedVideoMemory;
+            }
+            else
+            {
+                pAdapter->Release();
+            }
+
+            adapterIdx++;
+        }
+    }
+
+    if (pSelectedAdapter != nullptr)
+    {
+        DXGI_ADAPTER_DESC desc;
+        pSelectedAdapter->GetDesc(&desc);
+        m_adapterName = WCSToMBS(desc.Description);
+
+        OutputDebugStringA(("Adapter: " + m_adapterName + ", " + std::to_string(desc.DedicatedVideoMemory / (1024 * 1024)) + " MB dedicated video memory\n").c_str());
+    }
+
+    return pSelectedAdapter;
+}
+
+HRESULT Renderer::SetupBackBuffer()
+{
+    // Swap chain buffers are not created by renderer, so they are recorded by format size
+    MemoryRegistry::Get().SetExternal("SwapChain", (UINT64)m_width * m_height * 4 * BackBufferCount, MemoryRegistry::CategorySwapChain);
+
+    ID3D11Texture2D* pBackBuffer = NULL;
+    HRESULT result = m_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&pBackBuffer);
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateRenderTargetView(pBackBuffer, NULL, &m_pBackBufferRTV);
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateUnorderedAccessView(pBackBuffer, nullptr, &m_pBackBufferUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateShaderResourceView(pBackBuffer, nullptr, &m_pBackBufferSRV);
+        }
+
+        SAFE_RELEASE(pBackBuffer);
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::CreateSceneTargets(UINT width, UINT height)
+{
+    SAFE_RELEASE(m_pDepthBuffer);
+    SAFE_RELEASE(m_pDepthBufferDSV);
+    SAFE_RELEASE(m_pDepthBufferSRV);
+
+    m_targetWidth = width;
+    m_targetHeight = height;
+    ++m_targetReallocs;
+
+    // Requested formats fall back to the ones every device supports
+    if ((m_colorFormatSupportMask & (1u << m_colorFormat)) == 0)
+    {
+        m_colorFormat = ColorFormatRGBA8;
+    }
+    if ((m_depthFormatSupportMask & (1u << m_depthFormat)) == 0)
+    {
+        m_depthFormat = DepthFormatD32;
+    }
+    m_colorBufferFormat = m_colorFormat;
+    m_depthBufferFormat = m_depthFormat;
+
+    HRESULT result = S_OK;
+    if (SUCCEEDED(result))
+    {
+        D3D11_TEXTURE2D_DESC desc;
+        desc.Format = DepthFormats[m_depthBufferFormat].texture;
+        desc.ArraySize = 1;
+        desc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.SampleDesc.Count = 1;
+        desc.SampleDesc.Quality = 0;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.Height = m_targetHeight;
+        desc.Width = m_targetWidth;
+        desc.MipLevels = 1;
+
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pDepthBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDepthBuffer, "DepthBuffer");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+        dsvDesc.Format = DepthFormats[m_depthBufferFormat].dsv;
+        dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+        dsvDesc.Flags = 0;
+        dsvDesc.Texture2D.MipSlice = 0;
+
+        result = m_pDevice->CreateDepthStencilView(m_pDepthBuffer, &dsvDesc, &m_pDepthBufferDSV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDepthBuffer, "DepthBufferView");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DepthFormats[m_depthBufferFormat].srv;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        srvDesc.Texture2D.MostDetailedMip = 0;
+
+        result = m_pDevice->CreateShaderResourceView(m_pDepthBuffer, &srvDesc, &m_pDepthBufferSRV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDepthBufferSRV, "DepthBufferSRV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CreateHiZ();
+    }
+
+    SAFE_RELEASE(m_pColorBuffer);
+    SAFE_RELEASE(m_pColorBufferRTV);
+    SAFE_RELEASE(m_pColorBufferSRV);
+    SAFE_RELEASE(m_pColorBufferUAV);
+
+    if (SUCCEEDED(result))
+    {
+        D3D11_TEXTURE2D_DESC desc;
+        desc.Format = ColorFormats[m_colorBufferFormat];
+        desc.ArraySize = 1;
+        desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.SampleDesc.Count = 1;
+        desc.SampleDesc.Quality = 0;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.Height = m_targetHeight;
+        desc.Width = m_targetWidth;
+        desc.MipLevels = 1;
+
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pColorBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pColorBuffer, "ColorBuffer");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateRenderTargetView(m_pColorBuffer, nullptr, &m_pColorBufferRTV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pColorBufferRTV, "ColorBufferRTV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pColorBuffer, nullptr, &m_pColorBufferSRV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pColorBufferSRV, "ColorBufferSRV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateUnorderedAccessView(m_pColorBuffer, nullptr, &m_pColorBufferUAV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pColorBufferUAV, "ColorBufferUAV");
+        }
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = CreateMsaaTargets();
+    }
+
+    // G-buffer for deferred shading
+    static const DXGI_FORMAT GBufferFormats[GBufferCount] = { DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R16G16B16A16_FLOAT };
+    static const char* GBufferNames[GBufferCount] = { "GBufferAlbedo", "GBufferNormal" };
+    for (UINT i = 0; i < GBufferCount; i++)
+    {
+        SAFE_RELEASE(m_pGBuffers[i]);
+        SAFE_RELEASE(m_pGBufferRTVs[i]);
+        SAFE_RELEASE(m_pGBufferSRVs[i]);
+
+        if (SUCCEEDED(result))
+        {
+            D3D11_TEXTURE2D_DESC desc;
+            desc.Format = GBufferFormats[i];
+            desc.ArraySize = 1;
+            desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+            desc.CPUAccessFlags = 0;
+            desc.MiscFlags = 0;
+            desc.SampleDesc.Count = 1;
+            desc.SampleDesc.Quality = 0;
+            desc.Usage = D3D11_USAGE_DEFAULT;
+            desc.Height = m_targetHeight;
+            desc.Width = m_targetWidth;
+            desc.MipLevels = 1;
+
+            result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pGBuffers[i]);
+            if (SUCCEEDED(result))
+            {
+                result = SetResourceName(m_pGBuffers[i], GBufferNames[i]);
+            }
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateRenderTargetView(m_pGBuffers[i], nullptr, &m_pGBufferRTVs[i]);
+            if (SUCCEEDED(result))
+            {
+                result = SetResourceName(m_pGBufferRTVs[i], std::string(GBufferNames[i]) + "RTV");
+            }
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateShaderResourceView(m_pGBuffers[i], nullptr, &m_pGBufferSRVs[i]);
+            if (SUCCEEDED(result))
+            {
+                result = SetResourceName(m_pGBufferSRVs[i], std::string(GBufferNames[i]) + "SRV");
+            }
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitMaterials()
+{
+    UINT brick = m_materials.AddTexture(MaterialTable::TextureSetAlbedo, L"../Common/Brick.dds");
+    UINT kitty = m_materials.AddTexture(MaterialTable::TextureSetAlbedo, L"../Common/Kitty.dds");
+    UINT brickNM = m_materials.AddTexture(MaterialTable::TextureSetNormal, L"../Common/BrickNM.dds");
+
+    MaterialTable::Material material = {};
+    material.tint = Point4f{ 1, 1, 1, 1 };
+    material.albedoSlice = brick;
+    material.normalSlice = brickNM;
+    m_materials.AddMaterial(material);
+
+    material.albedoSlice = kitty;
+    material.normalSlice = MaterialTable::NoTexture;
+    material.filter = MaterialTable::FilterMedium; // Photo has no fine detail to keep at grazing angles
+    m_materials.AddMaterial(material);
+    material.filter = MaterialTable::FilterBest;
+
+    // Tinted bricks, drawn in the same instanced draw
+    static const Point4f Tints[] = {
+        Point4f{ 1.0f, 0.6f, 0.6f, 1 }, Point4f{ 0.6f, 1.0f, 0.6f, 1 }, Point4f{ 0.6f, 0.6f, 1.0f, 1 },
+        Point4f{ 1.0f, 1.0f, 0.5f, 1 }, Point4f{ 0.5f, 1.0f, 1.0f, 1 }, Point4f{ 1.0f, 0.5f, 1.0f, 1 }
+    };
+    for (const Point4f& tint : Tints)
+    {
+        material.tint = tint;
+        material.albedoSlice = brick;
+        material.normalSlice = brickNM;
+        m_materials.AddMaterial(material);
+    }
+
+    return m_materials.Init(m_pDevice, m_textureStreamer, m_textureSkipMips);
+}
+
+HRESULT Renderer::InitScene()
+{
+    // Textured cube
+    static const TextureTangentVertex Vertices[24] = {
+        // Bottom face
+        {Point3f{-0.5, -0.5,  0.5}, Point3f{1, 0, 0}, Point3f{0, -1, 0}, Point2f{0, 1}},
+        {Point3f{ 0.5, -0.5,  0.5}, Point3f{1, 0, 0}, Point3f{0, -1, 0}, Point2f{1, 1}},
+        {Point3f{ 0.5, -0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, -1, 0}, Point2f{1, 0}},
+        {Point3f{-0.5, -0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, -1, 0}, Point2f{0, 0}},
+        // Top face
+        {Point3f{-0.5,  0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 1, 0}, Point2f{0, 1}},
+        {Point3f{ 0.5,  0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 1, 0}, Point2f{1, 1}},
+        {Point3f{ 0.5,  0.5,  0.5}, Point3f{1, 0, 0}, Point3f{0, 1, 0}, Point2f{1, 0}},
+        {Point3f{-0.5,  0.5,  0.5}, Point3f{1, 0, 0}, Point3f{0, 1, 0}, Point2f{0, 0}},
+        // Front face
+        {Point3f{ 0.5, -0.5, -0.5}, Point3f{0, 0, 1}, Point3f{1, 0, 0}, Point2f{0, 1}},
+        {Point3f{ 0.5, -0.5,  0.5}, Point3f{0, 0, 1}, Point3f{1, 0, 0}, Point2f{1, 1}},
+        {Point3f{ 0.5,  0.5,  0.5}, Point3f{0, 0, 1}, Point3f{1, 0, 0}, Point2f{1, 0}},
+        {Point3f{ 0.5,  0.5, -0.5}, Point3f{0, 0, 1}, Point3f{1, 0, 0}, Point2f{0, 0}},
+        // Back face
+        {Point3f{-0.5, -0.5,  0.5}, Point3f{0, 0, -1}, Point3f{-1, 0, 0}, Point2f{0, 1}},
+        {Point3f{-0.5, -0.5, -0.5}, Point3f{0, 0, -1}, Point3f{-1, 0, 0}, Point2f{1, 1}},
+        {Point3f{-0.5,  0.5, -0.5}, Point3f{0, 0, -1}, Point3f{-1, 0, 0}, Point2f{1, 0}},
+        {Point3f{-0.5,  0.5,  0.5}, Point3f{0, 0, -1}, Point3f{-1, 0, 0}, Point2f{0, 0}},
+        // Left face
+        {Point3f{ 0.5, -0.5,  0.5}, Point3f{-1, 0, 0}, Point3f{0, 0, 1}, Point2f{0, 1}},
+        {Point3f{-0.5, -0.5,  0.5}, Point3f{-1, 0, 0}, Point3f{0, 0, 1}, Point2f{1, 1}},
+        {Point3f{-0.5,  0.5,  0.5}, Point3f{-1, 0, 0}, Point3f{0, 0, 1}, Point2f{1, 0}},
+        {Point3f{ 0.5,  0.5,  0.5}, Point3f{-1, 0, 0}, Point3f{0, 0, 1}, Point2f{0, 0}},
+        // Right face
+        {Point3f{-0.5, -0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 0, -1}, Point2f{0, 1}},
+        {Point3f{ 0.5, -0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 0, -1}, Point2f{1, 1}},
+        {Point3f{ 0.5,  0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 0, -1}, Point2f{1, 0}},
+        {Point3f{-0.5,  0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 0, -1}, Point2f{0, 0}}
+    };
+    static const UINT16 Indices[36] = {
+        0, 2, 1, 0, 3, 2,
+        4, 6, 5, 4, 7, 6,
+        8, 10, 9, 8, 11, 10,
+        12, 14, 13, 12, 15, 14,
+        16, 18, 17, 16, 19, 18,
+        20, 22, 21, 20, 23, 22
+    };
+    static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"INSTANCE", 0, DXGI_FORMAT_R32_UINT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1}
+    };
+    static const D3D11_INPUT_ELEMENT_DESC PackedInputDesc[] = {
+        {"POSITION", 0, DXGI_FORMAT_R16G16B16A16_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"NORMAL", 0, DXGI_FORMAT_R8G8B8A8_SNORM, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"INSTANCE", 0, DXGI_FORMAT_R32_UINT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1}
+    };
+
+    HRESULT result = InitMaterials();
+    if (SUCCEEDED(result))
+    {
+        result = m_textureProcessor.Init(m_pDevice, [this](const std::wstring& path, ID3D11DeviceChild** ppShader)
+        {
+            return CompileAndCreateShader(path, ppShader);
+        });
+    }
+
+    // Geometry is sub-allocated from shared pool, each instance draws one LOD of instanced meshes.
+    // Cube has the only LOD, unused LOD draws are skipped.
+    m_instanceMeshes[InstanceMeshCube * MaxLods] = AddInstancedMesh(Vertices, 24, Indices, 36);
+    m_lodCounts[InstanceMeshCube] = 1;
+    for (UINT lod = 0; lod < ImpostorLod; lod++)
+    {
+        static const size_t SphereSteps[ImpostorLod] = { 32, 16, 8 };
+
+        size_t indexCount;
+        size_t vertexCount;
+        GetSphereDataSize(SphereSteps[lod], SphereSteps[lod], indexCount, vertexCount);
+
+        std::vector<TextureTangentVertex> sphereVertices(vertexCount);
+        std::vector<UINT16> sphereIndices(indexCount);
+        CreateTexturedSphere(SphereSteps[lod], SphereSteps[lod], sphereIndices.data(), sphereVertices.data());
+
+        m_instanceMeshes[InstanceMeshSphere * MaxLods + lod] = AddInstancedMesh(sphereVertices.data(), (UINT)vertexCount, sphereIndices.data(), (UINT)indexCount);
+    }
+    m_lodCounts[InstanceMeshSphere] = ImpostorLod;
+
+    // Imported mesh goes from cooked cache straight to the pool, text is only parsed if cache is out of date
+    m_importedMesh = false;
+    if (!m_meshPath.empty())
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        MeshCache meshCache;
+        bool cooked = false;
+        if (meshCache.Open(m_meshPath, &cooked))
+        {
+            UINT triangles = 0;
+            for (UINT lod = 0; lod < meshCache.GetLodCount(); lod++)
+            {
+                m_instanceMeshes[InstanceMeshImported * MaxLods + lod] = AddInstancedMesh(meshCache.GetVertices(lod), meshCache.GetVertexCount(lod),
+                    meshCache.GetIndices(lod), meshCache.GetIndexCount(lod), false);
+                triangles += meshCache.GetIndexCount(lod) / 3;
+            }
+            m_lodCounts[InstanceMeshImported] = meshCache.GetLodCount();
+            m_importedMesh = true;
+
+            // Meshlets address LOD 0 indices, which the pool keeps in cooked order
+            m_meshlets.assign(meshCache.GetMeshlets(), meshCache.GetMeshlets() + meshCache.GetMeshletCount());
+
+            float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            m_meshStatus = std::string(cooked ? "Cooked" : "Cached") + " mesh, " + std::to_string(meshCache.GetLodCount()) + " LODs, "
+                + std::to_string(triangles) + " triangles in " + std::to_string((int)ms) + " ms";
+        }
+        else
+        {
+            m_meshStatus = "Failed to import " + WCSToMBS(m_meshPath);
+        }
+        OutputDebugStringA((m_meshStatus + "\n").c_str());
+    }
+    if (!m_importedMesh)
+    {
+        m_instanceMeshes[InstanceMeshImported * MaxLods] = m_instanceMeshes[InstanceMeshCube * MaxLods];
+        m_lodCounts[InstanceMeshImported] = 1;
+    }
+
+    // Index into visible ids for each drawn instance, as SV_InstanceID doesn't include start instance location.
+    // Multi-view segments of cascades are longer
+    if (SUCCEEDED(result))
+    {
+        std::vector<UINT> instanceIndices(MaxInst * InstanceDrawCount * (m_multiViewSupported ? CascadeCount : 1));
+        for (UINT i = 0; i < (UINT)instanceIndices.size(); i++)
+        {
+            instanceIndices[i] = i;
+        }
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = (UINT)(instanceIndices.size() * sizeof(UINT));
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = instanceIndices.data();
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pInstanceIndices);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstanceIndices, "InstanceIndices");
+        }
+    }
+
+    ID3DBlob* pVertexShaderCode = nullptr;
+    if (SUCCEEDED(result))
+    {
+        std::vector<std::string> defines;
+        if (m_packedVertices)
+        {
+            defines.push_back("PACKED_VERTEX");
+        }
+        result = CompileAndCreateShader(L"SimpleTexture.vs", (ID3D11DeviceChild**)&m_pVertexShader, defines, &pVertexShaderCode);
+        if (SUCCEEDED(result) && m_multiViewSupported)
+        {
+            // Same input signature, so input layout of the main one is used
+            defines.push_back("MULTI_VIEW");
+            result = CompileAndCreateShader(L"SimpleTexture.vs", (ID3D11DeviceChild**)&m_pMultiViewVertexShader, defines);
+            defines.pop_back();
+        }
+        if (SUCCEEDED(result))
+        {
+            // Extra outputs are at the end, so pixel shaders without motion vectors read it too
+            defines.push_back("MOTION_VECTORS");
+            result = CompileAndCreateShader(L"SimpleTexture.vs", (ID3D11DeviceChild**)&m_pMotionVertexShader, defines);
+            defines.pop_back();
+        }
+        if (SUCCEEDED(result))
+        {
+            defines.push_back("INSTANCE_TRANSFORMS");
+            result = CompileAndCreateShader(L"SimpleTexture.vs", (ID3D11DeviceChild**)&m_pTransformVertexShader, defines);
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileShaderVariants(L"SimpleTexture.ps", (ID3D11DeviceChild**)m_pPixelShaders, ForwardVariants);
+    }
+
+    if (SUCCEEDED(result))
+    {
+        if (m_packedVertices)
+        {
+            result = m_pDevice->CreateInputLayout(PackedInputDesc, 4, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &m_pInputLayout);
+        }
+        else
+        {
+            result = m_pDevice->CreateInputLayout(InputDesc, 5, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &m_pInputLayout);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInputLayout, "InputLayout");
+        }
+    }
+
+    SAFE_RELEASE(pVertexShaderCode);
+
+    // Create geometry buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(InstanceStore::GpuInstance) * MaxInst;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS; // UAV is for GPU animation
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(InstanceStore::GpuInstance);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pGeomBufferInst);
+        assert(SUCCEEDED(result));
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pGeomBufferInst, "GeomBufferInst");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxInst;
+
+            result = m_pDevice->CreateShaderResourceView(m_pGeomBufferInst, &srvDesc, &m_pGeomBufferInstSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pGeomBufferInstSRV, "GeomBufferInstSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxInst;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pGeomBufferInst, &uavDesc, &m_pGeomBufferInstUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pGeomBufferInstUAV, "GeomBufferInstUAV");
+        }
+        if (SUCCEEDED(result))
+        {
+            const float diag = sqrtf(2.0f) / 2.0f * 0.5f;
+
+            Point3f pos = Point3f{ 0.00001f, 0, 0 };
+            AABB bb;
+            bb.vmin = pos + Point3f{ -diag, -0.5f, -diag };
+            bb.vmax = pos + Point3f{ diag,  0.5f,  diag };
+            m_instances.Set(0, pos, ModelRotationSpeed, 0.0f, 0, InstanceMeshCube, bb);
+
+            pos = Point3f{ 2.0f, 0, 0 };
+            bb.vmin = pos + Point3f{ -0.5f, -0.5f, -0.5f };
+            bb.vmax = pos + Point3f{ 0.5f, 0.5f, 0.5f };
+            m_instances.Set(1, pos, 0.0f, 64.0f, 0, InstanceMeshCube, bb);
+
+            for (UINT i = 2; i < 10; i++)
+            {
+                InitGeom(i);
+            }
+            m_instCount = 10;
+            m_instances.ResetHandles(m_instCount);
+            m_updateCullParams = true;
+            MarkGeomDirty(0, m_instCount);
+            MarkBoundsDirty(0, m_instCount);
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_geomUploadRing.Init(m_pDevice, GeomUploadRingSize, "GeomUploadRing");
+    }
+    // Create geometry visibility buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT) * MaxInst * InstanceDrawCount;
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pGeomBufferInstVis);
+        assert(SUCCEEDED(result));
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pGeomBufferInstVis, "GeomBufferInstVis");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxInst * InstanceDrawCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pGeomBufferInstVis, &srvDesc, &m_pGeomBufferInstVisSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pGeomBufferInstVisSRV, "GeomBufferInstVisSRV");
+        }
+    }
+    // Create scene and settings buffers
+    if (SUCCEEDED(result))
+    {
+        result = m_sceneCB.Init(m_pDevice, "SceneBuffer");
+        assert(SUCCEEDED(result));
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_settingsCB.Init(m_pDevice, "SettingsBuffer");
+        assert(SUCCEEDED(result));
+    }
+
+    // CCW culling rasterizer state
+    if (SUCCEEDED(result))
+    {
+        D3D11_RASTERIZER_DESC desc = {};
+        desc.AntialiasedLineEnable = FALSE;
+        desc.FillMode = D3D11_FILL_SOLID;
+        desc.CullMode = D3D11_CULL_NONE;
+        desc.FrontCounterClockwise = FALSE;
+        desc.DepthBias = 0;
+        desc.SlopeScaledDepthBias = 0.0f;
+        desc.DepthBiasClamp = 0.0f;
+        desc.DepthClipEnable = TRUE;
+        desc.ScissorEnable = FALSE;
+        desc.MultisampleEnable = FALSE;
+
+        result = m_stateObjects.GetRasterizerState(m_pDevice, desc, "RasterizerState", &m_pRasterizerState);
+    }
+
+    // Create blend states
+    if (SUCCEEDED(result))
+    {
+        D3D11_BLEND_DESC desc = {};
+        desc.AlphaToCoverageEnable = FALSE;
+        desc.IndependentBlendEnable = FALSE;
+        desc.RenderTarget[0].BlendEnable = TRUE;
+        desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+        desc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+        desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED | D3D11_COLOR_WRITE_ENABLE_GREEN | D3D11_COLOR_WRITE_ENABLE_BLUE;
+        desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+        desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+        result = m_stateObjects.GetBlendState(m_pDevice, desc, "TransBlendState", &m_pTransBlendState);
+        if (SUCCEEDED(result))
+        {
+            // Reduced resolution target keeps transmittance of the scene behind in alpha
+            desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+            desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
+            desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+            result = m_stateObjects.GetBlendState(m_pDevice, desc, "LowResTransBlendState", &m_pLowResTransBlendState);
+        }
+        if (SUCCEEDED(result))
+        {
+            // Scene is multiplied by transmittance and blended color is added
+            desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED | D3D11_COLOR_WRITE_ENABLE_GREEN | D3D11_COLOR_WRITE_ENABLE_BLUE;
+            desc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+            desc.RenderTarget[0].DestBlend = D3D11_BLEND_SRC_ALPHA;
+            desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+            desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+            result = m_stateObjects.GetBlendState(m_pDevice, desc, "LowResCompositeBlendState", &m_pLowResCompositeBlendState);
+        }
+        if (SUCCEEDED(result))
+        {
+            desc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+            desc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+            desc.RenderTarget[0].BlendEnable = FALSE;
+            result = m_stateObjects.GetBlendState(m_pDevice, desc, "OpaqueBlendState", &m_pOpaqueBlendState);
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        // OIT accumulation is added, revealage is multiplied by 1 - alpha
+        D3D11_BLEND_DESC desc = {};
+        desc.AlphaToCoverageEnable = FALSE;
+        desc.IndependentBlendEnable = TRUE;
+        desc.RenderTarget[0].BlendEnable = TRUE;
+        desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+        desc.RenderTarget[1].BlendEnable = TRUE;
+        desc.RenderTarget[1].BlendOp = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[1].SrcBlend = D3D11_BLEND_ZERO;
+        desc.RenderTarget[1].DestBlend = D3D11_BLEND_INV_SRC_COLOR;
+        desc.RenderTarget[1].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[1].SrcBlendAlpha = D3D11_BLEND_ZERO;
+        desc.RenderTarget[1].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+        desc.RenderTarget[1].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED;
+        result = m_stateObjects.GetBlendState(m_pDevice, desc, "OitBlendState", &m_pOitBlendState);
+    }
+
+    // Create reverse depth state
+    if (SUCCEEDED(result))
+    {
+        D3D11_DEPTH_STENCIL_DESC desc = {};
+        desc.DepthEnable = TRUE;
+        desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+        desc.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
+        desc.StencilEnable = FALSE;
+
+        result = m_stateObjects.GetDepthStencilState(m_pDevice, desc, "DepthState", &m_pDepthState);
+    }
+
+    // Create reverse transparent depth state
+    if (SUCCEEDED(result))
+    {
+        D3D11_DEPTH_STENCIL_DESC desc = {};
+        desc.DepthEnable = TRUE;
+        desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+        desc.DepthFunc = D3D11_COMPARISON_GREATER;
+        desc.StencilEnable = FALSE;
+
+        result = m_stateObjects.GetDepthStencilState(m_pDevice, desc, "TransDepthState", &m_pTransDepthState);
+    }
+
+    // Create depth copy state, full screen pass writes depth of each pixel
+    if (SUCCEEDED(result))
+    {
+        D3D11_DEPTH_STENCIL_DESC desc = {};
+        desc.DepthEnable = TRUE;
+        desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+        desc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+        desc.StencilEnable = FALSE;
+
+        result = m_stateObjects.GetDepthStencilState(m_pDevice, desc, "DepthCopyState", &m_pDepthCopyState);
+    }
+
+    // Create sky depth state, sky is at far plane which is cleared depth of reversed Z
+    if (SUCCEEDED(result))
+    {
+        D3D11_DEPTH_STENCIL_DESC desc = {};
+        desc.DepthEnable = TRUE;
+        desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+        desc.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
+        desc.StencilEnable = FALSE;
+
+        result = m_stateObjects.GetDepthStencilState(m_pDevice, desc, "SkyDepthState", &m_pSkyDepthState);
+    }
+
+    // Create depth state for shading pass after depth pre-pass
+    if (SUCCEEDED(result))
+    {
+        D3D11_DEPTH_STENCIL_DESC desc = {};
+        desc.DepthEnable = TRUE;
+        desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+        desc.DepthFunc = D3D11_COMPARISON_EQUAL;
+        desc.StencilEnable = FALSE;
+
+        result = m_stateObjects.GetDepthStencilState(m_pDevice, desc, "DepthEqualState", &m_pDepthEqualState);
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = UpdateSamplers();
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = InitSphere();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitCubemap();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitSkyAmbient();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitRect();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitSmallSphere();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_geometryPool.Init(m_pDevice);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitPostProcess();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitCull();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitAnimation();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitOcclusion();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitLightClusters();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitDeferredShading();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitSort();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitShadows();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitMeshlets();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitImageDiff();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitPredicates();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitParticles();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitPicking();
+    }
+    if (SUCCEEDED(result))
+    {
+        result = InitDebugViews();
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitLightClusters()
+{
+    HRESULT result = CompileAndCreateShader(L"LightCull.cs", (ID3D11DeviceChild**)&m_pLightCullShader);
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"LightCull.cs", (ID3D11DeviceChild**)&m_pLightListShader, { "VISIBLE_LIST" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"LightCull.cs", (ID3D11DeviceChild**)&m_pBulbCullShader, { "BULB_LIST" });
+    }
+
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(LightCullParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pLightCullParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pLightCullParams, "LightCullParams");
+        }
+    }
+    // Create lights buffer, it is rewritten each frame
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(Light) * MaxLights;
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(Light);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pLightBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pLightBuffer, "LightBuffer");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxLights;
+
+            result = m_pDevice->CreateShaderResourceView(m_pLightBuffer, &srvDesc, &m_pLightBufferSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pLightBufferSRV, "LightBufferSRV");
+        }
+    }
+    // Create visible lights list and its counter
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(Light) * MaxLights;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(Light);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pVisibleLights);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleLights, "VisibleLights");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxLights;
+
+            result = m_pDevice->CreateShaderResourceView(m_pVisibleLights, &srvDesc, &m_pVisibleLightsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleLightsSRV, "VisibleLightsSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxLights;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pVisibleLights, &uavDesc, &m_pVisibleLightsUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleLightsUAV, "VisibleLightsUAV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pVisibleLightCount);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleLightCount, "VisibleLightCount");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = 1;
+
+            result = m_pDevice->CreateShaderResourceView(m_pVisibleLightCount, &srvDesc, &m_pVisibleLightCountSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleLightCountSRV, "VisibleLightCountSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = 1;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pVisibleLightCount, &uavDesc, &m_pVisibleLightCountUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleLightCountUAV, "VisibleLightCountUAV");
+        }
+    }
+    // Create visible bulbs list and its counter
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(Light) * MaxLights;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(Light);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pVisibleBulbs);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleBulbs, "VisibleBulbs");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxLights;
+
+            result = m_pDevice->CreateShaderResourceView(m_pVisibleBulbs, &srvDesc, &m_pVisibleBulbsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleBulbsSRV, "VisibleBulbsSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxLights;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pVisibleBulbs, &uavDesc, &m_pVisibleBulbsUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleBulbsUAV, "VisibleBulbsUAV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pVisibleBulbCount);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleBulbCount, "VisibleBulbCount");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = 1;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pVisibleBulbCount, &uavDesc, &m_pVisibleBulbCountUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleBulbCountUAV, "VisibleBulbCountUAV");
+        }
+    }
+    // Create cluster light lists
+    if (SUCCEEDED(result))
+    {
+        const UINT elementCount = ClusterCount * (MaxLightsPerCluster + 1);
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT) * elementCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pClusterLights);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pClusterLights, "ClusterLights");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = elementCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pClusterLights, &srvDesc, &m_pClusterLightsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pClusterLightsSRV, "ClusterLightsSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = elementCount;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pClusterLights, &uavDesc, &m_pClusterLightsUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pClusterLightsUAV, "ClusterLightsUAV");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitSort()
+{
+    HRESULT result = CompileAndCreateShader(L"BitonicSort.cs", (ID3D11DeviceChild**)&m_pSortKeysShader, { "SORT_KEYS" });
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"BitonicSort.cs", (ID3D11DeviceChild**)&m_pSortLocalShader, { "SORT_LOCAL" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"BitonicSort.cs", (ID3D11DeviceChild**)&m_pSortGlobalShader, { "SORT_GLOBAL" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"BitonicSort.cs", (ID3D11DeviceChild**)&m_pSortWriteShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(SortParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pSortParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSortParams, "SortParams");
+        }
+    }
+    // Create sort keys, distance and id pairs
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = 2 * sizeof(UINT) * MaxSortKeys;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = 2 * sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pSortKeys);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSortKeys, "SortKeys");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxSortKeys;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pSortKeys, &uavDesc, &m_pSortKeysUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSortKeysUAV, "SortKeysUAV");
+        }
+    }
+    // Create write pass dispatch arguments, group count in x is built from visible count of mesh LOD
+    if (SUCCEEDED(result))
+    {
+        UINT args[InstanceDrawCount * 3];
+        for (UINT i = 0; i < InstanceDrawCount; i++)
+        {
+            args[i * 3] = 0;
+            args[i * 3 + 1] = 1;
+            args[i * 3 + 2] = 1;
+        }
+
+        result = CreateIndirectArgs(args, InstanceDrawCount * 3, 0, &m_pSortWriteArgs, &m_pSortWriteArgsUAV, nullptr, "SortWriteArgs");
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitShadows()
+{
+    HRESULT result = m_shadowCB.Init(m_pDevice, "ShadowBuffer");
+    for (UINT i = 0; i < CascadeCount && SUCCEEDED(result); i++)
+    {
+        result = m_cascadeCBs[i].Init(m_pDevice, "CascadeSceneBuffer" + std::to_string(i));
+    }
+    if (SUCCEEDED(result) && m_constantOffsets)
+    {
+        result = m_constantRing.Init(m_pDevice, 64 * 1024, "ConstantRing");
+    }
+    // Create shadow atlas, reversed Z like the scene depth
+    if (SUCCEEDED(result))
+    {
+        D3D11_TEXTURE2D_DESC desc;
+        desc.Format = DXGI_FORMAT_R32_TYPELESS;
+        desc.ArraySize = 1;
+        desc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.SampleDesc.Count = 1;
+        desc.SampleDesc.Quality = 0;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.Width = CascadeSize * CascadeCount;
+        desc.Height = CascadeSize;
+        desc.MipLevels = 1;
+
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pShadowAtlas);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pShadowAtlas, "ShadowAtlas");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+            dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+            dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+
+            result = m_pDevice->CreateDepthStencilView(m_pShadowAtlas, &dsvDesc, &m_pShadowAtlasDSV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pShadowAtlasDSV, "ShadowAtlasDSV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+            srvDesc.Texture2D.MipLevels = 1;
+
+            result = m_pDevice->CreateShaderResourceView(m_pShadowAtlas, &srvDesc, &m_pShadowAtlasSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pShadowAtlasSRV, "ShadowAtlasSRV");
+        }
+    }
+    // Receiver is lit when it is not farther from the sun than the caster, that is its reversed depth is not less
+    if (SUCCEEDED(result))
+    {
+        D3D11_SAMPLER_DESC desc = {};
+        desc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+        desc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+        desc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+        desc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+        desc.MinLOD = 0.0f;
+        desc.MaxLOD = 0.0f;
+        desc.MipLODBias = 0.0f;
+        desc.MaxAnisotropy = 1;
+        desc.ComparisonFunc = D3D11_COMPARISON_GREATER_EQUAL;
+
+        result = m_samplerCache.Get(m_pDevice, desc, "ShadowSampler", &m_pShadowSampler);
+    }
+    // Slope bias pushes casters away from the sun, which is to smaller depth
+    if (SUCCEEDED(result))
+    {
+        D3D11_RASTERIZER_DESC desc = {};
+        desc.AntialiasedLineEnable = FALSE;
+        desc.FillMode = D3D11_FILL_SOLID;
+        desc.CullMode = D3D11_CULL_NONE;
+        desc.FrontCounterClockwise = FALSE;
+        desc.DepthBias = 0;
+        desc.SlopeScaledDepthBias = -2.0f;
+        desc.DepthBiasClamp = 0.0f;
+        desc.DepthClipEnable = TRUE;
+        desc.ScissorEnable = FALSE;
+        desc.MultisampleEnable = FALSE;
+
+        result = m_stateObjects.GetRasterizerState(m_pDevice, desc, "ShadowRasterizerState", &m_pShadowRasterizerState);
+    }
+    if (SUCCEEDED(result))
+    {
+        OcclusionParams occlusionParams = {};
+        occlusionParams.vp = DirectX::XMMatrixIdentity();
+
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(OcclusionParams);
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = &occlusionParams;
+        data.SysMemPitch = sizeof(occlusionParams);
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pNoOcclusionParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pNoOcclusionParams, "NoOcclusionParams");
+        }
+    }
+    // Arguments and visible ids of each cascade have the same layout as the ones of camera view
+    for (UINT i = 0; i < CascadeCount && SUCCEEDED(result); i++)
+    {
+        // Filled by copy of MeshArgsReset before each cull
+        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args[InstanceDrawCount] = {};
+        result = CreateIndirectArgs((const UINT*)args, sizeof(args) / sizeof(UINT), 0, &m_pShadowArgs[i], &m_pShadowArgsUAV[i], nullptr, "ShadowArgs" + std::to_string(i));
+        if (SUCCEEDED(result))
+        {
+            D3D11_BUFFER_DESC desc = {};
+            desc.ByteWidth = sizeof(UINT) * MaxInst * InstanceDrawCount;
+            desc.Usage = D3D11_USAGE_DEFAULT;
+            desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+            desc.CPUAccessFlags = 0;
+            desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+            desc.StructureByteStride = sizeof(UINT);
+
+            result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pShadowIds[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pShadowIds[i], "ShadowIds" + std::to_string(i));
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxInst * InstanceDrawCount;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pShadowIds[i], &uavDesc, &m_pShadowIdsUAV[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pShadowIdsUAV[i], "ShadowIdsUAV" + std::to_string(i));
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxInst * InstanceDrawCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pShadowIds[i], &srvDesc, &m_pShadowIdsSRV[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pShadowIdsSRV[i], "ShadowIdsSRV" + std::to_string(i));
+        }
+    }
+    // Single pass cascades have one set of arguments, each mesh LOD starts at its segment of CascadeCount * MaxInst tagged ids
+    if (SUCCEEDED(result) && m_multiViewSupported)
+    {
+        result = CompileAndCreateShader(L"FrustumCull.cs", (ID3D11DeviceChild**)&m_pMultiViewCullShader, { "MULTI_VIEW" });
+        if (SUCCEEDED(result))
+        {
+            result = m_multiViewCB.Init(m_pDevice, "MultiViewBuffer");
+        }
+
+        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args[InstanceDrawCount];
+        FillInstanceDrawArgs(args, MaxInst * CascadeCount);
+        if (SUCCEEDED(result))
+        {
+            result = CreateIndirectArgs((const UINT*)args, sizeof(args) / sizeof(UINT), 0, &m_pMultiViewArgs, &m_pMultiViewArgsUAV, nullptr, "MultiViewArgs");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_BUFFER_DESC desc = {};
+            desc.ByteWidth = sizeof(args);
+            desc.Usage = D3D11_USAGE_IMMUTABLE;
+            desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+            desc.CPUAccessFlags = 0;
+            desc.MiscFlags = 0;
+            desc.StructureByteStride = 0;
+
+            D3D11_SUBRESOURCE_DATA data;
+            data.pSysMem = args;
+            data.SysMemPitch = desc.ByteWidth;
+            data.SysMemSlicePitch = 0;
+
+            result = m_pDevice->CreateBuffer(&desc, &data, &m_pMultiViewArgsReset);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMultiViewArgsReset, "MultiViewArgsReset");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_BUFFER_DESC desc = {};
+            desc.ByteWidth = sizeof(UINT) * MaxInst * InstanceDrawCount * CascadeCount;
+            desc.Usage = D3D11_USAGE_DEFAULT;
+            desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+            desc.CPUAccessFlags = 0;
+            desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+            desc.StructureByteStride = sizeof(UINT);
+
+            result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pMultiViewIds);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMultiViewIds, "MultiViewIds");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxInst * InstanceDrawCount * CascadeCount;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pMultiViewIds, &uavDesc, &m_pMultiViewIdsUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMultiViewIdsUAV, "MultiViewIdsUAV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxInst * InstanceDrawCount * CascadeCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pMultiViewIds, &srvDesc, &m_pMultiViewIdsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMultiViewIdsSRV, "MultiViewIdsSRV");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitDeferredShading()
+{
+    HRESULT result = CompileShaderVariants(L"SimpleTexture.ps", (ID3D11DeviceChild**)m_pGBufferPixelShaders, GBufferVariants, { "GBUFFER" });
+    if (SUCCEEDED(result))
+    {
+        result = CompileShaderVariants(L"DeferredLighting.cs", (ID3D11DeviceChild**)m_pResolveShaders, LitVariants);
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(ResolveParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pResolveParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pResolveParams, "ResolveParams");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitSphere()
+{
+    static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+
+    HRESULT result = S_OK;
+
+    static const size_t SphereSteps = 32;
+
+    std::vector<Point3f> sphereVertices;
+    std::vector<UINT16> indices;
+
+    size_t indexCount;
+    size_t vertexCount;
+
+    GetSphereDataSize(SphereSteps, SphereSteps, indexCount, vertexCount);
+
+    sphereVertices.resize(vertexCount);
+    indices.resize(indexCount);
+
+    CreateSphere(SphereSteps, SphereSteps, indices.data(), sphereVertices.data());
+
+    m_sphereMesh = m_geometryPool.AddMesh(GeometryPool::VertexFormatPosition, sizeof(Point3f), sphereVertices.data(), (UINT)sphereVertices.size(), indices.data(), (UINT)indices.size());
+
+    ID3DBlob* pSphereVertexShaderCode = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"SphereTexture.vs", (ID3D11DeviceChild**)&m_pSphereVertexShader, {}, &pSphereVertexShaderCode);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"SphereTexture.ps", (ID3D11DeviceChild**)&m_pSpherePixelShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"SphereTexture.vs", (ID3D11DeviceChild**)&m_pSkyTriangleVertexShader, { "SCREEN_TRIANGLE" });
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateInputLayout(InputDesc, 1, pSphereVertexShaderCode->GetBufferPointer(), pSphereVertexShaderCode->GetBufferSize(), &m_pSphereInputLayout);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSphereInputLayout, "SphereInputLayout");
+        }
+    }
+
+    SAFE_RELEASE(pSphereVertexShaderCode);
+
+    // Instance counts are written by bulb culling
+    if (SUCCEEDED(result))
+    {
+        const GeometryPool::Mesh& mesh = m_geometryPool.GetMesh(m_sphereMesh);
+        const UINT args[] = {
+            3, 1, 0, 0,
+            mesh.indexCount, 1, mesh.startIndex, (UINT)mesh.baseVertex, 0
+        };
+        result = CreateIndirectArgs(args, sizeof(args) / sizeof(UINT), 0, &m_pSkyArgs, &m_pSkyArgsUAV, nullptr, "SkyArgs");
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitSmallSphere()
+{
+    static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+
+    HRESULT result = S_OK;
+
+    static const size_t SphereSteps = 8;
+
+    std::vector<Point3f> sphereVertices;
+    std::vector<UINT16> indices;
+
+    size_t indexCount;
+    size_t vertexCount;
+
+    GetSphereDataSize(SphereSteps, SphereSteps, indexCount, vertexCount);
+
+    sphereVertices.resize(vertexCount);
+    indices.resize(indexCount);
+
+    CreateSphere(SphereSteps, SphereSteps, indices.data(), sphereVertices.data());
+
+    for (auto& v : sphereVertices)
+    {
+        v = v * LightBulbRadius;
+    }
+
+    m_smallSphereMesh = m_geometryPool.AddMesh(GeometryPool::VertexFormatPosition, sizeof(Point3f), sphereVertices.data(), (UINT)sphereVertices.size(), indices.data(), (UINT)indices.size());
+
+    ID3DBlob* pSmallSphereVertexShaderCode = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"LightBulb.vs", (ID3D11DeviceChild**)&m_pSmallSphereVertexShader, {}, &pSmallSphereVertexShaderCode);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"LightBulb.ps", (ID3D11DeviceChild**)&m_pSmallSpherePixelShader);
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateInputLayout(InputDesc, 1, pSmallSphereVertexShaderCode->GetBufferPointer(), pSmallSphereVertexShaderCode->GetBufferSize(), &m_pSmallSphereInputLayout);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSmallSphereInputLayout, "SmallSphereInputLayout");
+        }
+    }
+
+    SAFE_RELEASE(pSmallSphereVertexShaderCode);
+
+    // Create draw arguments, bulb per visible light
+    if (SUCCEEDED(result))
+    {
+        const GeometryPool::Mesh& mesh = m_geometryPool.GetMesh(m_smallSphereMesh);
+        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args;
+        args.IndexCountPerInstance = mesh.indexCount;
+        args.InstanceCount = 0;
+        args.StartIndexLocation = mesh.startIndex;
+        args.BaseVertexLocation = mesh.baseVertex;
+        args.StartInstanceLocation = 0;
+
+        // Only written by copy of visible light count
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(args);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+        desc.StructureByteStride = 0;
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = &args;
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pBulbArgs);
+        assert(SUCCEEDED(result));
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pBulbArgs, "BulbArgs");
+        }
+    }
+
+    // Impostor bulbs are quads generated from vertex id, sphere is ray traced in pixel shader
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"LightBulb.vs", (ID3D11DeviceChild**)&m_pBulbImpostorVertexShader, { "IMPOSTOR" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"LightBulb.ps", (ID3D11DeviceChild**)&m_pBulbImpostorPixelShader, { "IMPOSTOR" });
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_DRAW_INSTANCED_INDIRECT_ARGS args;
+        args.VertexCountPerInstance = 6;
+        args.InstanceCount = 0;
+        args.StartVertexLocation = 0;
+        args.StartInstanceLocation = 0;
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(args);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+        desc.StructureByteStride = 0;
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = &args;
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pBulbImpostorArgs);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pBulbImpostorArgs, "BulbImpostorArgs");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::CreateImpostors()
+{
+    static const UINT AtlasSize = ImpostorFrames * ImpostorFrameSize;
+
+    // Bake shaders read instanced meshes with the same input layout as cubes
+    ID3D11VertexShader* pBakeVertexShader = nullptr;
+    ID3D11PixelShader* pBakePixelShader = nullptr;
+    std::vector<std::string> defines;
+    if (m_packedVertices)
+    {
+        defines.push_back("PACKED_VERTEX");
+    }
+    HRESULT result = CompileAndCreateShader(L"ImpostorBake.vs", (ID3D11DeviceChild**)&pBakeVertexShader, defines);
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"ImpostorBake.ps", (ID3D11DeviceChild**)&pBakePixelShader);
+    }
+
+    // Create atlases, slice per instanced mesh, frames are cells of ImpostorFrames x ImpostorFrames grid
+    if (SUCCEEDED(result))
+    {
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width = AtlasSize;
+        desc.Height = AtlasSize;
+        desc.MipLevels = 1;
+        desc.ArraySize = InstanceMeshCount;
+        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.SampleDesc.Count = 1;
+        desc.SampleDesc.Quality = 0;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pImpostorNormals);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pImpostorNormals, "ImpostorNormals");
+        }
+        if (SUCCEEDED(result))
+        {
+            desc.Format = DXGI_FORMAT_R16G16_FLOAT;
+            result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pImpostorUVs);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pImpostorUVs, "ImpostorUVs");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pImpostorNormals, nullptr, &m_pImpostorNormalsSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pImpostorNormalsSRV, "ImpostorNormalsSRV");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pImpostorUVs, nullptr, &m_pImpostorUVsSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pImpostorUVsSRV, "ImpostorUVsSRV");
+    }
+
+    // Bake depth is reused by all slices and released after bake
+    ID3D11Texture2D* pBakeDepth = nullptr;
+    ID3D11DepthStencilView* pBakeDepthDSV = nullptr;
+    if (SUCCEEDED(result))
+    {
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width = AtlasSize;
+        desc.Height = AtlasSize;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_D32_FLOAT;
+        desc.SampleDesc.Count = 1;
+        desc.SampleDesc.Quality = 0;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &pBakeDepth);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateDepthStencilView(pBakeDepth, nullptr, &pBakeDepthDSV);
+    }
+    ID3D11Buffer* pBakeParams = nullptr;
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(Point4i);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &pBakeParams);
+    }
+
+    // Bake runs in between frames, so it has a cache of its own on immediate context
+    if (SUCCEEDED(result))
+    {
+        StateCache state;
+        state.SetContext(m_pDeviceContext);
+
+        Pipeline pipeline = {
+            pBakeVertexShader, pBakePixelShader, m_pInputLayout, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+            m_pOpaqueBlendState, m_pDepthState, m_pRasterizerState
+        };
+        state.SetPipeline(pipeline);
+        D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (FLOAT)AtlasSize, (FLOAT)AtlasSize, 0.0f, 1.0f };
+        state.RSSetViewports(1, &viewport);
+        ID3D11Buffer* cbuffers[] = { pBakeParams };
+        state.VSSetConstantBuffers(0, 1, cbuffers);
+
+        m_geometryPool.Bind(state, m_packedVertices ? GeometryPool::VertexFormatPacked : GeometryPool::VertexFormatTextured);
+        ID3D11Buffer* instanceBuffers[] = { m_pInstanceIndices };
+        UINT instanceStrides[] = { sizeof(UINT) };
+        UINT instanceOffsets[] = { 0 };
+        state.IASetVertexBuffers(1, 1, instanceBuffers, instanceStrides, instanceOffsets);
+
+        // Finest LOD of each mesh, instance per frame
+        for (UINT mesh = 0; mesh < InstanceMeshCount && SUCCEEDED(result); mesh++)
+        {
+            D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+            rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+            rtvDesc.Texture2DArray.MipSlice = 0;
+            rtvDesc.Texture2DArray.FirstArraySlice = mesh;
+            rtvDesc.Texture2DArray.ArraySize = 1;
+
+            ID3D11RenderTargetView* views[2] = {};
+            rtvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+            result = m_pDevice->CreateRenderTargetView(m_pImpostorNormals, &rtvDesc, &views[0]);
+            if (SUCCEEDED(result))
+            {
+                rtvDesc.Format = DXGI_FORMAT_R16G16_FLOAT;
+                result = m_pDevice->CreateRenderTargetView(m_pImpostorUVs, &rtvDesc, &views[1]);
+            }
+            if (SUCCEEDED(result))
+            {
+                static const FLOAT ClearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                m_pDeviceContext->ClearRenderTargetView(views[0], ClearColor);
+                m_pDeviceContext->ClearRenderTargetView(views[1], ClearColor);
+                m_pDeviceContext->ClearDepthStencilView(pBakeDepthDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
+
+                Point4i bakeParams = Point4i{ (int)mesh, 0, 0, 0 };
+                m_pDeviceContext->UpdateSubresource(pBakeParams, 0, nullptr, &bakeParams, 0, 0);
+
+                state.OMSetRenderTargets(2, views, pBakeDepthDSV);
+                UINT meshId = m_instanceMeshes[mesh * MaxLods];
+                m_geometryPool.BindIndexBuffer(state, meshId);
+                m_geometryPool.DrawInstanced(state, meshId, ImpostorFrames * ImpostorFrames);
+            }
+            state.OMSetRenderTargets(0, nullptr, nullptr);
+            SAFE_RELEASE(views[0]);
+            SAFE_RELEASE(views[1]);
+        }
+    }
+
+    m_immediateState.Invalidate();
+
+    SAFE_RELEASE(pBakeParams);
+    SAFE_RELEASE(pBakeDepthDSV);
+    SAFE_RELEASE(pBakeDepth);
+    m_shaderReloader.Unregister((ID3D11DeviceChild**)&pBakePixelShader);
+    m_shaderReloader.Unregister((ID3D11DeviceChild**)&pBakeVertexShader);
+    SAFE_RELEASE(pBakePixelShader);
+    SAFE_RELEASE(pBakeVertexShader);
+
+    // Impostor draws read only the per instance index into visible ids, quad corners come from vertex id
+    ID3DBlob* pVertexShaderCode = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Impostor.vs", (ID3D11DeviceChild**)&m_pImpostorVertexShader, {}, &pVertexShaderCode);
+    }
+    if (SUCCEEDED(result))
+    {
+        static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
+            {"INSTANCE", 0, DXGI_FORMAT_R32_UINT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1}
+        };
+
+        result = m_pDevice->CreateInputLayout(InputDesc, 1, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &m_pImpostorInputLayout);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pImpostorInputLayout, "ImpostorInputLayout");
+        }
+    }
+    SAFE_RELEASE(pVertexShaderCode);
+    if (SUCCEEDED(result))
+    {
+        result = CompileShaderVariants(L"Impostor.ps", (ID3D11DeviceChild**)m_pImpostorPixelShaders, ImpostorVariants);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileShaderVariants(L"Impostor.ps", (ID3D11DeviceChild**)m_pImpostorGBufferPixelShaders, ImpostorGBufferVariants, { "GBUFFER" });
+    }
+
+    if (FAILED(result))
+    {
+        TermImpostors();
+    }
+
+    return result;
+}
+
+void Renderer::TermImpostors()
+{
+    m_shaderReloader.Unregister((ID3D11DeviceChild**)&m_pImpostorVertexShader);
+    m_shaderReloader.Unregister((ID3D11DeviceChild**)m_pImpostorPixelShaders, ShaderVariantCount);
+    m_shaderReloader.Unregister((ID3D11DeviceChild**)m_pImpostorGBufferPixelShaders, ShaderVariantCount);
+
+    SAFE_RELEASE(m_pImpostorNormals);
+    SAFE_RELEASE(m_pImpostorNormalsSRV);
+    SAFE_RELEASE(m_pImpostorUVs);
+    SAFE_RELEASE(m_pImpostorUVsSRV);
+    SAFE_RELEASE(m_pImpostorVertexShader);
+    SAFE_RELEASE(m_pImpostorInputLayout);
+    for (UINT i = 0; i < ShaderVariantCount; i++)
+    {
+        SAFE_RELEASE(m_pImpostorPixelShaders[i]);
+        SAFE_RELEASE(m_pImpostorGBufferPixelShaders[i]);
+    }
+}
+
+HRESULT Renderer::InitRect()
+{
+    static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+
+    static const ColorVertex Vertices[] =
+    {
+        {0.0, -0.75, -0.75, RGB(128,0,128)},
+        {0.0,  0.75, -0.75, RGB(128,0,128)},
+        {0.0,  0.75,  0.75, RGB(128,0,128)},
+        {0.0, -0.75,  0.75, RGB(128,0,128)}
+    };
+    static const UINT16 Indices[] = {
+        0, 1, 2,
+        0, 2, 3
+    };
+
+    HRESULT result = S_OK;
+
+    m_rectMesh = m_geometryPool.AddMesh(GeometryPool::VertexFormatColor, sizeof(ColorVertex), Vertices, 4, Indices, 6);
+
+    ID3DBlob* pRectVertexShaderCode = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"TransColor.vs", (ID3D11DeviceChild**)&m_pRectVertexShader, { "SORTED" }, &pRectVertexShaderCode);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileShaderVariants(L"TransColor.ps", (ID3D11DeviceChild**)m_pRectPixelShaders, LitVariants, { "USE_LIGHTS" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"TransColor.vs", (ID3D11DeviceChild**)&m_pRectOitVertexShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileShaderVariants(L"TransColor.ps", (ID3D11DeviceChild**)m_pRectOitPixelShaders, LitVariants, { "USE_LIGHTS", "OIT" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Fullscreen.vs", (ID3D11DeviceChild**)&m_pFullscreenVertexShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"OitComposite.ps", (ID3D11DeviceChild**)&m_pOitCompositePixelShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"OitComposite.ps", (ID3D11DeviceChild**)&m_pOitCompositeMsaaPixelShader, { "MSAA" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"LowResDepth.ps", (ID3D11DeviceChild**)&m_pLowResDepthPixelShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"LowResComposite.ps", (ID3D11DeviceChild**)&m_pLowResCompositePixelShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_lowResTransCB.Init(m_pDevice, "LowResTransBuffer");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"BitonicSort.cs", (ID3D11DeviceChild**)&m_pRectCullShader, { "CULL_TRANSPARENT" });
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateInputLayout(InputDesc, 2, pRectVertexShaderCode->GetBufferPointer(), pRectVertexShaderCode->GetBufferSize(), &m_pRectInputLayout);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectInputLayout, "RectInputLayout");
+        }
+    }
+
+    SAFE_RELEASE(pRectVertexShaderCode);
+
+    static const Point3f RectPos[RectCount] = { Rect0Pos, Rect1Pos };
+
+    AABB meshBounds;
+    for (int i = 0; i < 4; i++)
+    {
+        AABB vertex;
+        vertex.vmin = vertex.vmax = Point3f{ Vertices[i].x, Vertices[i].y, Vertices[i].z };
+        meshBounds.Add(vertex);
+    }
+
+    RectGeomBuffer rects[RectCount];
+    AABB rectBounds[RectCount];
+    for (UINT i = 0; i < RectCount; i++)
+    {
+        rects[i].m = DirectX::XMMatrixTranslation(RectPos[i].x, RectPos[i].y, RectPos[i].z);
+        rectBounds[i].vmin = meshBounds.vmin + RectPos[i];
+        rectBounds[i].vmax = meshBounds.vmax + RectPos[i];
+        m_rectsBounds.Add(rectBounds[i]);
+    }
+    rects[0].color = Point4f{ 0.5f, 0, 0.5f, 0.5f };
+    rects[1].color = Point4f{ 0.5f, 0.5f, 0, 0.5f };
+
+    // Create instance buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(RectGeomBuffer) * RectCount;
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(RectGeomBuffer);
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = rects;
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pRectInstBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectInstBuffer, "RectInstBuffer");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = RectCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pRectInstBuffer, &srvDesc, &m_pRectInstBufferSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectInstBufferSRV, "RectInstBufferSRV");
+        }
+    }
+    // Create bounds buffer, read by transparent cull
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(AABB) * RectCount;
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(AABB);
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = rectBounds;
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pRectBounds);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectBounds, "RectBounds");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = RectCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pRectBounds, &srvDesc, &m_pRectBoundsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectBoundsSRV, "RectBoundsSRV");
+        }
+    }
+    // Create visible ids buffer, written by sort and read by vertex shader
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT) * RectCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pRectIds);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectIds, "RectIds");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = RectCount;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pRectIds, &uavDesc, &m_pRectIdsUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectIdsUAV, "RectIdsUAV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = RectCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pRectIds, &srvDesc, &m_pRectIdsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectIdsSRV, "RectIdsSRV");
+        }
+    }
+    // Create indirect arguments, instance count is the visible count
+    if (SUCCEEDED(result))
+    {
+        const GeometryPool::Mesh& mesh = m_geometryPool.GetMesh(m_rectMesh);
+
+        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args;
+        args.IndexCountPerInstance = mesh.indexCount;
+        args.InstanceCount = 0;
+        args.StartIndexLocation = mesh.startIndex;
+        args.BaseVertexLocation = mesh.baseVertex;
+        args.StartInstanceLocation = 0;
+
+        result = CreateIndirectArgs((const UINT*)&args, sizeof(args) / sizeof(UINT), 0, &m_pRectArgs, &m_pRectArgsUAV, nullptr, "RectArgs");
+        if (SUCCEEDED(result))
+        {
+            // Instance count is reset each frame by copy of initial arguments
+            D3D11_BUFFER_DESC desc = {};
+            desc.ByteWidth = sizeof(args);
+            desc.Usage = D3D11_USAGE_IMMUTABLE;
+            desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+            desc.CPUAccessFlags = 0;
+            desc.MiscFlags = 0;
+            desc.StructureByteStride = 0;
+
+            D3D11_SUBRESOURCE_DATA data;
+            data.pSysMem = &args;
+            data.SysMemPitch = desc.ByteWidth;
+            data.SysMemSlicePitch = 0;
+
+            result = m_pDevice->CreateBuffer(&desc, &data, &m_pRectArgsReset);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRectArgsReset, "RectArgsReset");
+        }
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = InitRectTexture();
+    }
+
+    return result;
+}
+
+HRESULT Renderer::InitRectTexture()
+{
+    // Procedural glass tiles pattern, mips and compression are done on GPU
+    const UINT Size = 256;
+    const UINT TileCount = 4;
+    const UINT GroutWidth = 6;
+
+    std::vector<UINT32> pixels(Size * Size);
+    for (UINT y = 0; y < Size; y++)
+    {
+        for (UINT x = 0; x < Size; x++)
+        {
+            UINT tileX = x % (Size / TileCount);
+            UINT tileY = y % (Size / TileCount);
+            bool grout = tileX < GroutWidth / 2 || tileX >= Size / TileCount - GroutWidth / 2
+                || tileY < GroutWidth / 2 || tileY >= Size / TileCount - GroutWidth / 2;
+            pixels[y * Size + x] = grout ? 0xFF666666 : 0xFFFFFFFF;
+        }
+    }
+
+    ID3D11Texture2D* pSource = nullptr;
+    HRESULT result = TextureProcessor::CreateTarget(m_pDevice, Size, Size, "RectTextureSource", &pSource);
+    if (SUCCEEDED(result))
+    {
+        StallDetector::Get().UpdateSubresource(m_pDeviceContext, pSource, 0, nullptr, pixels.data(), Size * sizeof(UINT32), 0, STALL_SITE);
+
+        result = m_textureProcessor.GenerateMips(m_pDevice, m_pDeviceContext, pSource);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_textureProcessor.CompressBC1(m_pDevice, m_pDeviceContext, pSource, "RectTexture", &m_pRectTexture);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pRectTexture, nullptr, &m_pRectTextureSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pRectTextureSRV, "RectTextureSRV");
+    }
+    SAFE_RELEASE(pSource);
+
+    m_immediateState.Invalidate();
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitCubemap()
+{
+    HRESULT result = TextureStreamer::CreatePlaceholder(m_pDevice, 6, true, 0xFF806040, "Cubemap", &m_pCubemapTexture, &m_pCubemapView);
+    if (SUCCEEDED(result))
+    {
+        // Single cubemap file, e.g. BC6H, is preferred over separate faces
+        const std::wstring CubemapName = L"../Common/Cubemap.dds";
+
+        TextureStreamer::Request request;
+        if (GetFileAttributesW(CubemapName.c_str()) != INVALID_FILE_ATTRIBUTES)
+        {
+            request.files = { CubemapName };
+        }
+        else
+        {
+            request.files =
+            {
+                L"../Common/posx.dds", L"../Common/negx.dds",
+                L"../Common/posy.dds", L"../Common/negy.dds",
+                L"../Common/posz.dds", L"../Common/negz.dds"
+            };
+        }
+        request.cube = true;
+        request.singleMip = true;
+        request.name = "Cubemap";
+        request.ppTexture = &m_pCubemapTexture;
+        request.ppView = &m_pCubemapView;
+        m_textureStreamer.Load(request);
+    }
+
+    return result;
+}
+
+HRESULT Renderer::InitSkyAmbient()
+{
+    HRESULT result = CompileAndCreateShader(L"SkyAmbient.cs", (ID3D11DeviceChild**)&m_pSkyAmbientShader);
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(SkyAmbientParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pSkyAmbientParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSkyAmbientParams, "SkyAmbientParams");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(Point4f) * SkyAmbientCoeffCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pSkyAmbientCoeffs);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSkyAmbientCoeffs, "SkyAmbientCoeffs");
+        }
+
+        // Same size, so coefficients are copied as whole resource
+        if (SUCCEEDED(result))
+        {
+            desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+            result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pAmbientCB);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pAmbientCB, "AmbientBuffer");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC desc = {};
+        desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        desc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        desc.Buffer.FirstElement = 0;
+        desc.Buffer.NumElements = SkyAmbientCoeffCount;
+
+        result = m_pDevice->CreateUnorderedAccessView(m_pSkyAmbientCoeffs, &desc, &m_pSkyAmbientCoeffsUAV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pSkyAmbientCoeffsUAV, "SkyAmbientCoeffsUAV");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void Renderer::UpdateSkyAmbient()
+{
+    // Placeholder cubemap is projected too, its color is close enough until the streamed one arrives
+    if (m_skyAmbient && m_pCubemapView != m_pSkyAmbientSource)
+    {
+        m_updateSkyAmbient = true;
+    }
+    if (!m_updateSkyAmbient)
+    {
+        return;
+    }
+    m_updateSkyAmbient = false;
+
+    SAFE_RELEASE(m_pSkyAmbientSource);
+    if (!m_skyAmbient)
+    {
+        Point4f coeffs[SkyAmbientCoeffCount] = {};
+        coeffs[0] = m_settingsBuffer.ambientColor;
+        StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pAmbientCB, 0, nullptr, coeffs, 0, 0, STALL_SITE);
+        return;
+    }
+
+    m_pSkyAmbientSource = m_pCubemapView;
+    m_pSkyAmbientSource->AddRef();
+
+    SkyAmbientParams params;
+    params.ambientParams = Point4f{ m_skyAmbientIntensity, 0.0f, 0.0f, 0.0f };
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pSkyAmbientParams, 0, nullptr, &params, 0, 0, STALL_SITE);
+
+    ID3D11Buffer* constBuffers[1] = { m_pSkyAmbientParams };
+    m_pDeviceContext->CSSetConstantBuffers(0, 1, constBuffers);
+    ID3D11ShaderResourceView* srvs[1] = { m_pCubemapView };
+    m_pDeviceContext->CSSetShaderResources(0, 1, srvs);
+    ID3D11SamplerState* samplers[1] = { m_pSampler };
+    m_pDeviceContext->CSSetSamplers(0, 1, samplers);
+    ID3D11UnorderedAccessView* uavs[1] = { m_pSkyAmbientCoeffsUAV };
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+    m_pDeviceContext->CSSetShader(m_pSkyAmbientShader, nullptr, 0);
+
+    m_pDeviceContext->Dispatch(1, 1, 1);
+
+    ID3D11UnorderedAccessView* nullUAVs[1] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, nullptr);
+    ID3D11ShaderResourceView* nullSRVs[1] = {};
+    m_pDeviceContext->CSSetShaderResources(0, 1, nullSRVs);
+
+    m_pDeviceContext->CopyResource(m_pAmbientCB, m_pSkyAmbientCoeffs);
+
+    m_immediateState.Invalidate();
+}
+
+HRESULT Renderer::InitPostProcess()
+{
+    HRESULT result = S_OK;
+
+    PostProcess::CreateShader createShader = [this](const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines)
+    {
+        return CompileAndCreateShader(path, ppShader, defines);
+    };
+    result = m_postProcess.Init(m_pDevice, createShader);
+    if (SUCCEEDED(result))
+    {
+        result = m_videoRecorder.Init(m_pDevice, createShader);
+    }
+
+    return result;
+}
+
+HRESULT Renderer::InitCull()
+{
+    HRESULT result = S_OK;
+
+    // Create shader
+    result = CompileAndCreateShader(L"FrustumCull.cs", (ID3D11DeviceChild**)&m_pCullShader);
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"FrustumCull.cs", (ID3D11DeviceChild**)&m_pCullAtomicShader, { "PER_THREAD_APPEND" });
+    }
+    // Create indirect arguments buffer
+    if (SUCCEEDED(result))
+    {
+        // One record per instanced mesh, each mesh has its own segment of MaxInst visible ids
+        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args[InstanceDrawCount];
+        FillInstanceDrawArgs(args, MaxInst);
+
+        result = CreateIndirectArgs((const UINT*)args, sizeof(args) / sizeof(UINT), 0, &m_pIndirectArgs, &m_pIndirectArgsUAV, nullptr, "IndirectArgs");
+        if (SUCCEEDED(result))
+        {
+            // Instance counts are reset each frame by copy of initial arguments
+            D3D11_BUFFER_DESC desc = {};
+            desc.ByteWidth = sizeof(args);
+            desc.Usage = D3D11_USAGE_IMMUTABLE;
+            desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+            desc.CPUAccessFlags = 0;
+            desc.MiscFlags = 0;
+            desc.StructureByteStride = 0;
+
+            D3D11_SUBRESOURCE_DATA data;
+            data.pSysMem = args;
+            data.SysMemPitch = desc.ByteWidth;
+            data.SysMemSlicePitch = 0;
+
+            result = m_pDevice->CreateBuffer(&desc, &data, &m_pMeshArgsReset);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshArgsReset, "MeshArgsReset");
+        }
+    }
+    // Create culling params buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(CullParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pCullParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pCullParams, "CullParams");
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pShadowCullParams);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pShadowCullParams, "ShadowCullParams");
+        }
+    }
+    // Create instance bounds buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(AABB) * MaxInst;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(AABB);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pInstBounds);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstBounds, "InstBounds");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxInst;
+
+            result = m_pDevice->CreateShaderResourceView(m_pInstBounds, &srvDesc, &m_pInstBoundsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstBoundsSRV, "InstBoundsSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxInst;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pInstBounds, &uavDesc, &m_pInstBoundsUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstBoundsUAV, "InstBoundsUAV");
+        }
+    }
+    // Scatter kernels for instances and bounds
+    ScatterUpload::CreateShader createShader = [this](const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines)
+    {
+        return CompileAndCreateShader(path, ppShader, defines);
+    };
+    if (SUCCEEDED(result))
+    {
+        result = m_geomScatter.Init(m_pDevice, sizeof(InstanceStore::GpuInstance), ScatterCapacity, createShader, "GeomScatter");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_boundsScatter.Init(m_pDevice, sizeof(AABB), ScatterCapacity, createShader, "BoundsScatter");
+    }
+    // Create output buffer
+    if (SUCCEEDED(result))
+    {
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT) * MaxInst * InstanceDrawCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE; // Read directly by vertex shader
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pGeomBufferInstVisGPU);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pGeomBufferInstVisGPU, "GeomBufferInstVisGPU");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxInst * InstanceDrawCount;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pGeomBufferInstVisGPU, &uavDesc, &m_pGeomBufferInstVisGPU_UAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pGeomBufferInstVisGPU_UAV, "GeomBufferInstVisGPU_UAV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxInst * InstanceDrawCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pGeomBufferInstVisGPU, &srvDesc, &m_pGeomBufferInstVisGPU_SRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pGeomBufferInstVisGPU_SRV, "GeomBufferInstVisGPU_SRV");
+        }
+    }
+    // Create precomputed transforms, visible instances of all draws fit MaxInst
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"InstanceTransforms.cs", (ID3D11DeviceChild**)&m_pInstanceTransformsShader);
+    }
+    static const char* TransformSetNames[TransformSetCount] = { "", "Late" };
+    for (UINT i = 0; i < TransformSetCount && SUCCEEDED(result); i++)
+    {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+        uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.FirstElement = 0;
+        uavDesc.Buffer.NumElements = MaxInst;
+        uavDesc.Buffer.Flags = 0;
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.FirstElement = 0;
+        srvDesc.Buffer.NumElements = MaxInst;
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(InstanceTransform) * MaxInst;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(InstanceTransform);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pInstanceTransforms[i]);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstanceTransforms[i], std::string(TransformSetNames[i]) + "InstanceTransforms");
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateUnorderedAccessView(m_pInstanceTransforms[i], &uavDesc, &m_pInstanceTransformsUAV[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstanceTransformsUAV[i], std::string(TransformSetNames[i]) + "InstanceTransformsUAV");
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateShaderResourceView(m_pInstanceTransforms[i], &srvDesc, &m_pInstanceTransformsSRV[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstanceTransformsSRV[i], std::string(TransformSetNames[i]) + "InstanceTransformsSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            desc.ByteWidth = sizeof(UINT) * InstanceDrawCount;
+            desc.StructureByteStride = sizeof(UINT);
+            uavDesc.Buffer.NumElements = InstanceDrawCount;
+            srvDesc.Buffer.NumElements = InstanceDrawCount;
+
+            result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pDrawBases[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDrawBases[i], std::string(TransformSetNames[i]) + "DrawBases");
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateUnorderedAccessView(m_pDrawBases[i], &uavDesc, &m_pDrawBasesUAV[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDrawBasesUAV[i], std::string(TransformSetNames[i]) + "DrawBasesUAV");
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateShaderResourceView(m_pDrawBases[i], &srvDesc, &m_pDrawBasesSRV[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDrawBasesSRV[i], std::string(TransformSetNames[i]) + "DrawBasesSRV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"DispatchArgs.cs", (ID3D11DeviceChild**)&m_pDispatchArgsShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"DispatchArgs.cs", (ID3D11DeviceChild**)&m_pDispatchArgsStructuredShader, { "STRUCTURED_COUNTS" });
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(DispatchArgsParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pDispatchArgsParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDispatchArgsParams, "DispatchArgsParams");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_statsReadback.Init(m_pDevice, StatsReadbackSize, "StatsReadback");
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::CreateClusterCull()
+{
+    // Only GPU culling reads clusters, so they are created once it runs hierarchical
+    HRESULT result = CompileAndCreateShader(L"ClusterCull.cs", (ID3D11DeviceChild**)&m_pClusterCullShader);
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"FrustumCull.cs", (ID3D11DeviceChild**)&m_pClusteredCullShader, { "CLUSTERS" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"FrustumCull.cs", (ID3D11DeviceChild**)&m_pClusteredCullAtomicShader, { "CLUSTERS", "PER_THREAD_APPEND" });
+    }
+    // Create clusters buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(Bvh::Cluster) * MaxClusters;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(Bvh::Cluster);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pClusters);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pClusters, "Clusters");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxClusters;
+
+            result = m_pDevice->CreateShaderResourceView(m_pClusters, &srvDesc, &m_pClustersSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pClustersSRV, "ClustersSRV");
+        }
+    }
+    // Create sorted instance order buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT) * MaxInst;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pInstOrder);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstOrder, "InstOrder");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxInst;
+
+            result = m_pDevice->CreateShaderResourceView(m_pInstOrder, &srvDesc, &m_pInstOrderSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pInstOrderSRV, "InstOrderSRV");
+        }
+    }
+    // Create visible clusters buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT) * MaxClusters;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pVisibleClusters);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleClusters, "VisibleClusters");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxClusters;
+
+            result = m_pDevice->CreateShaderResourceView(m_pVisibleClusters, &srvDesc, &m_pVisibleClustersSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleClustersSRV, "VisibleClustersSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxClusters;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pVisibleClusters, &uavDesc, &m_pVisibleClustersUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pVisibleClustersUAV, "VisibleClustersUAV");
+        }
+    }
+    // Create cluster dispatch arguments buffer
+    if (SUCCEEDED(result))
+    {
+        UINT args[3] = { 0, 1, 1 }; // Group count in x is calculated by ClusterCull.cs
+
+        result = CreateIndirectArgs(args, 3, 0, &m_pClusterArgs, &m_pClusterArgsUAV, &m_pClusterArgsCountUAV, "ClusterArgs");
+    }
+
+    if (FAILED(result))
+    {
+        TermClusterCull();
+    }
+    // Clusters and order are uploaded with cull params
+    m_updateCullParams = true;
+
+    return result;
+}
+
+void Renderer::TermClusterCull()
+{
+    m_shaderReloader.Unregister((ID3D11DeviceChild**)&m_pClusterCullShader);
+    m_shaderReloader.Unregister((ID3D11DeviceChild**)&m_pClusteredCullShader);
+    m_shaderReloader.Unregister((ID3D11DeviceChild**)&m_pClusteredCullAtomicShader);
+
+    SAFE_RELEASE(m_pClusterCullShader);
+    SAFE_RELEASE(m_pClusteredCullShader);
+    SAFE_RELEASE(m_pClusteredCullAtomicShader);
+    SAFE_RELEASE(m_pClusters);
+    SAFE_RELEASE(m_pClustersSRV);
+    SAFE_RELEASE(m_pInstOrder);
+    SAFE_RELEASE(m_pInstOrderSRV);
+    SAFE_RELEASE(m_pVisibleClusters);
+    SAFE_RELEASE(m_pVisibleClustersSRV);
+    SAFE_RELEASE(m_pVisibleClustersUAV);
+    SAFE_RELEASE(m_pClusterArgs);
+    SAFE_RELEASE(m_pClusterArgsUAV);
+    SAFE_RELEASE(m_pClusterArgsCountUAV);
+}
+
+HRESULT Renderer::InitAnimation()
+{
+    HRESULT result = S_OK;
+
+    // Create shader
+    result = CompileAndCreateShader(L"Animate.cs", (ID3D11DeviceChild**)&m_pAnimateShader);
+    // Create animation params buffer
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(AnimateParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pAnimateParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pAnimateParams, "AnimateParams");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitOcclusion()
+{
+    HRESULT result = S_OK;
+
+    // Create shaders
+    result = CompileAndCreateShader(L"HiZ.cs", (ID3D11DeviceChild**)&m_pHiZShader);
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"HiZ.cs", (ID3D11DeviceChild**)&m_pHiZMsaaShader, { "MSAA" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"OcclusionCull.cs", (ID3D11DeviceChild**)&m_pOcclusionCullShader);
+    }
+    // Create parameter buffers
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(HiZParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pHiZParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pHiZParams, "HiZParams");
+        }
+    }
+    for (int i = 0; i < 2 && SUCCEEDED(result); i++)
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(OcclusionParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pOcclusionParams[i]);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pOcclusionParams[i], i == 0 ? "OcclusionParamsPrev" : "OcclusionParams");
+        }
+    }
+    // Create occluded candidates list
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT) * MaxInst;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pOccludedIds);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pOccludedIds, "OccludedIds");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxInst;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pOccludedIds, &uavDesc, &m_pOccludedIdsUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pOccludedIdsUAV, "OccludedIdsUAV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pOccludedCount);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pOccludedCount, "OccludedCount");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = 1;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pOccludedCount, &uavDesc, &m_pOccludedCountUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pOccludedCountUAV, "OccludedCountUAV");
+        }
+    }
+    // Create late visible ids, read directly by vertex shader
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT) * MaxInst * InstanceDrawCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pLateIds);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pLateIds, "LateIds");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxInst * InstanceDrawCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pLateIds, &srvDesc, &m_pLateIdsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pLateIdsSRV, "LateIdsSRV");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxInst * InstanceDrawCount;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pLateIds, &uavDesc, &m_pLateIdsUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pLateIdsUAV, "LateIdsUAV");
+        }
+    }
+    // Create late draw arguments
+    if (SUCCEEDED(result))
+    {
+        // Same layout as early arguments, so both are reset from the same copy
+        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args[InstanceDrawCount];
+        FillInstanceDrawArgs(args, MaxInst);
+
+        result = CreateIndirectArgs((const UINT*)args, sizeof(args) / sizeof(UINT), 0, &m_pLateArgs, &m_pLateArgsUAV, nullptr, "LateArgs");
+    }
+    if (SUCCEEDED(result))
+    {
+        UINT args[3] = { 0, 1, 1 }; // Group count in x is built from occluded count
+
+        result = CreateIndirectArgs(args, 3, 0, &m_pOccludedArgs, &m_pOccludedArgsUAV, nullptr, "OccludedArgs");
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::CreateIndirectArgs(const UINT* pArgs, UINT argCount, UINT counterIdx, ID3D11Buffer** ppBuffer, ID3D11UnorderedAccessView** ppUAV, ID3D11UnorderedAccessView** ppCounterUAV, const std::string& name)
+{
+    // Indirect arguments can't be structured, so typed views are used.
+    // Constant arguments are set once, counter is reset with its own single element view.
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = sizeof(UINT) * argCount;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+    desc.StructureByteStride = 0;
+
+    D3D11_SUBRESOURCE_DATA data;
+    data.pSysMem = pArgs;
+    data.SysMemPitch = desc.ByteWidth;
+    data.SysMemSlicePitch = 0;
+
+    HRESULT result = m_pDevice->CreateBuffer(&desc, &data, ppBuffer);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(*ppBuffer, name);
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+        uavDesc.Format = DXGI_FORMAT_R32_UINT;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.FirstElement = 0;
+        uavDesc.Buffer.NumElements = argCount;
+        uavDesc.Buffer.Flags = 0;
+
+        result = m_pDevice->CreateUnorderedAccessView(*ppBuffer, &uavDesc, ppUAV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(*ppUAV, name + "UAV");
+    }
+    if (SUCCEEDED(result) && ppCounterUAV != nullptr)
+    {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+        uavDesc.Format = DXGI_FORMAT_R32_UINT;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.FirstElement = counterIdx;
+        uavDesc.Buffer.NumElements = 1;
+        uavDesc.Buffer.Flags = 0;
+
+        result = m_pDevice->CreateUnorderedAccessView(*ppBuffer, &uavDesc, ppCounterUAV);
+    }
+    if (SUCCEEDED(result) && ppCounterUAV != nullptr)
+    {
+        result = SetResourceName(*ppCounterUAV, name + "CountUAV");
+    }
+
+    return result;
+}
+
+HRESULT Renderer::CreateMsaaTargets()
+{
+    SAFE_RELEASE(m_pMsaaColorBuffer);
+    SAFE_RELEASE(m_pMsaaColorBufferRTV);
+    SAFE_RELEASE(m_pMsaaDepthBuffer);
+    SAFE_RELEASE(m_pMsaaDepthBufferDSV);
+    SAFE_RELEASE(m_pMsaaDepthBufferSRV);
+
+    m_msaaBufferSamples = m_msaaSamples;
+    if (m_msaaSamples <= 1)
+    {
+        return S_OK;
+    }
+
+    HRESULT result = S_OK;
+
+    // Resolved to color buffer or, without post processing, to back buffer, both are of color buffer format then
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Format = ColorFormats[m_colorBufferFormat];
+    desc.ArraySize = 1;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = m_msaaSamples;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Height = m_targetHeight;
+    desc.Width = m_targetWidth;
+    desc.MipLevels = 1;
+
+    result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pMsaaColorBuffer);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pMsaaColorBuffer, "MsaaColorBuffer");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateRenderTargetView(m_pMsaaColorBuffer, nullptr, &m_pMsaaColorBufferRTV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMsaaColorBufferRTV, "MsaaColorBufferRTV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        desc.Format = DepthFormats[m_depthBufferFormat].texture;
+        desc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pMsaaDepthBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMsaaDepthBuffer, "MsaaDepthBuffer");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+        dsvDesc.Format = DepthFormats[m_depthBufferFormat].dsv;
+        dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DMS;
+        dsvDesc.Flags = 0;
+
+        result = m_pDevice->CreateDepthStencilView(m_pMsaaDepthBuffer, &dsvDesc, &m_pMsaaDepthBufferDSV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMsaaDepthBufferDSV, "MsaaDepthBufferDSV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DepthFormats[m_depthBufferFormat].srv;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DMS;
+
+        result = m_pDevice->CreateShaderResourceView(m_pMsaaDepthBuffer, &srvDesc, &m_pMsaaDepthBufferSRV);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMsaaDepthBufferSRV, "MsaaDepthBufferSRV");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::CreateOitTargets()
+{
+    TermOitTargets();
+
+    m_oitWidth = DivUp(m_targetWidth, GetTransScale());
+    m_oitHeight = DivUp(m_targetHeight, GetTransScale());
+    m_oitSamples = IsMsaaActive() ? m_msaaBufferSamples : 1;
+
+    HRESULT result = S_OK;
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    desc.ArraySize = 1;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = m_oitSamples;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Height = m_oitHeight;
+    desc.Width = m_oitWidth;
+    desc.MipLevels = 1;
+
+    result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pOitAccum);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOitAccum, "OitAccum");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateRenderTargetView(m_pOitAccum, nullptr, &m_pOitAccumRTV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOitAccumRTV, "OitAccumRTV");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pOitAccum, nullptr, &m_pOitAccumSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOitAccumSRV, "OitAccumSRV");
+    }
+    if (SUCCEEDED(result))
+    {
+        desc.Format = DXGI_FORMAT_R16_FLOAT;
+
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pOitRevealage);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOitRevealage, "OitRevealage");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateRenderTargetView(m_pOitRevealage, nullptr, &m_pOitRevealageRTV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOitRevealageRTV, "OitRevealageRTV");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pOitRevealage, nullptr, &m_pOitRevealageSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOitRevealageSRV, "OitRevealageSRV");
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void Renderer::TermOitTargets()
+{
+    SAFE_RELEASE(m_pOitAccum);
+    SAFE_RELEASE(m_pOitAccumRTV);
+    SAFE_RELEASE(m_pOitAccumSRV);
+    SAFE_RELEASE(m_pOitRevealage);
+    SAFE_RELEASE(m_pOitRevealageRTV);
+    SAFE_RELEASE(m_pOitRevealageSRV);
+    m_oitWidth = 0;
+    m_oitHeight = 0;
+    m_oitSamples = 0;
+}
+
+HRESULT Renderer::CreateLowResTransTargets()
+{
+    TermLowResTransTargets();
+
+    m_lowResTransWidth = DivUp(m_targetWidth, 1u << m_transResolution);
+    m_lowResTransHeight = DivUp(m_targetHeight, 1u << m_transResolution);
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    desc.ArraySize = 1;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Height = m_lowResTransHeight;
+    desc.Width = m_lowResTransWidth;
+    desc.MipLevels = 1;
+
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pLowResTransColor);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pLowResTransColor, "LowResTransColor");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateRenderTargetView(m_pLowResTransColor, nullptr, &m_pLowResTransColorRTV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pLowResTransColorRTV, "LowResTransColorRTV");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pLowResTransColor, nullptr, &m_pLowResTransColorSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pLowResTransColorSRV, "LowResTransColorSRV");
+    }
+
+    // 32-bit regardless of scene depth format, it is small
+    if (SUCCEEDED(result))
+    {
+        desc.Format = DepthFormats[DepthFormatD32].texture;
+        desc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pLowResTransDepth);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pLowResTransDepth, "LowResTransDepth");
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+        dsvDesc.Format = DepthFormats[DepthFormatD32].dsv;
+        dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+        dsvDesc.Flags = 0;
+        dsvDesc.Texture2D.MipSlice = 0;
+
+        result = m_pDevice->CreateDepthStencilView(m_pLowResTransDepth, &dsvDesc, &m_pLowResTransDepthDSV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pLowResTransDepthDSV, "LowResTransDepthDSV");
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DepthFormats[DepthFormatD32].srv;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        srvDesc.Texture2D.MostDetailedMip = 0;
+
+        result = m_pDevice->CreateShaderResourceView(m_pLowResTransDepth, &srvDesc, &m_pLowResTransDepthSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pLowResTransDepthSRV, "LowResTransDepthSRV");
+    }
+
+    if (FAILED(result))
+    {
+        TermLowResTransTargets();
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void Renderer::TermLowResTransTargets()
+{
+    SAFE_RELEASE(m_pLowResTransColor);
+    SAFE_RELEASE(m_pLowResTransColorRTV);
+    SAFE_RELEASE(m_pLowResTransColorSRV);
+    SAFE_RELEASE(m_pLowResTransDepth);
+    SAFE_RELEASE(m_pLowResTransDepthDSV);
+    SAFE_RELEASE(m_pLowResTransDepthSRV);
+    m_lowResTransWidth = 0;
+    m_lowResTransHeight = 0;
+}
+
+HRESULT Renderer::CreateTemporalTargets()
+{
+    TermTemporalTargets();
+
+    m_motionWidth = m_targetWidth;
+    m_motionHeight = m_targetHeight;
+    m_historyWidth = m_width;
+    m_historyHeight = m_height;
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Format = DXGI_FORMAT_R16G16_FLOAT;
+    desc.ArraySize = 1;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Height = m_targetHeight;
+    desc.Width = m_targetWidth;
+    desc.MipLevels = 1;
+
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pMotionBuffer);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pMotionBuffer, "MotionBuffer");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateRenderTargetView(m_pMotionBuffer, nullptr, &m_pMotionBufferRTV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pMotionBufferRTV, "MotionBufferRTV");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pMotionBuffer, nullptr, &m_pMotionBufferSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pMotionBufferSRV, "MotionBufferSRV");
+    }
+
+    // History keeps values above 1 for bloom and tone mapping
+    desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+    desc.Height = m_height;
+    desc.Width = m_width;
+    for (UINT i = 0; i < 2 && SUCCEEDED(result); i++)
+    {
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pHistory[i]);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pHistory[i], "History" + std::to_string(i));
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateShaderResourceView(m_pHistory[i], nullptr, &m_pHistorySRV[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pHistorySRV[i], "HistorySRV" + std::to_string(i));
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateUnorderedAccessView(m_pHistory[i], nullptr, &m_pHistoryUAV[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pHistoryUAV[i], "HistoryUAV" + std::to_string(i));
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void Renderer::TermTemporalTargets()
+{
+    SAFE_RELEASE(m_pMotionBuffer);
+    SAFE_RELEASE(m_pMotionBufferRTV);
+    SAFE_RELEASE(m_pMotionBufferSRV);
+    for (UINT i = 0; i < 2; i++)
+    {
+        SAFE_RELEASE(m_pHistory[i]);
+        SAFE_RELEASE(m_pHistorySRV[i]);
+        SAFE_RELEASE(m_pHistoryUAV[i]);
+    }
+    m_motionWidth = 0;
+    m_motionHeight = 0;
+    m_historyWidth = 0;
+    m_historyHeight = 0;
+    m_historyValid = false;
+}
+
+HRESULT Renderer::InitMeshlets()
+{
+    // Model is only drawn with imported mesh
+    m_meshletCount = (UINT)m_meshlets.size();
+    if (m_meshletCount == 0)
+    {
+        return S_OK;
+    }
+
+    const GeometryPool::Mesh& mesh = m_geometryPool.GetMesh(m_instanceMeshes[InstanceMeshImported * MaxLods]);
+
+    HRESULT result = CompileAndCreateShader(L"MeshletCull.cs", (ID3D11DeviceChild**)&m_pMeshletCullShader);
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(MeshletParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pMeshletParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshletParams, "MeshletParams");
+        }
+    }
+    // Create meshlet bounds
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(MeshOptimizer::Meshlet) * m_meshletCount;
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(MeshOptimizer::Meshlet);
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = m_meshlets.data();
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pMeshlets);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshlets, "Meshlets");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = m_meshletCount;
+
+            result = m_pDevice->CreateShaderResourceView(m_pMeshlets, &srvDesc, &m_pMeshletsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshletsSRV, "MeshletsSRV");
+        }
+    }
+    // Create compacted indices, raw view as typed UAV of index buffer isn't guaranteed
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT32) * mesh.indexCount;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_INDEX_BUFFER | D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pMeshletIndices);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshletIndices, "MeshletIndices");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = mesh.indexCount;
+            uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pMeshletIndices, &uavDesc, &m_pMeshletIndicesUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshletIndicesUAV, "MeshletIndicesUAV");
+        }
+    }
+    // Create draw arguments, only index count is written by culling
+    if (SUCCEEDED(result))
+    {
+        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args;
+        args.IndexCountPerInstance = 0;
+        args.InstanceCount = 1;
+        args.StartIndexLocation = 0;
+        args.BaseVertexLocation = mesh.baseVertex;
+        args.StartInstanceLocation = 0;
+
+        result = CreateIndirectArgs((const UINT*)&args, sizeof(args) / sizeof(UINT), 0, &m_pMeshletArgs, &m_pMeshletArgsUAV, &m_pMeshletArgsCountUAV, "MeshletArgs");
+    }
+    // Create the only instance, shaders of instanced meshes read it through visible ids
+    if (SUCCEEDED(result))
+    {
+        InstanceStore::GpuInstance instance = {};
+        GetMeshletModel(instance.model);
+        instance.shininess = DirectX::PackedVector::XMConvertFloatToHalf(64.0f);
+        instance.materialMesh = InstanceMeshImported << 16;
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(InstanceStore::GpuInstance);
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(InstanceStore::GpuInstance);
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = &instance;
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pMeshletGeom);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshletGeom, "MeshletGeom");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = 1;
+
+            result = m_pDevice->CreateShaderResourceView(m_pMeshletGeom, &srvDesc, &m_pMeshletGeomSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshletGeomSRV, "MeshletGeomSRV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        static const UINT Ids[1] = { 0 };
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(Ids);
+        desc.Usage = D3D11_USAGE_IMMUTABLE;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT);
+
+        D3D11_SUBRESOURCE_DATA data;
+        data.pSysMem = Ids;
+        data.SysMemPitch = desc.ByteWidth;
+        data.SysMemSlicePitch = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, &data, &m_pMeshletIds);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshletIds, "MeshletIds");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = 1;
+
+            result = m_pDevice->CreateShaderResourceView(m_pMeshletIds, &srvDesc, &m_pMeshletIdsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pMeshletIdsSRV, "MeshletIdsSRV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_meshletReadback.Init(m_pDevice, sizeof(UINT), "MeshletReadback");
+    }
+
+    // Bounds live on GPU only
+    std::vector<MeshOptimizer::Meshlet>().swap(m_meshlets);
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::UpdateSamplers()
+{
+    HRESULT result = S_OK;
+    for (UINT i = 0; i < MaterialTable::FilterCount && SUCCEEDED(result); i++)
+    {
+        const SamplerFilter& filter = MaterialFilters[m_filterQuality][i];
+        result = m_samplerCache.Get(m_pDevice, SamplerCache::MakeDesc(filter.filter, D3D11_TEXTURE_ADDRESS_CLAMP, filter.maxAnisotropy), filter.name,
+            &m_pMaterialSamplers[i]);
+    }
+    if (SUCCEEDED(result))
+    {
+        const SamplerFilter& filter = SceneFilters[m_filterQuality];
+        result = m_samplerCache.Get(m_pDevice, SamplerCache::MakeDesc(filter.filter, D3D11_TEXTURE_ADDRESS_CLAMP, filter.maxAnisotropy), filter.name, &m_pSampler);
+    }
+    if (SUCCEEDED(result))
+    {
+        m_samplerFilterQuality = m_filterQuality;
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitImageDiff()
+{
+    HRESULT result = CompileAndCreateShader(L"ImageDiff.cs", (ID3D11DeviceChild**)&m_pImageDiffShader);
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = 3 * sizeof(UINT);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pDiffResult);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDiffResult, "DiffResult");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = 3;
+            uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pDiffResult, &uavDesc, &m_pDiffResultUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDiffResultUAV, "DiffResultUAV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_diffReadback.Init(m_pDevice, 3 * sizeof(UINT), "DiffReadback");
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitPredicates()
+{
+    HRESULT result = CompileAndCreateShader(L"ProxyBox.vs", (ID3D11DeviceChild**)&m_pProxyBoxVertexShader);
+    if (SUCCEEDED(result))
+    {
+        result = m_predicateCB.Init(m_pDevice, "PredicateBuffer");
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BLEND_DESC desc = {};
+        desc.AlphaToCoverageEnable = FALSE;
+        desc.IndependentBlendEnable = FALSE;
+        desc.RenderTarget[0].BlendEnable = FALSE;
+        desc.RenderTarget[0].RenderTargetWriteMask = 0;
+        result = m_stateObjects.GetBlendState(m_pDevice, desc, "NoColorBlendState", &m_pNoColorBlendState);
+    }
+    for (UINT i = 0; i < PredicateGroupCount && SUCCEEDED(result); i++)
+    {
+        // Hint flag lets driver skip draws only once the result is known, instead of stalling GPU for it
+        D3D11_QUERY_DESC desc;
+        desc.Query = D3D11_QUERY_OCCLUSION_PREDICATE;
+        desc.MiscFlags = D3D11_QUERY_MISC_PREDICATEHINT;
+
+        result = m_pDevice->CreatePredicate(&desc, &m_pPredicates[i]);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pPredicates[i], "Predicate" + std::to_string(i));
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitParticles()
+{
+    HRESULT result = CompileAndCreateShader(L"Particles.cs", (ID3D11DeviceChild**)&m_pParticleResetShader, { "RESET" });
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Particles.cs", (ID3D11DeviceChild**)&m_pParticleEmitShader, { "EMIT" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Particles.cs", (ID3D11DeviceChild**)&m_pParticleSimulateShader, { "SIMULATE" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Particle.vs", (ID3D11DeviceChild**)&m_pParticleVertexShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Particle.ps", (ID3D11DeviceChild**)&m_pParticlePixelShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_particleCB.Init(m_pDevice, "ParticleParams");
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::CreateParticleBuffers()
+{
+    // Pool takes about 50 MB, so it is only created once particles are turned on
+    auto createBuffer = [this](UINT stride, UINT uavFlags, bool srv, ID3D11Buffer** ppBuffer, ID3D11ShaderResourceView** ppSRV, ID3D11UnorderedAccessView** ppUAV, const std::string& name)
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = stride * MaxParticles;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | (srv ? D3D11_BIND_SHADER_RESOURCE : 0);
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = stride;
+
+        HRESULT result = m_pDevice->CreateBuffer(&desc, nullptr, ppBuffer);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(*ppBuffer, name);
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = MaxParticles;
+            uavDesc.Buffer.Flags = uavFlags;
+
+            result = m_pDevice->CreateUnorderedAccessView(*ppBuffer, &uavDesc, ppUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(*ppUAV, name + "UAV");
+        }
+        if (SUCCEEDED(result) && srv)
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = MaxParticles;
 
-        case 'A':
-        case 'a':
-            m_rightDelta -= PanSpeed;
-            break;
+            result = m_pDevice->CreateShaderResourceView(*ppBuffer, &srvDesc, ppSRV);
+        }
+        if (SUCCEEDED(result) && srv)
+        {
+            result = SetResourceName(*ppSRV, name + "SRV");
+        }
+        return result;
+    };
+
+    static const UINT ParticleSize = 8 * sizeof(float); // Should match Particle.h
+    HRESULT result = createBuffer(ParticleSize, 0, true, &m_pParticles, &m_pParticlesSRV, &m_pParticlesUAV, "Particles");
+    if (SUCCEEDED(result))
+    {
+        result = createBuffer(sizeof(UINT), D3D11_BUFFER_UAV_FLAG_APPEND, false, &m_pParticleDead, nullptr, &m_pParticleDeadUAV, "ParticleDead");
+    }
+    for (UINT i = 0; i < 2 && SUCCEEDED(result); i++)
+    {
+        result = createBuffer(sizeof(UINT), D3D11_BUFFER_UAV_FLAG_APPEND, true, &m_pParticleAlive[i], &m_pParticleAliveSRV[i], &m_pParticleAliveUAV[i], "ParticleAlive" + std::to_string(i));
+    }
+    // Create sort keys, view depth and index pairs of visible particles
+    if (SUCCEEDED(result))
+    {
+        result = createBuffer(2 * sizeof(UINT), 0, true, &m_pParticleKeys, &m_pParticleKeysSRV, &m_pParticleKeysUAV, "ParticleKeys");
+    }
+    // Create list counts, constant buffer is a valid destination of CopyStructureCount
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = 4 * sizeof(UINT);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pParticleListCounts);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pParticleListCounts, "ParticleListCounts");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        UINT counts[4] = {};
+        result = CreateIndirectArgs(counts, 4, 0, &m_pParticleCounts, &m_pParticleCountsUAV, nullptr, "ParticleCounts");
+    }
+    if (SUCCEEDED(result))
+    {
+        UINT args[3] = { 0, 1, 1 };
+        result = CreateIndirectArgs(args, 3, 0, &m_pParticleSimArgs, &m_pParticleSimArgsUAV, nullptr, "ParticleSimArgs");
+    }
+    // Create draw arguments, quad per visible particle
+    if (SUCCEEDED(result))
+    {
+        D3D11_DRAW_INSTANCED_INDIRECT_ARGS args;
+        args.VertexCountPerInstance = 6;
+        args.InstanceCount = 0;
+        args.StartVertexLocation = 0;
+        args.StartInstanceLocation = 0;
+
+        result = CreateIndirectArgs((UINT*)&args, 4, 1, &m_pParticleDrawArgs, &m_pParticleDrawArgsUAV, &m_pParticleDrawCountUAV, "ParticleDrawArgs");
+    }
+
+    if (FAILED(result))
+    {
+        TermParticleBuffers();
     }
+    m_particlesReset = true;
+
+    return result;
 }
 
-void Renderer::KeyReleased(int keyCode)
+void Renderer::TermParticleBuffers()
 {
-    switch (keyCode)
+    SAFE_RELEASE(m_pParticles);
+    SAFE_RELEASE(m_pParticlesSRV);
+    SAFE_RELEASE(m_pParticlesUAV);
+    SAFE_RELEASE(m_pParticleDead);
+    SAFE_RELEASE(m_pParticleDeadUAV);
+    for (UINT i = 0; i < 2; i++)
     {
-        case 'W':
-        case 'w':
-            m_forwardDelta -= PanSpeed;
-            break;
+        SAFE_RELEASE(m_pParticleAlive[i]);
+        SAFE_RELEASE(m_pParticleAliveSRV[i]);
+        SAFE_RELEASE(m_pParticleAliveUAV[i]);
+    }
+    SAFE_RELEASE(m_pParticleKeys);
+    SAFE_RELEASE(m_pParticleKeysSRV);
+    SAFE_RELEASE(m_pParticleKeysUAV);
+    SAFE_RELEASE(m_pParticleListCounts);
+    SAFE_RELEASE(m_pParticleCounts);
+    SAFE_RELEASE(m_pParticleCountsUAV);
+    SAFE_RELEASE(m_pParticleSimArgs);
+    SAFE_RELEASE(m_pParticleSimArgsUAV);
+    SAFE_RELEASE(m_pParticleDrawArgs);
+    SAFE_RELEASE(m_pParticleDrawArgsUAV);
+    SAFE_RELEASE(m_pParticleDrawCountUAV);
+}
 
-        case 'S':
-        case 's':
-            m_forwardDelta += PanSpeed;
-            break;
+HRESULT Renderer::InitPicking()
+{
+    HRESULT result = CompileAndCreateShader(L"Pick.ps", (ID3D11DeviceChild**)&m_pPickPixelShader);
+    if (SUCCEEDED(result))
+    {
+        D3D11_RASTERIZER_DESC desc = {};
+        desc.AntialiasedLineEnable = FALSE;
+        desc.FillMode = D3D11_FILL_SOLID;
+        desc.CullMode = D3D11_CULL_NONE;
+        desc.FrontCounterClockwise = FALSE;
+        desc.DepthBias = 0;
+        desc.SlopeScaledDepthBias = 0.0f;
+        desc.DepthBiasClamp = 0.0f;
+        desc.DepthClipEnable = TRUE;
+        desc.ScissorEnable = TRUE;
+        desc.MultisampleEnable = FALSE;
+
+        result = m_stateObjects.GetRasterizerState(m_pDevice, desc, "PickRasterizerState", &m_pPickRasterizerState);
+    }
+    // Create picked id, single uint written by pixel shader and copied to readback ring
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = sizeof(UINT);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pPickResult);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pPickResult, "PickResult");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            uavDesc.Format = DXGI_FORMAT_R32_UINT;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.NumElements = 1;
+            uavDesc.Buffer.Flags = 0;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pPickResult, &uavDesc, &m_pPickResultUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pPickResultUAV, "PickResultUAV");
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pickReadback.Init(m_pDevice, sizeof(UINT), "PickReadback");
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::InitDebugViews()
+{
+    HRESULT result = CompileAndCreateShader(L"Overdraw.ps", (ID3D11DeviceChild**)&m_pOverdrawPixelShader);
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Heatmap.ps", (ID3D11DeviceChild**)&m_pOverdrawHeatmapPixelShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Heatmap.ps", (ID3D11DeviceChild**)&m_pLightHeatmapPixelShader, { "LIGHT_COUNT" });
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileAndCreateShader(L"Heatmap.ps", (ID3D11DeviceChild**)&m_pLightHeatmapMsaaPixelShader, { "LIGHT_COUNT", "MSAA" });
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::CreateOverdrawTarget()
+{
+    SAFE_RELEASE(m_pOverdraw);
+    SAFE_RELEASE(m_pOverdrawSRV);
+    SAFE_RELEASE(m_pOverdrawUAV);
+
+    // Counted per pixel, so it is single sampled with MSAA too
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = DXGI_FORMAT_R32_UINT;
+    desc.ArraySize = 1;
+    desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Width = m_targetWidth;
+    desc.Height = m_targetHeight;
+    desc.MipLevels = 1;
+
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pOverdraw);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOverdraw, "Overdraw");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pOverdraw, nullptr, &m_pOverdrawSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOverdrawSRV, "OverdrawSRV");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateUnorderedAccessView(m_pOverdraw, nullptr, &m_pOverdrawUAV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pOverdrawUAV, "OverdrawUAV");
+    }
+
+    m_overdrawWidth = SUCCEEDED(result) ? m_targetWidth : 0;
+    m_overdrawHeight = SUCCEEDED(result) ? m_targetHeight : 0;
+
+    return result;
+}
+
+HRESULT Renderer::CreateDiffTargets()
+{
+    static const char* TextureNames[2] = { "DiffReference", "DiffHalf" };
+    static const char* SRVNames[2] = { "DiffReferenceSRV", "DiffHalfSRV" };
+
+    for (int i = 0; i < 2; i++)
+    {
+        SAFE_RELEASE(m_pDiffTextures[i]);
+        SAFE_RELEASE(m_pDiffSRVs[i]);
+    }
+
+    m_diffWidth = m_width;
+    m_diffHeight = m_height;
+
+    // Back buffer copies, created on first comparison only
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.ArraySize = 1;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Height = m_diffHeight;
+    desc.Width = m_diffWidth;
+    desc.MipLevels = 1;
+
+    HRESULT result = S_OK;
+    for (int i = 0; i < 2 && SUCCEEDED(result); i++)
+    {
+        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pDiffTextures[i]);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDiffTextures[i], TextureNames[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = m_pDevice->CreateShaderResourceView(m_pDiffTextures[i], nullptr, &m_pDiffSRVs[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pDiffSRVs[i], SRVNames[i]);
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT Renderer::CreateHiZ()
+{
+    SAFE_RELEASE(m_pHiZ);
+    SAFE_RELEASE(m_pHiZSRV);
+    for (int i = 0; i < MaxHiZMips; i++)
+    {
+        SAFE_RELEASE(m_pHiZMipSRVs[i]);
+        SAFE_RELEASE(m_pHiZMipUAVs[i]);
+    }
+
+    // Mip 0 is half of depth buffer size
+    UINT width = std::max(1u, m_targetWidth / 2);
+    UINT height = std::max(1u, m_targetHeight / 2);
+    m_hiZMips = 1;
+    while ((width >> m_hiZMips) > 0 || (height >> m_hiZMips) > 0)
+    {
+        ++m_hiZMips;
+    }
+    m_hiZMips = std::min(m_hiZMips, (UINT)MaxHiZMips);
+    m_hiZWidth = m_targetWidth;
+    m_hiZHeight = m_targetHeight;
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Format = DXGI_FORMAT_R32_FLOAT;
+    desc.ArraySize = 1;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Height = height;
+    desc.Width = width;
+    desc.MipLevels = m_hiZMips;
+
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pHiZ);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pHiZ, "HiZ");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->CreateShaderResourceView(m_pHiZ, nullptr, &m_pHiZSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pHiZSRV, "HiZSRV");
+    }
+    for (UINT i = 0; i < m_hiZMips && SUCCEEDED(result); i++)
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        srvDesc.Texture2D.MostDetailedMip = i;
+
+        result = m_pDevice->CreateShaderResourceView(m_pHiZ, &srvDesc, &m_pHiZMipSRVs[i]);
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+            uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+            uavDesc.Texture2D.MipSlice = i;
+
+            result = m_pDevice->CreateUnorderedAccessView(m_pHiZ, &uavDesc, &m_pHiZMipUAVs[i]);
+        }
+        if (SUCCEEDED(result))
+        {
+            // Far plane, so nothing is occluded until Hi-Z is built
+            static const FLOAT Far[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            m_pDeviceContext->ClearUnorderedAccessViewFloat(m_pHiZMipUAVs[i], Far);
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+JobSystem::TaskHandle Renderer::UpdateCubes(double deltaSec)
+{
+    // Rotation speed is constant, so several ticks are simulated as one step of their total time
+    double simulatedSec = 0.0;
+    float interpolationSec = m_interpolationSec;
+    m_simulationTicks = 0;
+    if (m_rotateModel)
+    {
+        if (m_simulationHz > 0)
+        {
+            double tickSec = 1.0 / m_simulationHz;
+            m_simulationAccumSec += deltaSec;
+            m_simulationTicks = (UINT)(m_simulationAccumSec / tickSec);
+            if (m_simulationTicks > MaxSimulationTicks)
+            {
+                m_simulationTicks = MaxSimulationTicks;
+                m_simulationAccumSec = tickSec * MaxSimulationTicks;
+            }
+            simulatedSec = tickSec * m_simulationTicks;
+            m_simulationAccumSec -= simulatedSec;
+
+            // Frame is between the previous and the last tick
+            interpolationSec = (float)(m_simulationAccumSec - tickSec);
+        }
+        else
+        {
+            simulatedSec = deltaSec;
+            interpolationSec = 0.0f;
+        }
+    }
+    m_animationDeltaSec = (float)simulatedSec;
+    m_motionDeltaSec = (float)(simulatedSec + interpolationSec - m_interpolationSec);
+    m_instancesMoved = simulatedSec > 0.0 || interpolationSec != m_interpolationSec;
+    m_interpolationSec = interpolationSec;
+
+    if (m_instancesMoved && !m_computeAnimation)
+    {
+        for (UINT i = 0; i < m_instCount; i++)
+        {
+            if (m_instances.IsRotating(i))
+            {
+                MarkGeomDirty(i, 1);
+            }
+        }
+    }
+
+    if (!m_geomDirtyRanges.empty())
+    {
+        MergeRanges(m_geomDirtyRanges, GeomMergeGap);
+
+        // Instances beyond the current count are not used, skip them
+        while (!m_geomDirtyRanges.empty() && m_geomDirtyRanges.back().first >= m_instCount)
+        {
+            m_geomDirtyRanges.pop_back();
+        }
+        if (!m_geomDirtyRanges.empty())
+        {
+            BufferRange& last = m_geomDirtyRanges.back();
+            last.count = std::min(last.count, m_instCount - last.first);
+        }
+    }
+
+    // Angle is still tracked on CPU in GPU mode, so switching modes and re-uploading instances is seamless
+    JobSystem::TaskHandle animateTask;
+    if (simulatedSec > 0.0)
+    {
+        float animationDeltaSec = (float)simulatedSec;
+        animateTask = m_jobSystem.Submit([this, animationDeltaSec]()
+        {
+            CPU_PROFILE_ZONE("AnimateInstances");
+            m_jobSystem.ParallelForAdaptive(m_instCount, InstanceJobChunk, [this, animationDeltaSec](UINT begin, UINT end)
+            {
+                m_instances.Animate(animationDeltaSec, begin, end);
+            });
+        });
+    }
+
+    return m_jobSystem.Submit([this]()
+    {
+        CPU_PROFILE_ZONE("PackInstances");
+        for (const BufferRange& range : m_geomDirtyRanges)
+        {
+            m_jobSystem.ParallelForAdaptive(range.count, InstanceJobChunk, [this, &range](UINT begin, UINT end)
+            {
+                m_instances.Pack(range.first + begin, end - begin, m_interpolationSec);
+            });
+        }
+    }, { animateTask });
+}
+
+void Renderer::UploadCubes()
+{
+    // Upload only changed instances
+    m_geomUploadRing.ResetStats();
+    m_geomScatter.ResetStats();
+    m_boundsScatter.ResetStats();
+    if (!m_geomDirtyRanges.empty())
+    {
+        if (m_scatterUploads)
+        {
+            m_geomScatter.Upload(m_pDeviceContext, m_pGeomBufferInstUAV, m_instances.GetPacked(), m_geomDirtyRanges);
+        }
+        else
+        {
+            m_geomUploadRing.Upload(m_pDeviceContext, m_pGeomBufferInst, m_instances.GetPacked(), sizeof(InstanceStore::GpuInstance), m_geomDirtyRanges);
+        }
+        m_geomDirtyRanges.clear();
+    }
+}
 
-        case 'D':
-        case 'd':
-            m_rightDelta -= PanSpeed;
-            break;
+void Renderer::BuildCullStructures()
+{
+    CPU_PROFILE_ZONE("BuildCullStructures");
 
-        case 'A':
-        case 'a':
-            m_rightDelta += PanSpeed;
-            break;
+    m_bvh.Build(m_instances.GetBounds(), m_instCount);
+
+    m_cpuCull.Resize(m_instCount);
+    for (UINT i = 0; i < m_instCount; i++)
+    {
+        const AABB& bb = m_instances.GetBounds(i);
+        m_cpuCull.SetBox(i, bb.vmin, bb.vmax);
     }
 }
 
-HRESULT Renderer::SetupBackBuffer()
+static void AddDirtyRange(std::vector<BufferRange>& ranges, UINT first, UINT count)
 {
-    ID3D11Texture2D* pBackBuffer = NULL;
-    HRESULT result = m_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&pBackBuffer);
-    if (SUCCEEDED(result))
+    if (count == 0)
     {
-        result = m_pDevice->CreateRenderTargetView(pBackBuffer, NULL, &m_pBackBufferRTV);
-
-        SAFE_RELEASE(pBackBuffer);
+        return;
     }
-    if (SUCCEEDED(result))
-    {
-        D3D11_TEXTURE2D_DESC desc;
-        desc.Format = DXGI_FORMAT_D32_FLOAT;
-        desc.ArraySize = 1;
-        desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.SampleDesc.Count = 1;
-        desc.SampleDesc.Quality = 0;
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.Height = m_height;
-        desc.Width = m_width;
-        desc.MipLevels = 1;
 
-        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pDepthBuffer);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pDepthBuffer, "DepthBuffer");
-        }
-    }
-    if (SUCCEEDED(result))
+    // Extend the last range, as instances are mostly marked in order
+    if (!ranges.empty())
     {
-        result = m_pDevice->CreateDepthStencilView(m_pDepthBuffer, nullptr, &m_pDepthBufferDSV);
-        if (SUCCEEDED(result))
+        BufferRange& last = ranges.back();
+        if (first >= last.first && first <= last.first + last.count)
         {
-            result = SetResourceName(m_pDepthBuffer, "DepthBufferView");
+            last.count = std::max(last.count, first + count - last.first);
+            return;
         }
     }
 
-    SAFE_RELEASE(m_pColorBuffer);
-    SAFE_RELEASE(m_pColorBufferRTV);
-    SAFE_RELEASE(m_pColorBufferSRV);
+    ranges.push_back(BufferRange{ first, count });
+}
 
-    if (SUCCEEDED(result))
+void Renderer::MarkGeomDirty(UINT first, UINT count)
+{
+    AddDirtyRange(m_geomDirtyRanges, first, count);
+}
+
+void Renderer::MarkBoundsDirty(UINT first, UINT count)
+{
+    AddDirtyRange(m_boundsDirtyRanges, first, count);
+}
+
+void Renderer::UploadBounds()
+{
+    // Removed instances are past the count, so only added or reloaded ones are sent
+    MergeRanges(m_boundsDirtyRanges, GeomMergeGap);
+    while (!m_boundsDirtyRanges.empty() && m_boundsDirtyRanges.back().first >= m_instCount)
     {
-        D3D11_TEXTURE2D_DESC desc;
-        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-        desc.ArraySize = 1;
-        desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.SampleDesc.Count = 1;
-        desc.SampleDesc.Quality = 0;
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.Height = m_height;
-        desc.Width = m_width;
-        desc.MipLevels = 1;
+        m_boundsDirtyRanges.pop_back();
+    }
+    if (!m_boundsDirtyRanges.empty())
+    {
+        BufferRange& last = m_boundsDirtyRanges.back();
+        last.count = std::min(last.count, m_instCount - last.first);
 
-        result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pColorBuffer);
-        if (SUCCEEDED(result))
+        if (m_scatterUploads)
         {
-            result = SetResourceName(m_pColorBuffer, "ColorBuffer");
+            m_boundsScatter.Upload(m_pDeviceContext, m_pInstBoundsUAV, m_instances.GetBounds(), m_boundsDirtyRanges);
+        }
+        else
+        {
+            m_geomUploadRing.Upload(m_pDeviceContext, m_pInstBounds, m_instances.GetBounds(), sizeof(AABB), m_boundsDirtyRanges);
         }
     }
-    if (SUCCEEDED(result))
+    m_boundsDirtyRanges.clear();
+}
+
+void Renderer::SetInstanceCount(UINT count)
+{
+    count = std::min(count, (UINT)MaxInst);
+    for (UINT i = m_instCount; i < count; i++)
     {
-        result = m_pDevice->CreateRenderTargetView(m_pColorBuffer, nullptr, &m_pColorBufferRTV);
-        if (SUCCEEDED(result))
+        const Point3f& pos = m_instances.GetPosition(i);
+        if (pos.x == 0 && pos.y == 0 && pos.z == 0)
         {
-            result = SetResourceName(m_pColorBufferRTV, "ColorBufferRTV");
+            InitGeom(i);
         }
     }
-    if (SUCCEEDED(result))
+    if (count != m_instCount)
     {
-        result = m_pDevice->CreateShaderResourceView(m_pColorBuffer, nullptr, &m_pColorBufferSRV);
-        if (SUCCEEDED(result))
+        if (count > m_instCount)
         {
-            result = SetResourceName(m_pColorBufferSRV, "ColorBufferSRV");
+            for (UINT i = m_instCount; i < count; i++)
+            {
+                m_instances.AddHandle(i);
+            }
+            MarkGeomDirty(m_instCount, count - m_instCount);
+            MarkBoundsDirty(m_instCount, count - m_instCount);
+        }
+        else
+        {
+            for (UINT i = m_instCount; i-- > count;)
+            {
+                m_instances.RemoveLast(i);
+            }
         }
+        m_instCount = count;
+        m_updateCullParams = true;
     }
+}
 
-    assert(SUCCEEDED(result));
+void Renderer::RemoveInstance(InstanceStore::Handle handle)
+{
+    if (!m_instances.IsValid(handle))
+    {
+        return;
+    }
 
-    return result;
+    // Last instance fills the hole, so only that one element is sent again and instances stay dense for culling
+    UINT idx = m_instances.Remove(handle, m_instCount);
+    --m_instCount;
+    if (idx < m_instCount)
+    {
+        MarkGeomDirty(idx, 1);
+        MarkBoundsDirty(idx, 1);
+    }
+    m_updateCullParams = true;
 }
 
-HRESULT Renderer::InitScene()
+void Renderer::InitGeom(UINT idx)
 {
-    // Textured cube
-    static const TextureTangentVertex Vertices[24] = {
-        // Bottom face
-        {Point3f{-0.5, -0.5,  0.5}, Point3f{1, 0, 0}, Point3f{0, -1, 0}, Point2f{0, 1}},
-        {Point3f{ 0.5, -0.5,  0.5}, Point3f{1, 0, 0}, Point3f{0, -1, 0}, Point2f{1, 1}},
-        {Point3f{ 0.5, -0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, -1, 0}, Point2f{1, 0}},
-        {Point3f{-0.5, -0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, -1, 0}, Point2f{0, 0}},
-        // Top face
-        {Point3f{-0.5,  0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 1, 0}, Point2f{0, 1}},
-        {Point3f{ 0.5,  0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 1, 0}, Point2f{1, 1}},
-        {Point3f{ 0.5,  0.5,  0.5}, Point3f{1, 0, 0}, Point3f{0, 1, 0}, Point2f{1, 0}},
-        {Point3f{-0.5,  0.5,  0.5}, Point3f{1, 0, 0}, Point3f{0, 1, 0}, Point2f{0, 0}},
-        // Front face
-        {Point3f{ 0.5, -0.5, -0.5}, Point3f{0, 0, 1}, Point3f{1, 0, 0}, Point2f{0, 1}},
-        {Point3f{ 0.5, -0.5,  0.5}, Point3f{0, 0, 1}, Point3f{1, 0, 0}, Point2f{1, 1}},
-        {Point3f{ 0.5,  0.5,  0.5}, Point3f{0, 0, 1}, Point3f{1, 0, 0}, Point2f{1, 0}},
-        {Point3f{ 0.5,  0.5, -0.5}, Point3f{0, 0, 1}, Point3f{1, 0, 0}, Point2f{0, 0}},
-        // Back face
-        {Point3f{-0.5, -0.5,  0.5}, Point3f{0, 0, -1}, Point3f{-1, 0, 0}, Point2f{0, 1}},
-        {Point3f{-0.5, -0.5, -0.5}, Point3f{0, 0, -1}, Point3f{-1, 0, 0}, Point2f{1, 1}},
-        {Point3f{-0.5,  0.5, -0.5}, Point3f{0, 0, -1}, Point3f{-1, 0, 0}, Point2f{1, 0}},
-        {Point3f{-0.5,  0.5,  0.5}, Point3f{0, 0, -1}, Point3f{-1, 0, 0}, Point2f{0, 0}},
-        // Left face
-        {Point3f{ 0.5, -0.5,  0.5}, Point3f{-1, 0, 0}, Point3f{0, 0, 1}, Point2f{0, 1}},
-        {Point3f{-0.5, -0.5,  0.5}, Point3f{-1, 0, 0}, Point3f{0, 0, 1}, Point2f{1, 1}},
-        {Point3f{-0.5,  0.5,  0.5}, Point3f{-1, 0, 0}, Point3f{0, 0, 1}, Point2f{1, 0}},
-        {Point3f{ 0.5,  0.5,  0.5}, Point3f{-1, 0, 0}, Point3f{0, 0, 1}, Point2f{0, 0}},
-        // Right face
-        {Point3f{-0.5, -0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 0, -1}, Point2f{0, 1}},
-        {Point3f{ 0.5, -0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 0, -1}, Point2f{1, 1}},
-        {Point3f{ 0.5,  0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 0, -1}, Point2f{1, 0}},
-        {Point3f{-0.5,  0.5, -0.5}, Point3f{1, 0, 0}, Point3f{0, 0, -1}, Point2f{0, 0}}
-    };
-    static const UINT16 Indices[36] = {
-        0, 2, 1, 0, 3, 2,
-        4, 6, 5, 4, 7, 6,
-        8, 10, 9, 8, 11, 10,
-        12, 14, 13, 12, 15, 14,
-        16, 18, 17, 16, 19, 18,
-        20, 22, 21, 20, 23, 22
-    };
-    static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0}
-    };
+    Point3f offset = Point3f{ randNormf(), randNormf(), randNormf() } *7.0f - Point3f{ 3.5f, 3.5f, 3.5f };
 
-    HRESULT result = S_OK;
+    float shininess = randNormf() > 0.5f ? 64.0f : 0.0f;
+    float speed = randNormf() * 2 * (float)M_PI;
 
-    // Create vertex buffer
-    if (SUCCEEDED(result))
+    UINT material = (UINT)(rand() % m_materials.GetMaterialCount());
+
+    bool sphere = randNormf() > 0.75f;
+    // Extra random number is taken only with imported mesh, so generated scenes stay the same without it
+    bool imported = !sphere && m_importedMesh && randNormf() > 0.5f;
+
+    // Cube bounds cover any rotation around Y, imported mesh fits unit box like cube
+    const float diag = sphere ? 0.5f : sqrtf(2.0f) / 2.0f * 0.5f;
+    AABB bb;
+    bb.vmin = offset + Point3f{-diag, -0.5f, -diag};
+    bb.vmax = offset + Point3f{ diag,  0.5f,  diag};
+
+    m_instances.Set(idx, offset, speed, shininess, material, sphere ? InstanceMeshSphere : (imported ? InstanceMeshImported : InstanceMeshCube), bb);
+}
+
+// Cube and sphere have 16-bit indices, imported mesh goes to the wide index buffer
+template <typename Index>
+UINT Renderer::AddInstancedMesh(const TextureTangentVertex* pVertices, UINT vertexCount, const Index* pIndices, UINT indexCount, bool optimize)
+{
+    if (!m_packedVertices)
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(Vertices);
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        return m_geometryPool.AddMesh(GeometryPool::VertexFormatTextured, sizeof(TextureTangentVertex), pVertices, vertexCount, pIndices, indexCount, optimize);
+    }
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = &Vertices;
-        data.SysMemPitch = sizeof(Vertices);
-        data.SysMemSlicePitch = 0;
+    std::vector<PackedTangentVertex> packed(vertexCount);
+    for (UINT i = 0; i < vertexCount; i++)
+    {
+        packed[i] = PackVertex(pVertices[i]);
+    }
+    return m_geometryPool.AddMesh(GeometryPool::VertexFormatPacked, sizeof(PackedTangentVertex), packed.data(), vertexCount, pIndices, indexCount, optimize);
+}
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pVertexBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
+// Matches SelectLod of CullCommon.h
+UINT Renderer::SelectLod(const AABB& bb, UINT mesh) const
+{
+    Point3f center = (bb.vmin + bb.vmax) * 0.5f;
+    const Point3f& cameraPos = m_cameraSnapshot.pos;
+    float radius = (bb.vmax - bb.vmin).length() * 0.5f;
+    float size = radius / tanf(CameraFov / 2) / std::max((center - cameraPos).length(), radius);
+
+    if (m_impostors && size < ImpostorStartRadius)
+    {
+        return ImpostorLod;
+    }
+
+    float lod = floorf(log2f(LodStartRadius / size)) + 1;
+    return (UINT)std::min(std::max(lod, 0.0f), (float)(m_lodCounts[mesh] - 1));
+}
+
+// Impostor records are D3D11_DRAW_INSTANCED_INDIRECT_ARGS in the same 5 uint stride, so instance count stays in the same place
+void Renderer::FillInstanceDrawArgs(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS* pArgs, UINT segmentSize) const
+{
+    for (UINT i = 0; i < InstanceDrawCount; i++)
+    {
+        if (i % MaxLods == ImpostorLod)
         {
-            result = SetResourceName(m_pVertexBuffer, "VertexBuffer");
+            pArgs[i].IndexCountPerInstance = 6; // Vertex count
+            pArgs[i].InstanceCount = 0;
+            pArgs[i].StartIndexLocation = 0; // Start vertex
+            pArgs[i].BaseVertexLocation = (INT)(i * segmentSize); // Start instance
+            pArgs[i].StartInstanceLocation = 0; // Unused
         }
+        else
+        {
+            const GeometryPool::Mesh& mesh = m_geometryPool.GetMesh(m_instanceMeshes[i]);
+            pArgs[i].IndexCountPerInstance = mesh.indexCount;
+            pArgs[i].InstanceCount = 0;
+            pArgs[i].StartIndexLocation = mesh.startIndex;
+            pArgs[i].BaseVertexLocation = mesh.baseVertex;
+            pArgs[i].StartInstanceLocation = i * segmentSize;
+        }
+    }
+}
+
+void Renderer::TermScene()
+{
+    m_samplerCache.Term();
+    m_pSampler = nullptr;
+    m_pShadowSampler = nullptr;
+    for (UINT i = 0; i < MaterialTable::FilterCount; i++)
+    {
+        m_pMaterialSamplers[i] = nullptr;
+    }
+    m_samplerFilterQuality = FilterQualityCount;
+
+    // States are owned by cache
+    m_stateObjects.Term();
+    m_pRasterizerState = nullptr;
+    m_pDepthState = nullptr;
+    m_pTransDepthState = nullptr;
+    m_pDepthCopyState = nullptr;
+    m_pSkyDepthState = nullptr;
+    m_pDepthEqualState = nullptr;
+    m_pTransBlendState = nullptr;
+    m_pOpaqueBlendState = nullptr;
+    m_pOitBlendState = nullptr;
+    m_pLowResTransBlendState = nullptr;
+    m_pLowResCompositeBlendState = nullptr;
+    m_pNoColorBlendState = nullptr;
+    m_pShadowRasterizerState = nullptr;
+
+    SAFE_RELEASE(m_pColorBuffer);
+    SAFE_RELEASE(m_pColorBufferRTV);
+    SAFE_RELEASE(m_pColorBufferSRV);
+    SAFE_RELEASE(m_pColorBufferUAV);
+    SAFE_RELEASE(m_pMsaaColorBuffer);
+    SAFE_RELEASE(m_pMsaaColorBufferRTV);
+    SAFE_RELEASE(m_pMsaaDepthBuffer);
+    SAFE_RELEASE(m_pMsaaDepthBufferDSV);
+    SAFE_RELEASE(m_pMsaaDepthBufferSRV);
+    TermTemporalTargets();
+    m_postProcess.Term();
+    m_videoRecorder.Term();
+    m_commandRecorder.Clear();
+    m_renderGraph.Term();
+
+    m_virtualTextures.Term();
+    m_materials.Term();
+
+
+    SAFE_RELEASE(m_pInputLayout);
+    for (UINT i = 0; i < ShaderVariantCount; i++)
+    {
+        SAFE_RELEASE(m_pPixelShaders[i]);
+    }
+    SAFE_RELEASE(m_pVertexShader);
+    SAFE_RELEASE(m_pMultiViewVertexShader);
+    SAFE_RELEASE(m_pMotionVertexShader);
+    SAFE_RELEASE(m_pTransformVertexShader);
+    SAFE_RELEASE(m_pInstanceIndices);
+
+    TermImpostors();
+
+
+    m_sceneCB.Term();
+    m_settingsCB.Term();
+    m_uploadedLightCount = -1;
+    SAFE_RELEASE(m_pGeomBufferInst);
+    SAFE_RELEASE(m_pGeomBufferInstSRV);
+    SAFE_RELEASE(m_pGeomBufferInstUAV);
+    m_geomUploadRing.Term();
+    SAFE_RELEASE(m_pGeomBufferInstVis);
+    SAFE_RELEASE(m_pGeomBufferInstVisSRV);
+
+
+    // Term sphere
+    SAFE_RELEASE(m_pSphereInputLayout);
+    SAFE_RELEASE(m_pSpherePixelShader);
+    SAFE_RELEASE(m_pSphereVertexShader);
+    SAFE_RELEASE(m_pSkyTriangleVertexShader);
+    SAFE_RELEASE(m_pSkyArgs);
+    SAFE_RELEASE(m_pSkyArgsUAV);
+
+
+
+    SAFE_RELEASE(m_pCubemapTexture);
+    SAFE_RELEASE(m_pCubemapView);
+    SAFE_RELEASE(m_pSkyAmbientSource);
+    SAFE_RELEASE(m_pSkyAmbientShader);
+    SAFE_RELEASE(m_pSkyAmbientParams);
+    SAFE_RELEASE(m_pSkyAmbientCoeffsUAV);
+    SAFE_RELEASE(m_pSkyAmbientCoeffs);
+    SAFE_RELEASE(m_pAmbientCB);
+
+    // Term rect
+    SAFE_RELEASE(m_pRectInputLayout);
+    for (UINT i = 0; i < ShaderVariantCount; i++)
+    {
+        SAFE_RELEASE(m_pRectPixelShaders[i]);
+        SAFE_RELEASE(m_pRectOitPixelShaders[i]);
+    }
+    SAFE_RELEASE(m_pRectVertexShader);
+
+
+    SAFE_RELEASE(m_pRectInstBuffer);
+    SAFE_RELEASE(m_pRectInstBufferSRV);
+    SAFE_RELEASE(m_pRectBounds);
+    SAFE_RELEASE(m_pRectBoundsSRV);
+    SAFE_RELEASE(m_pRectArgs);
+    SAFE_RELEASE(m_pRectArgsUAV);
+    SAFE_RELEASE(m_pRectArgsReset);
+    SAFE_RELEASE(m_pRectIds);
+    SAFE_RELEASE(m_pRectIdsUAV);
+    SAFE_RELEASE(m_pRectIdsSRV);
+    SAFE_RELEASE(m_pRectCullShader);
+    SAFE_RELEASE(m_pRectOitVertexShader);
+    SAFE_RELEASE(m_pFullscreenVertexShader);
+    SAFE_RELEASE(m_pOitCompositePixelShader);
+    SAFE_RELEASE(m_pOitCompositeMsaaPixelShader);
+    TermOitTargets();
+    SAFE_RELEASE(m_pLowResDepthPixelShader);
+    SAFE_RELEASE(m_pLowResCompositePixelShader);
+    m_lowResTransCB.Term();
+    TermLowResTransTargets();
+    SAFE_RELEASE(m_pRectTexture);
+    SAFE_RELEASE(m_pRectTextureSRV);
+
+    // Term occlusion predicates
+    for (UINT i = 0; i < PredicateGroupCount; i++)
+    {
+        SAFE_RELEASE(m_pPredicates[i]);
+    }
+    SAFE_RELEASE(m_pProxyBoxVertexShader);
+    m_predicateCB.Term();
+
+    // Term particles
+    TermParticleBuffers();
+    SAFE_RELEASE(m_pParticleResetShader);
+    SAFE_RELEASE(m_pParticleEmitShader);
+    SAFE_RELEASE(m_pParticleSimulateShader);
+    SAFE_RELEASE(m_pParticleVertexShader);
+    SAFE_RELEASE(m_pParticlePixelShader);
+    m_particleCB.Term();
+
+    // Term debug views
+    SAFE_RELEASE(m_pOverdrawPixelShader);
+    SAFE_RELEASE(m_pOverdrawHeatmapPixelShader);
+    SAFE_RELEASE(m_pLightHeatmapPixelShader);
+    SAFE_RELEASE(m_pLightHeatmapMsaaPixelShader);
+    SAFE_RELEASE(m_pOverdraw);
+    SAFE_RELEASE(m_pOverdrawSRV);
+    SAFE_RELEASE(m_pOverdrawUAV);
+
+    // Term picking
+    SAFE_RELEASE(m_pPickPixelShader);
+    m_pPickRasterizerState = nullptr;
+    SAFE_RELEASE(m_pPickResult);
+    SAFE_RELEASE(m_pPickResultUAV);
+    m_pickReadback.Term();
+
+    m_textureProcessor.Term();
+
+    m_geometryPool.Term();
+
+    // Term depth buffer
+    SAFE_RELEASE(m_pDepthBuffer);
+    SAFE_RELEASE(m_pDepthBufferDSV);
+    SAFE_RELEASE(m_pDepthBufferSRV);
+
+    // Term small sphere
+    SAFE_RELEASE(m_pBulbArgs);
+    SAFE_RELEASE(m_pSmallSphereInputLayout);
+    SAFE_RELEASE(m_pSmallSphereVertexShader);
+    SAFE_RELEASE(m_pSmallSpherePixelShader);
+    SAFE_RELEASE(m_pBulbImpostorArgs);
+    SAFE_RELEASE(m_pBulbImpostorVertexShader);
+    SAFE_RELEASE(m_pBulbImpostorPixelShader);
+
+    // Term GPU culling setup
+    SAFE_RELEASE(m_pCullShader);
+    SAFE_RELEASE(m_pCullAtomicShader);
+    SAFE_RELEASE(m_pIndirectArgs);
+    SAFE_RELEASE(m_pMeshArgsReset);
+    SAFE_RELEASE(m_pCullParams);
+    SAFE_RELEASE(m_pShadowCullParams);
+    SAFE_RELEASE(m_pInstBounds);
+    SAFE_RELEASE(m_pInstBoundsSRV);
+    SAFE_RELEASE(m_pInstBoundsUAV);
+    m_geomScatter.Term();
+    m_boundsScatter.Term();
+    SAFE_RELEASE(m_pIndirectArgsUAV);
+    SAFE_RELEASE(m_pGeomBufferInstVisGPU);
+    SAFE_RELEASE(m_pGeomBufferInstVisGPU_UAV);
+    SAFE_RELEASE(m_pGeomBufferInstVisGPU_SRV);
+    SAFE_RELEASE(m_pInstanceTransformsShader);
+    for (UINT i = 0; i < TransformSetCount; i++)
+    {
+        SAFE_RELEASE(m_pInstanceTransforms[i]);
+        SAFE_RELEASE(m_pInstanceTransformsUAV[i]);
+        SAFE_RELEASE(m_pInstanceTransformsSRV[i]);
+        SAFE_RELEASE(m_pDrawBases[i]);
+        SAFE_RELEASE(m_pDrawBasesUAV[i]);
+        SAFE_RELEASE(m_pDrawBasesSRV[i]);
     }
+    m_statsReadback.Term();
+
+    // Term hierarchical culling setup
+    TermClusterCull();
+    SAFE_RELEASE(m_pDispatchArgsShader);
+    SAFE_RELEASE(m_pDispatchArgsStructuredShader);
+    SAFE_RELEASE(m_pDispatchArgsParams);
+
+    // Term occlusion culling setup
+    SAFE_RELEASE(m_pHiZ);
+    SAFE_RELEASE(m_pHiZSRV);
+    for (int i = 0; i < MaxHiZMips; i++)
+    {
+        SAFE_RELEASE(m_pHiZMipSRVs[i]);
+        SAFE_RELEASE(m_pHiZMipUAVs[i]);
+    }
+    SAFE_RELEASE(m_pHiZShader);
+    SAFE_RELEASE(m_pHiZMsaaShader);
+    SAFE_RELEASE(m_pHiZParams);
+    SAFE_RELEASE(m_pOcclusionCullShader);
+    for (int i = 0; i < 2; i++)
+    {
+        SAFE_RELEASE(m_pOcclusionParams[i]);
+    }
+    SAFE_RELEASE(m_pOccludedIds);
+    SAFE_RELEASE(m_pOccludedIdsUAV);
+    SAFE_RELEASE(m_pOccludedCount);
+    SAFE_RELEASE(m_pOccludedCountUAV);
+    SAFE_RELEASE(m_pLateIds);
+    SAFE_RELEASE(m_pLateIdsSRV);
+    SAFE_RELEASE(m_pLateIdsUAV);
+    SAFE_RELEASE(m_pLateArgs);
+    SAFE_RELEASE(m_pLateArgsUAV);
+    SAFE_RELEASE(m_pOccludedArgs);
+    SAFE_RELEASE(m_pOccludedArgsUAV);
+
+    // Term meshlet model
+    SAFE_RELEASE(m_pMeshletCullShader);
+    SAFE_RELEASE(m_pMeshletParams);
+    SAFE_RELEASE(m_pMeshlets);
+    SAFE_RELEASE(m_pMeshletsSRV);
+    SAFE_RELEASE(m_pMeshletIndices);
+    SAFE_RELEASE(m_pMeshletIndicesUAV);
+    SAFE_RELEASE(m_pMeshletArgs);
+    SAFE_RELEASE(m_pMeshletArgsUAV);
+    SAFE_RELEASE(m_pMeshletArgsCountUAV);
+    SAFE_RELEASE(m_pMeshletGeom);
+    SAFE_RELEASE(m_pMeshletGeomSRV);
+    SAFE_RELEASE(m_pMeshletIds);
+    SAFE_RELEASE(m_pMeshletIdsSRV);
+    m_meshletReadback.Term();
+    m_meshlets.clear();
+    m_meshletCount = 0;
+
+    // Term precision comparison
+    for (int i = 0; i < 2; i++)
+    {
+        SAFE_RELEASE(m_pDiffTextures[i]);
+        SAFE_RELEASE(m_pDiffSRVs[i]);
+    }
+    m_diffWidth = 0;
+    m_diffHeight = 0;
+    SAFE_RELEASE(m_pDiffResult);
+    SAFE_RELEASE(m_pDiffResultUAV);
+    SAFE_RELEASE(m_pImageDiffShader);
+    m_diffReadback.Term();
+    m_precisionCompare = PrecisionCompareIdle;
+
+    // Term GPU animation setup
+    SAFE_RELEASE(m_pAnimateShader);
+    SAFE_RELEASE(m_pAnimateParams);
+
+    // Term clustered lighting
+    SAFE_RELEASE(m_pLightBuffer);
+    SAFE_RELEASE(m_pLightBufferSRV);
+    SAFE_RELEASE(m_pVisibleLights);
+    SAFE_RELEASE(m_pVisibleLightsSRV);
+    SAFE_RELEASE(m_pVisibleLightsUAV);
+    SAFE_RELEASE(m_pVisibleLightCount);
+    SAFE_RELEASE(m_pVisibleLightCountSRV);
+    SAFE_RELEASE(m_pVisibleLightCountUAV);
+    SAFE_RELEASE(m_pLightListShader);
+    SAFE_RELEASE(m_pVisibleBulbs);
+    SAFE_RELEASE(m_pVisibleBulbsSRV);
+    SAFE_RELEASE(m_pVisibleBulbsUAV);
+    SAFE_RELEASE(m_pVisibleBulbCount);
+    SAFE_RELEASE(m_pVisibleBulbCountUAV);
+    SAFE_RELEASE(m_pBulbCullShader);
+    SAFE_RELEASE(m_pClusterLights);
+    SAFE_RELEASE(m_pClusterLightsSRV);
+    SAFE_RELEASE(m_pClusterLightsUAV);
+    SAFE_RELEASE(m_pLightCullShader);
+    SAFE_RELEASE(m_pLightCullParams);
+
+    // Term instance sort
+    SAFE_RELEASE(m_pSortKeys);
+    SAFE_RELEASE(m_pSortKeysUAV);
+    SAFE_RELEASE(m_pSortParams);
+    SAFE_RELEASE(m_pSortKeysShader);
+    SAFE_RELEASE(m_pSortLocalShader);
+    SAFE_RELEASE(m_pSortGlobalShader);
+    SAFE_RELEASE(m_pSortWriteShader);
+    SAFE_RELEASE(m_pSortWriteArgs);
+    SAFE_RELEASE(m_pSortWriteArgsUAV);
+
+    // Term sun shadows
+    m_shadowCB.Term();
+    m_constantRing.Term();
+    for (UINT i = 0; i < CascadeCount; i++)
+    {
+        m_cascadeCBs[i].Term();
+        SAFE_RELEASE(m_pShadowArgs[i]);
+        SAFE_RELEASE(m_pShadowArgsUAV[i]);
+        SAFE_RELEASE(m_pShadowIds[i]);
+        SAFE_RELEASE(m_pShadowIdsSRV[i]);
+        SAFE_RELEASE(m_pShadowIdsUAV[i]);
+    }
+    SAFE_RELEASE(m_pShadowAtlas);
+    SAFE_RELEASE(m_pShadowAtlasDSV);
+    SAFE_RELEASE(m_pShadowAtlasSRV);
+    SAFE_RELEASE(m_pNoOcclusionParams);
+    m_multiViewCB.Term();
+    SAFE_RELEASE(m_pMultiViewCullShader);
+    SAFE_RELEASE(m_pMultiViewArgs);
+    SAFE_RELEASE(m_pMultiViewArgsUAV);
+    SAFE_RELEASE(m_pMultiViewArgsReset);
+    SAFE_RELEASE(m_pMultiViewIds);
+    SAFE_RELEASE(m_pMultiViewIdsSRV);
+    SAFE_RELEASE(m_pMultiViewIdsUAV);
+
+    // Term deferred shading
+    for (UINT i = 0; i < GBufferCount; i++)
+    {
+        SAFE_RELEASE(m_pGBuffers[i]);
+        SAFE_RELEASE(m_pGBufferRTVs[i]);
+        SAFE_RELEASE(m_pGBufferSRVs[i]);
+    }
+    for (UINT i = 0; i < ShaderVariantCount; i++)
+    {
+        SAFE_RELEASE(m_pGBufferPixelShaders[i]);
+        SAFE_RELEASE(m_pResolveShaders[i]);
+    }
+    SAFE_RELEASE(m_pResolveParams);
+}
+
+void Renderer::BindFrameState(StateCache& state)
+{
+    ID3D11RenderTargetView* views[] = { GetSceneRTV() };
+    state.OMSetRenderTargets(1, views, GetSceneDSV());
+
+    SetViewport(state, GetRenderWidth(), GetRenderHeight());
 
-    // Create index buffer
-    if (SUCCEEDED(result))
-    {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(Indices);
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+    state.OMSetDepthStencilState(m_pDepthState, 0);
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = &Indices;
-        data.SysMemPitch = sizeof(Indices);
-        data.SysMemSlicePitch = 0;
+    state.RSSetState(m_pRasterizerState);
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pIndexBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pIndexBuffer, "IndexBuffer");
-        }
-    }
+    state.OMSetBlendState(m_pOpaqueBlendState, nullptr, 0xFFFFFFFF);
 
-    ID3DBlob* pVertexShaderCode = nullptr;
-    if (SUCCEEDED(result))
+    ID3D11SamplerState* samplers[] = { m_pSampler };
+    state.PSSetSamplers(0, 1, samplers);
+    state.PSSetSamplers(MaterialSamplerSlot, MaterialTable::FilterCount, m_pMaterialSamplers);
+
+    ID3D11Buffer* cbuffers[] = { m_sceneCB.Get() };
+    state.VSSetConstantBuffers(0, 1, cbuffers);
+    state.PSSetConstantBuffers(0, 1, cbuffers);
+    ID3D11Buffer* settingsCB[] = { m_settingsCB.Get() };
+    state.PSSetConstantBuffers(SettingsCBSlot, 1, settingsCB);
+    ID3D11Buffer* ambientCB[] = { m_pAmbientCB };
+    state.PSSetConstantBuffers(AmbientCBSlot, 1, ambientCB);
+
+    ID3D11ShaderResourceView* lightResources[] = { m_pVisibleLightsSRV, m_pClusterLightsSRV };
+    state.PSSetShaderResources(5, 2, lightResources);
+
+    // Sun light and its shadow cascades
+    ID3D11ShaderResourceView* shadowResources[] = { m_pShadowAtlasSRV };
+    state.PSSetShaderResources(ShadowAtlasSlot, 1, shadowResources);
+    ID3D11Buffer* shadowCB[] = { m_shadowCB.Get() };
+    state.PSSetConstantBuffers(ShadowCBSlot, 1, shadowCB);
+    ID3D11SamplerState* shadowSamplers[] = { m_pShadowSampler };
+    state.PSSetSamplers(1, 1, shadowSamplers);
+}
+
+void Renderer::BindCubeState(StateCache& state, ID3D11ShaderResourceView* pIdsSRV, TransformSet transforms)
+{
+    // Lit cubes are written to G-buffer in deferred shading mode, motion vectors go to the target after color ones
+    bool motionVectors = IsTemporalUpscaleActive();
+    if (m_deferredShading)
     {
-        result = CompileAndCreateShader(L"SimpleTexture.vs", (ID3D11DeviceChild**)&m_pVertexShader, {}, &pVertexShaderCode);
+        ID3D11RenderTargetView* views[] = { m_pGBufferRTVs[0], m_pGBufferRTVs[1], m_pMotionBufferRTV };
+        state.OMSetRenderTargets(motionVectors ? GBufferCount + 1 : GBufferCount, views, m_pDepthBufferDSV);
     }
-    if (SUCCEEDED(result))
+    else if (motionVectors)
     {
-        result = CompileAndCreateShader(L"SimpleTexture.ps", (ID3D11DeviceChild**)&m_pPixelShader);
+        ID3D11RenderTargetView* views[] = { GetSceneRTV(), m_pMotionBufferRTV };
+        state.OMSetRenderTargets(2, views, GetSceneDSV());
     }
 
-    if (SUCCEEDED(result))
+    // The same texture files, either streamed whole or mapped tile by tile
+    bool virtualTextures = IsVirtualTexturingActive();
+    ID3D11ShaderResourceView* resources[] = {
+        virtualTextures ? m_virtualTextures.GetView(MaterialTable::TextureSetAlbedo) : m_materials.GetTextureView(MaterialTable::TextureSetAlbedo),
+        virtualTextures ? m_virtualTextures.GetView(MaterialTable::TextureSetNormal) : m_materials.GetTextureView(MaterialTable::TextureSetNormal),
+        m_pGeomBufferInstSRV, pIdsSRV, m_materials.GetMaterialsSRV()
+    };
+    state.PSSetShaderResources(0, 5, resources);
+    state.VSSetShaderResources(2, 2, resources + 2);
+    if (virtualTextures)
     {
-        result = m_pDevice->CreateInputLayout(InputDesc, 4, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &m_pInputLayout);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pInputLayout, "InputLayout");
-        }
+        ID3D11ShaderResourceView* residency[] = {
+            m_virtualTextures.GetResidencyView(MaterialTable::TextureSetAlbedo), m_virtualTextures.GetResidencyView(MaterialTable::TextureSetNormal)
+        };
+        state.PSSetShaderResources(ResidencySlot, 2, residency);
+        ID3D11Buffer* virtualCB[] = { m_virtualTextures.GetConstants() };
+        state.PSSetConstantBuffers(VirtualTextureCBSlot, 1, virtualCB);
     }
 
-    SAFE_RELEASE(pVertexShaderCode);
+    m_geometryPool.Bind(state, m_packedVertices ? GeometryPool::VertexFormatPacked : GeometryPool::VertexFormatTextured);
 
-    // Create geometry buffer
-    if (SUCCEEDED(result))
+    ID3D11Buffer* instanceBuffers[] = { m_pInstanceIndices };
+    UINT instanceStrides[] = { sizeof(UINT) };
+    UINT instanceOffsets[] = { 0 };
+    state.IASetVertexBuffers(1, 1, instanceBuffers, instanceStrides, instanceOffsets);
+
+    // Motion vectors need rotation speed of instance, so they keep fetching it through ids
+    bool precomputed = transforms != TransformSetNone && !motionVectors;
+    if (precomputed)
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(GeomBuffer) * MaxInst;
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        ID3D11ShaderResourceView* transformResources[] = { m_pInstanceTransformsSRV[transforms], m_pDrawBasesSRV[transforms] };
+        state.VSSetShaderResources(4, 2, transformResources);
+    }
 
-        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pGeomBufferInst);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pGeomBufferInst, "GeomBufferInst");
-        }
-        if (SUCCEEDED(result))
-        {
-            const float diag = sqrtf(2.0f) / 2.0f * 0.5f;
+    Pipeline pipeline = {
+        motionVectors ? m_pMotionVertexShader : (precomputed ? m_pTransformVertexShader : m_pVertexShader),
+        m_deferredShading ? m_pGBufferPixelShaders[GetShaderVariant(GBufferVariants)] : m_pPixelShaders[GetShaderVariant(ForwardVariants)],
+        m_pInputLayout, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pOpaqueBlendState, m_pDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(pipeline);
+}
 
-            m_geomBuffers[0].shineSpeedTexIdNM.x = 0.0f;
-            m_geomBuffers[0].shineSpeedTexIdNM.y = ModelRotationSpeed;
-            m_geomBuffers[0].shineSpeedTexIdNM.z = 0.0f;
-            int useNM = 1;
-            m_geomBuffers[0].shineSpeedTexIdNM.w = *reinterpret_cast<float*>(&useNM);
-            m_geomBuffers[0].posAngle = Point4f{ 0.00001f, 0, 0, 0 };
-            m_geomBBs[0].vmin = m_geomBuffers[0].posAngle + Point3f{ -diag, -0.5f, -diag };
-            m_geomBBs[0].vmax = m_geomBuffers[0].posAngle + Point3f{ diag,  0.5f,  diag };
-
-            m_geomBuffers[1].shineSpeedTexIdNM.x = 64.0f;
-            m_geomBuffers[1].shineSpeedTexIdNM.y = 0.0f;
-            m_geomBuffers[1].shineSpeedTexIdNM.z = 0.0f;
-            m_geomBuffers[1].shineSpeedTexIdNM.w = *reinterpret_cast<float*>(&useNM);
-            m_geomBuffers[1].posAngle = Point4f{ 2.0f, 0, 0, 0 };
-            DirectX::XMMATRIX m = DirectX::XMMatrixMultiply(
-                DirectX::XMMatrixRotationAxis(DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f), -(float)m_geomBuffers[1].posAngle.w),
-                DirectX::XMMatrixTranslation(m_geomBuffers[1].posAngle.x, m_geomBuffers[1].posAngle.y, m_geomBuffers[1].posAngle.z)
-            );
-            m_geomBuffers[1].m = m;
-            m = DirectX::XMMatrixInverse(nullptr, m);
-            m = DirectX::XMMatrixTranspose(m);
-            m_geomBuffers[1].normalM = m;
-            m_geomBBs[1].vmin = m_geomBuffers[1].posAngle + Point3f{ -0.5f, -0.5f, -0.5f };
-            m_geomBBs[1].vmax = m_geomBuffers[1].posAngle + Point3f{ 0.5f, 0.5f, 0.5f };
-
-            for (int i = 2; i < 10; i++)
-            {
-                InitGeom(m_geomBuffers[i], m_geomBBs[i]);
-            }
-            m_instCount = 10;
-            m_updateCullParams = true;
-        }
-    }
-    // Create geometry visibility buffer
-    if (SUCCEEDED(result))
-    {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(Point4i) * MaxInst;
-        desc.Usage = D3D11_USAGE_DYNAMIC;
-        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+void Renderer::RenderCubes(StateCache& state)
+{
+    bool computeCull = m_doCull && m_computeCull;
+    BindCubeState(state, computeCull ? m_pGeomBufferInstVisGPU_SRV : m_pGeomBufferInstVisSRV,
+        computeCull && m_instanceTransforms ? TransformSetVisible : TransformSetNone);
 
-        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pGeomBufferInstVis);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pGeomBufferInstVis, "GeomBufferInstVis");
-        }
-    }
-    // Create scene buffer
-    if (SUCCEEDED(result))
+    if (m_depthPrePass)
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(SceneBuffer);
-        desc.Usage = D3D11_USAGE_DYNAMIC;
-        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        // Depth only, so the shading shader runs once per visible pixel
+        state.PSSetShader(nullptr, nullptr, 0);
+        DrawCubes(state);
 
-        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pSceneBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pSceneBuffer, "SceneBuffer");
-        }
+        state.OMSetDepthStencilState(m_pDepthEqualState, 0);
+        state.PSSetShader(m_deferredShading ? m_pGBufferPixelShaders[GetShaderVariant(GBufferVariants)] : m_pPixelShaders[GetShaderVariant(ForwardVariants)], nullptr, 0);
     }
 
-    // CCW culling rasterizer state
-    if (SUCCEEDED(result))
-    {
-        D3D11_RASTERIZER_DESC desc = {};
-        desc.AntialiasedLineEnable = FALSE;
-        desc.FillMode = D3D11_FILL_SOLID;
-        desc.CullMode = D3D11_CULL_NONE;
-        desc.FrontCounterClockwise = FALSE;
-        desc.DepthBias = 0;
-        desc.SlopeScaledDepthBias = 0.0f;
-        desc.DepthBiasClamp = 0.0f;
-        desc.DepthClipEnable = TRUE;
-        desc.ScissorEnable = FALSE;
-        desc.MultisampleEnable = FALSE;
+    DrawCubes(state);
 
-        result = m_pDevice->CreateRasterizerState(&desc, &m_pRasterizerState);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pRasterizerState, "RasterizerState");
-        }
+    // Impostors discard pixels out of the mesh, so they are not in depth pre-pass and write depth themselves
+    if (m_depthPrePass)
+    {
+        state.OMSetDepthStencilState(m_pDepthState, 0);
     }
+    DrawImpostors(state, computeCull ? m_pGeomBufferInstVisGPU_SRV : m_pGeomBufferInstVisSRV, computeCull ? m_pIndirectArgs : nullptr, GetImpostorPixelShader());
+}
 
-    // Create blend states
-    if (SUCCEEDED(result))
+void Renderer::DrawCubes(StateCache& state)
+{
+    // All instanced meshes share vertex format, so only draw arguments and index buffer of imported mesh change between meshes
+    for (UINT i = 0; i < InstanceDrawCount; i++)
     {
-        D3D11_BLEND_DESC desc = {};
-        desc.AlphaToCoverageEnable = FALSE;
-        desc.IndependentBlendEnable = FALSE;
-        desc.RenderTarget[0].BlendEnable = TRUE;
-        desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
-        desc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
-        desc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
-        desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED | D3D11_COLOR_WRITE_ENABLE_GREEN | D3D11_COLOR_WRITE_ENABLE_BLUE;
-        desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-        desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
-        desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
-        result = m_pDevice->CreateBlendState(&desc, &m_pTransBlendState);
-        if (SUCCEEDED(result))
+        if (i % MaxLods >= m_lodCounts[i / MaxLods])
         {
-            result = SetResourceName(m_pTransBlendState, "TransBlendState");
+            continue;
         }
-        if (SUCCEEDED(result))
+
+        m_geometryPool.BindIndexBuffer(state, m_instanceMeshes[i]);
+
+        if (m_doCull && m_computeCull)
         {
-            desc.RenderTarget[0].BlendEnable = FALSE;
-            result = m_pDevice->CreateBlendState(&desc, &m_pOpaqueBlendState);
+            state.DrawIndexedInstancedIndirect(m_pIndirectArgs, i * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS));
         }
-        if (SUCCEEDED(result))
+        else if (m_visibleCounts[i] > 0)
         {
-            result = SetResourceName(m_pOpaqueBlendState, "OpaqueBlendState");
+            m_geometryPool.DrawInstanced(state, m_instanceMeshes[i], m_visibleCounts[i], i * MaxInst);
         }
     }
+}
 
-    // Create reverse depth state
-    if (SUCCEEDED(result))
+void Renderer::RecordPass(UINT pass, StateCache& state)
+{
+    SetOverdrawCounting(state, IsOverdrawCounted(pass), pass == PassCubes);
+    BindFrameState(state);
+
+    switch (pass)
     {
-        D3D11_DEPTH_STENCIL_DESC desc = {};
-        desc.DepthEnable = TRUE;
-        desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-        desc.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
-        desc.StencilEnable = FALSE;
+        case PassCubes:
+            RenderCubes(state);
+            break;
 
-        result = m_pDevice->CreateDepthStencilState(&desc, &m_pDepthState);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pDepthState, "DepthState");
-        }
-    }
+        case PassSmallSpheres:
+            if (m_showLightBulbs)
+            {
+                BeginPredicatedDraw(state, PredicateBulbs);
+                RenderSmallSpheres(state);
+                EndPredicatedDraw(state, PredicateBulbs);
+            }
+            break;
 
-    // Create reverse transparent depth state
-    if (SUCCEEDED(result))
-    {
-        D3D11_DEPTH_STENCIL_DESC desc = {};
-        desc.DepthEnable = TRUE;
-        desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
-        desc.DepthFunc = D3D11_COMPARISON_GREATER;
-        desc.StencilEnable = FALSE;
+        case PassSphere:
+            RenderSphere(state);
+            break;
 
-        result = m_pDevice->CreateDepthStencilState(&desc, &m_pTransDepthState);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pTransDepthState, "TransDepthState");
-        }
+        case PassRects:
+            if (IsLowResTransActive())
+            {
+                BeginLowResTrans(state);
+            }
+            BeginPredicatedDraw(state, PredicateRects);
+            RenderRects(state);
+            EndPredicatedDraw(state, PredicateRects);
+            if (m_particles && m_pParticles != nullptr)
+            {
+                RenderParticles(state);
+            }
+            if (IsLowResTransActive())
+            {
+                EndLowResTrans(state);
+            }
+            break;
     }
 
-    // Load texture
-    DXGI_FORMAT textureFmt;
-    if (SUCCEEDED(result))
+    SetOverdrawCounting(state, false);
+}
+
+void Renderer::RecordPasses()
+{
+    // Passes only read renderer state, so they are recorded in parallel, one deferred context each
+    m_jobSystem.ParallelFor(PassCount, 1, [this](UINT begin, UINT end)
     {
-        TextureDesc textureDesc[2];
-        bool ddsRes = LoadDDS(L"../Common/Brick.dds", textureDesc[0]);
-        if (ddsRes)
+        for (UINT pass = begin; pass < end; pass++)
         {
-            ddsRes = LoadDDS(L"../Common/Kitty.dds", textureDesc[1]);
+            CPU_PROFILE_ZONE("RecordPass");
+            RecordPass(pass, m_deferredStates[pass]);
+
+            HRESULT result = m_pDeferredContexts[pass]->FinishCommandList(FALSE, &m_pCommandLists[pass]);
+            assert(SUCCEEDED(result));
+            m_deferredStates[pass].ResetToDefault();
         }
+    });
+}
 
-        textureFmt = textureDesc[0].fmt;
+void Renderer::SubmitPass(UINT pass)
+{
+    if (m_pCommandLists[pass] != nullptr)
+    {
+        m_pDeviceContext->ExecuteCommandList(m_pCommandLists[pass], FALSE);
+        SAFE_RELEASE(m_pCommandLists[pass]);
 
-        D3D11_TEXTURE2D_DESC desc = {};
-        desc.Format = textureDesc[0].fmt;
-        desc.ArraySize = 2;
-        desc.MipLevels = textureDesc[0].mipmapsCount;
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.SampleDesc.Count = 1;
-        desc.SampleDesc.Quality = 0;
-        desc.Height = textureDesc[0].height;
-        desc.Width = textureDesc[0].width;
+        // Immediate context state is cleared after execution
+        m_immediateState.ResetToDefault();
+    }
+    else
+    {
+        RecordPass(pass, m_immediateState);
+    }
+}
 
-        std::vector<D3D11_SUBRESOURCE_DATA> data;
-        data.resize(desc.MipLevels * 2);
-        for (UINT32 j = 0; j < 2; j++)
-        {
-            UINT32 blockWidth = DivUp(desc.Width, 4u);
-            UINT32 blockHeight = DivUp(desc.Height, 4u);
-            UINT32 pitch = blockWidth * GetBytesPerBlock(desc.Format);
-            const char* pSrcData = reinterpret_cast<const char*>(textureDesc[j].pData);
+void Renderer::RenderSphere(StateCache& state)
+{
+    ID3D11SamplerState* samplers[] = { m_pSampler };
+    state.PSSetSamplers(0, 1, samplers);
 
-            for (UINT32 i = 0; i < desc.MipLevels; i++)
-            {
-                data[j * desc.MipLevels + i].pSysMem = pSrcData;
-                data[j * desc.MipLevels + i].SysMemPitch = pitch;
-                data[j * desc.MipLevels + i].SysMemSlicePitch = 0;
+    ID3D11ShaderResourceView* resources[] = { m_pCubemapView };
+    state.PSSetShaderResources(0, 1, resources);
 
-                pSrcData += pitch * blockHeight;
-                blockHeight = std::max(1u, blockHeight / 2);
-                blockWidth = std::max(1u, blockWidth / 2);
-                pitch = blockWidth * GetBytesPerBlock(desc.Format);
-            }
-        }
-        result = m_pDevice->CreateTexture2D(&desc, data.data(), &m_pTexture);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pTexture, WCSToMBS(L"Diffuse textures"));
-        }
-        for (UINT32 j = 0; j < 2; j++)
-        {
-            free(textureDesc[j].pData);
-        }
+    ID3D11Buffer* cbuffers[] = { m_sceneCB.Get() };
+    state.VSSetConstantBuffers(0, 1, cbuffers);
+
+    // Drawn after opaque geometry, so only uncovered pixels sample the cubemap
+    Pipeline pipeline = {
+        m_pSkyTriangleVertexShader, m_pSpherePixelShader, nullptr, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pOpaqueBlendState, m_pSkyDepthState, m_pRasterizerState
+    };
+    // Instance count is 0 when Hi-Z shows the scene covers the view
+    if (m_skyTriangle)
+    {
+        state.SetPipeline(pipeline);
+        state.DrawInstancedIndirect(m_pSkyArgs, 0);
     }
-    if (SUCCEEDED(result))
+    else
+    {
+        pipeline.pVS = m_pSphereVertexShader;
+        pipeline.pInputLayout = m_pSphereInputLayout;
+        m_geometryPool.Bind(state, GeometryPool::VertexFormatPosition);
+        state.SetPipeline(pipeline);
+        state.DrawIndexedInstancedIndirect(m_pSkyArgs, 4 * sizeof(UINT));
+    }
+}
+
+void Renderer::RenderSmallSpheres(StateCache& state)
+{
+    // Bulb per light in the visible bulbs list, its position and color are read from the list
+    ID3D11ShaderResourceView* resources[] = { m_pVisibleBulbsSRV };
+    state.VSSetShaderResources(5, 1, resources);
+    if (m_bulbImpostors)
     {
-        D3D11_SHADER_RESOURCE_VIEW_DESC desc = {};
-        desc.Format = textureFmt;
-        desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
-        desc.Texture2DArray.ArraySize = 2;
-        desc.Texture2DArray.FirstArraySlice = 0;
-        desc.Texture2DArray.MipLevels = 11;
-        desc.Texture2DArray.MostDetailedMip = 0;
+        Pipeline pipeline = {
+            m_pBulbImpostorVertexShader, m_pBulbImpostorPixelShader, nullptr, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+            m_pOpaqueBlendState, m_pDepthState, m_pRasterizerState
+        };
+        state.SetPipeline(pipeline);
 
-        result = m_pDevice->CreateShaderResourceView(m_pTexture, &desc, &m_pTextureView);
+        state.DrawInstancedIndirect(m_pBulbImpostorArgs, 0);
+        return;
     }
-    if (SUCCEEDED(result))
+
+    m_geometryPool.Bind(state, GeometryPool::VertexFormatPosition);
+    Pipeline pipeline = {
+        m_pSmallSphereVertexShader, m_pSmallSpherePixelShader, m_pSmallSphereInputLayout, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pOpaqueBlendState, m_pDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(pipeline);
+
+    state.DrawIndexedInstancedIndirect(m_pBulbArgs, 0);
+}
+
+void Renderer::RenderRects(StateCache& state)
+{
+    if (m_weightedOit && m_pOitAccumRTV != nullptr)
     {
-        const std::wstring TextureName = L"../Common/BrickNM.dds";
+        RenderRectsOit(state);
+        return;
+    }
 
-        TextureDesc textureDesc;
-        bool ddsRes = LoadDDS(TextureName.c_str(), textureDesc);
+    // Visible rects are sorted back to front by SortTransparent
+    Pipeline pipeline = {
+        m_pRectVertexShader, m_pRectPixelShaders[GetShaderVariant(LitVariants)], m_pRectInputLayout, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        GetTransBlendState(), m_pTransDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(pipeline);
+
+    m_geometryPool.Bind(state, GeometryPool::VertexFormatColor);
+    ID3D11Buffer* cbuffers[] = { m_sceneCB.Get() };
+    state.VSSetConstantBuffers(0, 1, cbuffers);
+    ID3D11ShaderResourceView* vsResources[] = { m_pRectInstBufferSRV, m_pRectIdsSRV };
+    state.VSSetShaderResources(1, 2, vsResources);
+    state.PSSetConstantBuffers(0, 1, cbuffers);
+    ID3D11ShaderResourceView* resources[] = { m_pRectTextureSRV };
+    state.PSSetShaderResources(0, 1, resources);
+    ID3D11SamplerState* samplers[] = { m_pSampler };
+    state.PSSetSamplers(0, 1, samplers);
 
-        textureFmt = textureDesc.fmt;
+    state.DrawIndexedInstancedIndirect(m_pRectArgs, 0);
 
-        D3D11_TEXTURE2D_DESC desc = {};
-        desc.Format = textureDesc.fmt;
-        desc.ArraySize = 1;
-        desc.MipLevels = textureDesc.mipmapsCount;
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.SampleDesc.Count = 1;
-        desc.SampleDesc.Quality = 0;
-        desc.Height = textureDesc.height;
-        desc.Width = textureDesc.width;
+    // Ids are written by sort in the next frame
+    ID3D11ShaderResourceView* nullResources[2] = {};
+    state.VSSetShaderResources(1, 2, nullResources);
+}
+
+void Renderer::RenderRectsOit(StateCache& state)
+{
+    ID3D11DeviceContext* pContext = state.GetContext();
+
+    // Accumulate all rects unsorted, depth is tested against the scene but not written
+    static const FLOAT AccumClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    static const FLOAT RevealageClear[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    pContext->ClearRenderTargetView(m_pOitAccumRTV, AccumClear);
+    pContext->ClearRenderTargetView(m_pOitRevealageRTV, RevealageClear);
+
+    ID3D11RenderTargetView* oitViews[] = { m_pOitAccumRTV, m_pOitRevealageRTV };
+    state.OMSetRenderTargets(2, oitViews, GetTransDSV());
+    Pipeline accumPipeline = {
+        m_pRectOitVertexShader, m_pRectOitPixelShaders[GetShaderVariant(LitVariants)], m_pRectInputLayout, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pOitBlendState, m_pTransDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(accumPipeline);
+
+    m_geometryPool.Bind(state, GeometryPool::VertexFormatColor);
+    ID3D11Buffer* cbuffers[] = { m_sceneCB.Get() };
+    state.VSSetConstantBuffers(0, 1, cbuffers);
+    ID3D11ShaderResourceView* vsResources[] = { m_pRectInstBufferSRV };
+    state.VSSetShaderResources(1, 1, vsResources);
+    state.PSSetConstantBuffers(0, 1, cbuffers);
+    ID3D11ShaderResourceView* resources[] = { m_pRectTextureSRV };
+    state.PSSetShaderResources(0, 1, resources);
+    ID3D11SamplerState* samplers[] = { m_pSampler };
+    state.PSSetSamplers(0, 1, samplers);
 
-        UINT32 blockWidth = DivUp(desc.Width, 4u);
-        UINT32 blockHeight = DivUp(desc.Height, 4u);
-        UINT32 pitch = blockWidth * GetBytesPerBlock(desc.Format);
-        const char* pSrcData = reinterpret_cast<const char*>(textureDesc.pData);
+    m_geometryPool.DrawInstanced(state, m_rectMesh, RectCount);
 
-        std::vector<D3D11_SUBRESOURCE_DATA> data;
-        data.resize(desc.MipLevels);
-        for (UINT32 i = 0; i < desc.MipLevels; i++)
-        {
-            data[i].pSysMem = pSrcData;
-            data[i].SysMemPitch = pitch;
-            data[i].SysMemSlicePitch = 0;
+    // Composite over the scene with one fullscreen triangle
+    ID3D11RenderTargetView* views[] = { GetTransRTV() };
+    state.OMSetRenderTargets(1, views, nullptr);
+    Pipeline compositePipeline = {
+        m_pFullscreenVertexShader, m_oitSamples > 1 ? m_pOitCompositeMsaaPixelShader : m_pOitCompositePixelShader, nullptr, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        GetTransBlendState(), m_pTransDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(compositePipeline);
+    ID3D11ShaderResourceView* oitResources[] = { m_pOitAccumSRV, m_pOitRevealageSRV };
+    state.PSSetShaderResources(0, 2, oitResources);
 
-            pSrcData += pitch * blockHeight;
-            blockHeight = std::max(1u, blockHeight / 2);
-            blockWidth = std::max(1u, blockWidth / 2);
-            pitch = blockWidth * GetBytesPerBlock(desc.Format);
-        }
-        result = m_pDevice->CreateTexture2D(&desc, data.data(), &m_pTextureNM);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pTextureNM, WCSToMBS(TextureName));
-        }
+    state.Draw(3, 0);
 
-        free(textureDesc.pData);
-    }
-    if (SUCCEEDED(result))
-    {
-        D3D11_SHADER_RESOURCE_VIEW_DESC desc = {};
-        desc.Format = textureFmt;
-        desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-        desc.Texture2D.MipLevels = 11;
-        desc.Texture2D.MostDetailedMip = 0;
+    // Targets are written again in the next frame
+    ID3D11ShaderResourceView* nullResources[2] = {};
+    state.PSSetShaderResources(0, 2, nullResources);
+    vsResources[0] = nullptr;
+    state.VSSetShaderResources(1, 1, vsResources);
+}
 
-        result = m_pDevice->CreateShaderResourceView(m_pTextureNM, &desc, &m_pTextureViewNM);
-    }
+void Renderer::SetViewport(StateCache& state, UINT width, UINT height)
+{
+    D3D11_VIEWPORT viewport;
+    viewport.TopLeftX = 0;
+    viewport.TopLeftY = 0;
+    viewport.Width = (FLOAT)width;
+    viewport.Height = (FLOAT)height;
+    viewport.MinDepth = 0.0f;
+    viewport.MaxDepth = 1.0f;
+    state.RSSetViewports(1, &viewport);
 
-    if (SUCCEEDED(result))
-    {
-        D3D11_SAMPLER_DESC desc = {};
+    D3D11_RECT rect;
+    rect.left = 0;
+    rect.top = 0;
+    rect.right = width;
+    rect.bottom = height;
+    state.RSSetScissorRects(1, &rect);
+}
+
+void Renderer::BeginLowResTrans(StateCache& state)
+{
+    ID3D11DeviceContext* pContext = state.GetContext();
+
+    // Nothing blended yet, scene behind is fully visible
+    static const FLOAT TransClear[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    pContext->ClearRenderTargetView(m_pLowResTransColorRTV, TransClear);
+
+    UINT scale = GetTransScale();
+    SetViewport(state, DivUp(GetRenderWidth(), scale), DivUp(GetRenderHeight(), scale));
 
-        //desc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-        //desc.Filter = D3D11_FILTER_MIN_MAG_POINT_MIP_LINEAR;
-        desc.Filter = D3D11_FILTER_ANISOTROPIC;
-        desc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-        desc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-        desc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-        desc.MinLOD = -FLT_MAX;
-        desc.MaxLOD = FLT_MAX;
-        desc.MipLODBias = 0.0f;
-        desc.MaxAnisotropy = 16;
-        desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-        desc.BorderColor[0] = desc.BorderColor[1] = desc.BorderColor[2] = desc.BorderColor[3] = 1.0f;
+    // Scene depth is downsampled first, it is unbound from output before being read
+    state.OMSetRenderTargets(0, nullptr, m_pLowResTransDepthDSV);
+    Pipeline depthPipeline = {
+        m_pFullscreenVertexShader, m_pLowResDepthPixelShader, nullptr, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pNoColorBlendState, m_pDepthCopyState, m_pRasterizerState
+    };
+    state.SetPipeline(depthPipeline);
+    ID3D11Buffer* cbuffers[] = { m_lowResTransCB.Get() };
+    state.PSSetConstantBuffers(0, 1, cbuffers);
+    ID3D11ShaderResourceView* resources[] = { m_pDepthBufferSRV };
+    state.PSSetShaderResources(0, 1, resources);
+
+    state.Draw(3, 0);
+
+    ID3D11ShaderResourceView* nullResources[1] = {};
+    state.PSSetShaderResources(0, 1, nullResources);
+    // Transparent passes expect scene constants bound by BindFrameState
+    cbuffers[0] = m_sceneCB.Get();
+    state.PSSetConstantBuffers(0, 1, cbuffers);
+
+    ID3D11RenderTargetView* views[] = { m_pLowResTransColorRTV };
+    state.OMSetRenderTargets(1, views, m_pLowResTransDepthDSV);
+}
 
-        result = m_pDevice->CreateSamplerState(&desc, &m_pSampler);
-    }
+void Renderer::EndLowResTrans(StateCache& state)
+{
+    // Scene depth is read by the upsample, so it is not bound
+    ID3D11RenderTargetView* views[] = { GetSceneRTV() };
+    state.OMSetRenderTargets(1, views, nullptr);
+    SetViewport(state, GetRenderWidth(), GetRenderHeight());
+
+    Pipeline compositePipeline = {
+        m_pFullscreenVertexShader, m_pLowResCompositePixelShader, nullptr, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pLowResCompositeBlendState, m_pTransDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(compositePipeline);
+    ID3D11Buffer* cbuffers[] = { m_lowResTransCB.Get() };
+    state.PSSetConstantBuffers(0, 1, cbuffers);
+    ID3D11ShaderResourceView* resources[] = { m_pDepthBufferSRV, m_pLowResTransColorSRV, m_pLowResTransDepthSRV };
+    state.PSSetShaderResources(0, 3, resources);
+
+    state.Draw(3, 0);
+
+    // Targets are written again in the next frame
+    ID3D11ShaderResourceView* nullResources[3] = {};
+    state.PSSetShaderResources(0, 3, nullResources);
+    cbuffers[0] = m_sceneCB.Get();
+    state.PSSetConstantBuffers(0, 1, cbuffers);
+}
 
-    if (SUCCEEDED(result))
+void Renderer::UpdatePredicates()
+{
+    // Bulbs of all lights, only visible ones are drawn so the box may be larger than needed
+    AABB bulbsBounds;
+    for (int i = 0; i < m_settingsBuffer.lightCount.x; i++)
     {
-        result = InitSphere();
+        const Point4f& pos = m_lights[i].pos;
+        AABB bulb;
+        bulb.vmin = Point3f{ pos.x - LightBulbRadius, pos.y - LightBulbRadius, pos.z - LightBulbRadius };
+        bulb.vmax = Point3f{ pos.x + LightBulbRadius, pos.y + LightBulbRadius, pos.z + LightBulbRadius };
+        bulbsBounds.Add(bulb);
     }
-    if (SUCCEEDED(result))
+
+    const AABB* bounds[PredicateGroupCount] = { &m_rectsBounds, &bulbsBounds };
+    PredicateBuffer predicateBuffer = {};
+    const Point3f& cameraPos = m_cameraSnapshot.pos;
+    for (UINT i = 0; i < PredicateGroupCount; i++)
     {
-        result = InitCubemap();
+        const AABB& bb = *bounds[i];
+        predicateBuffer.boxMin[i] = Point4f{ bb.vmin.x, bb.vmin.y, bb.vmin.z, 0.0f };
+        predicateBuffer.boxMax[i] = Point4f{ bb.vmax.x, bb.vmax.y, bb.vmax.z, 0.0f };
+
+        // Box clipped by near plane may have no samples while the group is in view, so it is drawn unconditionally
+        bool inside = cameraPos.x > bb.vmin.x - PredicateNearMargin && cameraPos.x < bb.vmax.x + PredicateNearMargin
+            && cameraPos.y > bb.vmin.y - PredicateNearMargin && cameraPos.y < bb.vmax.y + PredicateNearMargin
+            && cameraPos.z > bb.vmin.z - PredicateNearMargin && cameraPos.z < bb.vmax.z + PredicateNearMargin;
+        m_predicateTested[i] = bb.vmin.x <= bb.vmax.x && !inside;
     }
-    if (SUCCEEDED(result))
+    m_predicateCB.Update(m_pDeviceContext, predicateBuffer);
+}
+
+void Renderer::BeginPredicatedDraw(StateCache& state, PredicateGroup group)
+{
+    if (!m_occlusionPredicates || !m_predicateTested[group])
     {
-        result = InitRect();
+        return;
     }
-    if (SUCCEEDED(result))
+
+    // Box is tested against opaque depth of this frame, without writing color or depth
+    Pipeline pipeline = {
+        m_pProxyBoxVertexShader, nullptr, nullptr, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pNoColorBlendState, m_pTransDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(pipeline);
+    ID3D11Buffer* cbuffers[] = { m_sceneCB.Get(), m_predicateCB.Get() };
+    state.VSSetConstantBuffers(0, 2, cbuffers);
+
+    ID3D11DeviceContext* pContext = state.GetContext();
+    pContext->Begin(m_pPredicates[group]);
+    state.Draw(36, group * 36);
+    pContext->End(m_pPredicates[group]);
+
+    // Draws until EndPredicatedDraw are skipped if the predicate is false, no sample of the box passed
+    pContext->SetPredication(m_pPredicates[group], FALSE);
+}
+
+void Renderer::EndPredicatedDraw(StateCache& state, PredicateGroup group)
+{
+    if (m_occlusionPredicates && m_predicateTested[group])
     {
-        result = InitSmallSphere();
+        state.GetContext()->SetPredication(nullptr, FALSE);
     }
-    if (SUCCEEDED(result))
+}
+
+void Renderer::UpdateParticleParams(double deltaSec)
+{
+    if (m_pParticles == nullptr && FAILED(CreateParticleBuffers()))
     {
-        result = InitPostProcess();
+        m_particles = false;
+        return;
     }
-    if (SUCCEEDED(result))
+
+    // Emission rate keeps alive count at the set one, fraction of particle is carried to the next frame
+    m_particleEmitAccum += m_particleCount / m_particleLifetime * deltaSec;
+    m_particleEmitCount = (UINT)std::min(m_particleEmitAccum, (double)MaxParticles);
+    m_particleEmitAccum = std::min(m_particleEmitAccum - m_particleEmitCount, 1.0);
+
+    // Visible count is only known on GPU, so sorting network is sized for all alive particles
+    m_particleKeyCount = SortLocalSize;
+    while (m_particleKeyCount < (UINT)m_particleCount)
     {
-        result = InitCull();
+        m_particleKeyCount *= 2;
     }
 
-    assert(SUCCEEDED(result));
+    const Point3f& up = m_cameraSnapshot.up;
+    Point3f right = up.cross(m_cameraSnapshot.dir);
+    right.normalize();
 
-    return result;
+    ParticleParams particleParams;
+    particleParams.emitter = Point4f{ m_particleEmitter.x, m_particleEmitter.y, m_particleEmitter.z, ParticleEmitterRadius };
+    particleParams.emitParams = Point4f{ m_particleLifetime, ParticleSpeed, ParticleSpread, (float)deltaSec };
+    particleParams.simParams = Point4f{ ParticleGravity, ParticleDrag, ParticleSize, 0.0f };
+    particleParams.cameraRight = Point4f{ right.x, right.y, right.z, 0.0f };
+    particleParams.cameraUp = Point4f{ up.x, up.y, up.z, 0.0f };
+    particleParams.particleCounts = Point4i{ (int)m_particleEmitCount, (int)m_particleSeed++, (int)m_particleKeyCount, 0 };
+    m_particleCB.Update(m_pDeviceContext, particleParams);
 }
 
-HRESULT Renderer::InitSphere()
+void Renderer::UpdateParticles()
 {
-    static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
-    };
+    UINT alive = m_particleAliveIdx;
+    static const UINT KeepCount = (UINT)-1;
 
-    HRESULT result = S_OK;
+    if (m_particlesReset)
+    {
+        // Every slot is appended to emptied dead list, alive list gets its counter reset at the emission bind
+        ID3D11UnorderedAccessView* uavBuffers[2] = {m_pParticlesUAV, m_pParticleDeadUAV};
+        UINT initialCounts[2] = {KeepCount, 0};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, uavBuffers, initialCounts);
 
-    static const size_t SphereSteps = 32;
+        m_pDeviceContext->CSSetShader(m_pParticleResetShader, nullptr, 0);
+        m_pDeviceContext->Dispatch(MaxParticles / 64, 1, 1);
+    }
 
-    std::vector<Point3f> sphereVertices;
-    std::vector<UINT16> indices;
+    // Emitted count is clamped on GPU by the dead count, so the pool never overflows
+    m_pDeviceContext->CopyStructureCount(m_pParticleListCounts, 0, m_pParticleDeadUAV);
 
-    size_t indexCount;
-    size_t vertexCount;
+    ID3D11Buffer* constBuffers[3] = {m_sceneCB.Get(), m_particleCB.Get(), m_pParticleListCounts};
+    m_pDeviceContext->CSSetConstantBuffers(0, 3, constBuffers);
 
-    GetSphereDataSize(SphereSteps, SphereSteps, indexCount, vertexCount);
+    {
+        ID3D11UnorderedAccessView* uavBuffers[3] = {m_pParticlesUAV, m_pParticleDeadUAV, m_pParticleAliveUAV[alive]};
+        UINT initialCounts[3] = {KeepCount, KeepCount, m_particlesReset ? 0 : KeepCount};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, uavBuffers, initialCounts);
 
-    sphereVertices.resize(vertexCount);
-    indices.resize(indexCount);
+        m_pDeviceContext->CSSetShader(m_pParticleEmitShader, nullptr, 0);
+        m_pDeviceContext->Dispatch(DivUp(m_particleEmitCount, 64u), 1, 1);
+        m_particlesReset = false;
+    }
 
-    m_sphereIndexCount = (UINT)indexCount;
+    // Alive count goes to simulation constants and to its dispatch arguments
+    m_pDeviceContext->CopyStructureCount(m_pParticleListCounts, sizeof(UINT), m_pParticleAliveUAV[alive]);
+    m_pDeviceContext->CopyStructureCount(m_pParticleCounts, 0, m_pParticleAliveUAV[alive]);
+    BuildDispatchArgs(m_pParticleCountsUAV, false, 1, 1, 0, m_pParticleSimArgsUAV);
 
-    CreateSphere(SphereSteps, SphereSteps, indices.data(), sphereVertices.data());
+    static const UINT ZeroCount[4] = {};
+    m_pDeviceContext->ClearUnorderedAccessViewUint(m_pParticleDrawCountUAV, ZeroCount);
+    if (m_sortParticles)
+    {
+        // Keys past visible ones are padding, which sort moves to the end
+        static const UINT PaddingKey[4] = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+        m_pDeviceContext->ClearUnorderedAccessViewUint(m_pParticleKeysUAV, PaddingKey);
+    }
 
-    // Create vertex buffer
-    if (SUCCEEDED(result))
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = (UINT)(sphereVertices.size() * sizeof(Point3f));
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        m_pDeviceContext->CSSetConstantBuffers(0, 3, constBuffers);
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = sphereVertices.data();
-        data.SysMemPitch = (UINT)(sphereVertices.size() * sizeof(Point3f));
-        data.SysMemSlicePitch = 0;
+        ID3D11UnorderedAccessView* uavBuffers[5] = {m_pParticlesUAV, m_pParticleDeadUAV, m_pParticleAliveUAV[1 - alive], m_pParticleKeysUAV, m_pParticleDrawArgsUAV};
+        UINT initialCounts[5] = {KeepCount, KeepCount, 0, KeepCount, KeepCount};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 5, uavBuffers, initialCounts);
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pSphereVertexBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pSphereVertexBuffer, "SphereVertexBuffer");
-        }
+        ID3D11ShaderResourceView* srvs[1] = {m_pParticleAliveSRV[alive]};
+        m_pDeviceContext->CSSetShaderResources(0, 1, srvs);
+
+        m_pDeviceContext->CSSetShader(m_pParticleSimulateShader, nullptr, 0);
+        m_pDeviceContext->DispatchIndirect(m_pParticleSimArgs, 0);
+
+        // Unbind, as pool and keys are read by vertex shader
+        ID3D11UnorderedAccessView* nullUAVs[5] = {};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 5, nullUAVs, nullptr);
+        ID3D11ShaderResourceView* nullSRVs[1] = {};
+        m_pDeviceContext->CSSetShaderResources(0, 1, nullSRVs);
     }
+    m_particleAliveIdx = 1 - alive;
 
-    // Create index buffer
-    if (SUCCEEDED(result))
+    if (m_sortParticles)
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = (UINT)(indices.size() * sizeof(UINT16));
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        ID3D11Buffer* sortBuffers[2] = {m_sceneCB.Get(), m_pSortParams};
+        m_pDeviceContext->CSSetConstantBuffers(0, 2, sortBuffers);
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = indices.data();
-        data.SysMemPitch = (UINT)(indices.size() * sizeof(UINT16));
-        data.SysMemSlicePitch = 0;
+        // Only keys are touched by local and global sort passes
+        ID3D11UnorderedAccessView* uavBuffers[3] = {nullptr, nullptr, m_pParticleKeysUAV};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, uavBuffers, nullptr);
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pSphereIndexBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pSphereIndexBuffer, "SphereIndexBuffer");
-        }
+        SortKeys(m_particleKeyCount, 0);
+
+        ID3D11UnorderedAccessView* nullUAVs[3] = {};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, nullUAVs, nullptr);
     }
+}
 
-    ID3DBlob* pSphereVertexShaderCode = nullptr;
-    if (SUCCEEDED(result))
+void Renderer::RenderParticles(StateCache& state)
+{
+    // OIT composite leaves depth unbound
+    ID3D11RenderTargetView* views[] = { GetTransRTV() };
+    state.OMSetRenderTargets(1, views, GetTransDSV());
+
+    // Visible particles were compacted and sorted by UpdateParticles, quad is built from vertex id
+    Pipeline pipeline = {
+        m_pParticleVertexShader, m_pParticlePixelShader, nullptr, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        GetTransBlendState(), m_pTransDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(pipeline);
+
+    ID3D11Buffer* cbuffers[] = { m_sceneCB.Get(), m_particleCB.Get() };
+    state.VSSetConstantBuffers(0, 2, cbuffers);
+    ID3D11ShaderResourceView* resources[] = { m_pParticlesSRV, m_pParticleKeysSRV };
+    state.VSSetShaderResources(0, 2, resources);
+
+    state.DrawInstancedIndirect(m_pParticleDrawArgs, 0);
+
+    // Pool and keys are written by simulation in the next frame
+    ID3D11ShaderResourceView* nullResources[2] = {};
+    state.VSSetShaderResources(0, 2, nullResources);
+}
+
+void Renderer::RenderMeshletModel(StateCache& state)
+{
+    BindFrameState(state);
+    BindCubeState(state, m_pMeshletIdsSRV);
+
+    // Instance data of the model replaces the instance buffer, so cube shaders draw it as the only instance
+    ID3D11ShaderResourceView* geomResources[] = { m_pMeshletGeomSRV };
+    state.VSSetShaderResources(2, 1, geomResources);
+    state.PSSetShaderResources(2, 1, geomResources);
+
+    if (m_meshletCull)
     {
-        result = CompileAndCreateShader(L"SphereTexture.vs", (ID3D11DeviceChild**)&m_pSphereVertexShader, {}, &pSphereVertexShaderCode);
+        state.IASetIndexBuffer(m_pMeshletIndices, DXGI_FORMAT_R32_UINT, 0);
+        state.DrawIndexedInstancedIndirect(m_pMeshletArgs, 0);
     }
-    if (SUCCEEDED(result))
+    else
     {
-        result = CompileAndCreateShader(L"SphereTexture.ps", (ID3D11DeviceChild**)&m_pSpherePixelShader);
+        UINT mesh = m_instanceMeshes[InstanceMeshImported * MaxLods];
+        m_geometryPool.BindIndexBuffer(state, mesh);
+        m_geometryPool.DrawInstanced(state, mesh, 1);
     }
+}
 
-    if (SUCCEEDED(result))
+ID3D11PixelShader* Renderer::GetImpostorPixelShader() const
+{
+    return m_deferredShading ? m_pImpostorGBufferPixelShaders[GetShaderVariant(ImpostorGBufferVariants)] : m_pImpostorPixelShaders[GetShaderVariant(ImpostorVariants)];
+}
+
+void Renderer::DrawImpostors(StateCache& state, ID3D11ShaderResourceView* pIdsSRV, ID3D11Buffer* pArgs, ID3D11PixelShader* pPixelShader)
+{
+    if (!m_impostors)
     {
-        result = m_pDevice->CreateInputLayout(InputDesc, 1, pSphereVertexShaderCode->GetBufferPointer(), pSphereVertexShaderCode->GetBufferSize(), &m_pSphereInputLayout);
-        if (SUCCEEDED(result))
+        return;
+    }
+
+    state.VSSetShader(m_pImpostorVertexShader, nullptr, 0);
+    state.PSSetShader(pPixelShader, nullptr, 0);
+    state.IASetInputLayout(m_pImpostorInputLayout);
+    ID3D11ShaderResourceView* ids[] = { pIdsSRV };
+    state.VSSetShaderResources(3, 1, ids);
+    state.PSSetShaderResources(3, 1, ids);
+    ID3D11ShaderResourceView* resources[] = { m_pImpostorNormalsSRV, m_pImpostorUVsSRV };
+    state.PSSetShaderResources(ImpostorSlot, 2, resources);
+
+    for (UINT mesh = 0; mesh < InstanceMeshCount; mesh++)
+    {
+        UINT draw = mesh * MaxLods + ImpostorLod;
+        if (pArgs != nullptr)
         {
-            result = SetResourceName(m_pSphereInputLayout, "SphereInputLayout");
+            state.DrawInstancedIndirect(pArgs, draw * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS));
+        }
+        else if (m_visibleCounts[draw] > 0)
+        {
+            state.DrawInstanced(6, m_visibleCounts[draw], 0, draw * MaxInst);
         }
     }
+}
 
-    SAFE_RELEASE(pSphereVertexShaderCode);
-
-    // Create geometry buffer
-    if (SUCCEEDED(result))
+void Renderer::DrawLateCubes(StateCache& state)
+{
+    for (UINT i = 0; i < InstanceDrawCount; i++)
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(SphereGeomBuffer);
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        if (i % MaxLods < m_lodCounts[i / MaxLods])
+        {
+            m_geometryPool.BindIndexBuffer(state, m_instanceMeshes[i]);
+            state.DrawIndexedInstancedIndirect(m_pLateArgs, i * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS));
+        }
+    }
+}
 
-        SphereGeomBuffer geomBuffer;
-        geomBuffer.m = DirectX::XMMatrixIdentity();
-        geomBuffer.size.x = 2.0f;
-        //geomBuffer.m = DirectX::XMMatrixTranslation(2.0f, 0.0f, 0.0f);
+void Renderer::PickInstance()
+{
+    static const UINT NoPickValue[4] = { NoPick, NoPick, NoPick, NoPick };
+    m_pDeviceContext->ClearUnorderedAccessViewUint(m_pPickResultUAV, NoPickValue);
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = &geomBuffer;
-        data.SysMemPitch = sizeof(geomBuffer);
-        data.SysMemSlicePitch = 0;
+    // Cursor is in window pixels, scene may be rendered at lower resolution
+    if (m_mouseX >= 0 && m_mouseY >= 0 && m_mouseX < (int)m_width && m_mouseY < (int)m_height)
+    {
+        LONG x = (LONG)((UINT64)m_mouseX * GetRenderWidth() / m_width);
+        LONG y = (LONG)((UINT64)m_mouseY * GetRenderHeight() / m_height);
+
+        bool computeCull = m_doCull && m_computeCull;
+        BindFrameState(m_immediateState);
+        BindCubeState(m_immediateState, computeCull ? m_pGeomBufferInstVisGPU_SRV : m_pGeomBufferInstVisSRV,
+            computeCull && m_instanceTransforms ? TransformSetVisible : TransformSetNone);
+        m_immediateState.PSSetShader(m_pPickPixelShader, nullptr, 0);
+        m_immediateState.OMSetDepthStencilState(m_pDepthEqualState, 0);
+        m_immediateState.RSSetState(m_pPickRasterizerState);
+        D3D11_RECT rect = { x, y, x + 1, y + 1 };
+        m_immediateState.RSSetScissorRects(1, &rect);
+
+        // Depth is the one cubes were drawn with, G-buffer pass uses single sampled one
+        ID3D11UnorderedAccessView* uavs[1] = { m_pPickResultUAV };
+        m_pDeviceContext->OMSetRenderTargetsAndUnorderedAccessViews(0, nullptr, m_deferredShading ? m_pDepthBufferDSV : GetSceneDSV(), 0, 1, uavs, nullptr);
+
+        DrawCubes(m_immediateState);
+        if (computeCull && m_occlusionCull)
+        {
+            ID3D11ShaderResourceView* lateIds[] = { m_pLateIdsSRV };
+            m_immediateState.VSSetShaderResources(3, 1, lateIds);
+            m_immediateState.PSSetShaderResources(3, 1, lateIds);
+            if (m_instanceTransforms)
+            {
+                ID3D11ShaderResourceView* lateTransforms[] = { m_pInstanceTransformsSRV[TransformSetLate], m_pDrawBasesSRV[TransformSetLate] };
+                m_immediateState.VSSetShaderResources(4, 2, lateTransforms);
+            }
+            DrawLateCubes(m_immediateState);
+        }
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pSphereGeomBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
+        // Impostors switch vertex shader, so they go after all cubes
+        DrawImpostors(m_immediateState, computeCull ? m_pGeomBufferInstVisGPU_SRV : m_pGeomBufferInstVisSRV, computeCull ? m_pIndirectArgs : nullptr, m_pPickPixelShader);
+        if (computeCull && m_occlusionCull)
         {
-            result = SetResourceName(m_pSphereGeomBuffer, "SphereGeomBuffer");
+            DrawImpostors(m_immediateState, m_pLateIdsSRV, m_pLateArgs, m_pPickPixelShader);
         }
+
+        m_pDeviceContext->OMSetRenderTargetsAndUnorderedAccessViews(0, nullptr, nullptr, 0, 0, nullptr, nullptr);
     }
 
-    return result;
+    m_pickReadback.Copy(m_pDeviceContext, m_pPickResult, 0, sizeof(UINT), 0);
+    m_pickReadback.EndFrame(m_pDeviceContext);
 }
 
-HRESULT Renderer::InitSmallSphere()
+bool Renderer::IsOverdrawCounted(UINT pass) const
 {
-    static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
-    };
+    return m_debugView == DebugViewOverdraw && m_pOverdrawUAV != nullptr && (m_overdrawPass == (int)PassCount || m_overdrawPass == (int)pass);
+}
 
-    HRESULT result = S_OK;
+void Renderer::SetOverdrawCounting(StateCache& state, bool counted, bool feedback)
+{
+    // Overdraw shader replaces material ones, so virtual texture feedback is only written without it
+    if (!counted && feedback && IsVirtualTexturingActive())
+    {
+        state.SetPixelShaderOverride(nullptr, m_virtualTextures.GetFeedbackUAV(), FeedbackUAVSlot);
+        return;
+    }
+    state.SetPixelShaderOverride(counted ? m_pOverdrawPixelShader : nullptr, counted ? m_pOverdrawUAV : nullptr, OverdrawUAVSlot);
+}
 
-    static const size_t SphereSteps = 8;
+void Renderer::RenderDebugView(StateCache& state)
+{
+    BindFrameState(state);
 
-    std::vector<Point3f> sphereVertices;
-    std::vector<UINT16> indices;
+    // Depth is read by light count view
+    ID3D11RenderTargetView* views[] = { GetSceneRTV() };
+    state.OMSetRenderTargets(1, views, nullptr);
 
-    size_t indexCount;
-    size_t vertexCount;
+    bool overdraw = m_debugView == DebugViewOverdraw;
+    ID3D11PixelShader* pPixelShader = overdraw ? m_pOverdrawHeatmapPixelShader : (IsMsaaActive() ? m_pLightHeatmapMsaaPixelShader : m_pLightHeatmapPixelShader);
+    Pipeline pipeline = {
+        m_pFullscreenVertexShader, pPixelShader, nullptr, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        overdraw ? m_pOpaqueBlendState : m_pTransBlendState, m_pTransDepthState, m_pRasterizerState
+    };
+    state.SetPipeline(pipeline);
 
-    GetSphereDataSize(SphereSteps, SphereSteps, indexCount, vertexCount);
+    ID3D11ShaderResourceView* resources[2] = { m_pOverdrawSRV, nullptr };
+    if (!overdraw)
+    {
+        resources[0] = IsMsaaActive() ? m_pMsaaDepthBufferSRV : m_pDepthBufferSRV;
+        resources[1] = m_pClusterLightsSRV;
+    }
+    state.PSSetShaderResources(0, 2, resources);
 
-    sphereVertices.resize(vertexCount);
-    indices.resize(indexCount);
+    state.Draw(3, 0);
 
-    m_smallSphereIndexCount = (UINT)indexCount;
+    ID3D11ShaderResourceView* nullResources[2] = {};
+    state.PSSetShaderResources(0, 2, nullResources);
+}
 
-    CreateSphere(SphereSteps, SphereSteps, indices.data(), sphereVertices.data());
+void Renderer::ReplayCommands()
+{
+    CPU_PROFILE_ZONE("ReplayCommands");
 
-    for (auto& v : sphereVertices)
+    // Two replays in flight at most, so wall time is not hidden by a deep queue
+    ID3D11Query* pEvents[2] = {};
+    CD3D11_QUERY_DESC desc(D3D11_QUERY_EVENT);
+    HRESULT result = m_pDevice->CreateQuery(&desc, &pEvents[0]);
+    if (SUCCEEDED(result))
     {
-        v = v * 0.125f;
+        result = m_pDevice->CreateQuery(&desc, &pEvents[1]);
     }
 
-    // Create vertex buffer
     if (SUCCEEDED(result))
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = (UINT)(sphereVertices.size() * sizeof(Point3f));
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        std::chrono::steady_clock::duration cpuTime = std::chrono::steady_clock::duration::zero();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        UINT replayed = 0;
+        for (; replayed < m_replayCount; replayed++)
+        {
+            std::chrono::steady_clock::time_point submitStart = std::chrono::steady_clock::now();
+            bool replayValid = m_commandRecorder.Replay(m_pDeviceContext);
+            cpuTime += std::chrono::steady_clock::now() - submitStart;
+            if (!replayValid)
+            {
+                break;
+            }
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = sphereVertices.data();
-        data.SysMemPitch = (UINT)(sphereVertices.size() * sizeof(Point3f));
-        data.SysMemSlicePitch = 0;
+            m_pDeviceContext->End(pEvents[replayed % 2]);
+            if (replayed > 0)
+            {
+                while (m_pDeviceContext->GetData(pEvents[(replayed + 1) % 2], nullptr, 0, 0) == S_FALSE)
+                {
+                    YieldProcessor();
+                }
+            }
+        }
+        if (replayed > 0)
+        {
+            while (m_pDeviceContext->GetData(pEvents[(replayed + 1) % 2], nullptr, 0, 0) == S_FALSE)
+            {
+                YieldProcessor();
+            }
+        }
+        std::chrono::steady_clock::duration wallTime = std::chrono::steady_clock::now() - start;
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pSmallSphereVertexBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
+        if (replayed > 0)
         {
-            result = SetResourceName(m_pSmallSphereVertexBuffer, "SmallSphereVertexBuffer");
+            m_replayCpuMs = std::chrono::duration<float, std::milli>(cpuTime).count() / replayed;
+            m_replayWallMs = std::chrono::duration<float, std::milli>(wallTime).count() / replayed;
         }
     }
+    SAFE_RELEASE(pEvents[0]);
+    SAFE_RELEASE(pEvents[1]);
 
-    // Create index buffer
-    if (SUCCEEDED(result))
-    {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = (UINT)(indices.size() * sizeof(UINT16));
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+    // Replay leaves state of the captured frame
+    m_pDeviceContext->ClearState();
+    m_immediateState.Invalidate();
+}
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = indices.data();
-        data.SysMemPitch = (UINT)(indices.size() * sizeof(UINT16));
-        data.SysMemSlicePitch = 0;
+UINT Renderer::GetAbToggles() const
+{
+    return (m_doCull ? AbCompare::ToggleCull : 0)
+        | (m_computeCull ? AbCompare::ToggleGpuCull : 0)
+        | (m_useNormalMaps ? AbCompare::ToggleNormalMaps : 0)
+        | (m_postSettings.sepia ? AbCompare::ToggleSepia : 0);
+}
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pSmallSphereIndexBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pSmallSphereIndexBuffer, "SmallSphereIndexBuffer");
-        }
-    }
+void Renderer::SetAbToggles(UINT toggles)
+{
+    m_doCull = (toggles & AbCompare::ToggleCull) != 0;
+    m_computeCull = (toggles & AbCompare::ToggleGpuCull) != 0;
+    m_useNormalMaps = (toggles & AbCompare::ToggleNormalMaps) != 0;
+    m_postSettings.sepia = (toggles & AbCompare::ToggleSepia) != 0;
+}
 
-    ID3DBlob* pSmallSphereVertexShaderCode = nullptr;
-    if (SUCCEEDED(result))
-    {
-        result = CompileAndCreateShader(L"TransColor.vs", (ID3D11DeviceChild**)&m_pSmallSphereVertexShader, {}, &pSmallSphereVertexShaderCode);
-    }
-    if (SUCCEEDED(result))
-    {
-        result = CompileAndCreateShader(L"TransColor.ps", (ID3D11DeviceChild**)&m_pSmallSpherePixelShader);
-    }
+void Renderer::StartAbCompare()
+{
+    m_abSavedToggles = GetAbToggles();
+    m_abSavedCamera = m_camera;
+    m_abSavedDeltaSec = m_fixedDeltaSec;
+    // Animation advances the same for both configurations, whatever their frame time is
+    SetFixedDeltaSec(1.0 / 60.0);
 
-    if (SUCCEEDED(result))
-    {
-        result = m_pDevice->CreateInputLayout(InputDesc, 1, pSmallSphereVertexShaderCode->GetBufferPointer(), pSmallSphereVertexShaderCode->GetBufferSize(), &m_pSmallSphereInputLayout);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pSmallSphereInputLayout, "SmallSphereInputLayout");
-        }
-    }
+    m_abCompare.Start(m_abSettings);
+}
 
-    SAFE_RELEASE(pSmallSphereVertexShaderCode);
+void Renderer::UpdateAbCompare()
+{
+    SetAbToggles(m_abCompare.GetToggles());
 
-    // Create geometry buffer
-    if (SUCCEEDED(result))
-    {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(RectGeomBuffer);
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+    // Orbit like the benchmark one, matched frames of A and B see the same view
+    float t = m_abCompare.GetPathPos();
+    SetCamera(Point3f{ 0, 0, 0 }, 8.0f + 4.0f * sinf(t * 4.0f * (float)M_PI), -(float)M_PI / 4 + t * 2.0f * (float)M_PI, (float)M_PI / 8);
+}
 
-        RectGeomBuffer geomBuffer;
-        geomBuffer.m = DirectX::XMMatrixIdentity();
-        geomBuffer.color = Point4f{1,1,1,1};
+void Renderer::EndAbCompare()
+{
+    m_abCompare.Stop();
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = &geomBuffer;
-        data.SysMemPitch = sizeof(geomBuffer);
-        data.SysMemSlicePitch = 0;
+    SetAbToggles(m_abSavedToggles);
+    m_camera = m_abSavedCamera;
+    SetFixedDeltaSec(m_abSavedDeltaSec);
+}
 
-        for (int i = 0; i < 10 && SUCCEEDED(result); i++)
+void Renderer::UpdateVirtualTextures()
+{
+    // Tiled arrays and their pool take memory only while the mode is on
+    if (m_virtualTexturing && m_virtualTexturesSupported && !m_virtualTextures.IsInitialized())
+    {
+        if (FAILED(m_virtualTextures.Init(m_pDevice, m_pDeviceContext, m_materials)))
         {
-            result = m_pDevice->CreateBuffer(&desc, &data, &m_pSmallSphereGeomBuffers[i]);
-            if (SUCCEEDED(result))
-            {
-                result = SetResourceName(m_pSmallSphereGeomBuffers[i], "SmallSphereGeomBuffer");
-            }
+            m_virtualTexturing = false;
         }
     }
+    else if (!m_virtualTexturing && m_virtualTextures.IsInitialized())
+    {
+        m_virtualTextures.Term();
+    }
 
-    assert(SUCCEEDED(result));
-
-    return result;
+    if (m_virtualTextures.IsInitialized())
+    {
+        CPU_PROFILE_ZONE("VirtualTextures");
+        m_virtualTextures.Update();
+    }
 }
 
-HRESULT Renderer::InitRect()
+void Renderer::UpdateFeatureResources()
 {
-    static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0}
-    };
-
-    static const ColorVertex Vertices[] =
+    // Features set up on first frame they are used, so startup time and memory follow enabled ones only
+    bool clusterCull = m_doCull && m_computeCull && m_hierarchicalCull;
+    if (clusterCull && m_pClusterCullShader == nullptr && FAILED(CreateClusterCull()))
     {
-        {0.0, -0.75, -0.75, RGB(128,0,128)},
-        {0.0,  0.75, -0.75, RGB(128,0,128)},
-        {0.0,  0.75,  0.75, RGB(128,0,128)},
-        {0.0, -0.75,  0.75, RGB(128,0,128)}
-    };
-    static const UINT16 Indices[] = {
-        0, 1, 2,
-        0, 2, 3
-    };
-
-    for (int j = 0; j < 2; j++)
+        m_computeCull = false;
+        clusterCull = false;
+    }
+    if (m_impostors && m_pImpostorVertexShader == nullptr && FAILED(CreateImpostors()))
     {
-        for (int i = 0; i < 4; i++)
-        {
-            m_boundingRects[j].vmin.x = std::min(m_boundingRects[j].vmin.x, Vertices[i].x);
-            m_boundingRects[j].vmin.y = std::min(m_boundingRects[j].vmin.y, Vertices[i].y);
-            m_boundingRects[j].vmin.z = std::min(m_boundingRects[j].vmin.z, Vertices[i].z);
-            m_boundingRects[j].vmax.x = std::max(m_boundingRects[j].vmax.x, Vertices[i].x);
-            m_boundingRects[j].vmax.y = std::max(m_boundingRects[j].vmax.y, Vertices[i].y);
-            m_boundingRects[j].vmax.z = std::max(m_boundingRects[j].vmax.z, Vertices[i].z);
-        }
+        m_impostors = false;
+        m_updateCullParams = true;
     }
-    m_boundingRects[0].vmin = m_boundingRects[0].vmin + Rect0Pos;
-    m_boundingRects[1].vmin = m_boundingRects[1].vmin + Rect0Pos;
-    m_boundingRects[1].vmin = m_boundingRects[1].vmin + Rect1Pos;
-    m_boundingRects[1].vmax = m_boundingRects[1].vmax + Rect1Pos;
-
-    HRESULT result = S_OK;
 
-    // Create vertex buffer
-    if (SUCCEEDED(result))
+    // Turned off features keep resources for a while, so toggling back and forth does not recreate them
+    if (IsFeatureReleaseDue(LazyFeatureClusterCull, clusterCull, m_pClusterCullShader != nullptr))
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = (UINT)sizeof(Vertices);
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        TermClusterCull();
+    }
+    if (IsFeatureReleaseDue(LazyFeatureImpostors, m_impostors, m_pImpostorVertexShader != nullptr))
+    {
+        TermImpostors();
+    }
+    if (IsFeatureReleaseDue(LazyFeatureParticles, m_particles, m_pParticles != nullptr))
+    {
+        TermParticleBuffers();
+    }
+    if (IsFeatureReleaseDue(LazyFeatureOit, m_weightedOit, m_pOitAccum != nullptr))
+    {
+        TermOitTargets();
+    }
+    if (IsFeatureReleaseDue(LazyFeatureTemporal, IsTemporalUpscaleActive(), m_motionWidth != 0))
+    {
+        TermTemporalTargets();
+    }
+    if (IsFeatureReleaseDue(LazyFeatureLowResTrans, IsLowResTransActive(), m_pLowResTransColor != nullptr))
+    {
+        TermLowResTransTargets();
+    }
+}
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = Vertices;
-        data.SysMemPitch = (UINT)sizeof(Vertices);
-        data.SysMemSlicePitch = 0;
+bool Renderer::IsFeatureReleaseDue(LazyFeature feature, bool used, bool created)
+{
+    UINT& idleFrames = m_featureIdleFrames[feature];
+    idleFrames = (used || !created) ? 0 : idleFrames + 1;
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pRectVertexBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pRectVertexBuffer, "RectVertexBuffer");
-        }
+    return m_featureReleaseFrames > 0 && idleFrames >= m_featureReleaseFrames;
+}
+
+void Renderer::PublishTelemetry()
+{
+    if (!m_telemetry.IsActive())
+    {
+        return;
     }
 
-    // Create index buffer
-    if (SUCCEEDED(result))
+    TelemetryExport::Frame frame = {};
+    frame.gpuFrameMs = m_gpuProfiler.GetLastFrameMs();
+    frame.visibleInstances = GetVisibleInstances();
+    frame.instanceCount = m_instCount;
+    MemoryRegistry::Get().QueryBudget(frame.vramBudget, frame.vramUsage);
+    frame.stalls = StallDetector::Get().GetTotalStalls();
+    frame.passCount = std::min(m_gpuProfiler.GetScopeCount(), TelemetryExport::MaxPasses);
+    for (UINT i = 0; i < frame.passCount; i++)
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = (UINT)sizeof(Indices);
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        frame.passNames[i] = m_gpuProfiler.GetScopeName(i);
+        frame.passMs[i] = m_gpuProfiler.GetScopeLastMs(i);
+    }
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = Indices;
-        data.SysMemPitch = (UINT)sizeof(Indices);
-        data.SysMemSlicePitch = 0;
+    m_telemetry.Publish(frame);
+}
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pRectIndexBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
+void Renderer::ReadGpuStats()
+{
+    D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args[2 * InstanceDrawCount];
+    if (m_statsReadback.Read(m_pDeviceContext, args, sizeof(args)))
+    {
+        // Late counts are stale when occlusion is off, as they are not copied then
+        UINT argsCount = m_occlusionCull ? 2 * InstanceDrawCount : InstanceDrawCount;
+
+        m_gpuVisibleInstances = 0;
+        for (UINT i = 0; i < argsCount; i++)
         {
-            result = SetResourceName(m_pRectIndexBuffer, "RectIndexBuffer");
+            m_gpuVisibleInstances += (int)args[i].InstanceCount;
         }
     }
 
-    ID3DBlob* pRectVertexShaderCode = nullptr;
-    if (SUCCEEDED(result))
+    UINT meshletIndices = 0;
+    if (m_meshletReadback.Read(m_pDeviceContext, &meshletIndices, sizeof(meshletIndices)))
     {
-        result = CompileAndCreateShader(L"TransColor.vs", (ID3D11DeviceChild**)&m_pRectVertexShader, {}, &pRectVertexShaderCode);
+        m_meshletTriangles = meshletIndices / 3;
     }
-    if (SUCCEEDED(result))
+
+    UINT pickedIdx = NoPick;
+    if (m_pickReadback.Read(m_pDeviceContext, &pickedIdx, sizeof(pickedIdx)))
     {
-        result = CompileAndCreateShader(L"TransColor.ps", (ID3D11DeviceChild**)&m_pRectPixelShader, { "USE_LIGHTS" });
+        m_pickedIdx = pickedIdx;
     }
 
-    if (SUCCEEDED(result))
+    UINT diff[3] = {}; // Max, sum, pixels over threshold
+    if (m_diffReadback.Read(m_pDeviceContext, diff, sizeof(diff)))
     {
-        result = m_pDevice->CreateInputLayout(InputDesc, 2, pRectVertexShaderCode->GetBufferPointer(), pRectVertexShaderCode->GetBufferSize(), &m_pRectInputLayout);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pRectInputLayout, "RectInputLayout");
-        }
+        m_diffValid = true;
+        m_diffMax = diff[0];
+        m_diffMean = (float)diff[1] / ((float)m_diffWidth * m_diffHeight);
+        m_diffPixels = diff[2];
     }
+}
 
-    SAFE_RELEASE(pRectVertexShaderCode);
-
-    // Create geometry buffer
-    if (SUCCEEDED(result))
+void Renderer::CullBoxes()
+{
+    // Boxes keep bounds while instances rotate, so still camera gives the same visibility, and results in visible ids and draw arguments buffers are kept.
+    // Occlusion depends on depth of the previous frame and mesh bounds follow rotation, so they are always tested
+    CullState state = {};
+    memcpy(state.frustum, m_cameraSnapshot.frustum, sizeof(state.frustum));
+    state.instCount = m_instCount;
+    state.flags = (m_doCull ? 1 : 0) | (m_computeCull ? 2 : 0) | (m_hierarchicalCull ? 4 : 0) | (m_simdCull ? 8 : 0) | (m_sortInstances ? 16 : 0)
+        | (m_orientedBounds ? 32 : 0);
+
+    m_visibilityReused = m_reuseVisibility && m_cullStateValid && !(m_computeCull && m_occlusionCull)
+        && !(m_orientedBounds && m_instancesMoved)
+        && memcmp(&state, &m_cullState, sizeof(CullState)) == 0;
+    m_cullState = state;
+    m_cullStateValid = true;
+    if (m_visibilityReused)
     {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(RectGeomBuffer);
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
+        return;
+    }
 
-        RectGeomBuffer geomBuffer;
-        geomBuffer.m = DirectX::XMMatrixTranslation(Rect0Pos.x, Rect0Pos.y, Rect0Pos.z);
-        geomBuffer.color = Point4f{ 0.5f, 0, 0.5f, 0.5f };
+    if (m_doCull && m_computeCull)
+    {
+        static const UINT Zero[4] = { 0, 0, 0, 0 };
+        m_pDeviceContext->CopyResource(m_pIndirectArgs, m_pMeshArgsReset);
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = &geomBuffer;
-        data.SysMemPitch = sizeof(geomBuffer);
-        data.SysMemSlicePitch = 0;
+        // Occlusion is tested against previous frame Hi-Z, reprojected with its view projection
+        OcclusionParams occlusionParams;
+        occlusionParams.vp = m_hiZVP;
+        occlusionParams.hiZSize = Point4i{ (int)m_hiZWidth, (int)m_hiZHeight, (int)m_hiZMips, m_occlusionCull ? 1 : 0 };
+        StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pOcclusionParams[0], 0, nullptr, &occlusionParams, 0, 0, STALL_SITE);
 
-        result = m_pDevice->CreateBuffer(&desc, &data, &m_pRectGeomBuffer);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
+        if (m_occlusionCull)
         {
-            result = SetResourceName(m_pRectGeomBuffer, "RectGeomBuffer");
+            m_pDeviceContext->ClearUnorderedAccessViewUint(m_pOccludedCountUAV, Zero);
         }
 
-        if (SUCCEEDED(result))
-        {
-            geomBuffer.m = DirectX::XMMatrixTranslation(Rect1Pos.x, Rect1Pos.y, Rect1Pos.z);
-            geomBuffer.color = Point4f{ 0.5f, 0.5f, 0, 0.5f };
+        ID3D11Buffer* constBuffers[3] = {m_sceneCB.Get(), m_pCullParams, m_pOcclusionParams[0]};
+        m_pDeviceContext->CSSetConstantBuffers(0, 3, constBuffers);
 
-            result = m_pDevice->CreateBuffer(&desc, &data, &m_pRectGeomBuffer2);
-        }
-        if (SUCCEEDED(result))
+        // Geometry gives mesh of visible instance
+        ID3D11ShaderResourceView* sharedSRVs[2] = {m_pHiZSRV, m_pGeomBufferInstSRV};
+        m_pDeviceContext->CSSetShaderResources(4, 2, sharedSRVs);
+
+        if (m_hierarchicalCull)
         {
-            result = SetResourceName(m_pRectGeomBuffer2, "RectGeomBuffer2");
-        }
-    }
+            // Cull clusters
+            m_pDeviceContext->ClearUnorderedAccessViewUint(m_pClusterArgsCountUAV, Zero);
 
-    return result;
-}
+            ID3D11ShaderResourceView* clusterSRVs[1] = {m_pClustersSRV};
+            m_pDeviceContext->CSSetShaderResources(0, 1, clusterSRVs);
 
-HRESULT Renderer::InitCubemap()
-{
-    HRESULT result = S_OK;
+            ID3D11UnorderedAccessView* clusterUAVs[2] = {m_pClusterArgsUAV, m_pVisibleClustersUAV};
+            m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, clusterUAVs, nullptr);
 
-    DXGI_FORMAT textureFmt;
-    if (SUCCEEDED(result))
-    {
-        const std::wstring TextureNames[6] =
-        {
-            L"../Common/posx.dds", L"../Common/negx.dds",
-            L"../Common/posy.dds", L"../Common/negy.dds",
-            L"../Common/posz.dds", L"../Common/negz.dds"
-        };
-        TextureDesc texDescs[6];
-        bool ddsRes = true;
-        for (int i = 0; i < 6 && ddsRes; i++)
-        {
-            ddsRes = LoadDDS(TextureNames[i].c_str(), texDescs[i], true);
-        }
+            m_pDeviceContext->CSSetShader(m_pClusterCullShader, nullptr, 0);
 
-        textureFmt = texDescs[0].fmt; // Assume all are the same
+            m_pDeviceContext->Dispatch(DivUp(m_bvh.GetClusterCount(), 64u), 1, 1);
 
-        D3D11_TEXTURE2D_DESC desc = {};
-        desc.Format = textureFmt;
-        desc.ArraySize = 6;
-        desc.MipLevels = 1;
-        desc.Usage = D3D11_USAGE_IMMUTABLE;
-        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-        desc.SampleDesc.Count = 1;
-        desc.SampleDesc.Quality = 0;
-        desc.Height = texDescs[0].height;
-        desc.Width = texDescs[0].width;
+            // Cull instances of visible clusters, group per cluster
+            ID3D11UnorderedAccessView* uavBuffers[4] = {m_pIndirectArgsUAV, m_pGeomBufferInstVisGPU_UAV, m_pOccludedIdsUAV, m_pOccludedCountUAV};
+            m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, uavBuffers, nullptr);
 
-        UINT32 blockWidth = DivUp(desc.Width, 4u);
-        UINT32 blockHeight = DivUp(desc.Height, 4u);
-        UINT32 pitch = blockWidth * GetBytesPerBlock(desc.Format);
+            ID3D11ShaderResourceView* srvs[4] = {m_pInstBoundsSRV, m_pClustersSRV, m_pInstOrderSRV, m_pVisibleClustersSRV};
+            m_pDeviceContext->CSSetShaderResources(0, 4, srvs);
 
-        D3D11_SUBRESOURCE_DATA data[6];
-        for (int i = 0; i < 6; i++)
-        {
-            data[i].pSysMem = texDescs[i].pData;
-            data[i].SysMemPitch = pitch;
-            data[i].SysMemSlicePitch = 0;
+            m_pDeviceContext->CSSetShader(m_groupAppend ? m_pClusteredCullShader : m_pClusteredCullAtomicShader, nullptr, 0);
+
+            m_pDeviceContext->DispatchIndirect(m_pClusterArgs, 0);
         }
-        result = m_pDevice->CreateTexture2D(&desc, data, &m_pCubemapTexture);
-        assert(SUCCEEDED(result));
-        if (SUCCEEDED(result))
+        else
         {
-            result = SetResourceName(m_pCubemapTexture, "CubemapTexture");
+            UINT groupNumber = DivUp(m_instCount, 64u);
+
+            ID3D11ShaderResourceView* srvs[1] = {m_pInstBoundsSRV};
+            m_pDeviceContext->CSSetShaderResources(0, 1, srvs);
+
+            ID3D11UnorderedAccessView* uavBuffers[4] = {m_pIndirectArgsUAV, m_pGeomBufferInstVisGPU_UAV, m_pOccludedIdsUAV, m_pOccludedCountUAV};
+            m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, uavBuffers, nullptr);
+
+            m_pDeviceContext->CSSetShader(m_groupAppend ? m_pCullShader : m_pCullAtomicShader, nullptr, 0);
+
+            m_pDeviceContext->Dispatch(groupNumber, 1, 1);
         }
-        for (int i = 0; i < 6; i++)
+
+        // Unbind, as visible ids are read by vertex shader
+        ID3D11UnorderedAccessView* nullUAVs[4] = {};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, nullUAVs, nullptr);
+
+        // Late pass only runs groups for occluded candidates
+        if (m_occlusionCull)
         {
-            free(texDescs[i].pData);
+            BuildDispatchArgs(m_pOccludedCountUAV, true, 1, 1, 0, m_pOccludedArgsUAV);
         }
     }
-    if (SUCCEEDED(result))
+    else
     {
-        D3D11_SHADER_RESOURCE_VIEW_DESC desc;
-        desc.Format = textureFmt;
-        desc.ViewDimension = D3D_SRV_DIMENSION_TEXTURECUBE;
-        desc.TextureCube.MipLevels = 1;
-        desc.TextureCube.MostDetailedMip = 0;
+        const Point4f* frustum = m_cameraSnapshot.frustum;
 
-        result = m_pDevice->CreateShaderResourceView(m_pCubemapTexture, &desc, &m_pCubemapView);
-        if (SUCCEEDED(result))
+        m_visibleInstances = 0;
+
+        // Ids are culled and sorted in scratch arrays, then split by mesh into the mapped buffer
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        HRESULT hr = StallDetector::Get().Map(m_pDeviceContext, m_pGeomBufferInstVis, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource, STALL_SITE);
+        assert(SUCCEEDED(hr));
+        if (SUCCEEDED(hr))
         {
-            result = SetResourceName(m_pCubemapView, "CubemapView");
+            UINT* pIds = m_cullIds.data();
+            if (!m_doCull)
+            {
+                for (UINT i = 0; i < m_instCount; i++)
+                {
+                    pIds[i] = i;
+                }
+                m_visibleInstances = m_instCount;
+            }
+            else if (m_hierarchicalCull)
+            {
+                m_visibleInstances = m_bvh.Cull(frustum, m_instances.GetBounds(), pIds);
+            }
+            else if (m_simdCull)
+            {
+                m_visibleInstances = m_cpuCull.Cull(frustum, pIds, m_parallelCull ? &m_jobSystem : nullptr);
+            }
+            else
+            {
+                for (UINT i = 0; i < m_instCount; i++)
+                {
+                    const AABB& bb = m_instances.GetBounds(i);
+                    if (IsBoxInside(frustum, bb.vmin, bb.vmax))
+                    {
+                        pIds[m_visibleInstances++] = i;
+                    }
+                }
+            }
+            // GPU animation accumulates its own angles, so boxes alone are used then
+            if (m_doCull && m_orientedBounds && !m_computeAnimation)
+            {
+                CPU_PROFILE_ZONE("CullOrientedBounds");
+                UINT visible = 0;
+                for (UINT i = 0; i < m_visibleInstances; i++)
+                {
+                    UINT id = pIds[i];
+                    if (IsOrientedBoxInside(frustum, m_instances.GetModel(id, m_interpolationSec), InstanceMeshBounds[m_instances.GetMesh(id)]))
+                    {
+                        pIds[visible++] = pIds[i];
+                    }
+                }
+                m_visibleInstances = visible;
+            }
+            if (m_doCull && m_sortInstances)
+            {
+                CPU_PROFILE_ZONE("SortInstances");
+                m_depthSort.Sort(pIds, m_visibleInstances, m_instances.GetBounds(), m_cameraSnapshot.pos, m_sortedIds.data());
+                pIds = m_sortedIds.data();
+            }
+
+            // Split keeps order, so ids stay sorted within each mesh LOD
+            UINT* pMapped = reinterpret_cast<UINT*>(subresource.pData);
+            for (UINT i = 0; i < InstanceDrawCount; i++)
+            {
+                m_visibleCounts[i] = 0;
+            }
+            for (UINT i = 0; i < m_visibleInstances; i++)
+            {
+                UINT mesh = m_instances.GetMesh(pIds[i]);
+                UINT draw = mesh * MaxLods + SelectLod(m_instances.GetBounds(pIds[i]), mesh);
+                pMapped[draw * MaxInst + m_visibleCounts[draw]++] = pIds[i];
+            }
+            m_pDeviceContext->Unmap(m_pGeomBufferInstVis, 0);
         }
     }
-
-    return result;
 }
 
-HRESULT Renderer::InitPostProcess()
+void Renderer::SortVisibleInstances()
 {
-    HRESULT result = S_OK;
-
-    result = CompileAndCreateShader(L"Sepia.vs", (ID3D11DeviceChild**)&m_pSepiaVertexShader);
-    if (SUCCEEDED(result))
+    // Visible count is only known on GPU, so sorting network is sized for all instances, write pass gets groups for visible ids only
+    UINT keyCount = (UINT)SortLocalSize;
+    while (keyCount < m_instCount)
     {
-        result = CompileAndCreateShader(L"Sepia.ps", (ID3D11DeviceChild**)&m_pSepiaPixelShader);
+        keyCount *= 2;
     }
+    assert(keyCount <= MaxSortKeys);
 
-    return result;
-}
+    static const UINT ArgsStride = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS) / sizeof(UINT);
+    BuildDispatchArgs(m_pIndirectArgsUAV, false, InstanceDrawCount, ArgsStride, 1, m_pSortWriteArgsUAV);
 
-HRESULT Renderer::InitCull()
-{
-    HRESULT result = S_OK;
+    ID3D11Buffer* constBuffers[2] = {m_sceneCB.Get(), m_pSortParams};
+    m_pDeviceContext->CSSetConstantBuffers(0, 2, constBuffers);
 
-    // Create shader
-    result = CompileAndCreateShader(L"FrustumCull.cs", (ID3D11DeviceChild**)&m_pCullShader);
-    // Create indirect arguments buffer (for calculation)
-    if (SUCCEEDED(result))
-    {
-        D3D11_BUFFER_DESC desc;
-        desc.ByteWidth = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS);
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-        desc.StructureByteStride = sizeof(UINT);
+    ID3D11ShaderResourceView* srvs[1] = {m_pInstBoundsSRV};
+    m_pDeviceContext->CSSetShaderResources(0, 1, srvs);
 
-        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pIndirectArgsSrc);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pIndirectArgsSrc, "IndirectArgsSrc");
-        }
-        if (SUCCEEDED(result))
-        {
-            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
-            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
-            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
-            uavDesc.Buffer.FirstElement = 0;
-            uavDesc.Buffer.NumElements = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS) / sizeof (UINT);
-            uavDesc.Buffer.Flags = 0;
+    ID3D11UnorderedAccessView* uavBuffers[3] = {m_pIndirectArgsUAV, m_pGeomBufferInstVisGPU_UAV, m_pSortKeysUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, uavBuffers, nullptr);
 
-            result = m_pDevice->CreateUnorderedAccessView(m_pIndirectArgsSrc, &uavDesc, &m_pIndirectArgsUAV);
-        }
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pIndirectArgsSrc, "IndirectArgsUAV");
-        }
-    }
-    // Create indirect arguments buffer (for usage)
-    if (SUCCEEDED(result))
+    // Each mesh LOD segment is sorted separately, keys buffer is reused
+    for (int mesh = 0; mesh < (int)InstanceDrawCount; mesh++)
     {
-        D3D11_BUFFER_DESC desc;
-        desc.ByteWidth = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS);
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = 0;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
-        desc.StructureByteStride = 0;
-
-        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pIndirectArgs);
-        if (SUCCEEDED(result))
+        if ((UINT)mesh % MaxLods >= m_lodCounts[(UINT)mesh / MaxLods])
         {
-            result = SetResourceName(m_pIndirectArgsSrc, "IndirectArgs");
+            continue;
         }
-    }
-    // Create culling params buffer
-    if (SUCCEEDED(result))
-    {
-        D3D11_BUFFER_DESC desc;
-        desc.ByteWidth = sizeof(CullParams);
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = 0;
-        desc.StructureByteStride = 0;
 
-        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pCullParams);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pCullParams, "CullParams");
-        }
+        SortParams sortParams;
+        sortParams.sortParams = Point4i{ (int)keyCount, 0, 0, mesh };
+        StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pSortParams, 0, nullptr, &sortParams, 0, 0, STALL_SITE);
+
+        m_pDeviceContext->CSSetShader(m_pSortKeysShader, nullptr, 0);
+        m_pDeviceContext->Dispatch(keyCount / 64, 1, 1);
+
+        SortKeys(keyCount, (UINT)mesh);
+
+        m_pDeviceContext->CSSetShader(m_pSortWriteShader, nullptr, 0);
+        m_pDeviceContext->DispatchIndirect(m_pSortWriteArgs, mesh * 3 * sizeof(UINT));
     }
-    // Create output buffer
-    if (SUCCEEDED(result))
-    {
 
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(Point4i) * MaxInst;
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
-        desc.CPUAccessFlags = 0;
-        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-        desc.StructureByteStride = sizeof(Point4i);
+    // Unbind, as visible ids are read by vertex shader
+    ID3D11UnorderedAccessView* nullUAVs[3] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, nullUAVs, nullptr);
+}
 
-        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pGeomBufferInstVisGPU);
-        if (SUCCEEDED(result))
-        {
-            result = SetResourceName(m_pGeomBufferInstVisGPU, "GeomBufferInstVisGPU");
-        }
-        if (SUCCEEDED(result))
-        {
-            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
-            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
-            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
-            uavDesc.Buffer.FirstElement = 0;
-            uavDesc.Buffer.NumElements = MaxInst;
-            uavDesc.Buffer.Flags = 0;
+void Renderer::SortKeys(UINT keyCount, UINT mesh)
+{
+    SortParams sortParams;
 
-            result = m_pDevice->CreateUnorderedAccessView(m_pGeomBufferInstVisGPU, &uavDesc, &m_pGeomBufferInstVisGPU_UAV);
-        }
-        if (SUCCEEDED(result))
+    // Sort blocks fitting into group shared memory
+    sortParams.sortParams = Point4i{ (int)keyCount, 0, 0, (int)mesh };
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pSortParams, 0, nullptr, &sortParams, 0, 0, STALL_SITE);
+
+    m_pDeviceContext->CSSetShader(m_pSortLocalShader, nullptr, 0);
+    m_pDeviceContext->Dispatch(keyCount / SortLocalSize, 1, 1);
+
+    // Merge blocks, compare steps with distance under local size are done in group shared memory
+    for (UINT k = 2 * SortLocalSize; k <= keyCount; k *= 2)
+    {
+        m_pDeviceContext->CSSetShader(m_pSortGlobalShader, nullptr, 0);
+        for (UINT j = k / 2; j >= SortLocalSize; j /= 2)
         {
-            result = SetResourceName(m_pIndirectArgsSrc, "GeomBufferInstVisGPU_UAV");
+            sortParams.sortParams = Point4i{ (int)keyCount, (int)k, (int)j, (int)mesh };
+            StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pSortParams, 0, nullptr, &sortParams, 0, 0, STALL_SITE);
+            m_pDeviceContext->Dispatch(keyCount / 2 / 64, 1, 1);
         }
+
+        sortParams.sortParams = Point4i{ (int)keyCount, (int)k, 0, (int)mesh };
+        StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pSortParams, 0, nullptr, &sortParams, 0, 0, STALL_SITE);
+
+        m_pDeviceContext->CSSetShader(m_pSortLocalShader, nullptr, 0);
+        m_pDeviceContext->Dispatch(keyCount / SortLocalSize, 1, 1);
     }
-    if (SUCCEEDED(result))
+}
+
+void Renderer::SortTransparent()
+{
+    UINT keyCount = (UINT)SortLocalSize;
+    while (keyCount < RectCount)
     {
-        D3D11_QUERY_DESC desc;
-        desc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
-        desc.MiscFlags = 0;
-        for (int i = 0; i < 10 && SUCCEEDED(result); i++)
-        {
-            result = m_pDevice->CreateQuery(&desc, &m_queries[i]);
-        }
+        keyCount *= 2;
     }
+    assert(keyCount <= MaxSortKeys);
 
-    assert(SUCCEEDED(result));
+    m_pDeviceContext->CopyResource(m_pRectArgs, m_pRectArgsReset);
 
-    return result;
+    ID3D11Buffer* constBuffers[2] = {m_sceneCB.Get(), m_pSortParams};
+    m_pDeviceContext->CSSetConstantBuffers(0, 2, constBuffers);
+
+    ID3D11ShaderResourceView* srvs[1] = {m_pRectBoundsSRV};
+    m_pDeviceContext->CSSetShaderResources(0, 1, srvs);
+
+    // Keys buffer is shared with instance sort, which is done by now
+    ID3D11UnorderedAccessView* uavBuffers[3] = {m_pRectArgsUAV, m_pRectIdsUAV, m_pSortKeysUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, uavBuffers, nullptr);
+
+    // Hidden rects get padding keys, so sort also compacts visible ones
+    SortParams sortParams;
+    sortParams.sortParams = Point4i{ (int)keyCount, 0, (int)RectCount, 0 };
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pSortParams, 0, nullptr, &sortParams, 0, 0, STALL_SITE);
+
+    m_pDeviceContext->CSSetShader(m_pRectCullShader, nullptr, 0);
+    m_pDeviceContext->Dispatch(keyCount / 64, 1, 1);
+
+    SortKeys(keyCount, 0);
+
+    m_pDeviceContext->CSSetShader(m_pSortWriteShader, nullptr, 0);
+    m_pDeviceContext->Dispatch(DivUp(RectCount, 64u), 1, 1);
+
+    // Unbind, as visible ids are read by vertex shader
+    ID3D11UnorderedAccessView* nullUAVs[3] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, nullUAVs, nullptr);
 }
 
-void Renderer::UpdateCubes(double deltaSec)
+void Renderer::AnimateCubes()
 {
-    if (m_rotateModel)
+    if (!m_computeAnimation || !m_instancesMoved || m_instCount == 0)
     {
-        for (UINT i = 0; i < m_instCount; i++)
-        {
-            if (fabs(m_geomBuffers[i].shineSpeedTexIdNM.y) > 0.0001)
-            {
-                m_geomBuffers[i].posAngle.w = m_geomBuffers[i].posAngle.w + (float)deltaSec * m_geomBuffers[i].shineSpeedTexIdNM.y;
+        return;
+    }
 
-                // Model matrix
-                // Angle is reversed, as DirectXMath calculates it as clockwise
-                DirectX::XMMATRIX m =DirectX::XMMatrixMultiply(
-                    DirectX::XMMatrixRotationAxis(DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f), -(float)m_geomBuffers[i].posAngle.w),
-                    DirectX::XMMatrixTranslation(m_geomBuffers[i].posAngle.x, m_geomBuffers[i].posAngle.y, m_geomBuffers[i].posAngle.z)
-                );
+    AnimateParams animateParams;
+    animateParams.deltaTime = Point4f{ m_animationDeltaSec, m_interpolationSec, 0, 0 };
+    animateParams.shapeCount = m_instCount;
 
-                m_geomBuffers[i].m = m;
-                m = DirectX::XMMatrixInverse(nullptr, m);
-                m = DirectX::XMMatrixTranspose(m);
-                m_geomBuffers[i].normalM = m;
-            }
-        }
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pAnimateParams, 0, nullptr, &animateParams, 0, 0, STALL_SITE);
 
-        m_pDeviceContext->UpdateSubresource(m_pGeomBufferInst, 0, nullptr, m_geomBuffers.data(), 0, 0);
-    }
+    ID3D11Buffer* constBuffers[1] = {m_pAnimateParams};
+    m_pDeviceContext->CSSetConstantBuffers(0, 1, constBuffers);
+
+    ID3D11UnorderedAccessView* uavBuffers[1] = {m_pGeomBufferInstUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, uavBuffers, nullptr);
+
+    m_pDeviceContext->CSSetShader(m_pAnimateShader, nullptr, 0);
+
+    m_pDeviceContext->Dispatch(DivUp(m_instCount, 64u), 1, 1);
+
+    // Unbind, as the buffer is read through SRV during rendering
+    uavBuffers[0] = nullptr;
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, uavBuffers, nullptr);
 }
 
-void Renderer::InitGeom(GeomBuffer& geomBuffer, AABB& bb)
+void Renderer::BuildHiZ()
 {
-    Point3f offset = Point3f{ randNormf(), randNormf(), randNormf() } *7.0f - Point3f{ 3.5f, 3.5f, 3.5f };
+    // Depth buffer is read, so detach it, and unbind everything culling has left
+    ID3D11RenderTargetView* views[] = { GetSceneRTV() };
+    m_pDeviceContext->OMSetRenderTargets(1, views, nullptr);
 
-    geomBuffer.shineSpeedTexIdNM.x = randNormf() > 0.5f ? 64.0f : 0.0f;
-    geomBuffer.shineSpeedTexIdNM.y = randNormf() * 2 * (float)M_PI;
-    geomBuffer.posAngle = Point4f{ offset.x, offset.y, offset.z, 0};
+    ID3D11ShaderResourceView* nullSRVs[5] = {};
+    m_pDeviceContext->CSSetShaderResources(0, 5, nullSRVs);
+    ID3D11UnorderedAccessView* nullUAVs[4] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, nullUAVs, nullptr);
 
-    const float diag = sqrtf(2.0f) / 2.0f * 0.5f;
-    bb.vmin = geomBuffer.posAngle + Point3f{-diag, -0.5f, -diag};
-    bb.vmax = geomBuffer.posAngle + Point3f{ diag,  0.5f,  diag};
+    ID3D11Buffer* constBuffers[1] = {m_pHiZParams};
+    m_pDeviceContext->CSSetConstantBuffers(0, 1, constBuffers);
 
-    int useNM = 1;
-    bool kitty = randNormf() > 0.5f;
-    if (kitty)
-    {
-        geomBuffer.shineSpeedTexIdNM.z = 1.0f;
-        useNM = 0;
-    }
-    else
+    // Only rendered part of depth is reduced, the rest of pyramid is not read
+    m_hiZWidth = GetRenderWidth();
+    m_hiZHeight = GetRenderHeight();
+    UINT srcWidth = m_hiZWidth;
+    UINT srcHeight = m_hiZHeight;
+    for (UINT mip = 0; mip < m_hiZMips; mip++)
     {
-        geomBuffer.shineSpeedTexIdNM.z = 0.0f;
-        useNM = 1;
+        UINT dstWidth = std::max(1u, m_hiZWidth >> (mip + 1));
+        UINT dstHeight = std::max(1u, m_hiZHeight >> (mip + 1));
+
+        HiZParams hiZParams;
+        hiZParams.sizes = Point4i{ (int)srcWidth, (int)srcHeight, (int)dstWidth, (int)dstHeight };
+        StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pHiZParams, 0, nullptr, &hiZParams, 0, 0, STALL_SITE);
+
+        // Multisampled depth is reduced over samples on the first level
+        ID3D11ShaderResourceView* pDepthSRV = IsMsaaActive() ? m_pMsaaDepthBufferSRV : m_pDepthBufferSRV;
+        ID3D11ShaderResourceView* srvs[1] = {mip == 0 ? pDepthSRV : m_pHiZMipSRVs[mip - 1]};
+        m_pDeviceContext->CSSetShaderResources(0, 1, srvs);
+        m_pDeviceContext->CSSetShader(mip == 0 && IsMsaaActive() ? m_pHiZMsaaShader : m_pHiZShader, nullptr, 0);
+
+        ID3D11UnorderedAccessView* uavs[1] = {m_pHiZMipUAVs[mip]};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+
+        m_pDeviceContext->Dispatch(DivUp(dstWidth, 8u), DivUp(dstHeight, 8u), 1);
+
+        // Unbind, as the mip is read on next step
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, nullptr);
+
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
     }
-    geomBuffer.shineSpeedTexIdNM.w = *reinterpret_cast<float*>(&useNM);
+    m_pDeviceContext->CSSetShaderResources(0, 1, nullSRVs);
+
+    m_hiZVP = m_sceneBuffer.vp;
+
+    m_pDeviceContext->OMSetRenderTargets(1, views, GetSceneDSV());
 }
 
-void Renderer::TermScene()
+void Renderer::CullOccluded()
 {
-    SAFE_RELEASE(m_pSampler);
+    // Hi-Z is just built from current frame depth
+    OcclusionParams occlusionParams;
+    occlusionParams.vp = m_hiZVP;
+    occlusionParams.hiZSize = Point4i{ (int)m_hiZWidth, (int)m_hiZHeight, (int)m_hiZMips, 1 };
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pOcclusionParams[1], 0, nullptr, &occlusionParams, 0, 0, STALL_SITE);
 
-    SAFE_RELEASE(m_pColorBuffer);
-    SAFE_RELEASE(m_pColorBufferRTV);
-    SAFE_RELEASE(m_pColorBufferSRV);
-    SAFE_RELEASE(m_pSepiaPixelShader);
-    SAFE_RELEASE(m_pSepiaVertexShader);
+    m_pDeviceContext->CopyResource(m_pLateArgs, m_pMeshArgsReset);
 
-    SAFE_RELEASE(m_pTextureView);
-    SAFE_RELEASE(m_pTexture);
-    SAFE_RELEASE(m_pTextureViewNM);
-    SAFE_RELEASE(m_pTextureNM);
+    ID3D11Buffer* constBuffers[3] = {m_sceneCB.Get(), m_pCullParams, m_pOcclusionParams[1]};
+    m_pDeviceContext->CSSetConstantBuffers(0, 3, constBuffers);
 
-    SAFE_RELEASE(m_pRasterizerState);
-    SAFE_RELEASE(m_pDepthState);
-    SAFE_RELEASE(m_pTransDepthState);
+    ID3D11ShaderResourceView* srvs[6] = {m_pInstBoundsSRV, nullptr, nullptr, nullptr, m_pHiZSRV, m_pGeomBufferInstSRV};
+    m_pDeviceContext->CSSetShaderResources(0, 6, srvs);
 
-    SAFE_RELEASE(m_pInputLayout);
-    SAFE_RELEASE(m_pPixelShader);
-    SAFE_RELEASE(m_pVertexShader);
+    ID3D11UnorderedAccessView* uavBuffers[4] = {m_pLateArgsUAV, m_pLateIdsUAV, m_pOccludedIdsUAV, m_pOccludedCountUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, uavBuffers, nullptr);
 
-    SAFE_RELEASE(m_pIndexBuffer);
-    SAFE_RELEASE(m_pVertexBuffer);
+    m_pDeviceContext->CSSetShader(m_pOcclusionCullShader, nullptr, 0);
 
-    SAFE_RELEASE(m_pSceneBuffer);
-    SAFE_RELEASE(m_pGeomBufferInst);
-    SAFE_RELEASE(m_pGeomBufferInstVis);
+    // Candidates count is only known on GPU, group count was built from it after the first cull pass
+    m_pDeviceContext->DispatchIndirect(m_pOccludedArgs, 0);
 
-    SAFE_RELEASE(m_pTransBlendState);
-    SAFE_RELEASE(m_pOpaqueBlendState);
+    // Unbind, as late ids are read by vertex shader
+    ID3D11UnorderedAccessView* nullUAVs[4] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, nullUAVs, nullptr);
+}
 
-    // Term sphere
-    SAFE_RELEASE(m_pSphereInputLayout);
-    SAFE_RELEASE(m_pSpherePixelShader);
-    SAFE_RELEASE(m_pSphereVertexShader);
+void Renderer::BuildInstanceTransforms(TransformSet set)
+{
+    bool late = set == TransformSetLate;
 
-    SAFE_RELEASE(m_pSphereIndexBuffer);
-    SAFE_RELEASE(m_pSphereVertexBuffer);
+    ID3D11Buffer* constBuffers[1] = {m_sceneCB.Get()};
+    m_pDeviceContext->CSSetConstantBuffers(0, 1, constBuffers);
 
-    SAFE_RELEASE(m_pSphereGeomBuffer);
+    ID3D11ShaderResourceView* srvs[2] = {m_pGeomBufferInstSRV, late ? m_pLateIdsSRV : m_pGeomBufferInstVisGPU_SRV};
+    m_pDeviceContext->CSSetShaderResources(0, 2, srvs);
 
-    SAFE_RELEASE(m_pCubemapTexture);
-    SAFE_RELEASE(m_pCubemapView);
+    ID3D11UnorderedAccessView* uavBuffers[3] = {late ? m_pLateArgsUAV : m_pIndirectArgsUAV, m_pInstanceTransformsUAV[set], m_pDrawBasesUAV[set]};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, uavBuffers, nullptr);
 
-    // Term rect
-    SAFE_RELEASE(m_pRectInputLayout);
-    SAFE_RELEASE(m_pRectPixelShader);
-    SAFE_RELEASE(m_pRectVertexShader);
+    // Visible count is only known on GPU, threads past it exit. Each instance is in one draw at most
+    m_pDeviceContext->CSSetShader(m_pInstanceTransformsShader, nullptr, 0);
+    m_pDeviceContext->Dispatch(DivUp(m_instCount, 64u), 1, 1);
 
-    SAFE_RELEASE(m_pRectIndexBuffer);
-    SAFE_RELEASE(m_pRectVertexBuffer);
+    // Unbind, as transforms are read by vertex shader and arguments by draws
+    ID3D11UnorderedAccessView* nullUAVs[3] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, nullUAVs, nullptr);
+    ID3D11ShaderResourceView* nullSRVs[2] = {};
+    m_pDeviceContext->CSSetShaderResources(0, 2, nullSRVs);
+}
 
-    SAFE_RELEASE(m_pRectGeomBuffer);
-    SAFE_RELEASE(m_pRectGeomBuffer2);
+void Renderer::BuildDispatchArgs(ID3D11UnorderedAccessView* pCountsUAV, bool structured, UINT dispatchCount, UINT countStride, UINT countOffset, ID3D11UnorderedAccessView* pArgsUAV)
+{
+    DispatchArgsParams argsParams;
+    argsParams.argsParams = Point4i{ (int)dispatchCount, (int)countStride, (int)countOffset, (int)DispatchGroupSize };
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pDispatchArgsParams, 0, nullptr, &argsParams, 0, 0, STALL_SITE);
 
-    // Term depth buffer
-    SAFE_RELEASE(m_pDepthBuffer);
-    SAFE_RELEASE(m_pDepthBufferDSV);
+    ID3D11Buffer* constBuffers[1] = {m_pDispatchArgsParams};
+    m_pDeviceContext->CSSetConstantBuffers(0, 1, constBuffers);
 
-    // Term small sphere
-    SAFE_RELEASE(m_pSmallSphereIndexBuffer);
-    SAFE_RELEASE(m_pSmallSphereVertexBuffer);
-    SAFE_RELEASE(m_pSmallSphereInputLayout);
-    SAFE_RELEASE(m_pSmallSphereVertexShader);
-    SAFE_RELEASE(m_pSmallSpherePixelShader);
-    for (int i = 0; i < 10; i++)
-    {
-        SAFE_RELEASE(m_pSmallSphereGeomBuffers[i]);
-    }
+    ID3D11UnorderedAccessView* uavBuffers[2] = {pCountsUAV, pArgsUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, uavBuffers, nullptr);
 
-    // Term GPU culling setup
-    SAFE_RELEASE(m_pCullShader);
-    SAFE_RELEASE(m_pIndirectArgsSrc);
-    SAFE_RELEASE(m_pIndirectArgs);
-    SAFE_RELEASE(m_pCullParams);
-    SAFE_RELEASE(m_pIndirectArgsUAV);
-    SAFE_RELEASE(m_pGeomBufferInstVisGPU);
-    SAFE_RELEASE(m_pGeomBufferInstVisGPU_UAV);
-    for (int i = 0; i < 10; i++)
-    {
-        SAFE_RELEASE(m_queries[i]);
-    }
+    m_pDeviceContext->CSSetShader(structured ? m_pDispatchArgsStructuredShader : m_pDispatchArgsShader, nullptr, 0);
+    m_pDeviceContext->Dispatch(DivUp(dispatchCount, 64u), 1, 1);
+
+    // Unbind, as arguments are read by DispatchIndirect
+    ID3D11UnorderedAccessView* nullUAVs[2] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, nullptr);
 }
 
-void Renderer::RenderSphere()
+void Renderer::CullMeshlets()
 {
-    ID3D11SamplerState* samplers[] = { m_pSampler };
-    m_pDeviceContext->PSSetSamplers(0, 1, samplers);
+    static const UINT Zero[4] = { 0, 0, 0, 0 };
+    m_pDeviceContext->ClearUnorderedAccessViewUint(m_pMeshletArgsCountUAV, Zero);
 
-    ID3D11ShaderResourceView* resources[] = { m_pCubemapView };
-    m_pDeviceContext->PSSetShaderResources(0, 1, resources);
+    // Hi-Z is only complete for this frame when occlusion culling has just built it
+    bool hiZ = m_doCull && m_computeCull && m_occlusionCull;
 
-    m_pDeviceContext->IASetIndexBuffer(m_pSphereIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-    ID3D11Buffer* vertexBuffers[] = { m_pSphereVertexBuffer };
-    UINT strides[] = { 12 };
-    UINT offsets[] = { 0 };
-    ID3D11Buffer* cbuffers[] = { m_pSceneBuffer, m_pSphereGeomBuffer };
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pSphereInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pSphereVertexShader, nullptr, 0);
-    m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetShader(m_pSpherePixelShader, nullptr, 0);
-    m_pDeviceContext->DrawIndexed(m_sphereIndexCount, 0, 0);
-}
+    const GeometryPool::Mesh& mesh = m_geometryPool.GetMesh(m_instanceMeshes[InstanceMeshImported * MaxLods]);
 
-void Renderer::RenderSmallSpheres()
-{
-    m_pDeviceContext->OMSetBlendState(m_pOpaqueBlendState, nullptr, 0xffffffff);
-    m_pDeviceContext->OMSetDepthStencilState(m_pDepthState, 0);
+    MeshletParams meshletParams;
+    GetMeshletModel(meshletParams.model);
+    meshletParams.modelScale = Point4f{ MeshletModelScale, 0.0f, 0.0f, 0.0f };
+    meshletParams.params = Point4i{ (int)m_meshletCount, (int)mesh.startIndex, m_meshletConeCull ? 1 : 0, hiZ ? 1 : 0 };
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pMeshletParams, 0, nullptr, &meshletParams, 0, 0, STALL_SITE);
 
-    m_pDeviceContext->IASetIndexBuffer(m_pSmallSphereIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-    ID3D11Buffer* vertexBuffers[] = { m_pSmallSphereVertexBuffer };
-    UINT strides[] = { 12 };
-    UINT offsets[] = { 0 };
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pSmallSphereInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pSmallSphereVertexShader, nullptr, 0);
-    m_pDeviceContext->PSSetShader(m_pSmallSpherePixelShader, nullptr, 0);
+    ID3D11Buffer* constBuffers[3] = {m_sceneCB.Get(), m_pMeshletParams, m_pOcclusionParams[1]};
+    m_pDeviceContext->CSSetConstantBuffers(0, 3, constBuffers);
 
-    for (int i = 0; i < m_sceneBuffer.lightCount.x; i++)
-    {
-        ID3D11Buffer* cbuffers[] = { m_pSceneBuffer, m_pSmallSphereGeomBuffers[i] };
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(m_smallSphereIndexCount, 0, 0);
-    }
+    ID3D11ShaderResourceView* srvs[5] = {m_pMeshletsSRV, m_geometryPool.GetWideIndexSRV(), nullptr, nullptr, hiZ ? m_pHiZSRV : nullptr};
+    m_pDeviceContext->CSSetShaderResources(0, 5, srvs);
+
+    ID3D11UnorderedAccessView* uavBuffers[2] = {m_pMeshletArgsUAV, m_pMeshletIndicesUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, uavBuffers, nullptr);
+
+    m_pDeviceContext->CSSetShader(m_pMeshletCullShader, nullptr, 0);
+
+    // Group per meshlet, rows of groups above dispatch dimension limit
+    m_pDeviceContext->Dispatch(std::min(m_meshletCount, MaxMeshletGroupsX), DivUp(m_meshletCount, MaxMeshletGroupsX), 1);
+
+    // Unbind, as indices and arguments are read by the draw
+    ID3D11UnorderedAccessView* nullUAVs[2] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, nullptr);
+    ID3D11ShaderResourceView* nullSRVs[5] = {};
+    m_pDeviceContext->CSSetShaderResources(0, 5, nullSRVs);
+
+    m_meshletReadback.Copy(m_pDeviceContext, m_pMeshletArgs, 0, sizeof(UINT), 0);
+    m_meshletReadback.EndFrame(m_pDeviceContext);
 }
 
-void Renderer::RenderRects()
+void Renderer::CullLights()
 {
-    m_pDeviceContext->OMSetDepthStencilState(m_pTransDepthState, 0);
+    static const UINT Zero[4] = { 0, 0, 0, 0 };
 
-    m_pDeviceContext->OMSetBlendState(m_pTransBlendState, nullptr, 0xFFFFFFFF);
+    ID3D11Buffer* constBuffers[2] = {m_sceneCB.Get(), m_pLightCullParams};
+    m_pDeviceContext->CSSetConstantBuffers(0, 2, constBuffers);
+    ID3D11Buffer* settingsCB[1] = {m_settingsCB.Get()};
+    m_pDeviceContext->CSSetConstantBuffers(SettingsCBSlot, 1, settingsCB);
 
-    m_pDeviceContext->IASetIndexBuffer(m_pRectIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-    ID3D11Buffer* vertexBuffers[] = { m_pRectVertexBuffer };
-    UINT strides[] = { 16 };
-    UINT offsets[] = { 0 };
-    ID3D11Buffer* cbuffers[] = { m_pSceneBuffer, nullptr };
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pRectInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pRectVertexShader, nullptr, 0);
-    m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetShader(m_pRectPixelShader, nullptr, 0);
+    // Lights which radius does not reach view frustum are dropped, thread per light
+    m_pDeviceContext->ClearUnorderedAccessViewUint(m_pVisibleLightCountUAV, Zero);
 
-    float d0 = 0.0f, d1 = 0.0f;
-    Point3f cameraPos = m_camera.poi + Point3f{ cosf(m_camera.theta) * cosf(m_camera.phi), sinf(m_camera.theta), cosf(m_camera.theta) * sinf(m_camera.phi) } *m_camera.r;
-    for (int i = 0; i < 8; i++)
-    {
-        d0 = std::max(d0, (cameraPos - m_boundingRects[0].GetVert(i)).lengthSqr());
-        d1 = std::max(d1, (cameraPos - m_boundingRects[1].GetVert(i)).lengthSqr());
-    }
+    ID3D11ShaderResourceView* lightSRVs[1] = {m_pLightBufferSRV};
+    m_pDeviceContext->CSSetShaderResources(0, 1, lightSRVs);
 
-    if (d0 > d1)
-    {
-        cbuffers[1] = m_pRectGeomBuffer;
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(6, 0, 0);
+    ID3D11UnorderedAccessView* listUAVs[2] = {m_pVisibleLightsUAV, m_pVisibleLightCountUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, listUAVs, nullptr);
 
-        cbuffers[1] = m_pRectGeomBuffer2;
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(6, 0, 0);
-    }
-    else
-    {
-        cbuffers[1] = m_pRectGeomBuffer2;
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(6, 0, 0);
+    m_pDeviceContext->CSSetShader(m_pLightListShader, nullptr, 0);
+    m_pDeviceContext->Dispatch(DivUp((UINT)m_settingsBuffer.lightCount.x, 64u), 1, 1);
+
+    ID3D11UnorderedAccessView* nullListUAVs[2] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, nullListUAVs, nullptr);
 
-        cbuffers[1] = m_pRectGeomBuffer;
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(6, 0, 0);
+    // Clusters are built from visible lights
+    ID3D11ShaderResourceView* srvs[2] = {m_pVisibleLightsSRV, m_pVisibleLightCountSRV};
+    m_pDeviceContext->CSSetShaderResources(0, 2, srvs);
+
+    ID3D11UnorderedAccessView* uavBuffers[1] = {m_pClusterLightsUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, uavBuffers, nullptr);
+
+    m_pDeviceContext->CSSetShader(m_pLightCullShader, nullptr, 0);
+
+    // Thread per cluster
+    m_pDeviceContext->Dispatch(DivUp((UINT)ClusterCount, 64u), 1, 1);
+
+    // Unbind, as cluster lights are read by pixel shaders
+    ID3D11UnorderedAccessView* nullUAVs[1] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, nullptr);
+    ID3D11ShaderResourceView* nullSRVs[2] = {};
+    m_pDeviceContext->CSSetShaderResources(0, 2, nullSRVs);
+
+    // Bulbs and sky are culled against Hi-Z once cubes pass has built it, otherwise bulbs against frustum only here
+    if (!(m_doCull && m_computeCull && m_occlusionCull))
+    {
+        CullBulbs();
     }
 }
 
-void Renderer::RenderPostProcess()
+void Renderer::CullBulbs()
 {
-    ID3D11RenderTargetView* views[] = { m_pBackBufferRTV };
-    m_pDeviceContext->OMSetRenderTargets(1, views, nullptr);
+    static const UINT Zero[4] = { 0, 0, 0, 0 };
+    m_pDeviceContext->ClearUnorderedAccessViewUint(m_pVisibleBulbCountUAV, Zero);
 
-    ID3D11SamplerState* samplers[] = { m_pSampler };
-    m_pDeviceContext->PSSetSamplers(0, 1, samplers);
+    // Occlusion parameters are of Hi-Z just built by cubes pass, unused without it
+    ID3D11Buffer* constBuffers[3] = {m_sceneCB.Get(), m_pLightCullParams, m_pOcclusionParams[1]};
+    m_pDeviceContext->CSSetConstantBuffers(0, 3, constBuffers);
+    ID3D11Buffer* settingsCB[1] = {m_settingsCB.Get()};
+    m_pDeviceContext->CSSetConstantBuffers(SettingsCBSlot, 1, settingsCB);
 
-    ID3D11ShaderResourceView* resources[] = { m_pColorBufferSRV };
-    m_pDeviceContext->PSSetShaderResources(0, 1, resources);
+    bool hiZ = m_doCull && m_computeCull && m_occlusionCull;
+    ID3D11ShaderResourceView* srvs[5] = {m_pLightBufferSRV, nullptr, nullptr, nullptr, hiZ ? m_pHiZSRV : nullptr};
+    m_pDeviceContext->CSSetShaderResources(0, 5, srvs);
 
-    m_pDeviceContext->OMSetDepthStencilState(nullptr, 0);
-    m_pDeviceContext->RSSetState(nullptr);
-    m_pDeviceContext->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+    ID3D11UnorderedAccessView* uavs[3] = {m_pVisibleBulbsUAV, m_pVisibleBulbCountUAV, m_pSkyArgsUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, uavs, nullptr);
 
-    m_pDeviceContext->IASetIndexBuffer(nullptr, DXGI_FORMAT_UNKNOWN, 0);
-    m_pDeviceContext->IASetInputLayout(nullptr);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pSepiaVertexShader, nullptr, 0);
-    m_pDeviceContext->PSSetShader(m_pSepiaPixelShader, nullptr, 0);
+    m_pDeviceContext->CSSetShader(m_pBulbCullShader, nullptr, 0);
 
-    m_pDeviceContext->Draw(3, 0);
+    // Thread per light, at least one group as the first thread writes sky arguments
+    m_pDeviceContext->Dispatch(std::max(DivUp((UINT)m_settingsBuffer.lightCount.x, 64u), 1u), 1, 1);
+
+    ID3D11UnorderedAccessView* nullUAVs[3] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 3, nullUAVs, nullptr);
+    ID3D11ShaderResourceView* nullSRVs[5] = {};
+    m_pDeviceContext->CSSetShaderResources(0, 5, nullSRVs);
+
+    // Bulbs are drawn for visible ones only
+    D3D11_BOX countBox = { 0, 0, 0, sizeof(UINT), 1, 1 };
+    m_pDeviceContext->CopySubresourceRegion(m_pBulbArgs, 0, sizeof(UINT), 0, 0, m_pVisibleBulbCount, 0, &countBox);
+    m_pDeviceContext->CopySubresourceRegion(m_pBulbImpostorArgs, 0, sizeof(UINT), 0, 0, m_pVisibleBulbCount, 0, &countBox);
 }
 
-void Renderer::ReadQueries()
+void Renderer::UpdateShadowCascades()
 {
-    D3D11_QUERY_DATA_PIPELINE_STATISTICS stats;
-    while (m_lastCompletedFrame < m_curFrame)
+    // Cascade view constants are four 256 byte ranges of one buffer on 11.1, instead of four constant buffers
+    m_cascadeRangesUsed = m_constantOffsets && !m_commandRecorder.IsRecording();
+    m_constantRing.ResetStats();
+
+    Point3f sunDir = SunDir;
+    sunDir.normalize();
+
+    const Point3f& pos = m_cameraSnapshot.pos;
+    const Point3f& dir = m_cameraSnapshot.dir;
+    const Point3f& up = m_cameraSnapshot.up;
+    Point3f right = up.cross(dir);
+
+    // Field of view is horizontal one
+    float tanHalfW = tanf(CameraFov / 2);
+    float tanHalfH = tanHalfW * m_height / m_width;
+
+    // Light looks along sun rays, up is only changed when they are close to vertical
+    Point3f lightUp = fabs(sunDir.y) > 0.99f ? Point3f{ 0, 0, 1 } : Point3f{ 0, 1, 0 };
+    DirectX::XMMATRIX lightView = DirectX::XMMatrixLookToLH(
+        DirectX::XMVectorZero(),
+        DirectX::XMVectorSet(-sunDir.x, -sunDir.y, -sunDir.z, 0.0f),
+        DirectX::XMVectorSet(lightUp.x, lightUp.y, lightUp.z, 0.0f)
+    );
+
+    float splits[CascadeCount];
+    float splitNear = CameraNear;
+    for (UINT c = 0; c < CascadeCount; c++)
     {
-        HRESULT result = m_pDeviceContext->GetData(m_queries[m_lastCompletedFrame % 10], &stats, sizeof(D3D11_QUERY_DATA_PIPELINE_STATISTICS), 0);
-        if (result == S_OK)
+        // Practical split scheme, logarithmic splits are blended with uniform ones
+        float t = (float)(c + 1) / CascadeCount;
+        float logSplit = CameraNear * powf(m_shadowDistance / CameraNear, t);
+        float uniformSplit = CameraNear + (m_shadowDistance - CameraNear) * t;
+        float splitFar = uniformSplit + (logSplit - uniformSplit) * CascadeSplitLambda;
+        splits[c] = splitFar;
+
+        // Bounding sphere of the frustum slice does not change with camera rotation, so cascade size is stable
+        Point3f corners[8];
+        for (UINT i = 0; i < 8; i++)
+        {
+            float depth = (i & 4) ? splitFar : splitNear;
+            float x = ((i & 1) ? 1.0f : -1.0f) * tanHalfW * depth;
+            float y = ((i & 2) ? 1.0f : -1.0f) * tanHalfH * depth;
+            corners[i] = pos + dir * depth + right * x + up * y;
+        }
+        Point3f center = (corners[0] + corners[7]) * 0.5f;
+        float radius = 0.0f;
+        for (UINT i = 0; i < 8; i++)
         {
-            m_gpuVisibleInstances = (int)stats.IAPrimitives / 12;
+            radius = std::max(radius, (corners[i] - center).length());
+        }
+        radius = ceilf(radius * 16.0f) / 16.0f;
+
+        // Center is snapped to texels, so shadow edges do not shimmer while camera moves
+        DirectX::XMFLOAT3 lightCenter;
+        DirectX::XMStoreFloat3(&lightCenter, DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(center.x, center.y, center.z, 1.0f), lightView));
+        float texelSize = 2.0f * radius / CascadeSize;
+        lightCenter.x = floorf(lightCenter.x / texelSize) * texelSize;
+        lightCenter.y = floorf(lightCenter.y / texelSize) * texelSize;
+
+        // Reversed Z, depth is 1 nearest to the sun, and casters out of slice are kept by extended range
+        DirectX::XMMATRIX lightProj = DirectX::XMMatrixOrthographicOffCenterLH(
+            lightCenter.x - radius, lightCenter.x + radius,
+            lightCenter.y - radius, lightCenter.y + radius,
+            lightCenter.z + radius, lightCenter.z - radius - ShadowCasterRange
+        );
 
-            ++m_lastCompletedFrame;
+        DirectX::XMMATRIX vp = DirectX::XMMatrixMultiply(lightView, lightProj);
+        m_shadowBuffer.cascadeVp[c] = vp;
+
+        // Camera position is kept, so LODs are the same as in camera view
+        SceneBuffer cascadeBuffer = m_sceneBuffer;
+        cascadeBuffer.vp = vp;
+        ExtractFrustum(vp, false, cascadeBuffer.frustum);
+        cascadeBuffer.invVp = DirectX::XMMatrixInverse(nullptr, vp);
+        if (m_cascadeRangesUsed)
+        {
+            m_cascadeFirstConstants[c] = m_constantRing.Write(m_pDeviceContext, &cascadeBuffer, sizeof(cascadeBuffer));
         }
         else
         {
-            break;
+            m_cascadeCBs[c].Update(m_pDeviceContext, cascadeBuffer);
+        }
+
+        splitNear = splitFar;
+    }
+
+    static_assert(CascadeCount == 4, "Cascade splits are packed to single vector");
+    m_shadowBuffer.cascadeSplits = Point4f{ splits[0], splits[1], splits[2], splits[3] };
+    m_shadowBuffer.sunDir = Point4f(sunDir, 0.0f);
+    m_shadowBuffer.sunColor = Point4f{ 0.8f, 0.75f, 0.6f, m_sunShadows ? 1.0f : 0.0f };
+    m_shadowBuffer.shadowParams = Point4f{ m_sunShadows ? 1.0f : 0.0f, 0.0005f, (float)CascadeSize, 0.0f };
+    m_shadowBuffer.cameraDir = Point4f(dir, 0.0f);
+    m_shadowCB.Update(m_pDeviceContext, m_shadowBuffer);
+
+    // Kept up to date while single pass is off, so it can be switched on any frame
+    if (m_multiViewSupported)
+    {
+        MultiViewBuffer multiViewBuffer = {};
+        for (UINT c = 0; c < CascadeCount; c++)
+        {
+            multiViewBuffer.viewVp[c] = m_shadowBuffer.cascadeVp[c];
+            ExtractFrustum(m_shadowBuffer.cascadeVp[c], false, &multiViewBuffer.viewFrusta[c * 6]);
         }
+        multiViewBuffer.viewParams = Point4i{ (int)CascadeCount, MaxInst * (int)CascadeCount, 0, 0 };
+        m_multiViewCB.Update(m_pDeviceContext, multiViewBuffer);
     }
 }
 
-void Renderer::CalcFrustum(Point4f frustum[6])
+void Renderer::CullShadowCasters()
 {
-    Point3f dir = -Point3f{ cosf(m_camera.theta) * cosf(m_camera.phi), sinf(m_camera.theta), cosf(m_camera.theta) * sinf(m_camera.phi) };
-    float upTheta = m_camera.theta + (float)M_PI / 2;
-    Point3f up = Point3f{ cosf(upTheta) * cosf(m_camera.phi), sinf(upTheta), cosf(upTheta) * sinf(m_camera.phi) };
-    Point3f right = up.cross(dir);
-    Point3f pos = m_camera.poi + Point3f{ cosf(m_camera.theta) * cosf(m_camera.phi), sinf(m_camera.theta), cosf(m_camera.theta) * sinf(m_camera.phi) } *m_camera.r;
+    for (UINT c = 0; c < CascadeCount; c++)
+    {
+        m_pDeviceContext->CopyResource(m_pShadowArgs[c], m_pMeshArgsReset);
+    }
+    if (m_instCount == 0)
+    {
+        return;
+    }
+
+    // Same frustum cull as for camera view, occlusion is off, as Hi-Z is of camera depth
+    ID3D11ShaderResourceView* srvs[6] = {m_pInstBoundsSRV, nullptr, nullptr, nullptr, nullptr, m_pGeomBufferInstSRV};
+    m_pDeviceContext->CSSetShaderResources(0, 6, srvs);
 
-    float f = 100.0f;
-    float n = 0.1f;
-    float fov = (float)M_PI / 3;
+    m_pDeviceContext->CSSetShader(m_groupAppend ? m_pCullShader : m_pCullAtomicShader, nullptr, 0);
 
-    float x = tanf(fov * 0.5f) * n;
-    float y = tanf(fov * 0.5f) * n * (float)m_height / m_width;
+    for (UINT c = 0; c < CascadeCount; c++)
+    {
+        if (m_cascadeRangesUsed)
+        {
+            ID3D11Buffer* ringBuffers[1] = {m_constantRing.Get()};
+            UINT firstConstants[1] = {m_cascadeFirstConstants[c]};
+            UINT constantCounts[1] = {ConstantRing::GetConstantCount(sizeof(SceneBuffer))};
+            m_pDeviceContext1->CSSetConstantBuffers1(0, 1, ringBuffers, firstConstants, constantCounts);
 
-    Point3f nearVertices[4];
-    nearVertices[0] = pos + dir * n - up * y - right * x;
-    nearVertices[1] = pos + dir * n - up * y + right * x;
-    nearVertices[2] = pos + dir * n + up * y + right * x;
-    nearVertices[3] = pos + dir * n + up * y - right * x;
+            ID3D11Buffer* constBuffers[2] = {m_pShadowCullParams, m_pNoOcclusionParams};
+            m_pDeviceContext->CSSetConstantBuffers(1, 2, constBuffers);
+        }
+        else
+        {
+            ID3D11Buffer* constBuffers[3] = {m_cascadeCBs[c].Get(), m_pShadowCullParams, m_pNoOcclusionParams};
+            m_pDeviceContext->CSSetConstantBuffers(0, 3, constBuffers);
+        }
 
-    x = tanf(fov * 0.5f) * f;
-    y = tanf(fov * 0.5f) * f * (float)m_height / m_width;
+        ID3D11UnorderedAccessView* uavBuffers[4] = {m_pShadowArgsUAV[c], m_pShadowIdsUAV[c], nullptr, nullptr};
+        m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, uavBuffers, nullptr);
 
-    Point3f farVertices[4];
-    farVertices[0] = pos + dir * f - up * y - right * x;
-    farVertices[1] = pos + dir * f - up * y + right * x;
-    farVertices[2] = pos + dir * f + up * y + right * x;
-    farVertices[3] = pos + dir * f + up * y - right * x;
+        m_pDeviceContext->Dispatch(DivUp(m_instCount, 64u), 1, 1);
+    }
 
-    frustum[0] = BuildPlane(nearVertices[0], nearVertices[1], nearVertices[2], nearVertices[3]);
-    frustum[1] = BuildPlane(nearVertices[0], farVertices[0], farVertices[1], nearVertices[1]);
-    frustum[2] = BuildPlane(nearVertices[1], farVertices[1], farVertices[2], nearVertices[2]);
-    frustum[3] = BuildPlane(nearVertices[2], farVertices[2], farVertices[3], nearVertices[3]);
-    frustum[4] = BuildPlane(nearVertices[3], farVertices[3], farVertices[0], nearVertices[0]);
-    frustum[5] = BuildPlane(farVertices[1], farVertices[0], farVertices[3], farVertices[2]);
+    // Unbind, as cascade ids are read by vertex shader
+    ID3D11UnorderedAccessView* nullUAVs[4] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, nullUAVs, nullptr);
 }
 
-void Renderer::CullBoxes()
+void Renderer::CullShadowCastersMultiView()
 {
-    if (m_computeCull)
+    m_pDeviceContext->CopyResource(m_pMultiViewArgs, m_pMultiViewArgsReset);
+    if (m_instCount == 0)
     {
-        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args;
-        args.IndexCountPerInstance = 36;
-        args.InstanceCount = 0;
-        args.StartIndexLocation = 0;
-        args.BaseVertexLocation = 0;
-        args.StartInstanceLocation = 0;
+        return;
+    }
+
+    // Camera scene constants give LODs, cascade frusta come from multi-view constants
+    ID3D11Buffer* constBuffers[3] = {m_sceneCB.Get(), m_pShadowCullParams, m_pNoOcclusionParams};
+    m_pDeviceContext->CSSetConstantBuffers(0, 3, constBuffers);
+    ID3D11Buffer* multiViewBuffers[1] = {m_multiViewCB.Get()};
+    m_pDeviceContext->CSSetConstantBuffers(5, 1, multiViewBuffers);
 
-        m_pDeviceContext->UpdateSubresource(m_pIndirectArgsSrc, 0, nullptr, &args, 0, 0);
+    ID3D11ShaderResourceView* srvs[6] = {m_pInstBoundsSRV, nullptr, nullptr, nullptr, nullptr, m_pGeomBufferInstSRV};
+    m_pDeviceContext->CSSetShaderResources(0, 6, srvs);
 
-        UINT groupNumber = DivUp(m_instCount, 64u);
+    ID3D11UnorderedAccessView* uavBuffers[4] = {m_pMultiViewArgsUAV, m_pMultiViewIdsUAV, nullptr, nullptr};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, uavBuffers, nullptr);
 
-        ID3D11Buffer* constBuffers[2] = {m_pSceneBuffer, m_pCullParams};
-        m_pDeviceContext->CSSetConstantBuffers(0, 2, constBuffers);
+    m_pDeviceContext->CSSetShader(m_pMultiViewCullShader, nullptr, 0);
 
-        ID3D11UnorderedAccessView* uavBuffers[2] = {m_pIndirectArgsUAV, m_pGeomBufferInstVisGPU_UAV};
-        m_pDeviceContext->CSSetUnorderedAccessViews(0, 2, uavBuffers, nullptr);
+    m_pDeviceContext->Dispatch(DivUp(m_instCount, 64u), 1, 1);
 
-        m_pDeviceContext->CSSetShader(m_pCullShader, nullptr, 0);
+    // Unbind, as tagged ids are read by vertex shader
+    ID3D11UnorderedAccessView* nullUAVs[4] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 4, nullUAVs, nullptr);
+}
 
-        m_pDeviceContext->Dispatch(groupNumber, 1, 1);
+void Renderer::RenderShadowsMultiView()
+{
+    StateCache& state = m_immediateState;
 
-        m_pDeviceContext->CopyResource(m_pGeomBufferInstVis, m_pGeomBufferInstVisGPU);
-    }
-    else
+    m_pDeviceContext->ClearDepthStencilView(m_pShadowAtlasDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
+
+    state.OMSetRenderTargets(0, nullptr, m_pShadowAtlasDSV);
+
+    m_geometryPool.Bind(state, m_packedVertices ? GeometryPool::VertexFormatPacked : GeometryPool::VertexFormatTextured);
+
+    ID3D11Buffer* instanceBuffers[] = { m_pInstanceIndices };
+    UINT instanceStrides[] = { sizeof(UINT) };
+    UINT instanceOffsets[] = { 0 };
+    state.IASetVertexBuffers(1, 1, instanceBuffers, instanceStrides, instanceOffsets);
+    Pipeline pipeline = {
+        m_pMultiViewVertexShader, nullptr, m_pInputLayout, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pOpaqueBlendState, m_pDepthState, m_pShadowRasterizerState
+    };
+    state.SetPipeline(pipeline);
+
+    // Viewport of each cascade in atlas, vertex shader selects it by cascade tag of instance
+    D3D11_VIEWPORT viewports[CascadeCount];
+    for (UINT c = 0; c < CascadeCount; c++)
     {
-        Point4f frustum[6];
-        CalcFrustum(frustum);
+        viewports[c].TopLeftX = (FLOAT)(c * CascadeSize);
+        viewports[c].TopLeftY = 0;
+        viewports[c].Width = (FLOAT)CascadeSize;
+        viewports[c].Height = (FLOAT)CascadeSize;
+        viewports[c].MinDepth = 0.0f;
+        viewports[c].MaxDepth = 1.0f;
+    }
+    state.RSSetViewports(CascadeCount, viewports);
 
-        std::vector<Point4i> ids(MaxInst);
+    ID3D11Buffer* cbuffers[] = { m_multiViewCB.Get() };
+    state.VSSetConstantBuffers(5, 1, cbuffers);
 
-        m_visibleInstances = 0;
-        for (UINT i = 0; i < m_instCount; i++)
-        {
-            if (IsBoxInside(frustum, m_geomBBs[i].vmin, m_geomBBs[i].vmax))
-            {
-                ids[m_visibleInstances].x = i;
-                ++m_visibleInstances;
-            }
-        }
+    ID3D11ShaderResourceView* resources[] = { m_pGeomBufferInstSRV, m_pMultiViewIdsSRV };
+    state.VSSetShaderResources(2, 2, resources);
 
-        D3D11_MAPPED_SUBRESOURCE subresource;
-        HRESULT hr = m_pDeviceContext->Map(m_pGeomBufferInstVis, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
-        assert(SUCCEEDED(hr));
-        if (SUCCEEDED(hr))
+    // Draw count doesn't depend on cascade count
+    for (UINT i = 0; i < InstanceDrawCount; i++)
+    {
+        if (i % MaxLods < m_lodCounts[i / MaxLods])
         {
-            memcpy(subresource.pData, ids.data(), sizeof(Point4i) * m_visibleInstances);
-            m_pDeviceContext->Unmap(m_pGeomBufferInstVis, 0);
+            m_geometryPool.BindIndexBuffer(state, m_instanceMeshes[i]);
+            state.DrawIndexedInstancedIndirect(m_pMultiViewArgs, i * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS));
         }
     }
+
+    // Unbind, as atlas is read by lit passes
+    state.OMSetRenderTargets(0, nullptr, nullptr);
+    ID3D11ShaderResourceView* nullResources[2] = {};
+    state.VSSetShaderResources(2, 2, nullResources);
 }
 
-class D3DInclude : public ID3DInclude
+void Renderer::RenderShadows()
 {
-    STDMETHOD(Open)(THIS_ D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID* ppData, UINT* pBytes)
+    StateCache& state = m_immediateState;
+
+    m_pDeviceContext->ClearDepthStencilView(m_pShadowAtlasDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
+
+    state.OMSetRenderTargets(0, nullptr, m_pShadowAtlasDSV);
+
+    // Depth only, vertex shader of camera view is used with cascade scene constants
+    m_geometryPool.Bind(state, m_packedVertices ? GeometryPool::VertexFormatPacked : GeometryPool::VertexFormatTextured);
+
+    ID3D11Buffer* instanceBuffers[] = { m_pInstanceIndices };
+    UINT instanceStrides[] = { sizeof(UINT) };
+    UINT instanceOffsets[] = { 0 };
+    state.IASetVertexBuffers(1, 1, instanceBuffers, instanceStrides, instanceOffsets);
+    Pipeline pipeline = {
+        m_pVertexShader, nullptr, m_pInputLayout, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+        m_pOpaqueBlendState, m_pDepthState, m_pShadowRasterizerState
+    };
+    state.SetPipeline(pipeline);
+
+    for (UINT c = 0; c < CascadeCount; c++)
     {
-        FILE* pFile = nullptr;
-        fopen_s(&pFile, pFileName, "rb");
-        assert(pFile != nullptr);
-        if (pFile == nullptr)
+        // Cascades are side by side in atlas
+        D3D11_VIEWPORT viewport;
+        viewport.TopLeftX = (FLOAT)(c * CascadeSize);
+        viewport.TopLeftY = 0;
+        viewport.Width = (FLOAT)CascadeSize;
+        viewport.Height = (FLOAT)CascadeSize;
+        viewport.MinDepth = 0.0f;
+        viewport.MaxDepth = 1.0f;
+        state.RSSetViewports(1, &viewport);
+
+        D3D11_RECT rect;
+        rect.left = c * CascadeSize;
+        rect.top = 0;
+        rect.right = (c + 1) * CascadeSize;
+        rect.bottom = CascadeSize;
+        state.RSSetScissorRects(1, &rect);
+
+        if (m_cascadeRangesUsed)
         {
-            return E_FAIL;
+            // Bound past the state cache, as it doesn't track ranges
+            ID3D11Buffer* cbuffers[] = { m_constantRing.Get() };
+            UINT firstConstants[] = { m_cascadeFirstConstants[c] };
+            UINT constantCounts[] = { ConstantRing::GetConstantCount(sizeof(SceneBuffer)) };
+            m_pDeviceContext1->VSSetConstantBuffers1(0, 1, cbuffers, firstConstants, constantCounts);
         }
-
-        fseek(pFile, 0, SEEK_END);
-        long long size = _ftelli64(pFile);
-        fseek(pFile, 0, SEEK_SET);
-
-        VOID* pData = malloc(size);
-        if (pData == nullptr)
+        else
         {
-            fclose(pFile);
-            return E_FAIL;
+            ID3D11Buffer* cbuffers[] = { m_cascadeCBs[c].Get() };
+            state.VSSetConstantBuffers(0, 1, cbuffers);
         }
 
-        size_t rd = fread(pData, 1, size, pFile);
-        assert(rd == (size_t)size);
+        ID3D11ShaderResourceView* resources[] = { m_pGeomBufferInstSRV, m_pShadowIdsSRV[c] };
+        state.VSSetShaderResources(2, 2, resources);
 
-        if (rd != (size_t)size)
+        for (UINT i = 0; i < InstanceDrawCount; i++)
         {
-            fclose(pFile);
-            free(pData);
-            return E_FAIL;
+            if (i % MaxLods < m_lodCounts[i / MaxLods])
+            {
+                m_geometryPool.BindIndexBuffer(state, m_instanceMeshes[i]);
+                state.DrawIndexedInstancedIndirect(m_pShadowArgs[c], i * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS));
+            }
         }
+    }
 
-        *ppData = pData;
-        *pBytes = (UINT)size;
+    // Unbind, as atlas is read by lit passes
+    state.OMSetRenderTargets(0, nullptr, nullptr);
+    ID3D11ShaderResourceView* nullResources[2] = {};
+    state.VSSetShaderResources(2, 2, nullResources);
+    if (m_cascadeRangesUsed)
+    {
+        state.Invalidate();
+    }
+}
 
-        return S_OK;
+void Renderer::UpdateResolutionScale()
+{
+    if (!m_dynamicResolution)
+    {
+        m_resolutionScale = 1.0f;
+        return;
     }
-    STDMETHOD(Close)(THIS_ LPCVOID pData)
+    if (m_gpuProfiler.GetCollectedFrames() == m_resolutionFrame)
     {
-        free(const_cast<void*>(pData));
-        return S_OK;
+        return;
     }
-};
+    m_resolutionFrame = m_gpuProfiler.GetCollectedFrames();
 
-HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines, ID3DBlob** ppCode)
+    // GPU time mostly follows pixel count, so linear scale goes with square root of time ratio
+    float frameMs = m_gpuProfiler.GetLastFrameMs();
+    if (frameMs > 0.0f)
+    {
+        float scale = m_resolutionScale * sqrtf(m_targetGpuMs / frameMs);
+        scale = m_resolutionScale + (scale - m_resolutionScale) * ResolutionScaleDamping;
+        m_resolutionScale = std::min(std::max(scale, MinResolutionScale), 1.0f);
+    }
+}
+
+void Renderer::ResolveLighting()
+{
+    // Depth and color buffers are accessed from compute shader
+    m_pDeviceContext->OMSetRenderTargets(0, nullptr, nullptr);
+
+    ResolveParams resolveParams;
+    resolveParams.invVP = DirectX::XMMatrixInverse(nullptr, m_sceneBuffer.vp);
+    resolveParams.resolveSize = Point4i{ (int)GetRenderWidth(), (int)GetRenderHeight(), 0, 0 };
+    StallDetector::Get().UpdateSubresource(m_pDeviceContext, m_pResolveParams, 0, nullptr, &resolveParams, 0, 0, STALL_SITE);
+
+    ID3D11Buffer* constBuffers[2] = {m_sceneCB.Get(), m_pResolveParams};
+    m_pDeviceContext->CSSetConstantBuffers(0, 2, constBuffers);
+    ID3D11Buffer* settingsCB[1] = {m_settingsCB.Get()};
+    m_pDeviceContext->CSSetConstantBuffers(SettingsCBSlot, 1, settingsCB);
+    ID3D11Buffer* shadowCB[1] = {m_shadowCB.Get()};
+    m_pDeviceContext->CSSetConstantBuffers(ShadowCBSlot, 1, shadowCB);
+    ID3D11Buffer* ambientCB[1] = {m_pAmbientCB};
+    m_pDeviceContext->CSSetConstantBuffers(AmbientCBSlot, 1, ambientCB);
+
+    ID3D11ShaderResourceView* srvs[8] = {m_pDepthBufferSRV, m_pGBufferSRVs[0], m_pGBufferSRVs[1], m_pVisibleLightCountSRV, nullptr, m_pVisibleLightsSRV, nullptr, m_pShadowAtlasSRV};
+    m_pDeviceContext->CSSetShaderResources(0, 8, srvs);
+    ID3D11SamplerState* samplers[2] = {nullptr, m_pShadowSampler};
+    m_pDeviceContext->CSSetSamplers(0, 2, samplers);
+
+    ID3D11UnorderedAccessView* uavs[1] = {IsPostProcessActive() ? m_pColorBufferUAV : m_pBackBufferUAV};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+
+    m_pDeviceContext->CSSetShader(m_pResolveShaders[GetShaderVariant(LitVariants)], nullptr, 0);
+
+    // Threads group per 16x16 tile
+    m_pDeviceContext->Dispatch(DivUp(GetRenderWidth(), 16u), DivUp(GetRenderHeight(), 16u), 1);
+
+    // Unbind, as color is rendered to and depth is tested by next passes
+    ID3D11ShaderResourceView* nullSRVs[8] = {};
+    m_pDeviceContext->CSSetShaderResources(0, 8, nullSRVs);
+    ID3D11UnorderedAccessView* nullUAVs[1] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, nullptr);
+}
+
+void Renderer::ResolveMsaa()
+{
+    m_pDeviceContext->OMSetRenderTargets(0, nullptr, nullptr);
+
+    // Without post processing resolve goes to back buffer
+    ID3D11Resource* pDst = m_pColorBuffer;
+    if (!IsPostProcessActive())
+    {
+        m_pBackBufferRTV->GetResource(&pDst);
+        pDst->Release(); // Swap chain keeps it alive
+    }
+    m_pDeviceContext->ResolveSubresource(pDst, 0, m_pMsaaColorBuffer, 0, ColorFormats[m_colorBufferFormat]);
+}
+
+void Renderer::ComparePrecision()
 {
-    // Try to load shader's source code first
-    FILE* pFile = nullptr;
-    _wfopen_s(&pFile, path.c_str(), L"rb");
-    assert(pFile != nullptr);
-    if (pFile == nullptr)
+    // Final image before UI, so post processing is compared too
+    ID3D11Resource* pBackBuffer = nullptr;
+    m_pBackBufferRTV->GetResource(&pBackBuffer);
+    pBackBuffer->Release(); // Swap chain keeps it alive
+
+    D3D11_BOX box = { 0, 0, 0, m_diffWidth, m_diffHeight, 1 };
+    if (m_precisionCompare == PrecisionCompareReference)
+    {
+        m_pDeviceContext->CopySubresourceRegion(m_pDiffTextures[0], 0, 0, 0, 0, pBackBuffer, 0, &box);
+        m_precisionCompare = PrecisionCompareHalf;
+        return;
+    }
+
+    m_precisionCompare = PrecisionCompareIdle;
+    if (m_width != m_diffWidth || m_height != m_diffHeight)
     {
-        return E_FAIL;
+        return; // Resized in between, frames don't match
     }
+    m_pDeviceContext->CopySubresourceRegion(m_pDiffTextures[1], 0, 0, 0, 0, pBackBuffer, 0, &box);
+
+    static const UINT Zero[4] = { 0, 0, 0, 0 };
+    m_pDeviceContext->ClearUnorderedAccessViewUint(m_pDiffResultUAV, Zero);
+
+    m_pDeviceContext->CSSetShaderResources(0, 2, m_pDiffSRVs);
+    ID3D11UnorderedAccessView* uavs[1] = { m_pDiffResultUAV };
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+    m_pDeviceContext->CSSetShader(m_pImageDiffShader, nullptr, 0);
+
+    m_pDeviceContext->Dispatch(DivUp(m_diffWidth, 8u), DivUp(m_diffHeight, 8u), 1);
+
+    ID3D11UnorderedAccessView* nullUAVs[1] = {};
+    m_pDeviceContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, nullptr);
+    ID3D11ShaderResourceView* nullSRVs[2] = {};
+    m_pDeviceContext->CSSetShaderResources(0, 2, nullSRVs);
 
-    fseek(pFile, 0, SEEK_END);
-    long long size = _ftelli64(pFile);
-    fseek(pFile, 0, SEEK_SET);
+    m_diffReadback.Copy(m_pDeviceContext, m_pDiffResult, 0, 3 * sizeof(UINT), 0);
+    m_diffReadback.EndFrame(m_pDeviceContext);
+}
+
+void Renderer::CaptureFrame()
+{
+    // Without post processing scene is rendered or resolved to back buffer, float color buffer is captured after tone mapping
+    ID3D11Texture2D* pSrc = m_pColorBuffer;
+    if (m_captureSource == CaptureSourceBackBuffer || !IsPostProcessActive() || m_colorBufferFormat != ColorFormatRGBA8)
+    {
+        ID3D11Resource* pBackBuffer = nullptr;
+        m_pBackBufferRTV->GetResource(&pBackBuffer);
+        pBackBuffer->Release(); // Swap chain keeps it alive
+        pSrc = (ID3D11Texture2D*)pBackBuffer;
+    }
 
-    std::vector<char> data;
-    data.resize(size + 1);
+    m_frameCapture.Capture(m_pDeviceContext, pSrc, m_captureName);
+    m_captureName.clear();
+}
 
-    size_t rd = fread(data.data(), 1, size, pFile);
-    assert(rd == (size_t)size);
+void Renderer::RecordFrame()
+{
+    GpuProfileScope scope(m_gpuProfiler, m_pDeviceContext, "RecordFrame");
+    m_videoRecorder.AddFrame(m_pDeviceContext, m_pBackBufferSRV);
+    m_immediateState.Invalidate();
+}
 
-    fclose(pFile);
+void Renderer::AddRandomLights(UINT count)
+{
+    for (UINT i = 0; i < count && m_settingsBuffer.lightCount.x < (int)MaxLights; i++)
+    {
+        Light& light = m_lights[m_settingsBuffer.lightCount.x++];
+        light.pos = Point4f{ randNormf() * 10.0f - 5.0f, randNormf() * 10.0f - 5.0f, randNormf() * 10.0f - 5.0f, 1.0f + randNormf() * 2.0f };
+        light.color = Point4f{ randNormf(), randNormf(), randNormf(), 0 };
+    }
+}
 
+HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines, ID3DBlob** ppCode)
+{
     // Determine shader's type
     std::wstring ext = Extension(path);
 
@@ -2357,33 +9461,13 @@ HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceC
     }
 
     // Setup flags
-    UINT flags1 = 0;
-#ifdef _DEBUG
-    flags1 |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif // _DEBUG
+    UINT flags1 = ShaderCache::GetCompileFlags(m_shaderOptimization);
 
-    D3DInclude includeHandler;
-
-    std::vector<D3D_SHADER_MACRO> shaderDefines;
-    shaderDefines.resize(defines.size() + 1);
-    for (int i = 0; i < defines.size(); i++)
-    {
-        shaderDefines[i].Name = defines[i].c_str();
-        shaderDefines[i].Definition = "";
-    }
-    shaderDefines.back().Name = nullptr;
-    shaderDefines.back().Definition = nullptr;
-
-    // Try to compile
+    // Compiler is only invoked if cache has no valid entry
     ID3DBlob* pCode = nullptr;
-    ID3DBlob* pErrMsg = nullptr;
-    HRESULT result = D3DCompile(data.data(), data.size(), WCSToMBS(path).c_str(), shaderDefines.data(), &includeHandler, entryPoint.c_str(), platform.c_str(), flags1, 0, &pCode, &pErrMsg);
-    if (!SUCCEEDED(result) && pErrMsg != nullptr)
-    {
-        OutputDebugStringA((const char*)pErrMsg->GetBufferPointer());
-    }
+    std::vector<ShaderCache::Dependency> dependencies;
+    HRESULT result = m_shaderCache.GetBytecode(path, defines, entryPoint, platform, flags1, &pCode, &dependencies);
     assert(SUCCEEDED(result));
-    SAFE_RELEASE(pErrMsg);
 
     // Create shader itself if anything else is OK
     if (SUCCEEDED(result))
@@ -2420,6 +9504,11 @@ HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceC
     {
         result = SetResourceName(*ppShader, WCSToMBS(path).c_str());
     }
+    if (SUCCEEDED(result))
+    {
+        // Input layouts are not recreated, so vertex shader inputs should stay the same on reload
+        m_shaderReloader.Register(path, defines, entryPoint, platform, flags1, ppShader, dependencies);
+    }
 
     if (ppCode)
     {
@@ -2432,3 +9521,28 @@ HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceC
 
     return result;
 }
+
+HRESULT Renderer::CompileShaderVariants(const std::wstring& path, ID3D11DeviceChild** ppVariants, UINT flags, const std::vector<std::string>& defines)
+{
+    // All variants are created up front, so toggles never wait for compiler, shader cache makes it cheap after first run
+    HRESULT result = S_OK;
+    for (UINT variant = 0; variant < ShaderVariantCount && SUCCEEDED(result); variant++)
+    {
+        if ((variant & ~flags) != 0)
+        {
+            continue;
+        }
+
+        std::vector<std::string> variantDefines = defines;
+        for (UINT i = 0; i < _countof(ShaderVariantDefines); i++)
+        {
+            if (variant & (1u << i))
+            {
+                variantDefines.push_back(ShaderVariantDefines[i]);
+            }
+        }
+        result = CompileAndCreateShader(path, ppVariants + variant, variantDefines);
+    }
+
+    return result;
+}
@@ -1,10 +1,44 @@
 #pragma once
 
-#include <dxgi.h>
-#include <d3d11.h>
+#include <dxgi1_6.h>
+#include <d3d11_1.h>
 
+#include "../Core/ShaderCache.h"
 #include "../Math/Point.h"
 
+#include "AABB.h"
+#include "AbCompare.h"
+#include "Bvh.h"
+#include "CommandRecorder.h"
+#include "ConstantBuffer.h"
+#include "CpuCull.h"
+#include "DepthSort.h"
+#include "FrameArena.h"
+#include "FrameCapture.h"
+#include "FramePacer.h"
+#include "GeometryPool.h"
+#include "GpuProfiler.h"
+#include "GpuReadback.h"
+#include "InstanceStore.h"
+#include "JobSystem.h"
+#include "MaterialTable.h"
+#include "PostProcess.h"
+#include "RawMouse.h"
+#include "SamplerCache.h"
+#include "ScatterUpload.h"
+#include "StateObjectCache.h"
+#include "ShaderReloader.h"
+#include "StateCache.h"
+#include "TelemetryExport.h"
+#include "TextureProcessor.h"
+#include "TextureStreamer.h"
+#include "UploadRing.h"
+#include "VideoRecorder.h"
+#include "VirtualTextures.h"
+#include "ConstantRing.h"
+
+struct TextureTangentVertex;
+
 class Renderer
 {
     static const double PanSpeed;
@@ -13,68 +47,394 @@ class Renderer
     static const Point3f Rect1Pos;
 
 public:
-    static const int MaxInst = 100;
+    static const int MaxInst = 100000;
+    static const int MaxClusters = (MaxInst + Bvh::LeafSize - 1) / Bvh::LeafSize;
+    static const int MaxHiZMips = 15;
+    static const UINT GeomUploadRingSize = 4 * 1024 * 1024;
+    static const UINT InstanceMeshCount = 3; // Should match instance mesh ids and GroupAppend.h
+    static const UINT MaxLods = 4;
+    static const UINT ImpostorLod = MaxLods - 1; // Last draw of each mesh is its impostor, mesh LODs go before it
+    static const UINT InstanceDrawCount = InstanceMeshCount * MaxLods; // Draw per mesh LOD, LODs of mesh are consecutive
+    static const UINT ImpostorFrames = 8; // Octahedral grid of bake directions, should match Impostor.h
+    static const UINT ImpostorFrameSize = 64; // Texels of each frame
+    static const UINT StatsReadbackSize = 2 * InstanceDrawCount * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS); // Early and late draw arguments
+    static const UINT GeomMergeGap = 4; // Unchanged instances allowed between merged dirty ranges
+    static const UINT ScatterCapacity = 16384; // Changed elements per scatter dispatch
+    static const UINT InstanceJobChunk = 4096; // Minimal instances per animation or packing job
+    static const UINT MaxSimulationTicks = 8; // Per frame, time beyond that is dropped so slow frames do not pile up ticks
+    static const UINT BackBufferCount = 2;
+    static const UINT MaxLights = 1024;
+    static const UINT DefaultUIRefreshRate = 30;
+    static const UINT SettleFrames = GpuProfiler::FrameCount + 2; // Rendered after a change in on demand mode, so readbacks catch up
+    // Light cluster grid, should match LightCluster.h
+    static const UINT ClusterGridX = 16;
+    static const UINT ClusterGridY = 9;
+    static const UINT ClusterGridZ = 24;
+    static const UINT ClusterCount = ClusterGridX * ClusterGridY * ClusterGridZ;
+    static const UINT MaxLightsPerCluster = 127;
+    static const UINT GBufferCount = 2; // Albedo, normal with shininess
+    static const UINT MaxSortKeys = 131072; // Power of two not less than MaxInst, for bitonic sort
+    static const UINT SortLocalSize = 1024; // Keys sorted in group shared memory, should match BitonicSort.cs
+    static const UINT RectCount = 2; // Transparent rect instances, sorted back to front on GPU without OIT
+    static const UINT CascadeCount = 4; // Sun shadow cascades, should match Shadow.h
+    static const UINT CascadeSize = 1024; // Texels of cascade square, cascades are side by side in shadow atlas
+    static const UINT MaxViews = 8; // Views of single pass multi-view rendering, should match MultiView.h
+    static const UINT MaxParticles = 1 << 20; // Particle pool, power of two so all of it fits the sort
+    static const UINT NoPick = 0xFFFFFFFF; // No instance under cursor
+
+    // Passes recordable on deferred contexts, in submission order
+    enum Pass
+    {
+        PassCubes = 0,
+        PassSmallSpheres,
+        PassSphere,
+        PassRects,
+
+        PassCount
+    };
+    // Heatmaps replacing or blended over the scene
+    enum DebugView
+    {
+        DebugViewNone = 0,
+        DebugViewOverdraw,   // Fragments passing depth test per pixel, of one pass or all of them
+        DebugViewLightCount, // Lights of the cluster per pixel, iterations of lighting loop
+
+        DebugViewCount
+    };
+    // Draw groups skipped on GPU when their bounding box is hidden by opaque depth, should match ProxyBox.vs
+    enum PredicateGroup
+    {
+        PredicateRects = 0,
+        PredicateBulbs,
+
+        PredicateGroupCount
+    };
+    // Precomputed transforms of visible instances, one set per list of visible ids drawn with indirect arguments
+    enum TransformSet
+    {
+        TransformSetVisible = 0,
+        TransformSetLate, // Instances visible only after occlusion retest
+
+        TransformSetCount,
+        TransformSetNone = TransformSetCount // Model is fetched through visible ids in vertex shader
+    };
+    // Toggles compiled into shader variants instead of branching on constants, bit index matches define in Renderer.cpp
+    enum ShaderVariantFlag
+    {
+        VariantNormalMaps = 1,
+        VariantShowNormals = 2,
+        VariantHalfPrecision = 4, // Shading in min16float
+        VariantVirtualTextures = 8, // Materials sample tiled arrays and write feedback
+        VariantMotionVectors = 16, // Motion vectors are written to an extra target for temporal upscaling
+
+        ShaderVariantCount = 32 // Combinations of all flags
+    };
+    // Half precision is checked by diff of two still frames, FP32 reference first
+    enum PrecisionCompare
+    {
+        PrecisionCompareIdle = 0,
+        PrecisionCompareReference,
+        PrecisionCompareHalf
+    };
+    // Global texture filtering, lower qualities save texture bandwidth on low end GPUs
+    enum FilterQuality
+    {
+        FilterQualityLow = 0,
+        FilterQualityMedium,
+        FilterQualityHigh,
+
+        FilterQualityCount
+    };
+    // Scene color buffer, float one keeps lighting above 1 for tone mapping of post processing
+    enum ColorFormat
+    {
+        ColorFormatRGBA8 = 0,
+        ColorFormatR11G11B10, // Same 32 bits per pixel, without alpha
+
+        ColorFormatCount
+    };
+    // Scene depth buffer, smaller ones save depth test bandwidth at the cost of precision
+    enum DepthFormat
+    {
+        DepthFormatD32 = 0,
+        DepthFormatD24, // Stencil bits are unused
+        DepthFormatD16,
+
+        DepthFormatCount
+    };
+    // Optional features whose resources are created on first use and released after staying unused for a while
+    enum LazyFeature
+    {
+        LazyFeatureClusterCull = 0, // Hierarchical culling on GPU
+        LazyFeatureImpostors,
+        LazyFeatureParticles,
+        LazyFeatureOit,
+        LazyFeatureTemporal,
+        LazyFeatureLowResTrans,
+
+        LazyFeatureCount
+    };
+    // Transparent rects and particles are blended into a target of reduced size and upsampled over the scene
+    enum TransResolution
+    {
+        TransResolutionFull = 0,
+        TransResolutionHalf,
+        TransResolutionQuarter,
+
+        TransResolutionCount
+    };
+    static const UINT PrecisionDiffThreshold = 2; // In 1/255 steps, pixels off by more are counted, should match ImageDiff.cs
+    static const UINT MaxFrameLatency = 1; // Frames queued ahead with flip model swap chain
+    static const UINT TargetSizeStep = 256; // Scene targets grow by it, so most window resizes only crop the viewport
+    static const UINT TargetShrinkRatio = 2; // Scene targets are reallocated if their area is this much larger than needed
+    static const UINT ResizeSettleMs = 200; // Resize during window drag is applied once size stays the same for this time
+    static const UINT RecordFps = 60; // Nominal rate of recorded video, frames are time stamped with actual time
+    static const UINT FeatureReleaseFrames = 600; // Default frames an unused feature keeps its resources
+    static const UINT RecordBitrate = 20000000;
 
 public:
     Renderer()
         : m_pDevice(nullptr)
         , m_pDeviceContext(nullptr)
+        , m_pDeviceContext1(nullptr)
+        , m_featureLevel(D3D_FEATURE_LEVEL_11_0)
+        , m_constantOffsets(false)
+        , m_adapterIndex(-1)
         , m_pSwapChain(nullptr)
+        , m_flipModel(true)
+        , m_featureReleaseFrames(FeatureReleaseFrames)
+        , m_textureSkipMips(0)
+        , m_virtualTexturesSupported(false)
+        , m_virtualTexturing(false)
+        , m_packedVertices(true)
+        , m_rawInput(false)
+#ifdef _DEBUG
+        , m_shaderOptimization(ShaderCache::OptimizationDebug)
+#else
+        , m_shaderOptimization(ShaderCache::OptimizationRelease)
+#endif // _DEBUG
+        , m_allowTearing(false)
+        , m_vsync(false)
+        , m_swapChainFlags(0)
+        , m_frameLatencyWaitable(nullptr)
+        , m_useDeferredContexts(false)
+        , m_deferredShading(false)
+        , m_stateCallsIssued(0)
+        , m_stateCallsSkipped(0)
         , m_pBackBufferRTV(nullptr)
+        , m_pBackBufferUAV(nullptr)
+        , m_pBackBufferSRV(nullptr)
         , m_pDepthBuffer(nullptr)
         , m_pDepthBufferDSV(nullptr)
+        , m_pDepthBufferSRV(nullptr)
         , m_pDepthState(nullptr)
         , m_pTransDepthState(nullptr)
+        , m_pSkyDepthState(nullptr)
+        , m_pDepthEqualState(nullptr)
+        , m_depthPrePass(false)
+        , m_weightedOit(true)
         , m_width(16)
         , m_height(16)
+        , m_pendingWidth(16)
+        , m_pendingHeight(16)
+        , m_resizePending(false)
+        , m_sizeMove(false)
+        , m_resizeUSec(0)
+        , m_targetWidth(0)
+        , m_targetHeight(0)
+        , m_fixedResolution(false)
+        , m_internalWidth(1280)
+        , m_internalHeight(720)
+        , m_swapChainResizes(0)
+        , m_targetReallocs(0)
         , m_pGeomBufferInst(nullptr)
+        , m_pGeomBufferInstSRV(nullptr)
         , m_pGeomBufferInstVis(nullptr)
-        , m_pSceneBuffer(nullptr)
-        , m_pVertexBuffer(nullptr)
-        , m_pIndexBuffer(nullptr)
-        , m_pPixelShader(nullptr)
+        , m_pGeomBufferInstVisSRV(nullptr)
         , m_pVertexShader(nullptr)
+        , m_pMotionVertexShader(nullptr)
         , m_pInputLayout(nullptr)
-        , m_pRectGeomBuffer(nullptr)
-        , m_pRectGeomBuffer2(nullptr)
-        , m_pRectVertexBuffer(nullptr)
-        , m_pRectIndexBuffer(nullptr)
-        , m_pRectPixelShader(nullptr)
         , m_pRectVertexShader(nullptr)
         , m_pRectInputLayout(nullptr)
-        , m_pSphereGeomBuffer(nullptr)
-        , m_pSphereVertexBuffer(nullptr)
-        , m_pSphereIndexBuffer(nullptr)
+        , m_pRectInstBuffer(nullptr)
+        , m_pRectInstBufferSRV(nullptr)
+        , m_pRectBounds(nullptr)
+        , m_pRectBoundsSRV(nullptr)
+        , m_pRectArgs(nullptr)
+        , m_pRectArgsUAV(nullptr)
+        , m_pRectArgsReset(nullptr)
+        , m_pRectIds(nullptr)
+        , m_pRectIdsUAV(nullptr)
+        , m_pRectIdsSRV(nullptr)
+        , m_pRectCullShader(nullptr)
+        , m_pRectOitVertexShader(nullptr)
+        , m_pFullscreenVertexShader(nullptr)
+        , m_pOitCompositePixelShader(nullptr)
+        , m_pOitCompositeMsaaPixelShader(nullptr)
+        , m_pOitBlendState(nullptr)
+        , m_pOitAccum(nullptr)
+        , m_pOitAccumRTV(nullptr)
+        , m_pOitAccumSRV(nullptr)
+        , m_pOitRevealage(nullptr)
+        , m_pOitRevealageRTV(nullptr)
+        , m_pOitRevealageSRV(nullptr)
+        , m_oitWidth(0)
+        , m_oitHeight(0)
+        , m_oitSamples(0)
+        , m_transResolution(TransResolutionFull)
+        , m_pLowResDepthPixelShader(nullptr)
+        , m_pLowResCompositePixelShader(nullptr)
+        , m_pDepthCopyState(nullptr)
+        , m_pLowResTransBlendState(nullptr)
+        , m_pLowResCompositeBlendState(nullptr)
+        , m_pLowResTransColor(nullptr)
+        , m_pLowResTransColorRTV(nullptr)
+        , m_pLowResTransColorSRV(nullptr)
+        , m_pLowResTransDepth(nullptr)
+        , m_pLowResTransDepthDSV(nullptr)
+        , m_pLowResTransDepthSRV(nullptr)
+        , m_lowResTransWidth(0)
+        , m_lowResTransHeight(0)
+        , m_pRectTexture(nullptr)
+        , m_pRectTextureSRV(nullptr)
+        , m_occlusionPredicates(true)
+        , m_pProxyBoxVertexShader(nullptr)
+        , m_pNoColorBlendState(nullptr)
+        , m_particles(false)
+        , m_sortParticles(true)
+        , m_particleCount(262144)
+        , m_particleLifetime(4.0f)
+        , m_particleEmitter{ 0.0f, 1.0f, 0.0f }
+        , m_particleEmitAccum(0.0)
+        , m_particleSeed(0)
+        , m_particleAliveIdx(0)
+        , m_particleEmitCount(0)
+        , m_particleKeyCount(0)
+        , m_particlesReset(false)
+        , m_pParticleResetShader(nullptr)
+        , m_pParticleEmitShader(nullptr)
+        , m_pParticleSimulateShader(nullptr)
+        , m_pParticleVertexShader(nullptr)
+        , m_pParticlePixelShader(nullptr)
+        , m_pParticles(nullptr)
+        , m_pParticlesSRV(nullptr)
+        , m_pParticlesUAV(nullptr)
+        , m_pParticleDead(nullptr)
+        , m_pParticleDeadUAV(nullptr)
+        , m_pParticleKeys(nullptr)
+        , m_pParticleKeysSRV(nullptr)
+        , m_pParticleKeysUAV(nullptr)
+        , m_pParticleListCounts(nullptr)
+        , m_pParticleCounts(nullptr)
+        , m_pParticleCountsUAV(nullptr)
+        , m_pParticleSimArgs(nullptr)
+        , m_pParticleSimArgsUAV(nullptr)
+        , m_pParticleDrawArgs(nullptr)
+        , m_pParticleDrawArgsUAV(nullptr)
+        , m_pParticleDrawCountUAV(nullptr)
+        , m_pickMode(false)
+        , m_pPickPixelShader(nullptr)
+        , m_pPickRasterizerState(nullptr)
+        , m_pPickResult(nullptr)
+        , m_pPickResultUAV(nullptr)
+        , m_pickedIdx(NoPick)
+        , m_debugView(DebugViewNone)
+        , m_overdrawPass(PassCount)
+        , m_pOverdrawPixelShader(nullptr)
+        , m_pOverdrawHeatmapPixelShader(nullptr)
+        , m_pLightHeatmapPixelShader(nullptr)
+        , m_pLightHeatmapMsaaPixelShader(nullptr)
+        , m_pOverdraw(nullptr)
+        , m_pOverdrawSRV(nullptr)
+        , m_pOverdrawUAV(nullptr)
+        , m_overdrawWidth(0)
+        , m_overdrawHeight(0)
         , m_pSpherePixelShader(nullptr)
         , m_pSphereVertexShader(nullptr)
+        , m_pSkyTriangleVertexShader(nullptr)
+        , m_skyTriangle(false)
+        , m_pSkyArgs(nullptr)
+        , m_pSkyArgsUAV(nullptr)
         , m_pSphereInputLayout(nullptr)
-        , m_sphereIndexCount(0)
-        , m_pSmallSphereVertexBuffer(nullptr)
-        , m_pSmallSphereIndexBuffer(nullptr)
+        , m_pBulbArgs(nullptr)
         , m_pSmallSpherePixelShader(nullptr)
         , m_pSmallSphereVertexShader(nullptr)
         , m_pSmallSphereInputLayout(nullptr)
-        , m_smallSphereIndexCount(0)
+        , m_bulbImpostors(true)
+        , m_pBulbImpostorArgs(nullptr)
+        , m_pBulbImpostorPixelShader(nullptr)
+        , m_pBulbImpostorVertexShader(nullptr)
         , m_pCubemapTexture(nullptr)
         , m_pCubemapView(nullptr)
+        , m_skyAmbient(true)
+        , m_skyAmbientIntensity(1.0f)
+        , m_updateSkyAmbient(true)
+        , m_pSkyAmbientSource(nullptr)
+        , m_pSkyAmbientShader(nullptr)
+        , m_pSkyAmbientParams(nullptr)
+        , m_pSkyAmbientCoeffs(nullptr)
+        , m_pSkyAmbientCoeffsUAV(nullptr)
+        , m_pAmbientCB(nullptr)
         , m_pRasterizerState(nullptr)
         , m_pTransBlendState(nullptr)
         , m_pOpaqueBlendState(nullptr)
         , m_pColorBuffer(nullptr)
         , m_pColorBufferRTV(nullptr)
         , m_pColorBufferSRV(nullptr)
-        , m_pSepiaPixelShader(nullptr)
-        , m_pSepiaVertexShader(nullptr)
+        , m_pColorBufferUAV(nullptr)
+        , m_colorFormat(ColorFormatRGBA8)
+        , m_colorBufferFormat(ColorFormatRGBA8)
+        , m_colorFormatSupportMask(1)
+        , m_depthFormat(DepthFormatD32)
+        , m_depthBufferFormat(DepthFormatD32)
+        , m_depthFormatSupportMask(1)
+        , m_msaaSamples(1)
+        , m_msaaBufferSamples(1)
+        , m_msaaSupportMask(1)
+        , m_pMsaaColorBuffer(nullptr)
+        , m_pMsaaColorBufferRTV(nullptr)
+        , m_pMsaaDepthBuffer(nullptr)
+        , m_pMsaaDepthBufferDSV(nullptr)
+        , m_pMsaaDepthBufferSRV(nullptr)
+        , m_dynamicResolution(false)
+        , m_targetGpuMs(16.0f)
+        , m_resolutionScale(1.0f)
+        , m_resolutionFrame(0)
+        , m_temporalUpscale(false)
+        , m_pMotionBuffer(nullptr)
+        , m_pMotionBufferRTV(nullptr)
+        , m_pMotionBufferSRV(nullptr)
+        , m_motionWidth(0)
+        , m_motionHeight(0)
+        , m_historyWidth(0)
+        , m_historyHeight(0)
+        , m_historyIdx(0)
+        , m_historyValid(false)
+        , m_jitterIdx(0)
+        , m_prevVp(DirectX::XMMatrixIdentity())
+        , m_temporalReproject(DirectX::XMMatrixIdentity())
+        , m_motionDeltaSec(0.0f)
+        , m_pResolveParams(nullptr)
         , m_prevUSec(0)
+        , m_fixedDeltaSec(0.0)
+        , m_showUI(true)
+        , m_uiDirty(true)
+        , m_uiRefreshRate(DefaultUIRefreshRate)
+        , m_uiBuildUSec(0)
+        , m_renderOnDemand(false)
+        , m_pendingFrames(SettleFrames)
+        , m_uploadedLightCount(-1)
+        , m_lightUploads(0)
+        , m_sceneFileMs(0.0f)
         , m_rbPressed(false)
         , m_prevMouseX(0)
         , m_prevMouseY(0)
+        , m_mouseX(-1)
+        , m_mouseY(-1)
         , m_rotateModel(true)
         , m_angle(0.0)
-        , m_pTexture(nullptr)
-        , m_pTextureView(nullptr)
-        , m_pTextureNM(nullptr)
-        , m_pTextureViewNM(nullptr)
+        , m_filterQuality(FilterQualityHigh)
+        , m_samplerFilterQuality(FilterQualityCount)
         , m_pSampler(nullptr)
         , m_forwardDelta(0.0)
         , m_rightDelta(0.0)
@@ -82,31 +442,282 @@ public:
         , m_useNormalMaps(true)
         , m_showNormals(false)
         , m_doCull(true)
-        , m_useSepia(false)
-        , m_geomBuffers(MaxInst)
-        , m_geomBBs(MaxInst)
+        , m_infiniteFar(true)
+        , m_instances(MaxInst)
+        , m_scatterUploads(true)
         , m_instCount(2)
         , m_visibleInstances(0)
+        , m_importedMesh(false)
+        , m_impostors(true)
+        , m_pImpostorNormals(nullptr)
+        , m_pImpostorNormalsSRV(nullptr)
+        , m_pImpostorUVs(nullptr)
+        , m_pImpostorUVsSRV(nullptr)
+        , m_pImpostorVertexShader(nullptr)
+        , m_pImpostorInputLayout(nullptr)
+        , m_meshletCount(0)
+        , m_meshletModel(true)
+        , m_meshletCull(true)
+        , m_meshletConeCull(true)
+        , m_pMeshlets(nullptr)
+        , m_pMeshletsSRV(nullptr)
+        , m_pMeshletIndices(nullptr)
+        , m_pMeshletIndicesUAV(nullptr)
+        , m_pMeshletArgs(nullptr)
+        , m_pMeshletArgsUAV(nullptr)
+        , m_pMeshletArgsCountUAV(nullptr)
+        , m_pMeshletGeom(nullptr)
+        , m_pMeshletGeomSRV(nullptr)
+        , m_pMeshletIds(nullptr)
+        , m_pMeshletIdsSRV(nullptr)
+        , m_pMeshletParams(nullptr)
+        , m_pMeshletCullShader(nullptr)
+        , m_meshletTriangles(0)
+        , m_halfPrecision(false)
+        , m_nativeHalfPrecision(false)
+        , m_precisionCompare(PrecisionCompareIdle)
+        , m_diffWidth(0)
+        , m_diffHeight(0)
+        , m_pDiffResult(nullptr)
+        , m_pDiffResultUAV(nullptr)
+        , m_pImageDiffShader(nullptr)
+        , m_diffValid(false)
+        , m_diffMax(0)
+        , m_diffMean(0.0f)
+        , m_diffPixels(0)
+        , m_captureSource(CaptureSourceBackBuffer)
+        , m_captureEveryFrame(false)
+        , m_captureIndex(0)
+        , m_recordCodec(VideoRecorder::CodecH264)
+        , m_recordOverlay(false)
+        , m_recordIndex(0)
+        , m_captureCommands(false)
+        , m_replayCount(0)
+        , m_replayCpuMs(0.0f)
+        , m_replayWallMs(0.0f)
+        , m_abSettings{ { AbCompare::ToggleCull, AbCompare::ToggleCull | AbCompare::ToggleGpuCull }, 60, 8, 8 }
+        , m_abSavedToggles(0)
+        , m_abSavedDeltaSec(0.0)
+        , m_pInstanceIndices(nullptr)
+        , m_sphereMesh(0)
+        , m_smallSphereMesh(0)
+        , m_rectMesh(0)
         , m_computeCull(false)
         , m_pCullShader(nullptr)
-        , m_pIndirectArgsSrc(nullptr)
+        , m_pCullAtomicShader(nullptr)
+        , m_groupAppend(true)
         , m_pIndirectArgs(nullptr)
+        , m_pMeshArgsReset(nullptr)
         , m_pCullParams(nullptr)
+        , m_pShadowCullParams(nullptr)
+        , m_pInstBounds(nullptr)
+        , m_pInstBoundsSRV(nullptr)
+        , m_pInstBoundsUAV(nullptr)
         , m_pGeomBufferInstVisGPU(nullptr)
         , m_pGeomBufferInstVisGPU_UAV(nullptr)
+        , m_pGeomBufferInstVisGPU_SRV(nullptr)
         , m_pIndirectArgsUAV(nullptr)
+        , m_instanceTransforms(true)
+        , m_pInstanceTransformsShader(nullptr)
+        , m_pTransformVertexShader(nullptr)
         , m_updateCullParams(false)
-        , m_curFrame(0)
-        , m_lastCompletedFrame(0)
         , m_gpuVisibleInstances(0)
+        , m_hierarchicalCull(true)
+        , m_occlusionCull(false)
+        , m_sortInstances(false)
+        , m_cullIds(MaxInst)
+        , m_sortedIds(MaxInst)
+        , m_pSortKeys(nullptr)
+        , m_pSortKeysUAV(nullptr)
+        , m_pSortParams(nullptr)
+        , m_pSortKeysShader(nullptr)
+        , m_pSortLocalShader(nullptr)
+        , m_pSortGlobalShader(nullptr)
+        , m_pSortWriteShader(nullptr)
+        , m_pSortWriteArgs(nullptr)
+        , m_pSortWriteArgsUAV(nullptr)
+        , m_pHiZ(nullptr)
+        , m_pHiZSRV(nullptr)
+        , m_hiZMips(0)
+        , m_hiZWidth(0)
+        , m_hiZHeight(0)
+        , m_hiZVP(DirectX::XMMatrixIdentity())
+        , m_pHiZShader(nullptr)
+        , m_pHiZMsaaShader(nullptr)
+        , m_pHiZParams(nullptr)
+        , m_pOcclusionCullShader(nullptr)
+        , m_pOccludedIds(nullptr)
+        , m_pOccludedIdsUAV(nullptr)
+        , m_pOccludedCount(nullptr)
+        , m_pOccludedCountUAV(nullptr)
+        , m_pLateIds(nullptr)
+        , m_pLateIdsSRV(nullptr)
+        , m_pLateIdsUAV(nullptr)
+        , m_pLateArgs(nullptr)
+        , m_pLateArgsUAV(nullptr)
+        , m_pOccludedArgs(nullptr)
+        , m_pOccludedArgsUAV(nullptr)
+        , m_pLightBuffer(nullptr)
+        , m_pLightBufferSRV(nullptr)
+        , m_pVisibleLights(nullptr)
+        , m_pVisibleLightsSRV(nullptr)
+        , m_pVisibleLightsUAV(nullptr)
+        , m_pVisibleLightCount(nullptr)
+        , m_pVisibleLightCountSRV(nullptr)
+        , m_pVisibleLightCountUAV(nullptr)
+        , m_pLightListShader(nullptr)
+        , m_pVisibleBulbs(nullptr)
+        , m_pVisibleBulbsSRV(nullptr)
+        , m_pVisibleBulbsUAV(nullptr)
+        , m_pVisibleBulbCount(nullptr)
+        , m_pVisibleBulbCountUAV(nullptr)
+        , m_pBulbCullShader(nullptr)
+        , m_pClusterLights(nullptr)
+        , m_pClusterLightsSRV(nullptr)
+        , m_pClusterLightsUAV(nullptr)
+        , m_pLightCullShader(nullptr)
+        , m_pLightCullParams(nullptr)
+        , m_sunShadows(true)
+        , m_shadowDistance(20.0f)
+        , m_cascadeRangesUsed(false)
+        , m_pShadowAtlas(nullptr)
+        , m_pShadowAtlasDSV(nullptr)
+        , m_pShadowAtlasSRV(nullptr)
+        , m_pShadowSampler(nullptr)
+        , m_pShadowRasterizerState(nullptr)
+        , m_pNoOcclusionParams(nullptr)
+        , m_multiViewSupported(false)
+        , m_multiViewShadows(true)
+        , m_pMultiViewCullShader(nullptr)
+        , m_pMultiViewVertexShader(nullptr)
+        , m_pMultiViewArgs(nullptr)
+        , m_pMultiViewArgsUAV(nullptr)
+        , m_pMultiViewArgsReset(nullptr)
+        , m_pMultiViewIds(nullptr)
+        , m_pMultiViewIdsSRV(nullptr)
+        , m_pMultiViewIdsUAV(nullptr)
+        , m_pClusterCullShader(nullptr)
+        , m_pClusteredCullShader(nullptr)
+        , m_pClusteredCullAtomicShader(nullptr)
+        , m_pClusters(nullptr)
+        , m_pClustersSRV(nullptr)
+        , m_pInstOrder(nullptr)
+        , m_pInstOrderSRV(nullptr)
+        , m_pVisibleClusters(nullptr)
+        , m_pVisibleClustersSRV(nullptr)
+        , m_pVisibleClustersUAV(nullptr)
+        , m_pClusterArgs(nullptr)
+        , m_pClusterArgsUAV(nullptr)
+        , m_pClusterArgsCountUAV(nullptr)
+        , m_pDispatchArgsShader(nullptr)
+        , m_pDispatchArgsStructuredShader(nullptr)
+        , m_pDispatchArgsParams(nullptr)
+        , m_simdCull(true)
+        , m_parallelCull(true)
+        , m_orientedBounds(true)
+        , m_reuseVisibility(true)
+        , m_cullStateValid(false)
+        , m_visibilityReused(false)
+        , m_cullState()
+        , m_computeAnimation(false)
+        , m_animationDeltaSec(0.0f)
+        , m_simulationHz(60)
+        , m_simulationAccumSec(0.0)
+        , m_interpolationSec(0.0f)
+        , m_simulationTicks(0)
+        , m_instancesMoved(false)
+        , m_pAnimateShader(nullptr)
+        , m_pAnimateParams(nullptr)
+        , m_pGeomBufferInstUAV(nullptr)
     {
-        for (int i = 0; i < 10; i++)
+        for (int i = 0; i < PassCount; i++)
         {
-            m_pSmallSphereGeomBuffers[i] = nullptr;
+            m_pDeferredContexts[i] = nullptr;
+            m_pCommandLists[i] = nullptr;
         }
-        for (int i = 0; i < 10; i++)
+        for (UINT i = 0; i < GBufferCount; i++)
         {
-            m_queries[i] = nullptr;
+            m_pGBuffers[i] = nullptr;
+            m_pGBufferRTVs[i] = nullptr;
+            m_pGBufferSRVs[i] = nullptr;
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            m_cubesGpuMs[i] = 0.0f;
+            m_cullGpuMs[i] = 0.0f;
+        }
+        for (UINT i = 0; i < TransformSetCount; i++)
+        {
+            m_pInstanceTransforms[i] = nullptr;
+            m_pInstanceTransformsUAV[i] = nullptr;
+            m_pInstanceTransformsSRV[i] = nullptr;
+            m_pDrawBases[i] = nullptr;
+            m_pDrawBasesUAV[i] = nullptr;
+            m_pDrawBasesSRV[i] = nullptr;
+        }
+        for (int i = 0; i < MaxHiZMips; i++)
+        {
+            m_pHiZMipSRVs[i] = nullptr;
+            m_pHiZMipUAVs[i] = nullptr;
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            m_pOcclusionParams[i] = nullptr;
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            m_pDiffTextures[i] = nullptr;
+            m_pDiffSRVs[i] = nullptr;
+            m_pHistory[i] = nullptr;
+            m_pHistorySRV[i] = nullptr;
+            m_pHistoryUAV[i] = nullptr;
+            m_jitter[i] = 0.0f;
+        }
+        for (UINT i = 0; i < MaterialTable::FilterCount; i++)
+        {
+            m_pMaterialSamplers[i] = nullptr;
+        }
+        for (UINT i = 0; i < ShaderVariantCount; i++)
+        {
+            m_pPixelShaders[i] = nullptr;
+            m_pRectPixelShaders[i] = nullptr;
+            m_pRectOitPixelShaders[i] = nullptr;
+            m_pGBufferPixelShaders[i] = nullptr;
+            m_pImpostorPixelShaders[i] = nullptr;
+            m_pImpostorGBufferPixelShaders[i] = nullptr;
+            m_pResolveShaders[i] = nullptr;
+        }
+        for (UINT i = 0; i < InstanceDrawCount; i++)
+        {
+            m_instanceMeshes[i] = 0;
+            m_visibleCounts[i] = 0;
+        }
+        for (UINT i = 0; i < InstanceMeshCount; i++)
+        {
+            m_lodCounts[i] = 1;
+        }
+        for (UINT i = 0; i < CascadeCount; i++)
+        {
+            m_pShadowArgs[i] = nullptr;
+            m_pShadowArgsUAV[i] = nullptr;
+            m_pShadowIds[i] = nullptr;
+            m_pShadowIdsSRV[i] = nullptr;
+            m_pShadowIdsUAV[i] = nullptr;
+        }
+        for (UINT i = 0; i < PredicateGroupCount; i++)
+        {
+            m_pPredicates[i] = nullptr;
+            m_predicateTested[i] = false;
+        }
+        for (UINT i = 0; i < LazyFeatureCount; i++)
+        {
+            m_featureIdleFrames[i] = 0;
+        }
+        for (UINT i = 0; i < 2; i++)
+        {
+            m_pParticleAlive[i] = nullptr;
+            m_pParticleAliveSRV[i] = nullptr;
+            m_pParticleAliveUAV[i] = nullptr;
         }
     }
 
@@ -115,7 +726,8 @@ public:
 
     bool Update();
     bool Render();
-    bool Resize(UINT width, UINT height);
+    void Resize(UINT width, UINT height);
+    void SetSizeMove(bool sizeMove);
 
     void MouseRBPressed(bool pressed, int x, int y);
     void MouseMoved(int x, int y);
@@ -123,6 +735,60 @@ public:
     void KeyPressed(int keyCode);
     void KeyReleased(int keyCode);
 
+    /** Adapter index in EnumAdapters order, negative selects high performance adapter, should be set before Init */
+    void SetAdapterIndex(int adapterIndex) { m_adapterIndex = adapterIndex; }
+    /** Use flip model swap chain if supported, should be set before Init */
+    void SetFlipModel(bool flipModel) { m_flipModel = flipModel; }
+    /** Shader optimization policy, should be set before Init, can be changed at runtime from UI */
+    void SetShaderOptimization(ShaderCache::Optimization optimization) { m_shaderOptimization = optimization; }
+    /** Most detailed texture mips to drop, trades quality for memory, should be set before Init */
+    void SetTextureSkipMips(UINT skipMips) { m_textureSkipMips = skipMips; }
+    /** Sample material textures from tiled arrays, which map only tiles in view. Streamed arrays are used if tiled resources are not supported */
+    void SetVirtualTexturing(bool virtualTexturing) { m_virtualTexturing = virtualTexturing; }
+    /** Use 16 byte vertices with half positions and octahedral normals for instanced meshes, should be set before Init */
+    void SetPackedVertices(bool packedVertices) { m_packedVertices = packedVertices; }
+    /** OBJ mesh drawn as one of the instanced meshes, cooked to mesh cache on first use, should be set before Init */
+    void SetMeshPath(const std::wstring& path) { m_meshPath = path; }
+    /** Camera rotation from raw mouse motion, should be set before Init */
+    void SetRawInput(bool rawInput) { m_rawInput = rawInput; }
+    RawMouse& GetRawMouse() { return m_rawMouse; }
+
+    /** Replace instances and materials with the ones of binary scene file */
+    bool LoadScene(const std::wstring& path);
+    /** Write instances, materials and mesh references to binary scene file */
+    bool SaveScene(const std::wstring& path);
+
+    // Benchmark control
+    void ResetInstances(UINT count, unsigned int seed);
+    void SetCamera(const Point3f& poi, float r, float phi, float theta);
+    /** Replace lights with count random ones, up to MaxLights */
+    void SetLightCount(UINT count, unsigned int seed);
+    /** Scene is rendered at width x height and scaled to window, zero size renders at window size */
+    void SetInternalResolution(UINT width, UINT height) { m_fixedResolution = width > 0 && height > 0; m_internalWidth = m_fixedResolution ? width : m_internalWidth; m_internalHeight = m_fixedResolution ? height : m_internalHeight; }
+    void SetUseNormalMaps(bool use) { m_useNormalMaps = use; }
+    void SetComputeCull(bool computeCull) { m_computeCull = computeCull; }
+    void SetSepia(bool sepia) { m_postSettings.sepia = sepia; }
+    /** Scene targets are recreated on the next frame, unsupported formats fall back to RGBA8 and D32 */
+    void SetColorFormat(ColorFormat format) { m_colorFormat = format; }
+    void SetDepthFormat(DepthFormat format) { m_depthFormat = format; }
+    void SetFixedDeltaSec(double deltaSec) { m_fixedDeltaSec = deltaSec; m_simulationAccumSec = 0.0; } // Simulation restarts from tick boundary, so runs are reproducible
+    /** Hidden UI costs nothing, ImGui frame is neither built nor rendered */
+    void SetShowUI(bool show) { m_showUI = show; m_uiDirty = true; }
+    /** ImGui windows are rebuilt at given rate in Hz (0 - every frame) or on input, previous draw data is rendered in between */
+    void SetUIRefreshRate(UINT rate) { m_uiRefreshRate = rate; }
+    /** Skip frames while nothing on screen changes, main loop sleeps on messages instead */
+    void SetRenderOnDemand(bool onDemand) { m_renderOnDemand = onDemand; m_pendingFrames = SettleFrames; }
+    /** Input or other outside change, the next few frames are rendered in on demand mode */
+    void Invalidate() { m_pendingFrames = SettleFrames; }
+    /** False in on demand mode when there is no input, animation or background work to show */
+    bool IsFrameNeeded();
+    UINT GetVisibleInstances() const { return m_doCull ? (m_computeCull ? (UINT)m_gpuVisibleInstances : m_visibleInstances) : m_instCount; }
+    GpuProfiler& GetGpuProfiler() { return m_gpuProfiler; }
+    FramePacer& GetFramePacer() { return m_framePacer; }
+    FrameCapture& GetFrameCapture() { return m_frameCapture; }
+    /** Image of current frame before UI is written as name, file is ready a few frames later */
+    void RequestCapture(const std::string& name) { m_captureName = name; }
+
 private:
     struct Camera
     {
@@ -136,171 +802,899 @@ private:
 
     struct Light
     {
-        Point4f pos = Point4f{ 0,0,0,0 };
+        Point4f pos = Point4f{ 0,0,0,5 }; // xyz - position, w - radius
         Point4f color = Point4f{ 1,1,1,0 };
     };
 
+    // Rewritten when camera moves
     struct SceneBuffer
     {
         DirectX::XMMATRIX vp;
         Point4f cameraPos;
-        Point4i lightCount; // x - light count (max 10), y - use normal maps, z - show normals, w - do culling
-        Point4i postProcess; // x - use sepia
-        Light lights[10];
-        Point4f ambientColor;
         Point4f frustum[6];
+        DirectX::XMMATRIX invVp; // Clip to world space, for view rays
+        DirectX::XMMATRIX prevVp; // Of the previous frame, without jitter
+        Point4f motionParams; // xy - projection jitter in clip space, z - animation time since the previous frame
     };
 
-    struct AABB
+    // Written on GPU only, should match InstanceTransform.h
+    struct InstanceTransform
     {
-        Point3f vmin = Point3f{
-            std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()
-        };
-        Point3f vmax = Point3f{
-            std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()
-        };
-
-        inline Point3f GetVert(int idx) const
-        {
-            return Point3f
-            {
-                (idx & 1) == 0 ? vmin.x : vmax.x,
-                (idx & 2) == 0 ? vmin.y : vmax.y,
-                (idx & 4) == 0 ? vmin.z : vmax.z
-            };
-        }
+        DirectX::XMMATRIX mvp;
+        Point4f model[3];
+    };
+
+    // Rewritten when camera moves, should match Shadow.h
+    struct ShadowBuffer
+    {
+        DirectX::XMMATRIX cascadeVp[CascadeCount];
+        Point4f cascadeSplits; // View depth where each cascade ends
+        Point4f sunDir; // Direction to the sun
+        Point4f sunColor; // w - 1 if sun is on
+        Point4f shadowParams; // x - shadows on, y - depth bias
+        Point4f cameraDir;
     };
 
-    struct GeomBuffer
+    // Rewritten with the views, should match MultiView.h
+    struct MultiViewBuffer
     {
-        DirectX::XMMATRIX m;
-        DirectX::XMMATRIX normalM;
-        Point4f shineSpeedTexIdNM; // x - shininess, y - rotation speed, z - texture id, w - normal map presence
-        Point4f posAngle; // xyz - position, w - current angle
+        DirectX::XMMATRIX viewVp[MaxViews];
+        Point4f viewFrusta[MaxViews * 6];
+        Point4i viewParams; // x - view count, y - visible ids per mesh LOD segment
+    };
+
+    // Rewritten when predicated groups move, should match ProxyBox.vs
+    struct PredicateBuffer
+    {
+        Point4f boxMin[PredicateGroupCount];
+        Point4f boxMax[PredicateGroupCount];
+    };
+
+    // Rewritten every frame, should match LowResTrans.h
+    struct LowResTransBuffer
+    {
+        Point4i lowResParams; // x - scale, yz - render size in scene pixels
+    };
+
+    // Rewritten every frame particles are on, should match Particle.h
+    struct ParticleParams
+    {
+        Point4f emitter; // xyz - position, w - radius
+        Point4f emitParams; // x - lifetime, y - speed, z - spread of direction, w - delta time
+        Point4f simParams; // x - gravity, y - drag, z - particle size
+        Point4f cameraRight;
+        Point4f cameraUp;
+        Point4i particleCounts; // x - particles to emit, y - random seed, z - sort key count
+    };
+
+    // Rewritten when settings, light count or projection change
+    struct SettingsBuffer
+    {
+        Point4i lightCount; // x - light count, yzw - unused, normal maps and normals view are shader variants
+        Point4f clusterParams; // x - scale, y - bias for cluster slice from log of view depth
+        Point4f ambientColor;
+        Point4f normalDecode; // x - scale, y - bias from normal map texel to [-1, 1]
     };
 
 private:
+    IDXGIAdapter* SelectAdapter(IDXGIFactory* pFactory);
     HRESULT SetupBackBuffer();
+    HRESULT ApplyResize();
+    HRESULT UpdateSceneTargets();
+    HRESULT CreateSceneTargets(UINT width, UINT height);
     HRESULT InitScene();
+    HRESULT InitMaterials();
     HRESULT InitSphere();
     HRESULT InitSmallSphere();
+    HRESULT CreateImpostors();
+    void TermImpostors();
     HRESULT InitRect();
+    HRESULT InitRectTexture();
     HRESULT InitCubemap();
+    HRESULT InitSkyAmbient();
     HRESULT InitPostProcess();
     HRESULT InitCull();
+    HRESULT CreateClusterCull();
+    void TermClusterCull();
+    HRESULT InitAnimation();
+    HRESULT InitOcclusion();
+    HRESULT InitLightClusters();
+    HRESULT InitDeferredShading();
+    HRESULT InitSort();
+    HRESULT InitShadows();
+    HRESULT InitMeshlets();
+    HRESULT InitImageDiff();
+    HRESULT InitPredicates();
+    HRESULT InitParticles();
+    HRESULT InitPicking();
+    HRESULT InitDebugViews();
+    HRESULT CreateOverdrawTarget();
+    HRESULT CreateParticleBuffers();
+    void TermParticleBuffers();
+    HRESULT UpdateSamplers();
+    HRESULT CreateDiffTargets();
+    HRESULT CreateHiZ();
+    HRESULT CreateMsaaTargets();
+    HRESULT CreateOitTargets();
+    void TermOitTargets();
+    HRESULT CreateLowResTransTargets();
+    void TermLowResTransTargets();
+    HRESULT CreateTemporalTargets();
+    void TermTemporalTargets();
+    HRESULT CreateIndirectArgs(const UINT* pArgs, UINT argCount, UINT counterIdx, ID3D11Buffer** ppBuffer, ID3D11UnorderedAccessView** ppUAV, ID3D11UnorderedAccessView** ppCounterUAV, const std::string& name);
 
-    void UpdateCubes(double deltaSec);
+    /** Returns task which animates and packs instances, UploadCubes should be called after it */
+    void RotateCamera(int dx, int dy);
+    JobSystem::TaskHandle UpdateCubes(double deltaSec);
+    void UploadCubes();
+    void BuildCullStructures();
+    void SetInstanceCount(UINT count);
+    /** Remove any instance, the last one is moved into its place */
+    void RemoveInstance(InstanceStore::Handle handle);
 
-    void InitGeom(GeomBuffer& geomBuffer, AABB& bb);
+    void InitGeom(UINT idx);
+    template <typename Index>
+    UINT AddInstancedMesh(const TextureTangentVertex* pVertices, UINT vertexCount, const Index* pIndices, UINT indexCount, bool optimize = true);
+    UINT SelectLod(const AABB& bb, UINT mesh) const;
+    void FillInstanceDrawArgs(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS* pArgs, UINT segmentSize) const;
+    void MarkGeomDirty(UINT first, UINT count);
+    void MarkBoundsDirty(UINT first, UINT count);
+    void UploadBounds();
 
     void TermScene();
 
-    void RenderSphere();
-    void RenderSmallSpheres();
-    void RenderRects();
-    void RenderPostProcess();
-    void ReadQueries();
+    void BindFrameState(StateCache& state);
+    void BindCubeState(StateCache& state, ID3D11ShaderResourceView* pIdsSRV, TransformSet transforms = TransformSetNone);
+    void RecordPass(UINT pass, StateCache& state);
+    void RecordPasses();
+    void SubmitPass(UINT pass);
+
+    void RenderCubes(StateCache& state);
+    void DrawCubes(StateCache& state);
+    void RenderSphere(StateCache& state);
+    void RenderSmallSpheres(StateCache& state);
+    void RenderRects(StateCache& state);
+    void RenderRectsOit(StateCache& state);
+    void BeginLowResTrans(StateCache& state);
+    void EndLowResTrans(StateCache& state);
+    void SetViewport(StateCache& state, UINT width, UINT height);
+    void RenderMeshletModel(StateCache& state);
+    void DrawLateCubes(StateCache& state);
+    /** Impostor quads after cubes of the pass, its state is kept except for shaders, input layout and ids. Null arguments draw CPU visible ones */
+    void DrawImpostors(StateCache& state, ID3D11ShaderResourceView* pIdsSRV, ID3D11Buffer* pArgs, ID3D11PixelShader* pPixelShader);
+    ID3D11PixelShader* GetImpostorPixelShader() const;
+    void PickInstance();
+    bool IsOverdrawCounted(UINT pass) const;
+    /** Feedback binds virtual texture feedback instead, for passes drawn with material shaders */
+    void SetOverdrawCounting(StateCache& state, bool counted, bool feedback = false);
+    void RenderDebugView(StateCache& state);
+    void UpdatePredicates();
+    void BeginPredicatedDraw(StateCache& state, PredicateGroup group);
+    void EndPredicatedDraw(StateCache& state, PredicateGroup group);
+    void UpdateParticleParams(double deltaSec);
+    void UpdateParticles();
+    void RenderParticles(StateCache& state);
+    void ReadGpuStats();
+    void ReplayCommands();
+    void PublishTelemetry();
+    UINT GetAbToggles() const;
+    void SetAbToggles(UINT toggles);
+    void StartAbCompare();
+    void UpdateAbCompare();
+    void EndAbCompare();
+    void UpdateVirtualTextures();
+    void UpdateFeatureResources();
+    void UpdateSkyAmbient();
+    /** Counts frames feature goes unused while its resources exist, true once they should be released */
+    bool IsFeatureReleaseDue(LazyFeature feature, bool used, bool created);
+
+    bool IsUIRebuildNeeded();
+    void BuildUI();
 
-    void CalcFrustum(Point4f frutsum[6]);
     void CullBoxes();
+    void SortVisibleInstances();
+    void SortKeys(UINT keyCount, UINT mesh);
+    void SortTransparent();
+    void UpdateShadowCascades();
+    void CullShadowCasters();
+    void RenderShadows();
+    void CullShadowCastersMultiView();
+    void RenderShadowsMultiView();
+    void AnimateCubes();
+    void BuildHiZ();
+    void CullOccluded();
+    void BuildInstanceTransforms(TransformSet set);
+    void BuildDispatchArgs(ID3D11UnorderedAccessView* pCountsUAV, bool structured, UINT dispatchCount, UINT countStride, UINT countOffset, ID3D11UnorderedAccessView* pArgsUAV);
+    void CullMeshlets();
+    void CullLights();
+    void CullBulbs();
+    void ResolveLighting();
+    void ResolveMsaa();
+    void ComparePrecision();
+    void CaptureFrame();
+    void RecordFrame();
+    void UpdateResolutionScale();
+
+    // MSAA is not used with deferred shading, as G-buffer is single sampled
+    inline bool IsMsaaActive() const { return m_msaaBufferSamples > 1 && !m_deferredShading; }
+    // Variant for current toggles, masked to flags the shader has variants for
+    inline UINT GetShaderVariant(UINT flags) const
+    {
+        return ((m_useNormalMaps ? VariantNormalMaps : 0) | (m_showNormals ? VariantShowNormals : 0) | (IsHalfPrecisionActive() ? VariantHalfPrecision : 0)
+            | (IsVirtualTexturingActive() ? VariantVirtualTextures : 0) | (IsTemporalUpscaleActive() ? VariantMotionVectors : 0)) & flags;
+    }
+    // History is resolved from single sampled color and depth, so MSAA turns it off
+    inline bool IsTemporalUpscaleActive() const { return m_temporalUpscale && !IsMsaaActive(); }
+    // Tiled arrays are created on first use and released when mode is turned off
+    inline bool IsVirtualTexturingActive() const { return m_virtualTexturing && m_virtualTextures.IsInitialized(); }
+    inline bool IsMultiViewShadowsActive() const { return m_multiViewSupported && m_multiViewShadows; }
+    // Precision comparison forces each path for its frame
+    inline bool IsHalfPrecisionActive() const
+    {
+        return m_precisionCompare == PrecisionCompareIdle ? m_halfPrecision : m_precisionCompare == PrecisionCompareHalf;
+    }
+    // Without post processing scene goes to back buffer directly, which is only possible if scene targets are of its size and format
+    inline bool IsPostProcessActive() const
+    {
+        return PostProcess::IsEnabled(m_postSettings) || m_dynamicResolution || m_targetWidth != m_width || m_targetHeight != m_height
+            || m_colorBufferFormat != ColorFormatRGBA8 || IsTemporalUpscaleActive();
+    }
+    inline ID3D11RenderTargetView* GetSceneRTV() const
+    {
+        return IsMsaaActive() ? m_pMsaaColorBufferRTV : (IsPostProcessActive() ? m_pColorBufferRTV : m_pBackBufferRTV);
+    }
+    inline ID3D11DepthStencilView* GetSceneDSV() const { return IsMsaaActive() ? m_pMsaaDepthBufferDSV : m_pDepthBufferDSV; }
+    // Depth downsample reads single sampled depth buffer
+    inline bool IsLowResTransActive() const { return m_transResolution != TransResolutionFull && !IsMsaaActive() && m_pLowResTransColor != nullptr; }
+    inline UINT GetTransScale() const { return IsLowResTransActive() ? 1u << m_transResolution : 1u; }
+    // Targets and blend state of transparent passes
+    inline ID3D11RenderTargetView* GetTransRTV() const { return IsLowResTransActive() ? m_pLowResTransColorRTV : GetSceneRTV(); }
+    inline ID3D11DepthStencilView* GetTransDSV() const { return IsLowResTransActive() ? m_pLowResTransDepthDSV : GetSceneDSV(); }
+    inline ID3D11BlendState* GetTransBlendState() const { return IsLowResTransActive() ? m_pLowResTransBlendState : m_pTransBlendState; }
+    // Scene size before dynamic resolution, window size or fixed internal resolution
+    inline UINT GetBaseWidth() const { return m_fixedResolution ? m_internalWidth : m_width; }
+    inline UINT GetBaseHeight() const { return m_fixedResolution ? m_internalHeight : m_height; }
+    // Scene viewport size, less than base size with dynamic resolution, scale is at least a half so it is never zero
+    inline UINT GetRenderWidth() const { return m_dynamicResolution ? (UINT)(GetBaseWidth() * m_resolutionScale + 0.5f) : GetBaseWidth(); }
+    inline UINT GetRenderHeight() const { return m_dynamicResolution ? (UINT)(GetBaseHeight() * m_resolutionScale + 0.5f) : GetBaseHeight(); }
+    void AddRandomLights(UINT count);
 
     HRESULT CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines = {}, ID3DBlob** ppCode = nullptr);
+    /** Shader for each combination of given variant flags, indexed by combination, slots of other combinations stay null */
+    HRESULT CompileShaderVariants(const std::wstring& path, ID3D11DeviceChild** ppVariants, UINT flags, const std::vector<std::string>& defines = {});
 
 private:
     ID3D11Device* m_pDevice;
     ID3D11DeviceContext* m_pDeviceContext;
+    ID3D11DeviceContext1* m_pDeviceContext1; // Null on runtimes without D3D11.1
+    D3D_FEATURE_LEVEL m_featureLevel;
+    bool m_constantOffsets; // Per draw constants are bound as ranges of m_constantRing, needs feature level 11.1
+    int m_adapterIndex; // Forced adapter, negative if it is selected by GPU preference and video memory
+    std::string m_adapterName;
 
     IDXGISwapChain* m_pSwapChain;
+    bool m_flipModel;
+    bool m_allowTearing;
+    bool m_vsync;
+    UINT m_swapChainFlags;
+    HANDLE m_frameLatencyWaitable;
+
+    bool m_useDeferredContexts;
+    ID3D11DeviceContext* m_pDeferredContexts[PassCount];
+    ID3D11CommandList* m_pCommandLists[PassCount];
+
+    // Redundant state filtering for pass rendering, one per context
+    StateCache m_immediateState;
+    StateCache m_deferredStates[PassCount];
+    UINT m_stateCallsIssued;
+    UINT m_stateCallsSkipped;
+
     ID3D11RenderTargetView* m_pBackBufferRTV;
+    ID3D11UnorderedAccessView* m_pBackBufferUAV; // Written by last post process or lighting resolve pass
+    ID3D11ShaderResourceView* m_pBackBufferSRV; // Read by video recording
 
     ID3D11Texture2D* m_pDepthBuffer;
     ID3D11DepthStencilView* m_pDepthBufferDSV;
+    ID3D11ShaderResourceView* m_pDepthBufferSRV;
 
+    // Blend, depth stencil and rasterizer states are owned by the cache and shared by description
+    StateObjectCache m_stateObjects;
     ID3D11DepthStencilState* m_pDepthState;
     ID3D11DepthStencilState* m_pTransDepthState;
+    ID3D11DepthStencilState* m_pSkyDepthState; // Far plane only passes where nothing was drawn
+    ID3D11DepthStencilState* m_pDepthEqualState; // Shading after depth pre-pass
+    bool m_depthPrePass;
+    bool m_weightedOit; // Transparent rects are drawn unsorted in one instanced pass
+    float m_cubesGpuMs[2]; // Average cubes pass time, 0 - without depth pre-pass, 1 - with it
 
-    ID3D11Buffer* m_pSceneBuffer;
+    // Constant buffers by update frequency, per draw data is in GeomBuffer constants and instance buffers
+    ConstantBuffer<SceneBuffer> m_sceneCB;
+    ConstantBuffer<SettingsBuffer> m_settingsCB;
 
     // For cubes
     ID3D11Buffer* m_pGeomBufferInst;
+    ID3D11ShaderResourceView* m_pGeomBufferInstSRV;
     ID3D11Buffer* m_pGeomBufferInstVis;
-    ID3D11Buffer* m_pVertexBuffer;
-    ID3D11Buffer* m_pIndexBuffer;
-    ID3D11PixelShader* m_pPixelShader;
+    ID3D11ShaderResourceView* m_pGeomBufferInstVisSRV;
+    ID3D11PixelShader* m_pPixelShaders[ShaderVariantCount];
     ID3D11VertexShader* m_pVertexShader;
+    ID3D11VertexShader* m_pMotionVertexShader; // Also outputs current and previous positions
     ID3D11InputLayout* m_pInputLayout;
-    std::vector<GeomBuffer> m_geomBuffers;
-    std::vector<AABB> m_geomBBs;
+    InstanceStore m_instances;
+    std::vector<BufferRange> m_geomDirtyRanges;
+    std::vector<BufferRange> m_boundsDirtyRanges; // Instances added or reloaded since bounds were last sent
+    UploadRing m_geomUploadRing;
+    // Instances and bounds stay on GPU, changed elements are sent as index and payload records
+    bool m_scatterUploads;
+    ScatterUpload m_geomScatter;
+    ScatterUpload m_boundsScatter;
     UINT m_instCount;
     UINT m_visibleInstances;
 
-    // For sphere
-    ID3D11Buffer* m_pSphereGeomBuffer;
-    ID3D11Buffer* m_pSphereVertexBuffer;
-    ID3D11Buffer* m_pSphereIndexBuffer;
+    // Instanced meshes share vertex format, each LOD is drawn from own segment of MaxInst visible ids
+    enum InstanceMesh
+    {
+        InstanceMeshCube = 0,
+        InstanceMeshSphere,
+        InstanceMeshImported // Cube if no mesh is imported
+    };
+
+    // Static meshes of all passes
+    GeometryPool m_geometryPool;
+    UINT m_instanceMeshes[InstanceDrawCount]; // Pool mesh of each LOD
+    UINT m_lodCounts[InstanceMeshCount];
+    std::wstring m_meshPath;
+    bool m_importedMesh; // Mesh of m_meshPath is loaded
+    std::string m_meshStatus;
+
+    // Octahedral impostors of instanced meshes, array slice per mesh, baked at load. Distant instances are culled into impostor draw
+    bool m_impostors;
+    ID3D11Texture2D* m_pImpostorNormals;
+    ID3D11ShaderResourceView* m_pImpostorNormalsSRV;
+    ID3D11Texture2D* m_pImpostorUVs;
+    ID3D11ShaderResourceView* m_pImpostorUVsSRV;
+    ID3D11VertexShader* m_pImpostorVertexShader;
+    ID3D11InputLayout* m_pImpostorInputLayout;
+    ID3D11PixelShader* m_pImpostorPixelShaders[ShaderVariantCount];
+    ID3D11PixelShader* m_pImpostorGBufferPixelShaders[ShaderVariantCount];
+
+    // Imported mesh also drawn once at large scale, its meshlets are culled on GPU into compacted index buffer
+    std::vector<MeshOptimizer::Meshlet> m_meshlets; // Until InitMeshlets uploads them
+    UINT m_meshletCount;
+    bool m_meshletModel;
+    bool m_meshletCull; // Whole mesh is drawn without it
+    bool m_meshletConeCull;
+    ID3D11Buffer* m_pMeshlets;
+    ID3D11ShaderResourceView* m_pMeshletsSRV;
+    ID3D11Buffer* m_pMeshletIndices; // Indices of visible meshlets, written by compute and read as index buffer
+    ID3D11UnorderedAccessView* m_pMeshletIndicesUAV;
+    ID3D11Buffer* m_pMeshletArgs;
+    ID3D11UnorderedAccessView* m_pMeshletArgsUAV;
+    ID3D11UnorderedAccessView* m_pMeshletArgsCountUAV;
+    ID3D11Buffer* m_pMeshletGeom; // The only instance, model has own transform and instanced mesh shaders draw it
+    ID3D11ShaderResourceView* m_pMeshletGeomSRV;
+    ID3D11Buffer* m_pMeshletIds;
+    ID3D11ShaderResourceView* m_pMeshletIdsSRV;
+    ID3D11Buffer* m_pMeshletParams;
+    ID3D11ComputeShader* m_pMeshletCullShader;
+    GpuReadback m_meshletReadback; // Visible index count
+    UINT m_meshletTriangles; // Visible triangles, a few frames late
+
+    // Half precision shading, on by default where GPU has native 16-bit pixel shader math
+    bool m_halfPrecision;
+    bool m_nativeHalfPrecision;
+    PrecisionCompare m_precisionCompare;
+    ID3D11Texture2D* m_pDiffTextures[2]; // FP32 reference and FP16 frame, copied from back buffer
+    ID3D11ShaderResourceView* m_pDiffSRVs[2];
+    UINT m_diffWidth;
+    UINT m_diffHeight;
+    ID3D11Buffer* m_pDiffResult; // Max difference, sum of differences, pixels over threshold
+    ID3D11UnorderedAccessView* m_pDiffResultUAV;
+    ID3D11ComputeShader* m_pImageDiffShader;
+    GpuReadback m_diffReadback;
+    bool m_diffValid;
+    UINT m_diffMax;
+    float m_diffMean;
+    UINT m_diffPixels;
+    enum CaptureSource
+    {
+        CaptureSourceBackBuffer = 0, // Final image
+        CaptureSourceColorBuffer,    // Before post processing, back buffer if post processing is off or color buffer is float
+
+        CaptureSourceCount
+    };
+    FrameCapture m_frameCapture;
+    CaptureSource m_captureSource;
+    bool m_captureEveryFrame;
+    UINT m_captureIndex;
+    std::string m_captureName; // Requested for current frame
+    VideoRecorder m_videoRecorder;
+    VideoRecorder::Codec m_recordCodec;
+    bool m_recordOverlay; // UI is burned into video
+    UINT m_recordIndex;
+    CommandRecorder m_commandRecorder; // Wraps immediate context for the frame commands are captured in
+    bool m_captureCommands; // Requested for next frame
+    UINT m_replayCount; // Requested before next frame
+    float m_replayCpuMs; // Per replay, submission only
+    float m_replayWallMs; // Per replay, until GPU completes
+    TelemetryExport m_telemetry;
+    AbCompare m_abCompare;
+    AbCompare::Settings m_abSettings; // Edited in UI
+    // Restored when comparison ends
+    UINT m_abSavedToggles;
+    Camera m_abSavedCamera;
+    double m_abSavedDeltaSec;
+    UINT m_visibleCounts[InstanceDrawCount]; // Per LOD visible count of CPU culling
+    ID3D11Buffer* m_pInstanceIndices; // Per instance index into visible ids
+    UINT m_sphereMesh;
+    UINT m_smallSphereMesh;
+    UINT m_rectMesh;
+
+    // For sky, either sphere at infinity or screen triangle with view rays
     ID3D11PixelShader* m_pSpherePixelShader;
     ID3D11VertexShader* m_pSphereVertexShader;
     ID3D11InputLayout* m_pSphereInputLayout;
-    UINT m_sphereIndexCount;
+    ID3D11VertexShader* m_pSkyTriangleVertexShader;
+    bool m_skyTriangle;
+    ID3D11Buffer* m_pSkyArgs; // Screen triangle, then sphere arguments, instance count is 0 if Hi-Z shows no sky pixel
+    ID3D11UnorderedAccessView* m_pSkyArgsUAV;
 
     // For small sphere
-    ID3D11Buffer* m_pSmallSphereGeomBuffers[10];
-    ID3D11Buffer* m_pSmallSphereVertexBuffer;
-    ID3D11Buffer* m_pSmallSphereIndexBuffer;
+    ID3D11Buffer* m_pBulbArgs; // Instance count is copied from visible bulb count
     ID3D11PixelShader* m_pSmallSpherePixelShader;
     ID3D11VertexShader* m_pSmallSphereVertexShader;
     ID3D11InputLayout* m_pSmallSphereInputLayout;
-    UINT m_smallSphereIndexCount;
-
-    // For rect
-    ID3D11Buffer* m_pRectGeomBuffer;
-    ID3D11Buffer* m_pRectGeomBuffer2;
-    ID3D11Buffer* m_pRectVertexBuffer;
-    ID3D11Buffer* m_pRectIndexBuffer;
-    ID3D11PixelShader* m_pRectPixelShader;
+    // Or camera facing quads with ray traced sphere
+    bool m_bulbImpostors;
+    ID3D11Buffer* m_pBulbImpostorArgs; // Non-indexed, instance count is copied the same way
+    ID3D11PixelShader* m_pBulbImpostorPixelShader;
+    ID3D11VertexShader* m_pBulbImpostorVertexShader;
+
+    // For rect, instances are culled and sorted back to front on GPU, then drawn with one indirect draw
+    ID3D11PixelShader* m_pRectPixelShaders[ShaderVariantCount];
     ID3D11VertexShader* m_pRectVertexShader;
     ID3D11InputLayout* m_pRectInputLayout;
+    ID3D11Buffer* m_pRectInstBuffer;
+    ID3D11ShaderResourceView* m_pRectInstBufferSRV;
+    ID3D11Buffer* m_pRectBounds;
+    ID3D11ShaderResourceView* m_pRectBoundsSRV;
+    ID3D11Buffer* m_pRectArgs;
+    ID3D11UnorderedAccessView* m_pRectArgsUAV;
+    ID3D11Buffer* m_pRectArgsReset;
+    ID3D11Buffer* m_pRectIds; // Visible ids, farthest first
+    ID3D11UnorderedAccessView* m_pRectIdsUAV;
+    ID3D11ShaderResourceView* m_pRectIdsSRV;
+    ID3D11ComputeShader* m_pRectCullShader;
+
+    // Weighted blended OIT, accumulation and revealage targets match scene size and sample count
+    ID3D11VertexShader* m_pRectOitVertexShader;
+    ID3D11PixelShader* m_pRectOitPixelShaders[ShaderVariantCount];
+    ID3D11VertexShader* m_pFullscreenVertexShader;
+    ID3D11PixelShader* m_pOitCompositePixelShader;
+    ID3D11PixelShader* m_pOitCompositeMsaaPixelShader;
+    ID3D11BlendState* m_pOitBlendState;
+    ID3D11Texture2D* m_pOitAccum;
+    ID3D11RenderTargetView* m_pOitAccumRTV;
+    ID3D11ShaderResourceView* m_pOitAccumSRV;
+    ID3D11Texture2D* m_pOitRevealage;
+    ID3D11RenderTargetView* m_pOitRevealageRTV;
+    ID3D11ShaderResourceView* m_pOitRevealageSRV;
+    UINT m_oitWidth;
+    UINT m_oitHeight;
+    UINT m_oitSamples;
+
+    // Reduced resolution transparents, depth is tested against farthest scene depth of each block and
+    // result is composited with bilateral upsample. Not used with MSAA, targets are created on first use
+    int m_transResolution;
+    ID3D11PixelShader* m_pLowResDepthPixelShader;
+    ID3D11PixelShader* m_pLowResCompositePixelShader;
+    ID3D11DepthStencilState* m_pDepthCopyState;
+    ID3D11BlendState* m_pLowResTransBlendState; // Trans blend, which also multiplies alpha as transmittance
+    ID3D11BlendState* m_pLowResCompositeBlendState;
+    ID3D11Texture2D* m_pLowResTransColor;
+    ID3D11RenderTargetView* m_pLowResTransColorRTV;
+    ID3D11ShaderResourceView* m_pLowResTransColorSRV;
+    ID3D11Texture2D* m_pLowResTransDepth;
+    ID3D11DepthStencilView* m_pLowResTransDepthDSV;
+    ID3D11ShaderResourceView* m_pLowResTransDepthSRV;
+    UINT m_lowResTransWidth;
+    UINT m_lowResTransHeight;
+    ConstantBuffer<LowResTransBuffer> m_lowResTransCB;
+    ID3D11Texture2D* m_pRectTexture;
+    ID3D11ShaderResourceView* m_pRectTextureSRV;
+    AABB m_rectsBounds; // All rect instances
+
+    // Occlusion predicates, box of a group is depth tested right before the group and the group is skipped
+    // on GPU if no sample of the box passed. Result is never read back, so CPU does not wait for it
+    bool m_occlusionPredicates;
+    ID3D11Predicate* m_pPredicates[PredicateGroupCount];
+    bool m_predicateTested[PredicateGroupCount]; // Box is not empty and camera is outside of it
+    ID3D11VertexShader* m_pProxyBoxVertexShader;
+    ID3D11BlendState* m_pNoColorBlendState; // Box only touches depth test
+    ConstantBuffer<PredicateBuffer> m_predicateCB;
+
+    // GPU particles, pool slots are moved between dead and alive append lists by emission and simulation.
+    // Pool is created on first use, counts stay on GPU and drive indirect dispatch and draw
+    bool m_particles;
+    bool m_sortParticles; // Back to front, for alpha blending
+    int m_particleCount; // Alive in steady state, emission rate is derived from it and lifetime
+    float m_particleLifetime;
+    Point3f m_particleEmitter;
+    double m_particleEmitAccum; // Fraction of particle carried to the next frame
+    UINT m_particleSeed;
+    UINT m_particleAliveIdx; // Alive list simulated this frame, survivors go to the other one
+    UINT m_particleEmitCount;
+    UINT m_particleKeyCount; // Power of two not less than particle count
+    bool m_particlesReset; // Lists are refilled before the next emission
+    ID3D11ComputeShader* m_pParticleResetShader;
+    ID3D11ComputeShader* m_pParticleEmitShader;
+    ID3D11ComputeShader* m_pParticleSimulateShader;
+    ID3D11VertexShader* m_pParticleVertexShader;
+    ID3D11PixelShader* m_pParticlePixelShader;
+    ConstantBuffer<ParticleParams> m_particleCB;
+    ID3D11Buffer* m_pParticles;
+    ID3D11ShaderResourceView* m_pParticlesSRV;
+    ID3D11UnorderedAccessView* m_pParticlesUAV;
+    ID3D11Buffer* m_pParticleDead;
+    ID3D11UnorderedAccessView* m_pParticleDeadUAV;
+    ID3D11Buffer* m_pParticleAlive[2];
+    ID3D11ShaderResourceView* m_pParticleAliveSRV[2];
+    ID3D11UnorderedAccessView* m_pParticleAliveUAV[2];
+    ID3D11Buffer* m_pParticleKeys;
+    ID3D11ShaderResourceView* m_pParticleKeysSRV;
+    ID3D11UnorderedAccessView* m_pParticleKeysUAV;
+    ID3D11Buffer* m_pParticleListCounts; // Constant buffer written by CopyStructureCount
+    ID3D11Buffer* m_pParticleCounts; // Alive count for simulation dispatch arguments
+    ID3D11UnorderedAccessView* m_pParticleCountsUAV;
+    ID3D11Buffer* m_pParticleSimArgs;
+    ID3D11UnorderedAccessView* m_pParticleSimArgsUAV;
+    ID3D11Buffer* m_pParticleDrawArgs;
+    ID3D11UnorderedAccessView* m_pParticleDrawArgsUAV;
+    ID3D11UnorderedAccessView* m_pParticleDrawCountUAV;
+
+    // GPU picking, visible instances are drawn again into the pixel under cursor only, with equal depth test.
+    // Id of the front most one comes back through readback ring a few frames later, so CPU neither raycasts nor waits
+    bool m_pickMode;
+    ID3D11PixelShader* m_pPickPixelShader;
+    ID3D11RasterizerState* m_pPickRasterizerState; // Scissor enabled
+    ID3D11Buffer* m_pPickResult;
+    ID3D11UnorderedAccessView* m_pPickResultUAV;
+    GpuReadback m_pickReadback;
+    UINT m_pickedIdx; // Instance index when the picked frame was rendered
+
+    // Debug views, overdraw is counted by replacing pixel shaders of the passes with an atomic add into a UAV
+    int m_debugView;
+    int m_overdrawPass; // PassCount for all passes
+    ID3D11PixelShader* m_pOverdrawPixelShader;
+    ID3D11PixelShader* m_pOverdrawHeatmapPixelShader;
+    ID3D11PixelShader* m_pLightHeatmapPixelShader;
+    ID3D11PixelShader* m_pLightHeatmapMsaaPixelShader;
+    ID3D11Texture2D* m_pOverdraw; // Scene target size, created on first use
+    ID3D11ShaderResourceView* m_pOverdrawSRV;
+    ID3D11UnorderedAccessView* m_pOverdrawUAV;
+    UINT m_overdrawWidth;
+    UINT m_overdrawHeight;
 
     ID3D11Texture2D* m_pCubemapTexture;
     ID3D11ShaderResourceView* m_pCubemapView;
 
+    // Ambient light projected from the cubemap into spherical harmonics, again whenever the streamed one is swapped in
+    bool m_skyAmbient; // Flat ambient color without it
+    float m_skyAmbientIntensity;
+    bool m_updateSkyAmbient;
+    ID3D11ShaderResourceView* m_pSkyAmbientSource; // Cubemap view coefficients are of, referenced so its address is not reused
+    ID3D11ComputeShader* m_pSkyAmbientShader;
+    ID3D11Buffer* m_pSkyAmbientParams;
+    ID3D11Buffer* m_pSkyAmbientCoeffs;
+    ID3D11UnorderedAccessView* m_pSkyAmbientCoeffsUAV;
+    ID3D11Buffer* m_pAmbientCB; // Copy of coefficients, constant buffers can not be written from compute shader
+
     ID3D11RasterizerState* m_pRasterizerState;
 
     ID3D11BlendState* m_pTransBlendState;
     ID3D11BlendState* m_pOpaqueBlendState;
 
-    ID3D11Texture2D* m_pTexture;
-    ID3D11ShaderResourceView* m_pTextureView;
-    ID3D11Texture2D* m_pTextureNM;
-    ID3D11ShaderResourceView* m_pTextureViewNM;
-    ID3D11SamplerState* m_pSampler;
+    MaterialTable m_materials;
+    // Samplers are owned by the cache
+    SamplerCache m_samplerCache;
+    FilterQuality m_filterQuality;
+    FilterQuality m_samplerFilterQuality; // Of samplers currently fetched from the cache
+    ID3D11SamplerState* m_pMaterialSamplers[MaterialTable::FilterCount];
+    ID3D11SamplerState* m_pSampler; // Sky and transparent rects, they gain nothing from anisotropy
 
     ID3D11Texture2D* m_pColorBuffer;
     ID3D11RenderTargetView* m_pColorBufferRTV;
     ID3D11ShaderResourceView* m_pColorBufferSRV;
-    ID3D11PixelShader* m_pSepiaPixelShader;
-    ID3D11VertexShader* m_pSepiaVertexShader;
+    ID3D11UnorderedAccessView* m_pColorBufferUAV; // Lighting resolve target
+    // Formats of scene targets are selected in UI or by benchmark, multisampled targets use the same ones
+    ColorFormat m_colorFormat;
+    ColorFormat m_colorBufferFormat; // Of created targets
+    UINT m_colorFormatSupportMask; // Bit per format supported for all uses and sample counts
+    DepthFormat m_depthFormat;
+    DepthFormat m_depthBufferFormat;
+    UINT m_depthFormatSupportMask;
+
+    // Multisampled scene targets, resolved to color buffer before post processing
+    UINT m_msaaSamples;
+    UINT m_msaaBufferSamples; // Sample count of created targets
+    UINT m_msaaSupportMask; // Bit per supported sample count
+    ID3D11Texture2D* m_pMsaaColorBuffer;
+    ID3D11RenderTargetView* m_pMsaaColorBufferRTV;
+    ID3D11Texture2D* m_pMsaaDepthBuffer;
+    ID3D11DepthStencilView* m_pMsaaDepthBufferDSV;
+    ID3D11ShaderResourceView* m_pMsaaDepthBufferSRV;
+
+    // Compute post processing, FXAA is a cheaper alternative to MSAA
+    PostProcess m_postProcess;
+    PostProcess::Settings m_postSettings;
+    RenderGraph m_renderGraph; // Post processing passes and their transient targets
+
+    // Dynamic resolution, scene is rendered to top left part of color buffer and upscaled by post processing
+    bool m_dynamicResolution;
+    float m_targetGpuMs;
+    float m_resolutionScale; // Of both dimensions
+    UINT64 m_resolutionFrame; // Last GPU profiler frame scale was adjusted for
+
+    // Temporal upscaling, scene is rendered with jittered projection and resolved with reprojected history to back buffer size
+    bool m_temporalUpscale;
+    ID3D11Texture2D* m_pMotionBuffer; // Uv offset from the previous frame, of target size
+    ID3D11RenderTargetView* m_pMotionBufferRTV;
+    ID3D11ShaderResourceView* m_pMotionBufferSRV;
+    ID3D11Texture2D* m_pHistory[2]; // Resolved frames of back buffer size, one is read while the other is written
+    ID3D11ShaderResourceView* m_pHistorySRV[2];
+    ID3D11UnorderedAccessView* m_pHistoryUAV[2];
+    UINT m_motionWidth;
+    UINT m_motionHeight;
+    UINT m_historyWidth;
+    UINT m_historyHeight;
+    UINT m_historyIdx; // Read one
+    bool m_historyValid;
+    UINT m_jitterIdx;
+    float m_jitter[2]; // In rendered pixels
+    DirectX::XMMATRIX m_prevVp; // Without jitter
+    DirectX::XMMATRIX m_temporalReproject; // Jittered clip space to clip space of the previous frame
+    float m_motionDeltaSec; // Animation time between rendered transforms of the previous and this frame
+
+    // Deferred shading
+    bool m_deferredShading;
+    ID3D11Texture2D* m_pGBuffers[GBufferCount];
+    ID3D11RenderTargetView* m_pGBufferRTVs[GBufferCount];
+    ID3D11ShaderResourceView* m_pGBufferSRVs[GBufferCount];
+    ID3D11PixelShader* m_pGBufferPixelShaders[ShaderVariantCount];
+    ID3D11ComputeShader* m_pResolveShaders[ShaderVariantCount];
+    ID3D11Buffer* m_pResolveParams;
 
     ID3D11ComputeShader* m_pCullShader;
-    ID3D11Buffer* m_pIndirectArgsSrc;
+    ID3D11ComputeShader* m_pCullAtomicShader; // Global atomic per visible id, to compare with group compaction
+    bool m_groupAppend;
+    float m_cullGpuMs[2]; // Average boxes culling time, 0 - with per thread atomics, 1 - with group compaction
     ID3D11Buffer* m_pIndirectArgs;
+    ID3D11Buffer* m_pMeshArgsReset; // Initial per mesh arguments, copied to reset instance counts
     ID3D11Buffer* m_pCullParams;
+    ID3D11Buffer* m_pShadowCullParams; // Without impostors, shadow casters keep mesh LODs
+    ID3D11Buffer* m_pInstBounds;
+    ID3D11ShaderResourceView* m_pInstBoundsSRV;
+    ID3D11UnorderedAccessView* m_pInstBoundsUAV; // Written by bounds scatter
     ID3D11Buffer* m_pGeomBufferInstVisGPU;
     ID3D11UnorderedAccessView* m_pGeomBufferInstVisGPU_UAV;
+    ID3D11ShaderResourceView* m_pGeomBufferInstVisGPU_SRV;
     ID3D11UnorderedAccessView* m_pIndirectArgsUAV;
-    ID3D11Query* m_queries[10];
-    UINT64 m_curFrame;
-    UINT64 m_lastCompletedFrame;
+    // Model view projection and model of GPU visible instances, packed in draw order so vertex shader reads them without ids
+    bool m_instanceTransforms;
+    ID3D11ComputeShader* m_pInstanceTransformsShader;
+    ID3D11VertexShader* m_pTransformVertexShader;
+    ID3D11Buffer* m_pInstanceTransforms[TransformSetCount];
+    ID3D11UnorderedAccessView* m_pInstanceTransformsUAV[TransformSetCount];
+    ID3D11ShaderResourceView* m_pInstanceTransformsSRV[TransformSetCount];
+    ID3D11Buffer* m_pDrawBases[TransformSetCount]; // First transform of each draw
+    ID3D11UnorderedAccessView* m_pDrawBasesUAV[TransformSetCount];
+    ID3D11ShaderResourceView* m_pDrawBasesSRV[TransformSetCount];
+    GpuReadback m_statsReadback;
+    GpuProfiler m_gpuProfiler;
+    FramePacer m_framePacer;
+    ShaderCache m_shaderCache;
+    ShaderReloader m_shaderReloader;
+    struct StartupPhase
+    {
+        const char* name;
+        float ms;
+    };
+    std::vector<StartupPhase> m_startupPhases; // Of the last Init, report ends with total
+    UINT m_featureIdleFrames[LazyFeatureCount];
+    UINT m_featureReleaseFrames; // 0 - resources of unused features are kept until exit
+    TextureStreamer m_textureStreamer;
+    TextureProcessor m_textureProcessor;
+    UINT m_textureSkipMips;
+    VirtualTextures m_virtualTextures;
+    bool m_virtualTexturesSupported; // Tiled resources tier 2
+    bool m_virtualTexturing;
+    bool m_packedVertices;
+    bool m_rawInput;
+    RawMouse m_rawMouse;
+    ShaderCache::Optimization m_shaderOptimization;
 
-    AABB m_boundingRects[2];
+    // Hierarchical culling
+    Bvh m_bvh;
+    bool m_hierarchicalCull;
+    ID3D11ComputeShader* m_pClusterCullShader;
+    ID3D11ComputeShader* m_pClusteredCullShader;
+    ID3D11ComputeShader* m_pClusteredCullAtomicShader;
+    ID3D11Buffer* m_pClusters;
+    ID3D11ShaderResourceView* m_pClustersSRV;
+    ID3D11Buffer* m_pInstOrder;
+    ID3D11ShaderResourceView* m_pInstOrderSRV;
+    ID3D11Buffer* m_pVisibleClusters;
+    ID3D11ShaderResourceView* m_pVisibleClustersSRV;
+    ID3D11UnorderedAccessView* m_pVisibleClustersUAV;
+    ID3D11Buffer* m_pClusterArgs;
+    ID3D11UnorderedAccessView* m_pClusterArgsUAV;
+    ID3D11UnorderedAccessView* m_pClusterArgsCountUAV;
+    // Passes of unknown size are chained by DispatchIndirect, group counts are built on GPU from counts of previous pass
+    ID3D11ComputeShader* m_pDispatchArgsShader;
+    ID3D11ComputeShader* m_pDispatchArgsStructuredShader; // Counts in structured buffer
+    ID3D11Buffer* m_pDispatchArgsParams;
 
-    UINT m_width;
+    // Hi-Z occlusion culling
+    bool m_occlusionCull;
+    ID3D11Texture2D* m_pHiZ;
+    ID3D11ShaderResourceView* m_pHiZSRV;
+    ID3D11ShaderResourceView* m_pHiZMipSRVs[MaxHiZMips];
+    ID3D11UnorderedAccessView* m_pHiZMipUAVs[MaxHiZMips];
+    UINT m_hiZMips;
+    DirectX::XMMATRIX m_hiZVP; // View projection Hi-Z was built with
+    UINT m_hiZWidth; // Depth size Hi-Z was built from
+    UINT m_hiZHeight;
+    ID3D11ComputeShader* m_pHiZShader;
+    ID3D11ComputeShader* m_pHiZMsaaShader; // First level from multisampled depth
+    ID3D11Buffer* m_pHiZParams;
+    ID3D11ComputeShader* m_pOcclusionCullShader;
+    ID3D11Buffer* m_pOcclusionParams[2]; // 0 - for previous frame Hi-Z, 1 - for current frame Hi-Z
+    ID3D11Buffer* m_pOccludedIds;
+    ID3D11UnorderedAccessView* m_pOccludedIdsUAV;
+    ID3D11Buffer* m_pOccludedCount;
+    ID3D11UnorderedAccessView* m_pOccludedCountUAV;
+    ID3D11Buffer* m_pLateIds;
+    ID3D11ShaderResourceView* m_pLateIdsSRV;
+    ID3D11UnorderedAccessView* m_pLateIdsUAV;
+    ID3D11Buffer* m_pLateArgs;
+    ID3D11UnorderedAccessView* m_pLateArgsUAV;
+    ID3D11Buffer* m_pOccludedArgs; // Groups of late pass for occluded count
+    ID3D11UnorderedAccessView* m_pOccludedArgsUAV;
+
+    // Clustered lighting
+    ID3D11Buffer* m_pLightBuffer;
+    ID3D11ShaderResourceView* m_pLightBufferSRV;
+    ID3D11Buffer* m_pVisibleLights; // Lights which radius reaches view frustum, clusters and bulbs use only them
+    ID3D11ShaderResourceView* m_pVisibleLightsSRV;
+    ID3D11UnorderedAccessView* m_pVisibleLightsUAV;
+    ID3D11Buffer* m_pVisibleLightCount;
+    ID3D11ShaderResourceView* m_pVisibleLightCountSRV;
+    ID3D11UnorderedAccessView* m_pVisibleLightCountUAV;
+    ID3D11ComputeShader* m_pLightListShader;
+    ID3D11Buffer* m_pVisibleBulbs; // Lights which bulb is in view and not behind Hi-Z, drawn bulbs read them
+    ID3D11ShaderResourceView* m_pVisibleBulbsSRV;
+    ID3D11UnorderedAccessView* m_pVisibleBulbsUAV;
+    ID3D11Buffer* m_pVisibleBulbCount;
+    ID3D11UnorderedAccessView* m_pVisibleBulbCountUAV;
+    ID3D11ComputeShader* m_pBulbCullShader; // Also writes sky instance counts
+    ID3D11Buffer* m_pClusterLights; // Per cluster light count, then light indices
+    ID3D11ShaderResourceView* m_pClusterLightsSRV;
+    ID3D11UnorderedAccessView* m_pClusterLightsUAV;
+    ID3D11ComputeShader* m_pLightCullShader;
+    ID3D11Buffer* m_pLightCullParams;
+
+    // Sun shadow cascades, each one is culled with FrustumCull.cs into its own arguments and ids and drawn depth only
+    bool m_sunShadows; // Sun light is off without them
+    float m_shadowDistance; // View depth where the last cascade ends
+    ShadowBuffer m_shadowBuffer;
+    ConstantBuffer<ShadowBuffer> m_shadowCB;
+    ConstantBuffer<SceneBuffer> m_cascadeCBs[CascadeCount]; // Scene constants of each cascade view, for cull and draw
+    ConstantRing m_constantRing; // Holds cascade scene constants instead of m_cascadeCBs with constant offsets
+    UINT m_cascadeFirstConstants[CascadeCount];
+    bool m_cascadeRangesUsed; // Cascade constants of this frame are in m_constantRing
+    ID3D11Texture2D* m_pShadowAtlas;
+    ID3D11DepthStencilView* m_pShadowAtlasDSV;
+    ID3D11ShaderResourceView* m_pShadowAtlasSRV;
+    ID3D11SamplerState* m_pShadowSampler; // Owned by sampler cache
+    ID3D11RasterizerState* m_pShadowRasterizerState;
+    ID3D11Buffer* m_pNoOcclusionParams; // Casters can't be tested against camera Hi-Z
+    ID3D11Buffer* m_pShadowArgs[CascadeCount];
+    ID3D11UnorderedAccessView* m_pShadowArgsUAV[CascadeCount];
+    ID3D11Buffer* m_pShadowIds[CascadeCount];
+    ID3D11ShaderResourceView* m_pShadowIdsSRV[CascadeCount];
+    ID3D11UnorderedAccessView* m_pShadowIdsUAV[CascadeCount];
+    // Single pass path of cascades, if vertex shader can select viewport. One cull dispatch appends ids tagged with cascade
+    // to segments CascadeCount times as long as the ones above, and each mesh LOD is drawn once for all cascades
+    bool m_multiViewSupported; // VPAndRTArrayIndexFromAnyShaderFeedingRasterizer
+    bool m_multiViewShadows;
+    ConstantBuffer<MultiViewBuffer> m_multiViewCB;
+    ID3D11ComputeShader* m_pMultiViewCullShader;
+    ID3D11VertexShader* m_pMultiViewVertexShader;
+    ID3D11Buffer* m_pMultiViewArgs;
+    ID3D11UnorderedAccessView* m_pMultiViewArgsUAV;
+    ID3D11Buffer* m_pMultiViewArgsReset;
+    ID3D11Buffer* m_pMultiViewIds;
+    ID3D11ShaderResourceView* m_pMultiViewIdsSRV;
+    ID3D11UnorderedAccessView* m_pMultiViewIdsUAV;
+
+    // Front to back sort of visible instances
+    bool m_sortInstances;
+    DepthSort m_depthSort;
+    std::vector<UINT> m_cullIds; // CPU culling output before sort
+    std::vector<UINT> m_sortedIds;
+    ID3D11Buffer* m_pSortKeys;
+    ID3D11UnorderedAccessView* m_pSortKeysUAV;
+    ID3D11Buffer* m_pSortParams;
+    ID3D11ComputeShader* m_pSortKeysShader;
+    ID3D11ComputeShader* m_pSortLocalShader;
+    ID3D11ComputeShader* m_pSortGlobalShader;
+    ID3D11ComputeShader* m_pSortWriteShader;
+    ID3D11Buffer* m_pSortWriteArgs; // Groups of write pass for visible count of each mesh LOD
+    ID3D11UnorderedAccessView* m_pSortWriteArgsUAV;
+
+    JobSystem m_jobSystem;
+    CpuCull m_cpuCull;
+    bool m_simdCull;
+    bool m_parallelCull;
+    bool m_orientedBounds; // Instances visible by boxes are tested with bounds of rotated mesh
+
+    // Inputs of the last cull, its results are kept while they stay the same
+    struct CullState
+    {
+        Point4f frustum[6];
+        UINT instCount;
+        UINT flags; // Settings affecting the result
+    };
+    bool m_reuseVisibility;
+    bool m_cullStateValid; // Reset when bounds change
+    bool m_visibilityReused; // By the current frame
+    CullState m_cullState;
+
+    ID3D11ComputeShader* m_pAnimateShader;
+    ID3D11Buffer* m_pAnimateParams;
+    ID3D11UnorderedAccessView* m_pGeomBufferInstUAV;
+    bool m_computeAnimation;
+    float m_animationDeltaSec;
+
+    // Simulation runs at fixed rate, rendered transforms are interpolated between the last two ticks
+    int m_simulationHz; // 0 - simulation step per frame
+    double m_simulationAccumSec; // Time not simulated yet
+    float m_interpolationSec; // Rendered time relative to the last tick, not positive
+    UINT m_simulationTicks; // Ticks of the frame
+    bool m_instancesMoved; // Rendered transforms changed this frame
+
+    UINT m_width;  // Back buffer size
     UINT m_height;
+    UINT m_pendingWidth; // Window size to resize back buffer to in Update
+    UINT m_pendingHeight;
+    bool m_resizePending;
+    bool m_sizeMove; // Window is dragged or resized by its frame
+    size_t m_resizeUSec; // Time pending size last changed at
+    UINT m_targetWidth; // Size of depth, color, G-buffer and other scene targets, at least the render size
+    UINT m_targetHeight;
+    bool m_fixedResolution; // Scene is rendered at internal resolution and scaled to window
+    UINT m_internalWidth;
+    UINT m_internalHeight;
+    UINT m_swapChainResizes;
+    UINT m_targetReallocs;
 
     Camera m_camera;
+
+    // Camera of the current frame, computed once in Update
+    struct CameraSnapshot
+    {
+        Point3f pos;
+        Point3f dir;
+        Point3f up;
+        DirectX::XMMATRIX vp;
+        Point4f frustum[6]; // Extracted from vp
+    };
+    CameraSnapshot m_cameraSnapshot;
     bool m_rbPressed;
     int m_prevMouseX;
     int m_prevMouseY;
+    int m_mouseX; // Last cursor position in window, negative until the first move
+    int m_mouseY;
     bool m_rotateModel;
     double m_angle;
     double m_forwardDelta;
@@ -310,13 +1704,30 @@ private:
     bool m_useNormalMaps;
     bool m_showNormals;
     bool m_doCull;
-    bool m_useSepia;
+    bool m_infiniteFar; // Reversed Z projection without far plane
     bool m_computeCull;
     bool m_updateCullParams;
 
     int m_gpuVisibleInstances;
 
     size_t m_prevUSec;
+    double m_fixedDeltaSec; // Used instead of real time if positive
+    bool m_showUI;
+    bool m_uiDirty;         // Rebuild UI on next frame regardless of refresh rate
+    UINT m_uiRefreshRate;
+    size_t m_uiBuildUSec;   // Time UI was last rebuilt at
+    bool m_renderOnDemand;
+    UINT m_pendingFrames;   // Left to render after the last change
 
     SceneBuffer m_sceneBuffer;
+    SettingsBuffer m_settingsBuffer;
+    Light m_lights[MaxLights];
+
+    // Lights are uploaded only if they differ from the last uploaded ones
+    Light m_uploadedLights[MaxLights];
+    int m_uploadedLightCount;
+    UINT m_lightUploads;
+
+    std::string m_sceneFileStatus; // Result of the last scene load or save
+    float m_sceneFileMs;
 };
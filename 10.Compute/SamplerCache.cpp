@@ -0,0 +1,67 @@
+#include "framework.h"
+
+#include "SamplerCache.h"
+
+#include <float.h>
+
+HRESULT SamplerCache::Get(ID3D11Device* pDevice, const D3D11_SAMPLER_DESC& desc, const std::string& name, ID3D11SamplerState** ppSampler)
+{
+    // A handful of samplers, linear search is enough
+    for (const Entry& entry : m_entries)
+    {
+        if (memcmp(&entry.desc, &desc, sizeof(desc)) == 0)
+        {
+            *ppSampler = entry.pSampler;
+            return S_OK;
+        }
+    }
+
+    Entry entry;
+    entry.desc = desc;
+    entry.pSampler = nullptr;
+
+    HRESULT result = pDevice->CreateSamplerState(&desc, &entry.pSampler);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(entry.pSampler, name);
+    }
+    if (SUCCEEDED(result))
+    {
+        m_entries.push_back(entry);
+        *ppSampler = entry.pSampler;
+    }
+    else
+    {
+        SAFE_RELEASE(entry.pSampler);
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void SamplerCache::Term()
+{
+    for (Entry& entry : m_entries)
+    {
+        SAFE_RELEASE(entry.pSampler);
+    }
+    m_entries.clear();
+}
+
+D3D11_SAMPLER_DESC SamplerCache::MakeDesc(D3D11_FILTER filter, D3D11_TEXTURE_ADDRESS_MODE address, UINT maxAnisotropy)
+{
+    D3D11_SAMPLER_DESC desc = {};
+    desc.Filter = filter;
+    desc.AddressU = address;
+    desc.AddressV = address;
+    desc.AddressW = address;
+    desc.MinLOD = -FLT_MAX;
+    desc.MaxLOD = FLT_MAX;
+    desc.MipLODBias = 0.0f;
+    desc.MaxAnisotropy = filter == D3D11_FILTER_ANISOTROPIC ? maxAnisotropy : 1;
+    desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    desc.BorderColor[0] = desc.BorderColor[1] = desc.BorderColor[2] = desc.BorderColor[3] = 1.0f;
+
+    return desc;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Sampler states shared by description, so each pass asks for the filtering it needs and equal requests share one object.
+ * Samplers are owned by the cache and live until Term, switching quality back and forth creates nothing new.
+ */
+class SamplerCache
+{
+public:
+    SamplerCache() {}
+
+    /** Sampler of given description, the name is set when it is created by the first request */
+    HRESULT Get(ID3D11Device* pDevice, const D3D11_SAMPLER_DESC& desc, const std::string& name, ID3D11SamplerState** ppSampler);
+    void Term();
+
+    UINT GetCount() const { return (UINT)m_entries.size(); }
+
+    /** Description with the same addressing on all axes and full mip range, anisotropy is only used by anisotropic filter */
+    static D3D11_SAMPLER_DESC MakeDesc(D3D11_FILTER filter, D3D11_TEXTURE_ADDRESS_MODE address, UINT maxAnisotropy = 1);
+
+private:
+    struct Entry
+    {
+        D3D11_SAMPLER_DESC desc;
+        ID3D11SamplerState* pSampler;
+    };
+
+    std::vector<Entry> m_entries;
+};
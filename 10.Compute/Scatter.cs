@@ -0,0 +1,29 @@
+// Stores payload of each record at its element index, thread per record
+cbuffer ScatterParams : register(b0)
+{
+    uint4 scatterParams; // x - record count
+};
+
+struct Element
+{
+    uint data[ELEMENT_UINTS];
+};
+
+struct Record
+{
+    uint index;
+    Element element;
+};
+
+StructuredBuffer<Record> records : register(t0);
+RWStructuredBuffer<Element> elements : register(u0);
+
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (globalThreadId.x < scatterParams.x)
+    {
+        Record record = records[globalThreadId.x];
+        elements[record.index] = record.element;
+    }
+}
@@ -0,0 +1,132 @@
+#include "framework.h"
+
+#include "ScatterUpload.h"
+#include "StallDetector.h"
+
+HRESULT ScatterUpload::Init(ID3D11Device* pDevice, UINT elementSize, UINT capacity, const CreateShader& createShader, const std::string& name)
+{
+    assert(elementSize % sizeof(UINT) == 0);
+
+    // Kernel copies payload as uints, so one variant serves all element types of the size
+    HRESULT result = createShader(L"Scatter.cs", (ID3D11DeviceChild**)&m_pScatterShader, { "ELEMENT_UINTS=" + std::to_string(elementSize / sizeof(UINT)) });
+    if (SUCCEEDED(result))
+    {
+        result = m_paramsCB.Init(pDevice, name + "Params");
+    }
+    if (SUCCEEDED(result))
+    {
+        // Record is element index followed by payload
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = (sizeof(UINT) + elementSize) * capacity;
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = sizeof(UINT) + elementSize;
+
+        result = pDevice->CreateBuffer(&desc, nullptr, &m_pRecords);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRecords, name + "Records");
+        }
+        if (SUCCEEDED(result))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.FirstElement = 0;
+            srvDesc.Buffer.NumElements = capacity;
+
+            result = pDevice->CreateShaderResourceView(m_pRecords, &srvDesc, &m_pRecordsSRV);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pRecordsSRV, name + "RecordsSRV");
+        }
+    }
+    assert(SUCCEEDED(result));
+    if (SUCCEEDED(result))
+    {
+        m_elementSize = elementSize;
+        m_capacity = capacity;
+    }
+
+    return result;
+}
+
+void ScatterUpload::Term()
+{
+    SAFE_RELEASE(m_pRecords);
+    SAFE_RELEASE(m_pRecordsSRV);
+    SAFE_RELEASE(m_pScatterShader);
+    m_paramsCB.Term();
+    m_elementSize = 0;
+    m_capacity = 0;
+}
+
+void ScatterUpload::Upload(ID3D11DeviceContext* pContext, ID3D11UnorderedAccessView* pDstUAV, const void* pSrc, const std::vector<BufferRange>& ranges)
+{
+    const BYTE* pSrcBytes = (const BYTE*)pSrc;
+    const UINT recordSize = sizeof(UINT) + m_elementSize;
+
+    pContext->CSSetShader(m_pScatterShader, nullptr, 0);
+    pContext->CSSetUnorderedAccessViews(0, 1, &pDstUAV, nullptr);
+
+    // Records which don't fit at once go in several batches, buffer is discarded for each
+    size_t rangeIdx = 0;
+    UINT rangeOffset = 0;
+    while (rangeIdx < ranges.size())
+    {
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        HRESULT result = StallDetector::Get().Map(pContext, m_pRecords, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource, STALL_SITE);
+        assert(SUCCEEDED(result));
+        if (FAILED(result))
+        {
+            break;
+        }
+
+        BYTE* pRecord = (BYTE*)subresource.pData;
+        UINT count = 0;
+        while (rangeIdx < ranges.size() && count < m_capacity)
+        {
+            if (rangeOffset < ranges[rangeIdx].count)
+            {
+                UINT idx = ranges[rangeIdx].first + rangeOffset;
+                memcpy(pRecord, &idx, sizeof(UINT));
+                memcpy(pRecord + sizeof(UINT), pSrcBytes + (size_t)idx * m_elementSize, m_elementSize);
+                pRecord += recordSize;
+                ++count;
+                ++rangeOffset;
+            }
+            if (rangeOffset >= ranges[rangeIdx].count)
+            {
+                ++rangeIdx;
+                rangeOffset = 0;
+            }
+        }
+
+        pContext->Unmap(m_pRecords, 0);
+
+        if (count == 0)
+        {
+            break;
+        }
+
+        m_paramsCB.Update(pContext, ScatterParams{ Point4i{ (int)count, 0, 0, 0 } });
+        ID3D11Buffer* constBuffers[1] = { m_paramsCB.Get() };
+        pContext->CSSetConstantBuffers(0, 1, constBuffers);
+        pContext->CSSetShaderResources(0, 1, &m_pRecordsSRV);
+
+        pContext->Dispatch(DivUp(count, 64u), 1, 1);
+
+        m_uploadedBytes += count * recordSize;
+        m_recordCount += count;
+        ++m_dispatchCount;
+    }
+
+    // Unbind, as destination is read through SRV during rendering
+    ID3D11ShaderResourceView* nullSRVs[1] = {};
+    pContext->CSSetShaderResources(0, 1, nullSRVs);
+    ID3D11UnorderedAccessView* nullUAVs[1] = {};
+    pContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, nullptr);
+}
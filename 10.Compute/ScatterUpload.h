@@ -0,0 +1,63 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "../Math/Point.h"
+
+#include "ConstantBuffer.h"
+#include "UploadRing.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Partial updates of GPU resident structured buffers by a compute kernel.
+ * Changed elements are written as (index, payload) records to a dynamic buffer and Scatter.cs
+ * stores each payload at its index, so upload size follows changes rather than buffer size or layout of ranges.
+ */
+class ScatterUpload
+{
+public:
+    typedef std::function<HRESULT(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines)> CreateShader;
+
+    ScatterUpload()
+        : m_pRecords(nullptr)
+        , m_pRecordsSRV(nullptr)
+        , m_pScatterShader(nullptr)
+        , m_elementSize(0)
+        , m_capacity(0)
+        , m_uploadedBytes(0)
+        , m_recordCount(0)
+        , m_dispatchCount(0)
+    {}
+
+    /** Element size should be a multiple of 4 bytes, capacity is records per dispatch */
+    HRESULT Init(ID3D11Device* pDevice, UINT elementSize, UINT capacity, const CreateShader& createShader, const std::string& name);
+    void Term();
+
+    /** Scatter given element ranges of pSrc to the same elements of destination, its view stride should be the element size */
+    void Upload(ID3D11DeviceContext* pContext, ID3D11UnorderedAccessView* pDstUAV, const void* pSrc, const std::vector<BufferRange>& ranges);
+
+    void ResetStats() { m_uploadedBytes = 0; m_recordCount = 0; m_dispatchCount = 0; }
+    UINT GetUploadedBytes() const { return m_uploadedBytes; }
+    UINT GetRecordCount() const { return m_recordCount; }
+    UINT GetDispatchCount() const { return m_dispatchCount; }
+
+private:
+    struct ScatterParams
+    {
+        Point4i scatterParams; // x - record count
+    };
+
+    ID3D11Buffer* m_pRecords;
+    ID3D11ShaderResourceView* m_pRecordsSRV;
+    ID3D11ComputeShader* m_pScatterShader;
+    ConstantBuffer<ScatterParams> m_paramsCB;
+    UINT m_elementSize;
+    UINT m_capacity;
+
+    UINT m_uploadedBytes;
+    UINT m_recordCount;
+    UINT m_dispatchCount;
+};
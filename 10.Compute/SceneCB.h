@@ -1,16 +1,25 @@
 struct Light
 {
-    float4 pos;
+    float4 pos; // xyz - position, w - radius
     float4 color;
 };
 
+// Per frame, rewritten when camera moves
 cbuffer SceneBuffer : register (b0)
 {
     float4x4 vp;
     float4 cameraPos; // Camera position
-    int4 lightCount; // x - light count (max 10), y - use normal maps, z - show normals instead of color, w - use culling
-    int4 postProcess; // x - use sepia
-    Light lights[10];
-    float4 ambientColor;
     float4 frustum[6];
+    float4x4 invVp; // Clip to world space
+    float4x4 prevVp; // Of the previous frame, without jitter
+    float4 motionParams; // xy - projection jitter in clip space, z - animation time since the previous frame
+};
+
+// Rewritten only when settings, light count or projection change. Slot is above pass specific buffers
+cbuffer SettingsBuffer : register (b3)
+{
+    int4 lightCount; // x - light count, yzw - unused, normal maps and normals view are shader variants
+    float4 clusterParams; // x - scale, y - bias for cluster slice from log of view depth
+    float4 ambientColor;
+    float4 normalDecode; // x - scale, y - bias from normal map texel to [-1, 1]
 };
@@ -0,0 +1,166 @@
+#include "framework.h"
+
+#include "SceneFile.h"
+
+void SceneFile::GetBlockSizes(const Header& header, UINT64 elementCounts[BlockCount], UINT64 elementSizes[BlockCount])
+{
+    static const UINT64 ElementSizes[BlockCount] = {
+        sizeof(Point3f), sizeof(float), sizeof(float), sizeof(UINT), sizeof(UINT), sizeof(AABB),
+        sizeof(MaterialTable::Material), sizeof(wchar_t) * MaxTexturePathLength, MaxMeshNameLength
+    };
+
+    UINT64 textureCount = 0;
+    for (UINT i = 0; i < MaterialTable::TextureSetCount; i++)
+    {
+        textureCount += header.textureCounts[i];
+    }
+
+    for (UINT i = 0; i < BlockCount; i++)
+    {
+        elementSizes[i] = ElementSizes[i];
+        elementCounts[i] = i <= BlockBounds ? header.instanceCount : 0;
+    }
+    elementCounts[BlockMaterialTable] = header.materialCount;
+    elementCounts[BlockTextureFiles] = textureCount;
+    elementCounts[BlockMeshNames] = header.meshCount;
+}
+
+bool SceneFile::Write(const std::wstring& path, const Contents& contents)
+{
+    Header header = {};
+    header.magic = Magic;
+    header.version = Version;
+    header.instanceCount = contents.instanceCount;
+    header.materialCount = (UINT32)contents.materials.size();
+    for (UINT i = 0; i < MaterialTable::TextureSetCount; i++)
+    {
+        header.textureCounts[i] = (UINT32)contents.textureFiles[i].size();
+    }
+    header.meshCount = (UINT32)contents.meshNames.size();
+
+    UINT64 elementCounts[BlockCount];
+    UINT64 elementSizes[BlockCount];
+    GetBlockSizes(header, elementCounts, elementSizes);
+
+    // Blocks are aligned, so they can be read in place from mapped file
+    UINT64 offset = DivUp((UINT64)sizeof(Header), (UINT64)BlockAlignment) * BlockAlignment;
+    for (UINT i = 0; i < BlockCount; i++)
+    {
+        header.blockOffsets[i] = offset;
+        offset += DivUp(elementCounts[i] * elementSizes[i], (UINT64)BlockAlignment) * BlockAlignment;
+    }
+
+    // Names are stored as fixed size records
+    std::vector<wchar_t> textureFiles;
+    for (UINT i = 0; i < MaterialTable::TextureSetCount; i++)
+    {
+        for (const std::wstring& file : contents.textureFiles[i])
+        {
+            size_t start = textureFiles.size();
+            textureFiles.resize(start + MaxTexturePathLength, 0);
+            wcsncpy_s(&textureFiles[start], MaxTexturePathLength, file.c_str(), _TRUNCATE);
+        }
+    }
+    std::vector<char> meshNames(contents.meshNames.size() * MaxMeshNameLength, 0);
+    for (size_t i = 0; i < contents.meshNames.size(); i++)
+    {
+        strncpy_s(&meshNames[i * MaxMeshNameLength], MaxMeshNameLength, contents.meshNames[i].c_str(), _TRUNCATE);
+    }
+
+    const void* blockData[BlockCount] = {
+        contents.pPositions, contents.pSpeeds, contents.pShininess, contents.pMaterials, contents.pMeshes, contents.pBounds,
+        contents.materials.data(), textureFiles.data(), meshNames.data()
+    };
+
+    // Written to temporary file first, so interrupted write never leaves broken scene
+    std::wstring tempPath = path + L".tmp";
+
+    FILE* pFile = nullptr;
+    _wfopen_s(&pFile, tempPath.c_str(), L"wb");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+
+    static const char Padding[BlockAlignment] = {};
+
+    bool written = fwrite(&header, sizeof(header), 1, pFile) == 1;
+    UINT64 position = sizeof(header);
+    for (UINT i = 0; i < BlockCount && written; i++)
+    {
+        UINT64 padding = header.blockOffsets[i] - position;
+        written = fwrite(Padding, 1, (size_t)padding, pFile) == padding;
+
+        size_t size = (size_t)(elementCounts[i] * elementSizes[i]);
+        written = written && (size == 0 || fwrite(blockData[i], 1, size, pFile) == size);
+        position = header.blockOffsets[i] + size;
+    }
+
+    fclose(pFile);
+
+    if (!written || !MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool SceneFile::Open(const std::wstring& path)
+{
+    Close();
+
+    if (!m_file.Open(path) || !m_file.Contains(0, 1, sizeof(Header)))
+    {
+        m_file.Close();
+        return false;
+    }
+
+    const Header* pHeader = reinterpret_cast<const Header*>(m_file.GetData());
+    if (pHeader->magic != Magic || pHeader->version != Version)
+    {
+        m_file.Close();
+        return false;
+    }
+
+    UINT64 elementCounts[BlockCount];
+    UINT64 elementSizes[BlockCount];
+    GetBlockSizes(*pHeader, elementCounts, elementSizes);
+    for (UINT i = 0; i < BlockCount; i++)
+    {
+        if (pHeader->blockOffsets[i] % BlockAlignment != 0 || !m_file.Contains(pHeader->blockOffsets[i], elementCounts[i], elementSizes[i]))
+        {
+            m_file.Close();
+            return false;
+        }
+    }
+
+    m_pHeader = pHeader;
+
+    return true;
+}
+
+void SceneFile::Close()
+{
+    m_pHeader = nullptr;
+    m_file.Close();
+}
+
+std::wstring SceneFile::GetTextureFile(MaterialTable::TextureSet set, UINT idx) const
+{
+    UINT record = idx;
+    for (UINT i = 0; i < (UINT)set; i++)
+    {
+        record += m_pHeader->textureCounts[i];
+    }
+
+    const wchar_t* pName = GetBlock<wchar_t>(BlockTextureFiles) + (size_t)record * MaxTexturePathLength;
+    return std::wstring(pName, wcsnlen(pName, MaxTexturePathLength));
+}
+
+std::string SceneFile::GetMeshName(UINT idx) const
+{
+    const char* pName = GetBlock<char>(BlockMeshNames) + (size_t)idx * MaxMeshNameLength;
+    return std::string(pName, strnlen(pName, MaxMeshNameLength));
+}
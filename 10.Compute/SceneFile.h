@@ -0,0 +1,102 @@
+#pragma once
+
+#include "AABB.h"
+#include "MappedFile.h"
+#include "MaterialTable.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Binary scene: versioned header, instance fields as blocks of InstanceStore layout, material table and mesh references.
+ * File is memory mapped and blocks are copied to instance store as they are, so nothing is parsed per instance.
+ * Materials reference textures and instances reference meshes by name, so files don't depend on load order.
+ */
+class SceneFile
+{
+public:
+    static const UINT32 Magic = 0x314E4353; // "SCN1"
+    static const UINT32 Version = 1;
+    static const UINT BlockAlignment = 16;
+    static const UINT MaxMeshNameLength = 32;  // Including terminating zero
+    static const UINT MaxTexturePathLength = 260;
+
+    enum Block
+    {
+        BlockPositions = 0, // Point3f per instance
+        BlockSpeeds,        // float per instance
+        BlockShininess,     // float per instance
+        BlockMaterials,     // UINT material id per instance
+        BlockMeshes,        // UINT mesh reference per instance
+        BlockBounds,        // AABB per instance
+        BlockMaterialTable, // MaterialTable::Material per material, slices index texture files of the set
+        BlockTextureFiles,  // wchar_t[MaxTexturePathLength] per texture, albedo files first
+        BlockMeshNames,     // char[MaxMeshNameLength] per mesh reference
+
+        BlockCount
+    };
+
+    struct Header
+    {
+        UINT32 magic;
+        UINT32 version;
+        UINT32 instanceCount;
+        UINT32 materialCount;
+        UINT32 textureCounts[MaterialTable::TextureSetCount];
+        UINT32 meshCount;
+        UINT32 pad;
+        UINT64 blockOffsets[BlockCount];
+    };
+
+    // Scene to write, instance arrays have instanceCount elements
+    struct Contents
+    {
+        UINT instanceCount = 0;
+        const Point3f* pPositions = nullptr;
+        const float* pSpeeds = nullptr;
+        const float* pShininess = nullptr;
+        const UINT* pMaterials = nullptr;
+        const UINT* pMeshes = nullptr;
+        const AABB* pBounds = nullptr;
+
+        std::vector<MaterialTable::Material> materials;
+        std::vector<std::wstring> textureFiles[MaterialTable::TextureSetCount];
+        std::vector<std::string> meshNames;
+    };
+
+    static bool Write(const std::wstring& path, const Contents& contents);
+
+    SceneFile()
+        : m_pHeader(nullptr)
+    {}
+
+    /** Map file and validate header and block ranges */
+    bool Open(const std::wstring& path);
+    void Close();
+
+    inline UINT GetInstanceCount() const { return m_pHeader->instanceCount; }
+    inline const Point3f* GetPositions() const { return GetBlock<Point3f>(BlockPositions); }
+    inline const float* GetSpeeds() const { return GetBlock<float>(BlockSpeeds); }
+    inline const float* GetShininess() const { return GetBlock<float>(BlockShininess); }
+    inline const UINT* GetMaterials() const { return GetBlock<UINT>(BlockMaterials); }
+    inline const UINT* GetMeshes() const { return GetBlock<UINT>(BlockMeshes); }
+    inline const AABB* GetBounds() const { return GetBlock<AABB>(BlockBounds); }
+
+    inline UINT GetMaterialCount() const { return m_pHeader->materialCount; }
+    inline const MaterialTable::Material* GetMaterialTable() const { return GetBlock<MaterialTable::Material>(BlockMaterialTable); }
+
+    inline UINT GetTextureCount(MaterialTable::TextureSet set) const { return m_pHeader->textureCounts[set]; }
+    std::wstring GetTextureFile(MaterialTable::TextureSet set, UINT idx) const;
+
+    inline UINT GetMeshCount() const { return m_pHeader->meshCount; }
+    std::string GetMeshName(UINT idx) const;
+
+private:
+    template<typename T>
+    inline const T* GetBlock(Block block) const { return reinterpret_cast<const T*>(m_file.GetData() + m_pHeader->blockOffsets[block]); }
+
+    static void GetBlockSizes(const Header& header, UINT64 elementCounts[BlockCount], UINT64 elementSizes[BlockCount]);
+
+    MappedFile m_file;
+    const Header* m_pHeader;
+};
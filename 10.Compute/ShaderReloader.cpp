@@ -0,0 +1,224 @@
+#include "framework.h"
+
+#include "ShaderReloader.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+
+UINT64 GetWriteTime(const std::string& name)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(name.c_str(), GetFileExInfoStandard, &data))
+    {
+        return 0;
+    }
+    return ((UINT64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
+}
+
+void ShaderReloader::Init(ID3D11Device* pDevice)
+{
+    m_pDevice = pDevice;
+    m_pDevice->AddRef();
+
+    m_stop = false;
+    m_worker = std::thread(&ShaderReloader::WorkerLoop, this);
+}
+
+void ShaderReloader::Term()
+{
+    if (m_worker.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_stopCV.notify_all();
+
+        m_worker.join();
+    }
+
+    for (Reloaded& reloaded : m_reloaded)
+    {
+        SAFE_RELEASE(reloaded.pShader);
+    }
+    m_reloaded.clear();
+    m_shaders.clear();
+    m_writeTimes.clear();
+
+    SAFE_RELEASE(m_pDevice);
+}
+
+void ShaderReloader::Register(const std::wstring& path, const std::vector<std::string>& defines, const std::string& entryPoint, const std::string& target, UINT flags, ID3D11DeviceChild** ppShader, const std::vector<ShaderCache::Dependency>& dependencies)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shaders.push_back({ path, defines, entryPoint, target, flags, ppShader, dependencies });
+}
+
+void ShaderReloader::Unregister(ID3D11DeviceChild** ppShaders, UINT count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Shader& shader : m_shaders)
+    {
+        if (shader.ppShader >= ppShaders && shader.ppShader < ppShaders + count)
+        {
+            shader.ppShader = nullptr;
+            shader.dependencies.clear();
+        }
+    }
+}
+
+void ShaderReloader::SetFlags(UINT flags)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flags = flags;
+    m_flagsChanged = true;
+}
+
+bool ShaderReloader::HasReloaded()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_reloaded.empty();
+}
+
+UINT ShaderReloader::Apply()
+{
+    std::vector<Reloaded> reloaded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_reloaded.empty())
+        {
+            return 0;
+        }
+        reloaded.swap(m_reloaded);
+
+        for (Reloaded& item : reloaded)
+        {
+            m_shaders[item.shaderIdx].dependencies = item.dependencies;
+        }
+    }
+
+    // Contexts hold their own references, so shader still bound is not destroyed here
+    for (Reloaded& item : reloaded)
+    {
+        ID3D11DeviceChild** ppShader = m_shaders[item.shaderIdx].ppShader;
+        if (ppShader == nullptr)
+        {
+            // Unregistered while it was compiled
+            SAFE_RELEASE(item.pShader);
+            continue;
+        }
+        SAFE_RELEASE(*ppShader);
+        *ppShader = item.pShader;
+    }
+    m_reloadCount += (UINT)reloaded.size();
+
+    return (UINT)reloaded.size();
+}
+
+void ShaderReloader::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopCV.wait_for(lock, std::chrono::milliseconds(PollIntervalMs), [this] { return m_stop; }))
+    {
+        bool reloadAll = m_flagsChanged;
+        if (m_flagsChanged)
+        {
+            for (Shader& shader : m_shaders)
+            {
+                shader.flags = m_flags;
+            }
+            m_flagsChanged = false;
+        }
+        std::vector<Shader> shaders = m_shaders;
+        lock.unlock();
+
+        // Files seen for the first time only get their write time recorded
+        std::vector<std::string> changed;
+        for (const Shader& shader : shaders)
+        {
+            for (const ShaderCache::Dependency& dependency : shader.dependencies)
+            {
+                auto it = m_writeTimes.find(dependency.name);
+                if (it == m_writeTimes.end())
+                {
+                    m_writeTimes[dependency.name] = GetWriteTime(dependency.name);
+                }
+                else if (std::find(changed.begin(), changed.end(), dependency.name) == changed.end())
+                {
+                    UINT64 writeTime = GetWriteTime(dependency.name);
+                    if (writeTime != it->second)
+                    {
+                        it->second = writeTime;
+                        changed.push_back(dependency.name);
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < shaders.size(); i++)
+        {
+            bool affected = reloadAll;
+            for (const ShaderCache::Dependency& dependency : shaders[i].dependencies)
+            {
+                affected = affected || std::find(changed.begin(), changed.end(), dependency.name) != changed.end();
+            }
+            if (affected && shaders[i].ppShader != nullptr)
+            {
+                Reload(shaders[i], i);
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+void ShaderReloader::Reload(const Shader& shader, size_t shaderIdx)
+{
+    ID3DBlob* pCode = nullptr;
+    std::vector<ShaderCache::Dependency> dependencies;
+    HRESULT result = m_cache.GetBytecode(shader.path, shader.defines, shader.entryPoint, shader.target, shader.flags, &pCode, &dependencies);
+
+    // Device is free threaded, so shader is created right here and render thread only swaps pointers
+    ID3D11DeviceChild* pShader = nullptr;
+    if (SUCCEEDED(result))
+    {
+        if (shader.entryPoint == "vs")
+        {
+            result = m_pDevice->CreateVertexShader(pCode->GetBufferPointer(), pCode->GetBufferSize(), nullptr, (ID3D11VertexShader**)&pShader);
+        }
+        else if (shader.entryPoint == "ps")
+        {
+            result = m_pDevice->CreatePixelShader(pCode->GetBufferPointer(), pCode->GetBufferSize(), nullptr, (ID3D11PixelShader**)&pShader);
+        }
+        else if (shader.entryPoint == "cs")
+        {
+            result = m_pDevice->CreateComputeShader(pCode->GetBufferPointer(), pCode->GetBufferSize(), nullptr, (ID3D11ComputeShader**)&pShader);
+        }
+        else
+        {
+            result = E_INVALIDARG;
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(pShader, WCSToMBS(shader.path).c_str());
+    }
+    SAFE_RELEASE(pCode);
+
+    if (SUCCEEDED(result))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reloaded.push_back({ shaderIdx, pShader, dependencies });
+    }
+    else
+    {
+        // Previous shader stays in use until sources compile again
+        SAFE_RELEASE(pShader);
+        OutputDebugStringA(("Shader reload failed: " + WCSToMBS(shader.path) + "\n").c_str());
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "../Core/ShaderCache.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Background recompilation of shaders whose source or included files have changed.
+ * Worker thread polls write times of all files shaders depend on and compiles and creates
+ * only affected permutations, render thread swaps finished shaders in between frames.
+ */
+class ShaderReloader
+{
+public:
+    static const UINT PollIntervalMs = 250;
+
+    ShaderReloader()
+        : m_pDevice(nullptr)
+        , m_stop(false)
+        , m_flags(0)
+        , m_flagsChanged(false)
+        , m_reloadCount(0)
+    {}
+
+    void Init(ID3D11Device* pDevice);
+    void Term();
+
+    /** Remember how shader was built, *ppShader is replaced by Apply once its sources change */
+    void Register(const std::wstring& path, const std::vector<std::string>& defines, const std::string& entryPoint, const std::string& target, UINT flags, ID3D11DeviceChild** ppShader, const std::vector<ShaderCache::Dependency>& dependencies);
+    /** Stop reloading count shaders from ppShaders, before they are released or their storage goes away */
+    void Unregister(ID3D11DeviceChild** ppShaders, UINT count = 1);
+
+    /** Recompile all shaders in background with new compile flags */
+    void SetFlags(UINT flags);
+
+    /** Swap in recompiled shaders, should be called on render thread between frames. Returns swapped count */
+    UINT Apply();
+
+    UINT GetReloadCount() const { return m_reloadCount; }
+    /** Recompiled shaders wait for Apply */
+    bool HasReloaded();
+
+private:
+    struct Shader
+    {
+        std::wstring path;
+        std::vector<std::string> defines;
+        std::string entryPoint;
+        std::string target;
+        UINT flags;
+        ID3D11DeviceChild** ppShader; // Null once unregistered, entry is kept as indices are in flight
+        std::vector<ShaderCache::Dependency> dependencies;
+    };
+
+    struct Reloaded
+    {
+        size_t shaderIdx;
+        ID3D11DeviceChild* pShader;
+        std::vector<ShaderCache::Dependency> dependencies;
+    };
+
+    void WorkerLoop();
+    void Reload(const Shader& shader, size_t shaderIdx);
+
+private:
+    ID3D11Device* m_pDevice;
+
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_stopCV;
+    bool m_stop;
+
+    // Guarded by m_mutex
+    std::vector<Shader> m_shaders;
+    std::vector<Reloaded> m_reloaded;
+    UINT m_flags;
+    bool m_flagsChanged;
+
+    // Only accessed by worker
+    ShaderCache m_cache;
+    std::map<std::string, UINT64> m_writeTimes;
+
+    UINT m_reloadCount;
+};
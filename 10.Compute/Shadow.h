@@ -0,0 +1,51 @@
+#include "SceneCB.h"
+
+static const uint CascadeCount = 4; // Should match Renderer::CascadeCount
+
+// Rewritten when camera moves
+cbuffer ShadowBuffer : register (b4)
+{
+    float4x4 cascadeVp[CascadeCount];
+    float4 cascadeSplits; // View depth where each cascade ends
+    float4 sunDir; // Direction to the sun
+    float4 sunColor; // w - 1 if sun is on
+    float4 shadowParams; // x - shadows on, y - depth bias, z - cascade size in texels
+    float4 cameraDir;
+};
+
+// Cascades are side by side in atlas, reversed Z, so depth is 1 nearest to the sun
+Texture2D<float> shadowAtlas : register (t7);
+SamplerComparisonState shadowSampler : register (s1);
+
+float SunShadow(in float3 pos)
+{
+    if (shadowParams.x == 0)
+    {
+        return 1.0;
+    }
+
+    // Cascade is selected by view depth, nothing is shadowed past the last one
+    float viewDepth = dot(pos - cameraPos.xyz, cameraDir.xyz);
+    uint cascade = (uint)dot(float4(viewDepth > cascadeSplits), float4(1, 1, 1, 1));
+    if (cascade >= CascadeCount)
+    {
+        return 1.0;
+    }
+
+    float4 clip = mul(cascadeVp[cascade], float4(pos, 1.0));
+    float2 uv = float2(clip.x * 0.5 + 0.5, 0.5 - clip.y * 0.5);
+    uv.x = (saturate(uv.x) + cascade) / CascadeCount;
+
+    // Receiver is lit when it is at least as close to the sun as the stored depth
+    float depth = clip.z + shadowParams.y;
+    float2 texel = float2(1.0 / (shadowParams.z * CascadeCount), 1.0 / shadowParams.z);
+
+    // 2x2 bilinear comparisons, so PCF covers 3x3 texels
+    float lit = 0.0;
+    lit += shadowAtlas.SampleCmpLevelZero(shadowSampler, uv + float2(-0.5, -0.5) * texel, depth);
+    lit += shadowAtlas.SampleCmpLevelZero(shadowSampler, uv + float2(0.5, -0.5) * texel, depth);
+    lit += shadowAtlas.SampleCmpLevelZero(shadowSampler, uv + float2(-0.5, 0.5) * texel, depth);
+    lit += shadowAtlas.SampleCmpLevelZero(shadowSampler, uv + float2(0.5, 0.5) * texel, depth);
+
+    return lit * 0.25;
+}
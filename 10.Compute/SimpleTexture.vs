@@ -1,31 +1,29 @@
 #include "SceneCB.h"
+#include "Instances.h"
+#ifdef MULTI_VIEW
+#include "MultiView.h"
+#endif // MULTI_VIEW
+#ifdef INSTANCE_TRANSFORMS
+#include "InstanceTransform.h"
 
-struct GeomBuffer
-{
-    float4x4 model;
-    float4x4 norm;
-    float4 shineSpeedTexIdNM; // x - shininess, y - rotation speed, z - texture id, w - normal map presence
-    float4 posAngle; // xyz - position, w - current angle
-};
-
-cbuffer GeomBufferInst : register (b1)
-{
-    GeomBuffer geomBuffer[100];
-};
-
-cbuffer GeomBufferInstVis : register (b2)
-{
-    uint4 ids[100];
-};
+StructuredBuffer<InstanceTransform> transforms : register (t4); // Of visible instances in draw order, built after culling
+StructuredBuffer<uint> drawBases : register (t5);
+#endif // INSTANCE_TRANSFORMS
 
 struct VSInput
 {
+#ifdef PACKED_VERTEX
+    float3 pos : POSITION;
+    float4 normTang : NORMAL; // Octahedral normal in xy, tangent in zw
+    float2 uv : TEXCOORD;
+#else
     float3 pos : POSITION;
     float3 tang : TANGENT;
     float3 norm : NORMAL;
     float2 uv : TEXCOORD;
+#endif
 
-    unsigned int instanceId : SV_InstanceID;
+    unsigned int drawInstance : INSTANCE; // Index into visible ids, offset to mesh segment by start instance
 };
 
 struct VSOutput
@@ -37,22 +35,79 @@ struct VSOutput
     float2 uv : TEXCOORD;
 
     nointerpolation unsigned int instanceId : SV_InstanceID;
+#ifdef MULTI_VIEW
+    unsigned int viewport : SV_ViewportArrayIndex; // Each view has own viewport
+#endif // MULTI_VIEW
+#ifdef MOTION_VECTORS
+    float4 curPos : CURRENT_POSITION; // Without jitter
+    float4 prevPos : PREVIOUS_POSITION;
+#endif // MOTION_VECTORS
 };
 
+#ifdef PACKED_VERTEX
+float3 OctDecode(float2 e)
+{
+    float3 v = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0)
+    {
+        v.xy = (1.0 - abs(v.yx)) * float2(v.x >= 0 ? 1.0 : -1.0, v.y >= 0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+#endif
+
 VSOutput vs(VSInput vertex)
 {
     VSOutput result;
 
-    unsigned int idx = lightCount.w == 1 ? ids[vertex.instanceId].x : vertex.instanceId;
+#ifdef PACKED_VERTEX
+    float3 tang = OctDecode(vertex.normTang.zw);
+    float3 norm = OctDecode(vertex.normTang.xy);
+#else
+    float3 tang = vertex.tang;
+    float3 norm = vertex.norm;
+#endif
+
+#if defined(INSTANCE_TRANSFORMS)
+    // Draw base is the same for all vertices of a draw, so the only divergent fetch is the transform itself
+    InstanceTransform transform = transforms[drawBases[vertex.drawInstance / MeshSegmentSize] + vertex.drawInstance % MeshSegmentSize];
+    float3x4 model = float3x4(transform.model[0], transform.model[1], transform.model[2]);
+#elif defined(MULTI_VIEW)
+    unsigned int view = ids[vertex.drawInstance] >> ViewShift;
+    unsigned int idx = ids[vertex.drawInstance] & ViewIdMask;
+    float3x4 model = GetModel(geomBuffer[idx]);
+#else
+    unsigned int idx = ids[vertex.drawInstance];
+    float3x4 model = GetModel(geomBuffer[idx]);
+#endif
 
-    float4 worldPos = mul(geomBuffer[idx].model, float4(vertex.pos, 1.0));
+    float4 worldPos = float4(mul(model, float4(vertex.pos, 1.0)), 1.0);
 
+#if defined(INSTANCE_TRANSFORMS)
+    result.pos = mul(transform.mvp, float4(vertex.pos, 1.0));
+#elif defined(MULTI_VIEW)
+    result.pos = mul(viewVp[view], worldPos);
+    result.viewport = view;
+#else
     result.pos = mul(vp, worldPos);
+#endif
     result.worldPos = worldPos;
     result.uv = vertex.uv;
-    result.tang = mul(geomBuffer[idx].norm, float4(vertex.tang, 0)).xyz;
-    result.norm = mul(geomBuffer[idx].norm, float4(vertex.norm, 0)).xyz;
-    result.instanceId = vertex.instanceId;
+
+    // Rigid transform with uniform scale at most, so its rotation part transforms normals too, length is restored in pixel shader
+    result.tang = mul((float3x3)model, tang);
+    result.norm = mul((float3x3)model, norm);
+    result.instanceId = vertex.drawInstance;
+
+#ifdef MOTION_VECTORS
+    // Instances only rotate around Y at constant speed, so previous transform is the current one rotated back by animation time of the frame
+    float s, c;
+    sincos(geomBuffer[idx].speed * motionParams.z, s, c);
+    float3 prevLocal = float3(c * vertex.pos.x + s * vertex.pos.z, vertex.pos.y, c * vertex.pos.z - s * vertex.pos.x);
+    result.curPos = result.pos;
+    result.curPos.xy -= motionParams.xy * result.pos.w;
+    result.prevPos = mul(prevVp, float4(mul(model, float4(prevLocal, 1.0)), 1.0));
+#endif // MOTION_VECTORS
 
     return result;
 }
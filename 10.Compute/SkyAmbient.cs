@@ -0,0 +1,101 @@
+cbuffer SkyAmbientParams : register(b0)
+{
+    float4 ambientParams; // x - intensity
+};
+
+TextureCube<float4> sky : register(t0);
+SamplerState skySampler : register(s0);
+
+// Irradiance in L2 spherical harmonics, layout of AmbientBuffer in Light.h
+RWBuffer<float4> coeffs : register(u0);
+
+static const uint ThreadCount = 256;
+static const uint GridSize = 64; // Samples per face side, finer detail of the sky does not reach L2 anyway
+static const uint CoeffCount = 9;
+static const float Pi = 3.14159265;
+
+// Squared constant factors of basis functions, once for projection and once for evaluation,
+// times cosine lobe convolution of each band divided by pi, so coefficients give diffuse light directly
+static const float CoeffScale[CoeffCount] = {
+    0.282095 * 0.282095,
+    0.488603 * 0.488603 * 2.0 / 3.0, 0.488603 * 0.488603 * 2.0 / 3.0, 0.488603 * 0.488603 * 2.0 / 3.0,
+    1.092548 * 1.092548 * 0.25, 1.092548 * 1.092548 * 0.25, 0.315392 * 0.315392 * 0.25, 1.092548 * 1.092548 * 0.25, 0.546274 * 0.546274 * 0.25
+};
+
+groupshared float4 partialSums[ThreadCount];
+
+// Basis functions without constant factors, order matches SkyAmbient in Light.h
+void Basis(in float3 n, out float basis[CoeffCount])
+{
+    basis[0] = 1.0;
+    basis[1] = n.y;
+    basis[2] = n.z;
+    basis[3] = n.x;
+    basis[4] = n.x * n.y;
+    basis[5] = n.y * n.z;
+    basis[6] = 3.0 * n.z * n.z - 1.0;
+    basis[7] = n.x * n.z;
+    basis[8] = n.x * n.x - n.y * n.y;
+}
+
+// Single group, the pass runs only when the sky changes
+[numthreads(ThreadCount, 1, 1)]
+void cs(uint localIdx : SV_GroupIndex)
+{
+    float3 sums[CoeffCount];
+    [unroll]
+    for (uint k = 0; k < CoeffCount; k++)
+    {
+        sums[k] = float3(0, 0, 0);
+    }
+    float weightSum = 0.0;
+
+    for (uint i = localIdx; i < 6 * GridSize * GridSize; i += ThreadCount)
+    {
+        uint face = i / (GridSize * GridSize);
+        uint texel = i % (GridSize * GridSize);
+        float2 uv = (float2(texel % GridSize, texel / GridSize) + 0.5) * (2.0 / GridSize) - 1.0;
+
+        // Faces are only required to cover the sphere, so the layout does not follow the cubemap one
+        float3 dir = face < 2 ? float3(1.0, uv) : (face < 4 ? float3(uv.x, 1.0, uv.y) : float3(uv, 1.0));
+        dir = (face & 1) != 0 ? -dir : dir;
+
+        // Solid angle of the sample, constant part cancels out in normalization by the sum
+        float lengthSq = 1.0 + dot(uv, uv);
+        float weight = rsqrt(lengthSq) / lengthSq;
+        dir *= rsqrt(lengthSq);
+
+        float3 color = sky.SampleLevel(skySampler, dir, 0).xyz * weight;
+        float basis[CoeffCount];
+        Basis(dir, basis);
+        [unroll]
+        for (uint k = 0; k < CoeffCount; k++)
+        {
+            sums[k] += color * (basis[k] * CoeffScale[k]);
+        }
+        weightSum += weight;
+    }
+
+    [unroll]
+    for (uint k = 0; k < CoeffCount; k++)
+    {
+        partialSums[localIdx] = float4(sums[k], weightSum);
+        GroupMemoryBarrierWithGroupSync();
+        for (uint stride = ThreadCount / 2; stride > 0; stride /= 2)
+        {
+            if (localIdx < stride)
+            {
+                partialSums[localIdx] += partialSums[localIdx + stride];
+            }
+            GroupMemoryBarrierWithGroupSync();
+        }
+
+        if (localIdx == 0)
+        {
+            // Weights add up to the full sphere
+            float4 total = partialSums[0];
+            coeffs[k] = float4(total.xyz * (4.0 * Pi / total.w) * ambientParams.x, 0.0);
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+}
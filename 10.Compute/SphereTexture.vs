@@ -2,17 +2,17 @@ cbuffer SceneBuffer : register (b0)
 {
     float4x4 vp;
     float4 cameraPos;
-};
-
-cbuffer GeomBuffer : register (b1)
-{
-    float4x4 model;
-    float4 size; // x - size of sphere
+    float4 frustum[6];
+    float4x4 invVp;
 };
 
 struct VSInput
 {
+#ifdef SCREEN_TRIANGLE
+    uint vertexId : SV_VertexID;
+#else
     float3 pos : POSITION;
+#endif // !SCREEN_TRIANGLE
 };
 
 struct VSOutput
@@ -21,15 +21,24 @@ struct VSOutput
     float3 localPos : POSITION1;
 };
 
+// Sky is put at far plane, which is depth 0 with reversed Z
 VSOutput vs(VSInput vertex)
 {
     VSOutput result;
 
-    float3 pos = cameraPos.xyz + vertex.pos * size.x;
+#ifdef SCREEN_TRIANGLE
+    // Triangle covering the viewport, view ray goes through the point on near plane and is linear in screen space
+    float2 uv = float2((vertex.vertexId << 1) & 2, vertex.vertexId & 2);
+    result.pos = float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
 
-    result.pos = mul(vp, mul(model, float4(pos, 1.0)));
+    float4 nearPos = mul(invVp, float4(result.pos.xy, 1, 1));
+    result.localPos = nearPos.xyz / nearPos.w - cameraPos.xyz;
+#else
+    // Directions are transformed without translation, so sphere is at infinity and needs no size
+    result.pos = mul(vp, float4(vertex.pos, 0.0));
     result.pos.z = 0;
     result.localPos = vertex.pos;
+#endif // !SCREEN_TRIANGLE
 
     return result;
 }
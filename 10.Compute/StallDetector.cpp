@@ -0,0 +1,187 @@
+#include "framework.h"
+
+#include "StallDetector.h"
+#include "CpuProfiler.h"
+
+#include <dxgi.h>
+#include <string.h>
+
+#include "imgui.h"
+
+namespace
+{
+
+const char* CallTypeNames[StallDetector::CallTypeCount] = { "Map", "UpdateSubresource", "GetData", "Present" };
+
+// File name of site, full path of __FILE__ is too long for the list
+const char* ShortSite(const char* site)
+{
+    const char* pSlash = strrchr(site, '\\');
+    const char* pForwardSlash = strrchr(site, '/');
+    if (pForwardSlash != nullptr && (pSlash == nullptr || pForwardSlash > pSlash))
+    {
+        pSlash = pForwardSlash;
+    }
+    return pSlash != nullptr ? pSlash + 1 : site;
+}
+
+}
+
+const float StallDetector::VsyncAllowanceMs = 1000.0f / 60.0f;
+
+StallDetector& StallDetector::Get()
+{
+    static StallDetector detector;
+    return detector;
+}
+
+StallDetector::StallDetector()
+    : m_enabled(true)
+    , m_probe(true)
+    , m_thresholdMs(1.0f)
+    , m_msPerTick(0.0)
+    , m_frame(0)
+    , m_stallPos(0)
+    , m_totalStalls(0)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_msPerTick = 1000.0 / (double)frequency.QuadPart;
+
+    memset(m_stalls, 0, sizeof(m_stalls));
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+HRESULT StallDetector::Map(ID3D11DeviceContext* pContext, ID3D11Resource* pResource, UINT subresource, D3D11_MAP mapType, UINT flags,
+    D3D11_MAPPED_SUBRESOURCE* pMapped, const char* site)
+{
+    INT64 begin = CpuProfiler::GetTicks();
+
+    // Do not wait is only allowed for maps which may wait, discard and no overwrite maps never use it
+    bool probed = false;
+    if (m_enabled && m_probe && mapType != D3D11_MAP_WRITE_DISCARD && mapType != D3D11_MAP_WRITE_NO_OVERWRITE
+        && (flags & D3D11_MAP_FLAG_DO_NOT_WAIT) == 0)
+    {
+        HRESULT result = pContext->Map(pResource, subresource, mapType, flags | D3D11_MAP_FLAG_DO_NOT_WAIT, pMapped);
+        if (result != DXGI_ERROR_WAS_STILL_DRAWING)
+        {
+            Record(site, CallMap, begin, m_thresholdMs, false);
+            return result;
+        }
+        probed = true;
+    }
+
+    HRESULT result = pContext->Map(pResource, subresource, mapType, flags, pMapped);
+    Record(site, CallMap, begin, m_thresholdMs, probed);
+
+    return result;
+}
+
+void StallDetector::UpdateSubresource(ID3D11DeviceContext* pContext, ID3D11Resource* pResource, UINT subresource, const D3D11_BOX* pBox,
+    const void* pData, UINT rowPitch, UINT depthPitch, const char* site)
+{
+    INT64 begin = CpuProfiler::GetTicks();
+    pContext->UpdateSubresource(pResource, subresource, pBox, pData, rowPitch, depthPitch);
+    Record(site, CallUpdateSubresource, begin, m_thresholdMs, false);
+}
+
+HRESULT StallDetector::GetData(ID3D11DeviceContext* pContext, ID3D11Asynchronous* pAsync, void* pData, UINT size, UINT flags, const char* site)
+{
+    INT64 begin = CpuProfiler::GetTicks();
+    HRESULT result = pContext->GetData(pAsync, pData, size, flags);
+    Record(site, CallGetData, begin, m_thresholdMs, false);
+
+    return result;
+}
+
+HRESULT StallDetector::Present(IDXGISwapChain* pSwapChain, UINT syncInterval, UINT flags, const char* site)
+{
+    INT64 begin = CpuProfiler::GetTicks();
+    HRESULT result = pSwapChain->Present(syncInterval, flags);
+    Record(site, CallPresent, begin, m_thresholdMs + VsyncAllowanceMs * syncInterval, false);
+
+    return result;
+}
+
+void StallDetector::Record(const char* site, CallType type, INT64 begin, float thresholdMs, bool probed)
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    float ms = (float)((CpuProfiler::GetTicks() - begin) * m_msPerTick);
+    if (ms < thresholdMs && !probed)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stalls[m_stallPos] = Stall{ site, type, m_frame, ms, probed };
+    m_stallPos = (m_stallPos + 1) % MaxStalls;
+    ++m_totalStalls;
+    ++m_counts[type];
+}
+
+void StallDetector::ShowWindow()
+{
+    ImGui::Begin("Stalls");
+
+    ImGui::Checkbox("Enabled", &m_enabled);
+    ImGui::SameLine();
+    ImGui::Checkbox("Probe maps", &m_probe);
+    ImGui::SliderFloat("Threshold, ms", &m_thresholdMs, 0.1f, 10.0f, "%.1f");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ImGui::Text("Frame %llu, stalls %llu", m_frame, m_totalStalls.load());
+    for (UINT i = 0; i < CallTypeCount; i++)
+    {
+        ImGui::Text("%s %llu", CallTypeNames[i], m_counts[i]);
+        if (i + 1 < CallTypeCount)
+        {
+            ImGui::SameLine();
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+    {
+        memset(m_stalls, 0, sizeof(m_stalls));
+        memset(m_counts, 0, sizeof(m_counts));
+        m_stallPos = 0;
+        m_totalStalls = 0;
+    }
+
+    ImGui::Separator();
+
+    // Most recent first
+    if (ImGui::BeginTable("Stalls", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Frame");
+        ImGui::TableSetupColumn("Call");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("Site");
+        ImGui::TableHeadersRow();
+
+        for (UINT i = 0; i < MaxStalls; i++)
+        {
+            const Stall& stall = m_stalls[(m_stallPos + MaxStalls - 1 - i) % MaxStalls];
+            if (stall.site == nullptr)
+            {
+                break;
+            }
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", stall.frame);
+            ImGui::TableNextColumn();
+            ImGui::Text("%s%s", CallTypeNames[stall.type], stall.probed ? " (busy)" : "");
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", stall.ms);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(ShortSite(stall.site));
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <atomic>
+#include <mutex>
+
+/**
+ * Timing of context calls which may wait for GPU, such as Map, UpdateSubresource, GetData and Present.
+ * Call above threshold is recorded as a stall with its call site and frame number.
+ * Probing maps first with D3D11_MAP_FLAG_DO_NOT_WAIT, so map which would wait is recorded even if it was short.
+ * Calls on deferred contexts never wait, they are timed the same way though.
+ */
+class StallDetector
+{
+public:
+    static const UINT MaxStalls = 64; ///< Most recent ones are kept
+    static const float VsyncAllowanceMs; ///< Present is expected to wait that long per sync interval
+
+    enum CallType
+    {
+        CallMap = 0,
+        CallUpdateSubresource,
+        CallGetData,
+        CallPresent,
+
+        CallTypeCount
+    };
+
+    struct Stall
+    {
+        const char* site; // File and line
+        CallType type;
+        UINT64 frame;
+        float ms;
+        bool probed; // Probe reported resource still in use
+    };
+
+    static StallDetector& Get();
+
+    void BeginFrame() { ++m_frame; }
+
+    HRESULT Map(ID3D11DeviceContext* pContext, ID3D11Resource* pResource, UINT subresource, D3D11_MAP mapType, UINT flags,
+        D3D11_MAPPED_SUBRESOURCE* pMapped, const char* site);
+    void UpdateSubresource(ID3D11DeviceContext* pContext, ID3D11Resource* pResource, UINT subresource, const D3D11_BOX* pBox,
+        const void* pData, UINT rowPitch, UINT depthPitch, const char* site);
+    HRESULT GetData(ID3D11DeviceContext* pContext, ID3D11Asynchronous* pAsync, void* pData, UINT size, UINT flags, const char* site);
+    HRESULT Present(IDXGISwapChain* pSwapChain, UINT syncInterval, UINT flags, const char* site);
+
+    /** Stalls recorded since start or last clear, readable without lock */
+    inline UINT64 GetTotalStalls() const { return m_totalStalls.load(std::memory_order_relaxed); }
+
+    /** Show threshold controls and recent stalls in ImGui window */
+    void ShowWindow();
+
+private:
+    StallDetector();
+
+    void Record(const char* site, CallType type, INT64 begin, float thresholdMs, bool probed);
+
+private:
+    bool m_enabled;
+    bool m_probe;
+    float m_thresholdMs;
+    double m_msPerTick;
+    UINT64 m_frame;
+
+    std::mutex m_mutex; // Calls may come from recording threads
+    Stall m_stalls[MaxStalls]; // Ring, guarded by mutex
+    UINT m_stallPos;
+    std::atomic<UINT64> m_totalStalls;
+    UINT64 m_counts[CallTypeCount];
+};
+
+#define STALL_STRINGIZE_IMPL(a) #a
+#define STALL_STRINGIZE(a) STALL_STRINGIZE_IMPL(a)
+#define STALL_SITE __FILE__ ":" STALL_STRINGIZE(__LINE__)
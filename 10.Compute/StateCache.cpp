@@ -0,0 +1,350 @@
+#include "framework.h"
+
+#include "StateCache.h"
+
+#include <initializer_list>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace
+{
+    // Value which never matches a real object, marks unknown state
+    template <typename T>
+    T* Unknown() { return reinterpret_cast<T*>(~(uintptr_t)0); }
+
+    template <typename T, size_t N>
+    void Fill(T* (&pItems)[N], T* pValue)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            pItems[i] = pValue;
+        }
+    }
+}
+
+void StateCache::SetAll(void* pValue)
+{
+    Fill(m_pRTVs, (ID3D11RenderTargetView*)pValue);
+    m_rtvCount = pValue == nullptr ? 0 : UINT_MAX;
+    m_pDSV = (ID3D11DepthStencilView*)pValue;
+    m_pDepthState = (ID3D11DepthStencilState*)pValue;
+    m_stencilRef = 0;
+    m_pBlendState = (ID3D11BlendState*)pValue;
+    for (int i = 0; i < 4; i++)
+    {
+        m_blendFactor[i] = 1.0f;
+    }
+    m_sampleMask = 0xFFFFFFFF;
+    m_pRasterizerState = (ID3D11RasterizerState*)pValue;
+    m_viewportValid = false;
+    m_scissorValid = false;
+
+    m_pIndexBuffer = (ID3D11Buffer*)pValue;
+    m_indexFormat = DXGI_FORMAT_UNKNOWN;
+    m_indexOffset = 0;
+    Fill(m_pVertexBuffers, (ID3D11Buffer*)pValue);
+    for (UINT i = 0; i < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; i++)
+    {
+        m_vertexStrides[i] = 0;
+        m_vertexOffsets[i] = 0;
+    }
+    m_pInputLayout = (ID3D11InputLayout*)pValue;
+    m_topology = pValue == nullptr ? D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED : (D3D11_PRIMITIVE_TOPOLOGY)-1;
+
+    m_pVS = (ID3D11VertexShader*)pValue;
+    m_pPS = (ID3D11PixelShader*)pValue;
+    for (StageState* pStage : { &m_vs, &m_ps })
+    {
+        Fill(pStage->pConstantBuffers, (ID3D11Buffer*)pValue);
+        Fill(pStage->pViews, (ID3D11ShaderResourceView*)pValue);
+        Fill(pStage->pSamplers, (ID3D11SamplerState*)pValue);
+    }
+}
+
+void StateCache::Invalidate()
+{
+    SetAll(Unknown<void>());
+}
+
+void StateCache::ResetToDefault()
+{
+    SetAll(nullptr);
+}
+
+bool StateCache::Filter(bool changed)
+{
+    if (changed)
+    {
+        ++m_issued;
+    }
+    else
+    {
+        ++m_skipped;
+    }
+    return changed;
+}
+
+template <typename T>
+bool StateCache::FilterSlots(T** pCached, UINT& startSlot, UINT& count, T* const*& ppItems)
+{
+    // Trim unchanged slots at both ends of the range
+    UINT first = 0;
+    while (first < count && pCached[startSlot + first] == ppItems[first])
+    {
+        ++first;
+    }
+    if (first == count)
+    {
+        return Filter(false);
+    }
+    UINT last = count;
+    while (pCached[startSlot + last - 1] == ppItems[last - 1])
+    {
+        --last;
+    }
+
+    for (UINT i = first; i < last; i++)
+    {
+        pCached[startSlot + i] = ppItems[i];
+    }
+    startSlot += first;
+    ppItems += first;
+    count = last - first;
+
+    return Filter(true);
+}
+
+void StateCache::OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* ppRTVs, ID3D11DepthStencilView* pDSV)
+{
+    bool changed = count != m_rtvCount || pDSV != m_pDSV;
+    for (UINT i = 0; i < count && !changed; i++)
+    {
+        changed = m_pRTVs[i] != ppRTVs[i];
+    }
+    if (Filter(changed))
+    {
+        if (m_pOMUAV != nullptr)
+        {
+            m_pContext->OMSetRenderTargetsAndUnorderedAccessViews(count, ppRTVs, pDSV, m_omUAVSlot, 1, &m_pOMUAV, nullptr);
+        }
+        else
+        {
+            m_pContext->OMSetRenderTargets(count, ppRTVs, pDSV);
+        }
+
+        for (UINT i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+        {
+            m_pRTVs[i] = i < count ? ppRTVs[i] : nullptr;
+        }
+        m_rtvCount = count;
+        m_pDSV = pDSV;
+
+        // Runtime unbinds shader resources of the new targets, so cached views can't be trusted
+        Fill(m_vs.pViews, Unknown<ID3D11ShaderResourceView>());
+        Fill(m_ps.pViews, Unknown<ID3D11ShaderResourceView>());
+    }
+}
+
+void StateCache::OMSetDepthStencilState(ID3D11DepthStencilState* pState, UINT stencilRef)
+{
+    if (Filter(pState != m_pDepthState || stencilRef != m_stencilRef))
+    {
+        m_pContext->OMSetDepthStencilState(pState, stencilRef);
+        m_pDepthState = pState;
+        m_stencilRef = stencilRef;
+    }
+}
+
+void StateCache::OMSetBlendState(ID3D11BlendState* pState, const FLOAT blendFactor[4], UINT sampleMask)
+{
+    static const FLOAT DefaultFactor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    const FLOAT* pFactor = blendFactor != nullptr ? blendFactor : DefaultFactor;
+    if (Filter(pState != m_pBlendState || sampleMask != m_sampleMask || memcmp(pFactor, m_blendFactor, sizeof(m_blendFactor)) != 0))
+    {
+        m_pContext->OMSetBlendState(pState, blendFactor, sampleMask);
+        m_pBlendState = pState;
+        memcpy(m_blendFactor, pFactor, sizeof(m_blendFactor));
+        m_sampleMask = sampleMask;
+    }
+}
+
+void StateCache::RSSetState(ID3D11RasterizerState* pState)
+{
+    if (Filter(pState != m_pRasterizerState))
+    {
+        m_pContext->RSSetState(pState);
+        m_pRasterizerState = pState;
+    }
+}
+
+void StateCache::RSSetViewports(UINT count, const D3D11_VIEWPORT* pViewports)
+{
+    // Only single viewport is tracked
+    bool changed = count != 1 || !m_viewportValid || memcmp(&m_viewport, pViewports, sizeof(D3D11_VIEWPORT)) != 0;
+    if (Filter(changed))
+    {
+        m_pContext->RSSetViewports(count, pViewports);
+        m_viewportValid = count == 1;
+        if (m_viewportValid)
+        {
+            m_viewport = pViewports[0];
+        }
+    }
+}
+
+void StateCache::RSSetScissorRects(UINT count, const D3D11_RECT* pRects)
+{
+    bool changed = count != 1 || !m_scissorValid || memcmp(&m_scissor, pRects, sizeof(D3D11_RECT)) != 0;
+    if (Filter(changed))
+    {
+        m_pContext->RSSetScissorRects(count, pRects);
+        m_scissorValid = count == 1;
+        if (m_scissorValid)
+        {
+            m_scissor = pRects[0];
+        }
+    }
+}
+
+void StateCache::IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT format, UINT offset)
+{
+    if (Filter(pBuffer != m_pIndexBuffer || format != m_indexFormat || offset != m_indexOffset))
+    {
+        m_pContext->IASetIndexBuffer(pBuffer, format, offset);
+        m_pIndexBuffer = pBuffer;
+        m_indexFormat = format;
+        m_indexOffset = offset;
+    }
+}
+
+void StateCache::IASetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides, const UINT* pOffsets)
+{
+    assert(startSlot + count <= D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT);
+
+    bool changed = false;
+    for (UINT i = 0; i < count && !changed; i++)
+    {
+        changed = m_pVertexBuffers[startSlot + i] != ppBuffers[i] || m_vertexStrides[startSlot + i] != pStrides[i] || m_vertexOffsets[startSlot + i] != pOffsets[i];
+    }
+    if (Filter(changed))
+    {
+        m_pContext->IASetVertexBuffers(startSlot, count, ppBuffers, pStrides, pOffsets);
+        for (UINT i = 0; i < count; i++)
+        {
+            m_pVertexBuffers[startSlot + i] = ppBuffers[i];
+            m_vertexStrides[startSlot + i] = pStrides[i];
+            m_vertexOffsets[startSlot + i] = pOffsets[i];
+        }
+    }
+}
+
+void StateCache::IASetInputLayout(ID3D11InputLayout* pLayout)
+{
+    if (Filter(pLayout != m_pInputLayout))
+    {
+        m_pContext->IASetInputLayout(pLayout);
+        m_pInputLayout = pLayout;
+    }
+}
+
+void StateCache::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+    if (Filter(topology != m_topology))
+    {
+        m_pContext->IASetPrimitiveTopology(topology);
+        m_topology = topology;
+    }
+}
+
+void StateCache::VSSetShader(ID3D11VertexShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT classInstanceCount)
+{
+    // Class instances are not tracked
+    if (Filter(pShader != m_pVS || classInstanceCount != 0))
+    {
+        m_pContext->VSSetShader(pShader, ppClassInstances, classInstanceCount);
+        m_pVS = classInstanceCount == 0 ? pShader : Unknown<ID3D11VertexShader>();
+    }
+}
+
+void StateCache::SetPixelShaderOverride(ID3D11PixelShader* pShader, ID3D11UnorderedAccessView* pUAV, UINT uavSlot)
+{
+    if (pUAV != m_pOMUAV)
+    {
+        // Render targets are kept, only UAV slot changes
+        UINT slot = pUAV != nullptr ? uavSlot : m_omUAVSlot;
+        m_pContext->OMSetRenderTargetsAndUnorderedAccessViews(D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, nullptr, nullptr, slot, 1, &pUAV, nullptr);
+    }
+    m_pPSOverride = pShader;
+    m_pOMUAV = pUAV;
+    m_omUAVSlot = uavSlot;
+}
+
+void StateCache::PSSetShader(ID3D11PixelShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT classInstanceCount)
+{
+    if (m_pPSOverride != nullptr && pShader != nullptr)
+    {
+        pShader = m_pPSOverride;
+    }
+    if (Filter(pShader != m_pPS || classInstanceCount != 0))
+    {
+        m_pContext->PSSetShader(pShader, ppClassInstances, classInstanceCount);
+        m_pPS = classInstanceCount == 0 ? pShader : Unknown<ID3D11PixelShader>();
+    }
+}
+
+void StateCache::VSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers)
+{
+    assert(startSlot + count <= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
+    if (FilterSlots(m_vs.pConstantBuffers, startSlot, count, ppBuffers))
+    {
+        m_pContext->VSSetConstantBuffers(startSlot, count, ppBuffers);
+    }
+}
+
+void StateCache::PSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers)
+{
+    assert(startSlot + count <= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
+    if (FilterSlots(m_ps.pConstantBuffers, startSlot, count, ppBuffers))
+    {
+        m_pContext->PSSetConstantBuffers(startSlot, count, ppBuffers);
+    }
+}
+
+void StateCache::VSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* ppViews)
+{
+    assert(startSlot + count <= D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT);
+    if (FilterSlots(m_vs.pViews, startSlot, count, ppViews))
+    {
+        m_pContext->VSSetShaderResources(startSlot, count, ppViews);
+    }
+}
+
+void StateCache::PSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* ppViews)
+{
+    assert(startSlot + count <= D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT);
+    if (FilterSlots(m_ps.pViews, startSlot, count, ppViews))
+    {
+        m_pContext->PSSetShaderResources(startSlot, count, ppViews);
+    }
+}
+
+void StateCache::PSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* ppSamplers)
+{
+    assert(startSlot + count <= D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT);
+    if (FilterSlots(m_ps.pSamplers, startSlot, count, ppSamplers))
+    {
+        m_pContext->PSSetSamplers(startSlot, count, ppSamplers);
+    }
+}
+
+void StateCache::SetPipeline(const Pipeline& pipeline)
+{
+    IASetInputLayout(pipeline.pInputLayout);
+    IASetPrimitiveTopology(pipeline.topology);
+    VSSetShader(pipeline.pVS, nullptr, 0);
+    PSSetShader(pipeline.pPS, nullptr, 0);
+    OMSetBlendState(pipeline.pBlendState, nullptr, 0xFFFFFFFF);
+    OMSetDepthStencilState(pipeline.pDepthState, 0);
+    RSSetState(pipeline.pRasterizerState);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <d3d11.h>
+
+/**
+ * Shaders, input layout and fixed function state of a draw, bound with one SetPipeline call.
+ * State objects come from StateObjectCache, so equal descriptions are equal pointers and binds are filtered by pointer.
+ */
+struct Pipeline
+{
+    ID3D11VertexShader* pVS;
+    ID3D11PixelShader* pPS; // Null for depth only draws
+    ID3D11InputLayout* pInputLayout; // Null for draws which generate vertices from ids
+    D3D11_PRIMITIVE_TOPOLOGY topology;
+    ID3D11BlendState* pBlendState;
+    ID3D11DepthStencilState* pDepthState;
+    ID3D11RasterizerState* pRasterizerState;
+};
+
+/**
+ * Filter for redundant state changes on a device context.
+ * Tracks bound graphics state and skips calls which don't change it, fully or partially for slot ranges.
+ * Code that changes state directly on the context should be followed by Invalidate.
+ */
+class StateCache
+{
+public:
+    StateCache()
+        : m_pContext(nullptr)
+        , m_pPSOverride(nullptr)
+        , m_pOMUAV(nullptr)
+        , m_omUAVSlot(0)
+        , m_issued(0)
+        , m_skipped(0)
+    {
+        Invalidate();
+    }
+
+    void SetContext(ID3D11DeviceContext* pContext) { m_pContext = pContext; Invalidate(); }
+    ID3D11DeviceContext* GetContext() const { return m_pContext; }
+
+    /** State is unknown, e.g. after direct context use */
+    void Invalidate();
+    /** State is known to be default, e.g. after ClearState, ExecuteCommandList or FinishCommandList */
+    void ResetToDefault();
+
+    /**
+     * Replace all pixel shaders but null ones of depth only draws, and keep UAV bound to output merger next to render targets.
+     * Debug views count fragments of unchanged passes this way. Slot should be above render targets of the passes, null turns it off.
+     * Null shader with UAV keeps pixel shaders and only binds UAV, for shaders which write it themselves
+     */
+    void SetPixelShaderOverride(ID3D11PixelShader* pShader, ID3D11UnorderedAccessView* pUAV, UINT uavSlot);
+
+    void ResetStats() { m_issued = 0; m_skipped = 0; }
+    UINT GetIssuedCount() const { return m_issued; }
+    UINT GetSkippedCount() const { return m_skipped; }
+
+    void OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* ppRTVs, ID3D11DepthStencilView* pDSV);
+    void OMSetDepthStencilState(ID3D11DepthStencilState* pState, UINT stencilRef);
+    void OMSetBlendState(ID3D11BlendState* pState, const FLOAT blendFactor[4], UINT sampleMask);
+    void RSSetState(ID3D11RasterizerState* pState);
+    void RSSetViewports(UINT count, const D3D11_VIEWPORT* pViewports);
+    void RSSetScissorRects(UINT count, const D3D11_RECT* pRects);
+
+    void IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT format, UINT offset);
+    void IASetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides, const UINT* pOffsets);
+    void IASetInputLayout(ID3D11InputLayout* pLayout);
+    void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+
+    void VSSetShader(ID3D11VertexShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT classInstanceCount);
+    void PSSetShader(ID3D11PixelShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT classInstanceCount);
+    void VSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers);
+    void PSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const* ppBuffers);
+    void VSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* ppViews);
+    void PSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const* ppViews);
+    void PSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const* ppSamplers);
+
+    /** Each part of pipeline is filtered separately, so pipelines sharing states only rebind what differs */
+    void SetPipeline(const Pipeline& pipeline);
+
+    // Draws are passed through, so passes use the cache only
+    void Draw(UINT vertexCount, UINT startVertex) { m_pContext->Draw(vertexCount, startVertex); }
+    void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) { m_pContext->DrawIndexed(indexCount, startIndex, baseVertex); }
+    void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+    {
+        m_pContext->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+    }
+    void DrawInstanced(UINT vertexCount, UINT instanceCount, UINT startVertex, UINT startInstance)
+    {
+        m_pContext->DrawInstanced(vertexCount, instanceCount, startVertex, startInstance);
+    }
+    void DrawIndexedInstancedIndirect(ID3D11Buffer* pArgs, UINT offset) { m_pContext->DrawIndexedInstancedIndirect(pArgs, offset); }
+    void DrawInstancedIndirect(ID3D11Buffer* pArgs, UINT offset) { m_pContext->DrawInstancedIndirect(pArgs, offset); }
+
+private:
+    template <typename T>
+    bool FilterSlots(T** pCached, UINT& startSlot, UINT& count, T* const*& ppItems);
+    bool Filter(bool changed);
+
+    void SetAll(void* pValue);
+
+    struct StageState
+    {
+        ID3D11Buffer* pConstantBuffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+        ID3D11ShaderResourceView* pViews[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+        ID3D11SamplerState* pSamplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+    };
+
+    ID3D11DeviceContext* m_pContext;
+
+    ID3D11RenderTargetView* m_pRTVs[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+    UINT m_rtvCount;
+    ID3D11DepthStencilView* m_pDSV;
+    ID3D11DepthStencilState* m_pDepthState;
+    UINT m_stencilRef;
+    ID3D11BlendState* m_pBlendState;
+    FLOAT m_blendFactor[4];
+    UINT m_sampleMask;
+    ID3D11RasterizerState* m_pRasterizerState;
+    bool m_viewportValid;
+    D3D11_VIEWPORT m_viewport;
+    bool m_scissorValid;
+    D3D11_RECT m_scissor;
+
+    ID3D11Buffer* m_pIndexBuffer;
+    DXGI_FORMAT m_indexFormat;
+    UINT m_indexOffset;
+    ID3D11Buffer* m_pVertexBuffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+    UINT m_vertexStrides[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+    UINT m_vertexOffsets[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+    ID3D11InputLayout* m_pInputLayout;
+    D3D11_PRIMITIVE_TOPOLOGY m_topology;
+
+    ID3D11VertexShader* m_pVS;
+    ID3D11PixelShader* m_pPS;
+    StageState m_vs;
+    StageState m_ps;
+
+    // Not a bound state, kept by Invalidate and ResetToDefault
+    ID3D11PixelShader* m_pPSOverride;
+    ID3D11UnorderedAccessView* m_pOMUAV;
+    UINT m_omUAVSlot;
+
+    UINT m_issued;
+    UINT m_skipped;
+};
@@ -0,0 +1,128 @@
+#include "framework.h"
+
+#include "StateObjectCache.h"
+
+namespace
+{
+
+// FNV-1a over description bytes
+size_t HashDesc(const void* pDesc, size_t size)
+{
+    const unsigned char* pBytes = (const unsigned char*)pDesc;
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ pBytes[i]) * 1099511628211ull;
+    }
+    return (size_t)hash;
+}
+
+// Descriptions are keyed by bytes, so padding is cleared where a description has it
+template <typename Desc>
+Desc MakeKey(const Desc& desc)
+{
+    return desc;
+}
+
+D3D11_DEPTH_STENCIL_DESC MakeKey(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+    // Two bytes of padding follow stencil masks
+    D3D11_DEPTH_STENCIL_DESC key;
+    memset(&key, 0, sizeof(key));
+    key.DepthEnable = desc.DepthEnable;
+    key.DepthWriteMask = desc.DepthWriteMask;
+    key.DepthFunc = desc.DepthFunc;
+    key.StencilEnable = desc.StencilEnable;
+    key.StencilReadMask = desc.StencilReadMask;
+    key.StencilWriteMask = desc.StencilWriteMask;
+    key.FrontFace = desc.FrontFace;
+    key.BackFace = desc.BackFace;
+    return key;
+}
+
+HRESULT CreateState(ID3D11Device* pDevice, const D3D11_BLEND_DESC& desc, ID3D11BlendState** ppState)
+{
+    return pDevice->CreateBlendState(&desc, ppState);
+}
+
+HRESULT CreateState(ID3D11Device* pDevice, const D3D11_DEPTH_STENCIL_DESC& desc, ID3D11DepthStencilState** ppState)
+{
+    return pDevice->CreateDepthStencilState(&desc, ppState);
+}
+
+HRESULT CreateState(ID3D11Device* pDevice, const D3D11_RASTERIZER_DESC& desc, ID3D11RasterizerState** ppState)
+{
+    return pDevice->CreateRasterizerState(&desc, ppState);
+}
+
+}
+
+template <typename Desc, typename State>
+HRESULT StateObjectCache::Table<Desc, State>::Get(ID3D11Device* pDevice, const Desc& desc, const std::string& name, State** ppState)
+{
+    Entry entry;
+    entry.desc = MakeKey(desc);
+    entry.pState = nullptr;
+
+    size_t hash = HashDesc(&entry.desc, sizeof(entry.desc));
+    auto range = m_entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (memcmp(&it->second.desc, &entry.desc, sizeof(entry.desc)) == 0)
+        {
+            *ppState = it->second.pState;
+            return S_OK;
+        }
+    }
+
+    HRESULT result = CreateState(pDevice, entry.desc, &entry.pState);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(entry.pState, name);
+    }
+    if (SUCCEEDED(result))
+    {
+        m_entries.insert(std::make_pair(hash, entry));
+        *ppState = entry.pState;
+    }
+    else
+    {
+        SAFE_RELEASE(entry.pState);
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+template <typename Desc, typename State>
+void StateObjectCache::Table<Desc, State>::Term()
+{
+    for (auto& item : m_entries)
+    {
+        SAFE_RELEASE(item.second.pState);
+    }
+    m_entries.clear();
+}
+
+HRESULT StateObjectCache::GetBlendState(ID3D11Device* pDevice, const D3D11_BLEND_DESC& desc, const std::string& name, ID3D11BlendState** ppState)
+{
+    return m_blendStates.Get(pDevice, desc, name, ppState);
+}
+
+HRESULT StateObjectCache::GetDepthStencilState(ID3D11Device* pDevice, const D3D11_DEPTH_STENCIL_DESC& desc, const std::string& name, ID3D11DepthStencilState** ppState)
+{
+    return m_depthStencilStates.Get(pDevice, desc, name, ppState);
+}
+
+HRESULT StateObjectCache::GetRasterizerState(ID3D11Device* pDevice, const D3D11_RASTERIZER_DESC& desc, const std::string& name, ID3D11RasterizerState** ppState)
+{
+    return m_rasterizerStates.Get(pDevice, desc, name, ppState);
+}
+
+void StateObjectCache::Term()
+{
+    m_blendStates.Term();
+    m_depthStencilStates.Term();
+    m_rasterizerStates.Term();
+}
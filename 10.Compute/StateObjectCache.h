@@ -0,0 +1,49 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+#include <unordered_map>
+
+/**
+ * Blend, depth stencil and rasterizer states shared by description.
+ * Descriptions are hashed and compared bytewise, so passes asking for the same state get the same object,
+ * which lets StateCache filter redundant binds by pointer. States are owned by the cache and live until Term.
+ */
+class StateObjectCache
+{
+public:
+    StateObjectCache() {}
+
+    /** State of given description, the name is set when it is created by the first request */
+    HRESULT GetBlendState(ID3D11Device* pDevice, const D3D11_BLEND_DESC& desc, const std::string& name, ID3D11BlendState** ppState);
+    HRESULT GetDepthStencilState(ID3D11Device* pDevice, const D3D11_DEPTH_STENCIL_DESC& desc, const std::string& name, ID3D11DepthStencilState** ppState);
+    HRESULT GetRasterizerState(ID3D11Device* pDevice, const D3D11_RASTERIZER_DESC& desc, const std::string& name, ID3D11RasterizerState** ppState);
+    void Term();
+
+    UINT GetCount() const { return m_blendStates.GetCount() + m_depthStencilStates.GetCount() + m_rasterizerStates.GetCount(); }
+
+private:
+    template <typename Desc, typename State>
+    class Table
+    {
+    public:
+        HRESULT Get(ID3D11Device* pDevice, const Desc& desc, const std::string& name, State** ppState);
+        void Term();
+
+        UINT GetCount() const { return (UINT)m_entries.size(); }
+
+    private:
+        struct Entry
+        {
+            Desc desc;
+            State* pState;
+        };
+
+        std::unordered_multimap<size_t, Entry> m_entries; // By hash of description
+    };
+
+    Table<D3D11_BLEND_DESC, ID3D11BlendState> m_blendStates;
+    Table<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> m_depthStencilStates;
+    Table<D3D11_RASTERIZER_DESC, ID3D11RasterizerState> m_rasterizerStates;
+};
@@ -0,0 +1,104 @@
+#include "framework.h"
+
+#include "TelemetryExport.h"
+
+#include <algorithm>
+
+bool TelemetryExport::Init(const wchar_t* name)
+{
+    const DWORD size = (DWORD)(sizeof(Header) + sizeof(Sample) * Capacity);
+    m_hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, size, name);
+    if (m_hMapping == nullptr)
+    {
+        return false;
+    }
+    // Another instance already exports under this name
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        Term();
+        return false;
+    }
+
+    BYTE* pView = static_cast<BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, size));
+    if (pView == nullptr)
+    {
+        Term();
+        return false;
+    }
+    // Mapping of page file is zero filled, so all sequences start even
+    m_pHeader = reinterpret_cast<Header*>(pView);
+    m_pSamples = reinterpret_cast<Sample*>(pView + sizeof(Header));
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_msPerTick = 1000.0 / frequency.QuadPart;
+
+    m_pHeader->headerSize = sizeof(Header);
+    m_pHeader->sampleSize = sizeof(Sample);
+    m_pHeader->capacity = Capacity;
+    m_pHeader->processId = GetCurrentProcessId();
+    m_pHeader->ticksPerSecond = frequency.QuadPart;
+    m_pHeader->published = 0;
+    m_pHeader->version = Version;
+    // Magic goes last, readers check it before anything else
+    MemoryBarrier();
+    m_pHeader->magic = Magic;
+
+    return true;
+}
+
+void TelemetryExport::Term()
+{
+    if (m_pHeader != nullptr)
+    {
+        UnmapViewOfFile(m_pHeader);
+        m_pHeader = nullptr;
+        m_pSamples = nullptr;
+    }
+    if (m_hMapping != nullptr)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+}
+
+void TelemetryExport::Publish(const Frame& frame)
+{
+    if (m_pHeader == nullptr)
+    {
+        return;
+    }
+
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    float frameMs = m_lastTime != 0 ? (float)((ticks.QuadPart - m_lastTime) * m_msPerTick) : 0.0f;
+    m_lastTime = ticks.QuadPart;
+
+    // Single writer, so plain stores with barriers around the payload are enough
+    Sample& sample = m_pSamples[m_frame % Capacity];
+    LONG64 sequence = sample.sequence;
+    sample.sequence = sequence + 1;
+    MemoryBarrier();
+
+    sample.frame = m_frame;
+    sample.time = ticks.QuadPart;
+    sample.frameMs = frameMs;
+    sample.gpuFrameMs = frame.gpuFrameMs;
+    sample.visibleInstances = frame.visibleInstances;
+    sample.instanceCount = frame.instanceCount;
+    sample.vramUsage = frame.vramUsage;
+    sample.vramBudget = frame.vramBudget;
+    sample.stalls = frame.stalls;
+    sample.passCount = std::min(frame.passCount, MaxPasses);
+    for (UINT i = 0; i < sample.passCount; i++)
+    {
+        strncpy_s(sample.passes[i].name, frame.passNames[i], _TRUNCATE);
+        sample.passes[i].ms = frame.passMs[i];
+    }
+
+    MemoryBarrier();
+    sample.sequence = sequence + 2;
+
+    ++m_frame;
+    InterlockedExchange64(&m_pHeader->published, (LONG64)m_frame);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <windows.h>
+
+/**
+ * Per frame statistics published to named shared memory, so external tools can poll a running process.
+ * Memory is a header followed by a ring of samples, written by the render thread only.
+ * Publishing is wait-free: sample is written in place with its sequence odd while it is written,
+ * then the published count is advanced, no locks and no waits for readers.
+ *
+ * Reader opens the mapping by name, reads published count, takes sample (published - 1) % capacity
+ * and copies it between two reads of its sequence, copy is consistent if both reads match and are even.
+ */
+class TelemetryExport
+{
+public:
+    static const UINT32 Magic = 0x4D4C4554; // "TELM"
+    static const UINT32 Version = 1;
+    static const UINT Capacity = 256;       ///< Samples in ring, reader polling slower than that loses samples
+    static const UINT MaxPasses = 32;       ///< GPU profiler scopes per sample
+    static const UINT PassNameLength = 28;
+
+    // Layout shared with readers, fields are naturally aligned
+
+    struct Pass
+    {
+        char name[PassNameLength]; // Truncated, null terminated
+        float ms;
+    };
+
+    struct Sample
+    {
+        volatile LONG64 sequence;
+        UINT64 frame;
+        INT64 time;              // QueryPerformanceCounter ticks
+        float frameMs;           // Between consecutive samples
+        float gpuFrameMs;        // Several frames old, as GPU times are
+        UINT32 visibleInstances;
+        UINT32 instanceCount;
+        UINT64 vramUsage;        // Zero if adapter can't report budget
+        UINT64 vramBudget;
+        UINT64 stalls;           // Since start
+        UINT32 passCount;
+        UINT32 reserved;
+        Pass passes[MaxPasses];
+    };
+
+    struct Header
+    {
+        UINT32 magic;
+        UINT32 version;
+        UINT32 headerSize;
+        UINT32 sampleSize;
+        UINT32 capacity;
+        UINT32 processId;
+        INT64 ticksPerSecond;
+        volatile LONG64 published; // Samples published since start
+    };
+
+    /** Values of a sample, filled by the renderer */
+    struct Frame
+    {
+        float gpuFrameMs;
+        UINT visibleInstances;
+        UINT instanceCount;
+        UINT64 vramUsage;
+        UINT64 vramBudget;
+        UINT64 stalls;
+        UINT passCount;
+        const char* passNames[MaxPasses];
+        float passMs[MaxPasses];
+    };
+
+    TelemetryExport()
+        : m_hMapping(nullptr)
+        , m_pHeader(nullptr)
+        , m_pSamples(nullptr)
+        , m_frame(0)
+        , m_lastTime(0)
+        , m_msPerTick(0.0)
+    {}
+
+    /** Create mapping of given name, such as Local\\DX11Tutorial.Telemetry. False if it is not available */
+    bool Init(const wchar_t* name);
+    void Term();
+
+    inline bool IsActive() const { return m_pHeader != nullptr; }
+
+    /** Write sample of the current frame, never blocks */
+    void Publish(const Frame& frame);
+
+private:
+    HANDLE m_hMapping;
+    Header* m_pHeader;
+    Sample* m_pSamples;
+    UINT64 m_frame;
+    INT64 m_lastTime;
+    double m_msPerTick;
+};
@@ -0,0 +1,105 @@
+#include "PostParams.h"
+
+// Should match NoMotion in Renderer.cpp, pixels not covered by instances keep it and are reprojected with camera motion
+static const float NoMotion = 1000.0;
+static const float ClampGamma = 1.25; // Of standard deviation of neighbourhood
+static const float MaxBlend = 0.1; // Weight of the new frame when its nearest sample is at pixel center
+
+cbuffer TemporalParams : register(b1)
+{
+    float4x4 reproject; // Jittered clip space of this frame to clip space of the previous one
+};
+
+Texture2D<float4> src : register(t0); // Scene color, rendered to top left part of it
+Texture2D<float> depth : register(t1);
+Texture2D<float2> motion : register(t2); // Offset in uv from position in the previous frame
+Texture2D<float4> history : register(t3); // Resolved previous frame of destination size
+RWTexture2D<float4> dst : register(u0);
+
+float MaxComponent(float3 color)
+{
+    return max(color.r, max(color.g, color.b));
+}
+
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (any(globalThreadId.xy >= sizes.zw))
+    {
+        return;
+    }
+
+    // Scene sample of pixel p is at p + 0.5 - jitter in rendered pixels
+    float2 renderSize = (float2)sizes.xy;
+    float2 jitter = params.xy;
+    float2 uv = (globalThreadId.xy + 0.5) / (float2)sizes.zw;
+    float2 pos = uv * renderSize;
+    int2 nearest = (int2)floor(pos + jitter);
+    int2 maxPixel = (int2)sizes.xy - 1;
+
+    // Gaussian reconstruction of samples around the pixel, their mean and variance bound the history
+    float3 sum = 0.0;
+    float weightSum = 0.0;
+    float3 m1 = 0.0;
+    float3 m2 = 0.0;
+    float nearestWeight = 0.0;
+    float closestDepth = 0.0;
+    int2 closest = clamp(nearest, 0, maxPixel);
+    [unroll]
+    for (int y = -1; y <= 1; y++)
+    {
+        [unroll]
+        for (int x = -1; x <= 1; x++)
+        {
+            int2 p = clamp(nearest + int2(x, y), 0, maxPixel);
+            float3 color = src.Load(int3(p, 0)).rgb;
+            float2 d = p + 0.5 - jitter - pos;
+            float weight = exp(-2.29 * dot(d, d));
+            sum += color * weight;
+            weightSum += weight;
+            m1 += color;
+            m2 += color * color;
+            if (x == 0 && y == 0)
+            {
+                nearestWeight = weight;
+            }
+
+            // Reversed Z, so motion of the closest surface keeps edges of moving objects
+            float z = depth.Load(int3(p, 0));
+            if (z > closestDepth)
+            {
+                closestDepth = z;
+                closest = p;
+            }
+        }
+    }
+    float3 current = sum / max(weightSum, 0.0001);
+    float3 mean = m1 / 9.0;
+    float3 deviation = sqrt(max(m2 / 9.0 - mean * mean, 0.0));
+    float3 minColor = mean - ClampGamma * deviation;
+    float3 maxColor = mean + ClampGamma * deviation;
+
+    float2 offset = motion.Load(int3(closest, 0));
+    if (offset.x >= NoMotion * 0.5)
+    {
+        float2 ndc = ((closest + 0.5) / renderSize * 2.0 - 1.0) * float2(1.0, -1.0);
+        float4 prevClip = mul(reproject, float4(ndc, closestDepth, 1.0));
+        float2 curUV = (closest + 0.5 - jitter) / renderSize;
+        offset = prevClip.w > 0.0 ? curUV - (prevClip.xy / prevClip.w * float2(0.5, -0.5) + 0.5) : (float2)NoMotion;
+    }
+
+    float3 result = current;
+    float2 prevUV = uv - offset;
+    if (flags.x != 0 && all(prevUV >= 0.0) && all(prevUV <= 1.0))
+    {
+        float3 prev = clamp(history.SampleLevel(linearSampler, prevUV, 0).rgb, minColor, maxColor);
+
+        // Blended with inverse luminance weights, so single bright samples don't flicker
+        float blend = MaxBlend * nearestWeight;
+        float currentWeight = blend / (1.0 + MaxComponent(current));
+        float prevWeight = (1.0 - blend) / (1.0 + MaxComponent(prev));
+        result = (current * currentWeight + prev * prevWeight) / (currentWeight + prevWeight);
+    }
+
+    dst[globalThreadId.xy] = float4(result, 1.0);
+}
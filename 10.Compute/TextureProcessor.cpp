@@ -0,0 +1,225 @@
+#include "framework.h"
+
+#include "TextureProcessor.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+
+namespace
+{
+
+struct ProcessParams
+{
+    UINT sizes[4]; // xy - source size, zw - destination size
+};
+
+}
+
+HRESULT TextureProcessor::Init(ID3D11Device* pDevice, const CreateShader& createShader)
+{
+    HRESULT result = createShader(L"MipGen.cs", (ID3D11DeviceChild**)&m_pMipGenShader);
+    if (SUCCEEDED(result))
+    {
+        result = createShader(L"BC1Encode.cs", (ID3D11DeviceChild**)&m_pBC1EncodeShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc;
+        desc.ByteWidth = sizeof(ProcessParams);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        result = pDevice->CreateBuffer(&desc, nullptr, &m_pParams);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(m_pParams, "TextureProcessParams");
+        }
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void TextureProcessor::Term()
+{
+    SAFE_RELEASE(m_pMipGenShader);
+    SAFE_RELEASE(m_pBC1EncodeShader);
+    SAFE_RELEASE(m_pParams);
+}
+
+HRESULT TextureProcessor::CreateTarget(ID3D11Device* pDevice, UINT width, UINT height, const std::string& name, ID3D11Texture2D** ppTexture)
+{
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.ArraySize = 1;
+    desc.MipLevels = 0; // Full chain
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Height = height;
+    desc.Width = width;
+
+    HRESULT result = pDevice->CreateTexture2D(&desc, nullptr, ppTexture);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(*ppTexture, name);
+    }
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT TextureProcessor::GenerateMips(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, ID3D11Texture2D* pTexture)
+{
+    D3D11_TEXTURE2D_DESC desc;
+    pTexture->GetDesc(&desc);
+    assert((desc.BindFlags & D3D11_BIND_UNORDERED_ACCESS) != 0);
+
+    HRESULT result = S_OK;
+    for (UINT mip = 1; mip < desc.MipLevels && SUCCEEDED(result); mip++)
+    {
+        ID3D11ShaderResourceView* pSrcSRV = nullptr;
+        ID3D11UnorderedAccessView* pDstUAV = nullptr;
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = desc.Format;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        srvDesc.Texture2D.MostDetailedMip = mip - 1;
+
+        result = pDevice->CreateShaderResourceView(pTexture, &srvDesc, &pSrcSRV);
+        if (SUCCEEDED(result))
+        {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+            uavDesc.Format = desc.Format;
+            uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+            uavDesc.Texture2D.MipSlice = mip;
+
+            result = pDevice->CreateUnorderedAccessView(pTexture, &uavDesc, &pDstUAV);
+        }
+        if (SUCCEEDED(result))
+        {
+            Dispatch(pContext, m_pMipGenShader, pSrcSRV, pDstUAV,
+                std::max(1u, desc.Width >> (mip - 1)), std::max(1u, desc.Height >> (mip - 1)),
+                std::max(1u, desc.Width >> mip), std::max(1u, desc.Height >> mip));
+        }
+
+        SAFE_RELEASE(pSrcSRV);
+        SAFE_RELEASE(pDstUAV);
+    }
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+HRESULT TextureProcessor::CompressBC1(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, ID3D11Texture2D* pSrc, const std::string& name, ID3D11Texture2D** ppDst)
+{
+    D3D11_TEXTURE2D_DESC desc;
+    pSrc->GetDesc(&desc);
+    assert(desc.Width % 4 == 0 && desc.Height % 4 == 0);
+
+    D3D11_TEXTURE2D_DESC dstDesc = desc;
+    dstDesc.Format = DXGI_FORMAT_BC1_UNORM;
+    dstDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    HRESULT result = pDevice->CreateTexture2D(&dstDesc, nullptr, ppDst);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(*ppDst, name);
+    }
+
+    // Blocks of every mip are encoded to the same scratch texture, and copied to compressed one,
+    // as BC1 is copy compatible with R32G32_UINT of block size
+    ID3D11Texture2D* pBlocks = nullptr;
+    ID3D11UnorderedAccessView* pBlocksUAV = nullptr;
+    if (SUCCEEDED(result))
+    {
+        D3D11_TEXTURE2D_DESC blocksDesc = {};
+        blocksDesc.Format = DXGI_FORMAT_R32G32_UINT;
+        blocksDesc.ArraySize = 1;
+        blocksDesc.MipLevels = 1;
+        blocksDesc.Usage = D3D11_USAGE_DEFAULT;
+        blocksDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        blocksDesc.CPUAccessFlags = 0;
+        blocksDesc.MiscFlags = 0;
+        blocksDesc.SampleDesc.Count = 1;
+        blocksDesc.SampleDesc.Quality = 0;
+        blocksDesc.Height = desc.Height / 4;
+        blocksDesc.Width = desc.Width / 4;
+
+        result = pDevice->CreateTexture2D(&blocksDesc, nullptr, &pBlocks);
+        if (SUCCEEDED(result))
+        {
+            result = SetResourceName(pBlocks, name + "Blocks");
+        }
+        if (SUCCEEDED(result))
+        {
+            result = pDevice->CreateUnorderedAccessView(pBlocks, nullptr, &pBlocksUAV);
+        }
+    }
+
+    for (UINT mip = 0; mip < desc.MipLevels && SUCCEEDED(result); mip++)
+    {
+        ID3D11ShaderResourceView* pSrcSRV = nullptr;
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = desc.Format;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        srvDesc.Texture2D.MostDetailedMip = mip;
+
+        result = pDevice->CreateShaderResourceView(pSrc, &srvDesc, &pSrcSRV);
+        if (SUCCEEDED(result))
+        {
+            UINT width = std::max(1u, desc.Width >> mip);
+            UINT height = std::max(1u, desc.Height >> mip);
+            UINT blocksX = DivUp(width, 4u);
+            UINT blocksY = DivUp(height, 4u);
+
+            Dispatch(pContext, m_pBC1EncodeShader, pSrcSRV, pBlocksUAV, width, height, blocksX, blocksY);
+
+            D3D11_BOX box = { 0, 0, 0, blocksX, blocksY, 1 };
+            pContext->CopySubresourceRegion(*ppDst, mip, 0, 0, 0, pBlocks, 0, &box);
+        }
+
+        SAFE_RELEASE(pSrcSRV);
+    }
+
+    SAFE_RELEASE(pBlocksUAV);
+    SAFE_RELEASE(pBlocks);
+
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void TextureProcessor::Dispatch(ID3D11DeviceContext* pContext, ID3D11ComputeShader* pShader, ID3D11ShaderResourceView* pSrc, ID3D11UnorderedAccessView* pDst, UINT srcWidth, UINT srcHeight, UINT dstWidth, UINT dstHeight)
+{
+    ProcessParams params = { { srcWidth, srcHeight, dstWidth, dstHeight } };
+    StallDetector::Get().UpdateSubresource(pContext, m_pParams, 0, nullptr, &params, 0, 0, STALL_SITE);
+
+    ID3D11Buffer* constBuffers[1] = { m_pParams };
+    pContext->CSSetConstantBuffers(0, 1, constBuffers);
+    pContext->CSSetShader(pShader, nullptr, 0);
+
+    ID3D11ShaderResourceView* srvs[1] = { pSrc };
+    pContext->CSSetShaderResources(0, 1, srvs);
+    ID3D11UnorderedAccessView* uavs[1] = { pDst };
+    pContext->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+
+    pContext->Dispatch(DivUp(dstWidth, 8u), DivUp(dstHeight, 8u), 1);
+
+    // Unbind, as destination is read on next step
+    srvs[0] = nullptr;
+    uavs[0] = nullptr;
+    pContext->CSSetShaderResources(0, 1, srvs);
+    pContext->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <functional>
+#include <string>
+
+/**
+ * GPU processing of textures produced at runtime.
+ * Mip chain is built with compute box filter, and the result may be encoded to BC1 on GPU,
+ * so generated and rendered textures get mips and compression without CPU readback.
+ * State is changed directly on the context, so state cache should be invalidated after use.
+ */
+class TextureProcessor
+{
+public:
+    // Should create compute shader from file, so shaders go through cache and hot reload
+    typedef std::function<HRESULT(const std::wstring& path, ID3D11DeviceChild** ppShader)> CreateShader;
+
+    TextureProcessor()
+        : m_pMipGenShader(nullptr)
+        , m_pBC1EncodeShader(nullptr)
+        , m_pParams(nullptr)
+    {}
+
+    HRESULT Init(ID3D11Device* pDevice, const CreateShader& createShader);
+    void Term();
+
+    /** Texture suitable for mip generation, R8G8B8A8_UNORM with full mip chain and UAV access */
+    static HRESULT CreateTarget(ID3D11Device* pDevice, UINT width, UINT height, const std::string& name, ID3D11Texture2D** ppTexture);
+
+    /** Build mips 1..N from mip 0, texture should have UAV bind flag and typed UAV store capable format */
+    HRESULT GenerateMips(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, ID3D11Texture2D* pTexture);
+    /** Encode all mips of RGBA texture to new BC1 texture, top level size should be multiple of 4 */
+    HRESULT CompressBC1(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, ID3D11Texture2D* pSrc, const std::string& name, ID3D11Texture2D** ppDst);
+
+private:
+    void Dispatch(ID3D11DeviceContext* pContext, ID3D11ComputeShader* pShader, ID3D11ShaderResourceView* pSrc, ID3D11UnorderedAccessView* pDst, UINT srcWidth, UINT srcHeight, UINT dstWidth, UINT dstHeight);
+
+private:
+    ID3D11ComputeShader* m_pMipGenShader;
+    ID3D11ComputeShader* m_pBC1EncodeShader;
+    ID3D11Buffer* m_pParams;
+};
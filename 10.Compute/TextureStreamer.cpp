@@ -0,0 +1,323 @@
+#include "framework.h"
+
+#include "TextureStreamer.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+
+void TextureStreamer::Init(ID3D11Device* pDevice, UINT threadCount)
+{
+    m_pDevice = pDevice;
+    m_pDevice->AddRef();
+
+    m_stop = false;
+    for (UINT i = 0; i < threadCount; i++)
+    {
+        m_workers.emplace_back(&TextureStreamer::WorkerLoop, this);
+    }
+}
+
+void TextureStreamer::Term()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeCV.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+
+    for (Streaming& streaming : m_prepared)
+    {
+        Release(streaming);
+    }
+    m_prepared.clear();
+    for (Streaming& streaming : m_uploading)
+    {
+        Release(streaming);
+    }
+    m_uploading.clear();
+    m_requests.clear();
+
+    SAFE_RELEASE(m_pDevice);
+}
+
+HRESULT TextureStreamer::CreatePlaceholder(ID3D11Device* pDevice, UINT arraySize, bool cube, UINT32 color, const std::string& name, ID3D11Texture2D** ppTexture, ID3D11ShaderResourceView** ppView, bool arrayView)
+{
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.ArraySize = arraySize;
+    desc.MipLevels = 1;
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Height = 1;
+    desc.Width = 1;
+
+    std::vector<D3D11_SUBRESOURCE_DATA> data(arraySize);
+    for (UINT i = 0; i < arraySize; i++)
+    {
+        data[i].pSysMem = &color;
+        data[i].SysMemPitch = sizeof(color);
+        data[i].SysMemSlicePitch = 0;
+    }
+
+    HRESULT result = pDevice->CreateTexture2D(&desc, data.data(), ppTexture);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(*ppTexture, name + "Placeholder");
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+        viewDesc.Format = desc.Format;
+        if (cube)
+        {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+            viewDesc.TextureCube.MipLevels = 1;
+        }
+        else if (arraySize > 1 || arrayView)
+        {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+            viewDesc.Texture2DArray.ArraySize = arraySize;
+            viewDesc.Texture2DArray.MipLevels = 1;
+        }
+        else
+        {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+            viewDesc.Texture2D.MipLevels = 1;
+        }
+
+        result = pDevice->CreateShaderResourceView(*ppTexture, &viewDesc, ppView);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(*ppView, name + "PlaceholderView");
+    }
+    assert(SUCCEEDED(result));
+
+    return result;
+}
+
+void TextureStreamer::Load(const Request& request)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back(request);
+        m_loadingCount++;
+    }
+    m_wakeCV.notify_one();
+}
+
+UINT TextureStreamer::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_loadingCount + (UINT)m_uploading.size();
+}
+
+void TextureStreamer::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wakeCV.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+        if (m_stop)
+        {
+            break;
+        }
+
+        Streaming streaming = {};
+        streaming.request = m_requests.front();
+        m_requests.pop_front();
+        lock.unlock();
+
+        bool prepared = Prepare(streaming);
+        if (!prepared)
+        {
+            OutputDebugStringA(("Texture streaming failed: " + streaming.request.name + "\n").c_str());
+            Release(streaming);
+        }
+
+        lock.lock();
+        m_loadingCount--;
+        if (prepared)
+        {
+            m_prepared.push_back(streaming);
+        }
+    }
+}
+
+bool TextureStreamer::Prepare(Streaming& streaming)
+{
+    const Request& request = streaming.request;
+
+    streaming.files.resize(request.files.size());
+    streaming.arraySize = 0;
+    bool cube = request.cube;
+    for (size_t i = 0; i < request.files.size(); i++)
+    {
+        if (!LoadDDS(request.files[i], streaming.files[i], request.singleMip, true))
+        {
+            return false;
+        }
+
+        const TextureDesc& first = streaming.files[0];
+        const TextureDesc& file = streaming.files[i];
+        if (file.fmt != first.fmt || file.width != first.width || file.height != first.height || file.mipmapsCount != first.mipmapsCount)
+        {
+            return false;
+        }
+        streaming.arraySize += file.arraySize;
+        cube = cube || file.cube;
+    }
+    if (streaming.files.empty() || (cube && streaming.arraySize % 6 != 0))
+    {
+        return false;
+    }
+
+    const TextureDesc& first = streaming.files[0];
+
+    // Block compressed top level should stay multiple of block size
+    UINT skipMips = std::min(request.skipMips, first.mipmapsCount - 1);
+    while (skipMips > 0 && (((first.width >> skipMips) % 4) != 0 || ((first.height >> skipMips) % 4) != 0))
+    {
+        skipMips--;
+    }
+    streaming.skipMips = skipMips;
+    streaming.mipCount = first.mipmapsCount - skipMips;
+    streaming.nextMip = streaming.mipCount;
+
+    // No initial data, mips are uploaded later by render thread
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = first.fmt;
+    desc.ArraySize = streaming.arraySize;
+    desc.MipLevels = streaming.mipCount;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Height = std::max(1u, first.height >> skipMips);
+    desc.Width = std::max(1u, first.width >> skipMips);
+
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, nullptr, &streaming.pTexture);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(streaming.pTexture, request.name);
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+        viewDesc.Format = desc.Format;
+        if (cube && desc.ArraySize > 6)
+        {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+            viewDesc.TextureCubeArray.NumCubes = desc.ArraySize / 6;
+            viewDesc.TextureCubeArray.MipLevels = desc.MipLevels;
+        }
+        else if (cube)
+        {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+            viewDesc.TextureCube.MipLevels = desc.MipLevels;
+        }
+        else if (desc.ArraySize > 1 || request.arrayView)
+        {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+            viewDesc.Texture2DArray.ArraySize = desc.ArraySize;
+            viewDesc.Texture2DArray.MipLevels = desc.MipLevels;
+        }
+        else
+        {
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+            viewDesc.Texture2D.MipLevels = desc.MipLevels;
+        }
+
+        result = m_pDevice->CreateShaderResourceView(streaming.pTexture, &viewDesc, &streaming.pView);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(streaming.pView, request.name + "View");
+    }
+
+    return SUCCEEDED(result);
+}
+
+UINT TextureStreamer::Update(ID3D11DeviceContext* pContext)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_uploading.insert(m_uploading.end(), m_prepared.begin(), m_prepared.end());
+        m_prepared.clear();
+    }
+
+    UINT swapped = 0;
+    UINT uploaded = 0;
+    while (!m_uploading.empty() && uploaded < UploadBudget)
+    {
+        Streaming& streaming = m_uploading.front();
+        const TextureDesc& first = streaming.files[0];
+
+        UINT mip = --streaming.nextMip;
+
+        UINT fileMip = mip + streaming.skipMips;
+        UINT32 offset = GetMipChainSize(first.fmt, first.width, first.height, fileMip);
+        UINT32 pitch = 0;
+        UINT32 mipSize = GetMipSize(first.fmt, first.width, first.height, fileMip, &pitch);
+
+        UINT slice = 0;
+        for (const TextureDesc& file : streaming.files)
+        {
+            for (UINT i = 0; i < file.arraySize; i++, slice++)
+            {
+                const char* pSrcData = reinterpret_cast<const char*>(file.pData) + i * file.sliceSize + offset;
+                StallDetector::Get().UpdateSubresource(pContext, streaming.pTexture, D3D11CalcSubresource(mip, slice, streaming.mipCount), nullptr, pSrcData, pitch, 0, STALL_SITE);
+                uploaded += mipSize;
+            }
+        }
+
+        // Only resident mips are sampled
+        pContext->SetResourceMinLOD(streaming.pTexture, (float)mip);
+
+        if (mip == streaming.mipCount - 1)
+        {
+            SAFE_RELEASE(*streaming.request.ppView);
+            SAFE_RELEASE(*streaming.request.ppTexture);
+            *streaming.request.ppView = streaming.pView;
+            *streaming.request.ppTexture = streaming.pTexture;
+            swapped++;
+        }
+
+        if (mip == 0)
+        {
+            for (TextureDesc& file : streaming.files)
+            {
+                FreeDDS(file);
+            }
+            m_uploading.erase(m_uploading.begin());
+        }
+    }
+
+    return swapped;
+}
+
+void TextureStreamer::Release(Streaming& streaming)
+{
+    // Texture is owned by requester once it is swapped in
+    if (streaming.nextMip == streaming.mipCount)
+    {
+        SAFE_RELEASE(streaming.pView);
+        SAFE_RELEASE(streaming.pTexture);
+    }
+    for (TextureDesc& file : streaming.files)
+    {
+        FreeDDS(file);
+    }
+}
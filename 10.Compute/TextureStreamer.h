@@ -0,0 +1,90 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "../Core/DDS.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Background loading of DDS textures.
+ * Files are mapped and textures are created on worker threads, as device is free threaded.
+ * Mip levels are then uploaded on render thread coarsest first within per frame budget,
+ * resident mips are exposed with SetResourceMinLOD, and placeholder view is replaced as soon as the coarsest mip is in.
+ */
+class TextureStreamer
+{
+public:
+    static const UINT DefaultThreadCount = 2;
+    static const UINT UploadBudget = 2 * 1024 * 1024; // Bytes uploaded per frame
+
+    struct Request
+    {
+        std::vector<std::wstring> files; // Each may hold several array slices, all should have the same format and size
+        bool cube = false; // Also set if file itself is a cubemap
+        bool singleMip = false;
+        UINT skipMips = 0; // Most detailed mips not loaded, to save memory
+        bool arrayView = false; // Array view even for single slice
+        std::string name;
+        ID3D11Texture2D** ppTexture = nullptr;    // Replaced once coarsest mip is resident
+        ID3D11ShaderResourceView** ppView = nullptr;
+    };
+
+    TextureStreamer()
+        : m_pDevice(nullptr)
+        , m_stop(false)
+        , m_loadingCount(0)
+    {}
+
+    void Init(ID3D11Device* pDevice, UINT threadCount = DefaultThreadCount);
+    void Term();
+
+    /** 1x1 texture of given color, with the same view dimension as the streamed one */
+    static HRESULT CreatePlaceholder(ID3D11Device* pDevice, UINT arraySize, bool cube, UINT32 color, const std::string& name, ID3D11Texture2D** ppTexture, ID3D11ShaderResourceView** ppView, bool arrayView = false);
+
+    void Load(const Request& request);
+
+    /** Upload mips and swap in views, should be called on render thread between frames. Returns swapped view count */
+    UINT Update(ID3D11DeviceContext* pContext);
+
+    /** Textures not fully resident yet */
+    UINT GetPendingCount();
+
+private:
+    struct Streaming
+    {
+        Request request;
+        std::vector<TextureDesc> files;
+        UINT arraySize;
+        ID3D11Texture2D* pTexture;
+        ID3D11ShaderResourceView* pView;
+        UINT mipCount;
+        UINT skipMips; // File mip of texture mip 0
+        UINT nextMip; // Next mip to upload, uploaded from the last one to 0
+    };
+
+    void WorkerLoop();
+    bool Prepare(Streaming& streaming);
+    static void Release(Streaming& streaming);
+
+private:
+    ID3D11Device* m_pDevice;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCV;
+    bool m_stop;
+
+    // Guarded by m_mutex
+    std::deque<Request> m_requests;
+    std::vector<Streaming> m_prepared;
+    UINT m_loadingCount;
+
+    // Only accessed by render thread
+    std::vector<Streaming> m_uploading;
+};
@@ -3,30 +3,49 @@ cbuffer SceneBuffer : register (b0)
     float4x4 vp;
 };
 
-cbuffer GeomBuffer : register (b1)
+struct RectGeom
 {
     float4x4 model;
+    float4 color;
 };
 
+StructuredBuffer<RectGeom> rectGeom : register (t1);
+#ifdef SORTED
+StructuredBuffer<uint> visibleIds : register (t2); // Farthest first, from BitonicSort.cs
+#endif // SORTED
+
 struct VSInput
 {
     float3 pos : POSITION;
+    uint instanceId : SV_InstanceID;
 };
 
 struct VSOutput
 {
     float4 pos : SV_Position;
     float3 worldPos : POSITION;
+    float2 uv : TEXCOORD;
+    nointerpolation float4 color : COLOR;
 };
 
 VSOutput vs(VSInput vertex)
 {
     VSOutput result;
 
+#ifdef SORTED
+    uint id = visibleIds[vertex.instanceId];
+#else
+    uint id = vertex.instanceId;
+#endif // !SORTED
+    float4x4 model = rectGeom[id].model;
+    result.color = rectGeom[id].color;
+
     float3 worldPos = mul(model, float4(vertex.pos, 1.0)).xyz;
 
     result.pos = mul(vp, float4(worldPos, 1.0));
     result.worldPos = worldPos;
+    // Rect lies in YZ plane, with [-0.75, 0.75] extent
+    result.uv = vertex.pos.zy / 1.5 + 0.5;
 
     return result;
 }
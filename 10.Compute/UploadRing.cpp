@@ -0,0 +1,137 @@
+#include "framework.h"
+
+#include "UploadRing.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+
+void MergeRanges(std::vector<BufferRange>& ranges, UINT maxGap)
+{
+    if (ranges.size() < 2)
+    {
+        return;
+    }
+
+    std::sort(ranges.begin(), ranges.end(), [](const BufferRange& a, const BufferRange& b) { return a.first < b.first; });
+
+    size_t last = 0;
+    for (size_t i = 1; i < ranges.size(); i++)
+    {
+        UINT lastEnd = ranges[last].first + ranges[last].count;
+        if (ranges[i].first <= lastEnd + maxGap)
+        {
+            ranges[last].count = std::max(lastEnd, ranges[i].first + ranges[i].count) - ranges[last].first;
+        }
+        else
+        {
+            ranges[++last] = ranges[i];
+        }
+    }
+    ranges.resize(last + 1);
+}
+
+HRESULT UploadRing::Init(ID3D11Device* pDevice, UINT size, const std::string& name)
+{
+    // Vertex buffer binding is used as NO_OVERWRITE on dynamic buffers of other types
+    // requires D3D11.1 runtime support (MapNoOverwriteOnDynamicBufferSRV)
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = size;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    desc.MiscFlags = 0;
+    desc.StructureByteStride = 0;
+
+    HRESULT result = pDevice->CreateBuffer(&desc, nullptr, &m_pBuffer);
+    assert(SUCCEEDED(result));
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pBuffer, name);
+    }
+    if (SUCCEEDED(result))
+    {
+        m_size = size;
+        m_offset = size; // So the very first map discards
+    }
+
+    return result;
+}
+
+void UploadRing::Term()
+{
+    SAFE_RELEASE(m_pBuffer);
+    m_size = 0;
+    m_offset = 0;
+}
+
+void UploadRing::Upload(ID3D11DeviceContext* pContext, ID3D11Buffer* pDst, const void* pSrc, UINT elementSize, const std::vector<BufferRange>& ranges)
+{
+    const UINT maxRangeCount = m_size / elementSize;
+    assert(maxRangeCount > 0);
+
+    // Split ranges which don't fit into the ring at once
+    std::vector<BufferRange> parts;
+    parts.reserve(ranges.size());
+    for (const auto& range : ranges)
+    {
+        for (UINT first = range.first; first < range.first + range.count; first += maxRangeCount)
+        {
+            parts.push_back(BufferRange{ first, std::min(maxRangeCount, range.first + range.count - first) });
+        }
+    }
+
+    const char* pSrcData = reinterpret_cast<const char*>(pSrc);
+
+    size_t idx = 0;
+    while (idx < parts.size())
+    {
+        // Gather as many ranges as fit into the ring with one map
+        size_t last = idx;
+        UINT batchSize = 0;
+        while (last < parts.size() && batchSize + parts[last].count * elementSize <= m_size)
+        {
+            batchSize += parts[last].count * elementSize;
+            ++last;
+        }
+
+        D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+        if (m_offset + batchSize > m_size)
+        {
+            mapType = D3D11_MAP_WRITE_DISCARD;
+            m_offset = 0;
+        }
+
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        HRESULT result = StallDetector::Get().Map(pContext, m_pBuffer, 0, mapType, 0, &subresource, STALL_SITE);
+        assert(SUCCEEDED(result));
+        if (FAILED(result))
+        {
+            return;
+        }
+
+        char* pDstData = reinterpret_cast<char*>(subresource.pData) + m_offset;
+        for (size_t i = idx; i < last; i++)
+        {
+            UINT size = parts[i].count * elementSize;
+            memcpy(pDstData, pSrcData + (size_t)parts[i].first * elementSize, size);
+            pDstData += size;
+        }
+
+        pContext->Unmap(m_pBuffer, 0);
+
+        UINT srcOffset = m_offset;
+        for (size_t i = idx; i < last; i++)
+        {
+            UINT size = parts[i].count * elementSize;
+            D3D11_BOX box = { srcOffset, 0, 0, srcOffset + size, 1, 1 };
+            pContext->CopySubresourceRegion(pDst, 0, parts[i].first * elementSize, 0, 0, m_pBuffer, 0, &box);
+            srcOffset += size;
+        }
+
+        m_offset += batchSize;
+        m_uploadedBytes += batchSize;
+        m_copyCount += (UINT)(last - idx);
+
+        idx = last;
+    }
+}
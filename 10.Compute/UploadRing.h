@@ -0,0 +1,50 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <string>
+#include <vector>
+
+/** Contiguous range of buffer elements */
+struct BufferRange
+{
+    UINT first;     ///< First element
+    UINT count;     ///< Element count
+};
+
+/** Sort ranges and merge the ones that overlap or are closer than maxGap elements */
+void MergeRanges(std::vector<BufferRange>& ranges, UINT maxGap);
+
+/**
+ * Dynamic buffer sub-allocated with MAP_WRITE_NO_OVERWRITE and used as a copy source
+ * for partial updates of default usage buffers. It is only discarded when it wraps around.
+ */
+class UploadRing
+{
+public:
+    UploadRing()
+        : m_pBuffer(nullptr)
+        , m_size(0)
+        , m_offset(0)
+        , m_uploadedBytes(0)
+        , m_copyCount(0)
+    {}
+
+    HRESULT Init(ID3D11Device* pDevice, UINT size, const std::string& name);
+    void Term();
+
+    /** Copy given element ranges of pSrc to the same ranges of pDst */
+    void Upload(ID3D11DeviceContext* pContext, ID3D11Buffer* pDst, const void* pSrc, UINT elementSize, const std::vector<BufferRange>& ranges);
+
+    void ResetStats() { m_uploadedBytes = 0; m_copyCount = 0; }
+    UINT GetUploadedBytes() const { return m_uploadedBytes; }
+    UINT GetCopyCount() const { return m_copyCount; }
+
+private:
+    ID3D11Buffer* m_pBuffer;
+    UINT m_size;
+    UINT m_offset;
+
+    UINT m_uploadedBytes;
+    UINT m_copyCount;
+};
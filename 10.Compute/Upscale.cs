@@ -0,0 +1,23 @@
+#include "PostParams.h"
+
+Texture2D<float4> src : register(t0); // Scene color, rendered to top left part of it
+RWTexture2D<unorm float4> dst : register(u0);
+
+[numthreads(8, 8, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (any(globalThreadId.xy >= sizes.zw))
+    {
+        return;
+    }
+
+    // Rendered part is sized as xy, params.xy is its size in texture uv, samples are clamped to it
+    uint width, height;
+    src.GetDimensions(width, height);
+    float2 halfTexel = 0.5 / float2(width, height);
+
+    float2 uv = (globalThreadId.xy + 0.5) / (float2)sizes.zw * params.xy;
+    uv = clamp(uv, halfTexel, params.xy - halfTexel);
+
+    dst[globalThreadId.xy] = float4(src.SampleLevel(linearSampler, uv, 0).rgb, 1.0);
+}
@@ -0,0 +1,318 @@
+#include "framework.h"
+
+#include "VideoRecorder.h"
+
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <d3d10.h>
+
+#include <algorithm>
+
+HRESULT VideoRecorder::Init(ID3D11Device* pDevice, const CreateShader& createShader)
+{
+    HRESULT result = createShader(L"Fullscreen.vs", (ID3D11DeviceChild**)&m_pFullscreenVS, {});
+    if (SUCCEEDED(result))
+    {
+        result = createShader(L"VideoBlit.ps", (ID3D11DeviceChild**)&m_pBlitPS, {});
+    }
+    assert(SUCCEEDED(result));
+    if (SUCCEEDED(result))
+    {
+        m_pDevice = pDevice;
+        m_pDevice->AddRef();
+
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        m_frequency = frequency.QuadPart;
+    }
+
+    return result;
+}
+
+void VideoRecorder::Term()
+{
+    Stop();
+
+    SAFE_RELEASE(m_pFullscreenVS);
+    SAFE_RELEASE(m_pBlitPS);
+    SAFE_RELEASE(m_pDevice);
+}
+
+bool VideoRecorder::Start(const std::wstring& path, UINT width, UINT height, Codec codec, UINT fps, UINT bitrate)
+{
+    if (m_pDevice == nullptr || IsRecording())
+    {
+        return false;
+    }
+
+    // Sink writer needs COM on the thread frames are submitted from, thread may already be in apartment of its own
+    HRESULT result = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    m_comInitialized = SUCCEEDED(result);
+    result = MFStartup(MF_VERSION, MFSTARTUP_NOSOCKET);
+    m_mfStarted = SUCCEEDED(result);
+
+    // Encoder uses immediate context from its own threads
+    ID3D10Multithread* pMultithread = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = m_pDevice->QueryInterface(__uuidof(ID3D10Multithread), (void**)&pMultithread);
+    }
+    if (SUCCEEDED(result))
+    {
+        pMultithread->SetMultithreadProtected(TRUE);
+        SAFE_RELEASE(pMultithread);
+    }
+
+    UINT resetToken = 0;
+    if (SUCCEEDED(result))
+    {
+        result = MFCreateDXGIDeviceManager(&resetToken, &m_pDeviceManager);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pDeviceManager->ResetDevice(m_pDevice, resetToken);
+    }
+
+    IMFAttributes* pAttributes = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = MFCreateAttributes(&pAttributes, 3);
+    }
+    if (SUCCEEDED(result))
+    {
+        pAttributes->SetUnknown(MF_SINK_WRITER_D3D_MANAGER, m_pDeviceManager);
+        pAttributes->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE);
+        // Frames are dropped on empty sample pool instead of blocking in WriteSample
+        pAttributes->SetUINT32(MF_SINK_WRITER_DISABLE_THROTTLING, TRUE);
+
+        result = MFCreateSinkWriterFromURL(path.c_str(), nullptr, pAttributes, &m_pSinkWriter);
+    }
+    SAFE_RELEASE(pAttributes);
+
+    IMFMediaType* pOutputType = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = MFCreateMediaType(&pOutputType);
+    }
+    if (SUCCEEDED(result))
+    {
+        pOutputType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+        pOutputType->SetGUID(MF_MT_SUBTYPE, codec == CodecHevc ? MFVideoFormat_HEVC : MFVideoFormat_H264);
+        pOutputType->SetUINT32(MF_MT_AVG_BITRATE, bitrate);
+        pOutputType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+        MFSetAttributeSize(pOutputType, MF_MT_FRAME_SIZE, width, height);
+        MFSetAttributeRatio(pOutputType, MF_MT_FRAME_RATE, fps, 1);
+        MFSetAttributeRatio(pOutputType, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+
+        result = m_pSinkWriter->AddStream(pOutputType, &m_streamIdx);
+    }
+    SAFE_RELEASE(pOutputType);
+
+    // B8G8R8A8 input, color conversion is done by hardware transform of sink writer
+    IMFMediaType* pInputType = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = MFCreateMediaType(&pInputType);
+    }
+    if (SUCCEEDED(result))
+    {
+        pInputType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+        pInputType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_ARGB32);
+        pInputType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+        pInputType->SetUINT32(MF_MT_DEFAULT_STRIDE, width * 4); // Top-down, RGB is bottom-up by default
+        MFSetAttributeSize(pInputType, MF_MT_FRAME_SIZE, width, height);
+        MFSetAttributeRatio(pInputType, MF_MT_FRAME_RATE, fps, 1);
+        MFSetAttributeRatio(pInputType, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+
+        result = m_pSinkWriter->SetInputMediaType(m_streamIdx, pInputType, nullptr);
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = MFCreateVideoSampleAllocatorEx(IID_PPV_ARGS(&m_pAllocator));
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_pAllocator->SetDirectXManager(m_pDeviceManager);
+    }
+    IMFAttributes* pPoolAttributes = nullptr;
+    if (SUCCEEDED(result))
+    {
+        result = MFCreateAttributes(&pPoolAttributes, 2);
+    }
+    if (SUCCEEDED(result))
+    {
+        pPoolAttributes->SetUINT32(MF_SA_D3D11_BINDFLAGS, D3D11_BIND_RENDER_TARGET);
+        pPoolAttributes->SetUINT32(MF_SA_D3D11_USAGE, D3D11_USAGE_DEFAULT);
+
+        result = m_pAllocator->InitializeSampleAllocatorEx(PoolSize, PoolSize, pPoolAttributes, pInputType);
+    }
+    SAFE_RELEASE(pPoolAttributes);
+    SAFE_RELEASE(pInputType);
+
+    if (SUCCEEDED(result))
+    {
+        result = m_pSinkWriter->BeginWriting();
+    }
+
+    if (FAILED(result))
+    {
+        OutputDebugStringA("Video recording is not available, hardware encoder may not support the codec\n");
+        Stop();
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_frameDuration = 10000000 / std::max(fps, 1u);
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    m_startTicks = ticks.QuadPart;
+    m_lastTime = -1;
+    m_frames = 0;
+    m_dropped = 0;
+
+    return true;
+}
+
+void VideoRecorder::Stop()
+{
+    if (m_pSinkWriter != nullptr && m_frames > 0)
+    {
+        HRESULT result = m_pSinkWriter->Finalize();
+        assert(SUCCEEDED(result));
+    }
+    SAFE_RELEASE(m_pSinkWriter);
+
+    for (auto& targetView : m_targetViews)
+    {
+        SAFE_RELEASE(targetView.second);
+    }
+    m_targetViews.clear();
+    if (m_pAllocator != nullptr)
+    {
+        m_pAllocator->UninitializeSampleAllocator();
+    }
+    SAFE_RELEASE(m_pAllocator);
+    SAFE_RELEASE(m_pDeviceManager);
+
+    if (m_mfStarted)
+    {
+        MFShutdown();
+        m_mfStarted = false;
+    }
+    if (m_comInitialized)
+    {
+        CoUninitialize();
+        m_comInitialized = false;
+    }
+    m_width = 0;
+    m_height = 0;
+}
+
+ID3D11RenderTargetView* VideoRecorder::GetTargetView(ID3D11Texture2D* pTexture)
+{
+    for (const auto& targetView : m_targetViews)
+    {
+        if (targetView.first == pTexture)
+        {
+            return targetView.second;
+        }
+    }
+
+    ID3D11RenderTargetView* pView = nullptr;
+    if (FAILED(m_pDevice->CreateRenderTargetView(pTexture, nullptr, &pView)))
+    {
+        return nullptr;
+    }
+    // View keeps texture alive, so pointer is not reused by another one
+    m_targetViews.push_back({ pTexture, pView });
+
+    return pView;
+}
+
+void VideoRecorder::AddFrame(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* pSrc)
+{
+    if (!IsRecording())
+    {
+        return;
+    }
+
+    // Pool is empty while encoder still holds all samples, skip this frame
+    IMFSample* pSample = nullptr;
+    if (FAILED(m_pAllocator->AllocateSample(&pSample)))
+    {
+        ++m_dropped;
+        return;
+    }
+
+    IMFMediaBuffer* pBuffer = nullptr;
+    IMFDXGIBuffer* pDxgiBuffer = nullptr;
+    IMF2DBuffer* p2DBuffer = nullptr;
+    ID3D11Texture2D* pTexture = nullptr;
+    HRESULT result = pSample->GetBufferByIndex(0, &pBuffer);
+    if (SUCCEEDED(result))
+    {
+        result = pBuffer->QueryInterface(IID_PPV_ARGS(&pDxgiBuffer));
+    }
+    if (SUCCEEDED(result))
+    {
+        result = pDxgiBuffer->GetResource(IID_PPV_ARGS(&pTexture));
+    }
+    if (SUCCEEDED(result))
+    {
+        result = pBuffer->QueryInterface(IID_PPV_ARGS(&p2DBuffer));
+    }
+    DWORD length = 0;
+    if (SUCCEEDED(result))
+    {
+        result = p2DBuffer->GetContiguousLength(&length);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = pBuffer->SetCurrentLength(length);
+    }
+    ID3D11RenderTargetView* pTargetView = SUCCEEDED(result) ? GetTargetView(pTexture) : nullptr;
+    if (pTargetView != nullptr)
+    {
+        // Output merger stores in B8G8R8A8 order of encoder input
+        D3D11_VIEWPORT viewport = { 0, 0, (FLOAT)m_width, (FLOAT)m_height, 0.0f, 1.0f };
+        pContext->OMSetRenderTargets(1, &pTargetView, nullptr);
+        pContext->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+        pContext->OMSetDepthStencilState(nullptr, 0);
+        pContext->RSSetState(nullptr);
+        pContext->RSSetViewports(1, &viewport);
+        pContext->IASetInputLayout(nullptr);
+        pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        pContext->VSSetShader(m_pFullscreenVS, nullptr, 0);
+        pContext->PSSetShader(m_pBlitPS, nullptr, 0);
+        pContext->PSSetShaderResources(0, 1, &pSrc);
+        pContext->Draw(3, 0, 0);
+
+        ID3D11ShaderResourceView* nullSRVs[1] = {};
+        pContext->PSSetShaderResources(0, 1, nullSRVs);
+        pContext->OMSetRenderTargets(0, nullptr, nullptr);
+
+        // Wall clock time stamps, so the video shows actual frame pacing
+        LARGE_INTEGER ticks;
+        QueryPerformanceCounter(&ticks);
+        LONGLONG time = (LONGLONG)((ticks.QuadPart - m_startTicks) * 10000000.0 / m_frequency);
+        time = std::max(time, m_lastTime + 1);
+        m_lastTime = time;
+
+        pSample->SetSampleTime(time);
+        pSample->SetSampleDuration(m_frameDuration);
+        result = m_pSinkWriter->WriteSample(m_streamIdx, pSample);
+        if (SUCCEEDED(result))
+        {
+            ++m_frames;
+        }
+    }
+
+    SAFE_RELEASE(pTexture);
+    SAFE_RELEASE(p2DBuffer);
+    SAFE_RELEASE(pDxgiBuffer);
+    SAFE_RELEASE(pBuffer);
+    SAFE_RELEASE(pSample);
+}
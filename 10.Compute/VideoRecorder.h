@@ -0,0 +1,100 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct IMFDXGIDeviceManager;
+struct IMFSinkWriter;
+struct IMFVideoSampleAllocatorEx;
+
+/**
+ * Recording of rendered frames to video file with hardware encoder.
+ * Media Foundation sink writer shares the device through DXGI device manager, frame is converted
+ * to encoder input by a full screen draw into a texture of sample pool, so pixels never leave GPU.
+ * Frame is dropped rather than waited for when encoder is behind and pool is empty.
+ */
+class VideoRecorder
+{
+public:
+    static const UINT PoolSize = 8; // Frames queued in encoder
+
+    typedef std::function<HRESULT(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines)> CreateShader;
+
+    enum Codec
+    {
+        CodecH264 = 0,
+        CodecHevc,
+
+        CodecCount
+    };
+
+    struct Stats
+    {
+        UINT64 frames;
+        UINT64 dropped; // Sample pool was empty
+    };
+
+    VideoRecorder()
+        : m_pDevice(nullptr)
+        , m_pFullscreenVS(nullptr)
+        , m_pBlitPS(nullptr)
+        , m_pDeviceManager(nullptr)
+        , m_pSinkWriter(nullptr)
+        , m_pAllocator(nullptr)
+        , m_streamIdx(0)
+        , m_width(0)
+        , m_height(0)
+        , m_frameDuration(0)
+        , m_startTicks(0)
+        , m_lastTime(-1)
+        , m_frequency(1)
+        , m_comInitialized(false)
+        , m_mfStarted(false)
+        , m_frames(0)
+        , m_dropped(0)
+    {}
+
+    HRESULT Init(ID3D11Device* pDevice, const CreateShader& createShader);
+    void Term();
+
+    /** Start encoding of width x height frames to path, width and height should be even. False if encoder is not available */
+    bool Start(const std::wstring& path, UINT width, UINT height, Codec codec, UINT fps, UINT bitrate);
+    /** Finalize file, waits for encoder to complete queued frames */
+    void Stop();
+    inline bool IsRecording() const { return m_pSinkWriter != nullptr; }
+
+    /** Encode top left width x height of source, frame time is the time of the call. Leaves pipeline state changed */
+    void AddFrame(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* pSrc);
+
+    inline Stats GetStats() const { return { m_frames, m_dropped }; }
+
+private:
+    ID3D11RenderTargetView* GetTargetView(ID3D11Texture2D* pTexture);
+
+private:
+    ID3D11Device* m_pDevice;
+    ID3D11VertexShader* m_pFullscreenVS;
+    ID3D11PixelShader* m_pBlitPS;
+
+    IMFDXGIDeviceManager* m_pDeviceManager;
+    IMFSinkWriter* m_pSinkWriter;
+    IMFVideoSampleAllocatorEx* m_pAllocator;
+    DWORD m_streamIdx;
+    // Views of pool textures, pool reuses the same ones
+    std::vector<std::pair<ID3D11Texture2D*, ID3D11RenderTargetView*>> m_targetViews;
+
+    UINT m_width;
+    UINT m_height;
+    LONGLONG m_frameDuration; // In 100 ns units
+    INT64 m_startTicks;
+    LONGLONG m_lastTime;
+    INT64 m_frequency;
+    bool m_comInitialized;
+    bool m_mfStarted;
+
+    UINT64 m_frames;
+    UINT64 m_dropped;
+};
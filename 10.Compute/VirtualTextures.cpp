@@ -0,0 +1,621 @@
+#include "framework.h"
+
+#include "VirtualTextures.h"
+#include "StallDetector.h"
+
+#include <algorithm>
+
+bool VirtualTextures::IsSupported(ID3D11Device* pDevice)
+{
+    D3D11_FEATURE_DATA_D3D11_OPTIONS1 options = {};
+    return SUCCEEDED(pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS1, &options, sizeof(options)))
+        && options.TiledResourcesTier >= D3D11_TILED_RESOURCES_TIER_2;
+}
+
+HRESULT VirtualTextures::Init(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, const MaterialTable& materials, UINT poolTiles)
+{
+    static const char* SetNames[SetCount] = { "VirtualAlbedo", "VirtualNormal" };
+
+    HRESULT result = pDevice->QueryInterface(__uuidof(ID3D11Device2), (void**)&m_pDevice);
+    if (SUCCEEDED(result))
+    {
+        result = pContext->QueryInterface(__uuidof(ID3D11DeviceContext2), (void**)&m_pContext);
+    }
+
+    memset(&m_info, 0, sizeof(m_info));
+    m_feedbackBits = 0;
+    for (UINT i = 0; i < SetCount && SUCCEEDED(result); i++)
+    {
+        result = InitSet(i, materials.GetTextureFiles((MaterialTable::TextureSet)i), SetNames[i]);
+    }
+
+    // Packed mip tails of all slices take the start of pool and are never evicted
+    m_poolTiles = poolTiles;
+    m_packedTiles = 0;
+    for (UINT i = 0; i < SetCount; i++)
+    {
+        m_packedTiles += m_sets[i].packedTilesPerSlice * m_sets[i].arraySize;
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = (m_packedTiles + m_poolTiles) * TileBytes;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_TILE_POOL;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pTilePool);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pTilePool, "VirtualTilePool");
+    }
+    UINT poolTile = 0;
+    for (UINT i = 0; i < SetCount && SUCCEEDED(result); i++)
+    {
+        result = MapPackedMips(i, poolTile);
+        if (SUCCEEDED(result))
+        {
+            result = InitResidency(i, SetNames[i]);
+        }
+    }
+
+    // Bit per standard tile of all slices of all sets
+    UINT feedbackSize = DivUp(std::max(m_feedbackBits, 1u), 32u) * (UINT)sizeof(UINT);
+    if (SUCCEEDED(result))
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = feedbackSize;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+        desc.StructureByteStride = 0;
+
+        result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pFeedback);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pFeedback, "VirtualFeedback");
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+        uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.FirstElement = 0;
+        uavDesc.Buffer.NumElements = feedbackSize / sizeof(UINT);
+        uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+        result = m_pDevice->CreateUnorderedAccessView(m_pFeedback, &uavDesc, &m_pFeedbackUAV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(m_pFeedbackUAV, "VirtualFeedbackUAV");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_feedbackReadback.Init(m_pDevice, feedbackSize, "VirtualFeedbackReadback");
+    }
+    if (SUCCEEDED(result))
+    {
+        result = m_constants.Init(m_pDevice, "VirtualTextureCB");
+    }
+
+    if (FAILED(result))
+    {
+        OutputDebugStringA("Virtual texturing is not available, tiled resources or texture files are not supported\n");
+        Term();
+        return result;
+    }
+
+    m_tilePoolTiles.assign(m_feedbackBits, NoTile);
+    m_tileLastUsed.assign(m_feedbackBits, 0);
+    m_poolTileBits.assign(m_poolTiles, NoTile);
+    m_requests.clear();
+    m_frame = 0;
+    m_feedbackFrame = 0;
+    m_mappedTiles = 0;
+    m_evictedTiles = 0;
+
+    return result;
+}
+
+HRESULT VirtualTextures::InitSet(UINT setIdx, const std::vector<std::wstring>& files, const std::string& name)
+{
+    Set& set = m_sets[setIdx];
+    SetInfo& info = m_info.sets[setIdx];
+
+    // Files stay mapped, tiles are copied straight from them
+    set.files.resize(files.size());
+    set.arraySize = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!LoadDDS(files[i], set.files[i], false, true))
+        {
+            return E_FAIL;
+        }
+
+        const TextureDesc& first = set.files[0];
+        const TextureDesc& file = set.files[i];
+        if (file.fmt != first.fmt || file.width != first.width || file.height != first.height || file.mipmapsCount != first.mipmapsCount || file.cube)
+        {
+            return E_FAIL;
+        }
+        set.arraySize += file.arraySize;
+    }
+    if (set.files.empty())
+    {
+        return E_FAIL;
+    }
+
+    const TextureDesc& first = set.files[0];
+    set.mipCount = std::min(first.mipmapsCount, MaxMips);
+
+    // No memory of its own, tiles are mapped to pool
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = first.fmt;
+    desc.ArraySize = set.arraySize;
+    desc.MipLevels = set.mipCount;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_TILED;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Height = first.height;
+    desc.Width = first.width;
+
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, nullptr, &set.pTexture);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(set.pTexture, name);
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+        viewDesc.Format = desc.Format;
+        viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+        viewDesc.Texture2DArray.ArraySize = desc.ArraySize;
+        viewDesc.Texture2DArray.MipLevels = desc.MipLevels;
+
+        result = m_pDevice->CreateShaderResourceView(set.pTexture, &viewDesc, &set.pView);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(set.pView, name + "View");
+    }
+    if (SUCCEEDED(result))
+    {
+        UINT tileCount = 0;
+        D3D11_PACKED_MIP_DESC packedDesc = {};
+        D3D11_TILE_SHAPE tileShape = {};
+        UINT tilingCount = set.mipCount;
+        m_pDevice->GetResourceTiling(set.pTexture, &tileCount, &packedDesc, &tileShape, &tilingCount, 0, set.tilings);
+
+        // Mip tail is packed per slice
+        set.packedTilesPerSlice = packedDesc.NumPackedMips > 0 ? packedDesc.NumTilesForPackedMips : 0;
+
+        info.size[0] = first.width;
+        info.size[1] = first.height;
+        info.tileShape[0] = tileShape.WidthInTexels;
+        info.tileShape[1] = tileShape.HeightInTexels;
+        info.standardMips = packedDesc.NumStandardMips;
+        info.feedbackBase = m_feedbackBits;
+        info.sliceBits = 0;
+        for (UINT mip = 0; mip < info.standardMips; mip++)
+        {
+            info.mipBits[mip] = info.sliceBits;
+            info.sliceBits += set.tilings[mip].WidthInTiles * set.tilings[mip].HeightInTiles;
+        }
+        m_feedbackBits += info.sliceBits * set.arraySize;
+    }
+
+    return result;
+}
+
+HRESULT VirtualTextures::InitResidency(UINT setIdx, const std::string& name)
+{
+    Set& set = m_sets[setIdx];
+    UINT standardMips = m_info.sets[setIdx].standardMips;
+    UINT width = standardMips > 0 ? set.tilings[0].WidthInTiles : 1;
+    UINT height = standardMips > 0 ? set.tilings[0].HeightInTiles : 1;
+
+    // Only mip tail is resident until first feedback arrives
+    set.residency.assign(width * height * set.arraySize, (BYTE)standardMips);
+    set.residencyDirty = false;
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = DXGI_FORMAT_R8_UINT;
+    desc.ArraySize = set.arraySize;
+    desc.MipLevels = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Height = height;
+    desc.Width = width;
+
+    std::vector<D3D11_SUBRESOURCE_DATA> data(set.arraySize);
+    for (UINT i = 0; i < set.arraySize; i++)
+    {
+        data[i].pSysMem = set.residency.data() + i * width * height;
+        data[i].SysMemPitch = width;
+        data[i].SysMemSlicePitch = 0;
+    }
+
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, data.data(), &set.pResidency);
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(set.pResidency, name + "Residency");
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+        viewDesc.Format = desc.Format;
+        viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+        viewDesc.Texture2DArray.ArraySize = desc.ArraySize;
+        viewDesc.Texture2DArray.MipLevels = 1;
+
+        result = m_pDevice->CreateShaderResourceView(set.pResidency, &viewDesc, &set.pResidencyView);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = SetResourceName(set.pResidencyView, name + "ResidencyView");
+    }
+
+    return result;
+}
+
+HRESULT VirtualTextures::MapPackedMips(UINT setIdx, UINT& poolTile)
+{
+    Set& set = m_sets[setIdx];
+    const TextureDesc& first = set.files[0];
+    UINT standardMips = m_info.sets[setIdx].standardMips;
+
+    HRESULT result = S_OK;
+    for (UINT slice = 0; slice < set.arraySize && set.packedTilesPerSlice > 0 && SUCCEEDED(result); slice++)
+    {
+        D3D11_TILED_RESOURCE_COORDINATE coord = { 0, 0, 0, D3D11CalcSubresource(standardMips, slice, set.mipCount) };
+        D3D11_TILE_REGION_SIZE region = { set.packedTilesPerSlice, FALSE, 0, 0, 0 };
+        UINT rangeFlags = 0;
+        UINT rangeTileCount = set.packedTilesPerSlice;
+        result = m_pContext->UpdateTileMappings(set.pTexture, 1, &coord, &region, m_pTilePool, 1, &rangeFlags, &poolTile, &rangeTileCount, 0);
+        poolTile += set.packedTilesPerSlice;
+
+        for (UINT mip = standardMips; mip < set.mipCount && SUCCEEDED(result); mip++)
+        {
+            UINT32 pitch = 0;
+            GetMipSize(first.fmt, first.width, first.height, mip, &pitch);
+            StallDetector::Get().UpdateSubresource(m_pContext, set.pTexture, D3D11CalcSubresource(mip, slice, set.mipCount), nullptr, GetFileData(set, slice, mip), pitch, 0, STALL_SITE);
+        }
+    }
+
+    return result;
+}
+
+void VirtualTextures::Term()
+{
+    for (UINT i = 0; i < SetCount; i++)
+    {
+        Set& set = m_sets[i];
+        SAFE_RELEASE(set.pView);
+        SAFE_RELEASE(set.pTexture);
+        SAFE_RELEASE(set.pResidencyView);
+        SAFE_RELEASE(set.pResidency);
+        for (TextureDesc& file : set.files)
+        {
+            FreeDDS(file);
+        }
+        set.files.clear();
+        set.residency.clear();
+        set.arraySize = 0;
+        set.mipCount = 0;
+        set.packedTilesPerSlice = 0;
+        set.residencyDirty = false;
+    }
+
+    m_feedbackReadback.Term();
+    m_constants.Term();
+    SAFE_RELEASE(m_pFeedbackUAV);
+    SAFE_RELEASE(m_pFeedback);
+    SAFE_RELEASE(m_pTilePool);
+    SAFE_RELEASE(m_pContext);
+    SAFE_RELEASE(m_pDevice);
+
+    m_tilePoolTiles.clear();
+    m_tileLastUsed.clear();
+    m_poolTileBits.clear();
+    m_requests.clear();
+    m_poolTiles = 0;
+    m_packedTiles = 0;
+    m_feedbackBits = 0;
+}
+
+void VirtualTextures::BeginFrame(ID3D11DeviceContext* pContext)
+{
+    static const UINT Zeros[4] = {};
+    pContext->ClearUnorderedAccessViewUint(m_pFeedbackUAV, Zeros);
+
+    // Step coprime with period visits every pixel of the block, and spreads consecutive ones apart
+    m_info.feedbackParams = Point4i{ (int)((m_frame * 7) % FeedbackPeriod), 0, 0, 0 };
+    m_constants.Update(pContext, m_info);
+}
+
+void VirtualTextures::EndFrame(ID3D11DeviceContext* pContext)
+{
+    UINT feedbackSize = DivUp(std::max(m_feedbackBits, 1u), 32u) * (UINT)sizeof(UINT);
+    m_feedbackReadback.Copy(pContext, m_pFeedback, 0, feedbackSize, 0);
+    m_feedbackReadback.EndFrame(pContext);
+
+    m_frame++;
+}
+
+void VirtualTextures::Update()
+{
+    std::vector<UINT> feedback(DivUp(std::max(m_feedbackBits, 1u), 32u));
+    UINT64 frame = 0;
+    if (m_feedbackReadback.Read(m_pContext, feedback.data(), (UINT)(feedback.size() * sizeof(UINT)), &frame))
+    {
+        // Zero is left for tiles never requested
+        m_feedbackFrame = frame + 1;
+        RequestTiles(feedback);
+    }
+
+    UINT mapped = 0;
+    size_t processed = 0;
+    for (; processed < m_requests.size() && mapped < UploadBudget; processed++)
+    {
+        UINT bit = m_requests[processed];
+        if (m_tilePoolTiles[bit] != NoTile)
+        {
+            continue;
+        }
+
+        UINT poolTile = AllocatePoolTile();
+        if (poolTile == NoTile)
+        {
+            // Pool is full of tiles in view, the rest waits for next feedback
+            processed = m_requests.size();
+            break;
+        }
+        MapTile(bit, poolTile);
+        mapped++;
+    }
+    m_requests.erase(m_requests.begin(), m_requests.begin() + processed);
+
+    for (UINT i = 0; i < SetCount; i++)
+    {
+        if (m_sets[i].residencyDirty)
+        {
+            UpdateResidency(i);
+        }
+    }
+}
+
+void VirtualTextures::RequestTiles(const std::vector<UINT>& feedback)
+{
+    m_requests.clear();
+
+    std::vector<bool> requested(m_feedbackBits, false);
+    for (UINT word = 0; word < (UINT)feedback.size(); word++)
+    {
+        for (UINT i = 0; i < 32 && feedback[word] >> i != 0; i++)
+        {
+            if ((feedback[word] & (1u << i)) == 0)
+            {
+                continue;
+            }
+
+            // Coarser tiles under it are needed by trilinear filtering and as fallback until it is mapped
+            Tile tile = DecodeTile(word * 32 + i);
+            const Set& set = m_sets[tile.set];
+            for (; tile.mip < m_info.sets[tile.set].standardMips; tile.mip++, tile.x /= 2, tile.y /= 2)
+            {
+                tile.x = std::min(tile.x, set.tilings[tile.mip].WidthInTiles - 1);
+                tile.y = std::min(tile.y, set.tilings[tile.mip].HeightInTiles - 1);
+                UINT bit = EncodeTile(tile);
+                if (requested[bit])
+                {
+                    break;
+                }
+                requested[bit] = true;
+                m_tileLastUsed[bit] = m_feedbackFrame;
+                if (m_tilePoolTiles[bit] == NoTile)
+                {
+                    m_requests.push_back(bit);
+                }
+            }
+        }
+    }
+
+    // Coarsest first, so each mapped tile has resident ones to fall back to
+    std::stable_sort(m_requests.begin(), m_requests.end(), [this](UINT a, UINT b)
+    {
+        return DecodeTile(a).mip > DecodeTile(b).mip;
+    });
+}
+
+UINT VirtualTextures::AllocatePoolTile()
+{
+    // Free tile, otherwise the least recently requested one which was not in view of the last feedback
+    UINT oldest = NoTile;
+    for (UINT i = 0; i < m_poolTiles; i++)
+    {
+        UINT bit = m_poolTileBits[i];
+        if (bit == NoTile)
+        {
+            return i;
+        }
+        if (m_tileLastUsed[bit] < m_feedbackFrame && (oldest == NoTile || m_tileLastUsed[bit] < m_tileLastUsed[m_poolTileBits[oldest]]))
+        {
+            oldest = i;
+        }
+    }
+
+    if (oldest != NoTile)
+    {
+        MapTile(m_poolTileBits[oldest], NoTile);
+    }
+    return oldest;
+}
+
+void VirtualTextures::MapTile(UINT bit, UINT poolTile)
+{
+    Tile tile = DecodeTile(bit);
+    Set& set = m_sets[tile.set];
+    const SetInfo& info = m_info.sets[tile.set];
+
+    D3D11_TILED_RESOURCE_COORDINATE coord = { tile.x, tile.y, 0, D3D11CalcSubresource(tile.mip, tile.slice, set.mipCount) };
+    D3D11_TILE_REGION_SIZE region = { 1, FALSE, 0, 0, 0 };
+    UINT rangeFlags = poolTile == NoTile ? D3D11_TILE_RANGE_NULL : 0;
+    UINT poolStart = poolTile == NoTile ? 0 : m_packedTiles + poolTile;
+    UINT rangeTileCount = 1;
+    HRESULT result = m_pContext->UpdateTileMappings(set.pTexture, 1, &coord, &region, m_pTilePool, 1, &rangeFlags, &poolStart, &rangeTileCount, 0);
+    assert(SUCCEEDED(result));
+    set.residencyDirty = true;
+
+    if (poolTile == NoTile)
+    {
+        m_poolTileBits[m_tilePoolTiles[bit]] = NoTile;
+        m_tilePoolTiles[bit] = NoTile;
+        ++m_evictedTiles;
+        return;
+    }
+    m_poolTileBits[poolTile] = bit;
+    m_tilePoolTiles[bit] = poolTile;
+    ++m_mappedTiles;
+
+    // Edge tiles of mips which are not multiple of tile size are clipped
+    const TextureDesc& first = set.files[0];
+    UINT width = std::max(1u, first.width >> tile.mip);
+    UINT height = std::max(1u, first.height >> tile.mip);
+    D3D11_BOX box;
+    box.left = tile.x * info.tileShape[0];
+    box.top = tile.y * info.tileShape[1];
+    box.front = 0;
+    box.right = std::min(box.left + info.tileShape[0], width);
+    box.bottom = std::min(box.top + info.tileShape[1], height);
+    box.back = 1;
+
+    UINT32 pitch = 0;
+    GetMipSize(first.fmt, first.width, first.height, tile.mip, &pitch);
+    UINT32 blockBytes = pitch / DivUp(width, 4u);
+    const BYTE* pData = GetFileData(set, tile.slice, tile.mip) + (box.top / 4) * pitch + (box.left / 4) * blockBytes;
+    StallDetector::Get().UpdateSubresource(m_pContext, set.pTexture, coord.Subresource, &box, pData, pitch, 0, STALL_SITE);
+}
+
+void VirtualTextures::UpdateResidency(UINT setIdx)
+{
+    Set& set = m_sets[setIdx];
+    const SetInfo& info = m_info.sets[setIdx];
+    set.residencyDirty = false;
+    if (info.standardMips == 0)
+    {
+        return;
+    }
+
+    UINT width = set.tilings[0].WidthInTiles;
+    UINT height = set.tilings[0].HeightInTiles;
+    std::vector<BYTE> resident(width * height);
+    for (UINT slice = 0; slice < set.arraySize; slice++)
+    {
+        // Finest mip of mip 0 tile which has all coarser ones under it resident
+        for (UINT y = 0; y < height; y++)
+        {
+            for (UINT x = 0; x < width; x++)
+            {
+                UINT mip = info.standardMips;
+                while (mip > 0)
+                {
+                    Tile tile = { setIdx, slice, mip - 1, std::min(x >> (mip - 1), set.tilings[mip - 1].WidthInTiles - 1), std::min(y >> (mip - 1), set.tilings[mip - 1].HeightInTiles - 1) };
+                    if (m_tilePoolTiles[EncodeTile(tile)] == NoTile)
+                    {
+                        break;
+                    }
+                    mip--;
+                }
+                resident[y * width + x] = (BYTE)mip;
+            }
+        }
+
+        // Filter footprint near tile edge reaches into neighbours, so the coarsest mip around is taken
+        BYTE* pResidency = set.residency.data() + slice * width * height;
+        for (UINT y = 0; y < height; y++)
+        {
+            for (UINT x = 0; x < width; x++)
+            {
+                BYTE mip = 0;
+                for (UINT ny = (y > 0 ? y - 1 : 0); ny <= std::min(y + 1, height - 1); ny++)
+                {
+                    for (UINT nx = (x > 0 ? x - 1 : 0); nx <= std::min(x + 1, width - 1); nx++)
+                    {
+                        mip = std::max(mip, resident[ny * width + nx]);
+                    }
+                }
+                pResidency[y * width + x] = mip;
+            }
+        }
+        StallDetector::Get().UpdateSubresource(m_pContext, set.pResidency, D3D11CalcSubresource(0, slice, 1), nullptr, pResidency, width, 0, STALL_SITE);
+    }
+}
+
+VirtualTextures::Tile VirtualTextures::DecodeTile(UINT bit) const
+{
+    Tile tile = {};
+    while (tile.set + 1 < SetCount && bit >= m_info.sets[tile.set + 1].feedbackBase)
+    {
+        tile.set++;
+    }
+
+    const SetInfo& info = m_info.sets[tile.set];
+    UINT local = bit - info.feedbackBase;
+    tile.slice = local / info.sliceBits;
+    local %= info.sliceBits;
+    while (tile.mip + 1 < info.standardMips && local >= info.mipBits[tile.mip + 1])
+    {
+        tile.mip++;
+    }
+    local -= info.mipBits[tile.mip];
+
+    UINT widthInTiles = m_sets[tile.set].tilings[tile.mip].WidthInTiles;
+    tile.x = local % widthInTiles;
+    tile.y = local / widthInTiles;
+    return tile;
+}
+
+UINT VirtualTextures::EncodeTile(const Tile& tile) const
+{
+    const SetInfo& info = m_info.sets[tile.set];
+    return info.feedbackBase + tile.slice * info.sliceBits + info.mipBits[tile.mip]
+        + tile.y * m_sets[tile.set].tilings[tile.mip].WidthInTiles + tile.x;
+}
+
+const BYTE* VirtualTextures::GetFileData(const Set& set, UINT slice, UINT mip) const
+{
+    for (const TextureDesc& file : set.files)
+    {
+        if (slice < file.arraySize)
+        {
+            return reinterpret_cast<const BYTE*>(file.pData) + slice * file.sliceSize + GetMipChainSize(file.fmt, file.width, file.height, mip);
+        }
+        slice -= file.arraySize;
+    }
+    return nullptr;
+}
+
+VirtualTextures::Stats VirtualTextures::GetStats() const
+{
+    Stats stats = {};
+    stats.residentTiles = (UINT)std::count_if(m_poolTileBits.begin(), m_poolTileBits.end(), [](UINT bit) { return bit != NoTile; });
+    stats.poolTiles = m_poolTiles;
+    stats.packedTiles = m_packedTiles;
+    stats.pendingTiles = (UINT)m_requests.size();
+    stats.mappedTiles = m_mappedTiles;
+    stats.evictedTiles = m_evictedTiles;
+    return stats;
+}
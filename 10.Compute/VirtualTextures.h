@@ -0,0 +1,176 @@
+#pragma once
+
+#include <d3d11_2.h>
+
+#include "../Core/DDS.h"
+
+#include "ConstantBuffer.h"
+#include "GpuReadback.h"
+#include "MaterialTable.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Sparse virtual texturing of material texture arrays with D3D11.2 tiled resources.
+ * Each texture set is a tiled array, all sets share one tile pool, only packed mip tails are always mapped.
+ * Material shaders clamp LOD to resident mips by residency map, and one pixel of each 4x4 block marks
+ * tile of the mip it wants in feedback buffer. Feedback is read back a few frames later, missing tiles are
+ * copied from mapped DDS files coarsest first, least recently used ones are unmapped when pool is full.
+ */
+class VirtualTextures
+{
+public:
+    static const UINT SetCount = MaterialTable::TextureSetCount;
+    static const UINT MaxMips = 16; // Should match VirtualMaxMips in Material.h
+    static const UINT TileBytes = D3D11_2_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+    static const UINT DefaultPoolTiles = 256; // 16 MB, packed mip tails are extra
+    static const UINT UploadBudget = 32; // Tiles mapped per frame
+    static const UINT FeedbackPeriod = 16; // Pixels of 4x4 block, each frame another one writes feedback
+
+    // Should match VirtualTextureInfo in Material.h
+    struct SetInfo
+    {
+        UINT size[2];      // Mip 0 size in texels
+        UINT tileShape[2]; // Standard tile size in texels
+        UINT standardMips; // Mips of standard tiles, coarser ones are packed
+        UINT sliceBits;    // Feedback bits per array slice
+        UINT feedbackBase; // First feedback bit of the set
+        UINT pad;
+        UINT mipBits[MaxMips]; // First feedback bit of each mip inside a slice
+    };
+
+    // Should match VirtualTextureBuffer in Material.h
+    struct Constants
+    {
+        SetInfo sets[SetCount];
+        Point4i feedbackParams; // x - pixel of 4x4 block which writes feedback
+    };
+
+    struct Stats
+    {
+        UINT residentTiles;
+        UINT poolTiles;
+        UINT packedTiles;  // Mip tails, always resident
+        UINT pendingTiles; // Requested by last feedback and not mapped yet
+        UINT64 mappedTiles;
+        UINT64 evictedTiles;
+    };
+
+    VirtualTextures()
+        : m_pDevice(nullptr)
+        , m_pContext(nullptr)
+        , m_pTilePool(nullptr)
+        , m_pFeedback(nullptr)
+        , m_pFeedbackUAV(nullptr)
+        , m_poolTiles(0)
+        , m_packedTiles(0)
+        , m_feedbackBits(0)
+        , m_frame(0)
+        , m_feedbackFrame(0)
+        , m_mappedTiles(0)
+        , m_evictedTiles(0)
+    {
+        for (UINT i = 0; i < SetCount; i++)
+        {
+            m_sets[i].pTexture = nullptr;
+            m_sets[i].pView = nullptr;
+            m_sets[i].pResidency = nullptr;
+            m_sets[i].pResidencyView = nullptr;
+            m_sets[i].arraySize = 0;
+            m_sets[i].mipCount = 0;
+            m_sets[i].packedTilesPerSlice = 0;
+            m_sets[i].residencyDirty = false;
+        }
+    }
+
+    /** Tier 2 is needed for LOD clamp in shaders and defined reads of unmapped tiles */
+    static bool IsSupported(ID3D11Device* pDevice);
+
+    /** Tiled arrays of texture files of materials, files stay mapped until Term */
+    HRESULT Init(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, const MaterialTable& materials, UINT poolTiles = DefaultPoolTiles);
+    void Term();
+    inline bool IsInitialized() const { return m_pTilePool != nullptr; }
+
+    /** Clear feedback and set constants of the frame, before materials are drawn */
+    void BeginFrame(ID3D11DeviceContext* pContext);
+    /** Queue feedback of the frame for readback, after materials are drawn */
+    void EndFrame(ID3D11DeviceContext* pContext);
+    /** Map tiles of completed feedback and update residency maps, on render thread between frames */
+    void Update();
+
+    inline ID3D11ShaderResourceView* GetView(UINT set) const { return m_sets[set].pView; }
+    inline ID3D11ShaderResourceView* GetResidencyView(UINT set) const { return m_sets[set].pResidencyView; }
+    inline ID3D11Buffer* GetConstants() const { return m_constants.Get(); }
+    inline ID3D11UnorderedAccessView* GetFeedbackUAV() const { return m_pFeedbackUAV; }
+    inline UINT GetPendingCount() const { return (UINT)m_requests.size(); }
+
+    Stats GetStats() const;
+
+private:
+    static const UINT NoTile = 0xFFFFFFFF;
+
+    struct Set
+    {
+        std::vector<TextureDesc> files;
+        ID3D11Texture2D* pTexture;
+        ID3D11ShaderResourceView* pView;
+        ID3D11Texture2D* pResidency; // Finest resident mip per mip 0 tile
+        ID3D11ShaderResourceView* pResidencyView;
+        UINT arraySize;
+        UINT mipCount;
+        UINT packedTilesPerSlice;
+        D3D11_SUBRESOURCE_TILING tilings[MaxMips]; // Of standard mips, the same in all slices
+        std::vector<BYTE> residency;
+        bool residencyDirty;
+    };
+
+    struct Tile
+    {
+        UINT set;
+        UINT slice;
+        UINT mip;
+        UINT x;
+        UINT y;
+    };
+
+    HRESULT InitSet(UINT set, const std::vector<std::wstring>& files, const std::string& name);
+    HRESULT InitResidency(UINT set, const std::string& name);
+    HRESULT MapPackedMips(UINT set, UINT& poolTile);
+
+    Tile DecodeTile(UINT bit) const;
+    UINT EncodeTile(const Tile& tile) const;
+    const BYTE* GetFileData(const Set& set, UINT slice, UINT mip) const;
+
+    void RequestTiles(const std::vector<UINT>& feedback);
+    UINT AllocatePoolTile();
+    void MapTile(UINT bit, UINT poolTile);
+    void UpdateResidency(UINT set);
+
+private:
+    ID3D11Device2* m_pDevice;
+    ID3D11DeviceContext2* m_pContext;
+
+    Set m_sets[SetCount];
+    Constants m_info;
+    ConstantBuffer<Constants> m_constants;
+
+    ID3D11Buffer* m_pTilePool;
+    UINT m_poolTiles;
+    UINT m_packedTiles; // Start of streamed tiles in pool
+
+    ID3D11Buffer* m_pFeedback;
+    ID3D11UnorderedAccessView* m_pFeedbackUAV;
+    UINT m_feedbackBits;
+    GpuReadback m_feedbackReadback;
+
+    std::vector<UINT> m_tilePoolTiles; // By feedback bit, NoTile if not resident
+    std::vector<UINT64> m_tileLastUsed; // Feedback frame which last requested the tile
+    std::vector<UINT> m_poolTileBits; // By streamed pool tile, NoTile if free
+    std::vector<UINT> m_requests; // Feedback bits, coarsest mips first
+
+    UINT64 m_frame;
+    UINT64 m_feedbackFrame;
+    UINT64 m_mappedTiles;
+    UINT64 m_evictedTiles;
+};
@@ -43,8 +43,14 @@
     }\
 }
 
+// Defined in MemoryRegistry.cpp
+void TrackResourceMemory(ID3D11DeviceChild* pResource, const std::string& name);
+
 inline HRESULT SetResourceName(ID3D11DeviceChild* pResource, const std::string& name)
 {
+    // Every named buffer and texture is recorded with its size
+    TrackResourceMemory(pResource, name);
+
     return pResource->SetPrivateData(WKPDID_D3DDebugObjectName, (UINT)name.length(), name.c_str());
 }
 
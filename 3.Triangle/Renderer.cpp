@@ -106,6 +106,8 @@ void Renderer::Term()
 {
     TermScene();
 
+    SAFE_RELEASE(m_pCommandList);
+    SAFE_RELEASE(m_pDeferredContext);
     SAFE_RELEASE(m_pBackBufferRTV);
     SAFE_RELEASE(m_pSwapChain);
     SAFE_RELEASE(m_pDeviceContext);
@@ -134,13 +136,36 @@ void Renderer::Term()
 
 bool Renderer::Render()
 {
-    m_pDeviceContext->ClearState();
+    if (m_minimalOverhead && m_pCommandList == nullptr)
+    {
+        // Frame is rendered directly if command list can not be recorded
+        m_minimalOverhead = SUCCEEDED(RecordCommandList());
+    }
+
+    if (m_minimalOverhead)
+    {
+        // Nothing changes between frames, so the whole frame is replayed
+        m_pDeviceContext->ExecuteCommandList(m_pCommandList, FALSE);
+    }
+    else
+    {
+        m_pDeviceContext->ClearState();
+        RenderFrame(m_pDeviceContext);
+    }
+
+    HRESULT result = m_pSwapChain->Present(0, 0);
+    assert(SUCCEEDED(result));
+
+    return SUCCEEDED(result);
+}
 
+void Renderer::RenderFrame(ID3D11DeviceContext* pContext)
+{
     ID3D11RenderTargetView* views[] = { m_pBackBufferRTV };
-    m_pDeviceContext->OMSetRenderTargets(1, views, nullptr);
+    pContext->OMSetRenderTargets(1, views, nullptr);
 
     static const FLOAT BackColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
-    m_pDeviceContext->ClearRenderTargetView(m_pBackBufferRTV, BackColor);
+    pContext->ClearRenderTargetView(m_pBackBufferRTV, BackColor);
 
     D3D11_VIEWPORT viewport;
     viewport.TopLeftX = 0;
@@ -149,36 +174,50 @@ bool Renderer::Render()
     viewport.Height = (FLOAT)m_height;
     viewport.MinDepth = 0.0f;
     viewport.MaxDepth = 1.0f;
-    m_pDeviceContext->RSSetViewports(1, &viewport);
+    pContext->RSSetViewports(1, &viewport);
 
     D3D11_RECT rect;
     rect.left = 0;
     rect.top = 0;
     rect.right = m_width;
     rect.bottom = m_height;
-    m_pDeviceContext->RSSetScissorRects(1, &rect);
+    pContext->RSSetScissorRects(1, &rect);
 
-    m_pDeviceContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
     ID3D11Buffer* vertexBuffers[] = {m_pVertexBuffer};
     UINT strides[] = {16};
     UINT offsets[] = {0};
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pVertexShader, nullptr, 0);
-    m_pDeviceContext->PSSetShader(m_pPixelShader, nullptr, 0);
-    m_pDeviceContext->DrawIndexed(3, 0, 0);
+    pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+    pContext->IASetInputLayout(m_pInputLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pContext->VSSetShader(m_pVertexShader, nullptr, 0);
+    pContext->PSSetShader(m_pPixelShader, nullptr, 0);
+    pContext->DrawIndexed(3, 0, 0);
+}
 
-    HRESULT result = m_pSwapChain->Present(0, 0);
+HRESULT Renderer::RecordCommandList()
+{
+    HRESULT result = S_OK;
+    if (m_pDeferredContext == nullptr)
+    {
+        result = m_pDevice->CreateDeferredContext(0, &m_pDeferredContext);
+    }
+    if (SUCCEEDED(result))
+    {
+        RenderFrame(m_pDeferredContext);
+        result = m_pDeferredContext->FinishCommandList(FALSE, &m_pCommandList);
+    }
     assert(SUCCEEDED(result));
 
-    return SUCCEEDED(result);
+    return result;
 }
 
 bool Renderer::Resize(UINT width, UINT height)
 {
     if (width != m_width || height != m_height)
     {
+        // Recorded frame refers to old views and viewport size
+        SAFE_RELEASE(m_pCommandList);
         SAFE_RELEASE(m_pBackBufferRTV);
 
         HRESULT result = m_pSwapChain->ResizeBuffers(2, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
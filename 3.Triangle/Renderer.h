@@ -18,6 +18,9 @@ public:
         , m_pPixelShader(nullptr)
         , m_pVertexShader(nullptr)
         , m_pInputLayout(nullptr)
+        , m_pDeferredContext(nullptr)
+        , m_pCommandList(nullptr)
+        , m_minimalOverhead(false)
     {}
 
     bool Init(HWND hWnd);
@@ -26,11 +29,17 @@ public:
     bool Render();
     bool Resize(UINT width, UINT height);
 
+    /** Record frame into command list once and replay it, only dynamic constants are written per frame */
+    inline void SetMinimalOverhead(bool minimalOverhead) { m_minimalOverhead = minimalOverhead; }
+
 private:
     HRESULT SetupBackBuffer();
     HRESULT InitScene();
     void TermScene();
 
+    void RenderFrame(ID3D11DeviceContext* pContext);
+    HRESULT RecordCommandList();
+
     HRESULT CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, ID3DBlob** ppCode = nullptr);
 
 private:
@@ -49,4 +58,8 @@ private:
 
     UINT m_width;
     UINT m_height;
+
+    ID3D11DeviceContext* m_pDeferredContext;
+    ID3D11CommandList* m_pCommandList;
+    bool m_minimalOverhead;
 };
@@ -29,6 +29,9 @@ public:
         , m_prevMouseY(0)
         , m_rotateModel(false)
         , m_angle(0.0)
+        , m_pDeferredContext(nullptr)
+        , m_pCommandList(nullptr)
+        , m_minimalOverhead(false)
     {}
 
     bool Init(HWND hWnd);
@@ -38,6 +41,9 @@ public:
     bool Render();
     bool Resize(UINT width, UINT height);
 
+    /** Record frame into command list once and replay it, only dynamic constants are written per frame */
+    inline void SetMinimalOverhead(bool minimalOverhead) { m_minimalOverhead = minimalOverhead; }
+
     void MouseRBPressed(bool pressed, int x, int y);
     void MouseMoved(int x, int y);
     void MouseWheel(int delta);
@@ -57,6 +63,9 @@ private:
     HRESULT InitScene();
     void TermScene();
 
+    void RenderFrame(ID3D11DeviceContext* pContext);
+    HRESULT RecordCommandList();
+
     HRESULT CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, ID3DBlob** ppCode = nullptr);
 
 private:
@@ -88,4 +97,8 @@ private:
     double m_angle;
 
     size_t m_prevUSec;
+
+    ID3D11DeviceContext* m_pDeferredContext;
+    ID3D11CommandList* m_pCommandList;
+    bool m_minimalOverhead;
 };
@@ -1,7 +1,6 @@
 #include "framework.h"
 
 #include "Renderer.h"
-#include "DDS.h"
 
 #include <d3dcompiler.h>
 
@@ -10,6 +9,8 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include "../Core/DDS.h"
+#include "../Core/Shapes.h"
 #include "../Math/Matrix.h"
 
 struct TextureVertex
@@ -40,52 +41,6 @@ static const float ModelRotationSpeed = (float)M_PI / 2.0f;
 
 static const float Eps = 0.00001f;
 
-namespace
-{
-
-void GetSphereDataSize(size_t latCells, size_t lonCells, size_t& indexCount, size_t& vertexCount)
-{
-    vertexCount = (latCells + 1) * (lonCells + 1);
-    indexCount = latCells * lonCells * 6;
-}
-
-void CreateSphere(size_t latCells, size_t lonCells, UINT16* pIndices, Point3f* pPos)
-{
-    for (size_t lat = 0; lat < latCells + 1; lat++)
-    {
-        for (size_t lon = 0; lon < lonCells + 1; lon++)
-        {
-            int index = (int)(lat * (lonCells + 1) + lon);
-            float lonAngle = 2.0f * (float)M_PI * lon / lonCells + (float)M_PI;
-            float latAngle = -(float)M_PI / 2 + (float)M_PI * lat / latCells;
-
-            Point3f r = Point3f{
-                sinf(lonAngle) * cosf(latAngle),
-                sinf(latAngle),
-                cosf(lonAngle) * cosf(latAngle)
-            };
-
-            pPos[index] = r * 0.5f;
-        }
-    }
-
-    for (size_t lat = 0; lat < latCells; lat++)
-    {
-        for (size_t lon = 0; lon < lonCells; lon++)
-        {
-            size_t index = lat * lonCells * 6 + lon * 6;
-            pIndices[index + 0] = (UINT16)(lat * (latCells + 1) + lon + 0);
-            pIndices[index + 2] = (UINT16)(lat * (latCells + 1) + lon + 1);
-            pIndices[index + 1] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon);
-            pIndices[index + 3] = (UINT16)(lat * (latCells + 1) + lon + 1);
-            pIndices[index + 5] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon + 1);
-            pIndices[index + 4] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon);
-        }
-    }
-}
-
-}
-
 void Renderer::Camera::GetDirections(Point3f& forward, Point3f& right)
 {
     Point3f dir = -Point3f{ cosf(theta) * cosf(phi), sinf(theta), cosf(theta) * sinf(phi) };
@@ -213,6 +168,8 @@ void Renderer::Term()
 {
     TermScene();
 
+    SAFE_RELEASE(m_pCommandList);
+    SAFE_RELEASE(m_pDeferredContext);
     SAFE_RELEASE(m_pBackBufferRTV);
     SAFE_RELEASE(m_pSwapChain);
     SAFE_RELEASE(m_pDeviceContext);
@@ -316,13 +273,36 @@ bool Renderer::Update()
 
 bool Renderer::Render()
 {
-    m_pDeviceContext->ClearState();
+    if (m_minimalOverhead && m_pCommandList == nullptr)
+    {
+        // Frame is rendered directly if command list can not be recorded
+        m_minimalOverhead = SUCCEEDED(RecordCommandList());
+    }
+
+    if (m_minimalOverhead)
+    {
+        // Update has already written dynamic constants, the rest of the frame is the same every time
+        m_pDeviceContext->ExecuteCommandList(m_pCommandList, FALSE);
+    }
+    else
+    {
+        m_pDeviceContext->ClearState();
+        RenderFrame(m_pDeviceContext);
+    }
+
+    HRESULT result = m_pSwapChain->Present(0, 0);
+    assert(SUCCEEDED(result));
+
+    return SUCCEEDED(result);
+}
 
+void Renderer::RenderFrame(ID3D11DeviceContext* pContext)
+{
     ID3D11RenderTargetView* views[] = { m_pBackBufferRTV };
-    m_pDeviceContext->OMSetRenderTargets(1, views, nullptr);
+    pContext->OMSetRenderTargets(1, views, nullptr);
 
     static const FLOAT BackColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
-    m_pDeviceContext->ClearRenderTargetView(m_pBackBufferRTV, BackColor);
+    pContext->ClearRenderTargetView(m_pBackBufferRTV, BackColor);
 
     D3D11_VIEWPORT viewport;
     viewport.TopLeftX = 0;
@@ -331,48 +311,62 @@ bool Renderer::Render()
     viewport.Height = (FLOAT)m_height;
     viewport.MinDepth = 0.0f;
     viewport.MaxDepth = 1.0f;
-    m_pDeviceContext->RSSetViewports(1, &viewport);
+    pContext->RSSetViewports(1, &viewport);
 
     D3D11_RECT rect;
     rect.left = 0;
     rect.top = 0;
     rect.right = m_width;
     rect.bottom = m_height;
-    m_pDeviceContext->RSSetScissorRects(1, &rect);
+    pContext->RSSetScissorRects(1, &rect);
 
-    RenderSphere();
+    RenderSphere(pContext);
 
-    m_pDeviceContext->RSSetState(m_pRasterizerState);
+    pContext->RSSetState(m_pRasterizerState);
 
     ID3D11SamplerState* samplers[] = {m_pSampler};
-    m_pDeviceContext->PSSetSamplers(0, 1, samplers);
+    pContext->PSSetSamplers(0, 1, samplers);
 
     ID3D11ShaderResourceView* resources[] = {m_pTextureView};
-    m_pDeviceContext->PSSetShaderResources(0, 1, resources);
+    pContext->PSSetShaderResources(0, 1, resources);
 
-    m_pDeviceContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
     ID3D11Buffer* vertexBuffers[] = {m_pVertexBuffer};
     UINT strides[] = {20};
     UINT offsets[] = {0};
     ID3D11Buffer* cbuffers[] = {m_pSceneBuffer, m_pGeomBuffer};
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pVertexShader, nullptr, 0);
-    m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetShader(m_pPixelShader, nullptr, 0);
-    m_pDeviceContext->DrawIndexed(36, 0, 0);
+    pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+    pContext->IASetInputLayout(m_pInputLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pContext->VSSetShader(m_pVertexShader, nullptr, 0);
+    pContext->VSSetConstantBuffers(0, 2, cbuffers);
+    pContext->PSSetShader(m_pPixelShader, nullptr, 0);
+    pContext->DrawIndexed(36, 0, 0);
+}
 
-    HRESULT result = m_pSwapChain->Present(0, 0);
+HRESULT Renderer::RecordCommandList()
+{
+    HRESULT result = S_OK;
+    if (m_pDeferredContext == nullptr)
+    {
+        result = m_pDevice->CreateDeferredContext(0, &m_pDeferredContext);
+    }
+    if (SUCCEEDED(result))
+    {
+        RenderFrame(m_pDeferredContext);
+        result = m_pDeferredContext->FinishCommandList(FALSE, &m_pCommandList);
+    }
     assert(SUCCEEDED(result));
 
-    return SUCCEEDED(result);
+    return result;
 }
 
 bool Renderer::Resize(UINT width, UINT height)
 {
     if (width != m_width || height != m_height)
     {
+        // Recorded frame refers to old views and viewport size
+        SAFE_RELEASE(m_pCommandList);
         SAFE_RELEASE(m_pBackBufferRTV);
 
         HRESULT result = m_pSwapChain->ResizeBuffers(2, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
@@ -747,7 +741,7 @@ HRESULT Renderer::InitScene()
             result = SetResourceName(m_pTexture, WCSToMBS(TextureName));
         }
 
-        free(textureDesc.pData);
+        FreeDDS(textureDesc);
     }
     if (SUCCEEDED(result))
     {
@@ -975,7 +969,7 @@ HRESULT Renderer::InitCubemap()
         }
         for (int i = 0; i < 6; i++)
         {
-            free(texDescs[i].pData);
+            FreeDDS(texDescs[i]);
         }
     }
     if (SUCCEEDED(result))
@@ -1029,51 +1023,30 @@ void Renderer::TermScene()
     SAFE_RELEASE(m_pCubemapView);
 }
 
-void Renderer::RenderSphere()
+void Renderer::RenderSphere(ID3D11DeviceContext* pContext)
 {
     ID3D11SamplerState* samplers[] = { m_pSampler };
-    m_pDeviceContext->PSSetSamplers(0, 1, samplers);
+    pContext->PSSetSamplers(0, 1, samplers);
 
     ID3D11ShaderResourceView* resources[] = { m_pCubemapView };
-    m_pDeviceContext->PSSetShaderResources(0, 1, resources);
+    pContext->PSSetShaderResources(0, 1, resources);
 
-    m_pDeviceContext->IASetIndexBuffer(m_pSphereIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pContext->IASetIndexBuffer(m_pSphereIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
     ID3D11Buffer* vertexBuffers[] = { m_pSphereVertexBuffer };
     UINT strides[] = { 12 };
     UINT offsets[] = { 0 };
     ID3D11Buffer* cbuffers[] = { m_pSceneBuffer, m_pSphereGeomBuffer };
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pSphereInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pSphereVertexShader, nullptr, 0);
-    m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetShader(m_pSpherePixelShader, nullptr, 0);
-    m_pDeviceContext->DrawIndexed(m_sphereIndexCount, 0, 0);
+    pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+    pContext->IASetInputLayout(m_pSphereInputLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pContext->VSSetShader(m_pSphereVertexShader, nullptr, 0);
+    pContext->VSSetConstantBuffers(0, 2, cbuffers);
+    pContext->PSSetShader(m_pSpherePixelShader, nullptr, 0);
+    pContext->DrawIndexed(m_sphereIndexCount, 0, 0);
 }
 
 HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, ID3DBlob** ppCode)
 {
-    // Try to load shader's source code first
-    FILE* pFile = nullptr;
-    _wfopen_s(&pFile, path.c_str(), L"rb");
-    assert(pFile != nullptr);
-    if (pFile == nullptr)
-    {
-        return E_FAIL;
-    }
-
-    fseek(pFile, 0, SEEK_END);
-    long long size = _ftelli64(pFile);
-    fseek(pFile, 0, SEEK_SET);
-
-    std::vector<char> data;
-    data.resize(size + 1);
-
-    size_t rd = fread(data.data(), 1, size, pFile);
-    assert(rd == (size_t)size);
-
-    fclose(pFile);
-
     // Determine shader's type
     std::wstring ext = Extension(path);
 
@@ -1097,16 +1070,10 @@ HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceC
     flags1 |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif // _DEBUG
 
-    // Try to compile
+    // Compiled only if source or any of included files changed since bytecode was cached
     ID3DBlob* pCode = nullptr;
-    ID3DBlob* pErrMsg = nullptr;
-    HRESULT result = D3DCompile(data.data(), data.size(), WCSToMBS(path).c_str(), nullptr, nullptr, entryPoint.c_str(), platform.c_str(), flags1, 0, &pCode, &pErrMsg);
-    if (!SUCCEEDED(result) && pErrMsg != nullptr)
-    {
-        OutputDebugStringA((const char*)pErrMsg->GetBufferPointer());
-    }
+    HRESULT result = m_shaderCache.GetBytecode(path, {}, entryPoint, platform, flags1, &pCode);
     assert(SUCCEEDED(result));
-    SAFE_RELEASE(pErrMsg);
 
     // Create shader itself if anything else is OK
     if (SUCCEEDED(result))
@@ -3,6 +3,7 @@
 #include <dxgi.h>
 #include <d3d11.h>
 
+#include "../Core/ShaderCache.h"
 #include "../Math/Point.h"
 
 class Renderer
@@ -45,6 +46,9 @@ public:
         , m_pSampler(nullptr)
         , m_forwardDelta(0.0)
         , m_rightDelta(0.0)
+        , m_pDeferredContext(nullptr)
+        , m_pCommandList(nullptr)
+        , m_minimalOverhead(false)
     {}
 
     bool Init(HWND hWnd);
@@ -54,6 +58,9 @@ public:
     bool Render();
     bool Resize(UINT width, UINT height);
 
+    /** Record frame into command list once and replay it, only dynamic constants are written per frame */
+    inline void SetMinimalOverhead(bool minimalOverhead) { m_minimalOverhead = minimalOverhead; }
+
     void MouseRBPressed(bool pressed, int x, int y);
     void MouseMoved(int x, int y);
     void MouseWheel(int delta);
@@ -78,7 +85,9 @@ private:
     HRESULT InitCubemap();
     void TermScene();
 
-    void RenderSphere();
+    void RenderFrame(ID3D11DeviceContext* pContext);
+    void RenderSphere(ID3D11DeviceContext* pContext);
+    HRESULT RecordCommandList();
 
     HRESULT CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, ID3DBlob** ppCode = nullptr);
 
@@ -89,6 +98,8 @@ private:
     IDXGISwapChain* m_pSwapChain;
     ID3D11RenderTargetView* m_pBackBufferRTV;
 
+    ShaderCache m_shaderCache;
+
     ID3D11Buffer* m_pSceneBuffer;
 
     // For cube
@@ -130,4 +141,8 @@ private:
     double m_rightDelta;
 
     size_t m_prevUSec;
+
+    ID3D11DeviceContext* m_pDeferredContext;
+    ID3D11CommandList* m_pCommandList;
+    bool m_minimalOverhead;
 };
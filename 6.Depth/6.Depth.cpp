@@ -24,6 +24,7 @@ UINT                WindowWidth = 1280;
 UINT                WindowHeight = 720;
 
 Renderer* pRenderer = nullptr;
+bool MinimalOverhead = false; // Replay of recorded command list, floor of per frame API cost
 
 bool PressedKeys[0xff] = {};
 
@@ -33,9 +34,8 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
-    // TODO: Place code here.
+    MinimalOverhead = wcsstr(lpCmdLine, L"-minimalOverhead") != nullptr;
 
     // Initialize global strings
     LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
@@ -144,6 +144,7 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
     }
 
     pRenderer = new Renderer();
+    pRenderer->SetMinimalOverhead(MinimalOverhead);
     if (!pRenderer->Init(hWnd))
     {
         delete pRenderer;
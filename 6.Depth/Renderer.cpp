@@ -1,7 +1,6 @@
 #include "framework.h"
 
 #include "Renderer.h"
-#include "DDS.h"
 
 #include <d3dcompiler.h>
 
@@ -10,6 +9,8 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include "../Core/DDS.h"
+#include "../Core/Shapes.h"
 #include "../Math/Matrix.h"
 
 struct TextureVertex
@@ -53,52 +54,6 @@ static const float ModelRotationSpeed = (float)M_PI / 2.0f;
 
 static const float Eps = 0.00001f;
 
-namespace
-{
-
-void GetSphereDataSize(size_t latCells, size_t lonCells, size_t& indexCount, size_t& vertexCount)
-{
-    vertexCount = (latCells + 1) * (lonCells + 1);
-    indexCount = latCells * lonCells * 6;
-}
-
-void CreateSphere(size_t latCells, size_t lonCells, UINT16* pIndices, Point3f* pPos)
-{
-    for (size_t lat = 0; lat < latCells + 1; lat++)
-    {
-        for (size_t lon = 0; lon < lonCells + 1; lon++)
-        {
-            int index = (int)(lat * (lonCells + 1) + lon);
-            float lonAngle = 2.0f * (float)M_PI * lon / lonCells + (float)M_PI;
-            float latAngle = -(float)M_PI / 2 + (float)M_PI * lat / latCells;
-
-            Point3f r = Point3f{
-                sinf(lonAngle) * cosf(latAngle),
-                sinf(latAngle),
-                cosf(lonAngle) * cosf(latAngle)
-            };
-
-            pPos[index] = r * 0.5f;
-        }
-    }
-
-    for (size_t lat = 0; lat < latCells; lat++)
-    {
-        for (size_t lon = 0; lon < lonCells; lon++)
-        {
-            size_t index = lat * lonCells * 6 + lon * 6;
-            pIndices[index + 0] = (UINT16)(lat * (latCells + 1) + lon + 0);
-            pIndices[index + 2] = (UINT16)(lat * (latCells + 1) + lon + 1);
-            pIndices[index + 1] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon);
-            pIndices[index + 3] = (UINT16)(lat * (latCells + 1) + lon + 1);
-            pIndices[index + 5] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon + 1);
-            pIndices[index + 4] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon);
-        }
-    }
-}
-
-}
-
 void Renderer::Camera::GetDirections(Point3f& forward, Point3f& right)
 {
     Point3f dir = -Point3f{ cosf(theta) * cosf(phi), sinf(theta), cosf(theta) * sinf(phi) };
@@ -229,6 +184,11 @@ void Renderer::Term()
 {
     TermScene();
 
+    for (int i = 0; i < 2; i++)
+    {
+        SAFE_RELEASE(m_pCommandLists[i]);
+    }
+    SAFE_RELEASE(m_pDeferredContext);
     SAFE_RELEASE(m_pBackBufferRTV);
     SAFE_RELEASE(m_pSwapChain);
     SAFE_RELEASE(m_pDeviceContext);
@@ -286,11 +246,6 @@ bool Renderer::Update()
         geomBuffer.m = m;
 
         m_pDeviceContext->UpdateSubresource(m_pGeomBuffer, 0, nullptr, &geomBuffer, 0, 0);
-
-        // Model matrix for second cube
-        m = DirectX::XMMatrixTranslation(2.0f, 0.0f, 0.0f);
-        geomBuffer.m = m;
-        m_pDeviceContext->UpdateSubresource(m_pGeomBuffer2, 0, nullptr, &geomBuffer, 0, 0);
     }
 
     m_prevUSec = usec;
@@ -337,14 +292,38 @@ bool Renderer::Update()
 
 bool Renderer::Render()
 {
-    m_pDeviceContext->ClearState();
+    bool firstRectFarther = IsFirstRectFarther();
+    if (m_minimalOverhead && m_pCommandLists[firstRectFarther ? 0 : 1] == nullptr)
+    {
+        // Frame is rendered directly if command list can not be recorded
+        m_minimalOverhead = SUCCEEDED(RecordCommandList(firstRectFarther));
+    }
 
+    if (m_minimalOverhead)
+    {
+        // Update has already written dynamic constants, the rest of the frame only depends on order of rects
+        m_pDeviceContext->ExecuteCommandList(m_pCommandLists[firstRectFarther ? 0 : 1], FALSE);
+    }
+    else
+    {
+        m_pDeviceContext->ClearState();
+        RenderFrame(m_pDeviceContext, firstRectFarther);
+    }
+
+    HRESULT result = m_pSwapChain->Present(0, 0);
+    assert(SUCCEEDED(result));
+
+    return SUCCEEDED(result);
+}
+
+void Renderer::RenderFrame(ID3D11DeviceContext* pContext, bool firstRectFarther)
+{
     ID3D11RenderTargetView* views[] = { m_pBackBufferRTV };
-    m_pDeviceContext->OMSetRenderTargets(1, views, m_pDepthBufferDSV);
+    pContext->OMSetRenderTargets(1, views, m_pDepthBufferDSV);
 
     static const FLOAT BackColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
-    m_pDeviceContext->ClearRenderTargetView(m_pBackBufferRTV, BackColor);
-    m_pDeviceContext->ClearDepthStencilView(m_pDepthBufferDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
+    pContext->ClearRenderTargetView(m_pBackBufferRTV, BackColor);
+    pContext->ClearDepthStencilView(m_pDepthBufferDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
 
     D3D11_VIEWPORT viewport;
     viewport.TopLeftX = 0;
@@ -353,58 +332,75 @@ bool Renderer::Render()
     viewport.Height = (FLOAT)m_height;
     viewport.MinDepth = 0.0f;
     viewport.MaxDepth = 1.0f;
-    m_pDeviceContext->RSSetViewports(1, &viewport);
+    pContext->RSSetViewports(1, &viewport);
 
     D3D11_RECT rect;
     rect.left = 0;
     rect.top = 0;
     rect.right = m_width;
     rect.bottom = m_height;
-    m_pDeviceContext->RSSetScissorRects(1, &rect);
+    pContext->RSSetScissorRects(1, &rect);
 
-    m_pDeviceContext->OMSetDepthStencilState(m_pDepthState, 0);
+    pContext->OMSetDepthStencilState(m_pDepthState, 0);
 
-    m_pDeviceContext->RSSetState(m_pRasterizerState);
+    pContext->RSSetState(m_pRasterizerState);
 
-    m_pDeviceContext->OMSetBlendState(m_pOpaqueBlendState, nullptr, 0xFFFFFFFF);
+    pContext->OMSetBlendState(m_pOpaqueBlendState, nullptr, 0xFFFFFFFF);
 
     ID3D11SamplerState* samplers[] = {m_pSampler};
-    m_pDeviceContext->PSSetSamplers(0, 1, samplers);
+    pContext->PSSetSamplers(0, 1, samplers);
 
     ID3D11ShaderResourceView* resources[] = {m_pTextureView};
-    m_pDeviceContext->PSSetShaderResources(0, 1, resources);
+    pContext->PSSetShaderResources(0, 1, resources);
 
-    m_pDeviceContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
     ID3D11Buffer* vertexBuffers[] = {m_pVertexBuffer};
     UINT strides[] = {20};
     UINT offsets[] = {0};
     ID3D11Buffer* cbuffers[] = {m_pSceneBuffer, m_pGeomBuffer};
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pVertexShader, nullptr, 0);
-    m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetShader(m_pPixelShader, nullptr, 0);
-    m_pDeviceContext->DrawIndexed(36, 0, 0);
+    pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+    pContext->IASetInputLayout(m_pInputLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pContext->VSSetShader(m_pVertexShader, nullptr, 0);
+    pContext->VSSetConstantBuffers(0, 2, cbuffers);
+    pContext->PSSetShader(m_pPixelShader, nullptr, 0);
+    pContext->DrawIndexed(36, 0, 0);
 
     ID3D11Buffer* cbuffers2[] = { m_pGeomBuffer2 };
-    m_pDeviceContext->VSSetConstantBuffers(1, 1, cbuffers2);
-    m_pDeviceContext->DrawIndexed(36, 0, 0);
+    pContext->VSSetConstantBuffers(1, 1, cbuffers2);
+    pContext->DrawIndexed(36, 0, 0);
 
-    RenderSphere();
+    RenderSphere(pContext);
 
-    RenderRects();
+    RenderRects(pContext, firstRectFarther);
+}
 
-    HRESULT result = m_pSwapChain->Present(0, 0);
+HRESULT Renderer::RecordCommandList(bool firstRectFarther)
+{
+    HRESULT result = S_OK;
+    if (m_pDeferredContext == nullptr)
+    {
+        result = m_pDevice->CreateDeferredContext(0, &m_pDeferredContext);
+    }
+    if (SUCCEEDED(result))
+    {
+        RenderFrame(m_pDeferredContext, firstRectFarther);
+        result = m_pDeferredContext->FinishCommandList(FALSE, &m_pCommandLists[firstRectFarther ? 0 : 1]);
+    }
     assert(SUCCEEDED(result));
 
-    return SUCCEEDED(result);
+    return result;
 }
 
 bool Renderer::Resize(UINT width, UINT height)
 {
     if (width != m_width || height != m_height)
     {
+        // Recorded frame refers to old views and viewport size
+        for (int i = 0; i < 2; i++)
+        {
+            SAFE_RELEASE(m_pCommandLists[i]);
+        }
         SAFE_RELEASE(m_pBackBufferRTV);
         SAFE_RELEASE(m_pDepthBuffer);
         SAFE_RELEASE(m_pDepthBufferDSV);
@@ -720,6 +716,8 @@ HRESULT Renderer::InitScene()
         }
         if (SUCCEEDED(result))
         {
+            // Second cube does not move, its matrix is set once
+            geomBuffer.m = DirectX::XMMatrixTranslation(2.0f, 0.0f, 0.0f);
             result = m_pDevice->CreateBuffer(&desc, &data, &m_pGeomBuffer2);
             assert(SUCCEEDED(result));
             if (SUCCEEDED(result))
@@ -881,7 +879,7 @@ HRESULT Renderer::InitScene()
             result = SetResourceName(m_pTexture, WCSToMBS(TextureName));
         }
 
-        free(textureDesc.pData);
+        FreeDDS(textureDesc);
     }
     if (SUCCEEDED(result))
     {
@@ -1251,7 +1249,7 @@ HRESULT Renderer::InitCubemap()
         }
         for (int i = 0; i < 6; i++)
         {
-            free(texDescs[i].pData);
+            FreeDDS(texDescs[i]);
         }
     }
     if (SUCCEEDED(result))
@@ -1326,104 +1324,88 @@ void Renderer::TermScene()
     SAFE_RELEASE(m_pDepthBufferDSV);
 }
 
-void Renderer::RenderSphere()
+void Renderer::RenderSphere(ID3D11DeviceContext* pContext)
 {
     ID3D11SamplerState* samplers[] = { m_pSampler };
-    m_pDeviceContext->PSSetSamplers(0, 1, samplers);
+    pContext->PSSetSamplers(0, 1, samplers);
 
     ID3D11ShaderResourceView* resources[] = { m_pCubemapView };
-    m_pDeviceContext->PSSetShaderResources(0, 1, resources);
+    pContext->PSSetShaderResources(0, 1, resources);
 
-    m_pDeviceContext->IASetIndexBuffer(m_pSphereIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pContext->IASetIndexBuffer(m_pSphereIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
     ID3D11Buffer* vertexBuffers[] = { m_pSphereVertexBuffer };
     UINT strides[] = { 12 };
     UINT offsets[] = { 0 };
     ID3D11Buffer* cbuffers[] = { m_pSceneBuffer, m_pSphereGeomBuffer };
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pSphereInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pSphereVertexShader, nullptr, 0);
-    m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetShader(m_pSpherePixelShader, nullptr, 0);
-    m_pDeviceContext->DrawIndexed(m_sphereIndexCount, 0, 0);
+    pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+    pContext->IASetInputLayout(m_pSphereInputLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pContext->VSSetShader(m_pSphereVertexShader, nullptr, 0);
+    pContext->VSSetConstantBuffers(0, 2, cbuffers);
+    pContext->PSSetShader(m_pSpherePixelShader, nullptr, 0);
+    pContext->DrawIndexed(m_sphereIndexCount, 0, 0);
 }
 
-void Renderer::RenderRects()
+void Renderer::RenderRects(ID3D11DeviceContext* pContext, bool firstRectFarther)
 {
-    m_pDeviceContext->OMSetDepthStencilState(m_pTransDepthState, 0);
+    pContext->OMSetDepthStencilState(m_pTransDepthState, 0);
 
-    m_pDeviceContext->OMSetBlendState(m_pTransBlendState, nullptr, 0xFFFFFFFF);
+    pContext->OMSetBlendState(m_pTransBlendState, nullptr, 0xFFFFFFFF);
 
-    m_pDeviceContext->IASetIndexBuffer(m_pRectIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pContext->IASetIndexBuffer(m_pRectIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
     ID3D11Buffer* vertexBuffers[] = { m_pRectVertexBuffer };
     UINT strides[] = { 16 };
     UINT offsets[] = { 0 };
     ID3D11Buffer* cbuffers[] = { m_pSceneBuffer, nullptr };
-    m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    m_pDeviceContext->IASetInputLayout(m_pRectInputLayout);
-    m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_pDeviceContext->VSSetShader(m_pRectVertexShader, nullptr, 0);
-    m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-    m_pDeviceContext->PSSetShader(m_pRectPixelShader, nullptr, 0);
+    pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+    pContext->IASetInputLayout(m_pRectInputLayout);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pContext->VSSetShader(m_pRectVertexShader, nullptr, 0);
+    pContext->VSSetConstantBuffers(0, 2, cbuffers);
+    pContext->PSSetConstantBuffers(0, 2, cbuffers);
+    pContext->PSSetShader(m_pRectPixelShader, nullptr, 0);
 
-    float d0 = 0.0f, d1 = 0.0f;
-    Point3f cameraPos = m_camera.poi + Point3f{ cosf(m_camera.theta) * cosf(m_camera.phi), sinf(m_camera.theta), cosf(m_camera.theta) * sinf(m_camera.phi) } *m_camera.r;
-    for (int i = 0; i < 4; i++)
-    {
-        d0 = std::max(d0, (cameraPos - m_boundingRects[0].v[i]).lengthSqr());
-        d1 = std::max(d1, (cameraPos - m_boundingRects[1].v[i]).lengthSqr());
-    }
-
-    if (d0 > d1)
+    if (firstRectFarther)
     {
         cbuffers[1] = m_pRectGeomBuffer;
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(6, 0, 0);
+        pContext->VSSetConstantBuffers(0, 2, cbuffers);
+        pContext->PSSetConstantBuffers(0, 2, cbuffers);
+        pContext->DrawIndexed(6, 0, 0);
 
         cbuffers[1] = m_pRectGeomBuffer2;
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(6, 0, 0);
+        pContext->VSSetConstantBuffers(0, 2, cbuffers);
+        pContext->PSSetConstantBuffers(0, 2, cbuffers);
+        pContext->DrawIndexed(6, 0, 0);
     }
     else
     {
         cbuffers[1] = m_pRectGeomBuffer2;
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(6, 0, 0);
+        pContext->VSSetConstantBuffers(0, 2, cbuffers);
+        pContext->PSSetConstantBuffers(0, 2, cbuffers);
+        pContext->DrawIndexed(6, 0, 0);
 
         cbuffers[1] = m_pRectGeomBuffer;
-        m_pDeviceContext->VSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->PSSetConstantBuffers(0, 2, cbuffers);
-        m_pDeviceContext->DrawIndexed(6, 0, 0);
+        pContext->VSSetConstantBuffers(0, 2, cbuffers);
+        pContext->PSSetConstantBuffers(0, 2, cbuffers);
+        pContext->DrawIndexed(6, 0, 0);
     }
 }
 
-HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, ID3DBlob** ppCode)
+bool Renderer::IsFirstRectFarther() const
 {
-    // Try to load shader's source code first
-    FILE* pFile = nullptr;
-    _wfopen_s(&pFile, path.c_str(), L"rb");
-    assert(pFile != nullptr);
-    if (pFile == nullptr)
+    float d0 = 0.0f, d1 = 0.0f;
+    Point3f cameraPos = m_camera.poi + Point3f{ cosf(m_camera.theta) * cosf(m_camera.phi), sinf(m_camera.theta), cosf(m_camera.theta) * sinf(m_camera.phi) } *m_camera.r;
+    for (int i = 0; i < 4; i++)
     {
-        return E_FAIL;
+        d0 = std::max(d0, (cameraPos - m_boundingRects[0].v[i]).lengthSqr());
+        d1 = std::max(d1, (cameraPos - m_boundingRects[1].v[i]).lengthSqr());
     }
 
-    fseek(pFile, 0, SEEK_END);
-    long long size = _ftelli64(pFile);
-    fseek(pFile, 0, SEEK_SET);
-
-    std::vector<char> data;
-    data.resize(size + 1);
-
-    size_t rd = fread(data.data(), 1, size, pFile);
-    assert(rd == (size_t)size);
-
-    fclose(pFile);
+    return d0 > d1;
+}
 
+HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, ID3DBlob** ppCode)
+{
     // Determine shader's type
     std::wstring ext = Extension(path);
 
@@ -1447,16 +1429,10 @@ HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceC
     flags1 |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif // _DEBUG
 
-    // Try to compile
+    // Compiled only if source or any of included files changed since bytecode was cached
     ID3DBlob* pCode = nullptr;
-    ID3DBlob* pErrMsg = nullptr;
-    HRESULT result = D3DCompile(data.data(), data.size(), WCSToMBS(path).c_str(), nullptr, nullptr, entryPoint.c_str(), platform.c_str(), flags1, 0, &pCode, &pErrMsg);
-    if (!SUCCEEDED(result) && pErrMsg != nullptr)
-    {
-        OutputDebugStringA((const char*)pErrMsg->GetBufferPointer());
-    }
+    HRESULT result = m_shaderCache.GetBytecode(path, {}, entryPoint, platform, flags1, &pCode);
     assert(SUCCEEDED(result));
-    SAFE_RELEASE(pErrMsg);
 
     // Create shader itself if anything else is OK
     if (SUCCEEDED(result))
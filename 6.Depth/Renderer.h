@@ -3,6 +3,7 @@
 #include <dxgi.h>
 #include <d3d11.h>
 
+#include "../Core/ShaderCache.h"
 #include "../Math/Point.h"
 
 class Renderer
@@ -62,7 +63,14 @@ public:
         , m_pSampler(nullptr)
         , m_forwardDelta(0.0)
         , m_rightDelta(0.0)
-    {}
+        , m_pDeferredContext(nullptr)
+        , m_minimalOverhead(false)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            m_pCommandLists[i] = nullptr;
+        }
+    }
 
     bool Init(HWND hWnd);
     void Term();
@@ -71,6 +79,9 @@ public:
     bool Render();
     bool Resize(UINT width, UINT height);
 
+    /** Record frame into command list once and replay it, only dynamic constants are written per frame */
+    inline void SetMinimalOverhead(bool minimalOverhead) { m_minimalOverhead = minimalOverhead; }
+
     void MouseRBPressed(bool pressed, int x, int y);
     void MouseMoved(int x, int y);
     void MouseWheel(int delta);
@@ -101,8 +112,11 @@ private:
     HRESULT InitCubemap();
     void TermScene();
 
-    void RenderSphere();
-    void RenderRects();
+    void RenderFrame(ID3D11DeviceContext* pContext, bool firstRectFarther);
+    void RenderSphere(ID3D11DeviceContext* pContext);
+    void RenderRects(ID3D11DeviceContext* pContext, bool firstRectFarther);
+    bool IsFirstRectFarther() const;
+    HRESULT RecordCommandList(bool firstRectFarther);
 
     HRESULT CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, ID3DBlob** ppCode = nullptr);
 
@@ -113,6 +127,8 @@ private:
     IDXGISwapChain* m_pSwapChain;
     ID3D11RenderTargetView* m_pBackBufferRTV;
 
+    ShaderCache m_shaderCache;
+
     ID3D11Texture2D* m_pDepthBuffer;
     ID3D11DepthStencilView* m_pDepthBufferDSV;
 
@@ -175,4 +191,8 @@ private:
     double m_rightDelta;
 
     size_t m_prevUSec;
+
+    ID3D11DeviceContext* m_pDeferredContext;
+    ID3D11CommandList* m_pCommandLists[2]; // By order of transparent rects, farther of them is drawn first
+    bool m_minimalOverhead;
 };
@@ -1,7 +1,6 @@
 #include "framework.h"
 
 #include "Renderer.h"
-#include "DDS.h"
 
 #include <d3dcompiler.h>
 
@@ -10,6 +9,8 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include "../Core/DDS.h"
+#include "../Core/Shapes.h"
 #include "../Math/Matrix.h"
 
 #include "imgui.h"
@@ -54,52 +55,6 @@ static const float ModelRotationSpeed = (float)M_PI / 2.0f;
 
 static const float Eps = 0.00001f;
 
-namespace
-{
-
-void GetSphereDataSize(size_t latCells, size_t lonCells, size_t& indexCount, size_t& vertexCount)
-{
-    vertexCount = (latCells + 1) * (lonCells + 1);
-    indexCount = latCells * lonCells * 6;
-}
-
-void CreateSphere(size_t latCells, size_t lonCells, UINT16* pIndices, Point3f* pPos)
-{
-    for (size_t lat = 0; lat < latCells + 1; lat++)
-    {
-        for (size_t lon = 0; lon < lonCells + 1; lon++)
-        {
-            int index = (int)(lat * (lonCells + 1) + lon);
-            float lonAngle = 2.0f * (float)M_PI * lon / lonCells + (float)M_PI;
-            float latAngle = -(float)M_PI / 2 + (float)M_PI * lat / latCells;
-
-            Point3f r = Point3f{
-                sinf(lonAngle) * cosf(latAngle),
-                sinf(latAngle),
-                cosf(lonAngle) * cosf(latAngle)
-            };
-
-            pPos[index] = r * 0.5f;
-        }
-    }
-
-    for (size_t lat = 0; lat < latCells; lat++)
-    {
-        for (size_t lon = 0; lon < lonCells; lon++)
-        {
-            size_t index = lat * lonCells * 6 + lon * 6;
-            pIndices[index + 0] = (UINT16)(lat * (latCells + 1) + lon + 0);
-            pIndices[index + 2] = (UINT16)(lat * (latCells + 1) + lon + 1);
-            pIndices[index + 1] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon);
-            pIndices[index + 3] = (UINT16)(lat * (latCells + 1) + lon + 1);
-            pIndices[index + 5] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon + 1);
-            pIndices[index + 4] = (UINT16)(lat * (latCells + 1) + latCells + 1 + lon);
-        }
-    }
-}
-
-}
-
 void Renderer::Camera::GetDirections(Point3f& forward, Point3f& right)
 {
     Point3f dir = -Point3f{ cosf(theta) * cosf(phi), sinf(theta), cosf(theta) * sinf(phi) };
@@ -982,7 +937,7 @@ HRESULT Renderer::InitScene()
             result = SetResourceName(m_pTexture, WCSToMBS(TextureName));
         }
 
-        free(textureDesc.pData);
+        FreeDDS(textureDesc);
     }
     if (SUCCEEDED(result))
     {
@@ -1041,7 +996,7 @@ HRESULT Renderer::InitScene()
             result = SetResourceName(m_pTextureNM, WCSToMBS(TextureName));
         }
 
-        free(textureDesc.pData);
+        FreeDDS(textureDesc);
     }
     if (SUCCEEDED(result))
     {
@@ -1549,7 +1504,7 @@ HRESULT Renderer::InitCubemap()
         }
         for (int i = 0; i < 6; i++)
         {
-            free(texDescs[i].pData);
+            FreeDDS(texDescs[i]);
         }
     }
     if (SUCCEEDED(result))
@@ -1736,74 +1691,8 @@ void Renderer::RenderRects()
     }
 }
 
-class D3DInclude : public ID3DInclude
-{
-    STDMETHOD(Open)(THIS_ D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID* ppData, UINT* pBytes)
-    {
-        FILE* pFile = nullptr;
-        fopen_s(&pFile, pFileName, "rb");
-        assert(pFile != nullptr);
-        if (pFile == nullptr)
-        {
-            return E_FAIL;
-        }
-
-        fseek(pFile, 0, SEEK_END);
-        long long size = _ftelli64(pFile);
-        fseek(pFile, 0, SEEK_SET);
-
-        VOID* pData = malloc(size);
-        if (pData == nullptr)
-        {
-            fclose(pFile);
-            return E_FAIL;
-        }
-
-        size_t rd = fread(pData, 1, size, pFile);
-        assert(rd == (size_t)size);
-
-        if (rd != (size_t)size)
-        {
-            fclose(pFile);
-            free(pData);
-            return E_FAIL;
-        }
-
-        *ppData = pData;
-        *pBytes = (UINT)size;
-
-        return S_OK;
-    }
-    STDMETHOD(Close)(THIS_ LPCVOID pData)
-    {
-        free(const_cast<void*>(pData));
-        return S_OK;
-    }
-};
-
 HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::vector<std::string>& defines, ID3DBlob** ppCode)
 {
-    // Try to load shader's source code first
-    FILE* pFile = nullptr;
-    _wfopen_s(&pFile, path.c_str(), L"rb");
-    assert(pFile != nullptr);
-    if (pFile == nullptr)
-    {
-        return E_FAIL;
-    }
-
-    fseek(pFile, 0, SEEK_END);
-    long long size = _ftelli64(pFile);
-    fseek(pFile, 0, SEEK_SET);
-
-    std::vector<char> data;
-    data.resize(size + 1);
-
-    size_t rd = fread(data.data(), 1, size, pFile);
-    assert(rd == (size_t)size);
-
-    fclose(pFile);
-
     // Determine shader's type
     std::wstring ext = Extension(path);
 
@@ -1827,28 +1716,10 @@ HRESULT Renderer::CompileAndCreateShader(const std::wstring& path, ID3D11DeviceC
     flags1 |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif // _DEBUG
 
-    D3DInclude includeHandler;
-
-    std::vector<D3D_SHADER_MACRO> shaderDefines;
-    shaderDefines.resize(defines.size() + 1);
-    for (int i = 0; i < defines.size(); i++)
-    {
-        shaderDefines[i].Name = defines[i].c_str();
-        shaderDefines[i].Definition = "";
-    }
-    shaderDefines.back().Name = nullptr;
-    shaderDefines.back().Definition = nullptr;
-
-    // Try to compile
+    // Compiled only if source or any of included files changed since bytecode was cached
     ID3DBlob* pCode = nullptr;
-    ID3DBlob* pErrMsg = nullptr;
-    HRESULT result = D3DCompile(data.data(), data.size(), WCSToMBS(path).c_str(), shaderDefines.data(), &includeHandler, entryPoint.c_str(), platform.c_str(), flags1, 0, &pCode, &pErrMsg);
-    if (!SUCCEEDED(result) && pErrMsg != nullptr)
-    {
-        OutputDebugStringA((const char*)pErrMsg->GetBufferPointer());
-    }
+    HRESULT result = m_shaderCache.GetBytecode(path, defines, entryPoint, platform, flags1, &pCode);
     assert(SUCCEEDED(result));
-    SAFE_RELEASE(pErrMsg);
 
     // Create shader itself if anything else is OK
     if (SUCCEEDED(result))
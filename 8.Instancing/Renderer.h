@@ -3,6 +3,7 @@
 #include <dxgi.h>
 #include <d3d11.h>
 
+#include "../Core/ShaderCache.h"
 #include "../Math/Point.h"
 
 class Renderer
@@ -183,6 +184,8 @@ private:
     IDXGISwapChain* m_pSwapChain;
     ID3D11RenderTargetView* m_pBackBufferRTV;
 
+    ShaderCache m_shaderCache;
+
     ID3D11Texture2D* m_pDepthBuffer;
     ID3D11DepthStencilView* m_pDepthBufferDSV;
 
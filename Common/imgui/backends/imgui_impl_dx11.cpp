@@ -12,6 +12,8 @@
 
 // CHANGELOG
 // (minor and older changes stripped away, please see git history for details)
+//  2026-10-15: DirectX11: Added ImGui_ImplDX11_SetCacheFile() to keep compiled shaders and font atlas on disk across runs.
+//  2026-10-14: DirectX11: Vertex/index buffers grow geometrically and are used as NO_OVERWRITE rings shared by several frames. Added ImGui_ImplDX11_SetCacheDeviceObjects().
 //  2022-10-11: Using 'nullptr' instead of 'NULL' as per our switch to C++11.
 //  2021-06-29: Reorganized backend to pull data from a single structure to facilitate usage with multiple-contexts (all g_XXXX access changed to bd->XXXX).
 //  2021-05-19: DirectX11: Replaced direct access to ImDrawCmd::TextureId with a call to ImDrawCmd::GetTexID(). (will become a requirement)
@@ -31,6 +33,7 @@
 //  2016-05-07: DirectX11: Disabling depth-write.
 
 #include "imgui.h"
+#include "imgui_internal.h"     // ImFontAtlasBuildInit(), ImHashData(), ImFileXXX() for the cache file
 #include "imgui_impl_dx11.h"
 
 // DirectX
@@ -60,10 +63,28 @@ struct ImGui_ImplDX11_Data
     ID3D11DepthStencilState*    pDepthStencilState;
     int                         VertexBufferSize;
     int                         IndexBufferSize;
+    int                         VtxRingPos;         // Next free vertex, data before it may still be used by GPU
+    int                         IdxRingPos;
+    int                         VtxDrawOffset;      // Start of uploaded geometry
+    int                         IdxDrawOffset;
+    int                         UploadedFrame;      // ImGui frame whose geometry is in pVB/pIB, draw data is reused until next NewFrame
 
-    ImGui_ImplDX11_Data()       { memset((void*)this, 0, sizeof(*this)); VertexBufferSize = 5000; IndexBufferSize = 10000; }
+    ImGui_ImplDX11_Data()       { memset((void*)this, 0, sizeof(*this)); VertexBufferSize = 5000; IndexBufferSize = 10000; UploadedFrame = -1; }
 };
 
+// Ring buffers hold at least that many frames of geometry, so overwriting waits for GPU rarely
+static const int    ImGui_ImplDX11_RingFrames = 3;
+
+// Compiled shaders outlive backend data, so re-initialization on a new device skips D3DCompile()
+static bool         g_CacheDeviceObjects = false;
+static ID3DBlob*    g_VertexShaderBlob = nullptr;
+static ID3DBlob*    g_PixelShaderBlob = nullptr;
+
+// Shader blobs and built font atlas of a previous run, file is rewritten when fonts or versions change
+static const ImU32  ImGui_ImplDX11_CacheMagic = 0x43444749; // "IGDC"
+static const ImU32  ImGui_ImplDX11_CacheVersion = 1;        // Bump when shaders or file layout change
+static char         g_CacheFilePath[260] = "";
+
 struct VERTEX_CONSTANT_BUFFER_DX11
 {
     float   mvp[4][4];
@@ -125,10 +146,14 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
     ID3D11DeviceContext* ctx = bd->pd3dDeviceContext;
 
     // Create and grow vertex/index buffers if needed
+    // Growth is geometric and leaves room for several frames, so buffers are rarely recreated while overlay grows
     if (!bd->pVB || bd->VertexBufferSize < draw_data->TotalVtxCount)
     {
         if (bd->pVB) { bd->pVB->Release(); bd->pVB = nullptr; }
-        bd->VertexBufferSize = draw_data->TotalVtxCount + 5000;
+        bd->UploadedFrame = -1;
+        bd->VtxRingPos = 0;
+        while (bd->VertexBufferSize < draw_data->TotalVtxCount * ImGui_ImplDX11_RingFrames)
+            bd->VertexBufferSize *= 2;
         D3D11_BUFFER_DESC desc;
         memset(&desc, 0, sizeof(D3D11_BUFFER_DESC));
         desc.Usage = D3D11_USAGE_DYNAMIC;
@@ -142,7 +167,10 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
     if (!bd->pIB || bd->IndexBufferSize < draw_data->TotalIdxCount)
     {
         if (bd->pIB) { bd->pIB->Release(); bd->pIB = nullptr; }
-        bd->IndexBufferSize = draw_data->TotalIdxCount + 10000;
+        bd->UploadedFrame = -1;
+        bd->IdxRingPos = 0;
+        while (bd->IndexBufferSize < draw_data->TotalIdxCount * ImGui_ImplDX11_RingFrames)
+            bd->IndexBufferSize *= 2;
         D3D11_BUFFER_DESC desc;
         memset(&desc, 0, sizeof(D3D11_BUFFER_DESC));
         desc.Usage = D3D11_USAGE_DYNAMIC;
@@ -153,24 +181,50 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
             return;
     }
 
-    // Upload vertex/index data into a single contiguous GPU buffer
-    D3D11_MAPPED_SUBRESOURCE vtx_resource, idx_resource;
-    if (ctx->Map(bd->pVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &vtx_resource) != S_OK)
-        return;
-    if (ctx->Map(bd->pIB, 0, D3D11_MAP_WRITE_DISCARD, 0, &idx_resource) != S_OK)
-        return;
-    ImDrawVert* vtx_dst = (ImDrawVert*)vtx_resource.pData;
-    ImDrawIdx* idx_dst = (ImDrawIdx*)idx_resource.pData;
-    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    // Upload vertex/index data after data of previous frames, buffer is discarded only when ring starts over
+    // Skipped when the same draw data is rendered again without ImGui::NewFrame() in between
+    if (bd->UploadedFrame != ImGui::GetFrameCount())
     {
-        const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        memcpy(vtx_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-        memcpy(idx_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-        vtx_dst += cmd_list->VtxBuffer.Size;
-        idx_dst += cmd_list->IdxBuffer.Size;
+        D3D11_MAP vtx_map = D3D11_MAP_WRITE_NO_OVERWRITE;
+        if (bd->VtxRingPos == 0 || bd->VtxRingPos + draw_data->TotalVtxCount > bd->VertexBufferSize)
+        {
+            vtx_map = D3D11_MAP_WRITE_DISCARD;
+            bd->VtxRingPos = 0;
+        }
+        D3D11_MAP idx_map = D3D11_MAP_WRITE_NO_OVERWRITE;
+        if (bd->IdxRingPos == 0 || bd->IdxRingPos + draw_data->TotalIdxCount > bd->IndexBufferSize)
+        {
+            idx_map = D3D11_MAP_WRITE_DISCARD;
+            bd->IdxRingPos = 0;
+        }
+
+        D3D11_MAPPED_SUBRESOURCE vtx_resource, idx_resource;
+        if (ctx->Map(bd->pVB, 0, vtx_map, 0, &vtx_resource) != S_OK)
+            return;
+        if (ctx->Map(bd->pIB, 0, idx_map, 0, &idx_resource) != S_OK)
+        {
+            ctx->Unmap(bd->pVB, 0);
+            return;
+        }
+        ImDrawVert* vtx_dst = (ImDrawVert*)vtx_resource.pData + bd->VtxRingPos;
+        ImDrawIdx* idx_dst = (ImDrawIdx*)idx_resource.pData + bd->IdxRingPos;
+        for (int n = 0; n < draw_data->CmdListsCount; n++)
+        {
+            const ImDrawList* cmd_list = draw_data->CmdLists[n];
+            memcpy(vtx_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+            memcpy(idx_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+            vtx_dst += cmd_list->VtxBuffer.Size;
+            idx_dst += cmd_list->IdxBuffer.Size;
+        }
+        ctx->Unmap(bd->pVB, 0);
+        ctx->Unmap(bd->pIB, 0);
+
+        bd->VtxDrawOffset = bd->VtxRingPos;
+        bd->IdxDrawOffset = bd->IdxRingPos;
+        bd->VtxRingPos += draw_data->TotalVtxCount;
+        bd->IdxRingPos += draw_data->TotalIdxCount;
+        bd->UploadedFrame = ImGui::GetFrameCount();
     }
-    ctx->Unmap(bd->pVB, 0);
-    ctx->Unmap(bd->pIB, 0);
 
     // Setup orthographic projection matrix into our constant buffer
     // Our visible imgui space lies from draw_data->DisplayPos (top left) to draw_data->DisplayPos+data_data->DisplaySize (bottom right). DisplayPos is (0,0) for single viewport apps.
@@ -244,8 +298,8 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
 
     // Render command lists
     // (Because we merged all buffers into a single one, we maintain our own offset into them)
-    int global_idx_offset = 0;
-    int global_vtx_offset = 0;
+    int global_idx_offset = bd->IdxDrawOffset;
+    int global_vtx_offset = bd->VtxDrawOffset;
     ImVec2 clip_off = draw_data->DisplayPos;
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
@@ -314,6 +368,7 @@ static void ImGui_ImplDX11_CreateFontsTexture()
     io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
 
     // Upload texture to graphics system
+    if (!bd->pFontTextureView)
     {
         D3D11_TEXTURE2D_DESC desc;
         ZeroMemory(&desc, sizeof(desc));
@@ -351,6 +406,7 @@ static void ImGui_ImplDX11_CreateFontsTexture()
 
     // Create texture sampler
     // (Bilinear sampling is required by default. Set 'io.Fonts->Flags |= ImFontAtlasFlags_NoBakedLines' or 'style.AntiAliasedLinesUseTex = false' to allow point/nearest sampling)
+    if (!bd->pFontSampler)
     {
         D3D11_SAMPLER_DESC desc;
         ZeroMemory(&desc, sizeof(desc));
@@ -366,14 +422,255 @@ static void ImGui_ImplDX11_CreateFontsTexture()
     }
 }
 
+// Everything which goes into rasterization of the atlas, so any font change misses the cache
+static ImGuiID ImGui_ImplDX11_HashFontConfig(ImFontAtlas* atlas)
+{
+    const int atlas_ints[] = { atlas->Flags, atlas->TexDesiredWidth, atlas->TexGlyphPadding, (int)atlas->FontBuilderFlags };
+    ImGuiID hash = ImHashData(atlas_ints, sizeof(atlas_ints));
+    for (const ImFontConfig& cfg : atlas->ConfigData)
+    {
+        const int font_idx = (int)(atlas->Fonts.find(cfg.DstFont) - atlas->Fonts.Data);
+        const int ints[] = { cfg.FontDataSize, cfg.FontNo, cfg.OversampleH, cfg.OversampleV, cfg.PixelSnapH, cfg.MergeMode, (int)cfg.FontBuilderFlags, (int)cfg.EllipsisChar, font_idx };
+        const float floats[] = { cfg.SizePixels, cfg.GlyphExtraSpacing.x, cfg.GlyphExtraSpacing.y, cfg.GlyphOffset.x, cfg.GlyphOffset.y, cfg.GlyphMinAdvanceX, cfg.GlyphMaxAdvanceX, cfg.RasterizerMultiply };
+        const ImWchar* ranges = cfg.GlyphRanges ? cfg.GlyphRanges : atlas->GetGlyphRangesDefault();
+        size_t ranges_count = 0;
+        while (ranges[ranges_count] != 0)
+            ranges_count++;
+        hash = ImHashData(ints, sizeof(ints), hash);
+        hash = ImHashData(floats, sizeof(floats), hash);
+        hash = ImHashData(ranges, ranges_count * sizeof(ImWchar), hash);
+        hash = ImHashData(cfg.FontData, (size_t)cfg.FontDataSize, hash);
+    }
+    return hash;
+}
+
+static void ImGui_ImplDX11_GetCacheHeader(ImFontAtlas* atlas, ImU32 header[6])
+{
+    header[0] = ImGui_ImplDX11_CacheMagic;
+    header[1] = ImGui_ImplDX11_CacheVersion;
+    header[2] = IMGUI_VERSION_NUM;
+    header[3] = sizeof(ImFontGlyph);
+    header[4] = sizeof(ImWchar);
+    header[5] = ImGui_ImplDX11_HashFontConfig(atlas);
+}
+
+struct ImGui_ImplDX11_CacheReader
+{
+    const char* Data;
+    size_t      Size;
+    size_t      Pos;
+
+    const void* Get(size_t size)            { if (size > Size - Pos) return nullptr; const void* p = Data + Pos; Pos += size; return p; }
+    bool        Read(void* dst, size_t size){ const void* p = Get(size); if (p) memcpy(dst, p, size); return p != nullptr; }
+};
+
+struct ImGui_ImplDX11_CachedFont
+{
+    int         ConfigIdx;
+    int         ConfigCount;
+    float       FontSize;
+    float       Ascent, Descent;
+    int         MetricsTotalSurface;
+    int         GlyphCount;
+};
+
+static ID3DBlob* ImGui_ImplDX11_ReadCacheBlob(ImGui_ImplDX11_CacheReader& reader)
+{
+    ImU32 size = 0;
+    const void* data = reader.Read(&size, sizeof(size)) ? reader.Get(size) : nullptr;
+    ID3DBlob* blob = nullptr;
+    if (data && size > 0 && SUCCEEDED(D3DCreateBlob(size, &blob)))
+        memcpy(blob->GetBufferPointer(), data, size);
+    return blob;
+}
+
+// Whole file is validated before atlas is touched, atlas is left for Build() on any mismatch
+static bool ImGui_ImplDX11_ReadCache(ImGui_ImplDX11_CacheReader& reader, ImFontAtlas* atlas, ID3DBlob** out_vs, ID3DBlob** out_ps)
+{
+    ImU32 header[6], expected[6];
+    ImGui_ImplDX11_GetCacheHeader(atlas, expected);
+    if (!reader.Read(header, sizeof(header)) || memcmp(header, expected, sizeof(header)) != 0)
+        return false;
+
+    *out_vs = ImGui_ImplDX11_ReadCacheBlob(reader);
+    *out_ps = ImGui_ImplDX11_ReadCacheBlob(reader);
+    if (!*out_vs || !*out_ps)
+        return false;
+
+    int tex_size[2];
+    ImVec2 tex_uvs[2];
+    ImVec4 tex_uv_lines[IM_DRAWLIST_TEX_LINES_WIDTH_MAX + 1];
+    int rect_count = 0;
+    if (!reader.Read(tex_size, sizeof(tex_size)) || !reader.Read(tex_uvs, sizeof(tex_uvs)) || !reader.Read(tex_uv_lines, sizeof(tex_uv_lines)) || !reader.Read(&rect_count, sizeof(rect_count)))
+        return false;
+    const unsigned short* rect_positions = (const unsigned short*)reader.Get((size_t)rect_count * 2 * sizeof(unsigned short));
+    int font_count = 0;
+    if (!rect_positions || !reader.Read(&font_count, sizeof(font_count)) || font_count != atlas->Fonts.Size)
+        return false;
+    ImVector<ImGui_ImplDX11_CachedFont> fonts;
+    ImVector<const ImFontGlyph*> glyphs;
+    fonts.resize(font_count);
+    glyphs.resize(font_count);
+    for (int i = 0; i < font_count; i++)
+    {
+        ImGui_ImplDX11_CachedFont& font = fonts[i];
+        if (!reader.Read(&font, sizeof(font)) || font.ConfigIdx < 0 || font.ConfigIdx >= atlas->ConfigData.Size)
+            return false;
+        glyphs[i] = (const ImFontGlyph*)reader.Get((size_t)font.GlyphCount * sizeof(ImFontGlyph));
+        if (!glyphs[i])
+            return false;
+    }
+    const void* pixels = reader.Get((size_t)tex_size[0] * tex_size[1] * 4);
+    if (!pixels || reader.Pos != reader.Size)
+        return false;
+
+    // Same custom rects as Build() registers, at their packed positions
+    ImFontAtlasBuildInit(atlas);
+    if (atlas->CustomRects.Size != rect_count)
+        return false;
+    for (int i = 0; i < rect_count; i++)
+    {
+        atlas->CustomRects[i].X = rect_positions[i * 2];
+        atlas->CustomRects[i].Y = rect_positions[i * 2 + 1];
+    }
+
+    atlas->TexWidth = tex_size[0];
+    atlas->TexHeight = tex_size[1];
+    atlas->TexUvScale = tex_uvs[0];
+    atlas->TexUvWhitePixel = tex_uvs[1];
+    memcpy(atlas->TexUvLines, tex_uv_lines, sizeof(tex_uv_lines));
+    atlas->TexPixelsRGBA32 = (unsigned int*)IM_ALLOC((size_t)tex_size[0] * tex_size[1] * 4);
+    memcpy(atlas->TexPixelsRGBA32, pixels, (size_t)tex_size[0] * tex_size[1] * 4);
+    for (int i = 0; i < font_count; i++)
+    {
+        ImFont* font = atlas->Fonts[i];
+        font->ClearOutputData();
+        font->FontSize = fonts[i].FontSize;
+        font->ConfigData = &atlas->ConfigData[fonts[i].ConfigIdx];
+        font->ConfigDataCount = (short)fonts[i].ConfigCount;
+        font->ContainerAtlas = atlas;
+        font->Ascent = fonts[i].Ascent;
+        font->Descent = fonts[i].Descent;
+        font->MetricsTotalSurface = fonts[i].MetricsTotalSurface;
+        font->Glyphs.resize(fonts[i].GlyphCount);
+        memcpy(font->Glyphs.Data, glyphs[i], (size_t)fonts[i].GlyphCount * sizeof(ImFontGlyph));
+        font->BuildLookupTable();
+    }
+    atlas->TexReady = true;
+
+    return true;
+}
+
+static bool ImGui_ImplDX11_LoadCache(ImFontAtlas* atlas)
+{
+    size_t size = 0;
+    void* data = ImFileLoadToMemory(g_CacheFilePath, "rb", &size);
+    if (!data)
+        return false;
+
+    ImGui_ImplDX11_CacheReader reader = { (const char*)data, size, 0 };
+    ID3DBlob* vertexShaderBlob = nullptr;
+    ID3DBlob* pixelShaderBlob = nullptr;
+    bool loaded = ImGui_ImplDX11_ReadCache(reader, atlas, &vertexShaderBlob, &pixelShaderBlob);
+    IM_FREE(data);
+
+    if (loaded && !g_VertexShaderBlob && !g_PixelShaderBlob)
+    {
+        g_VertexShaderBlob = vertexShaderBlob;
+        g_PixelShaderBlob = pixelShaderBlob;
+    }
+    else
+    {
+        if (vertexShaderBlob) vertexShaderBlob->Release();
+        if (pixelShaderBlob) pixelShaderBlob->Release();
+    }
+    return loaded;
+}
+
+static void ImGui_ImplDX11_AppendCache(ImVector<char>& out, const void* data, size_t size)
+{
+    const int pos = out.Size;
+    out.resize(pos + (int)size);
+    memcpy(out.Data + pos, data, size);
+}
+
+static void ImGui_ImplDX11_SaveCache(ImFontAtlas* atlas)
+{
+    // Custom glyphs point to fonts and fonts without glyphs are never set up, both are left to Build(). RGBA pixels are there once the texture is created
+    if (!g_VertexShaderBlob || !g_PixelShaderBlob || !atlas->TexPixelsRGBA32)
+        return;
+    for (const ImFontAtlasCustomRect& rect : atlas->CustomRects)
+        if (rect.Font != nullptr)
+            return;
+    for (const ImFont* font : atlas->Fonts)
+        if (font->ConfigData == nullptr)
+            return;
+
+    ImVector<char> out;
+    ImU32 header[6];
+    ImGui_ImplDX11_GetCacheHeader(atlas, header);
+    ImGui_ImplDX11_AppendCache(out, header, sizeof(header));
+    ID3DBlob* blobs[2] = { g_VertexShaderBlob, g_PixelShaderBlob };
+    for (ID3DBlob* blob : blobs)
+    {
+        const ImU32 size = (ImU32)blob->GetBufferSize();
+        ImGui_ImplDX11_AppendCache(out, &size, sizeof(size));
+        ImGui_ImplDX11_AppendCache(out, blob->GetBufferPointer(), size);
+    }
+
+    const int tex_size[2] = { atlas->TexWidth, atlas->TexHeight };
+    const ImVec2 tex_uvs[2] = { atlas->TexUvScale, atlas->TexUvWhitePixel };
+    ImGui_ImplDX11_AppendCache(out, tex_size, sizeof(tex_size));
+    ImGui_ImplDX11_AppendCache(out, tex_uvs, sizeof(tex_uvs));
+    ImGui_ImplDX11_AppendCache(out, atlas->TexUvLines, sizeof(atlas->TexUvLines));
+    ImGui_ImplDX11_AppendCache(out, &atlas->CustomRects.Size, sizeof(int));
+    for (const ImFontAtlasCustomRect& rect : atlas->CustomRects)
+    {
+        const unsigned short position[2] = { rect.X, rect.Y };
+        ImGui_ImplDX11_AppendCache(out, position, sizeof(position));
+    }
+    ImGui_ImplDX11_AppendCache(out, &atlas->Fonts.Size, sizeof(int));
+    for (const ImFont* font : atlas->Fonts)
+    {
+        ImGui_ImplDX11_CachedFont cached;
+        cached.ConfigIdx = atlas->ConfigData.index_from_ptr(font->ConfigData);
+        cached.ConfigCount = font->ConfigDataCount;
+        cached.FontSize = font->FontSize;
+        cached.Ascent = font->Ascent;
+        cached.Descent = font->Descent;
+        cached.MetricsTotalSurface = font->MetricsTotalSurface;
+        cached.GlyphCount = font->Glyphs.Size;
+        ImGui_ImplDX11_AppendCache(out, &cached, sizeof(cached));
+        ImGui_ImplDX11_AppendCache(out, font->Glyphs.Data, (size_t)font->Glyphs.Size * sizeof(ImFontGlyph));
+    }
+    ImGui_ImplDX11_AppendCache(out, atlas->TexPixelsRGBA32, (size_t)atlas->TexWidth * atlas->TexHeight * 4);
+
+    ImFileHandle f = ImFileOpen(g_CacheFilePath, "wb");
+    if (!f)
+        return;
+    ImFileWrite(out.Data, 1, (ImU64)out.Size, f);
+    ImFileClose(f);
+}
+
 bool    ImGui_ImplDX11_CreateDeviceObjects()
 {
     ImGui_ImplDX11_Data* bd = ImGui_ImplDX11_GetBackendData();
     if (!bd->pd3dDevice)
         return false;
-    if (bd->pFontSampler)
+    if (bd->pFontSampler && !g_CacheDeviceObjects)
         ImGui_ImplDX11_InvalidateDeviceObjects();
 
+    // Atlas built by a previous run replaces font rasterization, its shaders replace D3DCompile() below.
+    // Default font is added here as Build() would, since fonts are part of the cache key.
+    ImFontAtlas* atlas = ImGui::GetIO().Fonts;
+    bool write_cache = false;
+    if (g_CacheFilePath[0] != 0 && !atlas->IsBuilt())
+    {
+        if (atlas->ConfigData.Size == 0)
+            atlas->AddFontDefault();
+        write_cache = !ImGui_ImplDX11_LoadCache(atlas);
+    }
+
     // By using D3DCompile() from <d3dcompiler.h> / d3dcompiler.lib, we introduce a dependency to a given version of d3dcompiler_XX.dll (see D3DCOMPILER_DLL_A)
     // If you would like to use this DX11 sample code but remove this dependency you can:
     //  1) compile once, save the compiled shader blobs into a file or source code and pass them to CreateVertexShader()/CreatePixelShader() [preferred solution]
@@ -381,6 +678,7 @@ bool    ImGui_ImplDX11_CreateDeviceObjects()
     // See https://github.com/ocornut/imgui/pull/638 for sources and details.
 
     // Create the vertex shader
+    if (!bd->pVertexShader)
     {
         static const char* vertexShader =
             "cbuffer vertexBuffer : register(b0) \
@@ -410,9 +708,16 @@ bool    ImGui_ImplDX11_CreateDeviceObjects()
               return output;\
             }";
 
-        ID3DBlob* vertexShaderBlob;
-        if (FAILED(D3DCompile(vertexShader, strlen(vertexShader), nullptr, nullptr, nullptr, "main", "vs_4_0", 0, 0, &vertexShaderBlob, nullptr)))
+        ID3DBlob* vertexShaderBlob = g_VertexShaderBlob;
+        if (vertexShaderBlob)
+            vertexShaderBlob->AddRef();
+        else if (FAILED(D3DCompile(vertexShader, strlen(vertexShader), nullptr, nullptr, nullptr, "main", "vs_4_0", 0, 0, &vertexShaderBlob, nullptr)))
             return false; // NB: Pass ID3DBlob* pErrorBlob to D3DCompile() to get error showing in (const char*)pErrorBlob->GetBufferPointer(). Make sure to Release() the blob!
+        if ((g_CacheDeviceObjects || write_cache) && !g_VertexShaderBlob)
+        {
+            g_VertexShaderBlob = vertexShaderBlob;
+            g_VertexShaderBlob->AddRef();
+        }
         if (bd->pd3dDevice->CreateVertexShader(vertexShaderBlob->GetBufferPointer(), vertexShaderBlob->GetBufferSize(), nullptr, &bd->pVertexShader) != S_OK)
         {
             vertexShaderBlob->Release();
@@ -446,6 +751,7 @@ bool    ImGui_ImplDX11_CreateDeviceObjects()
     }
 
     // Create the pixel shader
+    if (!bd->pPixelShader)
     {
         static const char* pixelShader =
             "struct PS_INPUT\
@@ -463,9 +769,16 @@ bool    ImGui_ImplDX11_CreateDeviceObjects()
             return out_col; \
             }";
 
-        ID3DBlob* pixelShaderBlob;
-        if (FAILED(D3DCompile(pixelShader, strlen(pixelShader), nullptr, nullptr, nullptr, "main", "ps_4_0", 0, 0, &pixelShaderBlob, nullptr)))
+        ID3DBlob* pixelShaderBlob = g_PixelShaderBlob;
+        if (pixelShaderBlob)
+            pixelShaderBlob->AddRef();
+        else if (FAILED(D3DCompile(pixelShader, strlen(pixelShader), nullptr, nullptr, nullptr, "main", "ps_4_0", 0, 0, &pixelShaderBlob, nullptr)))
             return false; // NB: Pass ID3DBlob* pErrorBlob to D3DCompile() to get error showing in (const char*)pErrorBlob->GetBufferPointer(). Make sure to Release() the blob!
+        if ((g_CacheDeviceObjects || write_cache) && !g_PixelShaderBlob)
+        {
+            g_PixelShaderBlob = pixelShaderBlob;
+            g_PixelShaderBlob->AddRef();
+        }
         if (bd->pd3dDevice->CreatePixelShader(pixelShaderBlob->GetBufferPointer(), pixelShaderBlob->GetBufferSize(), nullptr, &bd->pPixelShader) != S_OK)
         {
             pixelShaderBlob->Release();
@@ -475,6 +788,7 @@ bool    ImGui_ImplDX11_CreateDeviceObjects()
     }
 
     // Create the blending setup
+    if (!bd->pBlendState)
     {
         D3D11_BLEND_DESC desc;
         ZeroMemory(&desc, sizeof(desc));
@@ -491,6 +805,7 @@ bool    ImGui_ImplDX11_CreateDeviceObjects()
     }
 
     // Create the rasterizer state
+    if (!bd->pRasterizerState)
     {
         D3D11_RASTERIZER_DESC desc;
         ZeroMemory(&desc, sizeof(desc));
@@ -502,6 +817,7 @@ bool    ImGui_ImplDX11_CreateDeviceObjects()
     }
 
     // Create depth-stencil State
+    if (!bd->pDepthStencilState)
     {
         D3D11_DEPTH_STENCIL_DESC desc;
         ZeroMemory(&desc, sizeof(desc));
@@ -517,19 +833,33 @@ bool    ImGui_ImplDX11_CreateDeviceObjects()
 
     ImGui_ImplDX11_CreateFontsTexture();
 
+    if (write_cache)
+        ImGui_ImplDX11_SaveCache(atlas);
+    // Blobs of the cache file are only kept when device objects are
+    if (!g_CacheDeviceObjects)
+    {
+        if (g_VertexShaderBlob)     { g_VertexShaderBlob->Release(); g_VertexShaderBlob = nullptr; }
+        if (g_PixelShaderBlob)      { g_PixelShaderBlob->Release(); g_PixelShaderBlob = nullptr; }
+    }
+
     return true;
 }
 
-void    ImGui_ImplDX11_InvalidateDeviceObjects()
+static void ImGui_ImplDX11_ReleaseDeviceObjects(bool keep_cached)
 {
     ImGui_ImplDX11_Data* bd = ImGui_ImplDX11_GetBackendData();
     if (!bd->pd3dDevice)
         return;
 
-    if (bd->pFontSampler)           { bd->pFontSampler->Release(); bd->pFontSampler = nullptr; }
-    if (bd->pFontTextureView)       { bd->pFontTextureView->Release(); bd->pFontTextureView = nullptr; ImGui::GetIO().Fonts->SetTexID(0); } // We copied data->pFontTextureView to io.Fonts->TexID so let's clear that as well.
+    // Geometry is recreated at the same size on next render
     if (bd->pIB)                    { bd->pIB->Release(); bd->pIB = nullptr; }
     if (bd->pVB)                    { bd->pVB->Release(); bd->pVB = nullptr; }
+    bd->UploadedFrame = -1;
+    if (keep_cached)
+        return;
+
+    if (bd->pFontSampler)           { bd->pFontSampler->Release(); bd->pFontSampler = nullptr; }
+    if (bd->pFontTextureView)       { bd->pFontTextureView->Release(); bd->pFontTextureView = nullptr; ImGui::GetIO().Fonts->SetTexID(0); } // We copied data->pFontTextureView to io.Fonts->TexID so let's clear that as well.
     if (bd->pBlendState)            { bd->pBlendState->Release(); bd->pBlendState = nullptr; }
     if (bd->pDepthStencilState)     { bd->pDepthStencilState->Release(); bd->pDepthStencilState = nullptr; }
     if (bd->pRasterizerState)       { bd->pRasterizerState->Release(); bd->pRasterizerState = nullptr; }
@@ -539,6 +869,26 @@ void    ImGui_ImplDX11_InvalidateDeviceObjects()
     if (bd->pVertexShader)          { bd->pVertexShader->Release(); bd->pVertexShader = nullptr; }
 }
 
+void    ImGui_ImplDX11_InvalidateDeviceObjects()
+{
+    ImGui_ImplDX11_ReleaseDeviceObjects(g_CacheDeviceObjects);
+}
+
+void    ImGui_ImplDX11_SetCacheDeviceObjects(bool cache)
+{
+    g_CacheDeviceObjects = cache;
+    if (!cache)
+    {
+        if (g_VertexShaderBlob)     { g_VertexShaderBlob->Release(); g_VertexShaderBlob = nullptr; }
+        if (g_PixelShaderBlob)      { g_PixelShaderBlob->Release(); g_PixelShaderBlob = nullptr; }
+    }
+}
+
+void    ImGui_ImplDX11_SetCacheFile(const char* path)
+{
+    ImStrncpy(g_CacheFilePath, path ? path : "", IM_ARRAYSIZE(g_CacheFilePath));
+}
+
 bool    ImGui_ImplDX11_Init(ID3D11Device* device, ID3D11DeviceContext* device_context)
 {
     ImGuiIO& io = ImGui::GetIO();
@@ -577,7 +927,7 @@ void ImGui_ImplDX11_Shutdown()
     IM_ASSERT(bd != nullptr && "No renderer backend to shutdown, or already shutdown?");
     ImGuiIO& io = ImGui::GetIO();
 
-    ImGui_ImplDX11_InvalidateDeviceObjects();
+    ImGui_ImplDX11_ReleaseDeviceObjects(false);
     if (bd->pFactory)             { bd->pFactory->Release(); }
     if (bd->pd3dDevice)           { bd->pd3dDevice->Release(); }
     if (bd->pd3dDeviceContext)    { bd->pd3dDeviceContext->Release(); }
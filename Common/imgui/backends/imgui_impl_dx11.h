@@ -24,3 +24,11 @@ IMGUI_IMPL_API void     ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data);
 // Use if you want to reset your rendering device without losing Dear ImGui state.
 IMGUI_IMPL_API void     ImGui_ImplDX11_InvalidateDeviceObjects();
 IMGUI_IMPL_API bool     ImGui_ImplDX11_CreateDeviceObjects();
+
+// Keep shaders, font texture and state objects when device objects are invalidated, only geometry buffers are released then.
+// Compiled shaders are also kept across Shutdown()/Init(), so backend re-creation on a new device skips shader compilation.
+IMGUI_IMPL_API void     ImGui_ImplDX11_SetCacheDeviceObjects(bool cache);
+
+// Keep compiled shaders and built font atlas in a file, so the next run creates device objects without D3DCompile() and font rasterization.
+// File is keyed by fonts of io.Fonts and backend version, and rewritten on mismatch. Call before the first NewFrame(), nullptr disables it.
+IMGUI_IMPL_API void     ImGui_ImplDX11_SetCacheFile(const char* path);
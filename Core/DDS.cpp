@@ -2,6 +2,8 @@
 
 #include "DDS.h"
 
+#include <io.h>
+
 namespace
 {
 
@@ -60,6 +62,12 @@ const UINT32 DDSD_MIPMAPCOUNT = 0x20000;
 const UINT32 DDSD_LINEARSIZE = 0x80000;
 const UINT32 DDSD_DEPTH = 0x800000;
 
+const UINT32 DDSCAPS2_CUBEMAP = 0x200;
+const UINT32 DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00;
+
+const UINT32 DDS_DIMENSION_TEXTURE2D = 3;
+const UINT32 DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
 bool HaveDXT10Header(const DDSHeader& header)
 {
     if ((header.pixelFormat.flags & DDPF_FOURCC) != 0)
@@ -81,8 +89,21 @@ bool ValidateFlags(const DDSHeader& header)
         && (header.flags & DDSD_PIXELFORMAT) != 0;
 }
 
-DXGI_FORMAT GetTextureFormat(const DDSHeader& header)
+bool IsBlockCompressed(DXGI_FORMAT fmt)
 {
+    return (fmt >= DXGI_FORMAT_BC1_TYPELESS && fmt <= DXGI_FORMAT_BC5_SNORM)
+        || (fmt >= DXGI_FORMAT_BC6H_TYPELESS && fmt <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+DXGI_FORMAT GetTextureFormat(const DDSHeader& header, const DDS10Header& header10)
+{
+    if (HaveDXT10Header(header))
+    {
+        // Only block compressed formats are supported
+        DXGI_FORMAT fmt = (DXGI_FORMAT)header10.dxgiFormat;
+        return IsBlockCompressed(fmt) ? fmt : DXGI_FORMAT_UNKNOWN;
+    }
+
     char fourCC[5] = { 0 };
     memcpy(fourCC, &header.pixelFormat.fourCC, 4);
 
@@ -102,12 +123,53 @@ DXGI_FORMAT GetTextureFormat(const DDSHeader& header)
     {
         return DXGI_FORMAT_BC3_UNORM;
     }
+    if (strcmp(fourCC, "ATI1") == 0 || strcmp(fourCC, "BC4U") == 0)
+    {
+        return DXGI_FORMAT_BC4_UNORM;
+    }
+    if (strcmp(fourCC, "BC4S") == 0)
+    {
+        return DXGI_FORMAT_BC4_SNORM;
+    }
+    if (strcmp(fourCC, "ATI2") == 0 || strcmp(fourCC, "BC5U") == 0)
+    {
+        return DXGI_FORMAT_BC5_UNORM;
+    }
+    if (strcmp(fourCC, "BC5S") == 0)
+    {
+        return DXGI_FORMAT_BC5_SNORM;
+    }
     return DXGI_FORMAT_UNKNOWN;
 }
 
 }
 
-bool LoadDDS(const std::wstring& filepath, TextureDesc& desc, bool singleMip)
+UINT32 GetMipSize(DXGI_FORMAT fmt, UINT32 width, UINT32 height, UINT32 mip, UINT32* pPitch, UINT32* pRows)
+{
+    UINT32 pitch = DivUp(std::max(1u, width >> mip), 4u) * GetBytesPerBlock(fmt);
+    UINT32 rows = DivUp(std::max(1u, height >> mip), 4u);
+    if (pPitch != nullptr)
+    {
+        *pPitch = pitch;
+    }
+    if (pRows != nullptr)
+    {
+        *pRows = rows;
+    }
+    return pitch * rows;
+}
+
+UINT32 GetMipChainSize(DXGI_FORMAT fmt, UINT32 width, UINT32 height, UINT32 mipCount)
+{
+    UINT32 size = 0;
+    for (UINT32 i = 0; i < mipCount; i++)
+    {
+        size += GetMipSize(fmt, width, height, i);
+    }
+    return size;
+}
+
+bool LoadDDS(const std::wstring& filepath, TextureDesc& desc, bool singleMip, bool mapFile)
 {
     FILE* pFile = nullptr;
     _wfopen_s(&pFile, filepath.c_str(), L"rb");
@@ -159,15 +221,38 @@ bool LoadDDS(const std::wstring& filepath, TextureDesc& desc, bool singleMip)
     desc.pitch = (header.flags & DDSD_PITCH) != 0 ? (UINT32)header.pitchOrLinearSize : 0;
 
     // Read mipmap count
-    desc.mipmapsCount = (header.flags & DDSD_MIPMAPCOUNT) != 0 ? (UINT32)header.mipMapCount : 1;
+    desc.mipmapsCount = (header.flags & DDSD_MIPMAPCOUNT) != 0 ? std::max(1u, (UINT32)header.mipMapCount) : 1;
+    UINT32 fileMipCount = desc.mipmapsCount;
 
     if (singleMip)
     {
         desc.mipmapsCount = 1;
     }
 
+    // Read array layout, only 2D textures are supported
+    if (HaveDXT10Header(header))
+    {
+        if (header10.resourceDimension != DDS_DIMENSION_TEXTURE2D || header10.arraySize == 0)
+        {
+            fclose(pFile);
+            return false;
+        }
+        desc.cube = (header10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+        desc.arraySize = header10.arraySize * (desc.cube ? 6 : 1);
+    }
+    else if ((header.caps2 & DDSCAPS2_CUBEMAP) != 0)
+    {
+        if ((header.caps2 & DDSCAPS2_CUBEMAP_ALLFACES) != DDSCAPS2_CUBEMAP_ALLFACES)
+        {
+            fclose(pFile);
+            return false;
+        }
+        desc.cube = true;
+        desc.arraySize = 6;
+    }
+
     // Read texture format
-    desc.fmt = GetTextureFormat(header);
+    desc.fmt = GetTextureFormat(header, header10);
     if (desc.fmt == DXGI_FORMAT_UNKNOWN)
     {
         fclose(pFile);
@@ -178,24 +263,40 @@ bool LoadDDS(const std::wstring& filepath, TextureDesc& desc, bool singleMip)
     desc.width = header.width;
     desc.height = header.height;
 
-    // Get data size
-    UINT32 dataSize = (header.flags & DDSD_LINEARSIZE) != 0 ? (UINT32)header.pitchOrLinearSize : 0;
-    if (dataSize == 0)
+    // Slices are stored with all mips present in file
+    desc.sliceSize = GetMipChainSize(desc.fmt, desc.width, desc.height, fileMipCount);
+
+    // Get data size, only mips actually used are read from the last slice
+    UINT32 dataSize = desc.sliceSize * (desc.arraySize - 1) + GetMipChainSize(desc.fmt, desc.width, desc.height, desc.mipmapsCount);
+
+    if (mapFile)
     {
-        long long curPos = _ftelli64(pFile);
+        long long dataPos = _ftelli64(pFile);
         fseek(pFile, 0, SEEK_END);
-        dataSize = (UINT32)(_ftelli64(pFile) - curPos);
-        fseek(pFile, (int)curPos, SEEK_SET);
-    }
-    else
-    {
-        UINT32 levelSize = dataSize / 4;
-        // We have top level size - let's calculate the whole size
-        for (UINT32 i = 1; i < desc.mipmapsCount; i++)
+        long long fileSize = _ftelli64(pFile);
+        if (dataPos + dataSize > fileSize)
+        {
+            fclose(pFile);
+            return false;
+        }
+
+        // View keeps both mapping and file alive, so handles are closed right away
+        HANDLE hFile = (HANDLE)_get_osfhandle(_fileno(pFile));
+        HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (hMapping != nullptr)
         {
-            dataSize += levelSize;
-            levelSize = std::max(16u, levelSize / 4);
+            desc.pMappedView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(hMapping);
         }
+        fclose(pFile);
+
+        if (desc.pMappedView == nullptr)
+        {
+            return false;
+        }
+        desc.pData = reinterpret_cast<char*>(desc.pMappedView) + dataPos;
+
+        return true;
     }
 
     desc.pData = malloc(dataSize);
@@ -212,3 +313,17 @@ bool LoadDDS(const std::wstring& filepath, TextureDesc& desc, bool singleMip)
 
     return true;
 }
+
+void FreeDDS(TextureDesc& desc)
+{
+    if (desc.pMappedView != nullptr)
+    {
+        UnmapViewOfFile(desc.pMappedView);
+    }
+    else
+    {
+        free(desc.pData);
+    }
+    desc.pData = nullptr;
+    desc.pMappedView = nullptr;
+}
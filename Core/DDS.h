@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+struct TextureDesc
+{
+    UINT32 pitch = 0;
+    UINT32 mipmapsCount = 0;
+
+    DXGI_FORMAT fmt = DXGI_FORMAT_UNKNOWN;
+
+    UINT32 width = 0;
+    UINT32 height = 0;
+    UINT32 arraySize = 1;   // Array slices, 6 per cube
+    UINT32 sliceSize = 0;   // Bytes between slices in pData, covers full mip chain of the file
+    bool cube = false;
+
+    void* pData = nullptr;
+    void* pMappedView = nullptr; // File view if pData points into memory mapped file
+};
+
+/** Size of mip level of block compressed texture, optionally its row pitch and count of block rows */
+UINT32 GetMipSize(DXGI_FORMAT fmt, UINT32 width, UINT32 height, UINT32 mip, UINT32* pPitch = nullptr, UINT32* pRows = nullptr);
+/** Size of mipCount most detailed levels, which is also offset of level mipCount inside a slice */
+UINT32 GetMipChainSize(DXGI_FORMAT fmt, UINT32 width, UINT32 height, UINT32 mipCount);
+
+/** Load DDS file, slices are stored one after another with full mip chain each. With mapFile data is not copied, but points into read only file mapping */
+bool LoadDDS(const std::wstring& filepath, TextureDesc& desc, bool singleMip = false, bool mapFile = false);
+/** Release data of loaded DDS */
+void FreeDDS(TextureDesc& desc);
@@ -0,0 +1,462 @@
+#include "framework.h"
+
+#include "ShaderCache.h"
+
+#include <d3dcompiler.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace
+{
+
+const UINT64 HashSeed = 0xcbf29ce484222325ull;
+
+// FNV-1a
+UINT64 Hash(const void* pData, size_t size, UINT64 hash = HashSeed)
+{
+    const unsigned char* pBytes = reinterpret_cast<const unsigned char*>(pData);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= pBytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+UINT64 Hash(const std::string& str, UINT64 hash)
+{
+    // Length is hashed too, so concatenated strings give different keys
+    UINT32 len = (UINT32)str.length();
+    hash = Hash(&len, sizeof(len), hash);
+    return Hash(str.c_str(), str.length(), hash);
+}
+
+bool ReadWholeFile(const wchar_t* pPath, std::vector<char>& data)
+{
+    FILE* pFile = nullptr;
+    _wfopen_s(&pFile, pPath, L"rb");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+
+    fseek(pFile, 0, SEEK_END);
+    long long size = _ftelli64(pFile);
+    fseek(pFile, 0, SEEK_SET);
+
+    data.resize((size_t)size);
+    size_t rd = fread(data.data(), 1, (size_t)size, pFile);
+
+    fclose(pFile);
+
+    return rd == (size_t)size;
+}
+
+const wchar_t* ManifestName = L"Startup.manifest";
+
+struct EntryHeader
+{
+    UINT32 magic;
+    UINT32 dependencyCount;
+    UINT32 codeSize;
+};
+
+}
+
+// Records every opened include with hash of its content
+class CachingInclude : public ID3DInclude
+{
+public:
+    std::vector<ShaderCache::Dependency> dependencies;
+
+    STDMETHOD(Open)(THIS_ D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID* ppData, UINT* pBytes)
+    {
+        // Missing include is reported by compiler, shader may be in the middle of editing
+        std::vector<char> data;
+        if (!ReadWholeFile(std::wstring(pFileName, pFileName + strlen(pFileName)).c_str(), data))
+        {
+            return E_FAIL;
+        }
+
+        VOID* pData = malloc(data.size());
+        if (pData == nullptr)
+        {
+            return E_FAIL;
+        }
+        memcpy(pData, data.data(), data.size());
+
+        dependencies.push_back({ pFileName, Hash(data.data(), data.size()) });
+
+        *ppData = pData;
+        *pBytes = (UINT)data.size();
+
+        return S_OK;
+    }
+    STDMETHOD(Close)(THIS_ LPCVOID pData)
+    {
+        free(const_cast<void*>(pData));
+        return S_OK;
+    }
+};
+
+UINT ShaderCache::GetCompileFlags(Optimization optimization)
+{
+    switch (optimization)
+    {
+        case OptimizationDebug:
+            return D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+
+        case OptimizationRelease:
+            return D3DCOMPILE_OPTIMIZATION_LEVEL3 | D3DCOMPILE_ENABLE_STRICTNESS;
+    }
+    assert(0);
+    return 0;
+}
+
+std::wstring ShaderCache::GetEntryPath(const std::wstring& path, const std::vector<std::string>& defines, const std::string& entryPoint, const std::string& target, UINT flags) const
+{
+    std::string name = WCSToMBS(path);
+
+    UINT64 key = Hash(name, HashSeed);
+    for (const std::string& define : defines)
+    {
+        key = Hash(define, key);
+    }
+    key = Hash(entryPoint, key);
+    key = Hash(target, key);
+    key = Hash(&flags, sizeof(flags), key);
+
+    wchar_t keyStr[17];
+    swprintf_s(keyStr, L"%016llx", (unsigned long long)key);
+
+    std::wstring fileName = path;
+    size_t slashPos = fileName.find_last_of(L"/\\");
+    if (slashPos != std::wstring::npos)
+    {
+        fileName = fileName.substr(slashPos + 1);
+    }
+    return m_directory + L"/" + fileName + L"_" + keyStr + L".dxbc";
+}
+
+HRESULT ShaderCache::GetBytecode(const std::wstring& path, const std::vector<std::string>& defines, const std::string& entryPoint, const std::string& target, UINT flags, ID3DBlob** ppCode, std::vector<Dependency>* pDependencies)
+{
+    std::wstring entryPath = GetEntryPath(path, defines, entryPoint, target, flags);
+
+    if (m_recording && m_requestEntries.insert(entryPath).second)
+    {
+        m_requests.push_back({ path, defines, entryPoint, target, flags });
+    }
+
+    HRESULT result = S_OK;
+    std::vector<Dependency> dependencies;
+    {
+        std::unique_lock<std::mutex> lock(m_prefetchMutex);
+        auto it = m_prefetched.find(entryPath);
+        if (it != m_prefetched.end())
+        {
+            m_prefetchCV.wait(lock, [this, &entryPath]() { return m_prefetched.at(entryPath).ready; });
+            it = m_prefetched.find(entryPath);
+
+            result = it->second.result;
+            *ppCode = it->second.pCode;
+            dependencies.swap(it->second.dependencies);
+            m_prefetched.erase(it);
+            m_prefetchUsed++;
+        }
+        else
+        {
+            lock.unlock();
+            result = Fetch(entryPath, path, defines, entryPoint, target, flags, ppCode, dependencies);
+        }
+    }
+
+    if (SUCCEEDED(result) && pDependencies != nullptr)
+    {
+        *pDependencies = dependencies;
+    }
+
+    return result;
+}
+
+HRESULT ShaderCache::Fetch(const std::wstring& entryPath, const std::wstring& path, const std::vector<std::string>& defines, const std::string& entryPoint, const std::string& target, UINT flags, ID3DBlob** ppCode, std::vector<Dependency>& dependencies)
+{
+    if (Load(entryPath, ppCode, dependencies))
+    {
+        m_hitCount++;
+        return S_OK;
+    }
+    m_missCount++;
+
+    std::string name = WCSToMBS(path);
+
+    std::vector<char> data;
+    if (!ReadWholeFile(path.c_str(), data))
+    {
+        return E_FAIL;
+    }
+
+    // Define is either a name or NAME=VALUE
+    std::vector<std::string> defineNames(defines.size());
+    std::vector<std::string> defineValues(defines.size());
+    std::vector<D3D_SHADER_MACRO> shaderDefines;
+    shaderDefines.resize(defines.size() + 1);
+    for (size_t i = 0; i < defines.size(); i++)
+    {
+        size_t eqPos = defines[i].find('=');
+        defineNames[i] = defines[i].substr(0, eqPos);
+        defineValues[i] = eqPos != std::string::npos ? defines[i].substr(eqPos + 1) : std::string();
+        shaderDefines[i].Name = defineNames[i].c_str();
+        shaderDefines[i].Definition = defineValues[i].c_str();
+    }
+    shaderDefines.back().Name = nullptr;
+    shaderDefines.back().Definition = nullptr;
+
+    CachingInclude includeHandler;
+
+    ID3DBlob* pCode = nullptr;
+    ID3DBlob* pErrMsg = nullptr;
+    HRESULT result = D3DCompile(data.data(), data.size(), name.c_str(), shaderDefines.data(), &includeHandler, entryPoint.c_str(), target.c_str(), flags, 0, &pCode, &pErrMsg);
+    if (!SUCCEEDED(result) && pErrMsg != nullptr)
+    {
+        OutputDebugStringA((const char*)pErrMsg->GetBufferPointer());
+    }
+    SAFE_RELEASE(pErrMsg);
+
+    // Input signature is kept, so stripped vertex shader code is still valid for input layouts
+    if (SUCCEEDED(result) && (flags & D3DCOMPILE_DEBUG) == 0)
+    {
+        ID3DBlob* pStripped = nullptr;
+        if (SUCCEEDED(D3DStripShader(pCode->GetBufferPointer(), pCode->GetBufferSize(), D3DCOMPILER_STRIP_REFLECTION_DATA | D3DCOMPILER_STRIP_DEBUG_INFO | D3DCOMPILER_STRIP_TEST_BLOBS, &pStripped)))
+        {
+            SAFE_RELEASE(pCode);
+            pCode = pStripped;
+        }
+    }
+
+    if (SUCCEEDED(result))
+    {
+        dependencies.clear();
+        dependencies.push_back({ name, Hash(data.data(), data.size()) });
+        dependencies.insert(dependencies.end(), includeHandler.dependencies.begin(), includeHandler.dependencies.end());
+
+        Store(entryPath, dependencies, pCode);
+
+        *ppCode = pCode;
+    }
+
+    return result;
+}
+
+void ShaderCache::SaveManifest() const
+{
+    CreateDirectoryW(m_directory.c_str(), nullptr);
+
+    FILE* pFile = nullptr;
+    _wfopen_s(&pFile, (m_directory + L"/" + ManifestName).c_str(), L"wb");
+    if (pFile == nullptr)
+    {
+        return;
+    }
+
+    // Line per request: target, entry point, flags, path and defines, tab separated
+    for (const Request& request : m_requests)
+    {
+        fprintf(pFile, "%s\t%s\t%u\t%s", request.target.c_str(), request.entryPoint.c_str(), request.flags, WCSToMBS(request.path).c_str());
+        for (const std::string& define : request.defines)
+        {
+            fprintf(pFile, "\t%s", define.c_str());
+        }
+        fprintf(pFile, "\n");
+    }
+
+    fclose(pFile);
+}
+
+bool ShaderCache::LoadManifest(std::vector<Request>& requests) const
+{
+    std::vector<char> data;
+    if (!ReadWholeFile((m_directory + L"/" + ManifestName).c_str(), data))
+    {
+        return false;
+    }
+
+    std::string text(data.begin(), data.end());
+    size_t lineStart = 0;
+    while (lineStart < text.length())
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+        {
+            lineEnd = text.length();
+        }
+
+        std::vector<std::string> fields;
+        size_t fieldStart = lineStart;
+        while (fieldStart <= lineEnd)
+        {
+            size_t fieldEnd = std::min(text.find('\t', fieldStart), lineEnd);
+            fields.push_back(text.substr(fieldStart, fieldEnd - fieldStart));
+            fieldStart = fieldEnd + 1;
+        }
+
+        // Broken lines are skipped, manifest is only a hint
+        if (fields.size() >= 4)
+        {
+            Request request;
+            request.target = fields[0];
+            request.entryPoint = fields[1];
+            request.flags = (UINT)strtoul(fields[2].c_str(), nullptr, 10);
+            request.path = std::wstring(fields[3].begin(), fields[3].end());
+            request.defines.assign(fields.begin() + 4, fields.end());
+            requests.push_back(request);
+        }
+
+        lineStart = lineEnd + 1;
+    }
+
+    return true;
+}
+
+void ShaderCache::Prefetch(const std::vector<Request>& requests, const RunFunc& run)
+{
+    for (const Request& request : requests)
+    {
+        std::wstring entryPath = GetEntryPath(request.path, request.defines, request.entryPoint, request.target, request.flags);
+        {
+            // Entry is added before the job runs, so GetBytecode waits for it instead of fetching it again
+            std::lock_guard<std::mutex> lock(m_prefetchMutex);
+            if (!m_prefetched.emplace(entryPath, Prefetched{ false, S_OK, nullptr, {} }).second)
+            {
+                continue;
+            }
+            m_pendingPrefetches++;
+        }
+
+        run([this, request, entryPath]()
+        {
+            ID3DBlob* pCode = nullptr;
+            std::vector<Dependency> dependencies;
+            HRESULT result = Fetch(entryPath, request.path, request.defines, request.entryPoint, request.target, request.flags, &pCode, dependencies);
+
+            std::lock_guard<std::mutex> lock(m_prefetchMutex);
+            Prefetched& prefetched = m_prefetched[entryPath];
+            prefetched.ready = true;
+            prefetched.result = result;
+            prefetched.pCode = pCode;
+            prefetched.dependencies.swap(dependencies);
+            m_pendingPrefetches--;
+            m_prefetchCV.notify_all();
+        });
+    }
+}
+
+void ShaderCache::EndPrefetch()
+{
+    std::unique_lock<std::mutex> lock(m_prefetchMutex);
+    m_prefetchCV.wait(lock, [this]() { return m_pendingPrefetches == 0; });
+
+    for (auto& item : m_prefetched)
+    {
+        SAFE_RELEASE(item.second.pCode);
+    }
+    m_prefetched.clear();
+}
+
+bool ShaderCache::Load(const std::wstring& entryPath, ID3DBlob** ppCode, std::vector<Dependency>& dependencies)
+{
+    std::vector<char> entry;
+    if (!ReadWholeFile(entryPath.c_str(), entry) || entry.size() < sizeof(EntryHeader))
+    {
+        return false;
+    }
+
+    EntryHeader header;
+    memcpy(&header, entry.data(), sizeof(header));
+    if (header.magic != Magic)
+    {
+        return false;
+    }
+
+    // Entry is only valid if none of the sources has changed
+    size_t offset = sizeof(header);
+    std::vector<char> data;
+    for (UINT32 i = 0; i < header.dependencyCount; i++)
+    {
+        UINT32 nameLen = 0;
+        if (offset + sizeof(nameLen) > entry.size())
+        {
+            return false;
+        }
+        memcpy(&nameLen, entry.data() + offset, sizeof(nameLen));
+        offset += sizeof(nameLen);
+
+        UINT64 hash = 0;
+        if (offset + nameLen + sizeof(hash) > entry.size())
+        {
+            return false;
+        }
+        std::string name(entry.data() + offset, nameLen);
+        offset += nameLen;
+        memcpy(&hash, entry.data() + offset, sizeof(hash));
+        offset += sizeof(hash);
+
+        if (!ReadWholeFile(std::wstring(name.begin(), name.end()).c_str(), data) || Hash(data.data(), data.size()) != hash)
+        {
+            return false;
+        }
+        dependencies.push_back({ name, hash });
+    }
+
+    if (offset + header.codeSize != entry.size())
+    {
+        return false;
+    }
+
+    HRESULT result = D3DCreateBlob(header.codeSize, ppCode);
+    if (FAILED(result))
+    {
+        return false;
+    }
+    memcpy((*ppCode)->GetBufferPointer(), entry.data() + offset, header.codeSize);
+
+    return true;
+}
+
+void ShaderCache::Store(const std::wstring& entryPath, const std::vector<Dependency>& dependencies, ID3DBlob* pCode)
+{
+    CreateDirectoryW(m_directory.c_str(), nullptr);
+
+    // Written to temporary file first, so interrupted write never leaves broken entry
+    std::wstring tempPath = entryPath + L".tmp";
+
+    FILE* pFile = nullptr;
+    _wfopen_s(&pFile, tempPath.c_str(), L"wb");
+    if (pFile == nullptr)
+    {
+        return;
+    }
+
+    EntryHeader header;
+    header.magic = Magic;
+    header.dependencyCount = (UINT32)dependencies.size();
+    header.codeSize = (UINT32)pCode->GetBufferSize();
+
+    bool written = fwrite(&header, sizeof(header), 1, pFile) == 1;
+    for (const Dependency& dependency : dependencies)
+    {
+        UINT32 nameLen = (UINT32)dependency.name.length();
+        written = written && fwrite(&nameLen, sizeof(nameLen), 1, pFile) == 1;
+        written = written && fwrite(dependency.name.c_str(), 1, nameLen, pFile) == nameLen;
+        written = written && fwrite(&dependency.hash, sizeof(dependency.hash), 1, pFile) == 1;
+    }
+    written = written && fwrite(pCode->GetBufferPointer(), 1, pCode->GetBufferSize(), pFile) == pCode->GetBufferSize();
+
+    fclose(pFile);
+
+    if (!written || !MoveFileExW(tempPath.c_str(), entryPath.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(tempPath.c_str());
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <d3dcommon.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Persistent cache of compiled shader bytecode.
+ * Entries are named by hash of source path, defines, entry point, target and compile flags,
+ * each entry stores hashes of the source and all included files, so changed sources are recompiled.
+ * Cache is either filled at runtime or built ahead with -buildShaderCache command line switch.
+ * Blobs compiled without debug info are stored stripped of reflection and debug data.
+ * Requests may be recorded into a manifest, so next startup prefetches them on worker threads
+ * while initialization proceeds, GetBytecode of a request being prefetched waits for it.
+ */
+class ShaderCache
+{
+public:
+    static const UINT32 Magic = 0x31434853; // 'SHC1'
+
+    // Shader optimization policy, independent of C++ build configuration
+    enum Optimization
+    {
+        OptimizationDebug = 0, // Debug info, no optimization
+        OptimizationRelease,   // Level 3 optimization with strictness, stripped blobs
+
+        OptimizationCount
+    };
+
+    static UINT GetCompileFlags(Optimization optimization);
+
+    struct Dependency
+    {
+        std::string name;
+        UINT64 hash;
+    };
+
+    struct Request
+    {
+        std::wstring path;
+        std::vector<std::string> defines;
+        std::string entryPoint;
+        std::string target;
+        UINT flags;
+    };
+
+    using RunFunc = std::function<void(const std::function<void()>& func)>;
+
+    ShaderCache()
+        : m_directory(L"ShaderCache")
+        , m_hitCount(0)
+        , m_missCount(0)
+        , m_prefetchUsed(0)
+        , m_recording(false)
+        , m_pendingPrefetches(0)
+    {}
+
+    void SetDirectory(const std::wstring& directory) { m_directory = directory; }
+
+    /** Load bytecode from cache, compile and store it if entry is missing or outdated, optionally return source and include files */
+    HRESULT GetBytecode(const std::wstring& path, const std::vector<std::string>& defines, const std::string& entryPoint, const std::string& target, UINT flags, ID3DBlob** ppCode, std::vector<Dependency>* pDependencies = nullptr);
+
+    /** Record distinct requests of GetBytecode for SaveManifest */
+    void SetRecording(bool recording) { m_recording = recording; }
+    void SaveManifest() const;
+    /** Requests recorded by the last SaveManifest, false if there is none */
+    bool LoadManifest(std::vector<Request>& requests) const;
+
+    /** Fetch bytecode of requests with functions given to run, which may call them on any thread */
+    void Prefetch(const std::vector<Request>& requests, const RunFunc& run);
+    /** Wait for pending prefetches and release bytecode nobody asked for */
+    void EndPrefetch();
+
+    UINT GetHitCount() const { return m_hitCount; }
+    UINT GetMissCount() const { return m_missCount; }
+    UINT GetPrefetchUsedCount() const { return m_prefetchUsed; }
+
+private:
+    struct Prefetched
+    {
+        bool ready;
+        HRESULT result;
+        ID3DBlob* pCode;
+        std::vector<Dependency> dependencies;
+    };
+
+    std::wstring GetEntryPath(const std::wstring& path, const std::vector<std::string>& defines, const std::string& entryPoint, const std::string& target, UINT flags) const;
+    /** Load entry or compile and store it, safe to call from several threads for different entries */
+    HRESULT Fetch(const std::wstring& entryPath, const std::wstring& path, const std::vector<std::string>& defines, const std::string& entryPoint, const std::string& target, UINT flags, ID3DBlob** ppCode, std::vector<Dependency>& dependencies);
+
+    bool Load(const std::wstring& entryPath, ID3DBlob** ppCode, std::vector<Dependency>& dependencies);
+    void Store(const std::wstring& entryPath, const std::vector<Dependency>& dependencies, ID3DBlob* pCode);
+
+private:
+    std::wstring m_directory;
+    std::atomic<UINT> m_hitCount;
+    std::atomic<UINT> m_missCount;
+    UINT m_prefetchUsed;
+
+    bool m_recording;
+    std::vector<Request> m_requests;
+    std::unordered_set<std::wstring> m_requestEntries; // Entry paths of recorded requests
+
+    std::mutex m_prefetchMutex;
+    std::condition_variable m_prefetchCV;
+    std::unordered_map<std::wstring, Prefetched> m_prefetched; // By entry path, guarded by mutex
+    UINT m_pendingPrefetches; // Guarded by mutex
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "../Math/Point.h"
+
+/** Index and vertex count of latitude-longitude sphere */
+void GetSphereDataSize(size_t latCells, size_t lonCells, size_t& indexCount, size_t& vertexCount);
+
+/** Sphere of 0.5 radius seen from inside, vertex count should fit 16-bit indices */
+void CreateSphere(size_t latCells, size_t lonCells, UINT16* pIndices, Point3f* pPos);
@@ -0,0 +1,112 @@
+// Cube drawn by every instancing strategy of InstancingBench, STRATEGY selects where model matrix comes from
+
+#define STRATEGY_DRAW_PER_INSTANCE 0 // Matrix in cbuffer updated before each draw
+#define STRATEGY_CBUFFER_ARRAY 1     // Array in cbuffer indexed by SV_InstanceID, like 8.Instancing
+#define STRATEGY_VERTEX_STREAM 2     // Per instance vertex data
+#define STRATEGY_STRUCTURED 3        // Structured buffer indexed by SV_InstanceID
+#define STRATEGY_GPU_CULLED 4        // Structured buffer indexed by ids of instances passed culling, like 10.Compute
+
+#define MAX_CBUFFER_INSTANCES 1024   // 64 KB cbuffer, should match InstancingBench.cpp
+
+cbuffer FrameBuffer : register (b0)
+{
+    float4x4 vp;
+    float4 frustum[6];
+    uint4 instanceCount; // x - instances to cull
+};
+
+#if STRATEGY == STRATEGY_DRAW_PER_INSTANCE
+cbuffer InstanceBuffer : register (b1)
+{
+    float4x4 instanceModel;
+};
+#elif STRATEGY == STRATEGY_CBUFFER_ARRAY
+cbuffer InstanceArrayBuffer : register (b1)
+{
+    float4x4 models[MAX_CBUFFER_INSTANCES];
+};
+#else
+StructuredBuffer<float4x4> models : register (t0);
+#endif
+
+#if STRATEGY == STRATEGY_GPU_CULLED
+StructuredBuffer<uint> visibleIds : register (t1);
+#endif
+
+struct VSInput
+{
+    float3 pos : POSITION;
+    float3 norm : NORMAL;
+#if STRATEGY == STRATEGY_VERTEX_STREAM
+    float4 modelRow0 : MODEL0;
+    float4 modelRow1 : MODEL1;
+    float4 modelRow2 : MODEL2;
+    float4 modelRow3 : MODEL3;
+#endif
+
+    uint instanceId : SV_InstanceID;
+};
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float3 norm : NORMAL;
+};
+
+float4x4 GetModel(in VSInput vertex)
+{
+#if STRATEGY == STRATEGY_DRAW_PER_INSTANCE
+    return instanceModel;
+#elif STRATEGY == STRATEGY_VERTEX_STREAM
+    // Rows of vertex data are rows of matrix as stored on CPU, so transposed like cbuffer load is
+    return transpose(float4x4(vertex.modelRow0, vertex.modelRow1, vertex.modelRow2, vertex.modelRow3));
+#elif STRATEGY == STRATEGY_GPU_CULLED
+    return models[visibleIds[vertex.instanceId]];
+#else
+    return models[vertex.instanceId];
+#endif
+}
+
+VSOutput vs(VSInput vertex)
+{
+    float4x4 model = GetModel(vertex);
+
+    VSOutput result;
+    result.pos = mul(vp, mul(model, float4(vertex.pos, 1.0)));
+    result.norm = mul((float3x3)model, vertex.norm);
+
+    return result;
+}
+
+float4 ps(VSOutput pixel) : SV_Target0
+{
+    float3 lightDir = normalize(float3(0.3, 1.0, -0.5));
+    return float4((0.2 + 0.8 * saturate(dot(normalize(pixel.norm), lightDir))) * float3(0.8, 0.6, 0.4), 1.0);
+}
+
+#if STRATEGY == STRATEGY_GPU_CULLED
+AppendStructuredBuffer<uint> visibleIdsOut : register (u0);
+
+[numthreads(64, 1, 1)]
+void cs(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint idx = globalThreadId.x;
+    if (idx >= instanceCount.x)
+    {
+        return;
+    }
+
+    // Bounding sphere of unit cube
+    float3 center = mul(models[idx], float4(0, 0, 0, 1)).xyz;
+    const float radius = 0.8660254;
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(frustum[i].xyz, center) + frustum[i].w < -radius)
+        {
+            return;
+        }
+    }
+
+    visibleIdsOut.Append(idx);
+}
+#endif
@@ -0,0 +1,812 @@
+// InstancingBench.cpp : Same cubes rendered offscreen with each instancing strategy across instance counts.
+// CPU submit time and GPU time per strategy are printed and written as JSON report, see -help for options.
+//
+
+#include "../10.Compute/framework.h"
+
+#include "../10.Compute/Frustum.h"
+
+#include <d3dcompiler.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace
+{
+
+enum Strategy
+{
+    StrategyDrawPerInstance = 0,
+    StrategyCBufferArray,
+    StrategyVertexStream,
+    StrategyStructured,
+    StrategyGpuCulled,
+
+    StrategyCount
+};
+
+const char* StrategyNames[StrategyCount] = { "draw_per_instance", "cbuffer_array", "vertex_stream", "structured_buffer", "gpu_culled_indirect" };
+
+const UINT MaxCBufferInstances = 1024; // 64 KB cbuffer, should match Instancing.hlsl
+const UINT QueryLatency = 4;           // Frames GPU timestamps are read back after
+
+struct Config
+{
+    std::vector<UINT> instanceCounts = { 1, 10, 100, 1000, 10000, 100000 };
+    UINT warmupFrames = 30;     ///< Frames skipped before measurement, covers driver warmup and query latency
+    UINT frames = 200;          ///< Measured frames per strategy and instance count
+    UINT width = 1280;
+    UINT height = 720;
+    bool staticInstances = false; ///< Buffers holding all instances are uploaded once instead of every frame
+    std::string reportPath = "instancing.json";
+};
+
+struct Result
+{
+    Strategy strategy;
+    UINT instances;
+    double cpuMedianMs; ///< Upload and submission of draws and dispatches
+    double cpuP95Ms;
+    double gpuMedianMs; ///< From the first command of the frame to the last draw
+    double gpuP95Ms;
+};
+
+struct FrameBuffer
+{
+    DirectX::XMMATRIX vp;
+    Point4f frustum[6];
+    UINT instanceCount[4];
+};
+
+struct Vertex
+{
+    Point3f pos;
+    Point3f norm;
+};
+
+/** GPU objects shared by all runs */
+struct Context
+{
+    ID3D11Device* pDevice = nullptr;
+    ID3D11DeviceContext* pContext = nullptr;
+
+    ID3D11Texture2D* pTarget = nullptr;
+    ID3D11RenderTargetView* pTargetRTV = nullptr;
+    ID3D11Texture2D* pDepth = nullptr;
+    ID3D11DepthStencilView* pDepthDSV = nullptr;
+    ID3D11DepthStencilState* pDepthState = nullptr;
+
+    ID3D11Buffer* pVertexBuffer = nullptr;
+    ID3D11Buffer* pIndexBuffer = nullptr;
+    ID3D11Buffer* pFrameBuffer = nullptr;
+    ID3D11Buffer* pInstanceBuffer = nullptr;      // Matrix of single instance
+    ID3D11Buffer* pInstanceArrayBuffer = nullptr; // MaxCBufferInstances matrices
+
+    ID3D11VertexShader* pVertexShaders[StrategyCount] = {};
+    ID3D11InputLayout* pInputLayouts[StrategyCount] = {};
+    ID3D11PixelShader* pPixelShader = nullptr;
+    ID3D11ComputeShader* pCullShader = nullptr;
+
+    ID3D11Query* pDisjoint[QueryLatency] = {};
+    ID3D11Query* pTimestamps[QueryLatency * 2] = {};
+};
+
+/** Buffers sized by instance count */
+struct InstanceBuffers
+{
+    ID3D11Buffer* pStream = nullptr;     // Per instance vertex data
+    ID3D11Buffer* pModels = nullptr;     // Structured buffer of matrices
+    ID3D11ShaderResourceView* pModelsSRV = nullptr;
+    ID3D11Buffer* pVisibleIds = nullptr; // Ids appended by culling
+    ID3D11ShaderResourceView* pVisibleIdsSRV = nullptr;
+    ID3D11UnorderedAccessView* pVisibleIdsUAV = nullptr;
+    ID3D11Buffer* pIndirectArgs = nullptr;
+};
+
+const UINT16 CubeIndices[36] = {
+    0, 2, 1, 0, 3, 2,
+    4, 6, 5, 4, 7, 6,
+    8, 10, 9, 8, 11, 10,
+    12, 14, 13, 12, 15, 14,
+    16, 18, 17, 16, 19, 18,
+    20, 22, 21, 20, 23, 22
+};
+
+const Vertex CubeVertices[24] = {
+    // Bottom face
+    {Point3f{-0.5, -0.5,  0.5}, Point3f{0, -1, 0}},
+    {Point3f{ 0.5, -0.5,  0.5}, Point3f{0, -1, 0}},
+    {Point3f{ 0.5, -0.5, -0.5}, Point3f{0, -1, 0}},
+    {Point3f{-0.5, -0.5, -0.5}, Point3f{0, -1, 0}},
+    // Top face
+    {Point3f{-0.5,  0.5, -0.5}, Point3f{0, 1, 0}},
+    {Point3f{ 0.5,  0.5, -0.5}, Point3f{0, 1, 0}},
+    {Point3f{ 0.5,  0.5,  0.5}, Point3f{0, 1, 0}},
+    {Point3f{-0.5,  0.5,  0.5}, Point3f{0, 1, 0}},
+    // Front face
+    {Point3f{ 0.5, -0.5, -0.5}, Point3f{1, 0, 0}},
+    {Point3f{ 0.5, -0.5,  0.5}, Point3f{1, 0, 0}},
+    {Point3f{ 0.5,  0.5,  0.5}, Point3f{1, 0, 0}},
+    {Point3f{ 0.5,  0.5, -0.5}, Point3f{1, 0, 0}},
+    // Back face
+    {Point3f{-0.5, -0.5,  0.5}, Point3f{-1, 0, 0}},
+    {Point3f{-0.5, -0.5, -0.5}, Point3f{-1, 0, 0}},
+    {Point3f{-0.5,  0.5, -0.5}, Point3f{-1, 0, 0}},
+    {Point3f{-0.5,  0.5,  0.5}, Point3f{-1, 0, 0}},
+    // Left face
+    {Point3f{ 0.5, -0.5,  0.5}, Point3f{0, 0, 1}},
+    {Point3f{-0.5, -0.5,  0.5}, Point3f{0, 0, 1}},
+    {Point3f{-0.5,  0.5,  0.5}, Point3f{0, 0, 1}},
+    {Point3f{ 0.5,  0.5,  0.5}, Point3f{0, 0, 1}},
+    // Right face
+    {Point3f{-0.5, -0.5, -0.5}, Point3f{0, 0, -1}},
+    {Point3f{ 0.5, -0.5, -0.5}, Point3f{0, 0, -1}},
+    {Point3f{ 0.5,  0.5, -0.5}, Point3f{0, 0, -1}},
+    {Point3f{-0.5,  0.5, -0.5}, Point3f{0, 0, -1}}
+};
+
+INT64 GetTicks()
+{
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return ticks.QuadPart;
+}
+
+double TicksToMs(INT64 ticks)
+{
+    static double msPerTick = 0.0;
+    if (msPerTick == 0.0)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        msPerTick = 1e3 / frequency.QuadPart;
+    }
+    return ticks * msPerTick;
+}
+
+double Percentile(std::vector<double>& values, double p)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    // Nearest rank
+    size_t rank = (size_t)ceil(p * values.size());
+    return values[std::min(std::max(rank, (size_t)1), values.size()) - 1];
+}
+
+HRESULT CompileShader(ID3D11Device* pDevice, Strategy strategy, const char* entryPoint, const char* target, ID3D11DeviceChild** ppShader, ID3DBlob** ppCode = nullptr)
+{
+    char strategyDefine[4];
+    sprintf_s(strategyDefine, "%d", (int)strategy);
+    D3D_SHADER_MACRO defines[] = { { "STRATEGY", strategyDefine }, { nullptr, nullptr } };
+
+    UINT flags = 0;
+#ifdef _DEBUG
+    flags |= D3DCOMPILE_DEBUG;
+#endif // _DEBUG
+
+    ID3DBlob* pCode = nullptr;
+    ID3DBlob* pErrMsg = nullptr;
+    HRESULT result = D3DCompileFromFile(L"Instancing.hlsl", defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, entryPoint, target, flags, 0, &pCode, &pErrMsg);
+    if (FAILED(result) && pErrMsg != nullptr)
+    {
+        printf("%s\n", (const char*)pErrMsg->GetBufferPointer());
+    }
+    SAFE_RELEASE(pErrMsg);
+
+    if (SUCCEEDED(result))
+    {
+        if (strcmp(target, "vs_5_0") == 0)
+        {
+            result = pDevice->CreateVertexShader(pCode->GetBufferPointer(), pCode->GetBufferSize(), nullptr, (ID3D11VertexShader**)ppShader);
+        }
+        else if (strcmp(target, "ps_5_0") == 0)
+        {
+            result = pDevice->CreatePixelShader(pCode->GetBufferPointer(), pCode->GetBufferSize(), nullptr, (ID3D11PixelShader**)ppShader);
+        }
+        else
+        {
+            result = pDevice->CreateComputeShader(pCode->GetBufferPointer(), pCode->GetBufferSize(), nullptr, (ID3D11ComputeShader**)ppShader);
+        }
+    }
+    if (SUCCEEDED(result) && ppCode != nullptr)
+    {
+        *ppCode = pCode;
+        pCode = nullptr;
+    }
+    SAFE_RELEASE(pCode);
+
+    return result;
+}
+
+HRESULT CreateBuffer(ID3D11Device* pDevice, UINT size, D3D11_USAGE usage, UINT bindFlags, UINT miscFlags, UINT stride, const void* pData, ID3D11Buffer** ppBuffer)
+{
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = size;
+    desc.Usage = usage;
+    desc.BindFlags = bindFlags;
+    desc.CPUAccessFlags = usage == D3D11_USAGE_DYNAMIC ? D3D11_CPU_ACCESS_WRITE : 0;
+    desc.MiscFlags = miscFlags;
+    desc.StructureByteStride = stride;
+
+    D3D11_SUBRESOURCE_DATA data = { pData, size, 0 };
+    return pDevice->CreateBuffer(&desc, pData != nullptr ? &data : nullptr, ppBuffer);
+}
+
+HRESULT InitContext(const Config& config, Context& ctx)
+{
+    UINT flags = 0;
+#ifdef _DEBUG
+    flags |= D3D11_CREATE_DEVICE_DEBUG;
+#endif // _DEBUG
+
+    D3D_FEATURE_LEVEL level;
+    D3D_FEATURE_LEVEL levels[] = { D3D_FEATURE_LEVEL_11_0 };
+    HRESULT result = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, flags, levels, 1, D3D11_SDK_VERSION, &ctx.pDevice, &level, &ctx.pContext);
+    ID3D11Device* pDevice = ctx.pDevice;
+
+    // Offscreen target, nothing is presented
+    if (SUCCEEDED(result))
+    {
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width = config.width;
+        desc.Height = config.height;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+        result = pDevice->CreateTexture2D(&desc, nullptr, &ctx.pTarget);
+        if (SUCCEEDED(result))
+        {
+            result = pDevice->CreateRenderTargetView(ctx.pTarget, nullptr, &ctx.pTargetRTV);
+        }
+
+        desc.Format = DXGI_FORMAT_D32_FLOAT;
+        desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+        if (SUCCEEDED(result))
+        {
+            result = pDevice->CreateTexture2D(&desc, nullptr, &ctx.pDepth);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = pDevice->CreateDepthStencilView(ctx.pDepth, nullptr, &ctx.pDepthDSV);
+        }
+    }
+    if (SUCCEEDED(result))
+    {
+        // Reversed depth, like the renderer
+        D3D11_DEPTH_STENCIL_DESC desc = {};
+        desc.DepthEnable = TRUE;
+        desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+        desc.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
+        result = pDevice->CreateDepthStencilState(&desc, &ctx.pDepthState);
+    }
+
+    if (SUCCEEDED(result))
+    {
+        result = CreateBuffer(pDevice, sizeof(CubeVertices), D3D11_USAGE_IMMUTABLE, D3D11_BIND_VERTEX_BUFFER, 0, 0, CubeVertices, &ctx.pVertexBuffer);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CreateBuffer(pDevice, sizeof(CubeIndices), D3D11_USAGE_IMMUTABLE, D3D11_BIND_INDEX_BUFFER, 0, 0, CubeIndices, &ctx.pIndexBuffer);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CreateBuffer(pDevice, sizeof(FrameBuffer), D3D11_USAGE_DEFAULT, D3D11_BIND_CONSTANT_BUFFER, 0, 0, nullptr, &ctx.pFrameBuffer);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CreateBuffer(pDevice, sizeof(DirectX::XMFLOAT4X4), D3D11_USAGE_DYNAMIC, D3D11_BIND_CONSTANT_BUFFER, 0, 0, nullptr, &ctx.pInstanceBuffer);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CreateBuffer(pDevice, sizeof(DirectX::XMFLOAT4X4) * MaxCBufferInstances, D3D11_USAGE_DYNAMIC, D3D11_BIND_CONSTANT_BUFFER, 0, 0, nullptr, &ctx.pInstanceArrayBuffer);
+    }
+
+    for (int strategy = 0; strategy < StrategyCount && SUCCEEDED(result); strategy++)
+    {
+        ID3DBlob* pCode = nullptr;
+        result = CompileShader(pDevice, (Strategy)strategy, "vs", "vs_5_0", (ID3D11DeviceChild**)&ctx.pVertexShaders[strategy], &pCode);
+        if (SUCCEEDED(result))
+        {
+            static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
+                { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+                { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+                { "MODEL", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+                { "MODEL", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+                { "MODEL", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+                { "MODEL", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+            };
+            UINT elementCount = strategy == StrategyVertexStream ? 6 : 2;
+            result = pDevice->CreateInputLayout(InputDesc, elementCount, pCode->GetBufferPointer(), pCode->GetBufferSize(), &ctx.pInputLayouts[strategy]);
+        }
+        SAFE_RELEASE(pCode);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileShader(pDevice, StrategyDrawPerInstance, "ps", "ps_5_0", (ID3D11DeviceChild**)&ctx.pPixelShader);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CompileShader(pDevice, StrategyGpuCulled, "cs", "cs_5_0", (ID3D11DeviceChild**)&ctx.pCullShader);
+    }
+
+    for (UINT i = 0; i < QueryLatency && SUCCEEDED(result); i++)
+    {
+        D3D11_QUERY_DESC desc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+        result = pDevice->CreateQuery(&desc, &ctx.pDisjoint[i]);
+
+        desc.Query = D3D11_QUERY_TIMESTAMP;
+        if (SUCCEEDED(result))
+        {
+            result = pDevice->CreateQuery(&desc, &ctx.pTimestamps[i * 2]);
+        }
+        if (SUCCEEDED(result))
+        {
+            result = pDevice->CreateQuery(&desc, &ctx.pTimestamps[i * 2 + 1]);
+        }
+    }
+
+    return result;
+}
+
+void TermContext(Context& ctx)
+{
+    for (UINT i = 0; i < QueryLatency; i++)
+    {
+        SAFE_RELEASE(ctx.pDisjoint[i]);
+        SAFE_RELEASE(ctx.pTimestamps[i * 2]);
+        SAFE_RELEASE(ctx.pTimestamps[i * 2 + 1]);
+    }
+    SAFE_RELEASE(ctx.pCullShader);
+    SAFE_RELEASE(ctx.pPixelShader);
+    for (UINT i = 0; i < StrategyCount; i++)
+    {
+        SAFE_RELEASE(ctx.pInputLayouts[i]);
+        SAFE_RELEASE(ctx.pVertexShaders[i]);
+    }
+    SAFE_RELEASE(ctx.pInstanceArrayBuffer);
+    SAFE_RELEASE(ctx.pInstanceBuffer);
+    SAFE_RELEASE(ctx.pFrameBuffer);
+    SAFE_RELEASE(ctx.pIndexBuffer);
+    SAFE_RELEASE(ctx.pVertexBuffer);
+    SAFE_RELEASE(ctx.pDepthState);
+    SAFE_RELEASE(ctx.pDepthDSV);
+    SAFE_RELEASE(ctx.pDepth);
+    SAFE_RELEASE(ctx.pTargetRTV);
+    SAFE_RELEASE(ctx.pTarget);
+    SAFE_RELEASE(ctx.pContext);
+    SAFE_RELEASE(ctx.pDevice);
+}
+
+HRESULT CreateInstanceBuffers(ID3D11Device* pDevice, const std::vector<DirectX::XMFLOAT4X4>& models, InstanceBuffers& buffers)
+{
+    UINT count = (UINT)models.size();
+    UINT size = count * sizeof(DirectX::XMFLOAT4X4);
+
+    HRESULT result = CreateBuffer(pDevice, size, D3D11_USAGE_DYNAMIC, D3D11_BIND_VERTEX_BUFFER, 0, 0, models.data(), &buffers.pStream);
+    if (SUCCEEDED(result))
+    {
+        result = CreateBuffer(pDevice, size, D3D11_USAGE_DYNAMIC, D3D11_BIND_SHADER_RESOURCE, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, sizeof(DirectX::XMFLOAT4X4), models.data(), &buffers.pModels);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = pDevice->CreateShaderResourceView(buffers.pModels, nullptr, &buffers.pModelsSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = CreateBuffer(pDevice, count * sizeof(UINT), D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, sizeof(UINT), nullptr, &buffers.pVisibleIds);
+    }
+    if (SUCCEEDED(result))
+    {
+        result = pDevice->CreateShaderResourceView(buffers.pVisibleIds, nullptr, &buffers.pVisibleIdsSRV);
+    }
+    if (SUCCEEDED(result))
+    {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC desc = {};
+        desc.Format = DXGI_FORMAT_UNKNOWN;
+        desc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        desc.Buffer.FirstElement = 0;
+        desc.Buffer.NumElements = count;
+        desc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_APPEND;
+        result = pDevice->CreateUnorderedAccessView(buffers.pVisibleIds, &desc, &buffers.pVisibleIdsUAV);
+    }
+    if (SUCCEEDED(result))
+    {
+        // Instance count is written by CopyStructureCount every frame
+        D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args = { 36, 0, 0, 0, 0 };
+        result = CreateBuffer(pDevice, sizeof(args), D3D11_USAGE_DEFAULT, 0, D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS, 0, &args, &buffers.pIndirectArgs);
+    }
+
+    return result;
+}
+
+void TermInstanceBuffers(InstanceBuffers& buffers)
+{
+    SAFE_RELEASE(buffers.pIndirectArgs);
+    SAFE_RELEASE(buffers.pVisibleIdsUAV);
+    SAFE_RELEASE(buffers.pVisibleIdsSRV);
+    SAFE_RELEASE(buffers.pVisibleIds);
+    SAFE_RELEASE(buffers.pModelsSRV);
+    SAFE_RELEASE(buffers.pModels);
+    SAFE_RELEASE(buffers.pStream);
+}
+
+/** Random rotations in a box in front of camera, density does not depend on count, so a similar part is visible */
+std::vector<DirectX::XMFLOAT4X4> CreateModels(UINT count)
+{
+    float side = 2.0f * powf((float)count, 1.0f / 3.0f);
+
+    std::vector<DirectX::XMFLOAT4X4> models(count);
+    for (UINT i = 0; i < count; i++)
+    {
+        DirectX::XMVECTOR axis = DirectX::XMVectorSet(randNormf() - 0.5f, randNormf() - 0.5f, randNormf() - 0.5f, 0.0f);
+        axis = DirectX::XMVector3Normalize(DirectX::XMVectorAdd(axis, DirectX::XMVectorSet(0.0f, 0.01f, 0.0f, 0.0f)));
+        DirectX::XMMATRIX m = DirectX::XMMatrixMultiply(
+            DirectX::XMMatrixRotationAxis(axis, randNormf() * 2.0f * (float)M_PI),
+            DirectX::XMMatrixTranslation((randNormf() - 0.5f) * side, (randNormf() - 0.5f) * side, 2.0f + randNormf() * side)
+        );
+        DirectX::XMStoreFloat4x4(&models[i], m);
+    }
+    return models;
+}
+
+void UploadDynamic(ID3D11DeviceContext* pContext, ID3D11Buffer* pBuffer, const void* pData, size_t size)
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (SUCCEEDED(pContext->Map(pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    {
+        memcpy(mapped.pData, pData, size);
+        pContext->Unmap(pBuffer, 0);
+    }
+}
+
+/** Upload and draw calls of one frame, these are what CPU time is measured for */
+void SubmitFrame(const Config& config, Context& ctx, Strategy strategy, const std::vector<DirectX::XMFLOAT4X4>& models, const InstanceBuffers& buffers)
+{
+    ID3D11DeviceContext* pContext = ctx.pContext;
+    UINT count = (UINT)models.size();
+    size_t size = count * sizeof(DirectX::XMFLOAT4X4);
+
+    switch (strategy)
+    {
+        case StrategyDrawPerInstance:
+            for (UINT i = 0; i < count; i++)
+            {
+                UploadDynamic(pContext, ctx.pInstanceBuffer, &models[i], sizeof(DirectX::XMFLOAT4X4));
+                pContext->DrawIndexed(36, 0, 0);
+            }
+            break;
+
+        case StrategyCBufferArray:
+            for (UINT first = 0; first < count; first += MaxCBufferInstances)
+            {
+                UINT chunk = std::min(count - first, MaxCBufferInstances);
+                UploadDynamic(pContext, ctx.pInstanceArrayBuffer, &models[first], chunk * sizeof(DirectX::XMFLOAT4X4));
+                pContext->DrawIndexedInstanced(36, chunk, 0, 0, 0);
+            }
+            break;
+
+        case StrategyVertexStream:
+            if (!config.staticInstances)
+            {
+                UploadDynamic(pContext, buffers.pStream, models.data(), size);
+            }
+            pContext->DrawIndexedInstanced(36, count, 0, 0, 0);
+            break;
+
+        case StrategyStructured:
+            if (!config.staticInstances)
+            {
+                UploadDynamic(pContext, buffers.pModels, models.data(), size);
+            }
+            pContext->DrawIndexedInstanced(36, count, 0, 0, 0);
+            break;
+
+        case StrategyGpuCulled:
+        {
+            if (!config.staticInstances)
+            {
+                UploadDynamic(pContext, buffers.pModels, models.data(), size);
+            }
+
+            // Culled ids are appended from zero, count goes to instance count of draw arguments
+            UINT initialCount = 0;
+            ID3D11ShaderResourceView* nullSRVs[2] = {};
+            pContext->VSSetShaderResources(0, 2, nullSRVs);
+            pContext->CSSetShader(ctx.pCullShader, nullptr, 0);
+            pContext->CSSetConstantBuffers(0, 1, &ctx.pFrameBuffer);
+            pContext->CSSetShaderResources(0, 1, &buffers.pModelsSRV);
+            pContext->CSSetUnorderedAccessViews(0, 1, &buffers.pVisibleIdsUAV, &initialCount);
+            pContext->Dispatch((count + 63) / 64, 1, 1);
+
+            ID3D11UnorderedAccessView* nullUAV = nullptr;
+            pContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+            pContext->CopyStructureCount(buffers.pIndirectArgs, sizeof(UINT), buffers.pVisibleIdsUAV);
+
+            ID3D11ShaderResourceView* resources[] = { buffers.pModelsSRV, buffers.pVisibleIdsSRV };
+            pContext->VSSetShaderResources(0, 2, resources);
+            pContext->DrawIndexedInstancedIndirect(buffers.pIndirectArgs, 0);
+            break;
+        }
+    }
+}
+
+void BindStrategy(Context& ctx, Strategy strategy, const InstanceBuffers& buffers)
+{
+    ID3D11DeviceContext* pContext = ctx.pContext;
+
+    pContext->ClearState();
+
+    D3D11_VIEWPORT viewport = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    D3D11_TEXTURE2D_DESC desc;
+    ctx.pTarget->GetDesc(&desc);
+    viewport.Width = (FLOAT)desc.Width;
+    viewport.Height = (FLOAT)desc.Height;
+    pContext->RSSetViewports(1, &viewport);
+    pContext->OMSetRenderTargets(1, &ctx.pTargetRTV, ctx.pDepthDSV);
+    pContext->OMSetDepthStencilState(ctx.pDepthState, 0);
+
+    ID3D11Buffer* vertexBuffers[] = { ctx.pVertexBuffer, buffers.pStream };
+    UINT strides[] = { sizeof(Vertex), sizeof(DirectX::XMFLOAT4X4) };
+    UINT offsets[] = { 0, 0 };
+    pContext->IASetVertexBuffers(0, strategy == StrategyVertexStream ? 2 : 1, vertexBuffers, strides, offsets);
+    pContext->IASetIndexBuffer(ctx.pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pContext->IASetInputLayout(ctx.pInputLayouts[strategy]);
+    pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    ID3D11Buffer* cbuffers[] = { ctx.pFrameBuffer, strategy == StrategyCBufferArray ? ctx.pInstanceArrayBuffer : ctx.pInstanceBuffer };
+    pContext->VSSetShader(ctx.pVertexShaders[strategy], nullptr, 0);
+    pContext->VSSetConstantBuffers(0, 2, cbuffers);
+    if (strategy == StrategyStructured)
+    {
+        pContext->VSSetShaderResources(0, 1, &buffers.pModelsSRV);
+    }
+    pContext->PSSetShader(ctx.pPixelShader, nullptr, 0);
+}
+
+/** Milliseconds between timestamps of frame, negative if disjoint */
+double ReadGpuTime(Context& ctx, UINT slot)
+{
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    while (ctx.pContext->GetData(ctx.pDisjoint[slot], &disjoint, sizeof(disjoint), 0) == S_FALSE)
+    {
+        YieldProcessor();
+    }
+    UINT64 begin = 0, end = 0;
+    while (ctx.pContext->GetData(ctx.pTimestamps[slot * 2], &begin, sizeof(begin), 0) == S_FALSE)
+    {
+        YieldProcessor();
+    }
+    while (ctx.pContext->GetData(ctx.pTimestamps[slot * 2 + 1], &end, sizeof(end), 0) == S_FALSE)
+    {
+        YieldProcessor();
+    }
+    return disjoint.Disjoint ? -1.0 : (end - begin) * 1000.0 / disjoint.Frequency;
+}
+
+Result Run(const Config& config, Context& ctx, Strategy strategy, const std::vector<DirectX::XMFLOAT4X4>& models, const InstanceBuffers& buffers)
+{
+    BindStrategy(ctx, strategy, buffers);
+
+    std::vector<double> cpuMs, gpuMs;
+    UINT totalFrames = config.warmupFrames + config.frames;
+    for (UINT frame = 0; frame < totalFrames + QueryLatency; frame++)
+    {
+        UINT slot = frame % QueryLatency;
+        if (frame >= QueryLatency)
+        {
+            // Waiting for GPU here also keeps CPU from queueing more than QueryLatency frames, as Present would
+            double ms = ReadGpuTime(ctx, slot);
+            if (frame - QueryLatency >= config.warmupFrames && ms >= 0.0)
+            {
+                gpuMs.push_back(ms);
+            }
+        }
+        if (frame >= totalFrames)
+        {
+            continue;
+        }
+
+        ctx.pContext->Begin(ctx.pDisjoint[slot]);
+        ctx.pContext->End(ctx.pTimestamps[slot * 2]);
+
+        static const FLOAT ClearColor[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
+        ctx.pContext->ClearRenderTargetView(ctx.pTargetRTV, ClearColor);
+        ctx.pContext->ClearDepthStencilView(ctx.pDepthDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
+
+        INT64 start = GetTicks();
+        SubmitFrame(config, ctx, strategy, models, buffers);
+        if (frame >= config.warmupFrames)
+        {
+            cpuMs.push_back(TicksToMs(GetTicks() - start));
+        }
+
+        ctx.pContext->End(ctx.pTimestamps[slot * 2 + 1]);
+        ctx.pContext->End(ctx.pDisjoint[slot]);
+        ctx.pContext->Flush();
+    }
+
+    Result result;
+    result.strategy = strategy;
+    result.instances = (UINT)models.size();
+    result.cpuMedianMs = Percentile(cpuMs, 0.5);
+    result.cpuP95Ms = Percentile(cpuMs, 0.95);
+    result.gpuMedianMs = Percentile(gpuMs, 0.5);
+    result.gpuP95Ms = Percentile(gpuMs, 0.95);
+
+    printf("%-20s %8u %10.3f %10.3f %10.3f %10.3f\n", StrategyNames[strategy], result.instances, result.cpuMedianMs, result.cpuP95Ms, result.gpuMedianMs, result.gpuP95Ms);
+
+    return result;
+}
+
+void UpdateFrameBuffer(const Config& config, Context& ctx, UINT instanceCount)
+{
+    const float fov = (float)M_PI / 3;
+    const float n = 0.1f;
+    const float f = 1000.0f;
+
+    DirectX::XMMATRIX v = DirectX::XMMatrixLookToLH(DirectX::XMVectorZero(), DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    DirectX::XMMATRIX p = DirectX::XMMatrixPerspectiveFovLH(fov, (float)config.width / config.height, f, n);
+
+    FrameBuffer frameBuffer;
+    frameBuffer.vp = DirectX::XMMatrixMultiply(v, p);
+    ExtractFrustum(frameBuffer.vp, false, frameBuffer.frustum);
+    frameBuffer.instanceCount[0] = instanceCount;
+    frameBuffer.instanceCount[1] = frameBuffer.instanceCount[2] = frameBuffer.instanceCount[3] = 0;
+    ctx.pContext->UpdateSubresource(ctx.pFrameBuffer, 0, nullptr, &frameBuffer, 0, 0);
+}
+
+/** Strategy with the lowest median of CPU or GPU time for each instance count */
+void PrintCrossover(const std::vector<Result>& results, bool gpu)
+{
+    printf("Fastest by %s:", gpu ? "GPU" : "CPU");
+    for (size_t i = 0; i < results.size(); i += StrategyCount)
+    {
+        size_t best = i;
+        for (size_t j = i + 1; j < i + StrategyCount && j < results.size(); j++)
+        {
+            if ((gpu ? results[j].gpuMedianMs : results[j].cpuMedianMs) < (gpu ? results[best].gpuMedianMs : results[best].cpuMedianMs))
+            {
+                best = j;
+            }
+        }
+        printf(" %u - %s%s", results[i].instances, StrategyNames[results[best].strategy], i + StrategyCount < results.size() ? "," : "\n");
+    }
+}
+
+bool SaveReport(const Config& config, const std::vector<Result>& results)
+{
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, config.reportPath.c_str(), "w") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+    fprintf(pFile, "{\n  \"frames\": %u,\n  \"width\": %u,\n  \"height\": %u,\n  \"staticInstances\": %d,\n  \"results\": [\n",
+        config.frames, config.width, config.height, config.staticInstances ? 1 : 0);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& result = results[i];
+        fprintf(pFile, "    { \"strategy\": \"%s\", \"instances\": %u, \"cpuMs\": { \"p50\": %.4f, \"p95\": %.4f }, \"gpuMs\": { \"p50\": %.4f, \"p95\": %.4f } }%s\n",
+            StrategyNames[result.strategy], result.instances, result.cpuMedianMs, result.cpuP95Ms, result.gpuMedianMs, result.gpuP95Ms, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(pFile, "  ]\n}\n");
+
+    fclose(pFile);
+
+    return true;
+}
+
+/** Parse [-counts a,b,c] [-frames N] [-static] [-report path] [-quick] options, false on unknown option */
+bool ParseArgs(int argc, wchar_t** argv, Config& config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (wcscmp(argv[i], L"-counts") == 0 && i + 1 < argc)
+        {
+            config.instanceCounts.clear();
+            wchar_t* pCounts = argv[++i];
+            while (*pCounts != 0)
+            {
+                wchar_t* pEnd = nullptr;
+                UINT count = (UINT)wcstoul(pCounts, &pEnd, 10);
+                if (count > 0)
+                {
+                    config.instanceCounts.push_back(count);
+                }
+                pCounts = *pEnd != 0 ? pEnd + 1 : pEnd; // Skip separator
+            }
+        }
+        else if (wcscmp(argv[i], L"-frames") == 0 && i + 1 < argc)
+        {
+            config.frames = std::max((UINT)_wtoi(argv[++i]), 1u);
+        }
+        else if (wcscmp(argv[i], L"-static") == 0)
+        {
+            config.staticInstances = true;
+        }
+        else if (wcscmp(argv[i], L"-report") == 0 && i + 1 < argc)
+        {
+            config.reportPath = WCSToMBS(argv[++i]);
+        }
+        else if (wcscmp(argv[i], L"-quick") == 0)
+        {
+            config.warmupFrames = 10;
+            config.frames = 50;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return !config.instanceCounts.empty();
+}
+
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    Config config;
+    if (!ParseArgs(argc, argv, config))
+    {
+        printf("Usage: InstancingBench [-counts a,b,c] [-frames N] [-static] [-report path] [-quick]\n");
+        return 1;
+    }
+
+    Context ctx;
+    if (FAILED(InitContext(config, ctx)))
+    {
+        printf("Failed to create device or compile Instancing.hlsl\n");
+        TermContext(ctx);
+        return 1;
+    }
+
+    // Same instances on every run
+    srand(12345);
+
+    printf("%-20s %8s %10s %10s %10s %10s\n", "strategy", "count", "cpu p50", "cpu p95", "gpu p50", "gpu p95");
+
+    std::vector<Result> results;
+    for (UINT count : config.instanceCounts)
+    {
+        std::vector<DirectX::XMFLOAT4X4> models = CreateModels(count);
+        InstanceBuffers buffers;
+        if (FAILED(CreateInstanceBuffers(ctx.pDevice, models, buffers)))
+        {
+            printf("Failed to create buffers of %u instances, skipped\n", count);
+            TermInstanceBuffers(buffers);
+            continue;
+        }
+        UpdateFrameBuffer(config, ctx, count);
+
+        for (int strategy = 0; strategy < StrategyCount; strategy++)
+        {
+            results.push_back(Run(config, ctx, (Strategy)strategy, models, buffers));
+        }
+
+        ctx.pContext->ClearState();
+        TermInstanceBuffers(buffers);
+    }
+
+    PrintCrossover(results, false);
+    PrintCrossover(results, true);
+
+    TermContext(ctx);
+
+    if (!SaveReport(config, results))
+    {
+        printf("Failed to write %s\n", config.reportPath.c_str());
+        return 1;
+    }
+    printf("Report written to %s\n", config.reportPath.c_str());
+
+    return 0;
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include "Matrix.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+// Batch bound operations. Box is any type of two Point3f members vmin and vmax, like AABB of 10.Compute.
+// Each operation has scalar version with Scalar suffix, the one without it uses SSE if MATH_SIMD is defined.
+// Matrices are affine and applied to row vectors, same as Matrix4::TransformPoints.
+// Plane tests write bit per element to mask words, 32 elements each, bit is set if element is not fully behind any plane.
+
+/** Bounds of pSrc[i] transformed by pMatrices[i] (Arvo) */
+template <typename Box>
+void TransformBoxesScalar(const Matrix4f* pMatrices, const Box* pSrc, Box* pDst, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* m = pMatrices[i].m;
+        const float* pMin = &pSrc[i].vmin.x;
+        const float* pMax = &pSrc[i].vmax.x;
+
+        // Translation, then the smaller and the larger product of each axis go to min and max
+        float newMin[3] = { m[12], m[13], m[14] };
+        float newMax[3] = { m[12], m[13], m[14] };
+        for (int j = 0; j < 3; j++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                float a = m[k * 4 + j] * pMin[k];
+                float b = m[k * 4 + j] * pMax[k];
+                newMin[j] += std::min(a, b);
+                newMax[j] += std::max(a, b);
+            }
+        }
+        pDst[i].vmin = Point3f{ newMin[0], newMin[1], newMin[2] };
+        pDst[i].vmax = Point3f{ newMax[0], newMax[1], newMax[2] };
+    }
+}
+
+/** Same test as IsBoxInside of 10.Compute, planes are (normal, distance) with normal pointing inside */
+template <typename Box>
+void TestBoxesScalar(const Point4f* pPlanes, size_t planeCount, const Box* pBoxes, size_t count, uint32_t* pMask)
+{
+    memset(pMask, 0, (count + 31) / 32 * sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++)
+    {
+        const Box& box = pBoxes[i];
+        bool inside = true;
+        for (size_t p = 0; p < planeCount && inside; p++)
+        {
+            // The most positive vertex along plane normal
+            const Point4f& plane = pPlanes[p];
+            float d = std::max(plane.x * box.vmin.x, plane.x * box.vmax.x)
+                + std::max(plane.y * box.vmin.y, plane.y * box.vmax.y)
+                + std::max(plane.z * box.vmin.z, plane.z * box.vmax.z) + plane.w;
+            inside = d >= 0.0f;
+        }
+        pMask[i / 32] |= inside ? 1u << (i % 32) : 0u;
+    }
+}
+
+/** Spheres are xyz - center, w - radius, plane normals should be normalized */
+inline void TestSpheresScalar(const Point4f* pPlanes, size_t planeCount, const Point4f* pSpheres, size_t count, uint32_t* pMask)
+{
+    memset(pMask, 0, (count + 31) / 32 * sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++)
+    {
+        const Point4f& sphere = pSpheres[i];
+        bool inside = true;
+        for (size_t p = 0; p < planeCount && inside; p++)
+        {
+            const Point4f& plane = pPlanes[p];
+            inside = plane.x * sphere.x + plane.y * sphere.y + plane.z * sphere.z + plane.w + sphere.w >= 0.0f;
+        }
+        pMask[i / 32] |= inside ? 1u << (i % 32) : 0u;
+    }
+}
+
+/** Sphere around each box, xyz - center, w - radius */
+template <typename Box>
+void BoxSpheresScalar(const Box* pBoxes, Point4f* pSpheres, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const Box& box = pBoxes[i];
+        Point3f halfSize = (box.vmax - box.vmin) * 0.5f;
+        pSpheres[i] = Point4f((box.vmin + box.vmax) * 0.5f, halfSize.length());
+    }
+}
+
+#ifdef MATH_SIMD
+namespace MathSimd
+{
+
+// Box is 6 floats, max is loaded from z of min on, so neither load reads past the box
+template <typename Box>
+inline void LoadBox(const Box& box, __m128& vmin, __m128& vmax)
+{
+    static_assert(sizeof(Box) == sizeof(float) * 6, "Box should be two Point3f");
+    vmin = _mm_loadu_ps(&box.vmin.x);
+    __m128 tail = _mm_loadu_ps(&box.vmin.z);
+    vmax = _mm_shuffle_ps(tail, tail, _MM_SHUFFLE(0, 3, 2, 1));
+}
+
+inline void StorePoint3(Point3f& p, __m128 v)
+{
+    float values[4];
+    _mm_storeu_ps(values, v);
+    p = Point3f{ values[0], values[1], values[2] };
+}
+
+// Components of 4 boxes, one per lane
+template <typename Box>
+inline void LoadBoxes4(const Box* pBoxes, __m128 vmin[3], __m128 vmax[3])
+{
+    vmin[0] = _mm_setr_ps(pBoxes[0].vmin.x, pBoxes[1].vmin.x, pBoxes[2].vmin.x, pBoxes[3].vmin.x);
+    vmin[1] = _mm_setr_ps(pBoxes[0].vmin.y, pBoxes[1].vmin.y, pBoxes[2].vmin.y, pBoxes[3].vmin.y);
+    vmin[2] = _mm_setr_ps(pBoxes[0].vmin.z, pBoxes[1].vmin.z, pBoxes[2].vmin.z, pBoxes[3].vmin.z);
+    vmax[0] = _mm_setr_ps(pBoxes[0].vmax.x, pBoxes[1].vmax.x, pBoxes[2].vmax.x, pBoxes[3].vmax.x);
+    vmax[1] = _mm_setr_ps(pBoxes[0].vmax.y, pBoxes[1].vmax.y, pBoxes[2].vmax.y, pBoxes[3].vmax.y);
+    vmax[2] = _mm_setr_ps(pBoxes[0].vmax.z, pBoxes[1].vmax.z, pBoxes[2].vmax.z, pBoxes[3].vmax.z);
+}
+
+}
+
+/** Arvo's method in center and half size form: center is transformed as point, half size by absolute rotation part */
+template <typename Box>
+void TransformBoxes(const Matrix4f* pMatrices, const Box* pSrc, Box* pDst, size_t count)
+{
+    using namespace MathSimd;
+
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    for (size_t i = 0; i < count; i++)
+    {
+        __m128 rows[4];
+        LoadRows(pMatrices[i].m, rows);
+
+        __m128 vmin, vmax;
+        LoadBox(pSrc[i], vmin, vmax);
+        __m128 center = _mm_mul_ps(_mm_add_ps(vmin, vmax), half);
+        __m128 halfSize = _mm_mul_ps(_mm_sub_ps(vmax, vmin), half);
+
+        __m128 newCenter = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0)), rows[0]), rows[3]);
+        newCenter = _mm_add_ps(newCenter, _mm_mul_ps(_mm_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1)), rows[1]));
+        newCenter = _mm_add_ps(newCenter, _mm_mul_ps(_mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2)), rows[2]));
+
+        __m128 newHalfSize = _mm_mul_ps(_mm_shuffle_ps(halfSize, halfSize, _MM_SHUFFLE(0, 0, 0, 0)), _mm_and_ps(rows[0], absMask));
+        newHalfSize = _mm_add_ps(newHalfSize, _mm_mul_ps(_mm_shuffle_ps(halfSize, halfSize, _MM_SHUFFLE(1, 1, 1, 1)), _mm_and_ps(rows[1], absMask)));
+        newHalfSize = _mm_add_ps(newHalfSize, _mm_mul_ps(_mm_shuffle_ps(halfSize, halfSize, _MM_SHUFFLE(2, 2, 2, 2)), _mm_and_ps(rows[2], absMask)));
+
+        StorePoint3(pDst[i].vmin, _mm_sub_ps(newCenter, newHalfSize));
+        StorePoint3(pDst[i].vmax, _mm_add_ps(newCenter, newHalfSize));
+    }
+}
+
+/** 4 boxes at once, remainder is tested by scalar code */
+template <typename Box>
+void TestBoxes(const Point4f* pPlanes, size_t planeCount, const Box* pBoxes, size_t count, uint32_t* pMask)
+{
+    using namespace MathSimd;
+
+    size_t simdCount = count & ~(size_t)3;
+    memset(pMask, 0, (count + 31) / 32 * sizeof(uint32_t));
+    for (size_t i = 0; i < simdCount; i += 4)
+    {
+        __m128 vmin[3], vmax[3];
+        LoadBoxes4(pBoxes + i, vmin, vmax);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t p = 0; p < planeCount; p++)
+        {
+            const Point4f& plane = pPlanes[p];
+            __m128 nx = _mm_set1_ps(plane.x);
+            __m128 ny = _mm_set1_ps(plane.y);
+            __m128 nz = _mm_set1_ps(plane.z);
+            __m128 d = _mm_add_ps(_mm_max_ps(_mm_mul_ps(nx, vmin[0]), _mm_mul_ps(nx, vmax[0])), _mm_set1_ps(plane.w));
+            d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(ny, vmin[1]), _mm_mul_ps(ny, vmax[1])));
+            d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(nz, vmin[2]), _mm_mul_ps(nz, vmax[2])));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+        pMask[i / 32] |= (uint32_t)_mm_movemask_ps(inside) << (i % 32);
+    }
+
+    if (simdCount < count)
+    {
+        uint32_t tail = 0;
+        TestBoxesScalar(pPlanes, planeCount, pBoxes + simdCount, count - simdCount, &tail);
+        pMask[simdCount / 32] |= tail << (simdCount % 32);
+    }
+}
+
+/** 4 spheres at once, remainder is tested by scalar code */
+inline void TestSpheres(const Point4f* pPlanes, size_t planeCount, const Point4f* pSpheres, size_t count, uint32_t* pMask)
+{
+    size_t simdCount = count & ~(size_t)3;
+    memset(pMask, 0, (count + 31) / 32 * sizeof(uint32_t));
+    for (size_t i = 0; i < simdCount; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&pSpheres[i].x);
+        __m128 y = _mm_loadu_ps(&pSpheres[i + 1].x);
+        __m128 z = _mm_loadu_ps(&pSpheres[i + 2].x);
+        __m128 radius = _mm_loadu_ps(&pSpheres[i + 3].x);
+        _MM_TRANSPOSE4_PS(x, y, z, radius);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t p = 0; p < planeCount; p++)
+        {
+            const Point4f& plane = pPlanes[p];
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_add_ps(radius, _mm_set1_ps(plane.w)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.y), y));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), z));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+        pMask[i / 32] |= (uint32_t)_mm_movemask_ps(inside) << (i % 32);
+    }
+
+    if (simdCount < count)
+    {
+        uint32_t tail = 0;
+        TestSpheresScalar(pPlanes, planeCount, pSpheres + simdCount, count - simdCount, &tail);
+        pMask[simdCount / 32] |= tail << (simdCount % 32);
+    }
+}
+
+template <typename Box>
+void BoxSpheres(const Box* pBoxes, Point4f* pSpheres, size_t count)
+{
+    using namespace MathSimd;
+
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (size_t i = 0; i < count; i++)
+    {
+        __m128 vmin, vmax;
+        LoadBox(pBoxes[i], vmin, vmax);
+        __m128 halfSize = _mm_mul_ps(_mm_sub_ps(vmax, vmin), half);
+
+        // Length of xyz, w lane of loaded boxes is not meaningful
+        __m128 sq = _mm_mul_ps(halfSize, halfSize);
+        __m128 lengthSq = _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 2, 2, 2)));
+
+        _mm_storeu_ps(&pSpheres[i].x, _mm_mul_ps(_mm_add_ps(vmin, vmax), half));
+        pSpheres[i].w = _mm_cvtss_f32(_mm_sqrt_ss(lengthSq));
+    }
+}
+#else
+template <typename Box>
+void TransformBoxes(const Matrix4f* pMatrices, const Box* pSrc, Box* pDst, size_t count)
+{
+    TransformBoxesScalar(pMatrices, pSrc, pDst, count);
+}
+
+template <typename Box>
+void TestBoxes(const Point4f* pPlanes, size_t planeCount, const Box* pBoxes, size_t count, uint32_t* pMask)
+{
+    TestBoxesScalar(pPlanes, planeCount, pBoxes, count, pMask);
+}
+
+inline void TestSpheres(const Point4f* pPlanes, size_t planeCount, const Point4f* pSpheres, size_t count, uint32_t* pMask)
+{
+    TestSpheresScalar(pPlanes, planeCount, pSpheres, count, pMask);
+}
+
+template <typename Box>
+void BoxSpheres(const Box* pBoxes, Point4f* pSpheres, size_t count)
+{
+    BoxSpheresScalar(pBoxes, pSpheres, count);
+}
+#endif // MATH_SIMD
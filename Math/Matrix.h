@@ -2,6 +2,13 @@
 
 #include "Point.h"
 
+// SSE paths of Matrix4f, define MATH_NO_SIMD to keep scalar code only.
+// Storage stays unaligned 16 floats, so layout matches constant buffers and unaligned loads are used.
+#if !defined(MATH_NO_SIMD) && (defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__))
+#define MATH_SIMD 1
+#include <emmintrin.h>
+#endif
+
 template <typename T>
 struct Matrix4
 {
@@ -95,6 +102,23 @@ struct Matrix4
         return res;
     }
 
+    /** Batch transform of points with w = 1 */
+    void TransformPoints(const Point3<T>* pSrc, Point4<T>* pDst, size_t count) const
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            pDst[i] = *this * Point4<T>(pSrc[i], T(1));
+        }
+    }
+
+    void TransformPoints(const Point4<T>* pSrc, Point4<T>* pDst, size_t count) const
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            pDst[i] = *this * pSrc[i];
+        }
+    }
+
     void CoordTransformMatrix(const Point3<T>& xaxis, const Point3<T>& yaxis, const Point3<T>& zaxis, const Point3<T>& origin)
     {
         Identity();
@@ -267,3 +291,179 @@ struct Matrix4
 };
 
 using Matrix4f = Matrix4<float>;
+
+#ifdef MATH_SIMD
+namespace MathSimd
+{
+
+#define MATH_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+#define MATH_SWIZZLE(a, x, y, z, w) MATH_SHUFFLE(a, a, x, y, z, w)
+
+// Vector by row major matrix, rows are pointed by pRows
+inline __m128 Transform(__m128 v, const __m128* pRows)
+{
+    __m128 res = _mm_mul_ps(MATH_SWIZZLE(v, 0, 0, 0, 0), pRows[0]);
+    res = _mm_add_ps(res, _mm_mul_ps(MATH_SWIZZLE(v, 1, 1, 1, 1), pRows[1]));
+    res = _mm_add_ps(res, _mm_mul_ps(MATH_SWIZZLE(v, 2, 2, 2, 2), pRows[2]));
+    return _mm_add_ps(res, _mm_mul_ps(MATH_SWIZZLE(v, 3, 3, 3, 3), pRows[3]));
+}
+
+inline void LoadRows(const float* m, __m128* pRows)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        pRows[i] = _mm_loadu_ps(m + i * 4);
+    }
+}
+
+// 2x2 matrices are stored as (m00, m01, m10, m11)
+inline __m128 Mat2Mul(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, MATH_SWIZZLE(b, 0, 3, 0, 3)), _mm_mul_ps(MATH_SWIZZLE(a, 1, 0, 3, 2), MATH_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// Adjugate of a multiplied by b
+inline __m128 Mat2AdjMul(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(MATH_SWIZZLE(a, 3, 3, 0, 0), b), _mm_mul_ps(MATH_SWIZZLE(a, 1, 1, 2, 2), MATH_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// a multiplied by adjugate of b
+inline __m128 Mat2MulAdj(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, MATH_SWIZZLE(b, 3, 0, 3, 0)), _mm_mul_ps(MATH_SWIZZLE(a, 1, 0, 3, 2), MATH_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+}
+
+template <>
+inline Matrix4<float> Matrix4<float>::operator*(const Matrix4<float>& b) const
+{
+    __m128 rows[4];
+    MathSimd::LoadRows(b.m, rows);
+
+    Matrix4<float> newM;
+    for (int i = 0; i < 4; i++)
+    {
+        _mm_storeu_ps(newM.m + i * 4, MathSimd::Transform(_mm_loadu_ps(m + i * 4), rows));
+    }
+
+    return newM;
+}
+
+template <>
+inline Point4<float> Matrix4<float>::operator*(const Point4<float>& p) const
+{
+    __m128 rows[4];
+    MathSimd::LoadRows(m, rows);
+
+    Point4<float> res;
+    _mm_storeu_ps(&res.x, MathSimd::Transform(_mm_loadu_ps(&p.x), rows));
+
+    return res;
+}
+
+template <>
+inline void Matrix4<float>::TransformPoints(const Point3<float>* pSrc, Point4<float>* pDst, size_t count) const
+{
+    __m128 rows[4];
+    MathSimd::LoadRows(m, rows);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        __m128 res = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pSrc[i].x), rows[0]), rows[3]);
+        res = _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(pSrc[i].y), rows[1]));
+        res = _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(pSrc[i].z), rows[2]));
+        _mm_storeu_ps(&pDst[i].x, res);
+    }
+}
+
+template <>
+inline void Matrix4<float>::TransformPoints(const Point4<float>* pSrc, Point4<float>* pDst, size_t count) const
+{
+    __m128 rows[4];
+    MathSimd::LoadRows(m, rows);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        _mm_storeu_ps(&pDst[i].x, MathSimd::Transform(_mm_loadu_ps(&pSrc[i].x), rows));
+    }
+}
+
+template <>
+inline Matrix4<float> Matrix4<float>::Transpose()
+{
+    __m128 rows[4];
+    MathSimd::LoadRows(m, rows);
+    _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+
+    Matrix4<float> trans;
+    for (int i = 0; i < 4; i++)
+    {
+        _mm_storeu_ps(trans.m + i * 4, rows[i]);
+    }
+
+    return trans;
+}
+
+// Block inverse with 2x2 sub matrices A, B (top) and C, D (bottom),
+// inverse blocks are built from adjugates X#, Y#, Z#, W# scaled by 1/|M|
+template <>
+inline Matrix4<float> Matrix4<float>::Inverse() const
+{
+    using namespace MathSimd;
+
+    __m128 rows[4];
+    LoadRows(m, rows);
+
+    __m128 A = _mm_movelh_ps(rows[0], rows[1]);
+    __m128 B = _mm_movehl_ps(rows[1], rows[0]);
+    __m128 C = _mm_movelh_ps(rows[2], rows[3]);
+    __m128 D = _mm_movehl_ps(rows[3], rows[2]);
+
+    // (|A|, |B|, |C|, |D|)
+    __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(MATH_SHUFFLE(rows[0], rows[2], 0, 2, 0, 2), MATH_SHUFFLE(rows[1], rows[3], 1, 3, 1, 3)),
+        _mm_mul_ps(MATH_SHUFFLE(rows[0], rows[2], 1, 3, 1, 3), MATH_SHUFFLE(rows[1], rows[3], 0, 2, 0, 2)));
+    __m128 detA = MATH_SWIZZLE(detSub, 0, 0, 0, 0);
+    __m128 detB = MATH_SWIZZLE(detSub, 1, 1, 1, 1);
+    __m128 detC = MATH_SWIZZLE(detSub, 2, 2, 2, 2);
+    __m128 detD = MATH_SWIZZLE(detSub, 3, 3, 3, 3);
+
+    __m128 adjDC = Mat2AdjMul(D, C);
+    __m128 adjAB = Mat2AdjMul(A, B);
+
+    // X# = |D|A - B(D#C), W# = |A|D - C(A#B), Y# = |B|C - D(A#B)#, Z# = |C|B - A(D#C)#
+    __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, adjDC));
+    __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, adjAB));
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, adjAB));
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, adjDC));
+
+    // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+    __m128 tr = _mm_mul_ps(adjAB, MATH_SWIZZLE(adjDC, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, MATH_SWIZZLE(tr, 2, 3, 0, 1));
+    tr = _mm_add_ps(tr, MATH_SWIZZLE(tr, 1, 0, 3, 2));
+    __m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+    // Same as scalar version, adjugate is returned for singular matrix
+    __m128 adjSign = _mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f);
+    __m128 scale = fabs(_mm_cvtss_f32(detM)) < 0.00001f ? adjSign : _mm_div_ps(adjSign, detM);
+
+    X = _mm_mul_ps(X, scale);
+    Y = _mm_mul_ps(Y, scale);
+    Z = _mm_mul_ps(Z, scale);
+    W = _mm_mul_ps(W, scale);
+
+    // Adjugate shuffle is combined with store
+    Matrix4<float> inv;
+    _mm_storeu_ps(inv.m + 0, MATH_SHUFFLE(X, Y, 3, 1, 3, 1));
+    _mm_storeu_ps(inv.m + 4, MATH_SHUFFLE(X, Y, 2, 0, 2, 0));
+    _mm_storeu_ps(inv.m + 8, MATH_SHUFFLE(Z, W, 3, 1, 3, 1));
+    _mm_storeu_ps(inv.m + 12, MATH_SHUFFLE(Z, W, 2, 0, 2, 0));
+
+    return inv;
+}
+
+#undef MATH_SWIZZLE
+#undef MATH_SHUFFLE
+#endif // MATH_SIMD
@@ -0,0 +1,496 @@
+// MicroBench.cpp : Console microbenchmarks of Math, culling, sphere generation and DDS loading.
+// Results are printed and written as JSON report, see -help for options.
+//
+
+#include "../10.Compute/framework.h"
+
+#include "../10.Compute/AABB.h"
+#include "../10.Compute/Frustum.h"
+
+#include "../Core/DDS.h"
+#include "../Core/Shapes.h"
+
+#include "../Math/Bounds.h"
+#include "../Math/Matrix.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace
+{
+
+struct Config
+{
+    double minBatchMs = 20.0;   ///< Iterations per batch are doubled until batch takes that long
+    UINT batches = 7;           ///< Measured batches, the fastest one is reported
+    std::string reportPath = "microbench.json";
+    std::vector<std::wstring> ddsFiles = { L"../Common/Brick.dds", L"../Common/BrickNM.dds", L"../Common/Kitty.dds", L"../Common/posx.dds" };
+};
+
+struct Result
+{
+    std::string name;
+    size_t size;        ///< Problem size, elements per call or sphere steps
+    double nsPerOp;     ///< Time per element
+    double itemsPerSec; ///< Elements, or vertices for spheres
+    double mbPerSec;    ///< Bytes read and written, 0 if not meaningful
+};
+
+// Results are accumulated here, so optimizer could not drop measured code
+volatile float g_sink = 0.0f;
+
+INT64 GetTicks()
+{
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return ticks.QuadPart;
+}
+
+double TicksToNs(INT64 ticks)
+{
+    static double nsPerTick = 0.0;
+    if (nsPerTick == 0.0)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        nsPerTick = 1e9 / frequency.QuadPart;
+    }
+    return ticks * nsPerTick;
+}
+
+/** Nanoseconds per call of func, fastest of config.batches batches after calibration */
+template <typename F>
+double Measure(const Config& config, F func)
+{
+    size_t iterations = 1;
+    for (;;)
+    {
+        INT64 start = GetTicks();
+        for (size_t i = 0; i < iterations; i++)
+        {
+            func();
+        }
+        double ns = TicksToNs(GetTicks() - start);
+        if (ns >= config.minBatchMs * 1e6 || iterations >= ((size_t)1 << 30))
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double best = 0.0;
+    for (UINT batch = 0; batch < config.batches; batch++)
+    {
+        INT64 start = GetTicks();
+        for (size_t i = 0; i < iterations; i++)
+        {
+            func();
+        }
+        double ns = TicksToNs(GetTicks() - start) / iterations;
+        best = batch == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+void AddResult(std::vector<Result>& results, const char* name, size_t size, double callNs, size_t opsPerCall, size_t itemsPerCall, size_t bytesPerCall)
+{
+    Result result;
+    result.name = name;
+    result.size = size;
+    result.nsPerOp = callNs / opsPerCall;
+    result.itemsPerSec = itemsPerCall * 1e9 / callNs;
+    result.mbPerSec = bytesPerCall * 1e9 / callNs / (1024.0 * 1024.0);
+    results.push_back(result);
+
+    printf("%-20s %10zu %12.3f ns/op %14.0f items/s %10.1f MB/s\n", name, size, result.nsPerOp, result.itemsPerSec, result.mbPerSec);
+}
+
+Matrix4f RandomMatrix()
+{
+    Matrix4f m;
+    for (int i = 0; i < 16; i++)
+    {
+        m.m[i] = randNormf() * 2.0f - 1.0f;
+    }
+    // Dominant diagonal keeps matrices invertible
+    m.m[0] += 4.0f;
+    m.m[5] += 4.0f;
+    m.m[10] += 4.0f;
+    m.m[15] += 4.0f;
+    return m;
+}
+
+Point3f RandomPoint(float range)
+{
+    return Point3f{ (randNormf() * 2.0f - 1.0f) * range, (randNormf() * 2.0f - 1.0f) * range, (randNormf() * 2.0f - 1.0f) * range };
+}
+
+void BenchMatrices(const Config& config, std::vector<Result>& results)
+{
+    static const size_t Sizes[] = { 64, 4096, 262144 };
+
+    for (size_t size : Sizes)
+    {
+        std::vector<Matrix4f> a(size), b(size), c(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            a[i] = RandomMatrix();
+            b[i] = RandomMatrix();
+        }
+
+        double ns = Measure(config, [&]()
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                c[i] = a[i] * b[i];
+            }
+            g_sink = g_sink + c[size - 1].m[0];
+        });
+        AddResult(results, "matrix_mul", size, ns, size, size, size * sizeof(Matrix4f) * 3);
+
+        ns = Measure(config, [&]()
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                c[i] = a[i].Inverse();
+            }
+            g_sink = g_sink + c[size - 1].m[0];
+        });
+        AddResult(results, "matrix_inverse", size, ns, size, size, size * sizeof(Matrix4f) * 2);
+
+        ns = Measure(config, [&]()
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                c[i] = a[i].Transpose();
+            }
+            g_sink = g_sink + c[size - 1].m[1];
+        });
+        AddResult(results, "matrix_transpose", size, ns, size, size, size * sizeof(Matrix4f) * 2);
+    }
+}
+
+void BenchTransform(const Config& config, std::vector<Result>& results)
+{
+    static const size_t Sizes[] = { 1024, 65536, 1048576 };
+
+    Matrix4f m = RandomMatrix();
+    for (size_t size : Sizes)
+    {
+        std::vector<Point3f> src3(size);
+        std::vector<Point4f> src4(size), dst(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            src3[i] = RandomPoint(10.0f);
+            src4[i] = Point4f{ src3[i].x, src3[i].y, src3[i].z, 1.0f };
+        }
+
+        double ns = Measure(config, [&]()
+        {
+            m.TransformPoints(src3.data(), dst.data(), size);
+            g_sink = g_sink + dst[size - 1].x;
+        });
+        AddResult(results, "transform_points3", size, ns, size, size, size * (sizeof(Point3f) + sizeof(Point4f)));
+
+        ns = Measure(config, [&]()
+        {
+            m.TransformPoints(src4.data(), dst.data(), size);
+            g_sink = g_sink + dst[size - 1].x;
+        });
+        AddResult(results, "transform_points4", size, ns, size, size, size * sizeof(Point4f) * 2);
+    }
+}
+
+void BenchCulling(const Config& config, std::vector<Result>& results)
+{
+    static const size_t Sizes[] = { 1024, 65536, 1048576 };
+    static const size_t CameraCount = 256;
+
+    std::vector<Point3f> dirs(CameraCount);
+    for (size_t i = 0; i < CameraCount; i++)
+    {
+        dirs[i] = RandomPoint(1.0f);
+        dirs[i].z += 2.0f;
+        dirs[i].normalize();
+    }
+    const Point3f up{ 0.0f, 1.0f, 0.0f };
+
+    std::vector<Point4f> frustums(CameraCount * 6);
+    double ns = Measure(config, [&]()
+    {
+        for (size_t i = 0; i < CameraCount; i++)
+        {
+            CalcFrustum(Point3f{}, dirs[i], up, (float)M_PI / 3, 9.0f / 16.0f, 0.1f, 100.0f, frustums.data() + i * 6);
+        }
+        g_sink = g_sink + frustums[CameraCount * 6 - 1].w;
+    });
+    AddResult(results, "calc_frustum", CameraCount, ns, CameraCount, CameraCount, 0);
+
+    // Renderer extracts planes from view projection it has anyway
+    std::vector<DirectX::XMMATRIX> vps(CameraCount);
+    DirectX::XMMATRIX p = DirectX::XMMatrixPerspectiveFovLH((float)M_PI / 3, 16.0f / 9.0f, 100.0f, 0.1f);
+    for (size_t i = 0; i < CameraCount; i++)
+    {
+        DirectX::XMMATRIX v = DirectX::XMMatrixLookToLH(DirectX::XMVectorZero(), DirectX::XMVectorSet(dirs[i].x, dirs[i].y, dirs[i].z, 0.0f), DirectX::XMVectorSet(up.x, up.y, up.z, 0.0f));
+        vps[i] = DirectX::XMMatrixMultiply(v, p);
+    }
+    ns = Measure(config, [&]()
+    {
+        for (size_t i = 0; i < CameraCount; i++)
+        {
+            ExtractFrustum(vps[i], false, frustums.data() + i * 6);
+        }
+        g_sink = g_sink + frustums[CameraCount * 6 - 1].w;
+    });
+    AddResult(results, "extract_frustum", CameraCount, ns, CameraCount, CameraCount, 0);
+
+    Point4f frustum[6];
+    CalcFrustum(Point3f{}, Point3f{ 0.0f, 0.0f, 1.0f }, up, (float)M_PI / 3, 9.0f / 16.0f, 0.1f, 100.0f, frustum);
+
+    for (size_t size : Sizes)
+    {
+        // Boxes around camera, about a tenth of them is visible like in the scene
+        std::vector<Point3f> bbMin(size), bbMax(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            Point3f center = RandomPoint(50.0f);
+            bbMin[i] = center - Point3f{ 0.5f, 0.5f, 0.5f };
+            bbMax[i] = center + Point3f{ 0.5f, 0.5f, 0.5f };
+        }
+
+        ns = Measure(config, [&]()
+        {
+            UINT visible = 0;
+            for (size_t i = 0; i < size; i++)
+            {
+                visible += IsBoxInside(frustum, bbMin[i], bbMax[i]) ? 1 : 0;
+            }
+            g_sink = g_sink + (float)visible;
+        });
+        AddResult(results, "is_box_inside", size, ns, size, size, size * sizeof(Point3f) * 2);
+    }
+}
+
+void BenchBounds(const Config& config, std::vector<Result>& results)
+{
+    static const size_t Sizes[] = { 1024, 65536, 1048576 };
+
+    Point4f frustum[6];
+    CalcFrustum(Point3f{}, Point3f{ 0.0f, 0.0f, 1.0f }, Point3f{ 0.0f, 1.0f, 0.0f }, (float)M_PI / 3, 9.0f / 16.0f, 0.1f, 100.0f, frustum);
+
+    for (size_t size : Sizes)
+    {
+        // Same boxes as is_box_inside, matrices are affine like model transforms
+        std::vector<AABB> boxes(size), transformed(size);
+        std::vector<Matrix4f> matrices(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            Point3f center = RandomPoint(50.0f);
+            boxes[i].vmin = center - Point3f{ 0.5f, 0.5f, 0.5f };
+            boxes[i].vmax = center + Point3f{ 0.5f, 0.5f, 0.5f };
+            matrices[i] = RandomMatrix();
+            matrices[i].m[3] = matrices[i].m[7] = matrices[i].m[11] = 0.0f;
+            matrices[i].m[15] = 1.0f;
+        }
+        std::vector<Point4f> spheres(size);
+        std::vector<uint32_t> mask((size + 31) / 32);
+
+        double ns = Measure(config, [&]()
+        {
+            TransformBoxesScalar(matrices.data(), boxes.data(), transformed.data(), size);
+            g_sink = g_sink + transformed[size - 1].vmax.x;
+        });
+        AddResult(results, "box_transform_scalar", size, ns, size, size, size * (sizeof(Matrix4f) + sizeof(AABB) * 2));
+        ns = Measure(config, [&]()
+        {
+            TransformBoxes(matrices.data(), boxes.data(), transformed.data(), size);
+            g_sink = g_sink + transformed[size - 1].vmax.x;
+        });
+        AddResult(results, "box_transform", size, ns, size, size, size * (sizeof(Matrix4f) + sizeof(AABB) * 2));
+
+        ns = Measure(config, [&]()
+        {
+            TestBoxesScalar(frustum, 6, boxes.data(), size, mask.data());
+            g_sink = g_sink + (float)mask[0];
+        });
+        AddResult(results, "box_test_scalar", size, ns, size, size, size * sizeof(AABB));
+        ns = Measure(config, [&]()
+        {
+            TestBoxes(frustum, 6, boxes.data(), size, mask.data());
+            g_sink = g_sink + (float)mask[0];
+        });
+        AddResult(results, "box_test", size, ns, size, size, size * sizeof(AABB));
+
+        ns = Measure(config, [&]()
+        {
+            BoxSpheresScalar(boxes.data(), spheres.data(), size);
+            g_sink = g_sink + spheres[size - 1].w;
+        });
+        AddResult(results, "box_spheres_scalar", size, ns, size, size, size * (sizeof(AABB) + sizeof(Point4f)));
+        ns = Measure(config, [&]()
+        {
+            BoxSpheres(boxes.data(), spheres.data(), size);
+            g_sink = g_sink + spheres[size - 1].w;
+        });
+        AddResult(results, "box_spheres", size, ns, size, size, size * (sizeof(AABB) + sizeof(Point4f)));
+
+        ns = Measure(config, [&]()
+        {
+            TestSpheresScalar(frustum, 6, spheres.data(), size, mask.data());
+            g_sink = g_sink + (float)mask[0];
+        });
+        AddResult(results, "sphere_test_scalar", size, ns, size, size, size * sizeof(Point4f));
+        ns = Measure(config, [&]()
+        {
+            TestSpheres(frustum, 6, spheres.data(), size, mask.data());
+            g_sink = g_sink + (float)mask[0];
+        });
+        AddResult(results, "sphere_test", size, ns, size, size, size * sizeof(Point4f));
+    }
+}
+
+void BenchSphere(const Config& config, std::vector<Result>& results)
+{
+    // Vertex count of 128 steps still fits 16-bit indices
+    static const size_t Steps[] = { 8, 16, 32, 64, 128 };
+
+    for (size_t steps : Steps)
+    {
+        size_t indexCount = 0, vertexCount = 0;
+        GetSphereDataSize(steps, steps, indexCount, vertexCount);
+
+        std::vector<UINT16> indices(indexCount);
+        std::vector<Point3f> vertices(vertexCount);
+        double ns = Measure(config, [&]()
+        {
+            CreateSphere(steps, steps, indices.data(), vertices.data());
+            g_sink = g_sink + vertices[vertexCount / 2].x;
+        });
+        AddResult(results, "create_sphere", steps, ns, 1, vertexCount, indexCount * sizeof(UINT16) + vertexCount * sizeof(Point3f));
+    }
+}
+
+void BenchDDS(const Config& config, std::vector<Result>& results)
+{
+    // Files are in OS cache after calibration, so that is parsing and copy cost rather than disk speed
+    for (const std::wstring& file : config.ddsFiles)
+    {
+        TextureDesc desc;
+        if (!LoadDDS(file, desc))
+        {
+            wprintf(L"Failed to load %s, skipped\n", file.c_str());
+            continue;
+        }
+        size_t size = (size_t)desc.sliceSize * desc.arraySize;
+        FreeDDS(desc);
+
+        for (int mapFile = 0; mapFile < 2; mapFile++)
+        {
+            double ns = Measure(config, [&]()
+            {
+                TextureDesc desc;
+                if (LoadDDS(file, desc, false, mapFile != 0))
+                {
+                    g_sink = g_sink + (float)*reinterpret_cast<const UINT8*>(desc.pData);
+                    FreeDDS(desc);
+                }
+            });
+            AddResult(results, mapFile != 0 ? "load_dds_mapped" : "load_dds", size, ns, 1, 1, size);
+        }
+    }
+}
+
+bool SaveReport(const Config& config, const std::vector<Result>& results)
+{
+    FILE* pFile = nullptr;
+    if (fopen_s(&pFile, config.reportPath.c_str(), "w") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+#ifdef MATH_SIMD
+    const int simd = 1;
+#else
+    const int simd = 0;
+#endif // MATH_SIMD
+
+    fprintf(pFile, "{\n  \"simd\": %d,\n  \"batches\": %u,\n  \"minBatchMs\": %.1f,\n  \"results\": [\n", simd, config.batches, config.minBatchMs);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& result = results[i];
+        fprintf(pFile, "    { \"name\": \"%s\", \"size\": %zu, \"nsPerOp\": %.4f, \"itemsPerSec\": %.1f, \"mbPerSec\": %.2f }%s\n",
+            result.name.c_str(), result.size, result.nsPerOp, result.itemsPerSec, result.mbPerSec, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(pFile, "  ]\n}\n");
+
+    fclose(pFile);
+
+    return true;
+}
+
+/** Parse [-report path] [-dds file]... [-quick] options, false on unknown option */
+bool ParseArgs(int argc, wchar_t** argv, Config& config)
+{
+    bool ddsGiven = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (wcscmp(argv[i], L"-report") == 0 && i + 1 < argc)
+        {
+            config.reportPath = WCSToMBS(argv[++i]);
+        }
+        else if (wcscmp(argv[i], L"-dds") == 0 && i + 1 < argc)
+        {
+            if (!ddsGiven)
+            {
+                config.ddsFiles.clear();
+                ddsGiven = true;
+            }
+            config.ddsFiles.push_back(argv[++i]);
+        }
+        else if (wcscmp(argv[i], L"-quick") == 0)
+        {
+            config.minBatchMs = 2.0;
+            config.batches = 3;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    Config config;
+    if (!ParseArgs(argc, argv, config))
+    {
+        printf("Usage: MicroBench [-report path] [-dds file]... [-quick]\n");
+        return 1;
+    }
+
+    // Same data on every run
+    srand(12345);
+
+    std::vector<Result> results;
+    BenchMatrices(config, results);
+    BenchTransform(config, results);
+    BenchCulling(config, results);
+    BenchBounds(config, results);
+    BenchSphere(config, results);
+    BenchDDS(config, results);
+
+    if (!SaveReport(config, results))
+    {
+        printf("Failed to write %s\n", config.reportPath.c_str());
+        return 1;
+    }
+    printf("Report written to %s\n", config.reportPath.c_str());
+
+    return 0;
+}